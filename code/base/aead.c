@@ -0,0 +1,375 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include "aead.h"
+
+typedef u32 t_chacha_v4u32 __attribute__((vector_size(16)));
+
+#define CHACHA_ROTL(v,n) (((v) << (n)) | ((v) >> (32-(n))))
+
+#define CHACHA_QUARTER_ROUND(a,b,c,d) \
+   a += b; d ^= a; d = CHACHA_ROTL(d,16); \
+   c += d; b ^= c; b = CHACHA_ROTL(b,12); \
+   a += b; d ^= a; d = CHACHA_ROTL(d,8); \
+   c += d; b ^= c; b = CHACHA_ROTL(b,7);
+
+#define CHACHA_DOUBLE_ROUND(x) \
+   CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12]) \
+   CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13]) \
+   CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14]) \
+   CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15]) \
+   CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15]) \
+   CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12]) \
+   CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13]) \
+   CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+
+static u32 _aead_load_le32(const u8* p)
+{
+   return ((u32)p[0]) | (((u32)p[1]) << 8) | (((u32)p[2]) << 16) | (((u32)p[3]) << 24);
+}
+
+static void _aead_store_le32(u8* p, u32 v)
+{
+   p[0] = v & 0xFF;
+   p[1] = (v >> 8) & 0xFF;
+   p[2] = (v >> 16) & 0xFF;
+   p[3] = (v >> 24) & 0xFF;
+}
+
+static void _chacha20_init_state(u32* pState, const u8* pKey, const u8* pNonce, u32 uCounter)
+{
+   pState[0] = 0x61707865;
+   pState[1] = 0x3320646e;
+   pState[2] = 0x79622d32;
+   pState[3] = 0x6b206574;
+   for( int i=0; i<8; i++ )
+      pState[4+i] = _aead_load_le32(pKey + 4*i);
+   pState[12] = uCounter;
+   pState[13] = _aead_load_le32(pNonce);
+   pState[14] = _aead_load_le32(pNonce + 4);
+   pState[15] = _aead_load_le32(pNonce + 8);
+}
+
+// Generates 4 consecutive keystream blocks (256 bytes), starting at block pState[12]
+static void _chacha20_blocks4(const u32* pState, u8* pOutput)
+{
+   t_chacha_v4u32 x[16];
+   t_chacha_v4u32 vInit[16];
+   for( int i=0; i<16; i++ )
+   {
+      t_chacha_v4u32 v = { pState[i], pState[i], pState[i], pState[i] };
+      vInit[i] = v;
+   }
+   t_chacha_v4u32 vCounters = { 0, 1, 2, 3 };
+   vInit[12] += vCounters;
+
+   for( int i=0; i<16; i++ )
+      x[i] = vInit[i];
+   for( int i=0; i<10; i++ )
+   {
+      CHACHA_DOUBLE_ROUND(x)
+   }
+   for( int i=0; i<16; i++ )
+   {
+      x[i] += vInit[i];
+      for( int k=0; k<4; k++ )
+         _aead_store_le32(pOutput + 64*k + 4*i, x[i][k]);
+   }
+}
+
+static void _chacha20_xor_state(u32* pState, const u8* pIn, u8* pOut, int iLength)
+{
+   u8 uKeyStream[256];
+   while ( iLength > 0 )
+   {
+      _chacha20_blocks4(pState, uKeyStream);
+      pState[12] += 4;
+      int iCount = (iLength < 256)?iLength:256;
+      for( int i=0; i<iCount; i++ )
+         pOut[i] = pIn[i] ^ uKeyStream[i];
+      pIn += iCount;
+      pOut += iCount;
+      iLength -= iCount;
+   }
+}
+
+void chacha20_xor(const u8* pKey, const u8* pNonce, u32 uCounter, const u8* pIn, u8* pOut, int iLength)
+{
+   u32 uState[16];
+   _chacha20_init_state(uState, pKey, pNonce, uCounter);
+   _chacha20_xor_state(uState, pIn, pOut, iLength);
+}
+
+void hchacha20(const u8* pKey, const u8* pInput, u8* pOutput)
+{
+   u32 x[16];
+   x[0] = 0x61707865;
+   x[1] = 0x3320646e;
+   x[2] = 0x79622d32;
+   x[3] = 0x6b206574;
+   for( int i=0; i<8; i++ )
+      x[4+i] = _aead_load_le32(pKey + 4*i);
+   for( int i=0; i<4; i++ )
+      x[12+i] = _aead_load_le32(pInput + 4*i);
+   for( int i=0; i<10; i++ )
+   {
+      CHACHA_DOUBLE_ROUND(x)
+   }
+   for( int i=0; i<4; i++ )
+   {
+      _aead_store_le32(pOutput + 4*i, x[i]);
+      _aead_store_le32(pOutput + 16 + 4*i, x[12+i]);
+   }
+}
+
+// Poly1305, 26 bit limbs
+
+typedef struct
+{
+   u32 r[5];
+   u32 h[5];
+   u32 pad[4];
+   u8 uBuffer[16];
+   int iBufferPos;
+} t_poly1305_context;
+
+static void _poly1305_init(t_poly1305_context* pCtx, const u8* pKey)
+{
+   pCtx->r[0] = (_aead_load_le32(pKey)) & 0x3ffffff;
+   pCtx->r[1] = (_aead_load_le32(pKey + 3) >> 2) & 0x3ffff03;
+   pCtx->r[2] = (_aead_load_le32(pKey + 6) >> 4) & 0x3ffc0ff;
+   pCtx->r[3] = (_aead_load_le32(pKey + 9) >> 6) & 0x3f03fff;
+   pCtx->r[4] = (_aead_load_le32(pKey + 12) >> 8) & 0x00fffff;
+   for( int i=0; i<5; i++ )
+      pCtx->h[i] = 0;
+   for( int i=0; i<4; i++ )
+      pCtx->pad[i] = _aead_load_le32(pKey + 16 + 4*i);
+   pCtx->iBufferPos = 0;
+}
+
+static void _poly1305_blocks(t_poly1305_context* pCtx, const u8* pData, int iLength, u32 uHiBit)
+{
+   const u32 r0 = pCtx->r[0], r1 = pCtx->r[1], r2 = pCtx->r[2], r3 = pCtx->r[3], r4 = pCtx->r[4];
+   const u32 s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+   u32 h0 = pCtx->h[0], h1 = pCtx->h[1], h2 = pCtx->h[2], h3 = pCtx->h[3], h4 = pCtx->h[4];
+
+   while ( iLength >= 16 )
+   {
+      h0 += (_aead_load_le32(pData)) & 0x3ffffff;
+      h1 += (_aead_load_le32(pData + 3) >> 2) & 0x3ffffff;
+      h2 += (_aead_load_le32(pData + 6) >> 4) & 0x3ffffff;
+      h3 += (_aead_load_le32(pData + 9) >> 6) & 0x3ffffff;
+      h4 += (_aead_load_le32(pData + 12) >> 8) | uHiBit;
+
+      u64 d0 = ((u64)h0 * r0) + ((u64)h1 * s4) + ((u64)h2 * s3) + ((u64)h3 * s2) + ((u64)h4 * s1);
+      u64 d1 = ((u64)h0 * r1) + ((u64)h1 * r0) + ((u64)h2 * s4) + ((u64)h3 * s3) + ((u64)h4 * s2);
+      u64 d2 = ((u64)h0 * r2) + ((u64)h1 * r1) + ((u64)h2 * r0) + ((u64)h3 * s4) + ((u64)h4 * s3);
+      u64 d3 = ((u64)h0 * r3) + ((u64)h1 * r2) + ((u64)h2 * r1) + ((u64)h3 * r0) + ((u64)h4 * s4);
+      u64 d4 = ((u64)h0 * r4) + ((u64)h1 * r3) + ((u64)h2 * r2) + ((u64)h3 * r1) + ((u64)h4 * r0);
+
+      u32 c = (u32)(d0 >> 26); h0 = (u32)d0 & 0x3ffffff;
+      d1 += c; c = (u32)(d1 >> 26); h1 = (u32)d1 & 0x3ffffff;
+      d2 += c; c = (u32)(d2 >> 26); h2 = (u32)d2 & 0x3ffffff;
+      d3 += c; c = (u32)(d3 >> 26); h3 = (u32)d3 & 0x3ffffff;
+      d4 += c; c = (u32)(d4 >> 26); h4 = (u32)d4 & 0x3ffffff;
+      h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+      h1 += c;
+
+      pData += 16;
+      iLength -= 16;
+   }
+   pCtx->h[0] = h0; pCtx->h[1] = h1; pCtx->h[2] = h2; pCtx->h[3] = h3; pCtx->h[4] = h4;
+}
+
+static void _poly1305_update(t_poly1305_context* pCtx, const u8* pData, int iLength)
+{
+   if ( pCtx->iBufferPos > 0 )
+   {
+      int iCount = 16 - pCtx->iBufferPos;
+      if ( iCount > iLength )
+         iCount = iLength;
+      memcpy(pCtx->uBuffer + pCtx->iBufferPos, pData, iCount);
+      pCtx->iBufferPos += iCount;
+      pData += iCount;
+      iLength -= iCount;
+      if ( pCtx->iBufferPos < 16 )
+         return;
+      _poly1305_blocks(pCtx, pCtx->uBuffer, 16, 1<<24);
+      pCtx->iBufferPos = 0;
+   }
+   int iFull = iLength & ~15;
+   if ( iFull > 0 )
+      _poly1305_blocks(pCtx, pData, iFull, 1<<24);
+   if ( iLength > iFull )
+   {
+      memcpy(pCtx->uBuffer, pData + iFull, iLength - iFull);
+      pCtx->iBufferPos = iLength - iFull;
+   }
+}
+
+// Zero pads the data added so far to a multiple of 16 bytes (AEAD construction)
+static void _poly1305_pad16(t_poly1305_context* pCtx)
+{
+   if ( 0 == pCtx->iBufferPos )
+      return;
+   memset(pCtx->uBuffer + pCtx->iBufferPos, 0, 16 - pCtx->iBufferPos);
+   _poly1305_blocks(pCtx, pCtx->uBuffer, 16, 1<<24);
+   pCtx->iBufferPos = 0;
+}
+
+static void _poly1305_finish(t_poly1305_context* pCtx, u8* pTag)
+{
+   if ( pCtx->iBufferPos > 0 )
+   {
+      pCtx->uBuffer[pCtx->iBufferPos] = 1;
+      memset(pCtx->uBuffer + pCtx->iBufferPos + 1, 0, 16 - pCtx->iBufferPos - 1);
+      _poly1305_blocks(pCtx, pCtx->uBuffer, 16, 0);
+   }
+
+   u32 h0 = pCtx->h[0], h1 = pCtx->h[1], h2 = pCtx->h[2], h3 = pCtx->h[3], h4 = pCtx->h[4];
+   u32 c = h1 >> 26; h1 &= 0x3ffffff;
+   h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+   h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+   h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+   h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+   h1 += c;
+
+   // g = h - p; use g if h >= p
+   u32 g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+   u32 g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+   u32 g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+   u32 g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+   u32 g4 = h4 + c - (1 << 26);
+
+   u32 uMask = (g4 >> 31) - 1;
+   g0 &= uMask; g1 &= uMask; g2 &= uMask; g3 &= uMask; g4 &= uMask;
+   uMask = ~uMask;
+   h0 = (h0 & uMask) | g0;
+   h1 = (h1 & uMask) | g1;
+   h2 = (h2 & uMask) | g2;
+   h3 = (h3 & uMask) | g3;
+   h4 = (h4 & uMask) | g4;
+
+   h0 = (h0 | (h1 << 26));
+   h1 = ((h1 >> 6) | (h2 << 20));
+   h2 = ((h2 >> 12) | (h3 << 14));
+   h3 = ((h3 >> 18) | (h4 << 8));
+
+   u64 f = (u64)h0 + pCtx->pad[0]; h0 = (u32)f;
+   f = (u64)h1 + pCtx->pad[1] + (f >> 32); h1 = (u32)f;
+   f = (u64)h2 + pCtx->pad[2] + (f >> 32); h2 = (u32)f;
+   f = (u64)h3 + pCtx->pad[3] + (f >> 32); h3 = (u32)f;
+
+   _aead_store_le32(pTag, h0);
+   _aead_store_le32(pTag + 4, h1);
+   _aead_store_le32(pTag + 8, h2);
+   _aead_store_le32(pTag + 12, h3);
+   memset(pCtx, 0, sizeof(t_poly1305_context));
+}
+
+void poly1305_mac(const u8* pKey, const u8* pData, int iLength, u8* pTag)
+{
+   t_poly1305_context ctx;
+   _poly1305_init(&ctx, pKey);
+   _poly1305_update(&ctx, pData, iLength);
+   _poly1305_finish(&ctx, pTag);
+}
+
+// Computes the tag over the AAD and the cipher text. The Poly1305 key is the first 32 bytes of block 0.
+static void _aead_compute_tag(const u8* pPolyKey, const u8* pAAD, int iAADLength, const u8* pCipherText, int iLength, u8* pTag)
+{
+   t_poly1305_context ctx;
+   _poly1305_init(&ctx, pPolyKey);
+   if ( iAADLength > 0 )
+      _poly1305_update(&ctx, pAAD, iAADLength);
+   _poly1305_pad16(&ctx);
+   _poly1305_update(&ctx, pCipherText, iLength);
+   _poly1305_pad16(&ctx);
+
+   u8 uLengths[16];
+   _aead_store_le32(uLengths, (u32)iAADLength);
+   _aead_store_le32(uLengths + 4, 0);
+   _aead_store_le32(uLengths + 8, (u32)iLength);
+   _aead_store_le32(uLengths + 12, 0);
+   _poly1305_update(&ctx, uLengths, 16);
+   _poly1305_finish(&ctx, pTag);
+}
+
+// Block 0 gives the Poly1305 key, the following 3 blocks of the same 4 blocks batch encrypt the first 192 bytes
+static void _aead_crypt(u32* pState, u8* pKeyStreamFirst, u8* pData, int iLength)
+{
+   int iCount = (iLength < 192)?iLength:192;
+   for( int i=0; i<iCount; i++ )
+      pData[i] ^= pKeyStreamFirst[64+i];
+   if ( iLength > iCount )
+   {
+      pState[12] = 4;
+      _chacha20_xor_state(pState, pData + iCount, pData + iCount, iLength - iCount);
+   }
+}
+
+void aead_chacha20_poly1305_seal(const u8* pKey, const u8* pNonce, const u8* pAAD, int iAADLength, u8* pData, int iLength, u8* pTag)
+{
+   u32 uState[16];
+   u8 uKeyStream[256];
+   _chacha20_init_state(uState, pKey, pNonce, 0);
+   _chacha20_blocks4(uState, uKeyStream);
+
+   _aead_crypt(uState, uKeyStream, pData, iLength);
+   _aead_compute_tag(uKeyStream, pAAD, iAADLength, pData, iLength, pTag);
+   memset(uKeyStream, 0, sizeof(uKeyStream));
+}
+
+int aead_chacha20_poly1305_open(const u8* pKey, const u8* pNonce, const u8* pAAD, int iAADLength, u8* pData, int iLength, const u8* pTag)
+{
+   u32 uState[16];
+   u8 uKeyStream[256];
+   u8 uTag[AEAD_TAG_SIZE];
+   _chacha20_init_state(uState, pKey, pNonce, 0);
+   _chacha20_blocks4(uState, uKeyStream);
+
+   _aead_compute_tag(uKeyStream, pAAD, iAADLength, pData, iLength, uTag);
+
+   // Constant time compare
+   u8 uDiff = 0;
+   for( int i=0; i<AEAD_TAG_SIZE; i++ )
+      uDiff |= uTag[i] ^ pTag[i];
+   if ( 0 != uDiff )
+   {
+      memset(uKeyStream, 0, sizeof(uKeyStream));
+      return 0;
+   }
+
+   _aead_crypt(uState, uKeyStream, pData, iLength);
+   memset(uKeyStream, 0, sizeof(uKeyStream));
+   return 1;
+}
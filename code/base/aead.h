@@ -0,0 +1,32 @@
+#pragma once
+#include "base.h"
+
+// ChaCha20-Poly1305 authenticated encryption (RFC 8439).
+// ChaCha20 keystream is generated 4 blocks at a time, using the compiler vector extensions
+// (NEON/SSE when available, plain 32 bit operations otherwise).
+
+#define AEAD_KEY_SIZE 32
+#define AEAD_NONCE_SIZE 12
+#define AEAD_TAG_SIZE 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// XORs iLength bytes of pIn with the ChaCha20 keystream starting at block uCounter. pIn and pOut can be the same buffer.
+void chacha20_xor(const u8* pKey, const u8* pNonce, u32 uCounter, const u8* pIn, u8* pOut, int iLength);
+
+// HChaCha20: derives a 32 bytes key from a key and a 16 bytes input
+void hchacha20(const u8* pKey, const u8* pInput, u8* pOutput);
+
+void poly1305_mac(const u8* pKey, const u8* pData, int iLength, u8* pTag);
+
+// Encrypts pData in place and computes the authentication tag over pAAD and the encrypted data
+void aead_chacha20_poly1305_seal(const u8* pKey, const u8* pNonce, const u8* pAAD, int iAADLength, u8* pData, int iLength, u8* pTag);
+
+// Returns 1 and decrypts pData in place if the tag is valid; returns 0 and leaves pData unchanged otherwise
+int aead_chacha20_poly1305_open(const u8* pKey, const u8* pNonce, const u8* pAAD, int iAADLength, u8* pData, int iLength, const u8* pTag);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,257 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "audio_codec.h"
+
+static const int s_iADPCMIndexTable[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static const int s_iADPCMStepTable[89] =
+{
+   7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+   50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+   253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+   1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+   3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+   12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+void audio_adpcm_init(t_audio_adpcm_state* pState)
+{
+   pState->iPredictor = 0;
+   pState->iStepIndex = 0;
+}
+
+int audio_adpcm_get_frame_samples(int iFrameSize)
+{
+   if ( iFrameSize <= AUDIO_ADPCM_FRAME_HEADER_SIZE )
+      return 0;
+   return 1 + (iFrameSize - AUDIO_ADPCM_FRAME_HEADER_SIZE) * 2;
+}
+
+static int _audio_adpcm_clamp_sample(int iValue)
+{
+   if ( iValue > 32767 )
+      return 32767;
+   if ( iValue < -32768 )
+      return -32768;
+   return iValue;
+}
+
+// Updates the state with the nibble and returns the new predicted sample
+static int _audio_adpcm_apply_nibble(t_audio_adpcm_state* pState, int iNibble)
+{
+   int iStep = s_iADPCMStepTable[pState->iStepIndex];
+   int iDiff = iStep >> 3;
+   if ( iNibble & 4 )
+      iDiff += iStep;
+   if ( iNibble & 2 )
+      iDiff += iStep >> 1;
+   if ( iNibble & 1 )
+      iDiff += iStep >> 2;
+   if ( iNibble & 8 )
+      pState->iPredictor = _audio_adpcm_clamp_sample(pState->iPredictor - iDiff);
+   else
+      pState->iPredictor = _audio_adpcm_clamp_sample(pState->iPredictor + iDiff);
+
+   pState->iStepIndex += s_iADPCMIndexTable[iNibble];
+   if ( pState->iStepIndex < 0 )
+      pState->iStepIndex = 0;
+   if ( pState->iStepIndex > 88 )
+      pState->iStepIndex = 88;
+   return pState->iPredictor;
+}
+
+static int _audio_adpcm_encode_sample(t_audio_adpcm_state* pState, int iSample)
+{
+   int iStep = s_iADPCMStepTable[pState->iStepIndex];
+   int iDiff = iSample - pState->iPredictor;
+   int iNibble = 0;
+   if ( iDiff < 0 )
+   {
+      iNibble = 8;
+      iDiff = -iDiff;
+   }
+   if ( iDiff >= iStep )
+   {
+      iNibble |= 4;
+      iDiff -= iStep;
+   }
+   iStep >>= 1;
+   if ( iDiff >= iStep )
+   {
+      iNibble |= 2;
+      iDiff -= iStep;
+   }
+   iStep >>= 1;
+   if ( iDiff >= iStep )
+      iNibble |= 1;
+
+   // Keep the encoder state in sync with what the decoder computes
+   _audio_adpcm_apply_nibble(pState, iNibble);
+   return iNibble;
+}
+
+void audio_adpcm_encode_frame(t_audio_adpcm_state* pState, const short* pSamples, u8* pOutput, int iFrameSize)
+{
+   int iCountSamples = audio_adpcm_get_frame_samples(iFrameSize);
+   if ( (NULL == pState) || (NULL == pSamples) || (NULL == pOutput) || (iCountSamples <= 0) )
+      return;
+
+   // Header: first sample (little endian), step index
+   pState->iPredictor = pSamples[0];
+   pOutput[0] = (u8)(pSamples[0] & 0xFF);
+   pOutput[1] = (u8)((pSamples[0] >> 8) & 0xFF);
+   pOutput[2] = (u8)pState->iStepIndex;
+   pOutput[3] = 0;
+
+   u8* pOut = pOutput + AUDIO_ADPCM_FRAME_HEADER_SIZE;
+   for( int i=1; i<iCountSamples; i += 2 )
+   {
+      int iLow = _audio_adpcm_encode_sample(pState, pSamples[i]);
+      int iHigh = _audio_adpcm_encode_sample(pState, pSamples[i+1]);
+      *pOut = (u8)(iLow | (iHigh << 4));
+      pOut++;
+   }
+}
+
+int audio_adpcm_decode_frame(const u8* pInput, int iFrameSize, short* pSamples)
+{
+   int iCountSamples = audio_adpcm_get_frame_samples(iFrameSize);
+   if ( (NULL == pInput) || (NULL == pSamples) || (iCountSamples <= 0) )
+      return 0;
+   if ( pInput[2] > 88 )
+      return 0;
+
+   t_audio_adpcm_state state;
+   state.iPredictor = (short)(((u16)pInput[0]) | (((u16)pInput[1]) << 8));
+   state.iStepIndex = pInput[2];
+   pSamples[0] = (short)state.iPredictor;
+
+   const u8* pIn = pInput + AUDIO_ADPCM_FRAME_HEADER_SIZE;
+   for( int i=1; i<iCountSamples; i += 2 )
+   {
+      pSamples[i] = (short)_audio_adpcm_apply_nibble(&state, (*pIn) & 0x0F);
+      pSamples[i+1] = (short)_audio_adpcm_apply_nibble(&state, ((*pIn) >> 4) & 0x0F);
+      pIn++;
+   }
+   return iCountSamples;
+}
+
+void audio_stream_parser_init(t_audio_stream_parser* pParser)
+{
+   memset(pParser, 0, sizeof(t_audio_stream_parser));
+   // The capture stream starts with the WAV header of the first segment
+   pParser->iHeaderMatch = 0;
+}
+
+static void _audio_stream_parser_output_byte(t_audio_stream_parser* pParser, u8 uByte, short* pSamples, int* piCountSamples)
+{
+   if ( ! pParser->iHasOddByte )
+   {
+      pParser->uOddByte = uByte;
+      pParser->iHasOddByte = 1;
+      return;
+   }
+   pSamples[*piCountSamples] = (short)(((u16)pParser->uOddByte) | (((u16)uByte) << 8));
+   (*piCountSamples)++;
+   pParser->iHasOddByte = 0;
+}
+
+int audio_stream_parser_add(t_audio_stream_parser* pParser, const u8* pData, int iLength, short* pSamples, int* pbBreakFound)
+{
+   static const char* s_szStamp = AUDIO_STREAM_BREAK_STAMP;
+   static const char* s_szRIFF = "RIFF";
+
+   if ( NULL != pbBreakFound )
+      *pbBreakFound = 0;
+   if ( (NULL == pParser) || (NULL == pData) || (NULL == pSamples) || (iLength <= 0) )
+      return 0;
+
+   int iCountSamples = 0;
+   for( int i=0; i<iLength; i++ )
+   {
+      u8 uByte = pData[i];
+      if ( pParser->iSkipBytes > 0 )
+      {
+         pParser->iSkipBytes--;
+         continue;
+      }
+
+      if ( pParser->iHeaderMatch >= 0 )
+      {
+         if ( uByte == (u8)s_szRIFF[pParser->iHeaderMatch] )
+         {
+            pParser->iHeaderMatch++;
+            if ( 0 == s_szRIFF[pParser->iHeaderMatch] )
+            {
+               pParser->iSkipBytes = AUDIO_STREAM_WAV_HEADER_SIZE - pParser->iHeaderMatch;
+               pParser->iHeaderMatch = -1;
+               pParser->uHeadersSkipped++;
+            }
+            continue;
+         }
+         // Not a WAV header, it's audio data
+         for( int k=0; k<pParser->iHeaderMatch; k++ )
+            _audio_stream_parser_output_byte(pParser, (u8)s_szRIFF[k], pSamples, &iCountSamples);
+         pParser->iHeaderMatch = -1;
+      }
+
+      if ( uByte == (u8)s_szStamp[pParser->iStampMatch] )
+      {
+         pParser->iStampMatch++;
+         if ( 0 == s_szStamp[pParser->iStampMatch] )
+         {
+            // New capture segment: realign the samples and skip its WAV header
+            pParser->iStampMatch = 0;
+            pParser->iHasOddByte = 0;
+            pParser->iHeaderMatch = 0;
+            pParser->uBreaks++;
+            if ( NULL != pbBreakFound )
+               *pbBreakFound = 1;
+         }
+         continue;
+      }
+
+      if ( pParser->iStampMatch > 0 )
+      {
+         for( int k=0; k<pParser->iStampMatch; k++ )
+            _audio_stream_parser_output_byte(pParser, (u8)s_szStamp[k], pSamples, &iCountSamples);
+         pParser->iStampMatch = 0;
+         if ( uByte == (u8)s_szStamp[0] )
+         {
+            pParser->iStampMatch = 1;
+            continue;
+         }
+      }
+      _audio_stream_parser_output_byte(pParser, uByte, pSamples, &iCountSamples);
+   }
+   return iCountSamples;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "base.h"
+
+// Audio stream helpers for the mono S16 audio link:
+// - IMA ADPCM codec, 4 bits per sample. Each frame starts with the first sample and the step index, so a
+//   frame decodes on its own and a lost audio packet does not affect the following ones.
+// - Parser of the raw capture stream (arecord output). It removes the break stamps written between the
+//   capture segments and the WAV header of each segment, and keeps the samples aligned.
+
+#define AUDIO_ADPCM_FRAME_HEADER_SIZE 4
+
+#define AUDIO_STREAM_BREAK_STAMP "0123456789\n"
+#define AUDIO_STREAM_WAV_HEADER_SIZE 44
+// Bytes the parser may hold back between calls (partial break stamp, odd byte)
+#define AUDIO_STREAM_PARSER_MAX_HELD_BYTES 16
+
+typedef struct
+{
+   int iPredictor;
+   int iStepIndex;
+} t_audio_adpcm_state;
+
+typedef struct
+{
+   int iStampMatch; // break stamp bytes matched so far
+   int iHeaderMatch; // "RIFF" bytes matched at the start of a segment, -1 if not at the start of a segment
+   int iSkipBytes; // WAV header bytes left to skip
+   int iHasOddByte;
+   u8 uOddByte;
+   u32 uBreaks;
+   u32 uHeadersSkipped;
+} t_audio_stream_parser;
+
+void audio_adpcm_init(t_audio_adpcm_state* pState);
+// Samples carried by an ADPCM frame of iFrameSize bytes
+int audio_adpcm_get_frame_samples(int iFrameSize);
+// Encodes audio_adpcm_get_frame_samples(iFrameSize) samples into pOutput (iFrameSize bytes)
+void audio_adpcm_encode_frame(t_audio_adpcm_state* pState, const short* pSamples, u8* pOutput, int iFrameSize);
+// Returns the number of samples decoded into pSamples, 0 if the frame is invalid
+int audio_adpcm_decode_frame(const u8* pInput, int iFrameSize, short* pSamples);
+
+void audio_stream_parser_init(t_audio_stream_parser* pParser);
+// Converts raw capture bytes to samples. pSamples must have room for (iLength + AUDIO_STREAM_PARSER_MAX_HELD_BYTES)/2 samples.
+// Returns the number of samples written. pbBreakFound (optional) is set if a segment break was found.
+int audio_stream_parser_add(t_audio_stream_parser* pParser, const u8* pData, int iLength, short* pSamples, int* pbBreakFound);
@@ -0,0 +1,326 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "audio_jitter_buffer.h"
+
+#define AUDIO_JITTER_BUFFER_MASK (AUDIO_JITTER_BUFFER_MAX_SAMPLES-1)
+
+static void _audio_jitter_buffer_update_target(t_audio_jitter_buffer* pBuffer)
+{
+   int iJitterSamples = (int)(((u64)pBuffer->iJitterMicros * (u64)pBuffer->iSampleRate) / 1000000);
+   int iTarget = pBuffer->iFrameSamples + 3 * iJitterSamples;
+   if ( iTarget < pBuffer->iMinTargetSamples )
+      iTarget = pBuffer->iMinTargetSamples;
+   iTarget += pBuffer->iUnderrunBoostSamples;
+   if ( iTarget > pBuffer->iMaxTargetSamples )
+      iTarget = pBuffer->iMaxTargetSamples;
+   pBuffer->iTargetSamples = iTarget;
+}
+
+void audio_jitter_buffer_init(t_audio_jitter_buffer* pBuffer, int iSampleRate, int iFrameSamples, int iTargetLatencyMs, int iMaxLatencyMs)
+{
+   if ( NULL == pBuffer )
+      return;
+   memset(pBuffer, 0, sizeof(t_audio_jitter_buffer));
+   if ( iSampleRate <= 0 )
+      iSampleRate = 44100;
+   if ( iFrameSamples <= 0 )
+      iFrameSamples = iSampleRate / 50;
+   pBuffer->iSampleRate = iSampleRate;
+   pBuffer->iFrameSamples = iFrameSamples;
+   pBuffer->iMinTargetSamples = (int)(((u64)iTargetLatencyMs * (u64)iSampleRate) / 1000);
+   pBuffer->iMaxTargetSamples = (int)(((u64)iMaxLatencyMs * (u64)iSampleRate) / 1000);
+
+   // Room for the max latency plus a frame being received
+   if ( pBuffer->iMaxTargetSamples > AUDIO_JITTER_BUFFER_MAX_SAMPLES - 2*iFrameSamples )
+      pBuffer->iMaxTargetSamples = AUDIO_JITTER_BUFFER_MAX_SAMPLES - 2*iFrameSamples;
+   if ( pBuffer->iMinTargetSamples > pBuffer->iMaxTargetSamples )
+      pBuffer->iMinTargetSamples = pBuffer->iMaxTargetSamples;
+
+   pBuffer->iPLCSegmentSamples = 0;
+   audio_jitter_buffer_reset(pBuffer);
+   log_line("[AudioJitterBuffer] Init: %d Hz, %d samples frames, target latency %d ms, max latency %d ms",
+      iSampleRate, iFrameSamples, iTargetLatencyMs, iMaxLatencyMs);
+}
+
+void audio_jitter_buffer_reset(t_audio_jitter_buffer* pBuffer)
+{
+   if ( NULL == pBuffer )
+      return;
+   pBuffer->iReadPos = 0;
+   pBuffer->iCount = 0;
+   pBuffer->bPlaying = 0;
+   pBuffer->bHasSequence = 0;
+   pBuffer->iDriftCounter = 0;
+   pBuffer->uAvgFillSamples256 = 0;
+   _audio_jitter_buffer_update_target(pBuffer);
+}
+
+static void _audio_jitter_buffer_write_sample(t_audio_jitter_buffer* pBuffer, short sSample)
+{
+   if ( pBuffer->iCount >= AUDIO_JITTER_BUFFER_MAX_SAMPLES )
+   {
+      pBuffer->iReadPos = (pBuffer->iReadPos + 1) & AUDIO_JITTER_BUFFER_MASK;
+      pBuffer->iCount--;
+      pBuffer->uOverflowSamples++;
+   }
+   pBuffer->sSamples[(pBuffer->iReadPos + pBuffer->iCount) & AUDIO_JITTER_BUFFER_MASK] = sSample;
+   pBuffer->iCount++;
+}
+
+static void _audio_jitter_buffer_conceal(t_audio_jitter_buffer* pBuffer, short* pOutput, int iCount)
+{
+   int iFadeSamples = (pBuffer->iSampleRate * AUDIO_JITTER_BUFFER_PLC_FADE_MS) / 1000;
+   for( int i=0; i<iCount; i++ )
+   {
+      if ( (pBuffer->iPLCSegmentSamples <= 0) || (pBuffer->iConcealedSamples >= iFadeSamples) )
+      {
+         pOutput[i] = 0;
+         continue;
+      }
+      int iSample = pBuffer->sPLCSegment[pBuffer->iConcealedSamples % pBuffer->iPLCSegmentSamples];
+      pOutput[i] = (short)((iSample * (iFadeSamples - pBuffer->iConcealedSamples)) / iFadeSamples);
+      pBuffer->iConcealedSamples++;
+   }
+   // Counts the silence too, so the next received audio is faded in
+   if ( 0 == pBuffer->iConcealedSamples )
+      pBuffer->iConcealedSamples = 1;
+   pBuffer->uSamplesConcealed += iCount;
+}
+
+static void _audio_jitter_buffer_update_plc_segment(t_audio_jitter_buffer* pBuffer, const short* pSamples, int iCount)
+{
+   int iSegment = pBuffer->iSampleRate / 100;
+   if ( iSegment > AUDIO_JITTER_BUFFER_MAX_PLC_SAMPLES )
+      iSegment = AUDIO_JITTER_BUFFER_MAX_PLC_SAMPLES;
+
+   if ( iCount >= iSegment )
+   {
+      memcpy(pBuffer->sPLCSegment, pSamples + iCount - iSegment, iSegment * sizeof(short));
+      pBuffer->iPLCSegmentSamples = iSegment;
+      return;
+   }
+   int iKeep = pBuffer->iPLCSegmentSamples;
+   if ( iKeep > iSegment - iCount )
+      iKeep = iSegment - iCount;
+   if ( iKeep > 0 )
+      memmove(pBuffer->sPLCSegment, pBuffer->sPLCSegment + pBuffer->iPLCSegmentSamples - iKeep, iKeep * sizeof(short));
+   else
+      iKeep = 0;
+   memcpy(pBuffer->sPLCSegment + iKeep, pSamples, iCount * sizeof(short));
+   pBuffer->iPLCSegmentSamples = iKeep + iCount;
+}
+
+void audio_jitter_buffer_push(t_audio_jitter_buffer* pBuffer, u32 uSequence, const short* pSamples, int iCount, u32 uTimeNowMicros)
+{
+   if ( (NULL == pBuffer) || (NULL == pSamples) || (iCount <= 0) )
+      return;
+
+   pBuffer->uFramesIn++;
+   if ( pBuffer->bHasSequence )
+   {
+      int iDelta = (int)(uSequence - pBuffer->uNextSequence);
+      if ( iDelta < 0 )
+      {
+         pBuffer->uFramesLate++;
+         return;
+      }
+
+      if ( iDelta > 0 )
+         pBuffer->uFramesLost += iDelta;
+
+      if ( (u64)iDelta * (u64)pBuffer->iFrameSamples > (u64)pBuffer->iMaxTargetSamples )
+      {
+         // Too long gap (link lost, stream restarted): start buffering again
+         log_line("[AudioJitterBuffer] Gap of %d frames in the audio stream, buffer again.", iDelta);
+         audio_jitter_buffer_reset(pBuffer);
+      }
+      else
+      {
+         int iExpectedMicros = (int)(((u64)(uSequence - pBuffer->uLastArrivalSequence) * (u64)pBuffer->iFrameSamples * 1000000) / (u64)pBuffer->iSampleRate);
+         int iD = (int)(uTimeNowMicros - pBuffer->uLastArrivalMicros) - iExpectedMicros;
+         if ( iD < 0 )
+            iD = -iD;
+         if ( iD > 1000000 )
+            iD = 1000000;
+         pBuffer->iJitterMicros += (iD - pBuffer->iJitterMicros) / 16;
+
+         if ( (iDelta > 0) && pBuffer->bPlaying )
+         {
+            short sConcealed[256];
+            int iMissing = iDelta * pBuffer->iFrameSamples;
+            while ( iMissing > 0 )
+            {
+               int iChunk = (iMissing > 256)?256:iMissing;
+               _audio_jitter_buffer_conceal(pBuffer, sConcealed, iChunk);
+               for( int i=0; i<iChunk; i++ )
+                  _audio_jitter_buffer_write_sample(pBuffer, sConcealed[i]);
+               iMissing -= iChunk;
+            }
+         }
+      }
+   }
+   pBuffer->bHasSequence = 1;
+   pBuffer->uNextSequence = uSequence + 1;
+   pBuffer->uLastArrivalSequence = uSequence;
+   pBuffer->uLastArrivalMicros = uTimeNowMicros;
+
+   if ( pBuffer->iConcealedSamples > 0 )
+   {
+      pBuffer->iConcealedSamples = 0;
+      pBuffer->iFadeInSamples = (pBuffer->iSampleRate * AUDIO_JITTER_BUFFER_FADE_IN_MS) / 1000;
+   }
+   int iFadeInTotal = (pBuffer->iSampleRate * AUDIO_JITTER_BUFFER_FADE_IN_MS) / 1000;
+   for( int i=0; i<iCount; i++ )
+   {
+      if ( pBuffer->iFadeInSamples > 0 )
+      {
+         int iSample = (pSamples[i] * (iFadeInTotal - pBuffer->iFadeInSamples)) / iFadeInTotal;
+         _audio_jitter_buffer_write_sample(pBuffer, (short)iSample);
+         pBuffer->iFadeInSamples--;
+      }
+      else
+         _audio_jitter_buffer_write_sample(pBuffer, pSamples[i]);
+   }
+   _audio_jitter_buffer_update_plc_segment(pBuffer, pSamples, iCount);
+   _audio_jitter_buffer_update_target(pBuffer);
+
+   // Too much audio buffered (i.e. after a burst): drop the oldest audio, down to the target
+   if ( pBuffer->iCount > pBuffer->iMaxTargetSamples + pBuffer->iFrameSamples )
+   {
+      int iDrop = pBuffer->iCount - pBuffer->iTargetSamples;
+      pBuffer->iReadPos = (pBuffer->iReadPos + iDrop) & AUDIO_JITTER_BUFFER_MASK;
+      pBuffer->iCount -= iDrop;
+      pBuffer->uOverflowSamples += iDrop;
+   }
+
+   if ( (! pBuffer->bPlaying) && (pBuffer->iCount >= pBuffer->iTargetSamples) )
+   {
+      pBuffer->bPlaying = 1;
+      pBuffer->iDriftCounter = 0;
+      pBuffer->uAvgFillSamples256 = ((u64)pBuffer->iCount) << 8;
+   }
+}
+
+int audio_jitter_buffer_pull(t_audio_jitter_buffer* pBuffer, short* pOutput, int iCount)
+{
+   if ( (NULL == pBuffer) || (NULL == pOutput) || (iCount <= 0) )
+      return 0;
+
+   if ( ! pBuffer->bPlaying )
+   {
+      _audio_jitter_buffer_conceal(pBuffer, pOutput, iCount);
+      return 0;
+   }
+
+   // Smoothed fill, about one second time constant
+   long long lFill256 = ((long long)pBuffer->iCount) << 8;
+   long long lAvg256 = (long long)pBuffer->uAvgFillSamples256;
+   if ( iCount >= pBuffer->iSampleRate )
+      lAvg256 = lFill256;
+   else
+      lAvg256 += ((lFill256 - lAvg256) * iCount) / pBuffer->iSampleRate;
+   pBuffer->uAvgFillSamples256 = (u64)lAvg256;
+
+   int iAvgFill = (int)(lAvg256 >> 8);
+   int iBand = pBuffer->iFrameSamples/2 + (pBuffer->iSampleRate * 5) / 1000;
+   int iDriftMode = 0;
+   if ( iAvgFill > pBuffer->iTargetSamples + iBand )
+      iDriftMode = 1;
+   else if ( iAvgFill < pBuffer->iTargetSamples - iBand )
+      iDriftMode = -1;
+
+   int iOut = 0;
+   while ( (iOut < iCount) && (pBuffer->iCount > 0) )
+   {
+      if ( (1 == iDriftMode) && (pBuffer->iDriftCounter >= AUDIO_JITTER_BUFFER_DRIFT_INTERVAL) && (pBuffer->iCount > 1) )
+      {
+         pBuffer->iReadPos = (pBuffer->iReadPos + 1) & AUDIO_JITTER_BUFFER_MASK;
+         pBuffer->iCount--;
+         pBuffer->iDriftCounter = 0;
+         pBuffer->uSamplesDriftDropped++;
+      }
+      short sSample = pBuffer->sSamples[pBuffer->iReadPos];
+      pOutput[iOut++] = sSample;
+      pBuffer->iDriftCounter++;
+      if ( (-1 == iDriftMode) && (pBuffer->iDriftCounter >= AUDIO_JITTER_BUFFER_DRIFT_INTERVAL) && (iOut < iCount) )
+      {
+         pOutput[iOut++] = sSample;
+         pBuffer->iDriftCounter = 0;
+         pBuffer->uSamplesDriftInserted++;
+      }
+      pBuffer->iReadPos = (pBuffer->iReadPos + 1) & AUDIO_JITTER_BUFFER_MASK;
+      pBuffer->iCount--;
+   }
+   int iReceived = iOut;
+
+   pBuffer->iStableSamples += iReceived;
+   if ( (pBuffer->iStableSamples >= pBuffer->iSampleRate * 5) && (pBuffer->iUnderrunBoostSamples > 0) )
+   {
+      pBuffer->iUnderrunBoostSamples -= pBuffer->iSampleRate / 1000;
+      if ( pBuffer->iUnderrunBoostSamples < 0 )
+         pBuffer->iUnderrunBoostSamples = 0;
+      pBuffer->iStableSamples = 0;
+      _audio_jitter_buffer_update_target(pBuffer);
+   }
+
+   if ( iOut < iCount )
+   {
+      // Underrun: conceal and buffer again, with a higher target
+      pBuffer->bPlaying = 0;
+      pBuffer->uUnderruns++;
+      pBuffer->iStableSamples = 0;
+      pBuffer->iUnderrunBoostSamples += (pBuffer->iSampleRate * AUDIO_JITTER_BUFFER_UNDERRUN_BOOST_MS) / 1000;
+      if ( pBuffer->iUnderrunBoostSamples > pBuffer->iMaxTargetSamples )
+         pBuffer->iUnderrunBoostSamples = pBuffer->iMaxTargetSamples;
+      _audio_jitter_buffer_update_target(pBuffer);
+      _audio_jitter_buffer_conceal(pBuffer, pOutput + iOut, iCount - iOut);
+   }
+   return iReceived;
+}
+
+int audio_jitter_buffer_get_latency_ms(t_audio_jitter_buffer* pBuffer)
+{
+   if ( (NULL == pBuffer) || (pBuffer->iSampleRate <= 0) )
+      return 0;
+   return (pBuffer->iCount * 1000) / pBuffer->iSampleRate;
+}
+
+void audio_jitter_buffer_log_info(t_audio_jitter_buffer* pBuffer)
+{
+   if ( NULL == pBuffer )
+      return;
+   log_line("[AudioJitterBuffer] %s, latency %d ms (target %d ms), jitter %d us; frames: %u in, %u late, %u lost; underruns: %u, concealed: %u samples, drift: %u dropped / %u repeated samples, overflow: %u samples",
+      pBuffer->bPlaying?"playing":"buffering", audio_jitter_buffer_get_latency_ms(pBuffer),
+      (pBuffer->iTargetSamples * 1000) / pBuffer->iSampleRate, pBuffer->iJitterMicros,
+      pBuffer->uFramesIn, pBuffer->uFramesLate, pBuffer->uFramesLost,
+      pBuffer->uUnderruns, pBuffer->uSamplesConcealed, pBuffer->uSamplesDriftDropped, pBuffer->uSamplesDriftInserted, pBuffer->uOverflowSamples);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "base.h"
+
+// Playback buffer for the received audio frames (decoded mono S16 samples).
+// Frames are pushed as they are received, with their sequence number; the output pulls samples at the
+// playback rate. Playback starts once the buffer holds the target latency. The target follows the measured
+// arrival jitter (and grows on underruns) between the configured latency and the max latency.
+// The smoothed fill is kept on the target by dropping or repeating one sample from time to time, which
+// compensates the clock drift between the capture (vehicle) and the playback (controller).
+// Lost frames and underruns are concealed by repeating the last received audio, faded out, then silence;
+// the audio that follows a concealment is faded in.
+
+#define AUDIO_JITTER_BUFFER_MAX_SAMPLES 32768
+#define AUDIO_JITTER_BUFFER_MAX_PLC_SAMPLES 1024
+// One sample is dropped/repeated every that many output samples while the fill is off target
+#define AUDIO_JITTER_BUFFER_DRIFT_INTERVAL 200
+#define AUDIO_JITTER_BUFFER_PLC_FADE_MS 40
+#define AUDIO_JITTER_BUFFER_FADE_IN_MS 3
+#define AUDIO_JITTER_BUFFER_UNDERRUN_BOOST_MS 10
+
+typedef struct
+{
+   short sSamples[AUDIO_JITTER_BUFFER_MAX_SAMPLES];
+   int iReadPos;
+   int iCount;
+
+   int iSampleRate;
+   int iFrameSamples; // nominal samples in a frame, used to conceal lost frames
+   int iMinTargetSamples; // configured latency
+   int iMaxTargetSamples;
+   int iTargetSamples;
+   int iUnderrunBoostSamples;
+   int iStableSamples; // played since the last underrun boost change
+   int bPlaying;
+
+   int bHasSequence;
+   u32 uNextSequence;
+   u32 uLastArrivalSequence;
+   u32 uLastArrivalMicros;
+   int iJitterMicros; // interarrival jitter estimate (RFC 3550 style)
+   u64 uAvgFillSamples256; // smoothed fill, 1/256 samples
+   int iDriftCounter;
+
+   short sPLCSegment[AUDIO_JITTER_BUFFER_MAX_PLC_SAMPLES]; // last received samples
+   int iPLCSegmentSamples;
+   int iConcealedSamples; // in the current loss
+   int iFadeInSamples; // left to fade in
+
+   u32 uFramesIn;
+   u32 uFramesLate;
+   u32 uFramesLost;
+   u32 uUnderruns;
+   u32 uOverflowSamples;
+   u32 uSamplesConcealed;
+   u32 uSamplesDriftDropped;
+   u32 uSamplesDriftInserted;
+} t_audio_jitter_buffer;
+
+void audio_jitter_buffer_init(t_audio_jitter_buffer* pBuffer, int iSampleRate, int iFrameSamples, int iTargetLatencyMs, int iMaxLatencyMs);
+// Drops the buffered audio; playback starts again once the target latency is buffered
+void audio_jitter_buffer_reset(t_audio_jitter_buffer* pBuffer);
+void audio_jitter_buffer_push(t_audio_jitter_buffer* pBuffer, u32 uSequence, const short* pSamples, int iCount, u32 uTimeNowMicros);
+// Always fills iCount samples (concealment or silence when there is no audio to play).
+// Returns the number of received samples in the output.
+int audio_jitter_buffer_pull(t_audio_jitter_buffer* pBuffer, short* pOutput, int iCount);
+int audio_jitter_buffer_get_latency_ms(t_audio_jitter_buffer* pBuffer);
+void audio_jitter_buffer_log_info(t_audio_jitter_buffer* pBuffer);
@@ -0,0 +1,241 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "audio_output.h"
+#include <errno.h>
+#ifdef FEATURE_AUDIO_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+// ALSA device buffer
+#define AUDIO_OUTPUT_ALSA_LATENCY_MICROS 60000
+
+static void _audio_output_write_wav_header(FILE* pFile, int iSampleRate, u32 uDataBytes)
+{
+   u8 uHeader[44];
+   u32 uValue;
+   u16 uValue16;
+   memcpy(uHeader, "RIFF", 4);
+   uValue = 36 + uDataBytes;
+   memcpy(&uHeader[4], &uValue, 4);
+   memcpy(&uHeader[8], "WAVEfmt ", 8);
+   uValue = 16;
+   memcpy(&uHeader[16], &uValue, 4);
+   uValue16 = 1; // PCM
+   memcpy(&uHeader[20], &uValue16, 2);
+   uValue16 = 1; // mono
+   memcpy(&uHeader[22], &uValue16, 2);
+   uValue = (u32)iSampleRate;
+   memcpy(&uHeader[24], &uValue, 4);
+   uValue = (u32)iSampleRate * 2;
+   memcpy(&uHeader[28], &uValue, 4);
+   uValue16 = 2;
+   memcpy(&uHeader[32], &uValue16, 2);
+   uValue16 = 16;
+   memcpy(&uHeader[34], &uValue16, 2);
+   memcpy(&uHeader[36], "data", 4);
+   memcpy(&uHeader[40], &uDataBytes, 4);
+   fseek(pFile, 0, SEEK_SET);
+   fwrite(uHeader, 1, sizeof(uHeader), pFile);
+}
+
+int audio_output_open(t_audio_output* pOutput, int iType, int iSampleRate, const char* szName)
+{
+   if ( NULL == pOutput )
+      return 0;
+   memset(pOutput, 0, sizeof(t_audio_output));
+   pOutput->iType = iType;
+   pOutput->iSampleRate = iSampleRate;
+   pOutput->fPipe = -1;
+   if ( NULL != szName )
+   {
+      strncpy(pOutput->szName, szName, sizeof(pOutput->szName)-1);
+      pOutput->szName[sizeof(pOutput->szName)-1] = 0;
+   }
+
+   if ( AUDIO_OUTPUT_NULL == iType )
+   {
+      log_line("[AudioOutput] Opened null audio output, %d Hz.", iSampleRate);
+      return 1;
+   }
+
+   if ( AUDIO_OUTPUT_WAV_FILE == iType )
+   {
+      pOutput->pFile = fopen(pOutput->szName, "wb");
+      if ( NULL == pOutput->pFile )
+      {
+         log_softerror_and_alarm("[AudioOutput] Failed to create WAV file %s", pOutput->szName);
+         return 0;
+      }
+      _audio_output_write_wav_header(pOutput->pFile, iSampleRate, 0);
+      log_line("[AudioOutput] Opened WAV file audio output %s, %d Hz.", pOutput->szName, iSampleRate);
+      return 1;
+   }
+
+   if ( AUDIO_OUTPUT_PIPE == iType )
+   {
+      // Waits for the player to open the read end
+      pOutput->fPipe = open(pOutput->szName, O_WRONLY);
+      if ( pOutput->fPipe < 0 )
+      {
+         log_softerror_and_alarm("[AudioOutput] Failed to open audio pipe %s", pOutput->szName);
+         pOutput->fPipe = -1;
+         return 0;
+      }
+      if ( fcntl(pOutput->fPipe, F_SETFL, fcntl(pOutput->fPipe, F_GETFL, 0) | O_NONBLOCK) < 0 )
+         log_softerror_and_alarm("[AudioOutput] Failed to set audio pipe in nonblocking mode: %s", strerror(errno));
+      log_line("[AudioOutput] Opened pipe audio output %s, %d Hz.", pOutput->szName, iSampleRate);
+      return 1;
+   }
+
+   if ( AUDIO_OUTPUT_ALSA == iType )
+   {
+      #ifdef FEATURE_AUDIO_ALSA
+      snd_pcm_t* pPCM = NULL;
+      const char* szDevice = (0 != pOutput->szName[0])?pOutput->szName:"default";
+      int iResult = snd_pcm_open(&pPCM, szDevice, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+      if ( iResult < 0 )
+      {
+         log_softerror_and_alarm("[AudioOutput] Failed to open ALSA device %s: %s", szDevice, snd_strerror(iResult));
+         return 0;
+      }
+      iResult = snd_pcm_set_params(pPCM, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 1, (unsigned int)iSampleRate, 1, AUDIO_OUTPUT_ALSA_LATENCY_MICROS);
+      if ( iResult < 0 )
+      {
+         log_softerror_and_alarm("[AudioOutput] Failed to set ALSA device %s params: %s", szDevice, snd_strerror(iResult));
+         snd_pcm_close(pPCM);
+         return 0;
+      }
+      pOutput->pALSAHandle = pPCM;
+      log_line("[AudioOutput] Opened ALSA audio output %s, %d Hz.", szDevice, iSampleRate);
+      return 1;
+      #else
+      log_softerror_and_alarm("[AudioOutput] ALSA audio output is not included in this build.");
+      return 0;
+      #endif
+   }
+
+   log_softerror_and_alarm("[AudioOutput] Invalid audio output type %d", iType);
+   return 0;
+}
+
+void audio_output_close(t_audio_output* pOutput)
+{
+   if ( NULL == pOutput )
+      return;
+   if ( NULL != pOutput->pFile )
+   {
+      _audio_output_write_wav_header(pOutput->pFile, pOutput->iSampleRate, pOutput->uSamplesWritten * 2);
+      fclose(pOutput->pFile);
+   }
+   pOutput->pFile = NULL;
+
+   if ( -1 != pOutput->fPipe )
+      close(pOutput->fPipe);
+   pOutput->fPipe = -1;
+
+   #ifdef FEATURE_AUDIO_ALSA
+   if ( NULL != pOutput->pALSAHandle )
+   {
+      snd_pcm_drop((snd_pcm_t*)pOutput->pALSAHandle);
+      snd_pcm_close((snd_pcm_t*)pOutput->pALSAHandle);
+   }
+   #endif
+   pOutput->pALSAHandle = NULL;
+
+   if ( (pOutput->uSamplesWritten > 0) || (pOutput->uSamplesDropped > 0) )
+      log_line("[AudioOutput] Closed audio output (type %d), %u samples written, %u samples dropped.", pOutput->iType, pOutput->uSamplesWritten, pOutput->uSamplesDropped);
+}
+
+int audio_output_is_open(t_audio_output* pOutput)
+{
+   if ( NULL == pOutput )
+      return 0;
+   if ( AUDIO_OUTPUT_NULL == pOutput->iType )
+      return 1;
+   if ( (NULL != pOutput->pFile) || (-1 != pOutput->fPipe) || (NULL != pOutput->pALSAHandle) )
+      return 1;
+   return 0;
+}
+
+int audio_output_write(t_audio_output* pOutput, const short* pSamples, int iCount)
+{
+   if ( (NULL == pOutput) || (NULL == pSamples) || (iCount <= 0) )
+      return 0;
+
+   int iWritten = 0;
+   if ( AUDIO_OUTPUT_NULL == pOutput->iType )
+      iWritten = iCount;
+   else if ( NULL != pOutput->pFile )
+      iWritten = (int)fwrite(pSamples, sizeof(short), iCount, pOutput->pFile);
+   else if ( -1 != pOutput->fPipe )
+   {
+      // Writes up to PIPE_BUF bytes are atomic, so the samples stay aligned
+      int iResult = write(pOutput->fPipe, pSamples, iCount * sizeof(short));
+      if ( iResult < 0 )
+      {
+         if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) )
+         {
+            log_softerror_and_alarm("[AudioOutput] Failed to write to audio pipe: %s", strerror(errno));
+            return -1;
+         }
+         iResult = 0;
+      }
+      iWritten = iResult / (int)sizeof(short);
+   }
+   #ifdef FEATURE_AUDIO_ALSA
+   else if ( NULL != pOutput->pALSAHandle )
+   {
+      snd_pcm_sframes_t iFrames = snd_pcm_writei((snd_pcm_t*)pOutput->pALSAHandle, pSamples, iCount);
+      if ( iFrames < 0 )
+      {
+         if ( iFrames != -EAGAIN )
+         {
+            // Underrun or suspend: recover, the samples are dropped
+            if ( snd_pcm_recover((snd_pcm_t*)pOutput->pALSAHandle, (int)iFrames, 1) < 0 )
+            {
+               log_softerror_and_alarm("[AudioOutput] Failed to write to ALSA device: %s", snd_strerror((int)iFrames));
+               return -1;
+            }
+         }
+         iFrames = 0;
+      }
+      iWritten = (int)iFrames;
+   }
+   #endif
+   else
+      return -1;
+
+   pOutput->uSamplesWritten += iWritten;
+   if ( iWritten < iCount )
+      pOutput->uSamplesDropped += iCount - iWritten;
+   return iWritten;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "base.h"
+
+// Output of the played audio (mono S16 samples) to a playback backend.
+// The ALSA backend plays in process; it's built only with FEATURE_AUDIO_ALSA (make RUBY_AUDIO_ALSA=1).
+// Writes never block: samples the backend can't take now are dropped and counted.
+
+#define AUDIO_OUTPUT_NULL 0
+#define AUDIO_OUTPUT_WAV_FILE 1
+#define AUDIO_OUTPUT_PIPE 2 // raw samples to a fifo (i.e. read by aplay)
+#define AUDIO_OUTPUT_ALSA 3
+
+typedef struct
+{
+   int iType;
+   int iSampleRate;
+   int fPipe;
+   FILE* pFile;
+   void* pALSAHandle;
+   u32 uSamplesWritten;
+   u32 uSamplesDropped;
+   char szName[128];
+} t_audio_output;
+
+// szName: file name for the WAV file, fifo name for the pipe, device name for ALSA (NULL: default device)
+// Returns 1 on success, 0 on failure.
+int audio_output_open(t_audio_output* pOutput, int iType, int iSampleRate, const char* szName);
+void audio_output_close(t_audio_output* pOutput);
+int audio_output_is_open(t_audio_output* pOutput);
+// Returns the number of samples taken by the backend, -1 on error
+int audio_output_write(t_audio_output* pOutput, const short* pSamples, int iCount);
@@ -170,6 +170,20 @@ u32 base_compute_crc32(u8 *buf, int length)
    return crc ^ ~0U;
 } 
 
+// Continues a CRC32 computed over the previous data (use 0 to start a new one):
+// base_compute_crc32_continue(base_compute_crc32(A), B) == base_compute_crc32(A+B)
+u32 base_compute_crc32_continue(u32 uPrevCrc, u8* buf, int length)
+{
+   u8* p = buf;
+   u32 crc = uPrevCrc ^ ~0U;
+
+   while (length-- > 0)
+   {
+      crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+   }
+   return crc ^ ~0U;
+}
+
 u8 base_compute_crc8(u8* pBuffer, int iLength)
 {
    u8 uCrc = 0xFF;
@@ -18,6 +18,7 @@
 #include "config_hw.h"
 
 
+typedef unsigned long long u64;
 typedef unsigned int u32;
 typedef unsigned short u16;
 typedef unsigned char u8;
@@ -32,7 +33,7 @@ typedef u32 __le32;
 // dword[3...0]: BB.BB.MM.mm  (BB.BB: build number (highest bytes), MM: major ver, mm: minor ver (lowest byte)) 
 #define SYSTEM_SW_VERSION_MAJOR 10
 #define SYSTEM_SW_VERSION_MINOR 10
-#define SYSTEM_SW_BUILD_NUMBER  254
+#define SYSTEM_SW_BUILD_NUMBER  255
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 #define le16_to_cpu(x) (x)
@@ -74,6 +75,7 @@ u32 revert_word(u32 input);
 void reset_counters(type_u32_couters* pCounters);
 
 u32 base_compute_crc32(u8 *buf, int length);
+u32 base_compute_crc32_continue(u32 uPrevCrc, u8* buf, int length);
 u8 base_compute_crc8(u8* pBuffer, int iLength);
 int base_check_crc32(u8* pBuffer, int iLength);
 
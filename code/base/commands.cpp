@@ -99,6 +99,7 @@ const char* commands_get_description(u8 command_type)
       case COMMAND_ID_SET_RC_CAMERA_PARAMS: strcpy(szCommandDesc, "Set_Camera_RC_Params"); break;
       case COMMAND_ID_ENABLE_LIVE_LOG: strcpy(szCommandDesc, "Enable_Live_Log"); break;
       case COMMAND_ID_UPLOAD_SW_TO_VEHICLE63: strcpy(szCommandDesc, "Upload_SW_To_Vehicle_2"); break;
+      case COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED: strcpy(szCommandDesc, "Upload_SW_To_Vehicle_Windowed"); break;
       case COMMAND_ID_UPLOAD_FILE_SEGMENT: strcpy(szCommandDesc, "Upload_File_Segment"); break;
       case COMMAND_ID_SET_RXTX_SYNC_TYPE: strcpy(szCommandDesc, "Set_RxTx_Sync_Type"); break;
       case COMMAND_ID_RESET_CPU_SPEED: strcpy(szCommandDesc, "Reset_CPU_Speed"); break;
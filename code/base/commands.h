@@ -248,6 +248,47 @@ typedef struct
    int block_length; // total_size and block_length are zero to cancel an upload
 } __attribute__((packed)) command_packet_sw_package;
 
+// Windowed software upload (see common/sw_upload.h): the controller streams the archive segments and
+// the FEC segments without waiting; some of them request a selective ack (the command response data).
+// The segments are one way commands, so vehicles that don't know it never answer. The controller uses it only
+// for vehicles with a software build of at least SW_UPLOAD_WINDOWED_MIN_SW_BUILD and uses COMMAND_ID_UPLOAD_SW_TO_VEHICLE63
+// for the older ones; if no ack comes in the first 4 seconds it also falls back to COMMAND_ID_UPLOAD_SW_TO_VEHICLE63.
+#define COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED 214
+
+#define SW_UPLOAD_FLAG_ACK_REQUEST ((u8)0x01)
+#define SW_UPLOAD_FLAG_CANCEL ((u8)0x02)
+
+typedef struct
+{
+   u32 uUploadId; // CRC32 of the entire archive, identifies the upload to resume
+   u32 uTotalSize;
+   u32 uSegmentIndex; // data segments are [0, segments count), then the FEC segments of each FEC group
+   u32 uAckRequestId; // echoed in the ack, when SW_UPLOAD_FLAG_ACK_REQUEST is set
+   u16 uSegmentSize; // all data segments and FEC segments have this size, except the last data segment
+   u16 uDataLength; // data after this header
+   u8 uFECData; // data segments in a FEC group, 0 for no FEC
+   u8 uFECParity; // FEC segments for each FEC group
+   u8 uFlags; // SW_UPLOAD_FLAG_*
+   u8 uType; // 0: update zip, 1: generated tar file from controller
+} __attribute__((packed)) command_packet_sw_upload_segment;
+
+#define SW_UPLOAD_STATUS_IN_PROGRESS 0
+#define SW_UPLOAD_STATUS_COMPLETED 1 // all the data received and the archive CRC matches the upload id
+#define SW_UPLOAD_STATUS_FAILED 2
+#define SW_UPLOAD_STATUS_FAILED_DISK_SPACE 3
+#define SW_UPLOAD_ACK_BITMAP_BYTES 64
+
+// The command response data to an ack request
+typedef struct
+{
+   u32 uUploadId;
+   u32 uAckRequestId;
+   u32 uSegmentsReceived; // data segments received or recovered using FEC
+   u32 uContiguousSegments; // all data segments before this one are received (and stored to disk)
+   u8 uStatus; // SW_UPLOAD_STATUS_*
+   u8 uBitmap[SW_UPLOAD_ACK_BITMAP_BYTES]; // bit k: data segment uContiguousSegments + 1 + k is received
+} __attribute__((packed)) t_sw_upload_ack;
+
 
 #define COMMAND_ID_DOWNLOAD_FILE 211 // has as param the ID of the file to download (high bit: request just status); has a response info about the file: t_packet_header_download_file_info
 
@@ -137,6 +137,9 @@
 #define RAW_TELEMETRY_MAX_BUFFER 512  // bytes
 #define RAW_TELEMETRY_SEND_TIMEOUT 200 // miliseconds. how much to wait until to send whatever is in a telemetry serial buffer to the radio
 #define RAW_TELEMETRY_MIN_SEND_LENGTH 255 // minimum data length to send right away to radio
+// MAVLink raw telemetry scheduler rate limits, in bytes/second (0 for no limit)
+#define DEFAULT_TELEMETRY_RATE_LIMIT_NORMAL 2500
+#define DEFAULT_TELEMETRY_RATE_LIMIT_BULK 2000
 
 #define AUXILIARY_DATA_LINK_SEND_TIMEOUT 100 // miliseconds. how much to wait until to send whatever is in a data link serial buffer to the radio
 #define AUXILIARY_DATA_LINK_MIN_SEND_LENGTH 255 // minimum data length to send right away to radio
@@ -40,10 +40,12 @@
 #define FILE_CONFIG_CURRENT_VEHICLE_COUNT "current_vehicle_count.cfg"
 #define FILE_CONFIG_CURRENT_SEARCH_BAND "current_search_band.cfg"
 #define FILE_CONFIG_CURRENT_RADIO_HW_CONFIG "current_radios.cfg"
+#define FILE_CONFIG_RADIO_EMULATOR "radio_emulator.cfg"
 #define FILE_CONFIG_HARDWARE_I2C_DEVICES "i2c_devices_settings.cfg"
 #define FILE_CONFIG_ENCRYPTION_PASS "current_pph.cfg"
 #define FILE_CONFIG_HW_SERIAL_PORTS "hw_serial.cfg"
 #define FILE_CONFIG_MODELS_CONNECT_FREQUENCIES "models_connect_freq.cfg"
+#define FILE_CONFIG_MODELS_INDEX "models_index.cfg"
 #define FILE_CONFIG_LAST_SIK_RADIOS_DETECTED "last_sik_radios_detected.cfg"
 #define FILE_CONFIG_BOOT_TIMESTAMP "boot_timestamp.cfg"
 #define FILE_CONFIG_BOOT_COUNT "boot_count.cfg"
@@ -73,6 +73,11 @@
 #define DEFAULT_LQ_VIDEO_DATA_LENGTH 1150
 
 #define MAX_BUFFERED_AUDIO_PACKETS 32
+#define AUDIO_SAMPLE_RATE 44100
+#define DEFAULT_AUDIO_OUTPUT_LATENCY_MS 80
+#define MAX_AUDIO_OUTPUT_LATENCY_MS 500
+// Audio params flags (byte 2): audio packets carry IMA ADPCM frames instead of raw PCM
+#define AUDIO_FLAGS_CODEC_ADPCM (((u32)0x01)<<16)
 
 #define MAX_BLOCKS_TO_OUTPUT_IF_AVAILABLE 20
 
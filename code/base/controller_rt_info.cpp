@@ -229,6 +229,7 @@ int controller_rt_info_check_advance_index(controller_runtime_info* pRTInfo, u32
       pRTInfo->vehicles[i].uCountAckRetransmissions[iIndex] = 0;
    }
    pRTInfo->uOutputedVideoPackets[iIndex] = 0;
+   pRTInfo->uOutputedVideoBlocks[iIndex] = 0;
    pRTInfo->uOutputedVideoPacketsRetransmitted[iIndex] = 0;
    pRTInfo->uOutputedVideoPacketsSingleECUsed[iIndex] = 0;
    pRTInfo->uOutputedVideoPacketsTwoECUsed[iIndex] = 0;
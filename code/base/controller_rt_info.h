@@ -68,6 +68,7 @@ typedef struct
    u8 uRecvEndOfFrame[SYSTEM_RT_INFO_INTERVALS];
    
    u8 uOutputedVideoPackets[SYSTEM_RT_INFO_INTERVALS];
+   u8 uOutputedVideoBlocks[SYSTEM_RT_INFO_INTERVALS];
    u8 uOutputedVideoPacketsRetransmitted[SYSTEM_RT_INFO_INTERVALS];
    u8 uOutputedVideoPacketsSingleECUsed[SYSTEM_RT_INFO_INTERVALS];
    u8 uOutputedVideoPacketsTwoECUsed[SYSTEM_RT_INFO_INTERVALS];
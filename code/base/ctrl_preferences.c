@@ -99,6 +99,7 @@ void reset_Preferences()
    s_Preferences.iDebugShowVehicleVideoStats = 0;
    s_Preferences.iDebugShowVehicleVideoGraphs = 0;
    s_Preferences.iDebugShowVideoSnapshotOnDiscard = 0;
+   s_Preferences.iDebugShowRouterProfiler = 0;
    s_Preferences.iDebugWiFiChangeDelay = DEFAULT_DELAY_WIFI_CHANGE;
 
    s_Preferences.iAutoExportSettings = 0;
@@ -185,6 +186,7 @@ int save_Preferences()
    fprintf(fd, "%d %d %d\n", s_Preferences.iShowOnlyPresentTxPowerCards, s_Preferences.iShowTxBoosters, s_Preferences.iMenuStyle);
    fprintf(fd, "%d %u\n", s_Preferences.iDebugStatsQAButton, s_Preferences.uDebugStatsFlags);
    fprintf(fd, "%d\n", s_Preferences.iStopRecordingAfterLinkLostSeconds);
+   fprintf(fd, "%d\n", s_Preferences.iDebugShowRouterProfiler);
    fclose(fd);
    log_line("Saved preferences to file: %s", szFile);
    return 1;
@@ -373,6 +375,12 @@ int load_Preferences()
       bOk = 0;
    }
 
+   if ( bOk && 1 != fscanf(fd, "%d", &s_Preferences.iDebugShowRouterProfiler) )
+   {
+      s_Preferences.iDebugShowRouterProfiler = 0;
+      bOk = 0;
+   }
+
    // ----------------------------------------------------
    // End reading file;
    // Validate settings
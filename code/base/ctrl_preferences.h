@@ -111,6 +111,7 @@ typedef struct
    int iDebugShowVehicleVideoStats;
    int iDebugShowVehicleVideoGraphs;
    int iDebugShowVideoSnapshotOnDiscard;
+   int iDebugShowRouterProfiler;
    int iDebugWiFiChangeDelay; // 1...100 milisec
    int iPersistentMessages;
    int nLogLevel; // 0 - all, 1 - errors
@@ -32,14 +32,114 @@
 #include "base.h"
 #include "config.h"
 #include "encr.h"
+#include "aead.h"
 #include "../radio/radiopackets2.h"
+#include <fcntl.h>
+#include <pthread.h>
 
 #define ENC_BLOCK_SIZE 8
 #define ENC_KEY_INIT_SEED 23
 
+#define ENC_KEY_DERIVATION_ROUNDS 4096
+#define ENC_REPLAY_SESSIONS 32
+#define ENC_REPLAY_WINDOW 1024
+
 u8 s_epp[MAX_PASS_LENGTH+1];
 u8 s_eppl = 0;
 
+// Link key, derived from the pass phrase
+u8 s_uEncLinkKey[AEAD_KEY_SIZE];
+int s_iEncLinkKeyValid = 0;
+
+// Nonce of sent packets: random session id (per process) and packet counter
+u32 s_uEncSessionId = 0;
+u32 s_uEncPacketCounter = 0;
+
+// Replay detection: for each recent sender session, on each receiving interface and stream,
+// the highest packet counter received and a ring bitmap of the received counters before it.
+// The packet counter is shared by all the streams and radio links of the sender, so the window
+// must cover the packets sent on the other streams and links while a packet is delayed.
+// Accessed from the radio rx thread and from the main loop, so it's protected by a mutex.
+typedef struct
+{
+   u32 uSessionId;
+   int iInterfaceIndex;
+   u32 uStreamIndex;
+   u32 uHighestCounter;
+   u64 uWindow[ENC_REPLAY_WINDOW/64];
+   u32 uLastUseIndex;
+} t_enc_replay_session;
+
+static pthread_mutex_t s_EncReplayMutex = PTHREAD_MUTEX_INITIALIZER;
+t_enc_replay_session s_EncReplaySessions[ENC_REPLAY_SESSIONS];
+u32 s_uEncReplayUseIndex = 0;
+
+static u32 _enc_random_u32()
+{
+   u32 uValue = 0;
+   int fd = open("/dev/urandom", O_RDONLY);
+   if ( fd >= 0 )
+   {
+      if ( sizeof(uValue) != read(fd, &uValue, sizeof(uValue)) )
+         uValue = 0;
+      close(fd);
+   }
+   if ( 0 == uValue )
+      uValue = (((u32)rand()) << 16) ^ ((u32)rand()) ^ get_current_timestamp_micros();
+   if ( 0 == uValue )
+      uValue = 1;
+   return uValue;
+}
+
+static void _enc_store_le32(u8* p, u32 v)
+{
+   p[0] = v & 0xFF;
+   p[1] = (v >> 8) & 0xFF;
+   p[2] = (v >> 16) & 0xFF;
+   p[3] = (v >> 24) & 0xFF;
+}
+
+static u32 _enc_load_le32(const u8* p)
+{
+   return ((u32)p[0]) | (((u32)p[1]) << 8) | (((u32)p[2]) << 16) | (((u32)p[3]) << 24);
+}
+
+// Link key = iterated HChaCha20 over the pass phrase, so that trying pass phrases is slow
+static void _enc_derive_link_key()
+{
+   u8 uMaterial[2*AEAD_KEY_SIZE];
+   u8 uInput[16];
+   u8 uKey[AEAD_KEY_SIZE];
+   u8 uNextKey[AEAD_KEY_SIZE];
+
+   memset(uMaterial, 0, sizeof(uMaterial));
+   memcpy(uMaterial, s_epp, (s_eppl < sizeof(uMaterial))?s_eppl:sizeof(uMaterial));
+   memcpy(uInput, "ruby-link-key-v1", 16);
+   uInput[15] = s_eppl;
+   hchacha20(uMaterial, uInput, uKey);
+   for( int i=0; i<AEAD_KEY_SIZE; i++ )
+      uKey[i] ^= uMaterial[AEAD_KEY_SIZE + i];
+
+   for( int i=0; i<ENC_KEY_DERIVATION_ROUNDS; i++ )
+   {
+      _enc_store_le32(uInput + 12, (u32)i);
+      hchacha20(uKey, uInput, uNextKey);
+      memcpy(uKey, uNextKey, AEAD_KEY_SIZE);
+   }
+   memcpy(s_uEncLinkKey, uKey, AEAD_KEY_SIZE);
+   memset(uKey, 0, sizeof(uKey));
+   memset(uNextKey, 0, sizeof(uNextKey));
+   memset(uMaterial, 0, sizeof(uMaterial));
+
+   s_iEncLinkKeyValid = 1;
+   s_uEncSessionId = _enc_random_u32();
+   s_uEncPacketCounter = 0;
+   pthread_mutex_lock(&s_EncReplayMutex);
+   memset(s_EncReplaySessions, 0, sizeof(s_EncReplaySessions));
+   s_uEncReplayUseIndex = 0;
+   pthread_mutex_unlock(&s_EncReplayMutex);
+}
+
 int lpp(char* szOutputBuffer, int maxLength)
 {
    char szFile[128];
@@ -87,9 +187,10 @@ int lpp(char* szOutputBuffer, int maxLength)
       return 0;
 
    szBuffer[pos] = 0;
-   s_eppl = pos;
+   s_eppl = (pos < MAX_PASS_LENGTH)?pos:MAX_PASS_LENGTH;
    strncpy((char*)s_epp, szBuffer, MAX_PASS_LENGTH);
    s_epp[MAX_PASS_LENGTH] = 0;
+   _enc_derive_link_key();
 
    if ( NULL != szOutputBuffer )
       strncpy(szOutputBuffer, szBuffer, maxLength);
@@ -109,9 +210,10 @@ int spp(char* szBuffer)
    if ( NULL == fd )
       return 0;
 
-   s_eppl = strlen(szBuffer);
+   s_eppl = (strlen(szBuffer) < MAX_PASS_LENGTH)?strlen(szBuffer):MAX_PASS_LENGTH;
    strncpy((char*)s_epp, szBuffer, MAX_PASS_LENGTH);
    s_epp[MAX_PASS_LENGTH] = 0;
+   _enc_derive_link_key();
 
    u8 sBlockSeed[ENC_BLOCK_SIZE];
    u8 sBlockInput[ENC_BLOCK_SIZE];
@@ -160,10 +262,23 @@ int spp(char* szBuffer)
    return 1;
 }
 
+int upp(const char* szBuffer)
+{
+   if ( NULL == szBuffer || 0 == szBuffer[0] )
+      return 0;
+   s_eppl = (strlen(szBuffer) < MAX_PASS_LENGTH)?strlen(szBuffer):MAX_PASS_LENGTH;
+   strncpy((char*)s_epp, szBuffer, MAX_PASS_LENGTH);
+   s_epp[MAX_PASS_LENGTH] = 0;
+   _enc_derive_link_key();
+   return 1;
+}
+
 void rpp()
 {
    s_eppl = 0;
    s_epp[0] = 0;
+   memset(s_uEncLinkKey, 0, sizeof(s_uEncLinkKey));
+   s_iEncLinkKeyValid = 0;
 }
 
 u8* gpp(int* pLen)
@@ -180,34 +295,133 @@ int hpp()
    return 0;
 }
 
-int epp(u8* pData, int len)
+static void _enc_build_nonce(u8* pNonce, u32 uNonceSeed, const u8* pTrailer)
 {
-   if ( NULL == pData || len <= 0 )
+   _enc_store_le32(pNonce, uNonceSeed);
+   memcpy(pNonce + 4, pTrailer, 8);
+}
+
+int epp(u8* pPacket, int iClearLength, int iLength, u32 uNonceSeed)
+{
+   if ( (NULL == pPacket) || (iClearLength < 0) || (iLength < iClearLength) )
+      return 0;
+   if ( ! s_iEncLinkKeyValid )
       return 0;
-   if ( 0 == s_eppl )
-      return 1;
 
-   for(int pos=0; pos < len; pos++ )
+   u32 uCounter = __sync_add_and_fetch(&s_uEncPacketCounter, 1);
+   // Counter wrapped around: new session, so that nonces are never reused
+   if ( 0 == uCounter )
    {
-      //*pData = (*pData)+1;
-      *pData = (*pData) ^ s_epp[pos%s_eppl];
-      pData++;
+      s_uEncSessionId = _enc_random_u32();
+      uCounter = __sync_add_and_fetch(&s_uEncPacketCounter, 1);
    }
+
+   u8* pTrailer = pPacket + iLength;
+   u8 uNonce[AEAD_NONCE_SIZE];
+   _enc_store_le32(pTrailer, s_uEncSessionId);
+   _enc_store_le32(pTrailer + 4, uCounter);
+   _enc_build_nonce(uNonce, uNonceSeed, pTrailer);
+   aead_chacha20_poly1305_seal(s_uEncLinkKey, uNonce, pPacket, iClearLength, pPacket + iClearLength, iLength - iClearLength, pTrailer + 8);
    return 1;
 }
 
-int dpp(u8* pData, int len)
+static t_enc_replay_session* _enc_find_replay_session(u32 uSessionId, int iInterfaceIndex, u32 uStreamIndex)
+{
+   for( int i=0; i<ENC_REPLAY_SESSIONS; i++ )
+   {
+      if ( (s_EncReplaySessions[i].uSessionId == uSessionId) &&
+           (s_EncReplaySessions[i].iInterfaceIndex == iInterfaceIndex) &&
+           (s_EncReplaySessions[i].uStreamIndex == uStreamIndex) &&
+           (0 != s_EncReplaySessions[i].uLastUseIndex) )
+         return &s_EncReplaySessions[i];
+   }
+   return NULL;
+}
+
+static int _enc_is_replayed(t_enc_replay_session* pSession, u32 uCounter)
 {
-   if ( NULL == pData || len <= 0 )
+   if ( NULL == pSession )
+      return 0;
+   if ( uCounter > pSession->uHighestCounter )
       return 0;
-   if ( 0 == s_eppl )
+   if ( pSession->uHighestCounter - uCounter >= ENC_REPLAY_WINDOW )
       return 1;
+   u32 uBit = uCounter % ENC_REPLAY_WINDOW;
+   return (pSession->uWindow[uBit/64] & (((u64)1) << (uBit%64)))?1:0;
+}
 
-   for(int pos=0; pos < len; pos++ )
+static void _enc_mark_received(t_enc_replay_session* pSession, u32 uSessionId, int iInterfaceIndex, u32 uStreamIndex, u32 uCounter)
+{
+   if ( NULL == pSession )
    {
-      //*pData = (*pData)-1;
-      *pData = (*pData) ^ s_epp[pos%s_eppl];
-      pData++;
+      // Replace the least recently used session
+      pSession = &s_EncReplaySessions[0];
+      for( int i=1; i<ENC_REPLAY_SESSIONS; i++ )
+      {
+         if ( s_EncReplaySessions[i].uLastUseIndex < pSession->uLastUseIndex )
+            pSession = &s_EncReplaySessions[i];
+      }
+      memset(pSession, 0, sizeof(t_enc_replay_session));
+      pSession->uSessionId = uSessionId;
+      pSession->iInterfaceIndex = iInterfaceIndex;
+      pSession->uStreamIndex = uStreamIndex;
+      pSession->uHighestCounter = uCounter;
    }
-   return 1;
+   else if ( uCounter > pSession->uHighestCounter )
+   {
+      // Clear the bits of the counters that are now out of the window
+      if ( uCounter - pSession->uHighestCounter >= ENC_REPLAY_WINDOW )
+         memset(pSession->uWindow, 0, sizeof(pSession->uWindow));
+      else
+      {
+         for( u32 u=pSession->uHighestCounter+1; u<uCounter; u++ )
+         {
+            u32 uBit = u % ENC_REPLAY_WINDOW;
+            pSession->uWindow[uBit/64] &= ~(((u64)1) << (uBit%64));
+         }
+      }
+      pSession->uHighestCounter = uCounter;
+   }
+
+   u32 uBit = uCounter % ENC_REPLAY_WINDOW;
+   pSession->uWindow[uBit/64] |= ((u64)1) << (uBit%64);
+
+   s_uEncReplayUseIndex++;
+   pSession->uLastUseIndex = s_uEncReplayUseIndex;
+}
+
+int dpp(u8* pPacket, int iClearLength, int iLength, u32 uNonceSeed, int iInterfaceIndex)
+{
+   if ( (NULL == pPacket) || (iClearLength < 0) || (iLength < iClearLength + ENC_PACKET_TRAILER_SIZE) )
+      return 0;
+   if ( ! s_iEncLinkKeyValid )
+      return 0;
+
+   int iDataLength = iLength - ENC_PACKET_TRAILER_SIZE;
+   u8* pTrailer = pPacket + iDataLength;
+   u32 uSessionId = _enc_load_le32(pTrailer);
+   u32 uCounter = _enc_load_le32(pTrailer + 4);
+   u32 uStreamIndex = (uNonceSeed & PACKET_FLAGS_MASK_STREAM_INDEX) >> PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
+   if ( 0 == uCounter )
+      return 0;
+
+   pthread_mutex_lock(&s_EncReplayMutex);
+   int iReplayed = _enc_is_replayed(_enc_find_replay_session(uSessionId, iInterfaceIndex, uStreamIndex), uCounter);
+   pthread_mutex_unlock(&s_EncReplayMutex);
+   if ( iReplayed )
+      return 0;
+
+   u8 uNonce[AEAD_NONCE_SIZE];
+   _enc_build_nonce(uNonce, uNonceSeed, pTrailer);
+   if ( ! aead_chacha20_poly1305_open(s_uEncLinkKey, uNonce, pPacket, iClearLength, pPacket + iClearLength, iDataLength - iClearLength, pTrailer + 8) )
+      return 0;
+
+   // Check again, the same packet could have been accepted meanwhile by another thread
+   pthread_mutex_lock(&s_EncReplayMutex);
+   t_enc_replay_session* pSession = _enc_find_replay_session(uSessionId, iInterfaceIndex, uStreamIndex);
+   iReplayed = _enc_is_replayed(pSession, uCounter);
+   if ( ! iReplayed )
+      _enc_mark_received(pSession, uSessionId, iInterfaceIndex, uStreamIndex, uCounter);
+   pthread_mutex_unlock(&s_EncReplayMutex);
+   return iReplayed?0:1;
 }
@@ -6,6 +6,9 @@
 
 #define MAX_PASS_LENGTH 64
 
+// Added after each encrypted packet: sender session id (4 bytes), packet counter (4 bytes), authentication tag (16 bytes)
+#define ENC_PACKET_TRAILER_SIZE 24
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,12 +18,21 @@ extern "C" {
 int lpp(char* szOutputBuffer, int maxLength);
 int spp(char* szBuffer);
 
+// Uses a pass phrase without saving it
+int upp(const char* szBuffer);
+
 void rpp();
 u8* gpp(int* pLen);
 int hpp();
 
-int epp(u8* pData, int len);
-int dpp(u8* pData, int len);
+// Authenticated encryption (ChaCha20-Poly1305) of a packet, in place. The first iClearLength bytes
+// are only authenticated, the rest is encrypted. uNonceSeed is part of the nonce (i.e. the stream packet index).
+// epp appends ENC_PACKET_TRAILER_SIZE bytes after the iLength bytes of the packet.
+// dpp gets the packet length including the trailer and rejects forged, corrupted and replayed packets.
+// Replays are tracked separately for each receiving interface (iInterfaceIndex) and stream.
+// Both return 1 on success, 0 on failure (or if no pass phrase is loaded).
+int epp(u8* pPacket, int iClearLength, int iLength, u32 uNonceSeed);
+int dpp(u8* pPacket, int iClearLength, int iLength, u32 uNonceSeed, int iInterfaceIndex);
 
 #ifdef __cplusplus
 }  
@@ -18,6 +18,7 @@
 #define TELEMETRY_FLAGS_ALLOW_ANY_VEHICLE_SYSID ((u32)(((u32)0x01)<<12))
 #define TELEMETRY_FLAGS_REMOVE_DUPLICATE_FC_MESSAGES ((u32)(((u32)0x01)<<13))
 #define TELEMETRY_FLAGS_DONT_SHOW_FC_MESSAGES ((u32)(((u32)0x01)<<14))
+#define TELEMETRY_FLAGS_DISABLE_DELTA_ENCODING ((u32)(((u32)0x01)<<15))
 
 
 // First 5 bits are model type
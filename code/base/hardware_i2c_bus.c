@@ -0,0 +1,176 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "hardware_i2c_bus.h"
+
+static t_i2c_bus_mock_handler s_pI2CBusMockHandler = NULL;
+
+void hardware_i2c_bus_set_mock_handler(t_i2c_bus_mock_handler pHandler)
+{
+   s_pI2CBusMockHandler = pHandler;
+   if ( NULL != pHandler )
+      log_line("[I2CBus] Using mock I2C bus.");
+}
+
+int hardware_i2c_bus_is_mock()
+{
+   return (NULL != s_pI2CBusMockHandler)?1:0;
+}
+
+int hardware_i2c_bus_open(int iBusNumber)
+{
+   if ( NULL != s_pI2CBusMockHandler )
+      return 0;
+
+   char szDevice[32];
+   sprintf(szDevice, "/dev/i2c-%d", iBusNumber);
+   int iFD = open(szDevice, O_RDWR);
+   if ( iFD < 0 )
+      log_softerror_and_alarm("[I2CBus] Failed to open I2C bus %s, error: %d (%s)", szDevice, errno, strerror(errno));
+   return iFD;
+}
+
+void hardware_i2c_bus_close(int iFD)
+{
+   if ( (NULL == s_pI2CBusMockHandler) && (iFD >= 0) )
+      close(iFD);
+}
+
+int hardware_i2c_bus_transfer(int iFD, u8 uAddress, u8* pWrite, int iWriteLength, u8* pRead, int iReadLength)
+{
+   if ( (iWriteLength <= 0) && (iReadLength <= 0) )
+      return -1;
+
+   if ( NULL != s_pI2CBusMockHandler )
+      return (*s_pI2CBusMockHandler)(uAddress, pWrite, iWriteLength, pRead, iReadLength);
+
+   if ( iFD < 0 )
+      return -1;
+
+   struct i2c_msg msgs[2];
+   int iCountMsgs = 0;
+   if ( iWriteLength > 0 )
+   {
+      msgs[iCountMsgs].addr = uAddress;
+      msgs[iCountMsgs].flags = 0;
+      msgs[iCountMsgs].len = iWriteLength;
+      msgs[iCountMsgs].buf = pWrite;
+      iCountMsgs++;
+   }
+   if ( iReadLength > 0 )
+   {
+      msgs[iCountMsgs].addr = uAddress;
+      msgs[iCountMsgs].flags = I2C_M_RD;
+      msgs[iCountMsgs].len = iReadLength;
+      msgs[iCountMsgs].buf = pRead;
+      iCountMsgs++;
+   }
+
+   struct i2c_rdwr_ioctl_data data;
+   data.msgs = msgs;
+   data.nmsgs = iCountMsgs;
+   if ( ioctl(iFD, I2C_RDWR, &data) < 0 )
+      return -1;
+   return 0;
+}
+
+int hardware_i2c_bus_read_reg8(int iFD, u8 uAddress, u8 uRegister, u8* pOutValue)
+{
+   if ( NULL == pOutValue )
+      return -1;
+   return hardware_i2c_bus_transfer(iFD, uAddress, &uRegister, 1, pOutValue, 1);
+}
+
+int hardware_i2c_bus_read_reg16(int iFD, u8 uAddress, u8 uRegister, u16* pOutValue)
+{
+   if ( NULL == pOutValue )
+      return -1;
+   u8 uBuff[2];
+   if ( 0 != hardware_i2c_bus_transfer(iFD, uAddress, &uRegister, 1, uBuff, 2) )
+      return -1;
+   *pOutValue = ((u16)uBuff[0]) | (((u16)uBuff[1]) << 8);
+   return 0;
+}
+
+int hardware_i2c_bus_write_reg16(int iFD, u8 uAddress, u8 uRegister, u16 uValue)
+{
+   u8 uBuff[3];
+   uBuff[0] = uRegister;
+   uBuff[1] = uValue & 0xFF;
+   uBuff[2] = (uValue >> 8) & 0xFF;
+   return hardware_i2c_bus_transfer(iFD, uAddress, uBuff, 3, NULL, 0);
+}
+
+int hardware_i2c_bus_read_regs16(int iFD, u8 uAddress, u8* pRegisters, int iCount, u16* pOutValues)
+{
+   if ( (NULL == pRegisters) || (NULL == pOutValues) || (iCount <= 0) || (iCount > I2C_BUS_MAX_REGS_PER_TRANSFER) )
+      return -1;
+
+   u8 uBuff[I2C_BUS_MAX_REGS_PER_TRANSFER*2];
+
+   if ( NULL != s_pI2CBusMockHandler )
+   {
+      for( int i=0; i<iCount; i++ )
+      {
+         if ( 0 != (*s_pI2CBusMockHandler)(uAddress, &pRegisters[i], 1, &uBuff[i*2], 2) )
+            return -1;
+      }
+   }
+   else
+   {
+      if ( iFD < 0 )
+         return -1;
+      struct i2c_msg msgs[I2C_BUS_MAX_MESSAGES_PER_TRANSFER];
+      for( int i=0; i<iCount; i++ )
+      {
+         msgs[2*i].addr = uAddress;
+         msgs[2*i].flags = 0;
+         msgs[2*i].len = 1;
+         msgs[2*i].buf = &pRegisters[i];
+         msgs[2*i+1].addr = uAddress;
+         msgs[2*i+1].flags = I2C_M_RD;
+         msgs[2*i+1].len = 2;
+         msgs[2*i+1].buf = &uBuff[i*2];
+      }
+      struct i2c_rdwr_ioctl_data data;
+      data.msgs = msgs;
+      data.nmsgs = 2*iCount;
+      if ( ioctl(iFD, I2C_RDWR, &data) < 0 )
+         return -1;
+   }
+
+   for( int i=0; i<iCount; i++ )
+      pOutValues[i] = ((u16)uBuff[2*i]) | (((u16)uBuff[2*i+1]) << 8);
+   return 0;
+}
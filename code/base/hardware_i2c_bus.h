@@ -0,0 +1,39 @@
+#pragma once
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Raw I2C transfers using combined (repeated start) I2C_RDWR transactions.
+// A mock bus backend can be installed, in which case all transfers go to it instead of the kernel.
+
+// Max messages the kernel accepts in a single I2C_RDWR transaction
+#define I2C_BUS_MAX_MESSAGES_PER_TRANSFER 42
+#define I2C_BUS_MAX_REGS_PER_TRANSFER (I2C_BUS_MAX_MESSAGES_PER_TRANSFER/2)
+
+// Mock handler: must process a write of iWriteLength bytes followed by a read of iReadLength bytes
+// (any of them can be 0) to/from device uAddress. Returns 0 on success, -1 on error (no ACK).
+typedef int (*t_i2c_bus_mock_handler)(u8 uAddress, u8* pWrite, int iWriteLength, u8* pRead, int iReadLength);
+
+void hardware_i2c_bus_set_mock_handler(t_i2c_bus_mock_handler pHandler);
+int hardware_i2c_bus_is_mock();
+
+// Returns a file descriptor for the bus or -1 on error. Not needed for the mock bus (any fd is accepted).
+int hardware_i2c_bus_open(int iBusNumber);
+void hardware_i2c_bus_close(int iFD);
+
+// One combined transaction: write, then repeated start and read. Returns 0 on success, -1 on error.
+int hardware_i2c_bus_transfer(int iFD, u8 uAddress, u8* pWrite, int iWriteLength, u8* pRead, int iReadLength);
+
+int hardware_i2c_bus_read_reg8(int iFD, u8 uAddress, u8 uRegister, u8* pOutValue);
+// 16 bit registers are returned in SMBus (little endian) byte order, same as wiringPiI2CReadReg16
+int hardware_i2c_bus_read_reg16(int iFD, u8 uAddress, u8 uRegister, u16* pOutValue);
+int hardware_i2c_bus_write_reg16(int iFD, u8 uAddress, u8 uRegister, u16 uValue);
+
+// Reads iCount 16 bit registers in a single I2C transaction (register write + read pairs)
+int hardware_i2c_bus_read_regs16(int iFD, u8 uAddress, u8* pRegisters, int iCount, u16* pOutValues);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1079,6 +1079,71 @@ void hardware_reset_radio_enumerated_flag()
    s_HardwareRadiosEnumeratedOnce = 0;
 }
 
+// Returns the number of emulated radio interfaces to use instead of the radio cards (0 for none)
+int _hardware_get_emulated_radios_count()
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_CONFIG);
+   strcat(szFile, FILE_CONFIG_RADIO_EMULATOR);
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+      return 0;
+
+   int iCount = 1;
+   char szLine[256];
+   char szKey[64];
+   int iValue = 0;
+   while ( NULL != fgets(szLine, 255, fd) )
+   {
+      if ( 2 != sscanf(szLine, "%63s %d", szKey, &iValue) )
+         continue;
+      if ( 0 == strcmp(szKey, "interfaces") )
+         iCount = iValue;
+   }
+   fclose(fd);
+
+   if ( iCount < 0 )
+      iCount = 0;
+   if ( iCount > MAX_RADIO_INTERFACES )
+      iCount = MAX_RADIO_INTERFACES;
+   return iCount;
+}
+
+int hardware_radio_add_emulated_radios(int iCount)
+{
+   int iAdded = 0;
+   for( int i=0; i<iCount; i++ )
+   {
+      if ( s_iHwRadiosCount >= MAX_RADIO_INTERFACES )
+         break;
+      radio_hw_info_t* pRadioInfo = &(sRadioInfo[s_iHwRadiosCount]);
+      memset(pRadioInfo, 0, sizeof(radio_hw_info_t));
+      sprintf(pRadioInfo->szName, "emu%d", i);
+      sprintf(pRadioInfo->szMAC, "02:00:00:00:00:%02X", i);
+      sprintf(pRadioInfo->szUSBPort, "E%d", i+1);
+      strcpy(pRadioInfo->szDescription, "Emulated");
+      strcpy(pRadioInfo->szDriver, "emulated");
+      pRadioInfo->isSupported = 1;
+      pRadioInfo->isConfigurable = 1;
+      pRadioInfo->isEnabled = 1;
+      pRadioInfo->isTxCapable = 1;
+      pRadioInfo->isHighCapacityInterface = 1;
+      pRadioInfo->iRadioType = RADIO_TYPE_EMULATED;
+      pRadioInfo->iRadioDriver = RADIO_HW_DRIVER_EMULATED;
+      pRadioInfo->supportedBands = RADIO_HW_SUPPORTED_BAND_23 | RADIO_HW_SUPPORTED_BAND_24 | RADIO_HW_SUPPORTED_BAND_25 | RADIO_HW_SUPPORTED_BAND_58;
+      reset_runtime_radio_rx_info(&pRadioInfo->runtimeInterfaceInfoRx.radioHwRxInfo);
+      reset_runtime_radio_rx_info(&pRadioInfo->runtimeInterfaceInfoTx.radioHwRxInfo);
+      pRadioInfo->runtimeInterfaceInfoRx.selectable_fd = -1;
+      pRadioInfo->runtimeInterfaceInfoTx.selectable_fd = -1;
+      log_line("[HardwareRadio] Added emulated radio interface %d: [%s]", s_iHwRadiosCount+1, pRadioInfo->szName);
+      s_iHwRadiosCount++;
+      s_iHwRadiosSupportedCount++;
+      iAdded++;
+   }
+   s_HardwareRadiosEnumeratedOnce = 1;
+   return iAdded;
+}
+
 int hardware_enumerate_radio_interfaces()
 {
    return hardware_enumerate_radio_interfaces_step(-1);
@@ -1115,7 +1180,15 @@ int hardware_enumerate_radio_interfaces_step(int iStep)
 
    if( iStep == -1 || iStep == 0 )
    {
-      _hardware_enumerate_wifi_radios();
+      int iCountEmulated = _hardware_get_emulated_radios_count();
+      if ( iCountEmulated > 0 )
+      {
+         log_line("[HardwareRadio] Radio emulator config file is present. Using %d emulated radio interfaces.", iCountEmulated);
+         s_iHwRadiosSupportedCount = 0;
+         hardware_radio_add_emulated_radios(iCountEmulated);
+      }
+      else
+         _hardware_enumerate_wifi_radios();
       
       if ( 0 == s_iHwRadiosCount )
          log_error_and_alarm("[HardwareRadio] No 2.4/5.8 radio modules found!");
@@ -1741,7 +1814,8 @@ int hardware_radio_is_wifi_radio(radio_hw_info_t* pRadioInfo)
    if ( pRadioInfo->iRadioType == RADIO_TYPE_RALINK ||
         pRadioInfo->iRadioType == RADIO_TYPE_ATHEROS ||
         pRadioInfo->iRadioType == RADIO_TYPE_REALTEK ||
-        pRadioInfo->iRadioType == RADIO_TYPE_MEDIATEK )
+        pRadioInfo->iRadioType == RADIO_TYPE_MEDIATEK ||
+        pRadioInfo->iRadioType == RADIO_TYPE_EMULATED )
       return 1;
 
    return 0;
@@ -13,6 +13,7 @@
 #define RADIO_TYPE_MEDIATEK 4
 #define RADIO_TYPE_SIK 5
 #define RADIO_TYPE_SERIAL 6
+#define RADIO_TYPE_EMULATED 7
 
 #define RADIO_HW_DRIVER_ATHEROS 1       // ath9k_htc
 #define RADIO_HW_DRIVER_RALINK 2        // rt2800usb, only 2.4Ghz band
@@ -24,6 +25,7 @@
 #define RADIO_HW_DRIVER_SERIAL_SIK 8
 #define RADIO_HW_DRIVER_SERIAL 9
 #define RADIO_HW_DRIVER_REALTEK_8812EU 10          // 88x2eu
+#define RADIO_HW_DRIVER_EMULATED 11                // radio/radio_emulator.c
 
 
 // 0 is generic card model
@@ -195,6 +197,8 @@ int hardware_get_radio_interfaces_count();
 int hardware_get_supported_radio_interfaces_count();
 radio_hw_info_t* hardware_get_radio_info_array();
 int hardware_add_radio_interface_info(radio_hw_info_t* pRadioInfo);
+// Adds radio interfaces that send and receive on the emulated radio medium instead of radio cards
+int hardware_radio_add_emulated_radios(int iCount);
 int hardware_get_radio_index_by_name(const char* szName);
 int hardware_get_radio_index_from_mac(const char* szMAC);
 int hardware_radio_has_low_capacity_links();
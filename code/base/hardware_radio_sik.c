@@ -39,6 +39,7 @@
 #include "hardware_radio.h"
 #include "hardware_radio_sik.h"
 #include "hardware_serial.h"
+#include "hardware_serial_io.h"
 #include "hw_procs.h"
 
 #define SIK_PARAM_INDEX_LOCAL_SPEED 1
@@ -1662,6 +1663,12 @@ int hardware_radio_sik_open_for_read_write(int iHWRadioInterfaceIndex)
    pRadioInfo->runtimeInterfaceInfoRx.selectable_fd = iSerialPortFD;
    pRadioInfo->runtimeInterfaceInfoTx.selectable_fd = iSerialPortFD;
 
+   // Writes go through the serial I/O engine, paced to the air rate of the radio. Reads are done by the radio rx thread.
+   int iAirRate = hardware_radio_sik_get_air_baudrate_in_bytes(iHWRadioInterfaceIndex);
+   if ( iAirRate < 0 )
+      iAirRate = 0;
+   serial_io_add_port(iSerialPortFD, SERIAL_IO_FLAG_TX, iAirRate);
+
    log_line("[HardwareRadio] Opened SiK radio interface %d for read/write. fd=%d", iHWRadioInterfaceIndex+1, iSerialPortFD);
    return 1;
 }
@@ -1682,6 +1689,7 @@ int hardware_radio_sik_close(int iHWRadioInterfaceIndex)
 
    if ( pRadioInfo->openedForWrite || pRadioInfo->openedForRead )
    {
+      serial_io_remove_port(pRadioInfo->runtimeInterfaceInfoTx.selectable_fd);
       if ( pRadioInfo->runtimeInterfaceInfoRx.selectable_fd > 0 )
          close(pRadioInfo->runtimeInterfaceInfoRx.selectable_fd);
       else if ( pRadioInfo->runtimeInterfaceInfoTx.selectable_fd > 0 )
@@ -1720,7 +1728,19 @@ int hardware_radio_sik_write_packet(int iHWRadioInterfaceIndex, u8* pData, int i
       return 0;
    }
 
-   int iRes = write(pRadioInfo->runtimeInterfaceInfoTx.selectable_fd, pData, iLength);
+   int iRes = 0;
+   if ( serial_io_has_port(pRadioInfo->runtimeInterfaceInfoTx.selectable_fd) )
+   {
+      iRes = serial_io_queue_write(pRadioInfo->runtimeInterfaceInfoTx.selectable_fd, pData, iLength);
+      if ( iRes != iLength )
+      {
+         log_softerror_and_alarm("[HardwareRadio] Write: Failed to queue %d bytes for write (%d bytes pending).", iLength, serial_io_get_tx_pending_bytes(pRadioInfo->runtimeInterfaceInfoTx.selectable_fd));
+         return 0;
+      }
+      return 1;
+   }
+
+   iRes = write(pRadioInfo->runtimeInterfaceInfoTx.selectable_fd, pData, iLength);
    if ( iRes != iLength )
    {
       log_softerror_and_alarm("[HardwareRadio] Write: Failed to write. Written %d bytes of %d bytes.", iRes, iLength);
@@ -1731,3 +1751,258 @@ int hardware_radio_sik_write_packet(int iHWRadioInterfaceIndex, u8* pData, int i
    return 1;
 }
 
+
+#define SIK_AT_GUARD_TIME_MS 50
+#define SIK_AT_COMMAND_MODE_TIMEOUT_MS 2500
+#define SIK_AT_RESPONSE_TIMEOUT_MS 2000
+
+static void _hardware_radio_sik_at_driver_set_state(t_sik_at_driver* pDriver, int iState, u32 uTimeNow)
+{
+   pDriver->iState = iState;
+   pDriver->uTimeStateStart = uTimeNow;
+}
+
+// Reads whatever is available on the serial port, without blocking
+static void _hardware_radio_sik_at_driver_read(t_sik_at_driver* pDriver)
+{
+   int iMaxRead = (int)sizeof(pDriver->uResponse) - 1 - pDriver->iResponseLength;
+   if ( iMaxRead <= 0 )
+   {
+      // Keep only the most recent half of the data
+      int iKeep = (int)sizeof(pDriver->uResponse)/2;
+      memmove(pDriver->uResponse, &pDriver->uResponse[pDriver->iResponseLength - iKeep], iKeep);
+      pDriver->iResponseLength = iKeep;
+      iMaxRead = (int)sizeof(pDriver->uResponse) - 1 - pDriver->iResponseLength;
+   }
+   int iRead = read(pDriver->iSerialPortFD, &pDriver->uResponse[pDriver->iResponseLength], iMaxRead);
+   if ( iRead > 0 )
+      pDriver->iResponseLength += iRead;
+   pDriver->uResponse[pDriver->iResponseLength] = 0;
+}
+
+static int _hardware_radio_sik_at_driver_response_has_ok(t_sik_at_driver* pDriver)
+{
+   for( int i=0; i<pDriver->iResponseLength-1; i++ )
+   {
+      if ( (pDriver->uResponse[i] == 'O') || (pDriver->uResponse[i] == 'o') )
+      if ( (pDriver->uResponse[i+1] == 'K') || (pDriver->uResponse[i+1] == 'k') )
+         return 1;
+   }
+   return 0;
+}
+
+void hardware_radio_sik_at_driver_init(t_sik_at_driver* pDriver, int iSerialPortFD)
+{
+   if ( NULL == pDriver )
+      return;
+   memset(pDriver, 0, sizeof(t_sik_at_driver));
+   pDriver->iSerialPortFD = iSerialPortFD;
+   pDriver->iState = SIK_AT_STATE_IDLE;
+}
+
+int hardware_radio_sik_at_driver_add_command(t_sik_at_driver* pDriver, const char* szCommand, int iParamIndex, u32 uParamValue)
+{
+   if ( (NULL == pDriver) || (NULL == szCommand) || (0 == szCommand[0]) )
+      return 0;
+   if ( pDriver->iCommandsCount >= SIK_AT_DRIVER_MAX_COMMANDS )
+   {
+      log_softerror_and_alarm("[HardwareRadio] SiK AT driver: too many commands, can't add command [%s].", szCommand);
+      return 0;
+   }
+   strncpy(pDriver->szCommands[pDriver->iCommandsCount], szCommand, sizeof(pDriver->szCommands[0])-1);
+   pDriver->szCommands[pDriver->iCommandsCount][sizeof(pDriver->szCommands[0])-1] = 0;
+   pDriver->iParamIndex[pDriver->iCommandsCount] = iParamIndex;
+   pDriver->uParamValue[pDriver->iCommandsCount] = uParamValue;
+   pDriver->iCommandSucceeded[pDriver->iCommandsCount] = 0;
+   pDriver->iCommandsCount++;
+   return 1;
+}
+
+static int _hardware_radio_sik_at_driver_add_param(t_sik_at_driver* pDriver, radio_hw_info_t* pRadioInfo, int iParamIndex, u32 uValue)
+{
+   if ( pRadioInfo->uHardwareParamsList[iParamIndex] == uValue )
+      return 0;
+   char szComm[32];
+   sprintf(szComm, "ATS%d=%u", iParamIndex, uValue);
+   return hardware_radio_sik_at_driver_add_command(pDriver, szComm, iParamIndex, uValue);
+}
+
+int hardware_radio_sik_at_driver_add_params(t_sik_at_driver* pDriver, radio_hw_info_t* pRadioInfo, u32 uFrequencyKhz, u32 uFreqSpread, u32 uChannels, u32 uNetId, u32 uAirSpeed, u32 uTxPower, u32 uECC, u32 uLBT, u32 uMCSTR)
+{
+   if ( (NULL == pDriver) || (NULL == pRadioInfo) )
+      return 0;
+
+   if ( uLBT != 0 )
+      uLBT = 50;
+
+   int iCount = 0;
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_AIRSPEED, hardware_radio_sik_get_encoded_air_baudrate(uAirSpeed));
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_NETID, uNetId);
+   if ( (uTxPower > 0) && (uTxPower <= 30) )
+      iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_TXPOWER, uTxPower);
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_ECC, uECC);
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_FREQ_MIN, uFrequencyKhz);
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_FREQ_MAX, uFrequencyKhz + uFreqSpread);
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_CHANNELS, uChannels);
+   // Duty cycle to 100 % ( percentage of time allowed to transmit )
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_DUTYCYCLE, 100);
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_LBT, uLBT);
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, SIK_PARAM_INDEX_MCSTR, uMCSTR);
+   // Max Window
+   iCount += _hardware_radio_sik_at_driver_add_param(pDriver, pRadioInfo, 15, 50);
+
+   if ( iCount > 0 )
+   {
+      hardware_radio_sik_at_driver_add_command(pDriver, "AT&W", -1, 0);
+      hardware_radio_sik_at_driver_add_command(pDriver, "ATZ", -1, 0);
+   }
+   return iCount;
+}
+
+int hardware_radio_sik_at_driver_step(t_sik_at_driver* pDriver, u32 uTimeNow)
+{
+   if ( NULL == pDriver )
+      return SIK_AT_STATE_FAILED;
+
+   switch ( pDriver->iState )
+   {
+      case SIK_AT_STATE_IDLE:
+         if ( (pDriver->iSerialPortFD <= 0) || (0 == pDriver->iCommandsCount) )
+         {
+            _hardware_radio_sik_at_driver_set_state(pDriver, (pDriver->iSerialPortFD <= 0)?SIK_AT_STATE_FAILED:SIK_AT_STATE_FINISHED, uTimeNow);
+            break;
+         }
+         pDriver->iCurrentCommand = 0;
+         pDriver->iFailedCommands = 0;
+         pDriver->iEnterCommandModeRetries = 0;
+         pDriver->iResponseLength = 0;
+         _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_GUARD_TIME, uTimeNow);
+         break;
+
+      case SIK_AT_STATE_GUARD_TIME:
+         // Flush any pending rx data and keep the line silent before the escape sequence
+         pDriver->iResponseLength = 0;
+         _hardware_radio_sik_at_driver_read(pDriver);
+         pDriver->iResponseLength = 0;
+         if ( uTimeNow < pDriver->uTimeStateStart + SIK_AT_GUARD_TIME_MS )
+            break;
+         if ( ! hardware_serial_send_sik_command(pDriver->iSerialPortFD, "+++") )
+         {
+            log_softerror_and_alarm("[HardwareRadio] SiK AT driver: failed to send AT command mode change.");
+            _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_FAILED, uTimeNow);
+            break;
+         }
+         _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_WAIT_COMMAND_MODE, uTimeNow);
+         break;
+
+      case SIK_AT_STATE_WAIT_COMMAND_MODE:
+         _hardware_radio_sik_at_driver_read(pDriver);
+         // Either "OK" or echo of "+++" if the radio is already in command mode
+         if ( _hardware_radio_sik_at_driver_response_has_ok(pDriver) || (NULL != strstr((char*)pDriver->uResponse, "+++")) )
+         {
+            log_line("[HardwareRadio] SiK AT driver: radio entered AT command mode.");
+            _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_SEND_COMMAND, uTimeNow);
+            break;
+         }
+         if ( uTimeNow < pDriver->uTimeStateStart + SIK_AT_COMMAND_MODE_TIMEOUT_MS )
+            break;
+         pDriver->iEnterCommandModeRetries++;
+         if ( pDriver->iEnterCommandModeRetries < 2 )
+         {
+            log_line("[HardwareRadio] SiK AT driver: no response to AT command mode change, retry.");
+            _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_GUARD_TIME, uTimeNow);
+            break;
+         }
+         log_softerror_and_alarm("[HardwareRadio] SiK AT driver: failed to enter SiK radio into AT command mode (received %d bytes).", pDriver->iResponseLength);
+         _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_FAILED, uTimeNow);
+         break;
+
+      case SIK_AT_STATE_SEND_COMMAND:
+         if ( pDriver->iCurrentCommand >= pDriver->iCommandsCount )
+         {
+            _hardware_radio_sik_at_driver_set_state(pDriver, (pDriver->iFailedCommands > 0)?SIK_AT_STATE_FAILED:SIK_AT_STATE_FINISHED, uTimeNow);
+            break;
+         }
+         pDriver->iResponseLength = 0;
+         pDriver->uResponse[0] = 0;
+         if ( ! hardware_serial_send_sik_command(pDriver->iSerialPortFD, pDriver->szCommands[pDriver->iCurrentCommand]) )
+         {
+            log_softerror_and_alarm("[HardwareRadio] SiK AT driver: failed to send command [%s].", pDriver->szCommands[pDriver->iCurrentCommand]);
+            _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_FAILED, uTimeNow);
+            break;
+         }
+         log_line("[HardwareRadio] SiK AT driver: sent command [%s]", pDriver->szCommands[pDriver->iCurrentCommand]);
+         // No response is expected to reboot command, wait for the radio to reboot
+         if ( 0 == strcmp(pDriver->szCommands[pDriver->iCurrentCommand], "ATZ") )
+         {
+            pDriver->iCommandSucceeded[pDriver->iCurrentCommand] = 1;
+            pDriver->iCurrentCommand++;
+            pDriver->iCommandRetries = 0;
+            _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_WAIT_REBOOT, uTimeNow);
+            break;
+         }
+         _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_WAIT_RESPONSE, uTimeNow);
+         break;
+
+      case SIK_AT_STATE_WAIT_RESPONSE:
+         _hardware_radio_sik_at_driver_read(pDriver);
+         if ( _hardware_radio_sik_at_driver_response_has_ok(pDriver) )
+         {
+            pDriver->iCommandSucceeded[pDriver->iCurrentCommand] = 1;
+            pDriver->iCurrentCommand++;
+            pDriver->iCommandRetries = 0;
+            _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_SEND_COMMAND, uTimeNow);
+            break;
+         }
+         if ( (NULL == strstr((char*)pDriver->uResponse, "ERROR")) && (uTimeNow < pDriver->uTimeStateStart + SIK_AT_RESPONSE_TIMEOUT_MS) )
+            break;
+
+         pDriver->iCommandRetries++;
+         if ( pDriver->iCommandRetries < 3 )
+         {
+            log_line("[HardwareRadio] SiK AT driver: no valid response to command [%s], retry.", pDriver->szCommands[pDriver->iCurrentCommand]);
+            _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_SEND_COMMAND, uTimeNow);
+            break;
+         }
+         log_softerror_and_alarm("[HardwareRadio] SiK AT driver: command [%s] failed, response: [%s]", pDriver->szCommands[pDriver->iCurrentCommand], (char*)pDriver->uResponse);
+         if ( pDriver->iParamIndex[pDriver->iCurrentCommand] >= 0 )
+            pDriver->iFailedCommands++;
+         pDriver->iCurrentCommand++;
+         pDriver->iCommandRetries = 0;
+         _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_SEND_COMMAND, uTimeNow);
+         break;
+
+      case SIK_AT_STATE_WAIT_REBOOT:
+         // Discard the boot output, if any
+         pDriver->iResponseLength = 0;
+         _hardware_radio_sik_at_driver_read(pDriver);
+         pDriver->iResponseLength = 0;
+         if ( uTimeNow < pDriver->uTimeStateStart + SIK_AT_REBOOT_TIME_MS )
+            break;
+         log_line("[HardwareRadio] SiK AT driver: radio reboot time elapsed.");
+         _hardware_radio_sik_at_driver_set_state(pDriver, SIK_AT_STATE_SEND_COMMAND, uTimeNow);
+         break;
+
+      default:
+         break;
+   }
+   return pDriver->iState;
+}
+
+int hardware_radio_sik_at_driver_apply_params(t_sik_at_driver* pDriver, radio_hw_info_t* pRadioInfo)
+{
+   if ( (NULL == pDriver) || (NULL == pRadioInfo) )
+      return 0;
+
+   int iFailed = 0;
+   for( int i=0; i<pDriver->iCommandsCount; i++ )
+   {
+      if ( (pDriver->iParamIndex[i] < 0) || (pDriver->iParamIndex[i] >= MAX_RADIO_HW_PARAMS) )
+         continue;
+      if ( pDriver->iCommandSucceeded[i] )
+         pRadioInfo->uHardwareParamsList[pDriver->iParamIndex[i]] = pDriver->uParamValue[i];
+      else
+         iFailed++;
+   }
+   return iFailed;
+}
@@ -8,6 +8,52 @@
 extern "C" {
 #endif 
 
+#define SIK_AT_DRIVER_MAX_COMMANDS 20
+
+#define SIK_AT_STATE_IDLE 0
+#define SIK_AT_STATE_GUARD_TIME 1
+#define SIK_AT_STATE_WAIT_COMMAND_MODE 2
+#define SIK_AT_STATE_SEND_COMMAND 3
+#define SIK_AT_STATE_WAIT_RESPONSE 4
+#define SIK_AT_STATE_FINISHED 5
+#define SIK_AT_STATE_FAILED 6
+#define SIK_AT_STATE_WAIT_REBOOT 7
+
+// Time a SiK radio needs to reboot (ATZ) before its serial port can be used again
+#define SIK_AT_REBOOT_TIME_MS 1500
+
+// Nonblocking AT commands driver: it is advanced by calling hardware_radio_sik_at_driver_step periodically,
+// so SiK radios can be configured from a main loop without blocking it or using a worker thread.
+typedef struct
+{
+   int iState;
+   int iSerialPortFD;
+   int iEnterCommandModeRetries;
+   int iCommandRetries;
+   u32 uTimeStateStart;
+
+   int iCommandsCount;
+   int iCurrentCommand;
+   int iFailedCommands;
+   char szCommands[SIK_AT_DRIVER_MAX_COMMANDS][24];
+   int iParamIndex[SIK_AT_DRIVER_MAX_COMMANDS]; // -1 for commands that do not set a parameter
+   u32 uParamValue[SIK_AT_DRIVER_MAX_COMMANDS];
+   int iCommandSucceeded[SIK_AT_DRIVER_MAX_COMMANDS];
+
+   u8 uResponse[256];
+   int iResponseLength;
+} t_sik_at_driver;
+
+void hardware_radio_sik_at_driver_init(t_sik_at_driver* pDriver, int iSerialPortFD);
+int hardware_radio_sik_at_driver_add_command(t_sik_at_driver* pDriver, const char* szCommand, int iParamIndex, u32 uParamValue);
+// Adds the commands to set all the params that are different from current ones, then save and reboot commands.
+// Returns the number of params to be changed.
+int hardware_radio_sik_at_driver_add_params(t_sik_at_driver* pDriver, radio_hw_info_t* pRadioInfo, u32 uFrequencyKhz, u32 uFreqSpread, u32 uChannels, u32 uNetId, u32 uAirSpeed, u32 uTxPower, u32 uECC, u32 uLBT, u32 uMCSTR);
+// Returns the current state of the driver (SIK_AT_STATE_...)
+int hardware_radio_sik_at_driver_step(t_sik_at_driver* pDriver, u32 uTimeNow);
+// Updates the radio info with the params that where set succesfully. Returns the number of failed params.
+int hardware_radio_sik_at_driver_apply_params(t_sik_at_driver* pDriver, radio_hw_info_t* pRadioInfo);
+
 int hardware_radio_has_sik_radios();
 int hardware_radio_sik_firmware_is_old();
 
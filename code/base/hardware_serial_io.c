@@ -0,0 +1,549 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include "base.h"
+#include "hardware.h"
+#include "hardware_serial_io.h"
+
+typedef struct
+{
+   int iFD;
+   u32 uFlags;
+   int iAirRateBytesPerSec;
+   int iUsesEpoll;
+   int iWaitingWritable;
+
+   u8 uTxBuffer[SERIAL_IO_TX_BUFFER_SIZE];
+   int iTxStart;
+   int iTxLength;
+   u32 uTxCreditBytes;
+   u32 uTimeLastCreditUpdateMicros;
+
+   u8 uRxBuffer[SERIAL_IO_RX_BUFFER_SIZE];
+   int iRxStart;
+   int iRxLength;
+
+   t_serial_io_port_stats stats;
+} t_serial_io_port;
+
+static int s_iSerialIOInitialized = 0;
+static int s_iSerialIOEpollFD = -1;
+static pthread_mutex_t s_pSerialIOMutex = PTHREAD_MUTEX_INITIALIZER;
+static t_serial_io_port s_SerialIOPorts[SERIAL_IO_MAX_PORTS];
+static int s_iSerialIOPortsCount = 0;
+
+static t_serial_io_port* _serial_io_get_port(int iFD)
+{
+   for( int i=0; i<s_iSerialIOPortsCount; i++ )
+   {
+      if ( s_SerialIOPorts[i].iFD == iFD )
+         return &s_SerialIOPorts[i];
+   }
+   return NULL;
+}
+
+static void _serial_io_update_epoll_events(t_serial_io_port* pPort)
+{
+   if ( (NULL == pPort) || (! pPort->iUsesEpoll) )
+      return;
+
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.data.fd = pPort->iFD;
+   if ( pPort->uFlags & SERIAL_IO_FLAG_RX )
+      ev.events |= EPOLLIN;
+   if ( pPort->iWaitingWritable )
+      ev.events |= EPOLLOUT;
+   epoll_ctl(s_iSerialIOEpollFD, EPOLL_CTL_MOD, pPort->iFD, &ev);
+}
+
+static void _serial_io_update_tx_credit(t_serial_io_port* pPort, u32 uTimeNowMicros)
+{
+   if ( pPort->iAirRateBytesPerSec <= 0 )
+      return;
+
+   u32 uMaxCredit = (u32)pPort->iAirRateBytesPerSec * SERIAL_IO_MAX_BURST_MS / 1000;
+   if ( uMaxCredit < 16 )
+      uMaxCredit = 16;
+
+   u32 uDeltaMicros = uTimeNowMicros - pPort->uTimeLastCreditUpdateMicros;
+   u64 uNewCredit = ((u64)uDeltaMicros * (u64)pPort->iAirRateBytesPerSec) / 1000000;
+   if ( 0 == uNewCredit )
+      return;
+
+   // Advance the time only by the amount of time that was converted into credit, to not lose fractions
+   pPort->uTimeLastCreditUpdateMicros += (u32)((uNewCredit * 1000000) / (u64)pPort->iAirRateBytesPerSec);
+   if ( (u64)pPort->uTxCreditBytes + uNewCredit >= uMaxCredit )
+   {
+      pPort->uTxCreditBytes = uMaxCredit;
+      pPort->uTimeLastCreditUpdateMicros = uTimeNowMicros;
+   }
+   else
+      pPort->uTxCreditBytes += (u32)uNewCredit;
+}
+
+// Minimum chunk of data we write at once on a paced port, so that pending data is coalesced
+static int _serial_io_get_min_write_chunk(t_serial_io_port* pPort)
+{
+   if ( pPort->iAirRateBytesPerSec <= 0 )
+      return 1;
+   int iChunk = pPort->iAirRateBytesPerSec * SERIAL_IO_FLUSH_INTERVAL_MS / 1000;
+   if ( iChunk < 1 )
+      iChunk = 1;
+   if ( iChunk > pPort->iTxLength )
+      iChunk = pPort->iTxLength;
+   return iChunk;
+}
+
+static void _serial_io_flush_port(t_serial_io_port* pPort, u32 uTimeNowMicros)
+{
+   if ( (NULL == pPort) || (pPort->iTxLength <= 0) || pPort->iWaitingWritable )
+      return;
+
+   int iToWrite = pPort->iTxLength;
+   if ( pPort->iAirRateBytesPerSec > 0 )
+   {
+      _serial_io_update_tx_credit(pPort, uTimeNowMicros);
+      if ( (int)pPort->uTxCreditBytes < _serial_io_get_min_write_chunk(pPort) )
+         return;
+      if ( iToWrite > (int)pPort->uTxCreditBytes )
+         iToWrite = (int)pPort->uTxCreditBytes;
+   }
+
+   struct iovec iov[2];
+   int iCountIOV = 1;
+   int iFirstLen = SERIAL_IO_TX_BUFFER_SIZE - pPort->iTxStart;
+   if ( iFirstLen > iToWrite )
+      iFirstLen = iToWrite;
+   iov[0].iov_base = &pPort->uTxBuffer[pPort->iTxStart];
+   iov[0].iov_len = iFirstLen;
+   if ( iFirstLen < iToWrite )
+   {
+      iov[1].iov_base = &pPort->uTxBuffer[0];
+      iov[1].iov_len = iToWrite - iFirstLen;
+      iCountIOV = 2;
+   }
+
+   int iRes = writev(pPort->iFD, iov, iCountIOV);
+   if ( iRes < 0 )
+   {
+      if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+      {
+         pPort->iWaitingWritable = 1;
+         _serial_io_update_epoll_events(pPort);
+         return;
+      }
+      log_softerror_and_alarm("[SerialIO] Failed to write to serial port fd %d, error: %d, discarding %d pending bytes.", pPort->iFD, errno, pPort->iTxLength);
+      pPort->stats.uTotalTxDroppedBytes += pPort->iTxLength;
+      pPort->iTxStart = 0;
+      pPort->iTxLength = 0;
+      return;
+   }
+
+   pPort->iTxStart = (pPort->iTxStart + iRes) % SERIAL_IO_TX_BUFFER_SIZE;
+   pPort->iTxLength -= iRes;
+   if ( 0 == pPort->iTxLength )
+      pPort->iTxStart = 0;
+   if ( pPort->iAirRateBytesPerSec > 0 )
+      pPort->uTxCreditBytes -= (u32)iRes;
+   pPort->stats.uTotalTxBytes += iRes;
+   pPort->stats.uTotalTxWrites++;
+
+   if ( (iRes < iToWrite) && pPort->iUsesEpoll )
+   {
+      pPort->iWaitingWritable = 1;
+      _serial_io_update_epoll_events(pPort);
+   }
+}
+
+static void _serial_io_read_port(t_serial_io_port* pPort)
+{
+   if ( (NULL == pPort) || (! (pPort->uFlags & SERIAL_IO_FLAG_RX)) )
+      return;
+
+   u8 uTmpBuffer[512];
+   while ( 1 )
+   {
+      int iRead = read(pPort->iFD, uTmpBuffer, sizeof(uTmpBuffer));
+      if ( iRead <= 0 )
+         return;
+
+      pPort->stats.uTotalRxBytes += iRead;
+      int iFree = SERIAL_IO_RX_BUFFER_SIZE - pPort->iRxLength;
+      if ( iRead > iFree )
+      {
+         // Drop the oldest data, keep the most recent one
+         int iDrop = iRead - iFree;
+         if ( iDrop > pPort->iRxLength )
+            iDrop = pPort->iRxLength;
+         pPort->iRxStart = (pPort->iRxStart + iDrop) % SERIAL_IO_RX_BUFFER_SIZE;
+         pPort->iRxLength -= iDrop;
+         pPort->stats.uTotalRxDroppedBytes += iDrop;
+      }
+      int iPos = (pPort->iRxStart + pPort->iRxLength) % SERIAL_IO_RX_BUFFER_SIZE;
+      for( int i=0; i<iRead; i++ )
+      {
+         pPort->uRxBuffer[iPos] = uTmpBuffer[i];
+         iPos++;
+         if ( iPos >= SERIAL_IO_RX_BUFFER_SIZE )
+            iPos = 0;
+      }
+      pPort->iRxLength += iRead;
+      if ( pPort->iRxLength > SERIAL_IO_RX_BUFFER_SIZE )
+         pPort->iRxLength = SERIAL_IO_RX_BUFFER_SIZE;
+      if ( iRead < (int)sizeof(uTmpBuffer) )
+         return;
+   }
+}
+
+int serial_io_init()
+{
+   if ( s_iSerialIOInitialized )
+      return 1;
+
+   s_iSerialIOEpollFD = epoll_create1(EPOLL_CLOEXEC);
+   if ( s_iSerialIOEpollFD < 0 )
+   {
+      log_softerror_and_alarm("[SerialIO] Failed to create epoll instance, error: %d", errno);
+      return 0;
+   }
+   s_iSerialIOPortsCount = 0;
+   s_iSerialIOInitialized = 1;
+   log_line("[SerialIO] Initialized.");
+   return 1;
+}
+
+void serial_io_uninit()
+{
+   if ( ! s_iSerialIOInitialized )
+      return;
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   if ( s_iSerialIOEpollFD >= 0 )
+      close(s_iSerialIOEpollFD);
+   s_iSerialIOEpollFD = -1;
+   s_iSerialIOPortsCount = 0;
+   s_iSerialIOInitialized = 0;
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   log_line("[SerialIO] Uninitialized.");
+}
+
+int serial_io_add_port(int iFD, u32 uFlags, int iAirRateBytesPerSec)
+{
+   if ( iFD < 0 )
+      return 0;
+   if ( ! s_iSerialIOInitialized )
+   if ( ! serial_io_init() )
+      return 0;
+
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   if ( NULL == pPort )
+   {
+      if ( s_iSerialIOPortsCount >= SERIAL_IO_MAX_PORTS )
+      {
+         pthread_mutex_unlock(&s_pSerialIOMutex);
+         log_softerror_and_alarm("[SerialIO] Can't add serial port fd %d, too many ports registered (%d).", iFD, s_iSerialIOPortsCount);
+         return 0;
+      }
+      pPort = &s_SerialIOPorts[s_iSerialIOPortsCount];
+      s_iSerialIOPortsCount++;
+   }
+   else
+      epoll_ctl(s_iSerialIOEpollFD, EPOLL_CTL_DEL, iFD, NULL);
+
+   memset(pPort, 0, sizeof(t_serial_io_port));
+   pPort->iFD = iFD;
+   pPort->uFlags = uFlags;
+   pPort->iAirRateBytesPerSec = iAirRateBytesPerSec;
+   pPort->uTimeLastCreditUpdateMicros = get_current_timestamp_micros();
+   pPort->uTxCreditBytes = (iAirRateBytesPerSec > 0)?((u32)iAirRateBytesPerSec * SERIAL_IO_FLUSH_INTERVAL_MS / 1000):0;
+
+   int iFlags = fcntl(iFD, F_GETFL, 0);
+   if ( (iFlags >= 0) && (!(iFlags & O_NONBLOCK)) )
+      fcntl(iFD, F_SETFL, iFlags | O_NONBLOCK);
+
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.data.fd = iFD;
+   if ( uFlags & SERIAL_IO_FLAG_RX )
+      ev.events |= EPOLLIN;
+   pPort->iUsesEpoll = 1;
+   if ( 0 != epoll_ctl(s_iSerialIOEpollFD, EPOLL_CTL_ADD, iFD, &ev) )
+   {
+      // Files that can't be polled (i.e. regular files) are always ready
+      pPort->iUsesEpoll = 0;
+      log_line("[SerialIO] Serial port fd %d can't be polled (error %d), will do direct I/O on it.", iFD, errno);
+   }
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+
+   log_line("[SerialIO] Added serial port fd %d, flags: %s%s, air rate: %d bytes/sec", iFD,
+      (uFlags & SERIAL_IO_FLAG_TX)?"tx ":"", (uFlags & SERIAL_IO_FLAG_RX)?"rx":"", iAirRateBytesPerSec);
+   return 1;
+}
+
+int serial_io_remove_port(int iFD)
+{
+   if ( (! s_iSerialIOInitialized) || (iFD < 0) )
+      return 0;
+
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   for( int i=0; i<s_iSerialIOPortsCount; i++ )
+   {
+      if ( s_SerialIOPorts[i].iFD != iFD )
+         continue;
+      if ( s_SerialIOPorts[i].iUsesEpoll )
+         epoll_ctl(s_iSerialIOEpollFD, EPOLL_CTL_DEL, iFD, NULL);
+      if ( s_SerialIOPorts[i].iTxLength > 0 )
+         log_line("[SerialIO] Removed serial port fd %d with %d bytes still pending for tx.", iFD, s_SerialIOPorts[i].iTxLength);
+      for( int k=i; k<s_iSerialIOPortsCount-1; k++ )
+         memcpy(&s_SerialIOPorts[k], &s_SerialIOPorts[k+1], sizeof(t_serial_io_port));
+      s_iSerialIOPortsCount--;
+      pthread_mutex_unlock(&s_pSerialIOMutex);
+      log_line("[SerialIO] Removed serial port fd %d", iFD);
+      return 1;
+   }
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   return 0;
+}
+
+int serial_io_has_port(int iFD)
+{
+   if ( ! s_iSerialIOInitialized )
+      return 0;
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   int iHas = (NULL != _serial_io_get_port(iFD))?1:0;
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   return iHas;
+}
+
+void serial_io_set_port_air_rate(int iFD, int iAirRateBytesPerSec)
+{
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   if ( (NULL != pPort) && (pPort->iAirRateBytesPerSec != iAirRateBytesPerSec) )
+   {
+      pPort->iAirRateBytesPerSec = iAirRateBytesPerSec;
+      pPort->uTxCreditBytes = 0;
+      pPort->uTimeLastCreditUpdateMicros = get_current_timestamp_micros();
+      log_line("[SerialIO] Set serial port fd %d air rate to %d bytes/sec", iFD, iAirRateBytesPerSec);
+   }
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+}
+
+int serial_io_queue_write(int iFD, u8* pData, int iLength)
+{
+   if ( (NULL == pData) || (iLength <= 0) )
+      return -1;
+
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   if ( (NULL == pPort) || (! (pPort->uFlags & SERIAL_IO_FLAG_TX)) )
+   {
+      pthread_mutex_unlock(&s_pSerialIOMutex);
+      return -1;
+   }
+   if ( iLength > SERIAL_IO_TX_BUFFER_SIZE - pPort->iTxLength )
+   {
+      pPort->stats.uTotalTxDroppedBytes += iLength;
+      pthread_mutex_unlock(&s_pSerialIOMutex);
+      return -1;
+   }
+
+   int iPos = (pPort->iTxStart + pPort->iTxLength) % SERIAL_IO_TX_BUFFER_SIZE;
+   int iFirstLen = SERIAL_IO_TX_BUFFER_SIZE - iPos;
+   if ( iFirstLen > iLength )
+      iFirstLen = iLength;
+   memcpy(&pPort->uTxBuffer[iPos], pData, iFirstLen);
+   if ( iFirstLen < iLength )
+      memcpy(&pPort->uTxBuffer[0], pData + iFirstLen, iLength - iFirstLen);
+   pPort->iTxLength += iLength;
+   if ( (u32)pPort->iTxLength > pPort->stats.uMaxTxPendingBytes )
+      pPort->stats.uMaxTxPendingBytes = pPort->iTxLength;
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   return iLength;
+}
+
+int serial_io_get_tx_pending_bytes(int iFD)
+{
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   int iPending = (NULL != pPort)?pPort->iTxLength:0;
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   return iPending;
+}
+
+void serial_io_discard_tx(int iFD)
+{
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   if ( NULL != pPort )
+   {
+      pPort->iTxStart = 0;
+      pPort->iTxLength = 0;
+   }
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+}
+
+int serial_io_read(int iFD, u8* pBuffer, int iMaxLength)
+{
+   if ( (NULL == pBuffer) || (iMaxLength <= 0) )
+      return 0;
+
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   if ( NULL == pPort )
+   {
+      pthread_mutex_unlock(&s_pSerialIOMutex);
+      return 0;
+   }
+   if ( ! pPort->iUsesEpoll )
+      _serial_io_read_port(pPort);
+
+   int iRead = pPort->iRxLength;
+   if ( iRead > iMaxLength )
+      iRead = iMaxLength;
+   for( int i=0; i<iRead; i++ )
+   {
+      pBuffer[i] = pPort->uRxBuffer[pPort->iRxStart];
+      pPort->iRxStart++;
+      if ( pPort->iRxStart >= SERIAL_IO_RX_BUFFER_SIZE )
+         pPort->iRxStart = 0;
+   }
+   pPort->iRxLength -= iRead;
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   return iRead;
+}
+
+int serial_io_get_rx_available_bytes(int iFD)
+{
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   int iAvailable = (NULL != pPort)?pPort->iRxLength:0;
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   return iAvailable;
+}
+
+void serial_io_discard_rx(int iFD)
+{
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   if ( NULL != pPort )
+   {
+      if ( ! pPort->iUsesEpoll )
+         _serial_io_read_port(pPort);
+      pPort->iRxStart = 0;
+      pPort->iRxLength = 0;
+   }
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+}
+
+int serial_io_poll(int iTimeoutMs)
+{
+   if ( ! s_iSerialIOInitialized )
+   {
+      if ( iTimeoutMs > 0 )
+         hardware_sleep_ms(iTimeoutMs);
+      return -1;
+   }
+
+   // Flush whatever can be flushed now and compute how long we can wait for the next tx credit
+
+   u32 uTimeNowMicros = get_current_timestamp_micros();
+   int iTimeoutToUse = iTimeoutMs;
+
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   for( int i=0; i<s_iSerialIOPortsCount; i++ )
+   {
+      t_serial_io_port* pPort = &s_SerialIOPorts[i];
+      _serial_io_flush_port(pPort, uTimeNowMicros);
+      if ( (pPort->iTxLength <= 0) || pPort->iWaitingWritable )
+         continue;
+      if ( pPort->iAirRateBytesPerSec <= 0 )
+      {
+         iTimeoutToUse = 0;
+         continue;
+      }
+      int iMissing = _serial_io_get_min_write_chunk(pPort) - (int)pPort->uTxCreditBytes;
+      int iWaitMs = 1 + (iMissing * 1000) / pPort->iAirRateBytesPerSec;
+      if ( iWaitMs < iTimeoutToUse )
+         iTimeoutToUse = iWaitMs;
+   }
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+
+   if ( iTimeoutToUse < 0 )
+      iTimeoutToUse = 0;
+
+   struct epoll_event events[SERIAL_IO_MAX_PORTS];
+   int iEvents = epoll_wait(s_iSerialIOEpollFD, events, SERIAL_IO_MAX_PORTS, iTimeoutToUse);
+   if ( (iEvents < 0) && (errno != EINTR) )
+   {
+      log_softerror_and_alarm("[SerialIO] Failed to wait for serial ports events, error: %d", errno);
+      return -1;
+   }
+
+   int iActivePorts = 0;
+   uTimeNowMicros = get_current_timestamp_micros();
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   for( int i=0; i<iEvents; i++ )
+   {
+      t_serial_io_port* pPort = _serial_io_get_port(events[i].data.fd);
+      if ( NULL == pPort )
+         continue;
+      iActivePorts++;
+      if ( events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP) )
+         _serial_io_read_port(pPort);
+      if ( events[i].events & EPOLLOUT )
+      {
+         pPort->iWaitingWritable = 0;
+         _serial_io_update_epoll_events(pPort);
+      }
+   }
+   for( int i=0; i<s_iSerialIOPortsCount; i++ )
+      _serial_io_flush_port(&s_SerialIOPorts[i], uTimeNowMicros);
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+
+   return iActivePorts;
+}
+
+int serial_io_get_port_stats(int iFD, t_serial_io_port_stats* pStats)
+{
+   if ( NULL == pStats )
+      return 0;
+   pthread_mutex_lock(&s_pSerialIOMutex);
+   t_serial_io_port* pPort = _serial_io_get_port(iFD);
+   if ( NULL != pPort )
+      memcpy(pStats, &pPort->stats, sizeof(t_serial_io_port_stats));
+   pthread_mutex_unlock(&s_pSerialIOMutex);
+   return (NULL != pPort)?1:0;
+}
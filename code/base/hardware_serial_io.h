@@ -0,0 +1,64 @@
+#pragma once
+#include "base.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Nonblocking, epoll based serial ports I/O engine.
+// Writes are queued and flushed in coalesced chunks, paced to the air datarate of the port (if any).
+// Reads (for ports registered for read) are buffered and can be consumed without blocking.
+
+#define SERIAL_IO_MAX_PORTS 8
+#define SERIAL_IO_TX_BUFFER_SIZE 4096
+#define SERIAL_IO_RX_BUFFER_SIZE 2048
+
+// How often (at most) the engine flushes tx data to a paced port, in miliseconds
+#define SERIAL_IO_FLUSH_INTERVAL_MS 20
+// How much tx credit (in miliseconds of air time) can be accumulated by an idle port
+#define SERIAL_IO_MAX_BURST_MS 60
+
+#define SERIAL_IO_FLAG_TX 0x01
+#define SERIAL_IO_FLAG_RX 0x02
+
+typedef struct
+{
+   u32 uTotalTxBytes;
+   u32 uTotalTxWrites;
+   u32 uTotalTxDroppedBytes;
+   u32 uTotalRxBytes;
+   u32 uTotalRxDroppedBytes;
+   u32 uMaxTxPendingBytes;
+} t_serial_io_port_stats;
+
+int serial_io_init();
+void serial_io_uninit();
+
+// iAirRateBytesPerSec: 0 for no pacing (write as fast as the port accepts)
+int serial_io_add_port(int iFD, u32 uFlags, int iAirRateBytesPerSec);
+int serial_io_remove_port(int iFD);
+int serial_io_has_port(int iFD);
+void serial_io_set_port_air_rate(int iFD, int iAirRateBytesPerSec);
+
+// Queues data for sending. Never blocks. Returns the number of bytes queued or -1 on error/no room.
+int serial_io_queue_write(int iFD, u8* pData, int iLength);
+int serial_io_get_tx_pending_bytes(int iFD);
+void serial_io_discard_tx(int iFD);
+
+// Returns the number of bytes read from the rx buffer of the port (0 if nothing available)
+int serial_io_read(int iFD, u8* pBuffer, int iMaxLength);
+int serial_io_get_rx_available_bytes(int iFD);
+void serial_io_discard_rx(int iFD);
+
+// Waits for I/O events for at most iTimeoutMs miliseconds (0 = do not wait), flushes pending
+// tx data within each port air time budget and buffers received data.
+// Returns the number of ports that had activity, or -1 on error.
+int serial_io_poll(int iTimeoutMs);
+
+// Copies the port stats to pStats. Returns 1 on success, 0 if the port is not registered.
+int serial_io_get_port_stats(int iFD, t_serial_io_port_stats* pStats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3969,9 +3969,14 @@ bool Model::validate_settings()
    if ( audio_params.quality < 0 || audio_params.quality > 3 )
       audio_params.quality = 1;
    if ( 0 == (audio_params.flags & 0xFF) || (audio_params.flags & 0xFF) > 16 )
-      audio_params.flags = 0x04 | (0x02<<8);
+      audio_params.flags = (audio_params.flags & 0xFFFF0000) | 0x04 | (0x02<<8);
    if ( ((audio_params.flags >> 8) & 0xFF) > (audio_params.flags & 0xFF) )
-      audio_params.flags = 0x04 | (0x02<<8);
+      audio_params.flags = (audio_params.flags & 0xFFFF0000) | 0x04 | (0x02<<8);
+   // Byte 2: only known codec flags
+   audio_params.flags &= ~(((u32)0xFF)<<16) | AUDIO_FLAGS_CODEC_ADPCM;
+   // Byte 3: output latency, in 10 ms units
+   if ( 10 * ((audio_params.flags >> 24) & 0xFF) > MAX_AUDIO_OUTPUT_LATENCY_MS )
+      audio_params.flags = (audio_params.flags & 0x00FFFFFF) | (((u32)(MAX_AUDIO_OUTPUT_LATENCY_MS/10)) << 24);
 
    for( int i=0; i<MAX_VIDEO_LINK_PROFILES; i++ )
       if ( video_link_profiles[i].video_data_length > MAX_VIDEO_PACKET_DATA_SIZE )
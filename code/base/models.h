@@ -278,6 +278,8 @@ typedef struct
    u32 flags;
       // byte 0: data packets
       // byte 1: EC packets
+      // byte 2: codec flags (AUDIO_FLAGS_CODEC_ADPCM)
+      // byte 3: controller audio output latency, in 10 ms units (0: default)
 } audio_parameters_t;
 
 
@@ -32,6 +32,14 @@
 #include "base.h"
 #include "hardware.h"
 #include "models.h"
+#include "models_list.h"
+#include <sys/stat.h>
+
+// Controller and spectator models are loaded on demand: at startup only the models index is read
+// (vehicle id, name, type and model file stamp for each slot). A slot with a NULL model pointer means the
+// slot model file is the up to date source of the model and it gets loaded when first needed.
+
+#define MODELS_INDEX_VERSION 1
 
 Model* s_pModelsSpectator[MAX_MODELS_SPECTATOR];
 int s_iModelsSpectatorCount = 0;
@@ -43,10 +51,302 @@ Model* s_pCurrentModel = NULL;
 
 static bool s_bLoadedAllModels = false;
 
+static t_model_index_entry s_ControllerModelsIndex[MAX_MODELS];
+static t_model_index_entry s_SpectatorModelsIndex[MAX_MODELS_SPECTATOR];
+
+static char s_szModelsListConfigFolder[MAX_FILE_PATH_SIZE] = FOLDER_CONFIG;
+static char s_szModelsListModelsFolder[MAX_FILE_PATH_SIZE] = FOLDER_CONFIG_MODELS;
+
+void setModelsListFolders(const char* szConfigFolder, const char* szModelsFolder)
+{
+   if ( NULL != szConfigFolder )
+      strcpy(s_szModelsListConfigFolder, szConfigFolder);
+   if ( NULL != szModelsFolder )
+      strcpy(s_szModelsListModelsFolder, szModelsFolder);
+}
+
+static void _models_list_get_config_file(const char* szFileName, char* szOutFile)
+{
+   strcpy(szOutFile, s_szModelsListConfigFolder);
+   strcat(szOutFile, szFileName);
+}
+
+static void _models_list_get_model_file(bool bSpectator, int iIndex, char* szOutFile)
+{
+   char szFolderM[MAX_FILE_PATH_SIZE];
+   strcpy(szFolderM, s_szModelsListModelsFolder);
+   strcat(szFolderM, bSpectator?FILE_VEHICLE_SPECTATOR:FILE_VEHICLE_CONTROLL);
+   sprintf(szOutFile, szFolderM, iIndex);
+}
+
+static t_model_index_entry* _models_list_get_index_entry(bool bSpectator, int iIndex)
+{
+   if ( bSpectator )
+      return &s_SpectatorModelsIndex[iIndex];
+   return &s_ControllerModelsIndex[iIndex];
+}
+
+static Model** _models_list_get_slot(bool bSpectator, int iIndex)
+{
+   if ( bSpectator )
+      return &s_pModelsSpectator[iIndex];
+   return &s_pModels[iIndex];
+}
+
+static bool _models_list_get_file_stamp(const char* szFile, t_model_index_entry* pEntry)
+{
+   struct stat statFile;
+   if ( 0 != stat(szFile, &statFile) )
+   {
+      pEntry->uFileTimeSec = 0;
+      pEntry->uFileTimeNSec = 0;
+      pEntry->uFileSize = 0;
+      return false;
+   }
+   pEntry->uFileTimeSec = (u32)statFile.st_mtim.tv_sec;
+   pEntry->uFileTimeNSec = (u32)statFile.st_mtim.tv_nsec;
+   pEntry->uFileSize = (u32)statFile.st_size;
+   return true;
+}
+
+// Updates the index entry of a slot after the slot model file was loaded or saved
+static void _models_list_update_index_entry(bool bSpectator, int iIndex, Model* pModel)
+{
+   t_model_index_entry* pEntry = _models_list_get_index_entry(bSpectator, iIndex);
+   pEntry->uVehicleId = pModel->uVehicleId;
+   pEntry->uVehicleType = pModel->vehicle_type;
+   pEntry->uIsSpectator = pModel->is_spectator?1:0;
+   strncpy(pEntry->szVehicleName, pModel->vehicle_name, MAX_VEHICLE_NAME_LENGTH-1);
+   pEntry->szVehicleName[MAX_VEHICLE_NAME_LENGTH-1] = 0;
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   _models_list_get_model_file(bSpectator, iIndex, szFile);
+   _models_list_get_file_stamp(szFile, pEntry);
+}
+
+// The in memory model of the slot no longer matches the slot file; force a full load of the file on next startup
+static void _models_list_invalidate_index_entry(bool bSpectator, int iIndex, Model* pModel)
+{
+   t_model_index_entry* pEntry = _models_list_get_index_entry(bSpectator, iIndex);
+   if ( NULL != pModel )
+   {
+      pEntry->uVehicleId = pModel->uVehicleId;
+      pEntry->uVehicleType = pModel->vehicle_type;
+      pEntry->uIsSpectator = pModel->is_spectator?1:0;
+   }
+   pEntry->uFileTimeSec = 0;
+   pEntry->uFileTimeNSec = 0;
+   pEntry->uFileSize = 0;
+}
+
+static bool _models_list_save_index()
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   char szFileTmp[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, s_szModelsListModelsFolder);
+   strcat(szFile, FILE_CONFIG_MODELS_INDEX);
+   strcpy(szFileTmp, szFile);
+   strcat(szFileTmp, ".tmp");
+
+   FILE* fd = fopen(szFileTmp, "w");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("Failed to save models index file: %s", szFileTmp);
+      return false;
+   }
+   fprintf(fd, "models_index %d\n%d %d\n", MODELS_INDEX_VERSION, s_iModelsCount, s_iModelsSpectatorCount);
+   for( int k=0; k<2; k++ )
+   {
+      bool bSpectator = (k == 1);
+      int iCount = bSpectator?s_iModelsSpectatorCount:s_iModelsCount;
+      for( int i=0; i<iCount; i++ )
+      {
+         t_model_index_entry* pEntry = _models_list_get_index_entry(bSpectator, i);
+         char szName[MAX_VEHICLE_NAME_LENGTH+1];
+         strcpy(szName, pEntry->szVehicleName);
+         if ( 0 == szName[0] )
+            strcpy(szName, "*");
+         for( int c=0; c<(int)strlen(szName); c++ )
+            if ( szName[c] == ' ' )
+               szName[c] = '_';
+         fprintf(fd, "%c %d %u %d %d %u %u %u %s\n", bSpectator?'s':'c', i, pEntry->uVehicleId, (int)pEntry->uVehicleType, (int)pEntry->uIsSpectator,
+            pEntry->uFileTimeSec, pEntry->uFileTimeNSec, pEntry->uFileSize, szName);
+      }
+   }
+   fclose(fd);
+   if ( 0 != rename(szFileTmp, szFile) )
+   {
+      log_softerror_and_alarm("Failed to update models index file: %s", szFile);
+      return false;
+   }
+   return true;
+}
+
+// Reads the models index file into the provided arrays. Entries not present in the index have a zero file stamp.
+static bool _models_list_load_index(t_model_index_entry* pControllerEntries, t_model_index_entry* pSpectatorEntries)
+{
+   memset(pControllerEntries, 0, MAX_MODELS*sizeof(t_model_index_entry));
+   memset(pSpectatorEntries, 0, MAX_MODELS_SPECTATOR*sizeof(t_model_index_entry));
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, s_szModelsListModelsFolder);
+   strcat(szFile, FILE_CONFIG_MODELS_INDEX);
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+      return false;
+
+   int iVersion = 0;
+   int iCountCtrl = 0, iCountSpect = 0;
+   if ( (1 != fscanf(fd, "%*s %d", &iVersion)) || (iVersion != MODELS_INDEX_VERSION) ||
+        (2 != fscanf(fd, "%d %d", &iCountCtrl, &iCountSpect)) )
+   {
+      log_softerror_and_alarm("Invalid models index file: %s", szFile);
+      fclose(fd);
+      return false;
+   }
+
+   for( int i=0; i<iCountCtrl + iCountSpect; i++ )
+   {
+      char cType = 0;
+      int iIndex = 0;
+      int iVehicleType = 0, iIsSpectator = 0;
+      t_model_index_entry entry;
+      char szName[256];
+      if ( 9 != fscanf(fd, " %c %d %u %d %d %u %u %u %255s", &cType, &iIndex, &entry.uVehicleId, &iVehicleType, &iIsSpectator,
+                &entry.uFileTimeSec, &entry.uFileTimeNSec, &entry.uFileSize, szName) )
+      {
+         log_softerror_and_alarm("Invalid models index file: %s, entry %d", szFile, i);
+         break;
+      }
+      entry.uVehicleType = (u8)iVehicleType;
+      entry.uIsSpectator = (u8)iIsSpectator;
+      // Names are stored the same way as in the model files (spaces replaced with '_')
+      if ( (szName[0] == '*') && (szName[1] == 0) )
+         szName[0] = 0;
+      strncpy(entry.szVehicleName, szName, MAX_VEHICLE_NAME_LENGTH-1);
+      entry.szVehicleName[MAX_VEHICLE_NAME_LENGTH-1] = 0;
+
+      if ( (cType == 'c') && (iIndex >= 0) && (iIndex < MAX_MODELS) )
+         memcpy(&pControllerEntries[iIndex], &entry, sizeof(t_model_index_entry));
+      if ( (cType == 's') && (iIndex >= 0) && (iIndex < MAX_MODELS_SPECTATOR) )
+         memcpy(&pSpectatorEntries[iIndex], &entry, sizeof(t_model_index_entry));
+   }
+   fclose(fd);
+   return true;
+}
+
+static bool _models_list_is_index_entry_valid_for_file(t_model_index_entry* pEntry, const char* szFile)
+{
+   if ( (0 == pEntry->uFileTimeSec) && (0 == pEntry->uFileSize) )
+      return false;
+   t_model_index_entry stamp;
+   if ( ! _models_list_get_file_stamp(szFile, &stamp) )
+      return false;
+   if ( (stamp.uFileTimeSec != pEntry->uFileTimeSec) || (stamp.uFileTimeNSec != pEntry->uFileTimeNSec) || (stamp.uFileSize != pEntry->uFileSize) )
+      return false;
+   return true;
+}
+
+// Returns the model in a slot, loading it from the slot model file if it's not loaded yet
+static Model* _models_list_materialize(bool bSpectator, int iIndex)
+{
+   Model** ppModel = _models_list_get_slot(bSpectator, iIndex);
+   if ( NULL != *ppModel )
+      return *ppModel;
+
+   t_model_index_entry* pEntry = _models_list_get_index_entry(bSpectator, iIndex);
+   if ( (NULL != s_pCurrentModel) && (s_pCurrentModel->uVehicleId == pEntry->uVehicleId) )
+   {
+      *ppModel = s_pCurrentModel;
+      return *ppModel;
+   }
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   _models_list_get_model_file(bSpectator, iIndex, szFile);
+   Model* pModel = new Model();
+   if ( ! pModel->loadFromFile(szFile, true) )
+      log_softerror_and_alarm("Failed to load %s model %d (VID %u) from file %s", bSpectator?"spectator":"controller", iIndex, pEntry->uVehicleId, szFile);
+   *ppModel = pModel;
+   return pModel;
+}
+
+static void _models_list_materialize_all(bool bSpectator)
+{
+   int iCount = bSpectator?s_iModelsSpectatorCount:s_iModelsCount;
+   for( int i=0; i<iCount; i++ )
+      _models_list_materialize(bSpectator, i);
+}
+
+static u32 _models_list_get_vehicle_id(bool bSpectator, int iIndex)
+{
+   Model* pModel = *_models_list_get_slot(bSpectator, iIndex);
+   if ( NULL != pModel )
+      return pModel->uVehicleId;
+   return _models_list_get_index_entry(bSpectator, iIndex)->uVehicleId;
+}
+
+static bool _models_list_get_is_spectator(bool bSpectator, int iIndex)
+{
+   Model* pModel = *_models_list_get_slot(bSpectator, iIndex);
+   if ( NULL != pModel )
+      return pModel->is_spectator;
+   return (_models_list_get_index_entry(bSpectator, iIndex)->uIsSpectator != 0);
+}
+
+static void _models_list_save_model(bool bSpectator, int iIndex, Model* pModel)
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   _models_list_get_model_file(bSpectator, iIndex, szFile);
+   pModel->saveToFile(szFile, hardware_is_station());
+   _models_list_update_index_entry(bSpectator, iIndex, pModel);
+}
+
+// Loads (or indexes) the controller or spectator models list. Returns how many models were fully parsed.
+static int _models_list_load_list(bool bSpectator, int iMaxCount, t_model_index_entry* pIndexEntries)
+{
+   int* piCount = bSpectator?&s_iModelsSpectatorCount:&s_iModelsCount;
+   int iCountParsed = 0;
+   *piCount = 0;
+
+   while ( *piCount < iMaxCount )
+   {
+      int i = *piCount;
+      char szFile[MAX_FILE_PATH_SIZE];
+      _models_list_get_model_file(bSpectator, i, szFile);
+      Model** ppModel = _models_list_get_slot(bSpectator, i);
+      *ppModel = NULL;
+
+      if ( bSpectator )
+      if ( access(szFile, R_OK) == -1 )
+         break;
+
+      if ( _models_list_is_index_entry_valid_for_file(&pIndexEntries[i], szFile) )
+         memcpy(_models_list_get_index_entry(bSpectator, i), &pIndexEntries[i], sizeof(t_model_index_entry));
+      else
+      {
+         Model* pModel = new Model();
+         if ( ! pModel->loadFromFile(szFile, true) )
+         {
+            delete pModel;
+            break;
+         }
+         iCountParsed++;
+         *ppModel = pModel;
+         _models_list_update_index_entry(bSpectator, i, pModel);
+      }
+
+      if ( s_pCurrentModel->uVehicleId == _models_list_get_vehicle_id(bSpectator, i) )
+         *ppModel = s_pCurrentModel;
+      (*piCount)++;
+   }
+   return iCountParsed;
+}
+
 bool loadAllModels()
 {
    log_line("Loading all models from storage...");
    s_bLoadedAllModels = true;
+   u32 uTimeStart = get_current_timestamp_ms();
   
    bool bSucceeded = true;
 
@@ -56,12 +356,10 @@ bool loadAllModels()
    s_pCurrentModel = new Model();
 
    char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_CONFIG);
-   strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL);
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL, szFile);
 
    char szFileBackup[MAX_FILE_PATH_SIZE];
-   strcpy(szFileBackup, FOLDER_CONFIG);
-   strcat(szFileBackup, FILE_CONFIG_CURRENT_VEHICLE_MODEL_BACKUP);
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL_BACKUP, szFileBackup);
 
    if ( ! s_pCurrentModel->loadFromFile(szFile, true) )
    {
@@ -81,51 +379,43 @@ bool loadAllModels()
    s_iModelsCount = 0;
    s_iModelsSpectatorCount = 0;
 
-   strcpy(szFile, FOLDER_CONFIG);
-   strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_COUNT);
+   t_model_index_entry* pControllerEntries = (t_model_index_entry*) malloc(MAX_MODELS*sizeof(t_model_index_entry));
+   t_model_index_entry* pSpectatorEntries = (t_model_index_entry*) malloc(MAX_MODELS_SPECTATOR*sizeof(t_model_index_entry));
+   if ( (NULL == pControllerEntries) || (NULL == pSpectatorEntries) )
+   {
+      log_error_and_alarm("Failed to allocate memory for models index.");
+      free(pControllerEntries);
+      free(pSpectatorEntries);
+      return false;
+   }
+   if ( ! _models_list_load_index(pControllerEntries, pSpectatorEntries) )
+      log_line("No valid models index present. Will load all models and rebuild it.");
+
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_COUNT, szFile);
    int count = load_simple_config_fileI(szFile, 0);
    if (count < 0 )
       count = 0;
+   if ( count > MAX_MODELS )
+      count = MAX_MODELS;
    log_line("Loading %d controller models...", count);
-   for( int i=0; i<count; i++ )
-   {
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_CONTROLL);
-      sprintf(szFile, szFolderM, i);
-      s_pModels[i] = new Model();
-      if ( ! s_pModels[i]->loadFromFile(szFile, true) )
-         break;
-
-      if ( s_pCurrentModel->uVehicleId == s_pModels[i]->uVehicleId )
-         s_pModels[i] = s_pCurrentModel;
-      s_iModelsCount++;
-   }
+   int iCountParsed = _models_list_load_list(false, count, pControllerEntries);
    log_line("Loaded %d controller models.", s_iModelsCount);
 
-   s_iModelsSpectatorCount = 0;
-   while( s_iModelsSpectatorCount < MAX_MODELS_SPECTATOR )
-   {
-      char szBuff[256];
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
-      sprintf(szBuff, szFolderM, s_iModelsSpectatorCount);
-      s_pModelsSpectator[s_iModelsSpectatorCount] = new Model();
-      if( access( szBuff, R_OK ) == -1 )
-         break;
-      if ( ! s_pModelsSpectator[s_iModelsSpectatorCount]->loadFromFile(szBuff, true) )
-         break;
-      if ( s_pCurrentModel->uVehicleId == s_pModelsSpectator[s_iModelsSpectatorCount]->uVehicleId )
-         s_pModelsSpectator[s_iModelsSpectatorCount] = s_pCurrentModel;
-      s_iModelsSpectatorCount++;
-   }
+   iCountParsed += _models_list_load_list(true, MAX_MODELS_SPECTATOR, pSpectatorEntries);
    log_line("Loaded %d spectator models.", s_iModelsSpectatorCount);
 
+   free(pControllerEntries);
+   free(pSpectatorEntries);
+
+   if ( iCountParsed > 0 )
+      _models_list_save_index();
+
    log_line("Loaded controller models (%d):", s_iModelsCount);
    for( int i=0; i<s_iModelsCount; i++ )
-      log_line("Controller model %d: [%s], VID: %u", i+1, s_pModels[i]->getLongName(), s_pModels[i]->uVehicleId);
+      log_line("Controller model %d: [%s], VID: %u", i+1, s_ControllerModelsIndex[i].szVehicleName, _models_list_get_vehicle_id(false, i));
 
+   log_line("Loaded all models in %u ms (%d models read from index, %d models fully loaded).",
+      get_current_timestamp_ms() - uTimeStart, s_iModelsCount + s_iModelsSpectatorCount - iCountParsed, iCountParsed);
    return true;
 }
 
@@ -138,8 +428,7 @@ bool saveCurrentModel()
    }
 
    char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_CONFIG);
-   strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL);
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL, szFile);
 
    log_line("Saving model id %u as current model", s_pCurrentModel->uVehicleId);
    s_pCurrentModel->saveToFile(szFile, hardware_is_station());
@@ -149,30 +438,21 @@ bool saveCurrentModel()
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-      if ( s_pModelsSpectator[i]->uVehicleId != s_pCurrentModel->uVehicleId )
+      if ( _models_list_get_vehicle_id(true, i) != s_pCurrentModel->uVehicleId )
          continue;
-      char szBuff[256];
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
-      sprintf(szBuff, szFolderM, i);
-      s_pModelsSpectator[i]->saveToFile(szBuff, hardware_is_station());
+      _models_list_save_model(true, i, _models_list_materialize(true, i));
    }
 
    log_line("Saving %d controller models.", s_iModelsCount);
-   strcpy(szFile, FOLDER_CONFIG);
-   strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_COUNT);
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_COUNT, szFile);
    save_simple_config_fileI(szFile, s_iModelsCount);
    for( int i=0; i<s_iModelsCount; i++ )
    {
-      if ( s_pModels[i]->uVehicleId != s_pCurrentModel->uVehicleId )
+      if ( _models_list_get_vehicle_id(false, i) != s_pCurrentModel->uVehicleId )
          continue;
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_CONTROLL);
-      sprintf(szFile, szFolderM, i);
-      s_pModels[i]->saveToFile(szFile, hardware_is_station());
+      _models_list_save_model(false, i, _models_list_materialize(false, i));
    }
+   _models_list_save_index();
    return true;
 }
 
@@ -189,8 +469,7 @@ bool reloadCurrentModel()
       return false;
 
    char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_CONFIG);
-   strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL);
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL, szFile);
    if ( ! s_pCurrentModel->loadFromFile(szFile) )
       return false;
 
@@ -201,19 +480,19 @@ void setCurrentModel(u32 uVehicleId)
 {
    for( int i=0; i<s_iModelsCount; i++ )
    {
-       if ( (NULL != s_pModels[i]) && (s_pModels[i]->uVehicleId == uVehicleId) )
+       if ( _models_list_get_vehicle_id(false, i) == uVehicleId )
        {
           log_line("Set current vehicle to controller vehicle index %d (VID %u)", i, uVehicleId);
-          s_pCurrentModel = s_pModels[i];
+          s_pCurrentModel = _models_list_materialize(false, i);
           return;
        }
    }
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-       if ( (NULL != s_pModelsSpectator[i]) && (s_pModelsSpectator[i]->uVehicleId == uVehicleId) )
+       if ( _models_list_get_vehicle_id(true, i) == uVehicleId )
        {
           log_line("Set current vehicle to controller spectator vehicle index %d (VID %u)", i, uVehicleId);
-          s_pCurrentModel = s_pModelsSpectator[i];
+          s_pCurrentModel = _models_list_materialize(true, i);
           return;
        }
    }
@@ -229,15 +508,41 @@ int getControllerModelsSpectatorCount()
    return s_iModelsSpectatorCount;
 }
 
+int getLoadedModelsCount()
+{
+   int iCount = 0;
+   for( int i=0; i<s_iModelsCount; i++ )
+      if ( NULL != s_pModels[i] )
+         iCount++;
+   for( int i=0; i<s_iModelsSpectatorCount; i++ )
+      if ( NULL != s_pModelsSpectator[i] )
+         iCount++;
+   return iCount;
+}
+
+t_model_index_entry* getControllerModelIndexEntry(int iIndex)
+{
+   if ( iIndex < 0 || iIndex >= s_iModelsCount )
+      return NULL;
+   return &s_ControllerModelsIndex[iIndex];
+}
+
+t_model_index_entry* getSpectatorModelIndexEntry(int iIndex)
+{
+   if ( iIndex < 0 || iIndex >= s_iModelsSpectatorCount )
+      return NULL;
+   return &s_SpectatorModelsIndex[iIndex];
+}
+
 void deleteAllModels()
 {
    log_line("Deleted all controller models.");
    s_iModelsSpectatorCount = 0;
    s_iModelsCount = 0;
    char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_CONFIG);
-   strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_COUNT);
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_COUNT, szFile);
    save_simple_config_fileI(szFile, s_iModelsCount);
+   _models_list_save_index();
 }
 
 
@@ -245,31 +550,53 @@ Model* getSpectatorModel(int iIndex)
 {
    if ( iIndex < 0 || iIndex > s_iModelsSpectatorCount )
       return NULL;
-   return s_pModelsSpectator[iIndex];
+   if ( iIndex == s_iModelsSpectatorCount )
+      return s_pModelsSpectator[iIndex];
+   return _models_list_materialize(true, iIndex);
 }
 
+// Moves a spectator model to the top of the list. All moved models are loaded first, as the slot files no longer match them.
+static void _models_list_move_spectator_model_to_top(int index)
+{
+   for( int i=0; i<=index; i++ )
+      _models_list_materialize(true, i);
+
+   Model* tmp = s_pModelsSpectator[index];
+   t_model_index_entry entryTmp;
+   memcpy(&entryTmp, &s_SpectatorModelsIndex[index], sizeof(t_model_index_entry));
+   for( int i=index-1; i >=0; i-- )
+   {
+      s_pModelsSpectator[i+1] = s_pModelsSpectator[i];
+      memcpy(&s_SpectatorModelsIndex[i+1], &s_SpectatorModelsIndex[i], sizeof(t_model_index_entry));
+   }
+   s_pModelsSpectator[0] = tmp;
+   memcpy(&s_SpectatorModelsIndex[0], &entryTmp, sizeof(t_model_index_entry));
+
+   for( int i=0; i<=index; i++ )
+      _models_list_invalidate_index_entry(true, i, s_pModelsSpectator[i]);
+}
 
 Model* addSpectatorModel(u32 vehicleId)
 {
    int index = 0;
    for( index = 0; index < s_iModelsSpectatorCount; index++ )
-      if ( s_pModelsSpectator[index]->uVehicleId == vehicleId )
+      if ( _models_list_get_vehicle_id(true, index) == vehicleId )
       {
          // Move it to top of the list;
-         Model* tmp = s_pModelsSpectator[index];
-         for( int i=index-1; i >=0; i-- )
-            if (i >=0 )
-               s_pModelsSpectator[i+1] = s_pModelsSpectator[i];
-         s_pModelsSpectator[0] = tmp;
+         _models_list_move_spectator_model_to_top(index);
          return s_pModelsSpectator[0];
       }
 
    // New vehicle, add it on top of the list, move the other ones down the list.
 
+   _models_list_materialize_all(true);
    for( int i=s_iModelsSpectatorCount-1; i >= 0; i-- )
    {
       if ( i < MAX_MODELS_SPECTATOR-1 )
+      {
          s_pModelsSpectator[i+1] = s_pModelsSpectator[i];
+         memcpy(&s_SpectatorModelsIndex[i+1], &s_SpectatorModelsIndex[i], sizeof(t_model_index_entry));
+      }
    }
    s_pModelsSpectator[0] = new Model();
    s_pModelsSpectator[0]->resetToDefaults(false);
@@ -282,12 +609,11 @@ Model* addSpectatorModel(u32 vehicleId)
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
       char szBuff[256];
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
-      sprintf(szBuff, szFolderM, i);
+      _models_list_get_model_file(true, i, szBuff);
       s_pModelsSpectator[i]->saveToFile(szBuff, true);
+      _models_list_update_index_entry(true, i, s_pModelsSpectator[i]);
    }
+   _models_list_save_index();
 
    return s_pModelsSpectator[0];
 }
@@ -297,18 +623,16 @@ void moveSpectatorModelToTop(int index)
    if ( index < 0 || index >= s_iModelsSpectatorCount )
       return;
         
-   Model* tmp = s_pModelsSpectator[index];
-   for( int i=index-1; i >=0; i-- )
-      if (i >=0 )
-         s_pModelsSpectator[i+1] = s_pModelsSpectator[i];
-   s_pModelsSpectator[0] = tmp;
+   _models_list_move_spectator_model_to_top(index);
 }
 
 Model* getModelAtIndex(int index) 
 {
    if ( index < 0 || index >= MAX_MODELS )
       return NULL;
-   return s_pModels[index];
+   if ( index >= s_iModelsCount )
+      return s_pModels[index];
+   return _models_list_materialize(false, index);
 }
 
 Model* addNewModel()
@@ -319,18 +643,13 @@ Model* addNewModel()
    s_pModels[s_iModelsCount] = new Model();
    s_pModels[s_iModelsCount]->resetToDefaults(true);
    
-   char szBuff[256];
-   char szFolderM[MAX_FILE_PATH_SIZE];
-   strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-   strcat(szFolderM, FILE_VEHICLE_CONTROLL);
-   sprintf(szBuff, szFolderM, s_iModelsCount);
-   s_pModels[s_iModelsCount]->saveToFile(szBuff, true);
+   _models_list_save_model(false, s_iModelsCount, s_pModels[s_iModelsCount]);
    s_iModelsCount++;
 
    char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_CONFIG);
-   strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_COUNT);
+   _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_COUNT, szFile);
    save_simple_config_fileI(szFile, s_iModelsCount);
+   _models_list_save_index();
    
    log_line("Added a new model in the controller's models list, VID: %u", s_pModels[s_iModelsCount-1]->uVehicleId);
    return s_pModels[s_iModelsCount-1];
@@ -341,6 +660,9 @@ void replaceModel(int index, Model* pModel)
    if ( index < 0 || index >= MAX_MODELS-1 )
       return;
 
+   if ( index < s_iModelsCount )
+      _models_list_materialize(false, index);
+
    if ( (NULL != s_pCurrentModel) && (NULL != s_pModels[index]) )
    if ( s_pCurrentModel->uVehicleId == s_pModels[index]->uVehicleId )
       s_pCurrentModel = pModel;
@@ -354,6 +676,7 @@ void replaceModel(int index, Model* pModel)
           pModel->uVehicleId, pModel);
 
    s_pModels[index] = pModel;
+   _models_list_invalidate_index_entry(false, index, pModel);
 
    if ( NULL == s_pCurrentModel )
       log_line("Current model is NULL");
@@ -373,18 +696,18 @@ Model* findModelWithId(u32 uVehicleId, u32 uSrcId)
       return s_pCurrentModel;
 
    for( int i=0; i<s_iModelsCount; i++ )
-      if ( s_pModels[i]->uVehicleId == uVehicleId )
-         return s_pModels[i];
+      if ( _models_list_get_vehicle_id(false, i) == uVehicleId )
+         return _models_list_materialize(false, i);
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
-      if ( s_pModelsSpectator[i]->uVehicleId == uVehicleId )
-         return s_pModelsSpectator[i];
+      if ( _models_list_get_vehicle_id(true, i) == uVehicleId )
+         return _models_list_materialize(true, i);
 
    log_softerror_and_alarm("Tried to find an inexistent VID: %u (source id: %u). Current loaded vehicles:", uVehicleId, uSrcId);
    for( int i=0; i<s_iModelsCount; i++ )
-      log_softerror_and_alarm("Vehicle Ctrlr %d: %u", i, s_pModels[i]->uVehicleId);
+      log_softerror_and_alarm("Vehicle Ctrlr %d: %u", i, _models_list_get_vehicle_id(false, i));
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
-      log_softerror_and_alarm("Vehicle Spect %d: %u", i, s_pModelsSpectator[i]->uVehicleId);
+      log_softerror_and_alarm("Vehicle Spect %d: %u", i, _models_list_get_vehicle_id(true, i));
    if ( NULL == s_pCurrentModel )
       log_softerror_and_alarm("Current vehicle: NULL");
    else
@@ -401,11 +724,11 @@ bool controllerHasModelWithId(u32 uVehicleId)
    }
 
    for( int i=0; i<s_iModelsCount; i++ )
-      if ( s_pModels[i]->uVehicleId == uVehicleId )
+      if ( _models_list_get_vehicle_id(false, i) == uVehicleId )
          return true;
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
-      if ( s_pModelsSpectator[i]->uVehicleId == uVehicleId )
+      if ( _models_list_get_vehicle_id(true, i) == uVehicleId )
          return true;
 
    return false;
@@ -440,48 +763,43 @@ Model* deleteModel(Model* pModel)
 
    for( pos=0; pos<s_iModelsCount; pos++ )
    {
-      if ( s_pModels[pos]->uVehicleId != pModel->uVehicleId )
+      if ( _models_list_get_vehicle_id(false, pos) != pModel->uVehicleId )
          continue;
 
       log_line("Deleting controller model index %d: VID %u, ptr: %X", pos+1, pModel->uVehicleId, pModel);
       
-      if ( (NULL != s_pCurrentModel) && (s_pModels[pos]->uVehicleId == s_pCurrentModel->uVehicleId) )
+      if ( (NULL != s_pCurrentModel) && (_models_list_get_vehicle_id(false, pos) == s_pCurrentModel->uVehicleId) )
       {
          log_line("Model to delete is also the current model. Delete it too.");
-         strcpy(szFile, FOLDER_CONFIG);
-         strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL_BACKUP);
+         _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL_BACKUP, szFile);
          unlink(szFile);
-         strcpy(szFile, FOLDER_CONFIG);
-         strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL);
+         _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL, szFile);
          unlink(szFile);
          log_line("Deleted current vehicle (VID %u, ptr: %X) model file: %s", s_pCurrentModel->uVehicleId, s_pCurrentModel, szFile);
          s_pCurrentModel = NULL;
       }
       
+      // Models after the deleted one are saved to new slots, load them first
+      for( int i=pos+1; i<s_iModelsCount; i++ )
+         _models_list_materialize(false, i);
       for( int i=pos; i<s_iModelsCount-1; i++ )
+      {
          s_pModels[i] = s_pModels[i+1];
+         memcpy(&s_ControllerModelsIndex[i], &s_ControllerModelsIndex[i+1], sizeof(t_model_index_entry));
+      }
       s_iModelsCount--;
 
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_CONTROLL);
-      sprintf(szFile, szFolderM, s_iModelsCount);
+      _models_list_get_model_file(false, s_iModelsCount, szFile);
       unlink(szFile);
       szFile[strlen(szFile)-3] = 0;
       strcat(szFile, "bak");
       unlink(szFile);
       
       log_line("Saving %d controller models.", s_iModelsCount);
-      strcpy(szFile, FOLDER_CONFIG);
-      strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_COUNT);
+      _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_COUNT, szFile);
       save_simple_config_fileI(szFile, s_iModelsCount);
       for( int i=pos; i<s_iModelsCount; i++ )
-      {
-         strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-         strcat(szFolderM, FILE_VEHICLE_CONTROLL);
-         sprintf(szFile, szFolderM, i);
-         s_pModels[i]->saveToFile(szFile, hardware_is_station());
-      }
+         _models_list_save_model(false, i, s_pModels[i]);
       bDeletedController = true;
       break;
    }
@@ -489,32 +807,32 @@ Model* deleteModel(Model* pModel)
    pos = 0;
    for( pos=0; pos<s_iModelsSpectatorCount; pos++ )
    {
-      if ( s_pModelsSpectator[pos]->uVehicleId != pModel->uVehicleId )
+      if ( _models_list_get_vehicle_id(true, pos) != pModel->uVehicleId )
          continue;
 
       log_line("Deleting spectator model index %d: VID %u, ptr: %X", pos+1, pModel->uVehicleId, pModel);
       
-      if ( (NULL != s_pCurrentModel) && (s_pModelsSpectator[pos]->uVehicleId == s_pCurrentModel->uVehicleId) )
+      if ( (NULL != s_pCurrentModel) && (_models_list_get_vehicle_id(true, pos) == s_pCurrentModel->uVehicleId) )
       {
          log_line("Model to delete is also the current spectator model. Delete it too.");
-         strcpy(szFile, FOLDER_CONFIG);
-         strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL_BACKUP);
+         _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL_BACKUP, szFile);
          unlink(szFile);
-         strcpy(szFile, FOLDER_CONFIG);
-         strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL);
+         _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL, szFile);
          unlink(szFile);
          log_line("Deleted current vehicle (VID %u, ptr: %X) model file: %s", s_pCurrentModel->uVehicleId, s_pCurrentModel, szFile);
          s_pCurrentModel = NULL;
       }
       
+      for( int i=pos+1; i<s_iModelsSpectatorCount; i++ )
+         _models_list_materialize(true, i);
       for( int i=pos; i<s_iModelsSpectatorCount-1; i++ )
+      {
          s_pModelsSpectator[i] = s_pModelsSpectator[i+1];
+         memcpy(&s_SpectatorModelsIndex[i], &s_SpectatorModelsIndex[i+1], sizeof(t_model_index_entry));
+      }
       s_iModelsSpectatorCount--;
 
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
-      sprintf(szFile, szFolderM, s_iModelsSpectatorCount);
+      _models_list_get_model_file(true, s_iModelsSpectatorCount, szFile);
       unlink(szFile);
       szFile[strlen(szFile)-3] = 0;
       strcat(szFile, "bak");
@@ -522,18 +840,15 @@ Model* deleteModel(Model* pModel)
       
       log_line("Saving %d spectator models.", s_iModelsSpectatorCount);
       for( int i=pos; i<s_iModelsSpectatorCount; i++ )
-      {
-         strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-         strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
-         sprintf(szFile, szFolderM, i);
-         s_pModelsSpectator[i]->saveToFile(szFile, hardware_is_station());
-      }
+         _models_list_save_model(true, i, s_pModelsSpectator[i]);
       bDeletedSpectator = true;
       break;
    }
 
    if ( (!bDeletedSpectator) && (!bDeletedController) )
       log_softerror_and_alarm("Tried to delete a model that is not in the list.");
+   else
+      _models_list_save_index();
    return s_pCurrentModel;
 }
 
@@ -542,47 +857,47 @@ void saveControllerModel(Model* pModel)
    if ( NULL == pModel )
       return;
 
+   bool bUpdatedIndex = false;
    for( int i=0; i<s_iModelsCount; i++ )
    {
-      if ( s_pModels[i]->uVehicleId == pModel->uVehicleId )
-      if ( s_pModels[i]->is_spectator == pModel->is_spectator )
+      if ( _models_list_get_vehicle_id(false, i) == pModel->uVehicleId )
+      if ( _models_list_get_is_spectator(false, i) == pModel->is_spectator )
       {
          log_line("Found matching vehicle in controller's list while saving a model. Save it in controller's models list too.");
          char szFile[MAX_FILE_PATH_SIZE];
-         char szFolderM[MAX_FILE_PATH_SIZE];
-         strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-         strcat(szFolderM, FILE_VEHICLE_CONTROLL);
-         sprintf(szFile, szFolderM, i);
+         _models_list_get_model_file(false, i, szFile);
          pModel->saveToFile(szFile, true);
-         s_pModels[i]->loadFromFile(szFile, true);
+         _models_list_materialize(false, i)->loadFromFile(szFile, true);
+         _models_list_update_index_entry(false, i, s_pModels[i]);
+         bUpdatedIndex = true;
          break;
       }
    }
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-      if ( s_pModelsSpectator[i]->uVehicleId == pModel->uVehicleId )
-      if ( s_pModelsSpectator[i]->is_spectator == pModel->is_spectator )
+      if ( _models_list_get_vehicle_id(true, i) == pModel->uVehicleId )
+      if ( _models_list_get_is_spectator(true, i) == pModel->is_spectator )
       {
          log_line("Found matching spectator vehicle in list.");
          char szFile[MAX_FILE_PATH_SIZE];
-         char szFolderM[MAX_FILE_PATH_SIZE];
-         strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-         strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
-         sprintf(szFile, szFolderM, i);
+         _models_list_get_model_file(true, i, szFile);
          pModel->saveToFile(szFile, true);
-         s_pModelsSpectator[i]->loadFromFile(szFile, true);
+         _models_list_materialize(true, i)->loadFromFile(szFile, true);
+         _models_list_update_index_entry(true, i, s_pModelsSpectator[i]);
+         bUpdatedIndex = true;
          break;
       }
    }
+   if ( bUpdatedIndex )
+      _models_list_save_index();
 
    if ( NULL != s_pCurrentModel )
    if ( pModel->uVehicleId == s_pCurrentModel->uVehicleId )
    {
       log_line("Saving model VID %u, ptr: %X, as current model", s_pCurrentModel->uVehicleId, s_pCurrentModel);
       char szFile[MAX_FILE_PATH_SIZE];
-      strcpy(szFile, FOLDER_CONFIG);
-      strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_MODEL);
+      _models_list_get_config_file(FILE_CONFIG_CURRENT_VEHICLE_MODEL, szFile);
       pModel->saveToFile(szFile, true);
       s_pCurrentModel->loadFromFile(szFile, true);
    }
@@ -592,9 +907,9 @@ Model* setControllerCurrentModel(u32 uVehicleId)
 {
    for( int i=0; i<s_iModelsCount; i++ )
    {
-      if ( s_pModels[i]->uVehicleId == uVehicleId )
+      if ( _models_list_get_vehicle_id(false, i) == uVehicleId )
       {
-         s_pCurrentModel = s_pModels[i];
+         s_pCurrentModel = _models_list_materialize(false, i);
          log_line("Set VID %u, index %d as current controller model", uVehicleId, i);
          return s_pCurrentModel;
       }
@@ -602,9 +917,9 @@ Model* setControllerCurrentModel(u32 uVehicleId)
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-      if ( s_pModelsSpectator[i]->uVehicleId == uVehicleId )
+      if ( _models_list_get_vehicle_id(true, i) == uVehicleId )
       {
-         s_pCurrentModel = s_pModelsSpectator[i];
+         s_pCurrentModel = _models_list_materialize(true, i);
          log_line("Set VID %u, index %d as current spectator model", uVehicleId, i);
          return s_pCurrentModel;
       }
@@ -614,13 +929,13 @@ Model* setControllerCurrentModel(u32 uVehicleId)
 
 void logControllerModels()
 {
-   log_line("Controller models: %d controller mode models, %d spectator mode models, has current model: %s",
-      s_iModelsCount, s_iModelsSpectatorCount, s_pCurrentModel != NULL? "yes": "no");
+   log_line("Controller models: %d controller mode models (%d loaded), %d spectator mode models, has current model: %s",
+      s_iModelsCount, getLoadedModelsCount(), s_iModelsSpectatorCount, s_pCurrentModel != NULL? "yes": "no");
 
    for( int i=0; i<s_iModelsCount; i++ )
    {
       if ( NULL == s_pModels[i] )
-         log_error_and_alarm("Controller model %d: is NULL.", i+1);
+         log_line("Controller model %d: VID %u, not loaded (indexed), name: [%s]", i+1, s_ControllerModelsIndex[i].uVehicleId, s_ControllerModelsIndex[i].szVehicleName);
       else
          log_line("Controller model %d: VID %u, ptr: %X, is spectator: %s, must sync: %s",
             i+1, s_pModels[i]->uVehicleId, s_pModels[i], s_pModels[i]->is_spectator?"yes":"no", s_pModels[i]->b_mustSyncFromVehicle?"yes":"no");
@@ -628,8 +943,8 @@ void logControllerModels()
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-      if ( NULL == s_pModels[i] )
-         log_error_and_alarm("Spectator model %d: is NULL.", i+1);
+      if ( NULL == s_pModelsSpectator[i] )
+         log_line("Spectator model %d: VID %u, not loaded (indexed), name: [%s]", i+1, s_SpectatorModelsIndex[i].uVehicleId, s_SpectatorModelsIndex[i].szVehicleName);
       else
          log_line("Spectator model %d: VID %u, ptr: %X, is spectator: %s, must sync: %s",
          i+1, s_pModelsSpectator[i]->uVehicleId, s_pModelsSpectator[i], s_pModelsSpectator[i]->is_spectator?"yes":"no", s_pModelsSpectator[i]->b_mustSyncFromVehicle?"yes":"no");
@@ -3,6 +3,18 @@
 #include "config.h"
 #include "models.h"
 
+// Index entry for a controller/spectator models list slot. Lets the list be browsed without loading the models.
+typedef struct
+{
+   u32 uVehicleId;
+   u8 uVehicleType;
+   u8 uIsSpectator;
+   char szVehicleName[MAX_VEHICLE_NAME_LENGTH];
+   // Stamp of the slot model file the entry was built from
+   u32 uFileTimeSec;
+   u32 uFileTimeNSec;
+   u32 uFileSize;
+} t_model_index_entry;
 
 bool loadAllModels();
 bool saveCurrentModel();
@@ -12,6 +24,13 @@ void setCurrentModel(u32 uVehicleId);
 
 int getControllerModelsCount();
 int getControllerModelsSpectatorCount();
+// How many controller/spectator models are loaded in memory (the others are only indexed)
+int getLoadedModelsCount();
+t_model_index_entry* getControllerModelIndexEntry(int iIndex);
+t_model_index_entry* getSpectatorModelIndexEntry(int iIndex);
+
+// Overrides the config and models folders (i.e. for tests). Folders must end with '/'
+void setModelsListFolders(const char* szConfigFolder, const char* szModelsFolder);
 
 void deleteAllModels();
 
@@ -0,0 +1,181 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "packet_pool.h"
+
+#define PACKET_POOL_SLAB_ALL_FREE ((u32)0xFFFFFFFF)
+
+void packet_pool_init(t_packet_pool* pPool, int iSlotSize, int iReserveSlots)
+{
+   if ( NULL == pPool )
+      return;
+   memset(pPool, 0, sizeof(t_packet_pool));
+   if ( iSlotSize < 1 )
+      iSlotSize = 1;
+   pPool->iSlotSize = ((iSlotSize + PACKET_POOL_SLOT_ALIGNMENT - 1) / PACKET_POOL_SLOT_ALIGNMENT) * PACKET_POOL_SLOT_ALIGNMENT;
+   pPool->iReserveSlots = iReserveSlots;
+}
+
+void packet_pool_uninit(t_packet_pool* pPool)
+{
+   if ( NULL == pPool )
+      return;
+   for( int i=0; i<PACKET_POOL_MAX_SLABS; i++ )
+   {
+      if ( NULL != pPool->pSlabs[i] )
+         free(pPool->pSlabs[i]);
+      pPool->pSlabs[i] = NULL;
+      pPool->uSlabFreeMask[i] = 0;
+   }
+   pPool->iCountSlabs = 0;
+   pPool->iFirstSlabWithFree = 0;
+   pPool->iUsedSlots = 0;
+}
+
+static void _packet_pool_release_slab(t_packet_pool* pPool, int iSlab)
+{
+   free(pPool->pSlabs[iSlab]);
+   pPool->pSlabs[iSlab] = NULL;
+   pPool->uSlabFreeMask[iSlab] = 0;
+   pPool->iCountSlabs--;
+   pPool->uSlabReleases++;
+}
+
+// Free slots left allocated if one more slab is released
+static int _packet_pool_can_release_slab(t_packet_pool* pPool)
+{
+   return ((pPool->iCountSlabs - 1) * PACKET_POOL_SLOTS_PER_SLAB - pPool->iUsedSlots >= pPool->iReserveSlots);
+}
+
+void packet_pool_set_reserve(t_packet_pool* pPool, int iReserveSlots)
+{
+   if ( NULL == pPool )
+      return;
+   pPool->iReserveSlots = iReserveSlots;
+
+   // Release the free slabs above the new reserve, highest first
+   for( int i=PACKET_POOL_MAX_SLABS-1; i>=0; i-- )
+   {
+      if ( ! _packet_pool_can_release_slab(pPool) )
+         break;
+      if ( (NULL != pPool->pSlabs[i]) && (pPool->uSlabFreeMask[i] == PACKET_POOL_SLAB_ALL_FREE) )
+         _packet_pool_release_slab(pPool, i);
+   }
+}
+
+u16 packet_pool_alloc(t_packet_pool* pPool)
+{
+   if ( NULL == pPool )
+      return PACKET_POOL_INVALID_SLOT;
+
+   // Use the allocated slabs first, so a released slab is not allocated again right away
+   int iSlab = -1;
+   for( int i=pPool->iFirstSlabWithFree; i<PACKET_POOL_MAX_SLABS; i++ )
+   {
+      if ( (NULL != pPool->pSlabs[i]) && (0 != pPool->uSlabFreeMask[i]) )
+      {
+         iSlab = i;
+         break;
+      }
+   }
+
+   if ( -1 == iSlab )
+   {
+      for( int i=0; i<PACKET_POOL_MAX_SLABS; i++ )
+      {
+         if ( NULL == pPool->pSlabs[i] )
+         {
+            iSlab = i;
+            break;
+         }
+      }
+      if ( -1 == iSlab )
+      {
+         pPool->uAllocFailures++;
+         return PACKET_POOL_INVALID_SLOT;
+      }
+      pPool->pSlabs[iSlab] = (u8*)malloc(pPool->iSlotSize * PACKET_POOL_SLOTS_PER_SLAB);
+      if ( NULL == pPool->pSlabs[iSlab] )
+      {
+         log_softerror_and_alarm("[PacketPool] Failed to allocate a slab of %d bytes.", pPool->iSlotSize * PACKET_POOL_SLOTS_PER_SLAB);
+         pPool->uAllocFailures++;
+         return PACKET_POOL_INVALID_SLOT;
+      }
+      pPool->uSlabFreeMask[iSlab] = PACKET_POOL_SLAB_ALL_FREE;
+      pPool->iCountSlabs++;
+      pPool->uSlabAllocations++;
+   }
+
+   int iSlot = __builtin_ctz(pPool->uSlabFreeMask[iSlab]);
+   pPool->uSlabFreeMask[iSlab] &= ~(((u32)1) << iSlot);
+   pPool->iFirstSlabWithFree = iSlab;
+   pPool->iUsedSlots++;
+   if ( pPool->iUsedSlots > pPool->iPeakUsedSlots )
+      pPool->iPeakUsedSlots = pPool->iUsedSlots;
+   return (u16)(iSlab * PACKET_POOL_SLOTS_PER_SLAB + iSlot);
+}
+
+void packet_pool_free(t_packet_pool* pPool, u16 uSlot)
+{
+   if ( (NULL == pPool) || (PACKET_POOL_INVALID_SLOT == uSlot) )
+      return;
+   int iSlab = uSlot / PACKET_POOL_SLOTS_PER_SLAB;
+   u32 uBit = ((u32)1) << (uSlot % PACKET_POOL_SLOTS_PER_SLAB);
+   if ( (iSlab >= PACKET_POOL_MAX_SLABS) || (NULL == pPool->pSlabs[iSlab]) || (pPool->uSlabFreeMask[iSlab] & uBit) )
+   {
+      log_softerror_and_alarm("[PacketPool] Tried to free an invalid slot: %d", (int)uSlot);
+      return;
+   }
+   pPool->uSlabFreeMask[iSlab] |= uBit;
+   pPool->iUsedSlots--;
+   if ( iSlab < pPool->iFirstSlabWithFree )
+      pPool->iFirstSlabWithFree = iSlab;
+
+   if ( pPool->uSlabFreeMask[iSlab] == PACKET_POOL_SLAB_ALL_FREE )
+   if ( _packet_pool_can_release_slab(pPool) )
+      _packet_pool_release_slab(pPool, iSlab);
+}
+
+int packet_pool_get_resident_bytes(t_packet_pool* pPool)
+{
+   if ( NULL == pPool )
+      return 0;
+   return pPool->iCountSlabs * PACKET_POOL_SLOTS_PER_SLAB * pPool->iSlotSize;
+}
+
+void packet_pool_log_info(t_packet_pool* pPool, const char* szName)
+{
+   if ( NULL == pPool )
+      return;
+   log_line("[PacketPool] %s: slot size: %d bytes, used slots: %d (peak %d), reserve: %d, slabs: %d (%d kb), slab allocs/releases: %u/%u, failed allocs: %u",
+      (NULL != szName)?szName:"", pPool->iSlotSize, pPool->iUsedSlots, pPool->iPeakUsedSlots, pPool->iReserveSlots,
+      pPool->iCountSlabs, packet_pool_get_resident_bytes(pPool)/1024, pPool->uSlabAllocations, pPool->uSlabReleases, pPool->uAllocFailures);
+}
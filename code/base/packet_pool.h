@@ -0,0 +1,45 @@
+#pragma once
+#include "base.h"
+#include "../radio/radiopackets2.h"
+
+// Pool of fixed size packet buffers, allocated in slabs of PACKET_POOL_SLOTS_PER_SLAB slots.
+// A packet is referenced by its slot number (u16), so the per packet state kept by the users is small.
+// Allocation takes the first free slot of the lowest slab, so the used slots stay packed in the first
+// slabs. A slab that gets completely free is released as long as more than the reserve of free slots
+// remains allocated, so the resident memory follows the packets actually held, not the worst case.
+
+#define PACKET_POOL_SLOTS_PER_SLAB 32
+#define PACKET_POOL_MAX_SLABS (((MAX_RXTX_BLOCKS_BUFFER * MAX_TOTAL_PACKETS_IN_BLOCK) / PACKET_POOL_SLOTS_PER_SLAB) + 4)
+#define PACKET_POOL_INVALID_SLOT 0xFFFF
+#define PACKET_POOL_SLOT_ALIGNMENT 64
+
+typedef struct
+{
+   u8* pSlabs[PACKET_POOL_MAX_SLABS]; // NULL if the slab is not allocated
+   u32 uSlabFreeMask[PACKET_POOL_MAX_SLABS]; // bit set: slot is free
+   int iSlotSize;
+   int iReserveSlots; // free slots kept allocated
+   int iCountSlabs; // allocated slabs
+   int iFirstSlabWithFree; // no free slot in the slabs below this one
+   int iUsedSlots;
+   int iPeakUsedSlots;
+   u32 uSlabAllocations;
+   u32 uSlabReleases;
+   u32 uAllocFailures;
+} t_packet_pool;
+
+// iSlotSize is rounded up to PACKET_POOL_SLOT_ALIGNMENT. No memory is allocated until the first packet.
+void packet_pool_init(t_packet_pool* pPool, int iSlotSize, int iReserveSlots);
+// Releases all the memory; slots still in use become invalid
+void packet_pool_uninit(t_packet_pool* pPool);
+void packet_pool_set_reserve(t_packet_pool* pPool, int iReserveSlots);
+// Returns the slot, or PACKET_POOL_INVALID_SLOT if the pool is full or out of memory
+u16 packet_pool_alloc(t_packet_pool* pPool);
+void packet_pool_free(t_packet_pool* pPool, u16 uSlot);
+int packet_pool_get_resident_bytes(t_packet_pool* pPool);
+void packet_pool_log_info(t_packet_pool* pPool, const char* szName);
+
+static inline u8* packet_pool_get(t_packet_pool* pPool, u16 uSlot)
+{
+   return pPool->pSlabs[uSlot / PACKET_POOL_SLOTS_PER_SLAB] + (uSlot % PACKET_POOL_SLOTS_PER_SLAB) * pPool->iSlotSize;
+}
@@ -32,7 +32,7 @@
 #include "parse_fc_telemetry.h"
 #include "parse_fc_telemetry_ltm.h"
 #include <math.h>
-#include "../../mavlink/common/mavlink.h"
+#include "telemetry_bulk_parser.h"
 #include "../base/models.h"
 #include "../radio/radiopackets2.h"
 
@@ -134,8 +134,26 @@ typedef enum ROVER_MODE
 } ROVER_MODE;
 #endif
  
-mavlink_status_t statusMav;
-mavlink_message_t msgMav;
+// The messages parsed from the FC, all other messages are skipped without being decoded
+static const u32 s_uMAVParsedMessagesIds[] =
+{
+   MAVLINK_MSG_ID_STATUSTEXT, MAVLINK_MSG_ID_STATUSTEXT_LONG, MAVLINK_MSG_ID_HEARTBEAT, MAVLINK_MSG_ID_BATTERY_STATUS,
+   MAVLINK_MSG_ID_SYS_STATUS, MAVLINK_MSG_ID_GLOBAL_POSITION_INT, MAVLINK_MSG_ID_GPS_RAW_INT, MAVLINK_MSG_ID_GPS2_RAW,
+   MAVLINK_MSG_ID_VFR_HUD, MAVLINK_MSG_ID_ATTITUDE, MAVLINK_MSG_ID_RC_CHANNELS_RAW, MAVLINK_MSG_ID_RC_CHANNELS,
+   MAVLINK_MSG_ID_RADIO_STATUS, MAVLINK_MSG_ID_HIGH_LATENCY, MAVLINK_MSG_ID_HIGH_LATENCY2, MAVLINK_MSG_ID_SCALED_PRESSURE,
+   MAVLINK_MSG_ID_WIND_COV
+};
+
+typedef struct
+{
+   t_packet_header_fc_telemetry* pPHFCT;
+   t_packet_header_ruby_telemetry_extended_v3* pPHRTE;
+   u8 uVehicleType;
+} t_mav_parse_context;
+
+static t_mavlink_bulk_parser s_MAVBulkParser;
+static t_mav_parse_context s_MAVParseContext;
+static bool s_bMAVBulkParserInitialized = false;
 u32 s_vehicleMavId = 1;
 int s_iAllowAnyVehicleSysId = 0;
 
@@ -299,8 +317,12 @@ bool _check_add_fc_message(char* szMessage)
    return true;
 }
 
-void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_ruby_telemetry_extended_v3* pPHRTE, u8 vehicleType)
+void _process_mav_message(const t_mavlink_bulk_message* pMessage, void* pContext)
 {
+   t_mav_parse_context* pParseContext = (t_mav_parse_context*)pContext;
+   t_packet_header_fc_telemetry* pdpfct = pParseContext->pPHFCT;
+   t_packet_header_ruby_telemetry_extended_v3* pPHRTE = pParseContext->pPHRTE;
+   u8 vehicleType = pParseContext->uVehicleType;
    char szBuff[512];
    u32 tmp32;
    u8 tmp8;
@@ -309,18 +331,18 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
    //u32 uTmp32;
 
    if ( 0 == s_iAllowAnyVehicleSysId )
-   if ( (msgMav.sysid != s_vehicleMavId) && (msgMav.sysid != 0) )
+   if ( (pMessage->uSysId != s_vehicleMavId) && (pMessage->uSysId != 0) )
       return;
 
    #ifdef DEBUG_MAV
-   log_line("MAV Msg id: %d", msgMav.msgid);
-   printf("MAV Msg id: %d\n", msgMav.msgid);
+   log_line("MAV Msg id: %u", pMessage->uMessageId);
+   printf("MAV Msg id: %u\n", pMessage->uMessageId);
    #endif
 
-   switch (msgMav.msgid)
+   switch (pMessage->uMessageId)
    { 
       case MAVLINK_MSG_ID_STATUSTEXT:
-         mavlink_msg_statustext_get_text(&msgMav, szBuff);
+         mavlink_bulk_get_string(pMessage, MAVLINK_BULK_OFFSET(statustext, text), MAVLINK_MSG_STATUSTEXT_FIELD_TEXT_LEN, szBuff);
          if ( _check_add_fc_message(szBuff) )
             log_line("MAV status text: %s", szBuff);
          #ifdef DEBUG_MAV
@@ -329,7 +351,7 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          break;
 
       case MAVLINK_MSG_ID_STATUSTEXT_LONG:
-         mavlink_msg_statustext_long_get_text(&msgMav, szBuff);
+         mavlink_bulk_get_string(pMessage, MAVLINK_BULK_OFFSET(statustext_long, text), MAVLINK_MSG_STATUSTEXT_LONG_FIELD_TEXT_LEN, szBuff);
          if ( _check_add_fc_message(szBuff) )
             log_line("MAV status text long: %s", szBuff);
          #ifdef DEBUG_MAV
@@ -339,11 +361,11 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
 
       case MAVLINK_MSG_ID_HEARTBEAT:
          #ifdef DEBUG_MAV
-         log_line("MAV Heart Beat, type: %d, autopilot: %d", mavlink_msg_heartbeat_get_type(&msgMav), mavlink_msg_heartbeat_get_autopilot(&msgMav));
-         printf("MAV Heart Beat, type: %d, autopilot: %d\n", mavlink_msg_heartbeat_get_type(&msgMav), mavlink_msg_heartbeat_get_autopilot(&msgMav));
+         log_line("MAV Heart Beat, type: %d, autopilot: %d", mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(heartbeat, type)), mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(heartbeat, autopilot)));
+         printf("MAV Heart Beat, type: %d, autopilot: %d\n", mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(heartbeat, type)), mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(heartbeat, autopilot)));
          #endif
-         tmp32 = mavlink_msg_heartbeat_get_custom_mode(&msgMav);
-         tmp8 = mavlink_msg_heartbeat_get_base_mode(&msgMav);
+         tmp32 = mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(heartbeat, custom_mode));
+         tmp8 = mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(heartbeat, base_mode));
          pdpfct->flight_mode = 0;
          /*
          switch ( tmp8 )
@@ -451,7 +473,7 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          break;
 
       case MAVLINK_MSG_ID_BATTERY_STATUS:
-         imah = mavlink_msg_battery_status_get_current_consumed(&msgMav);
+         imah = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(battery_status, current_consumed));
          pdpfct->mah = (imah<0)?0:imah;
          #ifdef DEBUG_MAV
          log_line("MAV battery status: mah: %d, %u", imah, pdpfct->mah);
@@ -460,8 +482,8 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          break;
 
       case MAVLINK_MSG_ID_SYS_STATUS:
-         imah = mavlink_msg_sys_status_get_current_battery(&msgMav);
-         pdpfct->voltage = mavlink_msg_sys_status_get_voltage_battery(&msgMav);
+         imah = (int16_t)mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(sys_status, current_battery));
+         pdpfct->voltage = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(sys_status, voltage_battery));
          pdpfct->current = (imah<0)?0:(imah*10U);
          #ifdef DEBUG_MAV
          log_line("MAV Sys Status: volt: %f, amps: %f", pdpfct->voltage/100.0f, pdpfct->current/100.0f);
@@ -471,8 +493,8 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          break;
       
       case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
-         pdpfct->altitude_abs = mavlink_msg_global_position_int_get_alt(&msgMav) / 10.0f + 100000;
-         pdpfct->altitude = mavlink_msg_global_position_int_get_relative_alt(&msgMav) / 10.0f + 100000;
+         pdpfct->altitude_abs = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(global_position_int, alt)) / 10.0f + 100000;
+         pdpfct->altitude = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(global_position_int, relative_alt)) / 10.0f + 100000;
          //log_line("alt: %f, abs: %f", ((int)pdpfct->altitude-100000)/100.0, ((int)pdpfct->altitude_abs-100000)/100.0);
          {
             if ( s_bShowLocalVerticalSpeed )
@@ -498,10 +520,10 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
                }
             }
          }
-         pdpfct->heading = mavlink_msg_global_position_int_get_hdg(&msgMav) / 100.0f;
+         pdpfct->heading = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(global_position_int, hdg)) / 100.0f;
 
-         pdpfct->latitude = mavlink_msg_global_position_int_get_lat(&msgMav);
-         pdpfct->longitude = mavlink_msg_global_position_int_get_lon(&msgMav);
+         pdpfct->latitude = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(global_position_int, lat));
+         pdpfct->longitude = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(global_position_int, lon));
          s_bHasReceivedGPSPos = true;
          #ifdef DEBUG_MAV
          log_line("MAV Pos Int: alt absolute: %f", pdpfct->altitude_abs/10.0f);
@@ -510,12 +532,12 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          break;
 
      case MAVLINK_MSG_ID_GPS_RAW_INT:
-         pdpfct->gps_fix_type = mavlink_msg_gps_raw_int_get_fix_type(&msgMav);
-         pdpfct->satelites = mavlink_msg_gps_raw_int_get_satellites_visible(&msgMav);
-         pdpfct->hdop = mavlink_msg_gps_raw_int_get_eph(&msgMav);
-         pdpfct->latitude = mavlink_msg_gps_raw_int_get_lat(&msgMav);
-         pdpfct->longitude = mavlink_msg_gps_raw_int_get_lon(&msgMav);
-         //uTmp32 = mavlink_msg_gps_raw_int_get_alt(&msgMav)/1000.0f / 10.0 + 100000;
+         pdpfct->gps_fix_type = mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, fix_type));
+         pdpfct->satelites = mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, satellites_visible));
+         pdpfct->hdop = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, eph));
+         pdpfct->latitude = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, lat));
+         pdpfct->longitude = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, lon));
+         //uTmp32 = (int32_t)mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, alt))/1000.0f / 10.0 + 100000;
          //if ( pdpfct->gps_fix_type >= GPS_FIX_TYPE_3D_FIX )
          //   pdpfct->altitude_abs = uTmp32;
 
@@ -528,9 +550,9 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
 
       case MAVLINK_MSG_ID_GPS2_RAW:
       {
-         pdpfct->extra_info[1] = mavlink_msg_gps2_raw_get_satellites_visible(&msgMav);
-         pdpfct->extra_info[2] = mavlink_msg_gps2_raw_get_fix_type(&msgMav);
-         u16 hdop = mavlink_msg_gps2_raw_get_eph(&msgMav);
+         pdpfct->extra_info[1] = mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(gps2_raw, satellites_visible));
+         pdpfct->extra_info[2] = mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(gps2_raw, fix_type));
+         u16 hdop = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(gps2_raw, eph));
          pdpfct->extra_info[3] = (hdop >> 8);
          pdpfct->extra_info[4] = (hdop & 0xFF);
          s_bHasReceivedGPSInfo = true;
@@ -538,18 +560,18 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
       }
       
       case MAVLINK_MSG_ID_VFR_HUD: 
-         pdpfct->throttle = mavlink_msg_vfr_hud_get_throttle(&msgMav);
+         pdpfct->throttle = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, throttle));
          if ( pdpfct->throttle > 200 )
             pdpfct->throttle = 0;
          if ( pdpfct->throttle > 100 )
             pdpfct->throttle = 100;
-         //pdpfct->altitude = mavlink_msg_vfr_hud_get_alt(&msgMav)*100 + 100000;
+         //pdpfct->altitude = mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, alt))*100 + 100000;
 
          if ( ! s_bShowLocalVerticalSpeed )
-            pdpfct->vspeed = mavlink_msg_vfr_hud_get_climb(&msgMav)*100 + 100000; 
-         pdpfct->hspeed = mavlink_msg_vfr_hud_get_groundspeed(&msgMav) * 100.0f + 100000;
+            pdpfct->vspeed = mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, climb))*100 + 100000; 
+         pdpfct->hspeed = mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, groundspeed)) * 100.0f + 100000;
 
-         tmp32= mavlink_msg_vfr_hud_get_airspeed(&msgMav) * 100.0f + 100000;
+         tmp32= mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, airspeed)) * 100.0f + 100000;
          pdpfct->aspeed = tmp32;
          #ifdef DEBUG_MAV
          log_line("MAV HUD: alt: %f, vspeed: %f", pdpfct->altitude/100.0f, pdpfct->vspeed/100.0f);
@@ -559,8 +581,8 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
 
       case MAVLINK_MSG_ID_ATTITUDE: 
          pdpfct->flags = pdpfct->flags | FC_TELE_FLAGS_HAS_ATTITUDE;
-         pdpfct->roll = (mavlink_msg_attitude_get_roll(&msgMav) + 3.141592653589793)*5700.2958;
-         pdpfct->pitch = (mavlink_msg_attitude_get_pitch(&msgMav) + 3.141592653589793)*5700.2958;
+         pdpfct->roll = (mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(attitude, roll)) + 3.141592653589793)*5700.2958;
+         pdpfct->pitch = (mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(attitude, pitch)) + 3.141592653589793)*5700.2958;
          #ifdef DEBUG_MAV
          log_line("MAV attitude: pitch: %.1f, roll: %.1f", pdpfct->pitch/100.0f, pdpfct->roll/100.0f);
          printf("MAV attitude: pitch: %.1f, roll: %.1f\n", pdpfct->pitch/100.0f, pdpfct->roll/100.0f);
@@ -568,7 +590,7 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          break;
 
       case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
-         tmpi = (int)((u8)mavlink_msg_rc_channels_raw_get_rssi(&msgMav));
+         tmpi = (int)((u8)mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, rssi)));
          
          if ( /*(tmpi != 255) &&*/ (NULL != pPHRTE) )
          {
@@ -583,18 +605,18 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          //if ( NULL != pPHRTE && (pPHRTE->flags & FLAG_RUBY_TELEMETRY_HAS_MAVLINK_RC_RSSI) && (tmpi == 255) )
          //   pPHRTE->uplink_mavlink_rc_rssi = 255;
 
-         s_MAVLinkRCChannels[0] = mavlink_msg_rc_channels_raw_get_chan1_raw(&msgMav);
-         s_MAVLinkRCChannels[1] = mavlink_msg_rc_channels_raw_get_chan2_raw(&msgMav);
-         s_MAVLinkRCChannels[2] = mavlink_msg_rc_channels_raw_get_chan3_raw(&msgMav);
-         s_MAVLinkRCChannels[3] = mavlink_msg_rc_channels_raw_get_chan4_raw(&msgMav);
-         s_MAVLinkRCChannels[4] = mavlink_msg_rc_channels_raw_get_chan5_raw(&msgMav);
-         s_MAVLinkRCChannels[5] = mavlink_msg_rc_channels_raw_get_chan6_raw(&msgMav);
-         s_MAVLinkRCChannels[6] = mavlink_msg_rc_channels_raw_get_chan7_raw(&msgMav);
-         s_MAVLinkRCChannels[7] = mavlink_msg_rc_channels_raw_get_chan8_raw(&msgMav);
+         s_MAVLinkRCChannels[0] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan1_raw));
+         s_MAVLinkRCChannels[1] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan2_raw));
+         s_MAVLinkRCChannels[2] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan3_raw));
+         s_MAVLinkRCChannels[3] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan4_raw));
+         s_MAVLinkRCChannels[4] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan5_raw));
+         s_MAVLinkRCChannels[5] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan6_raw));
+         s_MAVLinkRCChannels[6] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan7_raw));
+         s_MAVLinkRCChannels[7] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels_raw, chan8_raw));
          break;
 
       case MAVLINK_MSG_ID_RC_CHANNELS:
-         tmpi = (int)((u8)mavlink_msg_rc_channels_get_rssi(&msgMav));
+         tmpi = (int)((u8)mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(rc_channels, rssi)));
          
          if ( /*(tmpi != 255) &&*/ (NULL != pPHRTE) )
          {
@@ -609,24 +631,24 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
          //if ( NULL != pPHRTE && (pPHRTE->flags & FLAG_RUBY_TELEMETRY_HAS_MAVLINK_RC_RSSI) && (tmpi == 255) )
          //   pPHRTE->uplink_mavlink_rc_rssi = 255;
 
-         s_MAVLinkRCChannels[0] = mavlink_msg_rc_channels_get_chan1_raw(&msgMav);
-         s_MAVLinkRCChannels[1] = mavlink_msg_rc_channels_get_chan2_raw(&msgMav);
-         s_MAVLinkRCChannels[2] = mavlink_msg_rc_channels_get_chan3_raw(&msgMav);
-         s_MAVLinkRCChannels[3] = mavlink_msg_rc_channels_get_chan4_raw(&msgMav);
-         s_MAVLinkRCChannels[4] = mavlink_msg_rc_channels_get_chan5_raw(&msgMav);
-         s_MAVLinkRCChannels[5] = mavlink_msg_rc_channels_get_chan6_raw(&msgMav);
-         s_MAVLinkRCChannels[6] = mavlink_msg_rc_channels_get_chan7_raw(&msgMav);
-         s_MAVLinkRCChannels[7] = mavlink_msg_rc_channels_get_chan8_raw(&msgMav);
-         s_MAVLinkRCChannels[8] = mavlink_msg_rc_channels_get_chan9_raw(&msgMav);
-         s_MAVLinkRCChannels[9] = mavlink_msg_rc_channels_get_chan10_raw(&msgMav);
-         s_MAVLinkRCChannels[10] = mavlink_msg_rc_channels_get_chan11_raw(&msgMav);
-         s_MAVLinkRCChannels[11] = mavlink_msg_rc_channels_get_chan12_raw(&msgMav);
-         s_MAVLinkRCChannels[12] = mavlink_msg_rc_channels_get_chan13_raw(&msgMav);
-         s_MAVLinkRCChannels[13] = mavlink_msg_rc_channels_get_chan14_raw(&msgMav);         
+         s_MAVLinkRCChannels[0] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan1_raw));
+         s_MAVLinkRCChannels[1] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan2_raw));
+         s_MAVLinkRCChannels[2] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan3_raw));
+         s_MAVLinkRCChannels[3] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan4_raw));
+         s_MAVLinkRCChannels[4] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan5_raw));
+         s_MAVLinkRCChannels[5] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan6_raw));
+         s_MAVLinkRCChannels[6] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan7_raw));
+         s_MAVLinkRCChannels[7] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan8_raw));
+         s_MAVLinkRCChannels[8] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan9_raw));
+         s_MAVLinkRCChannels[9] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan10_raw));
+         s_MAVLinkRCChannels[10] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan11_raw));
+         s_MAVLinkRCChannels[11] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan12_raw));
+         s_MAVLinkRCChannels[12] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan13_raw));
+         s_MAVLinkRCChannels[13] = mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan14_raw));         
          break;
 
       case MAVLINK_MSG_ID_RADIO_STATUS:
-         tmp8 = ((int)mavlink_msg_radio_status_get_rssi(&msgMav))*100/255;
+         tmp8 = ((int)mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(radio_status, rssi)))*100/255;
          //if ( tmp8 != 0xFF )
          //   pdpfct->rc_rssi = tmp8;
 
@@ -652,11 +674,11 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
       case MAVLINK_MSG_ID_HIGH_LATENCY:
          {
             //log_line("MSG_HIGH_LAT");
-            int iTemp = mavlink_msg_high_latency_get_temperature(&msgMav);
+            int iTemp = (int8_t)mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(high_latency, temperature));
             if ( iTemp < 100 && iTemp > -100 )
                pdpfct->temperature = 100 + (int) iTemp;
 
-            iTemp = mavlink_msg_high_latency_get_temperature_air(&msgMav);
+            iTemp = (int8_t)mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(high_latency, temperature_air));
             if ( iTemp < 100 && iTemp > -100 )
                pdpfct->temperature = 100 + (int) iTemp;
          }
@@ -665,16 +687,16 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
       case MAVLINK_MSG_ID_HIGH_LATENCY2:
          {
             //log_line("MSG_HIGH_LAT2");
-            int iTemp = mavlink_msg_high_latency2_get_temperature_air(&msgMav);
+            int iTemp = (int8_t)mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(high_latency2, temperature_air));
             if ( iTemp < 100 && iTemp > -100 )
                pdpfct->temperature = 100 + (int) iTemp;
 
-            u16 uDir = 2 * mavlink_msg_high_latency2_get_wind_heading(&msgMav);
+            u16 uDir = 2 * mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(high_latency2, wind_heading));
             uDir++;
             pdpfct->extra_info[7] = uDir >> 8;
             pdpfct->extra_info[8] = uDir & 0xFF;
              
-            u16 uSpeed = 100 * mavlink_msg_high_latency2_get_windspeed(&msgMav) / 5;
+            u16 uSpeed = 100 * mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(high_latency2, windspeed)) / 5;
             uSpeed++;
             pdpfct->extra_info[9] = uSpeed >> 8;
             pdpfct->extra_info[10] = uSpeed & 0xFF;
@@ -684,7 +706,7 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
       case MAVLINK_MSG_ID_SCALED_PRESSURE:
          {
             //log_line("SCALED PRESSURE");
-            int iTemp = mavlink_msg_scaled_pressure_get_temperature(&msgMav);
+            int iTemp = (int16_t)mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(scaled_pressure, temperature));
             iTemp = iTemp/100;
             if ( iTemp < 100 && iTemp > -100 )
                pdpfct->temperature = 100 + (int) iTemp;
@@ -707,9 +729,9 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
       case MAVLINK_MSG_ID_WIND_COV:
        {
           //log_line("WIND_COV");
-          float fWindX = mavlink_msg_wind_cov_get_wind_x(&msgMav);
-          float fWindY = mavlink_msg_wind_cov_get_wind_x(&msgMav);
-          //float fWindZ = mavlink_msg_wind_cov_get_wind_x(&msgMav);
+          float fWindX = mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(wind_cov, wind_x));
+          float fWindY = mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(wind_cov, wind_x));
+          //float fWindZ = mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(wind_cov, wind_x));
           if ( fabs(fWindX) + fabs(fWindY) > 0.0001 )
           {
              float fLen = sqrtf(fWindX*fWindX + fWindY * fWindY);
@@ -739,12 +761,12 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
             char szBuff[32];
             szBuff[0] = '*';
             szBuff[1] = 0;
-            mavlink_msg_param_value_get_param_id(&msgMav, szBuff);
-            u8 type = mavlink_msg_param_value_get_param_type(&msgMav);
-            //int val = (int)mavlink_msg_param_value_get_param_value(&msgMav);
-            //log_line("recv param '%s' (%d of %d),  value: %d", szBuff, (int)mavlink_msg_param_value_get_param_index(&msgMav), (int)mavlink_msg_param_value_get_param_count(&msgMav), val);
-            float val = (float)mavlink_msg_param_value_get_param_value(&msgMav);
-            log_line("recv param '%s'(%d of %d), type: %d, value: %f", szBuff, (int)mavlink_msg_param_value_get_param_index(&msgMav), (int)mavlink_msg_param_value_get_param_count(&msgMav), type, val);
+            mavlink_bulk_get_string(pMessage, MAVLINK_BULK_OFFSET(param_value, param_id), MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN, szBuff);
+            u8 type = mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(param_value, param_type));
+            //int val = (int)mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(param_value, param_value));
+            //log_line("recv param '%s' (%d of %d),  value: %d", szBuff, (int)mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(param_value, param_index)), (int)mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(param_value, param_count)), val);
+            float val = (float)mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(param_value, param_value));
+            log_line("recv param '%s'(%d of %d), type: %d, value: %f", szBuff, (int)mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(param_value, param_index)), (int)mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(param_value, param_count)), type, val);
          }
          */
          break;
@@ -757,20 +779,21 @@ bool parse_telemetry_from_fc( u8* buffer, int length, t_packet_header_fc_telemet
    if ( telemetry_type == TELEMETRY_TYPE_LTM )
       return parse_telemetry_from_fc_ltm(buffer, length, pphfct, pPHRTE, vehicleType);
 
-   bool ret = false;
-   uint8_t c;
-   for( int i=0; i<length; i++)
+   if ( ! s_bMAVBulkParserInitialized )
    {
-      c = *buffer;
-      buffer++;
-      if (mavlink_parse_char(0, c, &msgMav, &statusMav))
-      {
-         s_uTimeLastMAVLinkMessageFromFC = get_current_timestamp_ms();
-         ret = true;
-         _process_mav_message(pphfct, pPHRTE, vehicleType);
-      }
+      mavlink_bulk_init(&s_MAVBulkParser);
+      for( int i=0; i<(int)(sizeof(s_uMAVParsedMessagesIds)/sizeof(s_uMAVParsedMessagesIds[0])); i++ )
+         mavlink_bulk_register(&s_MAVBulkParser, s_uMAVParsedMessagesIds[i], _process_mav_message, &s_MAVParseContext);
+      s_bMAVBulkParserInitialized = true;
    }
-   return ret;
+   s_MAVParseContext.pPHFCT = pphfct;
+   s_MAVParseContext.pPHRTE = pPHRTE;
+   s_MAVParseContext.uVehicleType = vehicleType;
+
+   if ( mavlink_bulk_parse(&s_MAVBulkParser, buffer, length) <= 0 )
+      return false;
+   s_uTimeLastMAVLinkMessageFromFC = get_current_timestamp_ms();
+   return true;
 }
 
 bool has_received_gps_info()
@@ -32,7 +32,7 @@
 #include "../base/base.h"
 #include "parse_fc_telemetry_ltm.h"
 #include "parse_fc_telemetry.h"
-#include "../../mavlink/common/mavlink.h"
+#include "telemetry_bulk_parser.h"
 
 #define LIGHTTELEMETRY_START1 0x24 //$ Header byte 1
 #define LIGHTTELEMETRY_START2 0x54 //T Header byte 2
@@ -44,19 +44,6 @@
 #define LIGHTTELEMETRY_SFRAME 0x53 //S Status frame: Sensors/Status data (VBat, Consumed current, Rssi, Airspeed, Arm status, Failsafe status, Flight mode)
 #define LIGHTTELEMETRY_XFRAME 'X' //X GPS eXtra frame: (GPS HDOP value, hw_status (failed sensor))
 
-// complete length including headers and checksum
-#define LIGHTTELEMETRY_GFRAMELENGTH 18
-#define LIGHTTELEMETRY_AFRAMELENGTH 10
-#define LIGHTTELEMETRY_SFRAMELENGTH 11
-#define LIGHTTELEMETRY_OFRAMELENGTH 18
-#define LIGHTTELEMETRY_NFRAMELENGTH 10
-#define LIGHTTELEMETRY_XFRAMELENGTH 10  
-
-#define LTM_PARSE_STATE_IDLE 0
-#define LTM_PARSE_STATE_HEADER_START1 1
-#define LTM_PARSE_STATE_HEADER_START2 2
-#define LTM_PARSE_STATE_HEADER_MSGTYPE 3
-#define LTM_PARSE_STATE_HEADER_DATA 4
 
 
 extern bool s_bHasReceivedGPSInfo;
@@ -66,13 +53,20 @@ extern bool s_bHasReceivedHeartbeat;
 extern int s_iHeartbeatMsgCount;
 extern int s_iSystemMsgCount;
 
-static u8 s_StateLTMParser = LTM_PARSE_STATE_IDLE;
+typedef struct
+{
+   t_packet_header_fc_telemetry* pPHFCT;
+   t_packet_header_ruby_telemetry_extended_v3* pPHRTE;
+   u8 uVehicleType;
+   bool bParsed;
+} t_ltm_parse_context;
+
+static t_ltm_bulk_parser s_LTMBulkParser;
+static t_ltm_parse_context s_LTMParseContext;
+static bool s_bLTMBulkParserInitialized = false;
 static u8 s_LTMExpectedFrameType = 0;
-static u8 s_LTMExpectedPayloadLength = 0;
-static u8 s_StateLTMChecksum = 0;
-static u8 s_StateLTMPayloadAddIndex = 0;
-
-static u8 s_LTMPayloadBuffer[1024];
+// Points to the payload of the frame being parsed, in the serial read buffer
+static const u8* s_pLTMPayload = NULL;
 static u8 s_LTMPayloadReadIndex = 0;
 
 static u32 s_LTMLastCurrentComputeTime = 0;
@@ -83,7 +77,7 @@ static long s_LastLTM_Altitude = 0; // in 1/10 m
 
 u8 parse_ltm_read_u8()
 {
-   return s_LTMPayloadBuffer[s_LTMPayloadReadIndex++];
+   return s_pLTMPayload[s_LTMPayloadReadIndex++];
 }
 
 
@@ -278,81 +272,28 @@ bool _parse_ltm_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_ru
 
 
 
+static void _parse_ltm_on_frame(u8 uFrameType, const u8* pPayload, int iPayloadLength, void* pContext)
+{
+   t_ltm_parse_context* pParseContext = (t_ltm_parse_context*)pContext;
+   s_LTMExpectedFrameType = uFrameType;
+   s_pLTMPayload = pPayload;
+   s_LTMPayloadReadIndex = 0;
+   if ( _parse_ltm_message(pParseContext->pPHFCT, pParseContext->pPHRTE, pParseContext->uVehicleType) )
+      pParseContext->bParsed = true;
+}
+
 bool parse_telemetry_from_fc_ltm( u8* buffer, int length, t_packet_header_fc_telemetry* pphfct, t_packet_header_ruby_telemetry_extended_v3* pPHRTE, u8 vehicleType)
 {
-   bool ret = false;
-   u8 c;
-   for( int i=0; i<length; i++)
+   if ( ! s_bLTMBulkParserInitialized )
    {
-      c = *buffer;
-      buffer++;
-      if ( s_StateLTMParser == LTM_PARSE_STATE_IDLE )
-      {
-         s_StateLTMParser = (c=='$') ? LTM_PARSE_STATE_HEADER_START1 : LTM_PARSE_STATE_IDLE;
-         continue;
-      }
-      if ( s_StateLTMParser == LTM_PARSE_STATE_HEADER_START1 )
-      {
-         s_StateLTMParser = (c=='T') ? LTM_PARSE_STATE_HEADER_START2 : LTM_PARSE_STATE_IDLE;
-         continue;
-      }
-      if ( s_StateLTMParser == LTM_PARSE_STATE_HEADER_START2 )
-      {
-         s_LTMExpectedPayloadLength = 0;
-         switch (c)
-         {
-            case 'G':
-               s_LTMExpectedPayloadLength = LIGHTTELEMETRY_GFRAMELENGTH;
-               break;
-            case 'A':
-               s_LTMExpectedPayloadLength = LIGHTTELEMETRY_AFRAMELENGTH;
-               break;
-            case 'S':
-               s_LTMExpectedPayloadLength = LIGHTTELEMETRY_SFRAMELENGTH;
-               break;
-            case 'O':
-               s_LTMExpectedPayloadLength = LIGHTTELEMETRY_OFRAMELENGTH;
-               break;
-            case 'N':
-               s_LTMExpectedPayloadLength = LIGHTTELEMETRY_NFRAMELENGTH;
-               break;
-            case 'X':
-               s_LTMExpectedPayloadLength = LIGHTTELEMETRY_XFRAMELENGTH;
-               break;
-            default:
-               s_StateLTMParser = LTM_PARSE_STATE_IDLE;
-               break;
-         }
-         if ( s_LTMExpectedPayloadLength > 0 )
-            s_StateLTMParser = LTM_PARSE_STATE_HEADER_MSGTYPE;
-         s_LTMExpectedFrameType = c;
-         s_StateLTMPayloadAddIndex = 0;
-         continue;
-      }
-
-      if ( s_StateLTMParser == LTM_PARSE_STATE_HEADER_MSGTYPE )
-      {
-           if ( s_StateLTMPayloadAddIndex == 0 )
-              s_StateLTMChecksum = c;
-           else 
-              s_StateLTMChecksum ^= c;
-
-           if (s_StateLTMPayloadAddIndex == s_LTMExpectedPayloadLength-4)
-           {
-              // Received checksum byte
-              s_LTMPayloadReadIndex = 0;
-              if ( s_StateLTMChecksum == 0 )
-              {
-                 set_time_last_mavlink_message_from_fc(get_current_timestamp_ms());
-                 ret = _parse_ltm_message( pphfct, pPHRTE, vehicleType );
-                 //printf("\nrecv %c ltm frame, %d bytes", s_LTMExpectedFrameType, s_StateLTMPayloadAddIndex );
-              }
-              s_StateLTMParser = LTM_PARSE_STATE_IDLE;
-
-           }
-           else
-              s_LTMPayloadBuffer[s_StateLTMPayloadAddIndex++] = c;
-      }
+      ltm_bulk_init(&s_LTMBulkParser, _parse_ltm_on_frame, &s_LTMParseContext);
+      s_bLTMBulkParserInitialized = true;
    }
-   return ret;
+   s_LTMParseContext.pPHFCT = pphfct;
+   s_LTMParseContext.pPHRTE = pPHRTE;
+   s_LTMParseContext.uVehicleType = vehicleType;
+   s_LTMParseContext.bParsed = false;
+   if ( ltm_bulk_parse(&s_LTMBulkParser, buffer, length) > 0 )
+      set_time_last_mavlink_message_from_fc(get_current_timestamp_ms());
+   return s_LTMParseContext.bParsed;
 }
@@ -0,0 +1,317 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "shared_mem.h"
+#include "profiler.h"
+
+static const char* s_szProfilerSectionNames[PROFILER_SECTIONS_COUNT] =
+{
+   "loop", "radio_rx_high_prio", "radio_rx", "camera_read", "video_tx", "video_rx",
+   "video_output", "radio_tx", "ipc", "periodic", "stats", "rx_thread_read"
+};
+
+static shared_mem_profiler* s_pProfilerSM = NULL;
+static pthread_mutex_t s_ProfilerMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread t_profiler_thread* s_pProfilerThread = NULL;
+
+u64 profiler_get_time_ns()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+   return ((u64)t.tv_sec)*1000000000LL + (u64)t.tv_nsec;
+}
+
+const char* profiler_get_section_name(int iSection)
+{
+   if ( (iSection < 0) || (iSection >= PROFILER_SECTIONS_COUNT) )
+      return "unknown";
+   return s_szProfilerSectionNames[iSection];
+}
+
+int profiler_init(const char* szSharedMemName)
+{
+   if ( NULL != s_pProfilerSM )
+      return 1;
+
+   s_pProfilerSM = (shared_mem_profiler*) open_shared_mem_for_write(szSharedMemName, sizeof(shared_mem_profiler));
+   if ( NULL == s_pProfilerSM )
+   {
+      log_softerror_and_alarm("[Profiler] Failed to open shared mem for writing: %s", szSharedMemName);
+      return 0;
+   }
+   s_pProfilerSM->iProcessId = getpid();
+   s_pProfilerSM->iThreadsCount = 0;
+   s_pProfilerSM->iSectionsCount = PROFILER_SECTIONS_COUNT;
+   s_pProfilerSM->uStartTimeNs = profiler_get_time_ns();
+   for( int i=0; i<PROFILER_SECTIONS_COUNT; i++ )
+   {
+      strncpy(s_pProfilerSM->szSectionNames[i], s_szProfilerSectionNames[i], PROFILER_MAX_SECTION_NAME-1);
+      s_pProfilerSM->szSectionNames[i][PROFILER_MAX_SECTION_NAME-1] = 0;
+   }
+   // Set last, readers ignore the shared mem until then
+   __atomic_store_n(&s_pProfilerSM->uVersion, PROFILER_SHARED_MEM_VERSION, __ATOMIC_RELEASE);
+   log_line("[Profiler] Initialized (%s, %d bytes).", szSharedMemName, (int)sizeof(shared_mem_profiler));
+   return 1;
+}
+
+void profiler_uninit()
+{
+   pthread_mutex_lock(&s_ProfilerMutex);
+   if ( NULL != s_pProfilerSM )
+      munmap(s_pProfilerSM, sizeof(shared_mem_profiler));
+   s_pProfilerSM = NULL;
+   pthread_mutex_unlock(&s_ProfilerMutex);
+   s_pProfilerThread = NULL;
+}
+
+int profiler_register_thread(const char* szName)
+{
+   if ( NULL != s_pProfilerThread )
+      return (int)(s_pProfilerThread - &s_pProfilerSM->threads[0]);
+
+   const char* szThreadName = (NULL != szName)?szName:"thread";
+   int iSlot = -1;
+   pthread_mutex_lock(&s_ProfilerMutex);
+   if ( NULL != s_pProfilerSM )
+   {
+      // Prefer the free slot of a previous thread with the same name, then a new slot, then any free slot
+      int iFreeSlot = -1;
+      for( int i=0; i<s_pProfilerSM->iThreadsCount; i++ )
+      {
+         if ( s_pProfilerSM->threads[i].iRegistered )
+            continue;
+         if ( 0 == strncmp(s_pProfilerSM->threads[i].szName, szThreadName, sizeof(s_pProfilerSM->threads[i].szName)-1) )
+         {
+            iSlot = i;
+            break;
+         }
+         if ( -1 == iFreeSlot )
+            iFreeSlot = i;
+      }
+      if ( (-1 != iSlot) || ((-1 != iFreeSlot) && (s_pProfilerSM->iThreadsCount >= PROFILER_MAX_THREADS)) )
+      {
+         // Reused slot: keep the write index, so readers just go on reading the ring
+         if ( -1 == iSlot )
+         {
+            iSlot = iFreeSlot;
+            memset(s_pProfilerSM->threads[iSlot].histograms, 0, sizeof(s_pProfilerSM->threads[iSlot].histograms));
+            memset(s_pProfilerSM->threads[iSlot].szName, 0, sizeof(s_pProfilerSM->threads[iSlot].szName));
+            strncpy(s_pProfilerSM->threads[iSlot].szName, szThreadName, sizeof(s_pProfilerSM->threads[iSlot].szName)-1);
+         }
+         t_profiler_thread* pThread = &s_pProfilerSM->threads[iSlot];
+         memset(pThread->uBeginTimeNs, 0, sizeof(pThread->uBeginTimeNs));
+         pThread->iThreadId = (int)syscall(SYS_gettid);
+         pThread->iRegistered = 1;
+         s_pProfilerThread = pThread;
+      }
+      else if ( s_pProfilerSM->iThreadsCount < PROFILER_MAX_THREADS )
+      {
+         iSlot = s_pProfilerSM->iThreadsCount;
+         t_profiler_thread* pThread = &s_pProfilerSM->threads[iSlot];
+         memset(pThread, 0, sizeof(t_profiler_thread));
+         strncpy(pThread->szName, szThreadName, sizeof(pThread->szName)-1);
+         pThread->iThreadId = (int)syscall(SYS_gettid);
+         pThread->iRegistered = 1;
+         __atomic_store_n(&s_pProfilerSM->iThreadsCount, iSlot+1, __ATOMIC_RELEASE);
+         s_pProfilerThread = pThread;
+      }
+   }
+   pthread_mutex_unlock(&s_ProfilerMutex);
+
+   // Processes that don't profile never call profiler_init, their threads are just not traced
+   if ( NULL == s_pProfilerSM )
+      return -1;
+   if ( -1 == iSlot )
+      log_softerror_and_alarm("[Profiler] Can't register thread %s, no more free slots.", szThreadName);
+   else
+      log_line("[Profiler] Registered thread %s on slot %d.", szThreadName, iSlot);
+   return iSlot;
+}
+
+void profiler_unregister_thread()
+{
+   if ( NULL == s_pProfilerThread )
+      return;
+   pthread_mutex_lock(&s_ProfilerMutex);
+   if ( NULL != s_pProfilerSM )
+      s_pProfilerThread->iRegistered = 0;
+   pthread_mutex_unlock(&s_ProfilerMutex);
+   s_pProfilerThread = NULL;
+}
+
+void profiler_begin(int iSection)
+{
+   if ( NULL == s_pProfilerThread )
+      return;
+   s_pProfilerThread->uBeginTimeNs[iSection & (PROFILER_MAX_SECTIONS-1)] = profiler_get_time_ns();
+}
+
+int profiler_get_histogram_bucket(u32 uMicros)
+{
+   if ( 0 == uMicros )
+      return 0;
+   int iBucket = 32 - __builtin_clz(uMicros);
+   if ( iBucket >= PROFILER_HISTOGRAM_BUCKETS )
+      iBucket = PROFILER_HISTOGRAM_BUCKETS-1;
+   return iBucket;
+}
+
+void profiler_end(int iSection)
+{
+   t_profiler_thread* pThread = s_pProfilerThread;
+   if ( NULL == pThread )
+      return;
+   iSection &= (PROFILER_MAX_SECTIONS-1);
+   u64 uStart = pThread->uBeginTimeNs[iSection];
+   if ( 0 == uStart )
+      return;
+   pThread->uBeginTimeNs[iSection] = 0;
+
+   u64 uDuration = profiler_get_time_ns() - uStart;
+   if ( uDuration > 0xFFFFFFFF )
+      uDuration = 0xFFFFFFFF;
+
+   u32 uIndex = pThread->uWriteIndex;
+   t_profiler_event* pEvent = &pThread->events[uIndex & (PROFILER_RING_SIZE-1)];
+   pEvent->uStartTimeNs = uStart;
+   pEvent->uDurationNs = (u32)uDuration;
+   pEvent->uSection = (u16)iSection;
+   __atomic_store_n(&pThread->uWriteIndex, uIndex+1, __ATOMIC_RELEASE);
+
+   u32 uMicros = (u32)(uDuration/1000);
+   t_profiler_histogram* pHistogram = &pThread->histograms[iSection];
+   pHistogram->uCount++;
+   pHistogram->uTotalMicros += uMicros;
+   if ( uMicros > pHistogram->uMaxMicros )
+      pHistogram->uMaxMicros = uMicros;
+   pHistogram->uBuckets[profiler_get_histogram_bucket(uMicros)]++;
+}
+
+u32 profiler_get_histogram_percentile(const t_profiler_histogram* pHistogram, int iPercentile)
+{
+   u32 uTotal = 0;
+   for( int i=0; i<PROFILER_HISTOGRAM_BUCKETS; i++ )
+      uTotal += pHistogram->uBuckets[i];
+   if ( 0 == uTotal )
+      return 0;
+
+   u64 uTarget = ((u64)uTotal * (u64)iPercentile + 99) / 100;
+   if ( uTarget < 1 )
+      uTarget = 1;
+   u64 uSum = 0;
+   for( int i=0; i<PROFILER_HISTOGRAM_BUCKETS-1; i++ )
+   {
+      uSum += pHistogram->uBuckets[i];
+      if ( uSum >= uTarget )
+      {
+         u32 uBound = (i == 0)?1:(((u32)1)<<i);
+         return (uBound < pHistogram->uMaxMicros)?uBound:pHistogram->uMaxMicros;
+      }
+   }
+   return pHistogram->uMaxMicros;
+}
+
+void profiler_get_section_histogram(shared_mem_profiler* pProfiler, int iSection, t_profiler_histogram* pSum)
+{
+   memset(pSum, 0, sizeof(t_profiler_histogram));
+   if ( (NULL == pProfiler) || (iSection < 0) || (iSection >= PROFILER_MAX_SECTIONS) )
+      return;
+
+   int iThreads = __atomic_load_n(&pProfiler->iThreadsCount, __ATOMIC_ACQUIRE);
+   if ( iThreads > PROFILER_MAX_THREADS )
+      iThreads = PROFILER_MAX_THREADS;
+   for( int i=0; i<iThreads; i++ )
+   {
+      const t_profiler_histogram* pHistogram = &pProfiler->threads[i].histograms[iSection];
+      pSum->uCount += pHistogram->uCount;
+      pSum->uTotalMicros += pHistogram->uTotalMicros;
+      if ( pHistogram->uMaxMicros > pSum->uMaxMicros )
+         pSum->uMaxMicros = pHistogram->uMaxMicros;
+      for( int k=0; k<PROFILER_HISTOGRAM_BUCKETS; k++ )
+         pSum->uBuckets[k] += pHistogram->uBuckets[k];
+   }
+}
+
+int profiler_read_thread_events(shared_mem_profiler* pProfiler, int iThread, u32* puReadIndex, t_profiler_event* pEvents, u32* puLostEvents)
+{
+   if ( (NULL == pProfiler) || (iThread < 0) || (iThread >= PROFILER_MAX_THREADS) || (NULL == puReadIndex) || (NULL == pEvents) )
+      return 0;
+
+   t_profiler_thread* pThread = &pProfiler->threads[iThread];
+   u32 uWrite = __atomic_load_n(&pThread->uWriteIndex, __ATOMIC_ACQUIRE);
+   u32 uFrom = *puReadIndex;
+   if ( uWrite == uFrom )
+      return 0;
+   // The oldest slot of a full ring is the one the writer fills next, so at most PROFILER_RING_SIZE-1 events are readable
+   u32 uLost = 0;
+   if ( uWrite - uFrom > PROFILER_RING_SIZE-1 )
+   {
+      uLost += uWrite - uFrom - (PROFILER_RING_SIZE-1);
+      uFrom = uWrite - (PROFILER_RING_SIZE-1);
+   }
+   u32 uCount = uWrite - uFrom;
+   for( u32 u=0; u<uCount; u++ )
+      memcpy(&pEvents[u], &pThread->events[(uFrom+u) & (PROFILER_RING_SIZE-1)], sizeof(t_profiler_event));
+
+   // The writer does not wait for the reader: drop the events it overwrote while they were copied
+   u32 uWriteAfter = __atomic_load_n(&pThread->uWriteIndex, __ATOMIC_ACQUIRE);
+   u32 uFirstValid = 0;
+   if ( uWriteAfter - uFrom >= PROFILER_RING_SIZE )
+   {
+      uFirstValid = uWriteAfter - uFrom - PROFILER_RING_SIZE + 1;
+      if ( uFirstValid > uCount )
+         uFirstValid = uCount;
+      uLost += uFirstValid;
+      if ( uFirstValid > 0 )
+         memmove(&pEvents[0], &pEvents[uFirstValid], (uCount - uFirstValid)*sizeof(t_profiler_event));
+   }
+   if ( NULL != puLostEvents )
+      *puLostEvents += uLost;
+   *puReadIndex = uWrite;
+   return (int)(uCount - uFirstValid);
+}
+
+shared_mem_profiler* shared_mem_profiler_open_for_read(const char* szSharedMemName)
+{
+   void *retVal = open_shared_mem_for_read(szSharedMemName, sizeof(shared_mem_profiler));
+   return (shared_mem_profiler*)retVal;
+}
+
+void shared_mem_profiler_close(shared_mem_profiler* pAddress)
+{
+   if ( NULL != pAddress )
+      munmap(pAddress, sizeof(shared_mem_profiler));
+}
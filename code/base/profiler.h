@@ -0,0 +1,114 @@
+#pragma once
+#include "base.h"
+#include "config.h"
+
+// Low overhead tracepoints for the router processes main loops.
+// A traced section is marked with PROFILER_BEGIN/PROFILER_END. On end, each traced thread writes the
+// section timing (CLOCK_MONOTONIC_RAW) to its own ring in the process profiler shared memory (single
+// writer, no locks, no syscalls besides the vDSO clock read) and adds it to the section latency histogram.
+// The rings are dumped as Chrome trace (Perfetto) JSON by ruby_trace; the histograms are shown in the
+// controller developer stats.
+// Build with -DRUBY_PROFILER_DISABLED to compile out the tracepoints.
+
+#define PROFILER_SHARED_MEM_VERSION 2
+#define PROFILER_MAX_THREADS 4
+#define PROFILER_RING_SIZE 4096 // events per thread, must be a power of 2
+#define PROFILER_MAX_SECTIONS 16
+#define PROFILER_MAX_SECTION_NAME 24
+// Bucket 0: under 1 microsec; bucket k: [2^(k-1), 2^k) microsec; the last bucket takes all above
+#define PROFILER_HISTOGRAM_BUCKETS 20
+
+#define PROFILER_SECTION_LOOP 0
+#define PROFILER_SECTION_RADIO_RX_HIGH_PRIO 1
+#define PROFILER_SECTION_RADIO_RX 2
+#define PROFILER_SECTION_CAMERA_READ 3
+#define PROFILER_SECTION_VIDEO_TX 4 // video packets, FEC encoding and send
+#define PROFILER_SECTION_VIDEO_RX 5 // video blocks reconstruction and retransmissions requests
+#define PROFILER_SECTION_VIDEO_OUTPUT 6
+#define PROFILER_SECTION_RADIO_TX 7
+#define PROFILER_SECTION_IPC 8
+#define PROFILER_SECTION_PERIODIC 9
+#define PROFILER_SECTION_STATS 10
+#define PROFILER_SECTION_RX_THREAD_READ 11
+#define PROFILER_SECTIONS_COUNT 12
+
+typedef struct
+{
+   u64 uStartTimeNs;
+   u32 uDurationNs;
+   u16 uSection;
+   u16 uReserved;
+} ALIGN_STRUCT_SPEC_INFO t_profiler_event;
+
+typedef struct
+{
+   u32 uCount;
+   u32 uMaxMicros;
+   u64 uTotalMicros;
+   u32 uBuckets[PROFILER_HISTOGRAM_BUCKETS];
+} ALIGN_STRUCT_SPEC_INFO t_profiler_histogram;
+
+typedef struct
+{
+   char szName[32];
+   int iThreadId;
+   int iRegistered; // 0 after the thread unregistered; the slot can then be reused
+   u32 uWriteIndex; // total events written; the last PROFILER_RING_SIZE-1 of them can be read from the ring
+   u64 uBeginTimeNs[PROFILER_MAX_SECTIONS];
+   t_profiler_histogram histograms[PROFILER_MAX_SECTIONS];
+   t_profiler_event events[PROFILER_RING_SIZE];
+} ALIGN_STRUCT_SPEC_INFO t_profiler_thread;
+
+typedef struct
+{
+   u32 uVersion;
+   int iProcessId;
+   int iThreadsCount;
+   int iSectionsCount;
+   u64 uStartTimeNs;
+   char szSectionNames[PROFILER_MAX_SECTIONS][PROFILER_MAX_SECTION_NAME];
+   t_profiler_thread threads[PROFILER_MAX_THREADS];
+} ALIGN_STRUCT_SPEC_INFO shared_mem_profiler;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Opens the process profiler shared memory for writing. Returns 1 on success, 0 on failure (tracepoints do nothing then).
+int profiler_init(const char* szSharedMemName);
+void profiler_uninit();
+// Must be called from the traced thread. Returns the thread slot, -1 on failure.
+// A thread restarted with the same name gets back its previous slot (its events and histograms continue).
+int profiler_register_thread(const char* szName);
+// Must be called from the traced thread before it exits, frees its slot.
+void profiler_unregister_thread();
+void profiler_begin(int iSection);
+void profiler_end(int iSection);
+
+u64 profiler_get_time_ns();
+const char* profiler_get_section_name(int iSection);
+int profiler_get_histogram_bucket(u32 uMicros);
+// Returns the upper bound (microsec) of the bucket holding the given percentile (0..100), at most the max value
+u32 profiler_get_histogram_percentile(const t_profiler_histogram* pHistogram, int iPercentile);
+// pSum = all the threads histograms of the section
+void profiler_get_section_histogram(shared_mem_profiler* pProfiler, int iSection, t_profiler_histogram* pSum);
+
+// Copies the events the thread wrote since *puReadIndex to pEvents (room for PROFILER_RING_SIZE events) and
+// advances *puReadIndex. Events overwritten before being read are added to *puLostEvents (optional).
+// Returns the number of events copied.
+int profiler_read_thread_events(shared_mem_profiler* pProfiler, int iThread, u32* puReadIndex, t_profiler_event* pEvents, u32* puLostEvents);
+
+shared_mem_profiler* shared_mem_profiler_open_for_read(const char* szSharedMemName);
+void shared_mem_profiler_close(shared_mem_profiler* pAddress);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef RUBY_PROFILER_DISABLED
+#define PROFILER_BEGIN(s)
+#define PROFILER_END(s)
+#else
+#define PROFILER_BEGIN(s) profiler_begin(s)
+#define PROFILER_END(s) profiler_end(s)
+#endif
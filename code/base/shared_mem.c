@@ -244,6 +244,42 @@ void shared_mem_video_link_graphs_close(shared_mem_video_link_graphs* pAddress)
       munmap(pAddress, sizeof(shared_mem_video_link_graphs));
 }
 
+shared_mem_relay_fast_path_stats* shared_mem_relay_fast_path_stats_open_for_read()
+{
+   void *retVal = open_shared_mem_for_read(SHARED_MEM_RELAY_FAST_PATH_STATS, sizeof(shared_mem_relay_fast_path_stats));
+   return (shared_mem_relay_fast_path_stats*)retVal;
+}
+
+shared_mem_relay_fast_path_stats* shared_mem_relay_fast_path_stats_open_for_write()
+{
+   void *retVal = open_shared_mem_for_write(SHARED_MEM_RELAY_FAST_PATH_STATS, sizeof(shared_mem_relay_fast_path_stats));
+   return (shared_mem_relay_fast_path_stats*)retVal;
+}
+
+void shared_mem_relay_fast_path_stats_close(shared_mem_relay_fast_path_stats* pAddress)
+{
+   if ( NULL != pAddress )
+      munmap(pAddress, sizeof(shared_mem_relay_fast_path_stats));
+}
+
+shared_mem_telemetry_scheduler_stats* shared_mem_telemetry_scheduler_stats_open_for_read()
+{
+   void *retVal = open_shared_mem_for_read(SHARED_MEM_TELEMETRY_SCHEDULER_STATS, sizeof(shared_mem_telemetry_scheduler_stats));
+   return (shared_mem_telemetry_scheduler_stats*)retVal;
+}
+
+shared_mem_telemetry_scheduler_stats* shared_mem_telemetry_scheduler_stats_open_for_write()
+{
+   void *retVal = open_shared_mem_for_write(SHARED_MEM_TELEMETRY_SCHEDULER_STATS, sizeof(shared_mem_telemetry_scheduler_stats));
+   return (shared_mem_telemetry_scheduler_stats*)retVal;
+}
+
+void shared_mem_telemetry_scheduler_stats_close(shared_mem_telemetry_scheduler_stats* pAddress)
+{
+   if ( NULL != pAddress )
+      munmap(pAddress, sizeof(shared_mem_telemetry_scheduler_stats));
+}
+
 
 t_packet_header_rc_info_downstream* shared_mem_rc_downstream_info_open_read()
 {
@@ -16,6 +16,10 @@
 #define SHARED_MEM_VIDEO_FRAMES_STATS_RADIO_IN "/SYSTEM_SHARED_MEM_STATION_VIDEO_STREAM_INFO_RADIO_IN"
 #define SHARED_MEM_VIDEO_FRAMES_STATS_RADIO_OUT "/SYSTEM_SHARED_MEM_STATION_VIDEO_STREAM_INFO_RADIO_OUT"
 #define SHARED_MEM_VIDEO_LINK_GRAPHS "/SYSTEM_SHARED_MEM_STATION_VIDEO_LINK_GRAPHS"
+#define SHARED_MEM_RELAY_FAST_PATH_STATS "/SYSTEM_SHARED_MEM_VEHICLE_RELAY_FAST_PATH_STATS"
+#define SHARED_MEM_TELEMETRY_SCHEDULER_STATS "/SYSTEM_SHARED_MEM_VEHICLE_TELEMETRY_SCHEDULER_STATS"
+#define SHARED_MEM_PROFILER_ROUTER_RX "/SYSTEM_SHARED_MEM_PROFILER_ROUTER_RX"
+#define SHARED_MEM_PROFILER_ROUTER_TX "/SYSTEM_SHARED_MEM_PROFILER_ROUTER_TX"
 #define SHARED_MEM_RC_DOWNLOAD_INFO "R_SHARED_MEM_VEHICLE_RC_DOWNLOAD_INFO"
 #define SHARED_MEM_RC_UPSTREAM_FRAME "R_SHARED_MEM_RC_UPSTREAM_FRAME"
 
@@ -94,6 +98,67 @@ typedef struct
 } ALIGN_STRUCT_SPEC_INFO shared_mem_video_link_graphs;
 
 
+#define RELAY_FAST_PATH_TO_CONTROLLER 0
+#define RELAY_FAST_PATH_TO_RELAYED_VEHICLE 1
+#define RELAY_FAST_PATH_DIRECTIONS 2
+
+typedef struct
+{
+   u32 uPacketsForwarded;
+   u32 uBytesForwarded;
+   u32 uPacketsDroppedQueueFull;
+   u32 uPacketsDroppedTxFailed;
+   u32 uPacketsSlowPath; // relayed packets left to the router main loop
+   u32 uMaxQueuedPackets;
+   // Time from the rx thread to written to the radio interface
+   u32 uLatencyAvgMicrosLastInterval;
+   u32 uLatencyMaxMicrosLastInterval;
+   u32 uLatencyMaxMicros;
+} ALIGN_STRUCT_SPEC_INFO shared_mem_relay_fast_path_direction_stats;
+
+typedef struct
+{
+   u32 uTimeLastUpdate;
+   u32 uRelayedVehicleId;
+   int iEnabled;
+   int iQueuedPackets;
+   shared_mem_relay_fast_path_direction_stats directions[RELAY_FAST_PATH_DIRECTIONS];
+} ALIGN_STRUCT_SPEC_INFO shared_mem_relay_fast_path_stats;
+
+
+// FC telemetry messages priority classes, highest priority first
+#define TELEMETRY_CLASS_CRITICAL 0
+#define TELEMETRY_CLASS_FLIGHT 1
+#define TELEMETRY_CLASS_NORMAL 2
+#define TELEMETRY_CLASS_BULK 3
+#define TELEMETRY_CLASSES 4
+
+typedef struct
+{
+   u32 uMessagesIn;
+   u32 uBytesIn;
+   u32 uMessagesSent;
+   u32 uBytesSent;
+   u32 uMessagesCoalesced; // replaced by a newer value of the same message before being sent
+   u32 uMessagesDropped; // no room left in the queue
+   u32 uQueuedMessages;
+   int iRateLimitBytesPerSecond; // 0 for no limit
+   // Time from read from the serial port to sent to the router
+   u32 uLatencyAvgMicrosLastInterval;
+   u32 uLatencyMaxMicrosLastInterval;
+   u32 uLatencyMaxMicros;
+} ALIGN_STRUCT_SPEC_INFO shared_mem_telemetry_scheduler_class_stats;
+
+typedef struct
+{
+   u32 uTimeLastUpdate;
+   int iEnabled;
+   u32 uSegmentsSent;
+   u32 uBytesDiscarded; // serial data that is not part of a valid MAVLink message
+   shared_mem_telemetry_scheduler_class_stats classes[TELEMETRY_CLASSES];
+} ALIGN_STRUCT_SPEC_INFO shared_mem_telemetry_scheduler_stats;
+
+
 #define MAX_INTERVALS_VIDEO_BITRATE_HISTORY 70
 
 typedef struct
@@ -215,6 +280,14 @@ shared_mem_video_link_graphs* shared_mem_video_link_graphs_open_for_read();
 shared_mem_video_link_graphs* shared_mem_video_link_graphs_open_for_write();
 void shared_mem_video_link_graphs_close(shared_mem_video_link_graphs* pAddress);
 
+shared_mem_relay_fast_path_stats* shared_mem_relay_fast_path_stats_open_for_read();
+shared_mem_relay_fast_path_stats* shared_mem_relay_fast_path_stats_open_for_write();
+void shared_mem_relay_fast_path_stats_close(shared_mem_relay_fast_path_stats* pAddress);
+
+shared_mem_telemetry_scheduler_stats* shared_mem_telemetry_scheduler_stats_open_for_read();
+shared_mem_telemetry_scheduler_stats* shared_mem_telemetry_scheduler_stats_open_for_write();
+void shared_mem_telemetry_scheduler_stats_close(shared_mem_telemetry_scheduler_stats* pAddress);
+
 t_packet_header_rc_info_downstream* shared_mem_rc_downstream_info_open_read();
 t_packet_header_rc_info_downstream* shared_mem_rc_downstream_info_open_write();
 void shared_mem_rc_downstream_info_close(t_packet_header_rc_info_downstream* pRCInfo);
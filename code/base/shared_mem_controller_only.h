@@ -12,6 +12,8 @@
 #define MAX_HISTORY_VIDEO_INTERVALS 50
 #define MAX_HISTORY_STACK_RETRANSMISSION_INFO 100
 #define MAX_RETRANSMISSION_PACKETS_IN_REQUEST 20
+#define MAX_RETRANSMISSION_PACKETS_IN_BITMAP_REQUEST 120
+#define MAX_RETRANSMISSION_BITMAP_REQUEST_SIZE 200
 
 #define MAX_RADIO_RX_QUEUE_INFO_VALUES 50
 
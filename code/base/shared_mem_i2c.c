@@ -96,3 +96,20 @@ void shared_mem_i2c_rotary_encoder_buttons_events_close(t_shared_mem_i2c_rotary_
       munmap(pAddress, sizeof(t_shared_mem_i2c_rotary_encoder_buttons_events));
 }
 
+t_shared_mem_i2c_devices_read_stats* shared_mem_i2c_devices_read_stats_open_for_read()
+{
+   void *retVal =  open_shared_mem(SHARED_MEM_NAME_I2C_DEVICES_READ_STATS, sizeof(t_shared_mem_i2c_devices_read_stats), 1);
+   return ((t_shared_mem_i2c_devices_read_stats*)retVal);
+}
+
+t_shared_mem_i2c_devices_read_stats* shared_mem_i2c_devices_read_stats_open_for_write()
+{
+   void *retVal =  open_shared_mem(SHARED_MEM_NAME_I2C_DEVICES_READ_STATS, sizeof(t_shared_mem_i2c_devices_read_stats), 0);
+   return ((t_shared_mem_i2c_devices_read_stats*)retVal);
+}
+
+void shared_mem_i2c_devices_read_stats_close(t_shared_mem_i2c_devices_read_stats* pAddress)
+{
+   if ( NULL != pAddress )
+      munmap(pAddress, sizeof(t_shared_mem_i2c_devices_read_stats));
+}
@@ -6,6 +6,9 @@
 #define SHARED_MEM_NAME_I2C_CURRENT "/SYSTEM_SHARED_MEM_RUBY_I2C_CURRENT"
 #define SHARED_MEM_NAME_I2C_CONTROLLER_RC_IN "/SYSTEM_SHARED_MEM_RUBY_I2C_CONTROLLER_RC_IN"
 #define SHARED_MEM_NAME_I2C_ROTARY_ENCODER_BUTTONS_EVENTS "/SYSTEM_SHARED_MEM_RUBY_I2C_ROTARY_ENCODER_BUTTONS_EVENTS"
+#define SHARED_MEM_NAME_I2C_DEVICES_READ_STATS "/SYSTEM_SHARED_MEM_RUBY_I2C_DEVICES_READ_STATS"
+
+#define MAX_I2C_READ_STATS_DEVICES 12
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,6 +47,28 @@ typedef struct
    u32 uCRC; // should be last in the structure as is not part of the CRC computation;
 } ALIGN_STRUCT_SPEC_INFO t_shared_mem_i2c_rotary_encoder_buttons_events;
 
+typedef struct
+{
+   char szName[16];
+   u8 uI2CAddress;
+   u8 uPriority;
+   u16 uPeriodMs;
+   u32 uReadsCount;
+   u32 uReadsFailed;
+   u32 uDeadlineMisses;
+   u32 uLastReadLatencyMicros;
+   u32 uAvgReadLatencyMicros;
+   u32 uMaxReadLatencyMicros;
+   u32 uMaxScheduleDelayMicros; // how late (max) a read started compared to when it was due
+} ALIGN_STRUCT_SPEC_INFO t_i2c_device_read_stats;
+
+typedef struct
+{
+   u32 uLastUpdateTime;
+   u32 uDevicesCount;
+   t_i2c_device_read_stats devices[MAX_I2C_READ_STATS_DEVICES];
+} ALIGN_STRUCT_SPEC_INFO t_shared_mem_i2c_devices_read_stats;
+
 
 t_shared_mem_i2c_current* shared_mem_i2c_current_open_for_write();
 t_shared_mem_i2c_current* shared_mem_i2c_current_open_for_read();
@@ -57,6 +82,10 @@ t_shared_mem_i2c_rotary_encoder_buttons_events* shared_mem_i2c_rotary_encoder_bu
 t_shared_mem_i2c_rotary_encoder_buttons_events* shared_mem_i2c_rotary_encoder_buttons_events_open_for_write();
 void shared_mem_i2c_rotary_encoder_buttons_events_close(t_shared_mem_i2c_rotary_encoder_buttons_events* pAddress);
 
+t_shared_mem_i2c_devices_read_stats* shared_mem_i2c_devices_read_stats_open_for_read();
+t_shared_mem_i2c_devices_read_stats* shared_mem_i2c_devices_read_stats_open_for_write();
+void shared_mem_i2c_devices_read_stats_close(t_shared_mem_i2c_devices_read_stats* pAddress);
+
 #ifdef __cplusplus
 }  
 #endif
@@ -95,6 +95,27 @@ typedef struct
    int iDbmNoiseLowest;
 } ALIGN_STRUCT_SPEC_INFO shared_mem_radio_stats_radio_interface_rx_signal_all;
 
+// Summary of the last rx window (the last completed graph slices) of a radio interface.
+// Computed when a slice completes, see common/radio_stats_window.h
+typedef struct
+{
+   u32 uWindowSlices; // completed slices in the window
+   u32 uPackets;
+   u32 uPacketsBad;
+   u32 uPacketsLost;
+   int iQuality; // 0...100%
+   int iDbmAvg; // best antenna signal; 1000 if no signal info
+   int iDbmMin;
+   int iDbmMax;
+   int iDbmP10; // 10% of the packets had a signal at or below this
+   int iDbmP50;
+   u32 uGapAvgMs; // time between received packets
+   u32 uGapMaxMs;
+   u32 uGapP50Ms;
+   u32 uGapP90Ms;
+   u32 uGapP99Ms;
+} ALIGN_STRUCT_SPEC_INFO shared_mem_radio_stats_window_summary;
+
 typedef struct
 {
    int assignedLocalRadioLinkId; // id of the radio link assigned to this radio interface
@@ -143,6 +164,16 @@ typedef struct
 
 } ALIGN_STRUCT_SPEC_INFO shared_mem_radio_stats_radio_interface;
 
+// Radio interface info used only on the local side. It is kept out of shared_mem_radio_stats_radio_interface,
+// which the vehicle sends as is to the controller (PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS),
+// and the controller drops that packet if the structure size does not match its own.
+typedef struct
+{
+   int iDiversityScore; // 0...1000, -1 if not computed; see radio/radio_diversity.h
+   u32 uDiversityRescuedPackets; // packets only this card received
+   shared_mem_radio_stats_window_summary windowSummary;
+} ALIGN_STRUCT_SPEC_INFO shared_mem_radio_stats_radio_interface_local;
+
 typedef struct
 {
    shared_mem_radio_stats_radio_interface_rx_signal_all signalInfo;
@@ -230,6 +261,7 @@ typedef struct
    shared_mem_radio_stats_stream           radio_streams[MAX_CONCURENT_VEHICLES][MAX_RADIO_STREAMS];
    shared_mem_radio_stats_radio_interface  radio_interfaces[MAX_RADIO_INTERFACES];
    shared_mem_radio_stats_radio_link       radio_links[MAX_RADIO_INTERFACES];
+   shared_mem_radio_stats_radio_interface_local radio_interfaces_local[MAX_RADIO_INTERFACES];
 
 } ALIGN_STRUCT_SPEC_INFO shared_mem_radio_stats;
 
@@ -0,0 +1,389 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "telemetry_bulk_parser.h"
+
+void telemetry_bulk_carry_reset(t_telemetry_bulk_carry* pCarry)
+{
+   pCarry->iLength = 0;
+}
+
+void telemetry_bulk_parse(t_telemetry_bulk_carry* pCarry, u8* pData, int iLength, t_telemetry_bulk_parse_span pfParseSpan, void* pContext)
+{
+   if ( (NULL == pData) || (iLength <= 0) )
+      return;
+
+   int iPos = 0;
+   if ( pCarry->iLength > 0 )
+   {
+      // Complete the carried frame with the start of the new data. At most one frame (and the byte
+      // after it) is carried, so the frames that start in the carried bytes can all be parsed now.
+      int iCarried = pCarry->iLength;
+      int iAppend = (int)sizeof(pCarry->uBuffer) - iCarried;
+      if ( iAppend > iLength )
+         iAppend = iLength;
+      memcpy(&pCarry->uBuffer[iCarried], pData, iAppend);
+      pCarry->iLength += iAppend;
+      int iConsumed = pfParseSpan(pContext, pCarry->uBuffer, pCarry->iLength);
+      if ( iConsumed < iCarried )
+      {
+         // Still not enough data: all the new data is in the carry buffer now
+         pCarry->iLength -= iConsumed;
+         memmove(pCarry->uBuffer, &pCarry->uBuffer[iConsumed], pCarry->iLength);
+         return;
+      }
+      // Go on with the rest of the new data, in place
+      iPos = iConsumed - iCarried;
+      pCarry->iLength = 0;
+   }
+
+   if ( iPos < iLength )
+      iPos += pfParseSpan(pContext, pData + iPos, iLength - iPos);
+
+   // Keep the incomplete frame at the end
+   int iTail = iLength - iPos;
+   if ( iTail > TELEMETRY_BULK_MAX_FRAME_LENGTH )
+   {
+      pCarry->iLength = 0;
+      log_softerror_and_alarm("[TelemBulkParser] Invalid unparsed data (%d bytes), discarded it.", iTail);
+      return;
+   }
+   if ( iTail > 0 )
+      memcpy(pCarry->uBuffer, pData + iPos, iTail);
+   pCarry->iLength = iTail;
+}
+
+void mavlink_bulk_init(t_mavlink_bulk_parser* pParser)
+{
+   memset(pParser, 0, sizeof(t_mavlink_bulk_parser));
+}
+
+static t_mavlink_bulk_filter* _mavlink_bulk_get_filter(t_mavlink_bulk_parser* pParser, u32 uMessageId)
+{
+   if ( uMessageId < MAVLINK_BULK_FILTER_TABLE_SIZE )
+   {
+      if ( 0 == pParser->uFilterIndex[uMessageId] )
+         return NULL;
+      return &pParser->filters[pParser->uFilterIndex[uMessageId]-1];
+   }
+   if ( 0 == pParser->iCountFiltersAboveTable )
+      return NULL;
+   for( int i=0; i<pParser->iCountFilters; i++ )
+   {
+      if ( pParser->filters[i].uMessageId == uMessageId )
+         return &pParser->filters[i];
+   }
+   return NULL;
+}
+
+int mavlink_bulk_register(t_mavlink_bulk_parser* pParser, u32 uMessageId, t_mavlink_bulk_handler pHandler, void* pContext)
+{
+   t_mavlink_bulk_filter* pFilter = _mavlink_bulk_get_filter(pParser, uMessageId);
+   if ( NULL == pFilter )
+   {
+      if ( pParser->iCountFilters >= MAVLINK_BULK_MAX_HANDLERS )
+      {
+         log_softerror_and_alarm("[TelemBulkParser] Can't register MAVLink message id %u, max filters (%d) reached.", uMessageId, MAVLINK_BULK_MAX_HANDLERS);
+         return -1;
+      }
+      pFilter = &pParser->filters[pParser->iCountFilters];
+      pParser->iCountFilters++;
+      if ( uMessageId < MAVLINK_BULK_FILTER_TABLE_SIZE )
+         pParser->uFilterIndex[uMessageId] = (u8)pParser->iCountFilters;
+      else
+         pParser->iCountFiltersAboveTable++;
+   }
+   pFilter->uMessageId = uMessageId;
+   pFilter->pHandler = pHandler;
+   pFilter->pContext = pContext;
+   return 0;
+}
+
+void mavlink_bulk_set_default_handler(t_mavlink_bulk_parser* pParser, t_mavlink_bulk_handler pHandler, void* pContext)
+{
+   pParser->pDefaultHandler = pHandler;
+   pParser->pDefaultContext = pContext;
+}
+
+// Position of the next MAVLink v1 or v2 start byte, iLength if none
+static int _mavlink_bulk_find_start(const u8* pData, int iPos, int iLength)
+{
+   const u8* pStartV2 = (const u8*)memchr(pData + iPos, MAVLINK_STX, iLength - iPos);
+   int iEnd = (NULL != pStartV2) ? (int)(pStartV2 - pData) : iLength;
+   const u8* pStartV1 = (const u8*)memchr(pData + iPos, MAVLINK_STX_MAVLINK1, iEnd - iPos);
+   if ( NULL != pStartV1 )
+      return (int)(pStartV1 - pData);
+   return iEnd;
+}
+
+static int _mavlink_bulk_parse_span(void* pContext, u8* pData, int iLength)
+{
+   t_mavlink_bulk_parser* pParser = (t_mavlink_bulk_parser*)pContext;
+   t_mavlink_bulk_message message;
+   int iPos = 0;
+
+   while ( iPos < iLength )
+   {
+      if ( (pData[iPos] != MAVLINK_STX) && (pData[iPos] != MAVLINK_STX_MAVLINK1) )
+      {
+         int iStart = _mavlink_bulk_find_start(pData, iPos, iLength);
+         pParser->uBytesDiscarded += iStart - iPos;
+         iPos = iStart;
+         if ( iPos >= iLength )
+            break;
+      }
+
+      u8* pMessage = pData + iPos;
+      int iAvailable = iLength - iPos;
+      int iIsV2 = (pMessage[0] == MAVLINK_STX)?1:0;
+      int iHeaderLength = iIsV2?10:6;
+      if ( iAvailable < iHeaderLength )
+         break;
+      int iMessageLength = iHeaderLength + pMessage[1] + MAVLINK_NUM_CHECKSUM_BYTES;
+      u32 uMessageId = pMessage[5];
+      if ( iIsV2 )
+      {
+         if ( pMessage[2] & MAVLINK_IFLAG_SIGNED )
+            iMessageLength += MAVLINK_SIGNATURE_BLOCK_LEN;
+         uMessageId = ((u32)pMessage[7]) | (((u32)pMessage[8]) << 8) | (((u32)pMessage[9]) << 16);
+      }
+      if ( iAvailable < iMessageLength )
+         break;
+
+      // Known messages are CRC checked. Unknown ones (other dialects) are taken only if someone wants them
+      // (default handler) and another message starts right after, so a false start byte doesn't eat real messages.
+      int iValid = 0;
+      const mavlink_msg_entry_t* pEntry = mavlink_get_msg_entry(uMessageId);
+      if ( NULL != pEntry )
+      {
+         u16 uCRC = crc_calculate(pMessage+1, iHeaderLength-1 + pMessage[1]);
+         crc_accumulate(pEntry->crc_extra, &uCRC);
+         int iCRCPos = iHeaderLength + pMessage[1];
+         iValid = (pMessage[iCRCPos] == (uCRC & 0xFF)) && (pMessage[iCRCPos+1] == (uCRC >> 8));
+         if ( ! iValid )
+            pParser->uCRCErrors++;
+      }
+      else if ( NULL == pParser->pDefaultHandler )
+         iValid = 0;
+      else if ( iAvailable == iMessageLength )
+         break;
+      else
+         iValid = (pMessage[iMessageLength] == MAVLINK_STX) || (pMessage[iMessageLength] == MAVLINK_STX_MAVLINK1);
+
+      if ( ! iValid )
+      {
+         iPos++;
+         pParser->uBytesDiscarded++;
+         continue;
+      }
+
+      pParser->uMessages++;
+      t_mavlink_bulk_filter* pFilter = _mavlink_bulk_get_filter(pParser, uMessageId);
+      t_mavlink_bulk_handler pHandler = (NULL != pFilter) ? pFilter->pHandler : pParser->pDefaultHandler;
+      if ( NULL != pHandler )
+      {
+         message.pData = pMessage;
+         message.iLength = iMessageLength;
+         message.pPayload = pMessage + iHeaderLength;
+         message.iPayloadLength = pMessage[1];
+         message.uMessageId = uMessageId;
+         message.uSysId = pMessage[iIsV2?5:3];
+         message.uCompId = pMessage[iIsV2?6:4];
+         message.uSeq = pMessage[iIsV2?4:2];
+         message.uIsV2 = (u8)iIsV2;
+         if ( NULL != pFilter )
+         {
+            pParser->uMessagesDispatched++;
+            pHandler(&message, pFilter->pContext);
+         }
+         else
+            pHandler(&message, pParser->pDefaultContext);
+      }
+      iPos += iMessageLength;
+   }
+   return iPos;
+}
+
+int mavlink_bulk_parse(t_mavlink_bulk_parser* pParser, u8* pData, int iLength)
+{
+   u32 uMessagesBefore = pParser->uMessages;
+   telemetry_bulk_parse(&pParser->carry, pData, iLength, _mavlink_bulk_parse_span, pParser);
+   return (int)(pParser->uMessages - uMessagesBefore);
+}
+
+static int _ltm_bulk_get_frame_length(u8 uFrameType)
+{
+   switch ( uFrameType )
+   {
+      case 'G': return LIGHTTELEMETRY_GFRAMELENGTH;
+      case 'A': return LIGHTTELEMETRY_AFRAMELENGTH;
+      case 'S': return LIGHTTELEMETRY_SFRAMELENGTH;
+      case 'O': return LIGHTTELEMETRY_OFRAMELENGTH;
+      case 'N': return LIGHTTELEMETRY_NFRAMELENGTH;
+      case 'X': return LIGHTTELEMETRY_XFRAMELENGTH;
+   }
+   return 0;
+}
+
+void ltm_bulk_init(t_ltm_bulk_parser* pParser, t_ltm_bulk_handler pHandler, void* pContext)
+{
+   memset(pParser, 0, sizeof(t_ltm_bulk_parser));
+   pParser->pHandler = pHandler;
+   pParser->pContext = pContext;
+}
+
+static int _ltm_bulk_parse_span(void* pContext, u8* pData, int iLength)
+{
+   t_ltm_bulk_parser* pParser = (t_ltm_bulk_parser*)pContext;
+   int iPos = 0;
+   while ( iPos < iLength )
+   {
+      if ( pData[iPos] != '$' )
+      {
+         const u8* pStart = (const u8*)memchr(pData + iPos, '$', iLength - iPos);
+         int iStart = (NULL != pStart) ? (int)(pStart - pData) : iLength;
+         pParser->uBytesDiscarded += iStart - iPos;
+         iPos = iStart;
+         if ( iPos >= iLength )
+            break;
+      }
+      // Header: $, T, frame type
+      if ( iLength - iPos < 3 )
+         break;
+      u8* pFrame = pData + iPos;
+      int iFrameLength = 0;
+      if ( pFrame[1] == 'T' )
+         iFrameLength = _ltm_bulk_get_frame_length(pFrame[2]);
+      if ( 0 == iFrameLength )
+      {
+         iPos++;
+         pParser->uBytesDiscarded++;
+         continue;
+      }
+      if ( iLength - iPos < iFrameLength )
+         break;
+
+      // The payload and the checksum byte xor to 0
+      u8 uChecksum = 0;
+      for( int i=3; i<iFrameLength; i++ )
+         uChecksum ^= pFrame[i];
+      if ( 0 != uChecksum )
+      {
+         iPos++;
+         pParser->uChecksumErrors++;
+         pParser->uBytesDiscarded++;
+         continue;
+      }
+      pParser->uFrames++;
+      if ( NULL != pParser->pHandler )
+         pParser->pHandler(pFrame[2], pFrame + 3, iFrameLength - 4, pParser->pContext);
+      iPos += iFrameLength;
+   }
+   return iPos;
+}
+
+int ltm_bulk_parse(t_ltm_bulk_parser* pParser, u8* pData, int iLength)
+{
+   u32 uFramesBefore = pParser->uFrames;
+   telemetry_bulk_parse(&pParser->carry, pData, iLength, _ltm_bulk_parse_span, pParser);
+   return (int)(pParser->uFrames - uFramesBefore);
+}
+
+void msp_bulk_init(t_msp_bulk_parser* pParser, t_msp_bulk_handler pHandler, void* pContext)
+{
+   memset(pParser, 0, sizeof(t_msp_bulk_parser));
+   pParser->pHandler = pHandler;
+   pParser->pContext = pContext;
+}
+
+static int _msp_bulk_parse_span(void* pContext, u8* pData, int iLength)
+{
+   t_msp_bulk_parser* pParser = (t_msp_bulk_parser*)pContext;
+   t_msp_bulk_frame frame;
+   int iPos = 0;
+   while ( iPos < iLength )
+   {
+      if ( pData[iPos] != '$' )
+      {
+         const u8* pStart = (const u8*)memchr(pData + iPos, '$', iLength - iPos);
+         int iStart = (NULL != pStart) ? (int)(pStart - pData) : iLength;
+         pParser->uBytesDiscarded += iStart - iPos;
+         iPos = iStart;
+         if ( iPos >= iLength )
+            break;
+      }
+      // Header: $, M, direction, size, command
+      if ( iLength - iPos < 5 )
+         break;
+      u8* pFrame = pData + iPos;
+      if ( (pFrame[1] != 'M') || ((pFrame[2] != '<') && (pFrame[2] != '>')) )
+      {
+         iPos++;
+         pParser->uBytesDiscarded++;
+         continue;
+      }
+      int iFrameLength = 6 + (int)pFrame[3];
+      if ( iLength - iPos < iFrameLength )
+         break;
+
+      // Size, command and payload xor to the checksum byte
+      u8 uChecksum = 0;
+      for( int i=3; i<iFrameLength-1; i++ )
+         uChecksum ^= pFrame[i];
+      if ( uChecksum != pFrame[iFrameLength-1] )
+      {
+         iPos++;
+         pParser->uChecksumErrors++;
+         pParser->uBytesDiscarded++;
+         continue;
+      }
+      pParser->uFrames++;
+      if ( NULL != pParser->pHandler )
+      {
+         frame.pData = pFrame;
+         frame.iLength = iFrameLength;
+         frame.uDirection = pFrame[2];
+         frame.uCommand = pFrame[4];
+         frame.pPayload = pFrame + 5;
+         frame.iPayloadLength = (int)pFrame[3];
+         pParser->pHandler(&frame, pParser->pContext);
+      }
+      iPos += iFrameLength;
+   }
+   return iPos;
+}
+
+int msp_bulk_parse(t_msp_bulk_parser* pParser, u8* pData, int iLength)
+{
+   u32 uFramesBefore = pParser->uFrames;
+   telemetry_bulk_parse(&pParser->carry, pData, iLength, _msp_bulk_parse_span, pParser);
+   return (int)(pParser->uFrames - uFramesBefore);
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <stddef.h>
+#include "base.h"
+#include "../../mavlink/common/mavlink.h"
+
+// Bulk parsers for the telemetry read from the FC serial port (MAVLink, LTM, MSP).
+// A whole read buffer is parsed in place: start markers are found with memchr, each frame is checked
+// (CRC or checksum) over its contiguous span and only then handed out as pointers into the buffer.
+// Only the bytes of a frame that is not complete at the end of a buffer are kept (carry buffer), until
+// the next read completes it.
+
+// Largest frame of any of the protocols (MAVLink v2 signed)
+#define TELEMETRY_BULK_MAX_FRAME_LENGTH MAVLINK_MAX_PACKET_LEN
+
+typedef struct
+{
+   u8 uBuffer[2*TELEMETRY_BULK_MAX_FRAME_LENGTH];
+   int iLength;
+} t_telemetry_bulk_carry;
+
+// Parses the whole frames at the start of pData. Returns how many bytes were consumed (parsed frames
+// and discarded bytes); parsing stops at the first frame that is not complete yet or that can't be
+// confirmed without the bytes that follow it.
+typedef int (*t_telemetry_bulk_parse_span)(void* pContext, u8* pData, int iLength);
+
+void telemetry_bulk_carry_reset(t_telemetry_bulk_carry* pCarry);
+// Runs pfParseSpan over the carried bytes and the new data
+void telemetry_bulk_parse(t_telemetry_bulk_carry* pCarry, u8* pData, int iLength, t_telemetry_bulk_parse_span pfParseSpan, void* pContext);
+
+// MAVLink
+
+// Message ids below this are looked up in a table, the ones above in a short list
+#define MAVLINK_BULK_FILTER_TABLE_SIZE 1024
+#define MAVLINK_BULK_MAX_HANDLERS 32
+
+typedef struct
+{
+   const u8* pData; // the whole message
+   int iLength;
+   const u8* pPayload;
+   int iPayloadLength; // can be shorter than the message struct (MAVLink 2 truncates trailing zeros)
+   u32 uMessageId;
+   u8 uSysId;
+   u8 uCompId;
+   u8 uSeq;
+   u8 uIsV2;
+} t_mavlink_bulk_message;
+
+typedef void (*t_mavlink_bulk_handler)(const t_mavlink_bulk_message* pMessage, void* pContext);
+
+typedef struct
+{
+   u32 uMessageId;
+   t_mavlink_bulk_handler pHandler;
+   void* pContext;
+} t_mavlink_bulk_filter;
+
+typedef struct
+{
+   t_telemetry_bulk_carry carry;
+   u8 uFilterIndex[MAVLINK_BULK_FILTER_TABLE_SIZE]; // index+1 in filters, 0 if not registered
+   t_mavlink_bulk_filter filters[MAVLINK_BULK_MAX_HANDLERS];
+   int iCountFilters;
+   int iCountFiltersAboveTable;
+   t_mavlink_bulk_handler pDefaultHandler;
+   void* pDefaultContext;
+
+   u32 uMessages; // all valid messages, dispatched or not
+   u32 uMessagesDispatched;
+   u32 uCRCErrors;
+   u32 uBytesDiscarded;
+} t_mavlink_bulk_parser;
+
+void mavlink_bulk_init(t_mavlink_bulk_parser* pParser);
+// Returns 0 on success, -1 if the filter table is full
+int mavlink_bulk_register(t_mavlink_bulk_parser* pParser, u32 uMessageId, t_mavlink_bulk_handler pHandler, void* pContext);
+// Gets all the valid messages with no registered handler. Without it, messages of other dialects
+// (unknown ids, no CRC check possible) are skipped.
+void mavlink_bulk_set_default_handler(t_mavlink_bulk_parser* pParser, t_mavlink_bulk_handler pHandler, void* pContext);
+// Returns the number of valid messages found (dispatched or not)
+int mavlink_bulk_parse(t_mavlink_bulk_parser* pParser, u8* pData, int iLength);
+
+// LTM
+
+// Complete frame lengths, including the headers and the checksum
+#define LIGHTTELEMETRY_GFRAMELENGTH 18
+#define LIGHTTELEMETRY_AFRAMELENGTH 10
+#define LIGHTTELEMETRY_SFRAMELENGTH 11
+#define LIGHTTELEMETRY_OFRAMELENGTH 18
+#define LIGHTTELEMETRY_NFRAMELENGTH 10
+#define LIGHTTELEMETRY_XFRAMELENGTH 10
+
+typedef void (*t_ltm_bulk_handler)(u8 uFrameType, const u8* pPayload, int iPayloadLength, void* pContext);
+
+typedef struct
+{
+   t_telemetry_bulk_carry carry;
+   t_ltm_bulk_handler pHandler;
+   void* pContext;
+   u32 uFrames;
+   u32 uChecksumErrors;
+   u32 uBytesDiscarded;
+} t_ltm_bulk_parser;
+
+void ltm_bulk_init(t_ltm_bulk_parser* pParser, t_ltm_bulk_handler pHandler, void* pContext);
+// Returns the number of valid frames found
+int ltm_bulk_parse(t_ltm_bulk_parser* pParser, u8* pData, int iLength);
+
+// MSP (v1)
+
+typedef struct
+{
+   const u8* pData; // the whole frame: $, M, direction, size, command, payload, checksum
+   int iLength;
+   u8 uDirection; // '<' to the FC, '>' from the FC
+   u8 uCommand;
+   const u8* pPayload;
+   int iPayloadLength;
+} t_msp_bulk_frame;
+
+typedef void (*t_msp_bulk_handler)(const t_msp_bulk_frame* pFrame, void* pContext);
+
+typedef struct
+{
+   t_telemetry_bulk_carry carry;
+   t_msp_bulk_handler pHandler;
+   void* pContext;
+   u32 uFrames;
+   u32 uChecksumErrors;
+   u32 uBytesDiscarded;
+} t_msp_bulk_parser;
+
+void msp_bulk_init(t_msp_bulk_parser* pParser, t_msp_bulk_handler pHandler, void* pContext);
+// Returns the number of valid frames found
+int msp_bulk_parse(t_msp_bulk_parser* pParser, u8* pData, int iLength);
+
+// MAVLink field extractors: read a field straight from the received payload, at the offset of the field in
+// the message struct (the structs are packed in wire order). Bytes truncated by MAVLink 2 read as 0.
+#define MAVLINK_BULK_OFFSET(msgname, field) ((int)offsetof(mavlink_##msgname##_t, field))
+
+static inline void mavlink_bulk_get_bytes(const t_mavlink_bulk_message* pMessage, int iOffset, void* pOut, int iSize)
+{
+   int iAvailable = pMessage->iPayloadLength - iOffset;
+   if ( iAvailable >= iSize )
+   {
+      memcpy(pOut, pMessage->pPayload + iOffset, iSize);
+      return;
+   }
+   if ( iAvailable < 0 )
+      iAvailable = 0;
+   if ( iAvailable > 0 )
+      memcpy(pOut, pMessage->pPayload + iOffset, iAvailable);
+   memset((u8*)pOut + iAvailable, 0, iSize - iAvailable);
+}
+
+static inline u8 mavlink_bulk_get_u8(const t_mavlink_bulk_message* pMessage, int iOffset)
+{
+   return (iOffset < pMessage->iPayloadLength) ? pMessage->pPayload[iOffset] : 0;
+}
+
+static inline u16 mavlink_bulk_get_u16(const t_mavlink_bulk_message* pMessage, int iOffset)
+{
+   u16 uValue;
+   mavlink_bulk_get_bytes(pMessage, iOffset, &uValue, sizeof(uValue));
+   return uValue;
+}
+
+static inline u32 mavlink_bulk_get_u32(const t_mavlink_bulk_message* pMessage, int iOffset)
+{
+   u32 uValue;
+   mavlink_bulk_get_bytes(pMessage, iOffset, &uValue, sizeof(uValue));
+   return uValue;
+}
+
+static inline float mavlink_bulk_get_float(const t_mavlink_bulk_message* pMessage, int iOffset)
+{
+   float fValue;
+   mavlink_bulk_get_bytes(pMessage, iOffset, &fValue, sizeof(fValue));
+   return fValue;
+}
+
+// Copies a char array field (not null terminated on the wire) and adds the terminator
+static inline void mavlink_bulk_get_string(const t_mavlink_bulk_message* pMessage, int iOffset, int iFieldLength, char* szOut)
+{
+   mavlink_bulk_get_bytes(pMessage, iOffset, szOut, iFieldLength);
+   szOut[iFieldLength] = 0;
+}
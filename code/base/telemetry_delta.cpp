@@ -0,0 +1,343 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "telemetry_delta.h"
+#include "../common/string_utils.h"
+
+int telemetry_delta_is_encoded_type(u8 uPacketType)
+{
+   if ( (uPacketType == PACKET_TYPE_RUBY_TELEMETRY_EXTENDED) ||
+        (uPacketType == PACKET_TYPE_FC_TELEMETRY) ||
+        (uPacketType == PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS) ||
+        (uPacketType == PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_TX_HISTORY) )
+      return 1;
+   return 0;
+}
+
+static t_telemetry_delta_stream* _telemetry_delta_get_stream(t_telemetry_delta_stream* pStreams, int* piCountStreams, u32 uVehicleId, u8 uPacketType)
+{
+   for( int i=0; i<*piCountStreams; i++ )
+   {
+      if ( (pStreams[i].uVehicleId == uVehicleId) && (pStreams[i].uPacketType == uPacketType) )
+         return &pStreams[i];
+   }
+   if ( *piCountStreams >= TELEMETRY_DELTA_MAX_STREAMS )
+      return NULL;
+
+   t_telemetry_delta_stream* pStream = &pStreams[*piCountStreams];
+   (*piCountStreams)++;
+   memset(pStream, 0, sizeof(t_telemetry_delta_stream));
+   pStream->uVehicleId = uVehicleId;
+   pStream->uPacketType = uPacketType;
+   log_line("[TelemDelta] Added stream for VID %u, packet type %s (%d streams)", uVehicleId, str_get_packet_type(uPacketType), *piCountStreams);
+   return pStream;
+}
+
+// Writes the runs of bytes of pData that differ from pBase.
+// Returns the length of the runs, or -1 if they don't fit in iMaxLength bytes.
+static int _telemetry_delta_build_runs(const u8* pBase, const u8* pData, int iLength, u8* pOutput, int iMaxLength)
+{
+   int iOut = 0;
+   int iLastRunEnd = 0;
+   int i = 0;
+   while ( i < iLength )
+   {
+      if ( pBase[i] == pData[i] )
+      {
+         i++;
+         continue;
+      }
+
+      int iSkip = i - iLastRunEnd;
+      while ( iSkip > 255 )
+      {
+         if ( iOut + 2 > iMaxLength )
+            return -1;
+         pOutput[iOut++] = 255;
+         pOutput[iOut++] = 0;
+         iSkip -= 255;
+      }
+
+      // Extend the run over the changed bytes and over the short unchanged gaps between them
+      int iEnd = i+1;
+      while ( (iEnd < iLength) && (iEnd - i < 255) )
+      {
+         if ( pBase[iEnd] != pData[iEnd] )
+         {
+            iEnd++;
+            continue;
+         }
+         int iGapEnd = iEnd;
+         while ( (iGapEnd < iLength) && (pBase[iGapEnd] == pData[iGapEnd]) && (iGapEnd - iEnd <= TELEMETRY_DELTA_MAX_MERGED_GAP) )
+            iGapEnd++;
+         if ( (iGapEnd >= iLength) || (iGapEnd - iEnd > TELEMETRY_DELTA_MAX_MERGED_GAP) || (iGapEnd - i >= 255) )
+            break;
+         iEnd = iGapEnd;
+      }
+
+      int iCount = iEnd - i;
+      if ( iOut + 2 + iCount > iMaxLength )
+         return -1;
+      pOutput[iOut++] = (u8)iSkip;
+      pOutput[iOut++] = (u8)iCount;
+      memcpy(pOutput + iOut, pData + i, iCount);
+      iOut += iCount;
+      iLastRunEnd = iEnd;
+      i = iEnd;
+   }
+   return iOut;
+}
+
+// Applies the runs on top of pOutput (that has the keyframe). Returns 0 on success, -1 if the runs are not valid.
+static int _telemetry_delta_apply_runs(const u8* pRuns, int iRunsLength, u8* pOutput, int iLength)
+{
+   int iPos = 0;
+   int i = 0;
+   while ( i < iRunsLength )
+   {
+      if ( i + 2 > iRunsLength )
+         return -1;
+      int iSkip = pRuns[i];
+      int iCount = pRuns[i+1];
+      i += 2;
+      if ( (iPos + iSkip + iCount > iLength) || (i + iCount > iRunsLength) )
+         return -1;
+      iPos += iSkip;
+      memcpy(pOutput + iPos, pRuns + i, iCount);
+      iPos += iCount;
+      i += iCount;
+   }
+   return 0;
+}
+
+void telemetry_delta_encoder_init(t_telemetry_delta_encoder* pEncoder, u32 uKeyframeIntervalMs, u8 uSessionId)
+{
+   if ( NULL == pEncoder )
+      return;
+   memset(pEncoder, 0, sizeof(t_telemetry_delta_encoder));
+   pEncoder->uKeyframeIntervalMs = uKeyframeIntervalMs;
+   pEncoder->uSessionId = uSessionId;
+}
+
+void telemetry_delta_encoder_force_keyframes(t_telemetry_delta_encoder* pEncoder)
+{
+   if ( NULL == pEncoder )
+      return;
+   for( int i=0; i<pEncoder->iCountStreams; i++ )
+      pEncoder->streams[i].iHasKeyframe = 0;
+}
+
+int telemetry_delta_encode(t_telemetry_delta_encoder* pEncoder, const u8* pPacket, int iLength, u8* pOutput, u32 uTimeNow)
+{
+   if ( (NULL == pEncoder) || (NULL == pPacket) || (NULL == pOutput) || (iLength <= (int)sizeof(t_packet_header)) )
+      return 0;
+
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_COMPONENT_TELEMETRY )
+      return 0;
+   if ( ! telemetry_delta_is_encoded_type(pPH->packet_type) )
+      return 0;
+   if ( pPH->total_length != iLength )
+      return 0;
+   int iPayloadLength = iLength - (int)sizeof(t_packet_header);
+   if ( (iPayloadLength > MAX_PACKET_PAYLOAD) || (iLength + (int)sizeof(t_packet_header_telemetry_delta) > MAX_PACKET_TOTAL_SIZE) )
+      return 0;
+
+   t_telemetry_delta_stream* pStream = _telemetry_delta_get_stream(pEncoder->streams, &pEncoder->iCountStreams, pPH->vehicle_id_src, pPH->packet_type);
+   if ( NULL == pStream )
+      return 0;
+
+   const u8* pPayload = pPacket + sizeof(t_packet_header);
+   u8* pBody = pOutput + sizeof(t_packet_header) + sizeof(t_packet_header_telemetry_delta);
+   int iBodyLength = -1;
+
+   bool bKeyframe = false;
+   if ( (! pStream->iHasKeyframe) || (pStream->iPayloadLength != iPayloadLength) )
+      bKeyframe = true;
+   if ( (uTimeNow < pStream->uTimeLastKeyframe) || (uTimeNow >= pStream->uTimeLastKeyframe + pEncoder->uKeyframeIntervalMs) )
+      bKeyframe = true;
+
+   if ( ! bKeyframe )
+   {
+      iBodyLength = _telemetry_delta_build_runs(pStream->uKeyframe, pPayload, iPayloadLength, pBody, (iPayloadLength * TELEMETRY_DELTA_MAX_DELTA_PERCENT)/100);
+      if ( iBodyLength < 0 )
+         bKeyframe = true;
+   }
+
+   pStream->uSequence++;
+
+   t_packet_header_telemetry_delta* pPHTD = (t_packet_header_telemetry_delta*)(pOutput + sizeof(t_packet_header));
+   pPHTD->uPacketType = pPH->packet_type;
+   pPHTD->uFlags = 0;
+   pPHTD->uSessionId = pEncoder->uSessionId;
+   pPHTD->uSequence = pStream->uSequence;
+   pPHTD->uPayloadLength = (u16)iPayloadLength;
+
+   if ( bKeyframe )
+   {
+      memcpy(pBody, pPayload, iPayloadLength);
+      iBodyLength = iPayloadLength;
+      memcpy(pStream->uKeyframe, pPayload, iPayloadLength);
+      pStream->iPayloadLength = iPayloadLength;
+      pStream->uKeyframeSequence = pStream->uSequence;
+      pStream->uTimeLastKeyframe = uTimeNow;
+      pStream->iHasKeyframe = 1;
+      pPHTD->uFlags |= FLAG_TELEMETRY_DELTA_KEYFRAME;
+      pEncoder->uKeyframes++;
+   }
+   pPHTD->uKeyframeSequence = pStream->uKeyframeSequence;
+
+   memcpy(pOutput, pPacket, sizeof(t_packet_header));
+   t_packet_header* pPHOut = (t_packet_header*)pOutput;
+   pPHOut->packet_type = PACKET_TYPE_RUBY_TELEMETRY_DELTA;
+   pPHOut->total_length = (u16)(sizeof(t_packet_header) + sizeof(t_packet_header_telemetry_delta) + iBodyLength);
+
+   pEncoder->uPackets++;
+   pEncoder->uBytesIn += iLength;
+   pEncoder->uBytesOut += pPHOut->total_length;
+   return pPHOut->total_length;
+}
+
+void telemetry_delta_encoder_log_info(t_telemetry_delta_encoder* pEncoder)
+{
+   if ( (NULL == pEncoder) || (0 == pEncoder->uPackets) )
+      return;
+   log_line("[TelemDelta] Encoded %u packets (%u keyframes), %u bytes to %u bytes (%d%%)",
+      pEncoder->uPackets, pEncoder->uKeyframes, pEncoder->uBytesIn, pEncoder->uBytesOut,
+      (int)(((u64)pEncoder->uBytesOut * 100) / (u64)pEncoder->uBytesIn));
+}
+
+void telemetry_delta_decoder_init(t_telemetry_delta_decoder* pDecoder)
+{
+   if ( NULL == pDecoder )
+      return;
+   memset(pDecoder, 0, sizeof(t_telemetry_delta_decoder));
+}
+
+int telemetry_delta_decode(t_telemetry_delta_decoder* pDecoder, const u8* pPacket, int iLength, u8* pOutput)
+{
+   if ( (NULL == pDecoder) || (NULL == pPacket) || (NULL == pOutput) )
+      return -1;
+
+   int iHeadersLength = (int)(sizeof(t_packet_header) + sizeof(t_packet_header_telemetry_delta));
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   t_packet_header_telemetry_delta* pPHTD = (t_packet_header_telemetry_delta*)(pPacket + sizeof(t_packet_header));
+   if ( (iLength < iHeadersLength) || (pPH->total_length != iLength) || (pPH->packet_type != PACKET_TYPE_RUBY_TELEMETRY_DELTA) ||
+        (0 == pPHTD->uPayloadLength) || (pPHTD->uPayloadLength > MAX_PACKET_PAYLOAD) ||
+        (sizeof(t_packet_header) + pPHTD->uPayloadLength > MAX_PACKET_TOTAL_SIZE) )
+   {
+      pDecoder->uPacketsInvalid++;
+      return -1;
+   }
+
+   t_telemetry_delta_stream* pStream = _telemetry_delta_get_stream(pDecoder->streams, &pDecoder->iCountStreams, pPH->vehicle_id_src, pPHTD->uPacketType);
+   if ( NULL == pStream )
+   {
+      pDecoder->uPacketsInvalid++;
+      return 0;
+   }
+   pDecoder->uPackets++;
+
+   bool bKeyframe = (pPHTD->uFlags & FLAG_TELEMETRY_DELTA_KEYFRAME)?true:false;
+   const u8* pBody = pPacket + iHeadersLength;
+   int iBodyLength = iLength - iHeadersLength;
+
+   // The vehicle restarted: the sequences and keyframes so far are not valid anymore
+   if ( pStream->iHasSequence && (pStream->uSessionId != pPHTD->uSessionId) )
+   {
+      log_line("[TelemDelta] New session for VID %u, packet type %s", pPH->vehicle_id_src, str_get_packet_type(pPHTD->uPacketType));
+      pStream->iHasSequence = 0;
+      pStream->iHasKeyframe = 0;
+      pDecoder->uSessionsChanged++;
+   }
+   pStream->uSessionId = pPHTD->uSessionId;
+
+   if ( pStream->iHasSequence )
+   {
+      int iDiff = (int)(short)(pPHTD->uSequence - pStream->uSequence);
+      // Same or older than the last one
+      if ( iDiff <= 0 )
+      {
+         pDecoder->uPacketsOutOfOrder++;
+         return 0;
+      }
+      if ( iDiff > 1 )
+         pDecoder->uPacketsLost += iDiff - 1;
+   }
+   pStream->iHasSequence = 1;
+   pStream->uSequence = pPHTD->uSequence;
+
+   u8* pPayloadOut = pOutput + sizeof(t_packet_header);
+   if ( bKeyframe )
+   {
+      if ( iBodyLength != pPHTD->uPayloadLength )
+      {
+         pDecoder->uPacketsInvalid++;
+         return -1;
+      }
+      memcpy(pStream->uKeyframe, pBody, iBodyLength);
+      pStream->iPayloadLength = iBodyLength;
+      pStream->uKeyframeSequence = pPHTD->uSequence;
+      pStream->iHasKeyframe = 1;
+      memcpy(pPayloadOut, pBody, iBodyLength);
+      pDecoder->uKeyframes++;
+   }
+   else
+   {
+      if ( (! pStream->iHasKeyframe) || (pStream->uKeyframeSequence != pPHTD->uKeyframeSequence) || (pStream->iPayloadLength != pPHTD->uPayloadLength) )
+      {
+         pDecoder->uPacketsNoKeyframe++;
+         return 0;
+      }
+      memcpy(pPayloadOut, pStream->uKeyframe, pStream->iPayloadLength);
+      if ( 0 != _telemetry_delta_apply_runs(pBody, iBodyLength, pPayloadOut, pStream->iPayloadLength) )
+      {
+         pDecoder->uPacketsInvalid++;
+         return -1;
+      }
+   }
+
+   memcpy(pOutput, pPacket, sizeof(t_packet_header));
+   t_packet_header* pPHOut = (t_packet_header*)pOutput;
+   pPHOut->packet_type = pPHTD->uPacketType;
+   pPHOut->total_length = (u16)(sizeof(t_packet_header) + pPHTD->uPayloadLength);
+   radio_packet_compute_crc(pOutput, pPHOut->total_length);
+   return pPHOut->total_length;
+}
+
+void telemetry_delta_decoder_log_info(t_telemetry_delta_decoder* pDecoder)
+{
+   if ( (NULL == pDecoder) || (0 == pDecoder->uPackets) )
+      return;
+   log_line("[TelemDelta] Decoded %u packets (%u keyframes), lost: %u, skipped (no keyframe): %u, out of order: %u, invalid: %u, sessions changed: %u",
+      pDecoder->uPackets, pDecoder->uKeyframes, pDecoder->uPacketsLost, pDecoder->uPacketsNoKeyframe,
+      pDecoder->uPacketsOutOfOrder, pDecoder->uPacketsInvalid, pDecoder->uSessionsChanged);
+}
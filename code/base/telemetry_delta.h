@@ -0,0 +1,82 @@
+#pragma once
+#include "base.h"
+#include "../radio/radiopackets2.h"
+
+// Delta encoding of the periodic telemetry structures sent from the vehicle to the controller
+// (Ruby telemetry extended, FC telemetry, vehicle radio rx cards stats, vehicle tx history).
+// A keyframe (the full original payload) is sent periodically, or when the structure size changes; the
+// packets in between carry only the bytes that differ from the last keyframe. Each delta refers to its
+// keyframe by sequence number, so a lost delta never affects the following ones; a lost keyframe makes
+// the receiver skip the deltas up to the next keyframe. A new session id on each encoder start keeps the
+// receiver from applying deltas of a restarted vehicle to the keyframes it had before.
+// Encoded packets are PACKET_TYPE_RUBY_TELEMETRY_DELTA packets. The receiver rebuilds the original
+// packet (same header, original packet type, length and CRC), so consumers are not aware of the encoding.
+
+#define TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS 1000
+// First controller software build that decodes PACKET_TYPE_RUBY_TELEMETRY_DELTA
+#define TELEMETRY_DELTA_MIN_SW_BUILD 255
+// 4 packet types from up to 6 vehicles
+#define TELEMETRY_DELTA_MAX_STREAMS 24
+// Gaps of unchanged bytes up to this size are sent inside a run rather than starting a new run
+#define TELEMETRY_DELTA_MAX_MERGED_GAP 2
+// A delta bigger than this percent of the full payload is sent as a keyframe instead
+#define TELEMETRY_DELTA_MAX_DELTA_PERCENT 70
+
+typedef struct
+{
+   u32 uVehicleId;
+   u8 uPacketType;
+   u8 uSessionId;
+   u16 uSequence; // last sent (encoder) or last received (decoder) packet
+   u16 uKeyframeSequence;
+   u32 uTimeLastKeyframe;
+   int iHasSequence;
+   int iHasKeyframe;
+   int iPayloadLength;
+   u8 uKeyframe[MAX_PACKET_PAYLOAD];
+} t_telemetry_delta_stream;
+
+typedef struct
+{
+   t_telemetry_delta_stream streams[TELEMETRY_DELTA_MAX_STREAMS];
+   int iCountStreams;
+   u32 uKeyframeIntervalMs;
+   u8 uSessionId;
+
+   u32 uPackets;
+   u32 uKeyframes;
+   u32 uBytesIn; // full packets
+   u32 uBytesOut; // encoded packets
+} t_telemetry_delta_encoder;
+
+typedef struct
+{
+   t_telemetry_delta_stream streams[TELEMETRY_DELTA_MAX_STREAMS];
+   int iCountStreams;
+
+   u32 uPackets;
+   u32 uKeyframes;
+   u32 uPacketsLost; // sequence gaps
+   u32 uPacketsNoKeyframe; // deltas dropped because their keyframe was not received
+   u32 uPacketsOutOfOrder;
+   u32 uPacketsInvalid;
+   u32 uSessionsChanged;
+} t_telemetry_delta_decoder;
+
+// Packet types that are delta encoded
+int telemetry_delta_is_encoded_type(u8 uPacketType);
+
+// uSessionId must differ from the one of the previous run (i.e. derived from the current time)
+void telemetry_delta_encoder_init(t_telemetry_delta_encoder* pEncoder, u32 uKeyframeIntervalMs, u8 uSessionId);
+// Next packet of each stream is sent as a keyframe
+void telemetry_delta_encoder_force_keyframes(t_telemetry_delta_encoder* pEncoder);
+// Encodes a single packet into pOutput (MAX_PACKET_TOTAL_SIZE bytes).
+// Returns the length of the encoded packet, or 0 if the packet must be sent unchanged.
+int telemetry_delta_encode(t_telemetry_delta_encoder* pEncoder, const u8* pPacket, int iLength, u8* pOutput, u32 uTimeNow);
+void telemetry_delta_encoder_log_info(t_telemetry_delta_encoder* pEncoder);
+
+void telemetry_delta_decoder_init(t_telemetry_delta_decoder* pDecoder);
+// Rebuilds the original packet of a PACKET_TYPE_RUBY_TELEMETRY_DELTA packet into pOutput (MAX_PACKET_TOTAL_SIZE bytes).
+// Returns the length of the rebuilt packet, 0 if it can't be rebuilt now (no keyframe, stale), -1 if invalid.
+int telemetry_delta_decode(t_telemetry_delta_decoder* pDecoder, const u8* pPacket, int iLength, u8* pOutput);
+void telemetry_delta_decoder_log_info(t_telemetry_delta_decoder* pDecoder);
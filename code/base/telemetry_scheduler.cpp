@@ -0,0 +1,431 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "telemetry_scheduler.h"
+#include "telemetry_bulk_parser.h"
+
+typedef struct
+{
+   u8 uData[MAVLINK_MAX_PACKET_LEN];
+   int iLength;
+   u32 uMessageId;
+   u8 uSysId;
+   u8 uCompId;
+   int iCoalesce;
+   u32 uTimeQueuedMicros; // when it was first queued, used for the max queue time
+   u32 uTimeUpdatedMicros; // when its current value was read, used for the latency
+   int iNext;
+} t_telemetry_scheduler_message;
+
+typedef struct
+{
+   int iHead;
+   int iTail;
+   int iCount;
+   int iBytes;
+   int iRateLimit;
+   int iTokens; // can go negative: a message larger than the tokens left is still sent
+   u32 uTimeLastRefillMicros;
+   u32 uMaxDelayMicros;
+   u32 uTmpLatencySumMicros;
+   u32 uTmpLatencyCount;
+   u32 uTmpLatencyMaxMicros;
+} t_telemetry_scheduler_class;
+
+static t_telemetry_scheduler_message s_TelemSchedMessages[TELEMETRY_SCHEDULER_MAX_QUEUED_MESSAGES];
+static int s_iTelemSchedFreeMessages[TELEMETRY_SCHEDULER_MAX_QUEUED_MESSAGES];
+static int s_iTelemSchedFreeMessagesCount = 0;
+static t_telemetry_scheduler_class s_TelemSchedClasses[TELEMETRY_CLASSES];
+static shared_mem_telemetry_scheduler_stats s_TelemSchedStats;
+static int s_iTelemSchedMaxSegmentLength = MAVLINK_MAX_PACKET_LEN;
+
+static t_mavlink_bulk_parser s_TelemSchedParser;
+static u32 s_uTelemSchedParseTimeMicros = 0;
+
+static void _telemetry_scheduler_on_message(const t_mavlink_bulk_message* pMessage, void* pContext);
+
+void telemetry_scheduler_init(int iMaxSegmentLength)
+{
+   s_iTelemSchedMaxSegmentLength = iMaxSegmentLength;
+   if ( s_iTelemSchedMaxSegmentLength < MAVLINK_MAX_PACKET_LEN )
+      s_iTelemSchedMaxSegmentLength = MAVLINK_MAX_PACKET_LEN;
+   if ( s_iTelemSchedMaxSegmentLength > RAW_TELEMETRY_MAX_BUFFER )
+      s_iTelemSchedMaxSegmentLength = RAW_TELEMETRY_MAX_BUFFER;
+
+   memset(&s_TelemSchedStats, 0, sizeof(shared_mem_telemetry_scheduler_stats));
+   s_TelemSchedStats.iEnabled = 1;
+   s_iTelemSchedFreeMessagesCount = 0;
+   for( int i=TELEMETRY_SCHEDULER_MAX_QUEUED_MESSAGES-1; i>=0; i-- )
+      s_iTelemSchedFreeMessages[s_iTelemSchedFreeMessagesCount++] = i;
+   mavlink_bulk_init(&s_TelemSchedParser);
+   mavlink_bulk_set_default_handler(&s_TelemSchedParser, _telemetry_scheduler_on_message, &s_uTelemSchedParseTimeMicros);
+
+   u32 uMaxDelaysMs[TELEMETRY_CLASSES] = { TELEMETRY_SCHEDULER_MAX_DELAY_MS_CRITICAL, TELEMETRY_SCHEDULER_MAX_DELAY_MS_FLIGHT, TELEMETRY_SCHEDULER_MAX_DELAY_MS_NORMAL, TELEMETRY_SCHEDULER_MAX_DELAY_MS_BULK };
+   int iRateLimits[TELEMETRY_CLASSES] = { 0, 0, DEFAULT_TELEMETRY_RATE_LIMIT_NORMAL, DEFAULT_TELEMETRY_RATE_LIMIT_BULK };
+   memset(s_TelemSchedClasses, 0, sizeof(s_TelemSchedClasses));
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      s_TelemSchedClasses[i].iHead = -1;
+      s_TelemSchedClasses[i].iTail = -1;
+      s_TelemSchedClasses[i].uMaxDelayMicros = uMaxDelaysMs[i] * 1000;
+      telemetry_scheduler_set_rate_limit(i, iRateLimits[i]);
+   }
+   log_line("[TelemScheduler] Init: max segment length: %d bytes, rate limits (bytes/sec): normal: %d, bulk: %d",
+      s_iTelemSchedMaxSegmentLength, iRateLimits[TELEMETRY_CLASS_NORMAL], iRateLimits[TELEMETRY_CLASS_BULK]);
+}
+
+void telemetry_scheduler_set_rate_limit(int iClass, int iBytesPerSecond)
+{
+   if ( (iClass < 0) || (iClass >= TELEMETRY_CLASSES) )
+      return;
+   if ( iBytesPerSecond < 0 )
+      iBytesPerSecond = 0;
+   s_TelemSchedClasses[iClass].iRateLimit = iBytesPerSecond;
+   s_TelemSchedClasses[iClass].iTokens = 0;
+   s_TelemSchedClasses[iClass].uTimeLastRefillMicros = get_current_timestamp_micros();
+   s_TelemSchedStats.classes[iClass].iRateLimitBytesPerSecond = iBytesPerSecond;
+}
+
+int telemetry_scheduler_get_message_class(u32 uMessageId)
+{
+   switch ( uMessageId )
+   {
+      case MAVLINK_MSG_ID_HEARTBEAT:
+      case MAVLINK_MSG_ID_SYS_STATUS:
+      case MAVLINK_MSG_ID_STATUSTEXT:
+      case MAVLINK_MSG_ID_COMMAND_LONG:
+      case MAVLINK_MSG_ID_COMMAND_INT:
+      case MAVLINK_MSG_ID_COMMAND_ACK:
+      case MAVLINK_MSG_ID_MISSION_ACK:
+      case MAVLINK_MSG_ID_EXTENDED_SYS_STATE:
+      case MAVLINK_MSG_ID_HIGH_LATENCY:
+      case MAVLINK_MSG_ID_HIGH_LATENCY2:
+         return TELEMETRY_CLASS_CRITICAL;
+
+      case MAVLINK_MSG_ID_ATTITUDE:
+      case MAVLINK_MSG_ID_ATTITUDE_QUATERNION:
+      case MAVLINK_MSG_ID_GPS_RAW_INT:
+      case MAVLINK_MSG_ID_GPS2_RAW:
+      case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+      case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+      case MAVLINK_MSG_ID_VFR_HUD:
+      case MAVLINK_MSG_ID_ALTITUDE:
+      case MAVLINK_MSG_ID_HOME_POSITION:
+      case MAVLINK_MSG_ID_RC_CHANNELS:
+      case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
+      case MAVLINK_MSG_ID_BATTERY_STATUS:
+      case MAVLINK_MSG_ID_RADIO_STATUS:
+         return TELEMETRY_CLASS_FLIGHT;
+
+      case MAVLINK_MSG_ID_PARAM_VALUE:
+      case MAVLINK_MSG_ID_LOG_ENTRY:
+      case MAVLINK_MSG_ID_LOG_DATA:
+      case MAVLINK_MSG_ID_LOGGING_DATA:
+      case MAVLINK_MSG_ID_MISSION_COUNT:
+      case MAVLINK_MSG_ID_MISSION_ITEM:
+      case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+      case MAVLINK_MSG_ID_MISSION_REQUEST:
+      case MAVLINK_MSG_ID_MISSION_REQUEST_INT:
+      case MAVLINK_MSG_ID_FILE_TRANSFER_PROTOCOL:
+      case MAVLINK_MSG_ID_ENCAPSULATED_DATA:
+      case MAVLINK_MSG_ID_DATA_TRANSMISSION_HANDSHAKE:
+      case MAVLINK_MSG_ID_RAW_IMU:
+      case MAVLINK_MSG_ID_SCALED_IMU:
+      case MAVLINK_MSG_ID_SCALED_IMU2:
+      case MAVLINK_MSG_ID_SCALED_IMU3:
+      case MAVLINK_MSG_ID_HIGHRES_IMU:
+      case MAVLINK_MSG_ID_RAW_PRESSURE:
+      case MAVLINK_MSG_ID_SCALED_PRESSURE:
+      case MAVLINK_MSG_ID_SCALED_PRESSURE2:
+      case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
+      case MAVLINK_MSG_ID_VIBRATION:
+         return TELEMETRY_CLASS_BULK;
+   }
+   return TELEMETRY_CLASS_NORMAL;
+}
+
+// Only periodic stream messages with a single instance for each source, where just the latest value
+// matters. Messages with an instance in the payload (battery id, value name, ICAO address, port,
+// sensor id) and event messages are never coalesced.
+static int _telemetry_scheduler_can_coalesce(int iClass, u32 uMessageId)
+{
+   if ( TELEMETRY_CLASS_CRITICAL == iClass )
+      return 0;
+   if ( NULL == mavlink_get_msg_entry(uMessageId) )
+      return 0;
+   switch ( uMessageId )
+   {
+      case MAVLINK_MSG_ID_ATTITUDE:
+      case MAVLINK_MSG_ID_ATTITUDE_QUATERNION:
+      case MAVLINK_MSG_ID_GPS_RAW_INT:
+      case MAVLINK_MSG_ID_GPS2_RAW:
+      case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+      case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+      case MAVLINK_MSG_ID_VFR_HUD:
+      case MAVLINK_MSG_ID_ALTITUDE:
+      case MAVLINK_MSG_ID_HOME_POSITION:
+      case MAVLINK_MSG_ID_RC_CHANNELS:
+      case MAVLINK_MSG_ID_RADIO_STATUS:
+      case MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT:
+      case MAVLINK_MSG_ID_SYSTEM_TIME:
+      case MAVLINK_MSG_ID_ESTIMATOR_STATUS:
+      case MAVLINK_MSG_ID_POWER_STATUS:
+      case MAVLINK_MSG_ID_SCALED_IMU:
+      case MAVLINK_MSG_ID_SCALED_IMU2:
+      case MAVLINK_MSG_ID_SCALED_IMU3:
+      case MAVLINK_MSG_ID_RAW_PRESSURE:
+      case MAVLINK_MSG_ID_SCALED_PRESSURE:
+      case MAVLINK_MSG_ID_SCALED_PRESSURE2:
+      case MAVLINK_MSG_ID_VIBRATION:
+         return 1;
+   }
+   return 0;
+}
+
+static void _telemetry_scheduler_remove_head(int iClass)
+{
+   t_telemetry_scheduler_class* pClass = &s_TelemSchedClasses[iClass];
+   if ( pClass->iHead < 0 )
+      return;
+   int iIndex = pClass->iHead;
+   pClass->iHead = s_TelemSchedMessages[iIndex].iNext;
+   if ( pClass->iHead < 0 )
+      pClass->iTail = -1;
+   pClass->iCount--;
+   pClass->iBytes -= s_TelemSchedMessages[iIndex].iLength;
+   s_iTelemSchedFreeMessages[s_iTelemSchedFreeMessagesCount++] = iIndex;
+}
+
+static void _telemetry_scheduler_queue_message(const u8* pMessage, int iLength, u32 uMessageId, u32 uTimeNowMicros)
+{
+   int iClass = telemetry_scheduler_get_message_class(uMessageId);
+   t_telemetry_scheduler_class* pClass = &s_TelemSchedClasses[iClass];
+   shared_mem_telemetry_scheduler_class_stats* pStats = &s_TelemSchedStats.classes[iClass];
+   pStats->uMessagesIn++;
+   pStats->uBytesIn += iLength;
+
+   // MAVLink 1: sysid, compid at 3,4; MAVLink 2: at 5,6
+   u8 uSysId = (MAVLINK_STX_MAVLINK1 == pMessage[0])?pMessage[3]:pMessage[5];
+   u8 uCompId = (MAVLINK_STX_MAVLINK1 == pMessage[0])?pMessage[4]:pMessage[6];
+   int iCoalesce = _telemetry_scheduler_can_coalesce(iClass, uMessageId);
+
+   if ( iCoalesce )
+   for( int iIndex = pClass->iHead; iIndex >= 0; iIndex = s_TelemSchedMessages[iIndex].iNext )
+   {
+      t_telemetry_scheduler_message* pMsg = &s_TelemSchedMessages[iIndex];
+      if ( (pMsg->uMessageId != uMessageId) || (pMsg->uSysId != uSysId) || (pMsg->uCompId != uCompId) )
+         continue;
+      pClass->iBytes += iLength - pMsg->iLength;
+      memcpy(pMsg->uData, pMessage, iLength);
+      pMsg->iLength = iLength;
+      pMsg->uTimeUpdatedMicros = uTimeNowMicros;
+      pStats->uMessagesCoalesced++;
+      return;
+   }
+
+   // No room: drop the oldest message of the lowest priority class, if not higher than this one
+   if ( 0 == s_iTelemSchedFreeMessagesCount )
+   {
+      int iDropClass = -1;
+      for( int i=TELEMETRY_CLASSES-1; i>=iClass; i-- )
+      {
+         if ( s_TelemSchedClasses[i].iCount > 0 )
+         {
+            iDropClass = i;
+            break;
+         }
+      }
+      if ( iDropClass < 0 )
+      {
+         pStats->uMessagesDropped++;
+         return;
+      }
+      _telemetry_scheduler_remove_head(iDropClass);
+      s_TelemSchedStats.classes[iDropClass].uMessagesDropped++;
+   }
+
+   int iIndex = s_iTelemSchedFreeMessages[--s_iTelemSchedFreeMessagesCount];
+   t_telemetry_scheduler_message* pMsg = &s_TelemSchedMessages[iIndex];
+   memcpy(pMsg->uData, pMessage, iLength);
+   pMsg->iLength = iLength;
+   pMsg->uMessageId = uMessageId;
+   pMsg->uSysId = uSysId;
+   pMsg->uCompId = uCompId;
+   pMsg->iCoalesce = iCoalesce;
+   pMsg->uTimeQueuedMicros = uTimeNowMicros;
+   pMsg->uTimeUpdatedMicros = uTimeNowMicros;
+   pMsg->iNext = -1;
+   if ( pClass->iTail >= 0 )
+      s_TelemSchedMessages[pClass->iTail].iNext = iIndex;
+   else
+      pClass->iHead = iIndex;
+   pClass->iTail = iIndex;
+   pClass->iCount++;
+   pClass->iBytes += iLength;
+}
+
+// All messages go to the queues, none are decoded
+static void _telemetry_scheduler_on_message(const t_mavlink_bulk_message* pMessage, void* pContext)
+{
+   _telemetry_scheduler_queue_message(pMessage->pData, pMessage->iLength, pMessage->uMessageId, *((u32*)pContext));
+}
+
+void telemetry_scheduler_add_serial_data(u8* pData, int iDataLength, u32 uTimeNowMicros)
+{
+   s_uTelemSchedParseTimeMicros = uTimeNowMicros;
+   mavlink_bulk_parse(&s_TelemSchedParser, pData, iDataLength);
+   s_TelemSchedStats.uBytesDiscarded = s_TelemSchedParser.uBytesDiscarded;
+}
+
+static void _telemetry_scheduler_refill_tokens(u32 uTimeNowMicros)
+{
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      t_telemetry_scheduler_class* pClass = &s_TelemSchedClasses[i];
+      if ( 0 == pClass->iRateLimit )
+         continue;
+      u32 uDeltaMicros = uTimeNowMicros - pClass->uTimeLastRefillMicros;
+      int iNewTokens = (int)(((u64)uDeltaMicros * (u64)pClass->iRateLimit) / 1000000);
+      if ( iNewTokens <= 0 )
+         continue;
+      // Keep the fractional part for the next refill
+      pClass->uTimeLastRefillMicros += (u32)(((u64)iNewTokens * 1000000) / pClass->iRateLimit);
+      pClass->iTokens += iNewTokens;
+      int iBurst = pClass->iRateLimit/4;
+      if ( iBurst < s_iTelemSchedMaxSegmentLength )
+         iBurst = s_iTelemSchedMaxSegmentLength;
+      if ( pClass->iTokens > iBurst )
+         pClass->iTokens = iBurst;
+   }
+}
+
+static int _telemetry_scheduler_class_can_send(int iClass)
+{
+   t_telemetry_scheduler_class* pClass = &s_TelemSchedClasses[iClass];
+   if ( pClass->iHead < 0 )
+      return 0;
+   return (0 == pClass->iRateLimit) || (pClass->iTokens > 0);
+}
+
+int telemetry_scheduler_get_segment(u8* pSegment, u32 uTimeNowMicros)
+{
+   _telemetry_scheduler_refill_tokens(uTimeNowMicros);
+
+   bool bDue = false;
+   int iReadyBytes = 0;
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      if ( ! _telemetry_scheduler_class_can_send(i) )
+         continue;
+      t_telemetry_scheduler_class* pClass = &s_TelemSchedClasses[i];
+      iReadyBytes += pClass->iBytes;
+      if ( uTimeNowMicros - s_TelemSchedMessages[pClass->iHead].uTimeQueuedMicros >= pClass->uMaxDelayMicros )
+         bDue = true;
+   }
+   if ( (! bDue) && (iReadyBytes < RAW_TELEMETRY_MIN_SEND_LENGTH) )
+      return 0;
+
+   // Whole messages only, highest priority first, in queue order within each class
+   int iLength = 0;
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      t_telemetry_scheduler_class* pClass = &s_TelemSchedClasses[i];
+      shared_mem_telemetry_scheduler_class_stats* pStats = &s_TelemSchedStats.classes[i];
+      while ( _telemetry_scheduler_class_can_send(i) )
+      {
+         t_telemetry_scheduler_message* pMsg = &s_TelemSchedMessages[pClass->iHead];
+         if ( iLength + pMsg->iLength > s_iTelemSchedMaxSegmentLength )
+            break;
+         memcpy(pSegment + iLength, pMsg->uData, pMsg->iLength);
+         iLength += pMsg->iLength;
+         if ( 0 != pClass->iRateLimit )
+            pClass->iTokens -= pMsg->iLength;
+
+         u32 uLatencyMicros = uTimeNowMicros - pMsg->uTimeUpdatedMicros;
+         pClass->uTmpLatencySumMicros += uLatencyMicros;
+         pClass->uTmpLatencyCount++;
+         if ( uLatencyMicros > pClass->uTmpLatencyMaxMicros )
+            pClass->uTmpLatencyMaxMicros = uLatencyMicros;
+         if ( uLatencyMicros > pStats->uLatencyMaxMicros )
+            pStats->uLatencyMaxMicros = uLatencyMicros;
+         pStats->uMessagesSent++;
+         pStats->uBytesSent += pMsg->iLength;
+         _telemetry_scheduler_remove_head(i);
+      }
+   }
+   if ( iLength > 0 )
+      s_TelemSchedStats.uSegmentsSent++;
+   return iLength;
+}
+
+int telemetry_scheduler_get_max_segment_length()
+{
+   return s_iTelemSchedMaxSegmentLength;
+}
+
+shared_mem_telemetry_scheduler_stats* telemetry_scheduler_update_stats(u32 uTimeNowMs)
+{
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      t_telemetry_scheduler_class* pClass = &s_TelemSchedClasses[i];
+      shared_mem_telemetry_scheduler_class_stats* pStats = &s_TelemSchedStats.classes[i];
+      pStats->uLatencyAvgMicrosLastInterval = 0;
+      if ( pClass->uTmpLatencyCount > 0 )
+         pStats->uLatencyAvgMicrosLastInterval = pClass->uTmpLatencySumMicros / pClass->uTmpLatencyCount;
+      pStats->uLatencyMaxMicrosLastInterval = pClass->uTmpLatencyMaxMicros;
+      pStats->uQueuedMessages = pClass->iCount;
+      pClass->uTmpLatencySumMicros = 0;
+      pClass->uTmpLatencyCount = 0;
+      pClass->uTmpLatencyMaxMicros = 0;
+   }
+   s_TelemSchedStats.uTimeLastUpdate = uTimeNowMs;
+   return &s_TelemSchedStats;
+}
+
+shared_mem_telemetry_scheduler_stats* telemetry_scheduler_get_stats()
+{
+   return &s_TelemSchedStats;
+}
+
+void telemetry_scheduler_log_info()
+{
+   const char* szClasses[TELEMETRY_CLASSES] = { "critical", "flight", "normal", "bulk" };
+   log_line("[TelemScheduler] Sent %u segments, discarded %u bytes (not MAVLink)", s_TelemSchedStats.uSegmentsSent, s_TelemSchedStats.uBytesDiscarded);
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      shared_mem_telemetry_scheduler_class_stats* pStats = &s_TelemSchedStats.classes[i];
+      log_line("[TelemScheduler] %s: in %u msg (%u bytes), sent %u msg (%u bytes), coalesced %u, dropped %u, queued %u, latency avg/max: %u/%u us (max total: %u us), rate limit: %d bytes/sec",
+         szClasses[i], pStats->uMessagesIn, pStats->uBytesIn, pStats->uMessagesSent, pStats->uBytesSent,
+         pStats->uMessagesCoalesced, pStats->uMessagesDropped, pStats->uQueuedMessages,
+         pStats->uLatencyAvgMicrosLastInterval, pStats->uLatencyMaxMicrosLastInterval, pStats->uLatencyMaxMicros,
+         pStats->iRateLimitBytesPerSecond);
+   }
+}
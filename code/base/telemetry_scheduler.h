@@ -0,0 +1,42 @@
+#pragma once
+#include "base.h"
+#include "config.h"
+#include "shared_mem.h"
+
+// MAVLink aware scheduler for the raw FC telemetry sent to the controller.
+// The serial data read from the FC is split into whole MAVLink messages (v1 and v2, CRC checked for
+// the known messages). Each message goes to the queue of its priority class, by message id:
+//  - critical: heartbeat, system status, status texts, commands and their acks; sent right away;
+//  - flight: attitude, position, GPS, VFR HUD, RC channels, battery, radio status;
+//  - normal: everything else;
+//  - bulk: parameters, logs, missions, file transfers, raw sensors and IMU streams.
+// Single instance stream messages (attitude, position, GPS, VFR HUD, ...) are coalesced: a newer
+// value of the same message from the same source replaces the queued one, keeping its place in the
+// queue. All other messages (multi instance ones like battery status or named values, events, status
+// texts, acks, params, logs, missions, files, unknown messages) are never coalesced.
+// Each class has a rate limit (token bucket, bytes/second) and a max time in the queue. Segments
+// for the controller hold only whole messages, higher priority classes first, so a lost radio
+// packet only loses the messages in it.
+
+#define TELEMETRY_SCHEDULER_MAX_QUEUED_MESSAGES 128
+#define TELEMETRY_SCHEDULER_MAX_DELAY_MS_CRITICAL 0
+#define TELEMETRY_SCHEDULER_MAX_DELAY_MS_FLIGHT 20
+#define TELEMETRY_SCHEDULER_MAX_DELAY_MS_NORMAL 100
+#define TELEMETRY_SCHEDULER_MAX_DELAY_MS_BULK RAW_TELEMETRY_SEND_TIMEOUT
+
+// iMaxSegmentLength is raised to the max MAVLink message length if needed
+void telemetry_scheduler_init(int iMaxSegmentLength);
+// 0 for no limit
+void telemetry_scheduler_set_rate_limit(int iClass, int iBytesPerSecond);
+int telemetry_scheduler_get_message_class(u32 uMessageId);
+
+void telemetry_scheduler_add_serial_data(u8* pData, int iDataLength, u32 uTimeNowMicros);
+// Builds the next segment to send to the controller, if one is due now.
+// Returns the segment length, 0 if nothing has to be sent now
+int telemetry_scheduler_get_segment(u8* pSegment, u32 uTimeNowMicros);
+int telemetry_scheduler_get_max_segment_length();
+
+// Computes the last interval latencies; call it once a second
+shared_mem_telemetry_scheduler_stats* telemetry_scheduler_update_stats(u32 uTimeNowMs);
+shared_mem_telemetry_scheduler_stats* telemetry_scheduler_get_stats();
+void telemetry_scheduler_log_info();
@@ -968,6 +968,10 @@ bool radio_utils_set_interface_frequency(Model* pModel, int iRadioIndex, int iAs
             continue;
          }
       }
+      else if ( pRadioInfo->iRadioDriver == RADIO_HW_DRIVER_EMULATED )
+      {
+         // Nothing to configure: the emulated radio medium uses the frequency as the channel
+      }
       else if ( hardware_radio_is_wifi_radio(pRadioInfo) )
       {
          bool bTryHT40 = false;
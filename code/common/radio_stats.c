@@ -38,6 +38,7 @@
 #include "../radio/radiopackets_short.h"
 #include "../radio/radio_duplicate_det.h"
 #include "radio_stats.h"
+#include "radio_stats_window.h"
 
 static u32 s_uControllerLinkStats_tmpRecv[MAX_RADIO_INTERFACES];
 static u32 s_uControllerLinkStats_tmpRecvBad[MAX_RADIO_INTERFACES];
@@ -46,6 +47,31 @@ static u32 s_uControllerLinkStats_tmpRecvLost[MAX_RADIO_INTERFACES];
 static u32 s_uLastTimeDebugPacketRecvOnNoLink = 0;
 static int s_iRadioStatsEnableHistoryMonitor = 0;
 
+// Rx window of each radio interface; only its summary goes to the shared mem radio stats
+static t_radio_stats_window s_RadioStatsWindows[MAX_RADIO_INTERFACES];
+
+// The rx quality is computed over the last 2 seconds of graph slices
+static int _radio_stats_get_window_slices(int iGraphRefreshIntervalMs)
+{
+   int iSlices = 3;
+   if ( iGraphRefreshIntervalMs > 0 )
+      iSlices = 2000 / iGraphRefreshIntervalMs;
+   if ( iSlices < 3 )
+      iSlices = 3;
+   if ( iSlices >= MAX_HISTORY_RADIO_STATS_RECV_SLICES )
+      iSlices = MAX_HISTORY_RADIO_STATS_RECV_SLICES - 1;
+   return iSlices;
+}
+
+static void _radio_stats_reset_windows(shared_mem_radio_stats* pSMRS)
+{
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      radio_stats_window_reset(&s_RadioStatsWindows[i], _radio_stats_get_window_slices(pSMRS->graphRefreshIntervalMs));
+      memcpy(&pSMRS->radio_interfaces_local[i].windowSummary, &s_RadioStatsWindows[i].summary, sizeof(shared_mem_radio_stats_window_summary));
+   }
+}
+
 
 void shared_mem_radio_stats_rx_hist_reset(shared_mem_radio_stats_rx_hist* pStats)
 {
@@ -221,6 +247,8 @@ void radio_stats_reset(shared_mem_radio_stats* pSMRS, int graphRefreshInterval)
 
       pSMRS->radio_interfaces[i].rxQuality = 0;
       pSMRS->radio_interfaces[i].rxRelativeQuality = 0;
+      pSMRS->radio_interfaces_local[i].iDiversityScore = -1;
+      pSMRS->radio_interfaces_local[i].uDiversityRescuedPackets = 0;
 
       pSMRS->radio_interfaces[i].uSlicesUpdated = 0;
       for( int k=0; k<MAX_HISTORY_RADIO_STATS_RECV_SLICES; k++ )
@@ -337,6 +365,8 @@ void radio_stats_reset_received_info(shared_mem_radio_stats* pSMRS)
 
       pSMRS->radio_interfaces[i].rxQuality = 0;
       pSMRS->radio_interfaces[i].rxRelativeQuality = 0;
+      pSMRS->radio_interfaces_local[i].iDiversityScore = -1;
+      pSMRS->radio_interfaces_local[i].uDiversityRescuedPackets = 0;
 
       pSMRS->radio_interfaces[i].uSlicesUpdated = 0;
       for( int k=0; k<MAX_HISTORY_RADIO_STATS_RECV_SLICES; k++ )
@@ -382,6 +412,7 @@ void radio_stats_reset_received_info(shared_mem_radio_stats* pSMRS)
       pSMRS->radio_links[i].tmp_downlink_tx_time_per_sec = 0;
    }
 
+   _radio_stats_reset_windows(pSMRS);
    radio_duplicate_detection_remove_data_for_all_except(0);
 }
 
@@ -463,6 +494,7 @@ void radio_stats_reset_interfaces_rx_info(shared_mem_radio_stats* pSMRS)
       pSMRS->radio_interfaces[i].hist_tmp_rxPacketsBadCount = 0;
       pSMRS->radio_interfaces[i].hist_tmp_rxPacketsLostCount = 0;
    }
+   _radio_stats_reset_windows(pSMRS);
 }
 
 void radio_stats_set_graph_refresh_interval(shared_mem_radio_stats* pSMRS, int graphRefreshInterval)
@@ -470,6 +502,7 @@ void radio_stats_set_graph_refresh_interval(shared_mem_radio_stats* pSMRS, int g
    if ( NULL == pSMRS )
       return;
    pSMRS->graphRefreshIntervalMs = graphRefreshInterval;
+   _radio_stats_reset_windows(pSMRS);
    log_line("[RadioStats] Set radio stats graph refresh interval: %d ms", pSMRS->graphRefreshIntervalMs);
 }
 
@@ -591,6 +624,14 @@ void radio_stats_log_info(shared_mem_radio_stats* pSMRS, u32 uTimeNow)
    }
    log_line(szBuff);
 
+   strcpy(szBuff, "Radio Interf diversity score (rescued packets): ");
+   for( int i=0; i<pSMRS->countLocalRadioInterfaces; i++ )
+   {
+      sprintf(szBuff2, "%d (%u), ", pSMRS->radio_interfaces_local[i].iDiversityScore, pSMRS->radio_interfaces_local[i].uDiversityRescuedPackets);
+      strcat(szBuff, szBuff2);
+   }
+   log_line(szBuff);
+
    
    log_line( "Radio streams throughput (global):");
    for( int k=0; k<MAX_CONCURENT_VEHICLES; k++ )
@@ -724,31 +765,12 @@ int radio_stats_periodic_update(shared_mem_radio_stats* pSMRS, shared_mem_radio_
          _radio_stats_update_kbps_values(pSMRS, uDeltaTime);
       }
   
-      // Update RX quality for each radio interface
-
-      int iIntervalsToUse = 2000 / pSMRS->graphRefreshIntervalMs;
-      if ( iIntervalsToUse < 3 )
-         iIntervalsToUse = 3;
-      if ( iIntervalsToUse >= sizeof(pSMRS->radio_interfaces[0].hist_rxPacketsCount)/sizeof(pSMRS->radio_interfaces[0].hist_rxPacketsCount[0]) )
-         iIntervalsToUse = sizeof(pSMRS->radio_interfaces[0].hist_rxPacketsCount)/sizeof(pSMRS->radio_interfaces[0].hist_rxPacketsCount[0]) - 1;
+      // Update RX quality for each radio interface, from the last rx window
 
       pSMRS->iMaxRxQuality = 0;
       for( int i=0; i<pSMRS->countLocalRadioInterfaces; i++ )
       {
-         u32 totalRecv = 0;
-         u32 totalRecvBad = 0;
-         u32 totalRecvLost = 0;
-         for( int k=0; k<iIntervalsToUse; k++ )
-         {
-            totalRecv += pSMRS->radio_interfaces[i].hist_rxPacketsCount[k];
-            totalRecvBad += pSMRS->radio_interfaces[i].hist_rxPacketsBadCount[k];
-            totalRecvLost += pSMRS->radio_interfaces[i].hist_rxPacketsLostCount[k];
-         }
-         if ( 0 == totalRecv )
-            pSMRS->radio_interfaces[i].rxQuality = 0;
-         else
-            pSMRS->radio_interfaces[i].rxQuality = 100 - (100*(totalRecvLost+totalRecvBad))/(totalRecv+totalRecvLost);
-      
+         pSMRS->radio_interfaces[i].rxQuality = s_RadioStatsWindows[i].summary.iQuality;
          if ( pSMRS->radio_interfaces[i].rxQuality > pSMRS->iMaxRxQuality )
             pSMRS->iMaxRxQuality = pSMRS->radio_interfaces[i].rxQuality;
       }
@@ -780,19 +802,10 @@ int radio_stats_periodic_update(shared_mem_radio_stats* pSMRS, shared_mem_radio_
 
       for( int i=0; i<pSMRS->countLocalRadioInterfaces; i++ )
       {
-         u32 totalRecv = 0;
-         u32 totalRecvBad = 0;
-         u32 totalRecvLost = 0;
-         for( int i=0; i<iIntervalsToUse; i++ )
-         {
-            totalRecv += pSMRS->radio_interfaces[i].hist_rxPacketsCount[i];
-            totalRecvBad += pSMRS->radio_interfaces[i].hist_rxPacketsBadCount[i];
-            totalRecvLost += pSMRS->radio_interfaces[i].hist_rxPacketsLostCount[i];
-         }
-
-         totalRecv += pSMRS->radio_interfaces[i].hist_tmp_rxPacketsCount;
-         totalRecvBad += pSMRS->radio_interfaces[i].hist_tmp_rxPacketsBadCount;
-         totalRecvLost += pSMRS->radio_interfaces[i].hist_tmp_rxPacketsLostCount;
+         t_radio_stats_window_slice* pCurrentSlice = radio_stats_window_get_current_slice(&s_RadioStatsWindows[i]);
+         u32 totalRecv = s_RadioStatsWindows[i].summary.uPackets + pCurrentSlice->uPackets;
+         u32 totalRecvBad = s_RadioStatsWindows[i].summary.uPacketsBad + pCurrentSlice->uPacketsBad;
+         u32 totalRecvLost = s_RadioStatsWindows[i].summary.uPacketsLost + pCurrentSlice->uPacketsLost;
 
          pSMRS->radio_interfaces[i].rxRelativeQuality = pSMRS->radio_interfaces[i].rxQuality;
          if ( pSMRS->radio_interfaces[i].signalInfo.iDbmBest < 500 )
@@ -819,14 +832,15 @@ int radio_stats_periodic_update(shared_mem_radio_stats* pSMRS, shared_mem_radio_
 
       for( int i=0; i<pSMRS->countLocalRadioInterfaces; i++ )
       {
+         radio_stats_window_complete_slice(&s_RadioStatsWindows[i]);
+         memcpy(&pSMRS->radio_interfaces_local[i].windowSummary, &s_RadioStatsWindows[i].summary, sizeof(shared_mem_radio_stats_window_summary));
+
+         // The history arrays are sent as is to the controller (newest slice first), keep their layout
          pSMRS->radio_interfaces[i].uSlicesUpdated++;
-         for( int k=MAX_HISTORY_RADIO_STATS_RECV_SLICES-1; k>0; k-- )
-         {
-            pSMRS->radio_interfaces[i].hist_rxPacketsCount[k] = pSMRS->radio_interfaces[i].hist_rxPacketsCount[k-1];
-            pSMRS->radio_interfaces[i].hist_rxPacketsBadCount[k] = pSMRS->radio_interfaces[i].hist_rxPacketsBadCount[k-1];
-            pSMRS->radio_interfaces[i].hist_rxPacketsLostCount[k] = pSMRS->radio_interfaces[i].hist_rxPacketsLostCount[k-1];
-            pSMRS->radio_interfaces[i].hist_rxGapMiliseconds[k] = pSMRS->radio_interfaces[i].hist_rxGapMiliseconds[k-1];
-         }
+         memmove(&pSMRS->radio_interfaces[i].hist_rxPacketsCount[1], &pSMRS->radio_interfaces[i].hist_rxPacketsCount[0], MAX_HISTORY_RADIO_STATS_RECV_SLICES-1);
+         memmove(&pSMRS->radio_interfaces[i].hist_rxPacketsBadCount[1], &pSMRS->radio_interfaces[i].hist_rxPacketsBadCount[0], MAX_HISTORY_RADIO_STATS_RECV_SLICES-1);
+         memmove(&pSMRS->radio_interfaces[i].hist_rxPacketsLostCount[1], &pSMRS->radio_interfaces[i].hist_rxPacketsLostCount[0], MAX_HISTORY_RADIO_STATS_RECV_SLICES-1);
+         memmove(&pSMRS->radio_interfaces[i].hist_rxGapMiliseconds[1], &pSMRS->radio_interfaces[i].hist_rxGapMiliseconds[0], MAX_HISTORY_RADIO_STATS_RECV_SLICES-1);
 
          if ( pSMRS->radio_interfaces[i].hist_tmp_rxPacketsCount < 255 )
             pSMRS->radio_interfaces[i].hist_rxPacketsCount[0] = pSMRS->radio_interfaces[i].hist_tmp_rxPacketsCount;
@@ -961,6 +975,7 @@ void radio_stats_set_bad_data_on_current_rx_interval(shared_mem_radio_stats* pSM
       pSMRS->radio_interfaces[iRadioInterface].hist_tmp_rxPacketsLostCount = 1;
    if ( 0 == s_uControllerLinkStats_tmpRecvLost[iRadioInterface] )
       s_uControllerLinkStats_tmpRecvLost[iRadioInterface] = 1;
+   radio_stats_window_set_bad_data(&s_RadioStatsWindows[iRadioInterface]);
 
    if ( NULL != pSMRXStats )
    {
@@ -1070,6 +1085,18 @@ int radio_stats_update_on_new_radio_packet_received(shared_mem_radio_stats* pSMR
    u32 uTimeGap = timeNow - pSMRS->radio_interfaces[iInterfaceIndex].timeLastRxPacket;
    if ( 0 == pSMRS->radio_interfaces[iInterfaceIndex].timeLastRxPacket )
       uTimeGap = 0;
+
+   int iDbmBest = 1000;
+   for( int i=0; (i<pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo.nAntennaCount) && (i<MAX_RADIO_ANTENNAS); i++ )
+   {
+      int iDbm = pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo.nDbmLast[i];
+      if ( (iDbm < 500) && ((iDbmBest > 500) || (iDbm > iDbmBest)) )
+         iDbmBest = iDbm;
+   }
+   radio_stats_window_add_packet(&s_RadioStatsWindows[iInterfaceIndex], iDbmBest,
+      (0 == pSMRS->radio_interfaces[iInterfaceIndex].timeLastRxPacket)?MAX_U32:uTimeGap,
+      ((0 == iDataIsOk) || (iPacketLength <= 0))?1:0);
+
    if ( uTimeGap > 254 )
       uTimeGap = 254;
    if ( pSMRS->radio_interfaces[iInterfaceIndex].hist_rxGapMiliseconds[0] == 0xFF )
@@ -1122,6 +1149,7 @@ int radio_stats_update_on_new_radio_packet_received(shared_mem_radio_stats* pSMR
                uLost = pPHS->packet_id + 255 - uNext;
             pSMRS->radio_interfaces[iInterfaceIndex].hist_tmp_rxPacketsLostCount += uLost;
             pSMRS->radio_interfaces[iInterfaceIndex].totalRxPacketsLost += uLost;
+            radio_stats_window_add_lost(&s_RadioStatsWindows[iInterfaceIndex], uLost);
             if ( NULL != pSMRXStats )
                pSMRXStats->interfaces[iInterfaceIndex].tmp_rxPacketsLost += uLost;
             s_uControllerLinkStats_tmpRecvLost[iInterfaceIndex] += uLost;
@@ -1144,6 +1172,7 @@ int radio_stats_update_on_new_radio_packet_received(shared_mem_radio_stats* pSMR
                u32 uLost = pPH->radio_link_packet_index - pSMRS->radio_interfaces[iInterfaceIndex].lastReceivedRadioLinkPacketIndex - 1;
                pSMRS->radio_interfaces[iInterfaceIndex].hist_tmp_rxPacketsLostCount += uLost;
                pSMRS->radio_interfaces[iInterfaceIndex].totalRxPacketsLost += uLost;
+               radio_stats_window_add_lost(&s_RadioStatsWindows[iInterfaceIndex], uLost);
                if ( NULL != pSMRXStats )
                   pSMRXStats->interfaces[iInterfaceIndex].tmp_rxPacketsLost += uLost;
                s_uControllerLinkStats_tmpRecvLost[iInterfaceIndex] += uLost;
@@ -0,0 +1,326 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "radio_stats_window.h"
+
+#define RADIO_STATS_WINDOW_RING_SIZE (RADIO_STATS_WINDOW_MAX_SLICES+1)
+
+static int _radio_stats_window_get_dbm_bucket(int iDbm)
+{
+   int iBucket = (iDbm - RADIO_STATS_WINDOW_DBM_MIN) / RADIO_STATS_WINDOW_DBM_BUCKET_SIZE;
+   if ( iDbm < RADIO_STATS_WINDOW_DBM_MIN )
+      iBucket = 0;
+   if ( iBucket >= RADIO_STATS_WINDOW_DBM_BUCKETS )
+      iBucket = RADIO_STATS_WINDOW_DBM_BUCKETS-1;
+   return iBucket;
+}
+
+static int _radio_stats_window_get_gap_bucket(u32 uGapMs)
+{
+   if ( 0 == uGapMs )
+      return 0;
+   int iBucket = 32 - __builtin_clz(uGapMs);
+   if ( iBucket >= RADIO_STATS_WINDOW_GAP_BUCKETS )
+      iBucket = RADIO_STATS_WINDOW_GAP_BUCKETS-1;
+   return iBucket;
+}
+
+static void _radio_stats_window_reset_slice(t_radio_stats_window_slice* pSlice)
+{
+   memset(pSlice, 0, sizeof(t_radio_stats_window_slice));
+   pSlice->iDbmMin = 1000;
+   pSlice->iDbmMax = 1000;
+}
+
+static void _radio_stats_window_extremes_expire(t_radio_stats_window_extremes* pExtremes, u32 uFirstSlice)
+{
+   while ( (pExtremes->iCount > 0) && (pExtremes->uSlice[pExtremes->iFront] < uFirstSlice) )
+   {
+      pExtremes->iFront = (pExtremes->iFront + 1) % RADIO_STATS_WINDOW_MAX_SLICES;
+      pExtremes->iCount--;
+   }
+}
+
+// Drops the values the new one makes useless: the window min (max) can't be one of them anymore
+static void _radio_stats_window_extremes_push(t_radio_stats_window_extremes* pExtremes, u32 uSlice, int iValue, int bLowest)
+{
+   while ( pExtremes->iCount > 0 )
+   {
+      int iBack = (pExtremes->iFront + pExtremes->iCount - 1) % RADIO_STATS_WINDOW_MAX_SLICES;
+      if ( bLowest && (pExtremes->iValue[iBack] < iValue) )
+         break;
+      if ( (!bLowest) && (pExtremes->iValue[iBack] > iValue) )
+         break;
+      pExtremes->iCount--;
+   }
+   if ( pExtremes->iCount >= RADIO_STATS_WINDOW_MAX_SLICES )
+   {
+      pExtremes->iFront = (pExtremes->iFront + 1) % RADIO_STATS_WINDOW_MAX_SLICES;
+      pExtremes->iCount--;
+   }
+   int iPos = (pExtremes->iFront + pExtremes->iCount) % RADIO_STATS_WINDOW_MAX_SLICES;
+   pExtremes->uSlice[iPos] = uSlice;
+   pExtremes->iValue[iPos] = iValue;
+   pExtremes->iCount++;
+}
+
+static void _radio_stats_window_add_to_totals(t_radio_stats_window_totals* pTotals, t_radio_stats_window_slice* pSlice)
+{
+   pTotals->uPackets += pSlice->uPackets;
+   pTotals->uPacketsBad += pSlice->uPacketsBad;
+   pTotals->uPacketsLost += pSlice->uPacketsLost;
+   pTotals->uDbmCount += pSlice->uDbmCount;
+   pTotals->iDbmSum += pSlice->iDbmSum;
+   pTotals->uGapCount += pSlice->uGapCount;
+   pTotals->uGapSumMs += pSlice->uGapSumMs;
+   if ( pSlice->uDbmCount > 0 )
+   for( int i=0; i<RADIO_STATS_WINDOW_DBM_BUCKETS; i++ )
+      pTotals->uDbmBuckets[i] += pSlice->uDbmBuckets[i];
+   if ( pSlice->uGapCount > 0 )
+   for( int i=0; i<RADIO_STATS_WINDOW_GAP_BUCKETS; i++ )
+      pTotals->uGapBuckets[i] += pSlice->uGapBuckets[i];
+}
+
+static void _radio_stats_window_remove_from_totals(t_radio_stats_window_totals* pTotals, t_radio_stats_window_slice* pSlice)
+{
+   pTotals->uPackets -= pSlice->uPackets;
+   pTotals->uPacketsBad -= pSlice->uPacketsBad;
+   pTotals->uPacketsLost -= pSlice->uPacketsLost;
+   pTotals->uDbmCount -= pSlice->uDbmCount;
+   pTotals->iDbmSum -= pSlice->iDbmSum;
+   pTotals->uGapCount -= pSlice->uGapCount;
+   pTotals->uGapSumMs -= pSlice->uGapSumMs;
+   if ( pSlice->uDbmCount > 0 )
+   for( int i=0; i<RADIO_STATS_WINDOW_DBM_BUCKETS; i++ )
+      pTotals->uDbmBuckets[i] -= pSlice->uDbmBuckets[i];
+   if ( pSlice->uGapCount > 0 )
+   for( int i=0; i<RADIO_STATS_WINDOW_GAP_BUCKETS; i++ )
+      pTotals->uGapBuckets[i] -= pSlice->uGapBuckets[i];
+}
+
+// Finds, in one pass, the histogram buckets holding the given percentiles (0...100, in increasing order).
+// All the values are in the [iFirstBucket, iLastBucket] buckets (from the window min/max), only those are scanned.
+static void _radio_stats_window_get_percentile_buckets(u32* pBuckets, int iFirstBucket, int iLastBucket, u32 uTotal, const int* piPercentiles, int* piBuckets, int iCount)
+{
+   int iIndex = 0;
+   u32 uTarget = (uTotal * (u32)piPercentiles[0] + 99) / 100;
+   if ( uTarget < 1 )
+      uTarget = 1;
+   u32 uSum = 0;
+   for( int i=iFirstBucket; (i<=iLastBucket) && (iIndex < iCount); i++ )
+   {
+      uSum += pBuckets[i];
+      while ( (iIndex < iCount) && (uSum >= uTarget) )
+      {
+         piBuckets[iIndex] = i;
+         iIndex++;
+         if ( iIndex < iCount )
+         {
+            uTarget = (uTotal * (u32)piPercentiles[iIndex] + 99) / 100;
+            if ( uTarget < 1 )
+               uTarget = 1;
+         }
+      }
+   }
+   for( ; iIndex < iCount; iIndex++ )
+      piBuckets[iIndex] = iLastBucket;
+}
+
+static int _radio_stats_window_get_dbm_from_bucket(t_radio_stats_window* pWindow, int iBucket)
+{
+   int iDbm = RADIO_STATS_WINDOW_DBM_MIN + iBucket * RADIO_STATS_WINDOW_DBM_BUCKET_SIZE + RADIO_STATS_WINDOW_DBM_BUCKET_SIZE/2;
+   if ( iDbm < pWindow->summary.iDbmMin )
+      iDbm = pWindow->summary.iDbmMin;
+   if ( iDbm > pWindow->summary.iDbmMax )
+      iDbm = pWindow->summary.iDbmMax;
+   return iDbm;
+}
+
+static u32 _radio_stats_window_get_gap_from_bucket(t_radio_stats_window* pWindow, int iBucket)
+{
+   u32 uGapMs = (iBucket == 0)?0:(((u32)1)<<iBucket) - 1;
+   if ( uGapMs > pWindow->summary.uGapMaxMs )
+      uGapMs = pWindow->summary.uGapMaxMs;
+   return uGapMs;
+}
+
+static void _radio_stats_window_update_summary(t_radio_stats_window* pWindow)
+{
+   shared_mem_radio_stats_window_summary* pSummary = &pWindow->summary;
+   t_radio_stats_window_totals* pTotals = &pWindow->totals;
+
+   pSummary->uWindowSlices = pWindow->uCurrentSlice + 1;
+   if ( pSummary->uWindowSlices > (u32)pWindow->iSlices )
+      pSummary->uWindowSlices = (u32)pWindow->iSlices;
+   pSummary->uPackets = pTotals->uPackets;
+   pSummary->uPacketsBad = pTotals->uPacketsBad;
+   pSummary->uPacketsLost = pTotals->uPacketsLost;
+   pSummary->iQuality = 0;
+   if ( 0 != pTotals->uPackets )
+      pSummary->iQuality = 100 - (100*(pTotals->uPacketsLost + pTotals->uPacketsBad))/(pTotals->uPackets + pTotals->uPacketsLost);
+
+   pSummary->iDbmAvg = 1000;
+   pSummary->iDbmMin = 1000;
+   pSummary->iDbmMax = 1000;
+   pSummary->iDbmP10 = 1000;
+   pSummary->iDbmP50 = 1000;
+   if ( (pTotals->uDbmCount > 0) && (pWindow->dbmMin.iCount > 0) && (pWindow->dbmMax.iCount > 0) )
+   {
+      pSummary->iDbmAvg = pTotals->iDbmSum / (int)pTotals->uDbmCount;
+      pSummary->iDbmMin = pWindow->dbmMin.iValue[pWindow->dbmMin.iFront];
+      pSummary->iDbmMax = pWindow->dbmMax.iValue[pWindow->dbmMax.iFront];
+      static const int s_iDbmPercentiles[2] = { 10, 50 };
+      int iBuckets[2];
+      _radio_stats_window_get_percentile_buckets(pTotals->uDbmBuckets,
+         _radio_stats_window_get_dbm_bucket(pSummary->iDbmMin), _radio_stats_window_get_dbm_bucket(pSummary->iDbmMax), pTotals->uDbmCount, s_iDbmPercentiles, iBuckets, 2);
+      pSummary->iDbmP10 = _radio_stats_window_get_dbm_from_bucket(pWindow, iBuckets[0]);
+      pSummary->iDbmP50 = _radio_stats_window_get_dbm_from_bucket(pWindow, iBuckets[1]);
+   }
+
+   pSummary->uGapAvgMs = 0;
+   pSummary->uGapMaxMs = 0;
+   pSummary->uGapP50Ms = 0;
+   pSummary->uGapP90Ms = 0;
+   pSummary->uGapP99Ms = 0;
+   if ( (pTotals->uGapCount > 0) && (pWindow->gapMax.iCount > 0) )
+   {
+      pSummary->uGapAvgMs = pTotals->uGapSumMs / pTotals->uGapCount;
+      pSummary->uGapMaxMs = (u32)pWindow->gapMax.iValue[pWindow->gapMax.iFront];
+      static const int s_iGapPercentiles[3] = { 50, 90, 99 };
+      int iBuckets[3];
+      _radio_stats_window_get_percentile_buckets(pTotals->uGapBuckets,
+         0, _radio_stats_window_get_gap_bucket(pSummary->uGapMaxMs), pTotals->uGapCount, s_iGapPercentiles, iBuckets, 3);
+      pSummary->uGapP50Ms = _radio_stats_window_get_gap_from_bucket(pWindow, iBuckets[0]);
+      pSummary->uGapP90Ms = _radio_stats_window_get_gap_from_bucket(pWindow, iBuckets[1]);
+      pSummary->uGapP99Ms = _radio_stats_window_get_gap_from_bucket(pWindow, iBuckets[2]);
+   }
+}
+
+void radio_stats_window_reset(t_radio_stats_window* pWindow, int iSlices)
+{
+   if ( NULL == pWindow )
+      return;
+   memset(pWindow, 0, sizeof(t_radio_stats_window));
+   if ( iSlices < 1 )
+      iSlices = 1;
+   if ( iSlices > RADIO_STATS_WINDOW_MAX_SLICES )
+      iSlices = RADIO_STATS_WINDOW_MAX_SLICES;
+   pWindow->iSlices = iSlices;
+   pWindow->uCurrentSlice = 0;
+   _radio_stats_window_reset_slice(&pWindow->slices[0]);
+   _radio_stats_window_update_summary(pWindow);
+   pWindow->summary.uWindowSlices = 0;
+}
+
+t_radio_stats_window_slice* radio_stats_window_get_current_slice(t_radio_stats_window* pWindow)
+{
+   return &pWindow->slices[pWindow->uCurrentSlice % RADIO_STATS_WINDOW_RING_SIZE];
+}
+
+void radio_stats_window_add_packet(t_radio_stats_window* pWindow, int iDbm, u32 uGapMs, int iIsBad)
+{
+   t_radio_stats_window_slice* pSlice = &pWindow->slices[pWindow->uCurrentSlice % RADIO_STATS_WINDOW_RING_SIZE];
+   pSlice->uPackets++;
+   if ( iIsBad )
+      pSlice->uPacketsBad++;
+
+   if ( iDbm < 500 )
+   {
+      pSlice->uDbmCount++;
+      pSlice->iDbmSum += iDbm;
+      if ( (pSlice->iDbmMin > 500) || (iDbm < pSlice->iDbmMin) )
+         pSlice->iDbmMin = iDbm;
+      if ( (pSlice->iDbmMax > 500) || (iDbm > pSlice->iDbmMax) )
+         pSlice->iDbmMax = iDbm;
+      u16* pBucket = &pSlice->uDbmBuckets[_radio_stats_window_get_dbm_bucket(iDbm)];
+      if ( *pBucket < 0xFFFF )
+         (*pBucket)++;
+   }
+
+   if ( uGapMs != MAX_U32 )
+   {
+      pSlice->uGapCount++;
+      pSlice->uGapSumMs += uGapMs;
+      if ( uGapMs > pSlice->uGapMaxMs )
+         pSlice->uGapMaxMs = uGapMs;
+      u16* pBucket = &pSlice->uGapBuckets[_radio_stats_window_get_gap_bucket(uGapMs)];
+      if ( *pBucket < 0xFFFF )
+         (*pBucket)++;
+   }
+}
+
+void radio_stats_window_add_lost(t_radio_stats_window* pWindow, u32 uLost)
+{
+   pWindow->slices[pWindow->uCurrentSlice % RADIO_STATS_WINDOW_RING_SIZE].uPacketsLost += uLost;
+}
+
+void radio_stats_window_set_bad_data(t_radio_stats_window* pWindow)
+{
+   t_radio_stats_window_slice* pSlice = &pWindow->slices[pWindow->uCurrentSlice % RADIO_STATS_WINDOW_RING_SIZE];
+   if ( 0 == pSlice->uPacketsBad )
+      pSlice->uPacketsBad = 1;
+   if ( 0 == pSlice->uPacketsLost )
+      pSlice->uPacketsLost = 1;
+}
+
+void radio_stats_window_complete_slice(t_radio_stats_window* pWindow)
+{
+   if ( NULL == pWindow )
+      return;
+
+   u32 uSlice = pWindow->uCurrentSlice;
+   t_radio_stats_window_slice* pSlice = &pWindow->slices[uSlice % RADIO_STATS_WINDOW_RING_SIZE];
+   _radio_stats_window_add_to_totals(&pWindow->totals, pSlice);
+
+   u32 uFirstSlice = 0;
+   if ( uSlice >= (u32)pWindow->iSlices )
+   {
+      // The oldest slice leaves the window
+      _radio_stats_window_remove_from_totals(&pWindow->totals, &pWindow->slices[(uSlice - (u32)pWindow->iSlices) % RADIO_STATS_WINDOW_RING_SIZE]);
+      uFirstSlice = uSlice - (u32)pWindow->iSlices + 1;
+   }
+
+   _radio_stats_window_extremes_expire(&pWindow->dbmMin, uFirstSlice);
+   _radio_stats_window_extremes_expire(&pWindow->dbmMax, uFirstSlice);
+   _radio_stats_window_extremes_expire(&pWindow->gapMax, uFirstSlice);
+   if ( pSlice->uDbmCount > 0 )
+   {
+      _radio_stats_window_extremes_push(&pWindow->dbmMin, uSlice, pSlice->iDbmMin, 1);
+      _radio_stats_window_extremes_push(&pWindow->dbmMax, uSlice, pSlice->iDbmMax, 0);
+   }
+   if ( pSlice->uGapCount > 0 )
+      _radio_stats_window_extremes_push(&pWindow->gapMax, uSlice, (int)pSlice->uGapMaxMs, 0);
+
+   _radio_stats_window_update_summary(pWindow);
+
+   pWindow->uCurrentSlice++;
+   _radio_stats_window_reset_slice(&pWindow->slices[pWindow->uCurrentSlice % RADIO_STATS_WINDOW_RING_SIZE]);
+}
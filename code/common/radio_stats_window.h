@@ -0,0 +1,90 @@
+#pragma once
+#include "../base/base.h"
+#include "../base/shared_mem.h"
+
+// Sliding window aggregation of the packets received on a radio interface.
+// The window is made of the last iSlices completed slices (one slice is one rx graph interval).
+// Each slice keeps counts, sums, min/max and small histograms (sketches) of the signal and of the
+// time between received packets; the window totals are kept up to date incrementally:
+//  - a received packet updates only the current slice: O(1);
+//  - completing a slice adds it to the totals and subtracts the slice that left the window, and the
+//    window min/max come from monotonic queues of the slices min/max: O(1) (amortized for min/max);
+//  - the summary (quality, signal avg/min/max/percentiles, gap avg/max/percentiles) is computed from
+//    the totals once per completed slice, consumers just read it.
+
+#define RADIO_STATS_WINDOW_MAX_SLICES MAX_HISTORY_RADIO_STATS_RECV_SLICES
+// Signal histogram: RADIO_STATS_WINDOW_DBM_BUCKETS buckets of RADIO_STATS_WINDOW_DBM_BUCKET_SIZE dB, starting at RADIO_STATS_WINDOW_DBM_MIN
+#define RADIO_STATS_WINDOW_DBM_MIN -112
+#define RADIO_STATS_WINDOW_DBM_BUCKET_SIZE 2
+#define RADIO_STATS_WINDOW_DBM_BUCKETS 48
+// Gap histogram: bucket 0: 0 ms; bucket k: [2^(k-1), 2^k) ms; the last bucket takes all above
+#define RADIO_STATS_WINDOW_GAP_BUCKETS 12
+
+typedef struct
+{
+   u32 uPackets;
+   u32 uPacketsBad;
+   u32 uPacketsLost;
+   u32 uDbmCount;
+   int iDbmSum;
+   int iDbmMin;
+   int iDbmMax;
+   u32 uGapCount;
+   u32 uGapSumMs;
+   u32 uGapMaxMs;
+   u16 uDbmBuckets[RADIO_STATS_WINDOW_DBM_BUCKETS];
+   u16 uGapBuckets[RADIO_STATS_WINDOW_GAP_BUCKETS];
+} t_radio_stats_window_slice;
+
+typedef struct
+{
+   u32 uPackets;
+   u32 uPacketsBad;
+   u32 uPacketsLost;
+   u32 uDbmCount;
+   int iDbmSum;
+   u32 uGapCount;
+   u32 uGapSumMs;
+   u32 uDbmBuckets[RADIO_STATS_WINDOW_DBM_BUCKETS];
+   u32 uGapBuckets[RADIO_STATS_WINDOW_GAP_BUCKETS];
+} t_radio_stats_window_totals;
+
+// Slices min (or max) values, in slice order, each one lower (higher) than the ones before it:
+// the front is the window min (max)
+typedef struct
+{
+   u32 uSlice[RADIO_STATS_WINDOW_MAX_SLICES];
+   int iValue[RADIO_STATS_WINDOW_MAX_SLICES];
+   int iFront;
+   int iCount;
+} t_radio_stats_window_extremes;
+
+typedef struct
+{
+   int iSlices;
+   u32 uCurrentSlice; // sequence number of the current slice
+   t_radio_stats_window_slice slices[RADIO_STATS_WINDOW_MAX_SLICES+1]; // the window slices and the current one
+   t_radio_stats_window_totals totals; // of the completed slices in the window
+   t_radio_stats_window_extremes dbmMin;
+   t_radio_stats_window_extremes dbmMax;
+   t_radio_stats_window_extremes gapMax;
+   shared_mem_radio_stats_window_summary summary;
+} t_radio_stats_window;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void radio_stats_window_reset(t_radio_stats_window* pWindow, int iSlices);
+// iDbm: best antenna signal, 1000 if unknown; uGapMs: time since the previous packet, MAX_U32 if unknown
+void radio_stats_window_add_packet(t_radio_stats_window* pWindow, int iDbm, u32 uGapMs, int iIsBad);
+void radio_stats_window_add_lost(t_radio_stats_window* pWindow, u32 uLost);
+// Marks the current slice as having bad and lost packets, if it has none
+void radio_stats_window_set_bad_data(t_radio_stats_window* pWindow);
+// Completes the current slice and updates the window summary
+void radio_stats_window_complete_slice(t_radio_stats_window* pWindow);
+t_radio_stats_window_slice* radio_stats_window_get_current_slice(t_radio_stats_window* pWindow);
+
+#ifdef __cplusplus
+}
+#endif
@@ -38,6 +38,34 @@
 #include <ctype.h>
 #include "string_utils.h"
 
+// Builds a [value] = "name" table entry, for tables indexed by the named constant
+#define STR_TABLE_ENTRY(x) [x] = #x
+
+// Writes the decimal value at szOutput, returns the end of the written string
+static char* _str_append_u32(char* szOutput, u32 uValue)
+{
+   char szDigits[12];
+   int iCount = 0;
+   do
+   {
+      szDigits[iCount++] = '0' + (uValue % 10);
+      uValue /= 10;
+   }
+   while ( uValue > 0 );
+   while ( iCount > 0 )
+      *szOutput++ = szDigits[--iCount];
+   *szOutput = 0;
+   return szOutput;
+}
+
+static char* _str_append(char* szOutput, const char* szText)
+{
+   while ( *szText )
+      *szOutput++ = *szText++;
+   *szOutput = 0;
+   return szOutput;
+}
+
 
 void str_sanitize_modelname(char* szName)
 {
@@ -240,104 +268,144 @@ char* str_get_pipe_flags(int iFlags)
    return s_szBufferPipeFlags;
 }
 
-char* str_get_packet_type(int iPacketType)
+// Packet types names, indexed by packet type (packet types are u8)
+static const char* s_szPacketTypesNames[256] =
+{
+   STR_TABLE_ENTRY(PACKET_TYPE_EMBEDED_SHORT_PACKET),
+   STR_TABLE_ENTRY(PACKET_TYPE_EMBEDED_FULL_PACKET),
+
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_PING_CLOCK),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_PING_CLOCK_REPLY),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_RADIO_REINITIALIZED),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_MODEL_SETTINGS),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_PAIRING_REQUEST),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_PAIRING_CONFIRMATION),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_RADIO_CONFIG_UPDATED),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_LOG_FILE_SEGMENT),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_ALARM),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_DATA_98),
+   STR_TABLE_ENTRY(PACKET_TYPE_AUDIO_SEGMENT),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_EC_RECOVERY_STATS),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE),
+   STR_TABLE_ENTRY(PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK),
+   STR_TABLE_ENTRY(PACKET_TYPE_COMMAND),
+   STR_TABLE_ENTRY(PACKET_TYPE_COMMAND_RESPONSE),
+   STR_TABLE_ENTRY(PACKET_TYPE_SIK_CONFIG),
+   STR_TABLE_ENTRY(PACKET_TYPE_DEBUG_INFO),
+   STR_TABLE_ENTRY(PACKET_TYPE_RC_FULL_FRAME),
+   STR_TABLE_ENTRY(PACKET_TYPE_RC_DOWNLOAD_INFO),
+   // Telemetry
+
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_SHORT),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_EXTENDED),
+   STR_TABLE_ENTRY(PACKET_TYPE_FC_TELEMETRY),
+   STR_TABLE_ENTRY(PACKET_TYPE_FC_TELEMETRY_EXTENDED),
+   STR_TABLE_ENTRY(PACKET_TYPE_FC_RC_CHANNELS),
+   STR_TABLE_ENTRY(PACKET_TYPE_RC_TELEMETRY),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_STATS),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_GRAPHS),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_TX_HISTORY),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_DEV_VIDEO_BITRATE_HISTORY),
+   STR_TABLE_ENTRY(PACKET_TYPE_TELEMETRY_RAW_DOWNLOAD),
+   STR_TABLE_ENTRY(PACKET_TYPE_TELEMETRY_RAW_UPLOAD),
+   STR_TABLE_ENTRY(PACKET_TYPE_AUX_DATA_LINK_UPLOAD),
+   STR_TABLE_ENTRY(PACKET_TYPE_AUX_DATA_LINK_DOWNLOAD),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_VIDEO_INFO_STATS),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_RADIO_RX_HISTORY),
+   STR_TABLE_ENTRY(PACKET_TYPE_RUBY_TELEMETRY_DELTA),
+
+   STR_TABLE_ENTRY(PACKET_TYPE_VEHICLE_RECORDING),
+   STR_TABLE_ENTRY(PACKET_TYPE_NEGOCIATE_RADIO_LINKS),
+   // Local packets
+
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_PAUSE_VIDEO),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_RESUME_VIDEO),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_UPDATE_VIDEO_PROGRAM),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_MODEL_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_SIGNAL_VIDEO_ENCODINGS_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_CONTROLLER_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_START_VIDEO_PROGRAM),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_REBOOT),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_UPDATE_STARTED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_UPDATE_STOPED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_UPDATE_FINISHED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_START),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_STOP),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_PAUSE),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_RESUME),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_UPDATED_VIDEO_LINK_OVERWRITES),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_RELAY_MODE_SWITCHED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_BROADCAST_RADIO_REINITIALIZED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_RECEIVED_MODEL_SETTING),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_REINITIALIZE_RADIO_LINKS),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_RECEIVED_VEHICLE_LOG_SEGMENT),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_SIGNAL_USER_SELECTED_VIDEO_PROFILE_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_PASSPHRASE_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROLL_VIDEO_DETECTED_ON_SEARCH),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_I2C_DEVICE_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROLLER_ROUTER_READY),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROLLER_RADIO_INTERFACE_FAILED_TO_INITIALIZE),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROLLER_RELOAD_CORE_PLUGINS),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SET_CAMERA_PARAM),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_BROADCAST_VEHICLE_STATS),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROLLER_SEARCH_FREQ_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_LINK_FREQUENCY_CHANGED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_FORCE_VIDEO_PROFILE),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_VEHICLE_VIDEO_PROFILE_SWITCHED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_VEHICLE_ROUTER_READY),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SET_SIK_RADIO_SERIAL_SPEED),
+   STR_TABLE_ENTRY(PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SEND_MODEL_SETTINGS),
+
+   STR_TABLE_ENTRY(PACKET_TYPE_DEBUG_VEHICLE_RT_INFO),
+   STR_TABLE_ENTRY(PACKET_TYPE_OTA_UPDATE_STATUS),
+};
+
+// Components names, indexed by component id
+static const char* s_szComponentsNames[8] =
 {
-   static char s_szPacketType[128];
+   STR_TABLE_ENTRY(PACKET_COMPONENT_LOCAL_CONTROL),
+   STR_TABLE_ENTRY(PACKET_COMPONENT_VIDEO),
+   STR_TABLE_ENTRY(PACKET_COMPONENT_TELEMETRY),
+   STR_TABLE_ENTRY(PACKET_COMPONENT_COMMANDS),
+   STR_TABLE_ENTRY(PACKET_COMPONENT_RC),
+   STR_TABLE_ENTRY(PACKET_COMPONENT_RUBY),
+   STR_TABLE_ENTRY(PACKET_COMPONENT_AUDIO)
+};
+
+const char* str_get_packet_type_name(int iPacketType)
+{
+   if ( (iPacketType < 0) || (iPacketType > 255) )
+      return NULL;
+   return s_szPacketTypesNames[iPacketType];
+}
 
-   switch(iPacketType)
+char* str_format_packet_type(int iPacketType, char* szOutput, int iMaxLength)
+{
+   if ( (NULL == szOutput) || (iMaxLength < 1) )
+      return szOutput;
+   const char* szName = str_get_packet_type_name(iPacketType);
+   if ( NULL != szName )
    {
-      case PACKET_TYPE_EMBEDED_SHORT_PACKET: strcpy(s_szPacketType, "PACKET_TYPE_EMBEDED_SHORT_PACKET"); break;
-      case PACKET_TYPE_EMBEDED_FULL_PACKET: strcpy(s_szPacketType, "PACKET_TYPE_EMBEDED_FULL_PACKET"); break;
-      
-      case PACKET_TYPE_RUBY_PING_CLOCK:          strcpy(s_szPacketType, "PACKET_TYPE_RUBY_PING_CLOCK"); break;
-      case PACKET_TYPE_RUBY_PING_CLOCK_REPLY:    strcpy(s_szPacketType, "PACKET_TYPE_RUBY_PING_CLOCK_REPLY"); break;
-      case PACKET_TYPE_RUBY_RADIO_REINITIALIZED: strcpy(s_szPacketType, "PACKET_TYPE_RUBY_RADIO_REINITIALIZED"); break;
-      case PACKET_TYPE_RUBY_MODEL_SETTINGS:      strcpy(s_szPacketType, "PACKET_TYPE_RUBY_MODEL_SETTINGS"); break;
-      case PACKET_TYPE_RUBY_PAIRING_REQUEST:     strcpy(s_szPacketType, "PACKET_TYPE_RUBY_PAIRING_REQUEST"); break;
-      case PACKET_TYPE_RUBY_PAIRING_CONFIRMATION: strcpy(s_szPacketType, "PACKET_TYPE_RUBY_PAIRING_CONFIRMATION"); break;
-      case PACKET_TYPE_RUBY_RADIO_CONFIG_UPDATED: strcpy(s_szPacketType, "PACKET_TYPE_RUBY_RADIO_CONFIG_UPDATED"); break;
-      case PACKET_TYPE_RUBY_LOG_FILE_SEGMENT:    strcpy(s_szPacketType, "PACKET_TYPE_RUBY_LOG_FILE_SEGMENT"); break;
-      case PACKET_TYPE_RUBY_ALARM:               strcpy(s_szPacketType, "PACKET_TYPE_RUBY_ALARM"); break;
-      case PACKET_TYPE_VIDEO_DATA_98  :          strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_DATA_98"); break;
-      case PACKET_TYPE_AUDIO_SEGMENT:            strcpy(s_szPacketType, "PACKET_TYPE_AUDIO_SEGMENT"); break;
-      case PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS:   strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS"); break;
-      case PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL:     strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL"); break;
-      case PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK: strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK"); break;
-      case PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE:     strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE"); break;
-      case PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK: strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK"); break;
-      case PACKET_TYPE_COMMAND:                  strcpy(s_szPacketType, "PACKET_TYPE_COMMAND"); break;
-      case PACKET_TYPE_COMMAND_RESPONSE:         strcpy(s_szPacketType, "PACKET_TYPE_COMMAND_RESPONSE"); break;
-      case PACKET_TYPE_SIK_CONFIG:               strcpy(s_szPacketType, "PACKET_TYPE_SIK_CONFIG"); break;
-      case PACKET_TYPE_DEBUG_INFO:               strcpy(s_szPacketType, "PACKET_TYPE_DEBUG_INFO"); break;
-      case PACKET_TYPE_RC_FULL_FRAME:            strcpy(s_szPacketType, "PACKET_TYPE_RC_FULL_FRAME"); break;
-      case PACKET_TYPE_RC_DOWNLOAD_INFO:         strcpy(s_szPacketType, "PACKET_TYPE_RC_DOWNLOAD_INFO"); break;
-      // Telemetry
-
-      case PACKET_TYPE_RUBY_TELEMETRY_SHORT:      strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_SHORT"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_EXTENDED:   strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_EXTENDED"); break;
-      case PACKET_TYPE_FC_TELEMETRY:              strcpy(s_szPacketType, "PACKET_TYPE_FC_TELEMETRY"); break;
-      case PACKET_TYPE_FC_TELEMETRY_EXTENDED:     strcpy(s_szPacketType, "PACKET_TYPE_FC_TELEMETRY_EXTENDED"); break;
-      case PACKET_TYPE_FC_RC_CHANNELS:            strcpy(s_szPacketType, "PACKET_TYPE_FC_RC_CHANNELS"); break;
-      case PACKET_TYPE_RC_TELEMETRY:              strcpy(s_szPacketType, "PACKET_TYPE_RC_TELEMETRY"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_STATS:   strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_STATS"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_GRAPHS:  strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_GRAPHS"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_TX_HISTORY:     strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_TX_HISTORY"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS: strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_DEV_VIDEO_BITRATE_HISTORY: strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_DEV_VIDEO_BITRATE_HISTORY"); break;
-      case PACKET_TYPE_TELEMETRY_RAW_DOWNLOAD:    strcpy(s_szPacketType, "PACKET_TYPE_TELEMETRY_RAW_DOWNLOAD"); break;
-      case PACKET_TYPE_TELEMETRY_RAW_UPLOAD:      strcpy(s_szPacketType, "PACKET_TYPE_TELEMETRY_RAW_UPLOAD"); break;
-      case PACKET_TYPE_AUX_DATA_LINK_UPLOAD:      strcpy(s_szPacketType, "PACKET_TYPE_AUX_DATA_LINK_UPLOAD"); break;
-      case PACKET_TYPE_AUX_DATA_LINK_DOWNLOAD:    strcpy(s_szPacketType, "PACKET_TYPE_AUX_DATA_LINK_DOWNLOAD"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_VIDEO_INFO_STATS:  strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_VIDEO_INFO_STATS"); break;
-      case PACKET_TYPE_RUBY_TELEMETRY_RADIO_RX_HISTORY: strcpy(s_szPacketType, "PACKET_TYPE_RUBY_TELEMETRY_RADIO_RX_HISTORY"); break;
-
-      case PACKET_TYPE_VEHICLE_RECORDING: strcpy(s_szPacketType, "PACKET_TYPE_VEHICLE_RECORDING"); break;
-      case PACKET_TYPE_NEGOCIATE_RADIO_LINKS: strcpy(s_szPacketType, "PACKET_TYPE_NEGOCIATE_RADIO_LINKS"); break;       
-      // Local packets
-
-      case PACKET_TYPE_LOCAL_CONTROL_PAUSE_VIDEO:           strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_PAUSE_VIDEO"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_RESUME_VIDEO:          strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_RESUME_VIDEO"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_UPDATE_VIDEO_PROGRAM:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_UPDATE_VIDEO_PROGRAM"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_MODEL_CHANGED:         strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_MODEL_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_SIGNAL_VIDEO_ENCODINGS_CHANGED:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_SIGNAL_VIDEO_ENCODINGS_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_CONTROLLER_CHANGED:    strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_CONTROLLER_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_START_VIDEO_PROGRAM:   strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_START_VIDEO_PROGRAM"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_REBOOT:                strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_REBOOT"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_UPDATE_STARTED:        strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_UPDATE_STARTED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_UPDATE_STOPED:         strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_UPDATE_STOPED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_UPDATE_FINISHED:       strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_UPDATE_FINISHED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_START:     strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_START"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_STOP:      strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_STOP"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_PAUSE:     strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_PAUSE"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_RESUME:    strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_DEBUG_SCOPE_RESUME"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_UPDATED_VIDEO_LINK_OVERWRITES:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_UPDATED_VIDEO_LINK_OVERWRITES"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_RELAY_MODE_SWITCHED:            strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_RELAY_MODE_SWITCHED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_BROADCAST_RADIO_REINITIALIZED:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_BROADCAST_RADIO_REINITIALIZED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_RECEIVED_MODEL_SETTING:         strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_RECEIVED_MODEL_SETTING"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_REINITIALIZE_RADIO_LINKS:       strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_REINITIALIZE_RADIO_LINKS"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_RECEIVED_VEHICLE_LOG_SEGMENT:   strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_RECEIVED_VEHICLE_LOG_SEGMENT"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_SIGNAL_USER_SELECTED_VIDEO_PROFILE_CHANGED:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_SIGNAL_USER_SELECTED_VIDEO_PROFILE_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_PASSPHRASE_CHANGED:      strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_PASSPHRASE_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROLL_VIDEO_DETECTED_ON_SEARCH: strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROLL_VIDEO_DETECTED_ON_SEARCH"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_I2C_DEVICE_CHANGED:      strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_I2C_DEVICE_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROLLER_ROUTER_READY:         strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROLLER_ROUTER_READY"); break;
-      case PACKET_TYPE_LOCAL_CONTROLLER_RADIO_INTERFACE_FAILED_TO_INITIALIZE:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROLLER_RADIO_INTERFACE_FAILED_TO_INITIALIZE"); break;
-      case PACKET_TYPE_LOCAL_CONTROLLER_RELOAD_CORE_PLUGINS:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROLLER_RELOAD_CORE_PLUGINS"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SET_CAMERA_PARAM: strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SET_CAMERA_PARAM"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_BROADCAST_VEHICLE_STATS: strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_BROADCAST_VEHICLE_STATS"); break;
-      case PACKET_TYPE_LOCAL_CONTROLLER_SEARCH_FREQ_CHANGED:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROLLER_SEARCH_FREQ_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_LINK_FREQUENCY_CHANGED:          strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_LINK_FREQUENCY_CHANGED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_FORCE_VIDEO_PROFILE:     strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_FORCE_VIDEO_PROFILE"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_VEHICLE_VIDEO_PROFILE_SWITCHED:   strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_VEHICLE_VIDEO_PROFILE_SWITCHED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_VEHICLE_ROUTER_READY:             strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_VEHICLE_ROUTER_READY"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SET_SIK_RADIO_SERIAL_SPEED:  strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SET_SIK_RADIO_SERIAL_SPEED"); break;
-      case PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SEND_MODEL_SETTINGS:      strcpy(s_szPacketType, "PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SEND_MODEL_SETTINGS"); break;
-
-      case PACKET_TYPE_DEBUG_VEHICLE_RT_INFO:      strcpy(s_szPacketType, "PACKET_TYPE_DEBUG_VEHICLE_RT_INFO"); break;
-      case PACKET_TYPE_OTA_UPDATE_STATUS:          strcpy(s_szPacketType, "PACKET_TYPE_OTA_UPDATE_STATUS"); break;
-      default: sprintf(s_szPacketType, "Unknown %d", iPacketType); break;
+      strncpy(szOutput, szName, iMaxLength-1);
+      szOutput[iMaxLength-1] = 0;
    }
-   return s_szPacketType;
+   else
+      snprintf(szOutput, iMaxLength, "Unknown %d", iPacketType);
+   return szOutput;
+}
+
+const char* str_get_packet_type(int iPacketType)
+{
+   const char* szName = str_get_packet_type_name(iPacketType);
+   if ( NULL != szName )
+      return szName;
+   static __thread char s_szPacketTypeUnknown[32];
+   return str_format_packet_type(iPacketType, s_szPacketTypeUnknown, sizeof(s_szPacketTypeUnknown));
 }
 
 char* str_get_packet_history_symbol(int iPacketType, int iRepeatCount)
@@ -374,7 +442,8 @@ char* str_get_packet_history_symbol(int iPacketType, int iRepeatCount)
       s_szOSDRenderRxHistoryPacketSymbol[0] = 'A';
 
    if ( iPacketType == PACKET_TYPE_VIDEO_DATA_98 ||
-        iPacketType == PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS )
+        iPacketType == PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS ||
+        iPacketType == PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP )
      s_szOSDRenderRxHistoryPacketSymbol[0] = 'V';
 
    if ( iPacketType == PACKET_TYPE_AUX_DATA_LINK_UPLOAD ||
@@ -392,7 +461,8 @@ char* str_get_packet_history_symbol(int iPacketType, int iRepeatCount)
         iPacketType == PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS ||
         iPacketType == PACKET_TYPE_RUBY_TELEMETRY_DEV_VIDEO_BITRATE_HISTORY ||
         iPacketType == PACKET_TYPE_RUBY_TELEMETRY_VIDEO_INFO_STATS ||
-        iPacketType == PACKET_TYPE_RUBY_TELEMETRY_RADIO_RX_HISTORY )
+        iPacketType == PACKET_TYPE_RUBY_TELEMETRY_RADIO_RX_HISTORY ||
+        iPacketType == PACKET_TYPE_RUBY_TELEMETRY_DELTA )
       s_szOSDRenderRxHistoryPacketSymbol[0] = 'r';
 
    if ( iPacketType == PACKET_TYPE_FC_TELEMETRY ||
@@ -404,7 +474,8 @@ char* str_get_packet_history_symbol(int iPacketType, int iRepeatCount)
    if ( iPacketType == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL ||
         iPacketType == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK ||
         iPacketType == PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE ||
-        iPacketType == PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK )
+        iPacketType == PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK ||
+        iPacketType == PACKET_TYPE_VIDEO_EC_RECOVERY_STATS )
       s_szOSDRenderRxHistoryPacketSymbol[0] = 'S';
 
    if ( iPacketType == PACKET_TYPE_RUBY_MODEL_SETTINGS )
@@ -451,9 +522,15 @@ void str_getDataRateDescription(int dataRateBPS, int iHT40, char* szOutput)
    {
       int mcsIndex = -dataRateBPS-1;
       if ( mcsIndex <= MAX_MCS_INDEX )
-         sprintf(szOutput, "MCS-%d %u Mb", mcsIndex, getRealDataRateFromMCSRate(mcsIndex, iHT40)/1000/1000 );
+      {
+         char* szPos = _str_append(szOutput, "MCS-");
+         szPos = _str_append_u32(szPos, (u32)mcsIndex);
+         szPos = _str_append(szPos, " ");
+         szPos = _str_append_u32(szPos, getRealDataRateFromMCSRate(mcsIndex, iHT40)/1000/1000);
+         _str_append(szPos, " Mb");
+      }
       else
-         sprintf(szOutput, "MCS-?");
+         strcpy(szOutput, "MCS-?");
    }
    else if ( 0 == dataRateBPS )
    {
@@ -461,7 +538,9 @@ void str_getDataRateDescription(int dataRateBPS, int iHT40, char* szOutput)
    }
    else if ( dataRateBPS <= 56 )
    {
-       sprintf(szOutput, "*%d Mbps", dataRateBPS);
+      char* szPos = _str_append(szOutput, "*");
+      szPos = _str_append_u32(szPos, (u32)dataRateBPS);
+      _str_append(szPos, " Mbps");
    }
    else
    {
@@ -470,12 +549,12 @@ void str_getDataRateDescription(int dataRateBPS, int iHT40, char* szOutput)
          if ( ((dataRateBPS /1000) % 1000) != 0 )
             sprintf(szOutput, "%1.f Mbps", (float)dataRateBPS/1000.0/1000.0);
          else
-            sprintf(szOutput, "%d Mbps", dataRateBPS/1000/1000);
+            _str_append(_str_append_u32(szOutput, (u32)dataRateBPS/1000/1000), " Mbps");
       }
       else if ( dataRateBPS >= 10000 )
-         sprintf(szOutput, "%d kbps", dataRateBPS/1000);
+         _str_append(_str_append_u32(szOutput, (u32)dataRateBPS/1000), " kbps");
       else
-         sprintf(szOutput, "%d bps", dataRateBPS);
+         _str_append(_str_append_u32(szOutput, (u32)dataRateBPS), " bps");
    }
 }
 
@@ -585,44 +664,53 @@ const char* str_getBandName(u32 band)
    return "";
 }
 
-char* str_format_frequency(u32 uFrequencyKhz)
+// Writes the frequency in Mhz, with up to 3 decimals (trailing zeros removed)
+static char* _str_format_frequency_mhz(u32 uFrequencyKhz, char* szOutput)
 {
-   static char s_szFrequencyFormat[64];
+   char* szPos = _str_append_u32(szOutput, uFrequencyKhz/1000);
+   u32 uDecimals = uFrequencyKhz % 1000;
+   if ( 0 == uDecimals )
+      return szPos;
+   *szPos++ = '.';
+   *szPos++ = '0' + uDecimals/100;
+   if ( 0 != (uDecimals % 100) )
+   {
+      *szPos++ = '0' + (uDecimals/10) % 10;
+      if ( 0 != (uDecimals % 10) )
+         *szPos++ = '0' + uDecimals % 10;
+   }
+   *szPos = 0;
+   return szPos;
+}
 
-   s_szFrequencyFormat[0] = 0;
-   
+char* str_format_frequency_r(u32 uFrequencyKhz, char* szOutput)
+{
+   if ( NULL == szOutput )
+      return szOutput;
    if ( uFrequencyKhz < 10000 )
       uFrequencyKhz *= 1000;
-     
-   if ( (uFrequencyKhz%1000) == 0 )
-      sprintf(s_szFrequencyFormat, "%u Mhz", uFrequencyKhz/1000);
-   else if ( (uFrequencyKhz%100) == 0 )
-      sprintf(s_szFrequencyFormat, "%u.%u Mhz", uFrequencyKhz/1000, (uFrequencyKhz%1000) / 100);
-   else if ( (uFrequencyKhz%10) == 0 )
-      sprintf(s_szFrequencyFormat, "%u.%u Mhz", uFrequencyKhz/1000, (uFrequencyKhz%1000) / 10);
-   else
-      sprintf(s_szFrequencyFormat, "%u.%u Mhz", uFrequencyKhz/1000, uFrequencyKhz%1000);
+   _str_append(_str_format_frequency_mhz(uFrequencyKhz, szOutput), " Mhz");
+   return szOutput;
+}
 
-   return s_szFrequencyFormat;
+char* str_format_frequency_no_sufix_r(u32 uFrequencyKhz, char* szOutput)
+{
+   if ( NULL == szOutput )
+      return szOutput;
+   _str_format_frequency_mhz(uFrequencyKhz, szOutput);
+   return szOutput;
 }
 
+char* str_format_frequency(u32 uFrequencyKhz)
+{
+   static __thread char s_szFrequencyFormat[32];
+   return str_format_frequency_r(uFrequencyKhz, s_szFrequencyFormat);
+}
 
 char* str_format_frequency_no_sufix(u32 uFrequencyKhz)
 {
-   static char s_szFrequencyFormatNoSufix[64];
-
-   s_szFrequencyFormatNoSufix[0] = 0;
-   
-   if ( (uFrequencyKhz%1000) == 0 )
-      sprintf(s_szFrequencyFormatNoSufix, "%u", uFrequencyKhz/1000);
-   else if ( (uFrequencyKhz%100) == 0 )
-      sprintf(s_szFrequencyFormatNoSufix, "%u.%u", uFrequencyKhz/1000, (uFrequencyKhz%1000) / 100);
-   else if ( (uFrequencyKhz%10) == 0 )
-      sprintf(s_szFrequencyFormatNoSufix, "%u.%u", uFrequencyKhz/1000, (uFrequencyKhz%1000) / 10);
-   else
-      sprintf(s_szFrequencyFormatNoSufix, "%u.%u", uFrequencyKhz/1000, uFrequencyKhz%1000);
-
-   return s_szFrequencyFormatNoSufix;
+   static __thread char s_szFrequencyFormatNoSufix[32];
+   return str_format_frequency_no_sufix_r(uFrequencyKhz, s_szFrequencyFormatNoSufix);
 }
 
 
@@ -930,6 +1018,8 @@ const char* str_get_radio_type_description(int iRadioType)
       strcpy(sszNICTypeDescription, "SiK-Radio");
    if ( iRadioType == RADIO_TYPE_SERIAL )
       strcpy(sszNICTypeDescription, "Serial-Radio");
+   if ( iRadioType == RADIO_TYPE_EMULATED )
+      strcpy(sszNICTypeDescription, "Emulated");
    return sszNICTypeDescription;
 }
 
@@ -956,6 +1046,8 @@ const char* str_get_radio_driver_description(int iDriverType)
       strcpy(sszNICDriverDescription, "SiK");
    if ( iDriverType == RADIO_HW_DRIVER_SERIAL )
       strcpy(sszNICDriverDescription, "Serial");
+   if ( iDriverType == RADIO_HW_DRIVER_EMULATED )
+      strcpy(sszNICDriverDescription, "Emulated");
    return sszNICDriverDescription;
 }
 
@@ -1060,7 +1152,7 @@ void str_get_radio_capabilities_description(u32 flags, char* szOutput)
 
 char* str_get_radio_frame_flags_description2(u32 frameFlags)
 {
-   static char s_szRadioFrameFlagsDescription[256];
+   static __thread char s_szRadioFrameFlagsDescription[256];
    s_szRadioFrameFlagsDescription[0] = 0;
    str_get_radio_frame_flags_description(frameFlags, s_szRadioFrameFlagsDescription);   
    return s_szRadioFrameFlagsDescription;
@@ -1313,29 +1405,13 @@ char* str_get_command_response_flags_string(u32 uResponseFlags)
    return s_szCommandResponseFlagsString;
 }
 
-char* str_get_component_id(int iComponentId)
+const char* str_get_component_id(int iComponentId)
 {
-   static char s_szComponentIdString[64];
-   s_szComponentIdString[0] = 0;
-
-   if ( iComponentId == PACKET_COMPONENT_LOCAL_CONTROL )
-      strcpy(s_szComponentIdString, "PACKET_COMPONENT_LOCAL_CONTROL");
-   else if ( iComponentId == PACKET_COMPONENT_VIDEO )
-      strcpy(s_szComponentIdString, "PACKET_COMPONENT_VIDEO");
-   else if ( iComponentId == PACKET_COMPONENT_TELEMETRY )
-      strcpy(s_szComponentIdString, "PACKET_COMPONENT_TELEMETRY");
-   else if ( iComponentId == PACKET_COMPONENT_COMMANDS )
-      strcpy(s_szComponentIdString, "PACKET_COMPONENT_COMMANDS");
-   else if ( iComponentId == PACKET_COMPONENT_RC )
-      strcpy(s_szComponentIdString, "PACKET_COMPONENT_RC");
-   else if ( iComponentId == PACKET_COMPONENT_RUBY )
-      strcpy(s_szComponentIdString, "PACKET_COMPONENT_RUBY");
-   else if ( iComponentId == PACKET_COMPONENT_AUDIO )
-      strcpy(s_szComponentIdString, "PACKET_COMPONENT_AUDIO");
-   else
-      strcpy(s_szComponentIdString, "INVALID");
-
-   return s_szComponentIdString;
+   if ( (iComponentId < 0) || (iComponentId >= (int)(sizeof(s_szComponentsNames)/sizeof(s_szComponentsNames[0]))) )
+      return "INVALID";
+   if ( NULL == s_szComponentsNames[iComponentId] )
+      return "INVALID";
+   return s_szComponentsNames[iComponentId];
 }
 
 char* str_get_model_change_type(int iModelChangeType)
@@ -19,9 +19,18 @@ void str_format_bitrate_no_sufix(int bitrate_bps, char* szBuffer);
 const char* str_getBandName(u32 band);
 void str_get_supported_bands_string(u32 bands, char* szOut);
 
+// The functions returning a pointer to an internal buffer use a per thread buffer.
+// The _r versions write to the provided buffer (at least 32 bytes).
 char* str_format_frequency(u32 uFrequencyKhz);
 char* str_format_frequency_no_sufix(u32 uFrequencyKhz);
-char* str_get_packet_type(int iPacketType);
+char* str_format_frequency_r(u32 uFrequencyKhz, char* szOutput);
+char* str_format_frequency_no_sufix_r(u32 uFrequencyKhz, char* szOutput);
+
+// Packet type names are looked up in a table indexed by packet type.
+// Returns NULL for unknown packet types.
+const char* str_get_packet_type_name(int iPacketType);
+char* str_format_packet_type(int iPacketType, char* szOutput, int iMaxLength);
+const char* str_get_packet_type(int iPacketType);
 char* str_get_packet_history_symbol(int iPacketType, int iRepeatCount);
 char* str_get_packet_test_link_command(int iTestCommandId);
 
@@ -54,7 +63,7 @@ char* str_get_developer_flags(u32 uDeveloperFlags);
 
 char* str_get_command_response_flags_string(u32 uResponseFlags);
 
-char* str_get_component_id(int iComponentId);
+const char* str_get_component_id(int iComponentId);
 char* str_get_model_change_type(int iModelChangeType);
 
 char* str_format_relay_flags(u32 uRelayFlags);
@@ -0,0 +1,872 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sw_upload.h"
+#include "../radio/fec.h"
+
+#define SW_UPLOAD_STATE_MAGIC 0x53575550
+
+typedef struct
+{
+   u32 uMagic;
+   u32 uUploadId;
+   u32 uTotalSize;
+   u32 uSegmentSize;
+   u32 uSegmentsCount;
+   u32 uType;
+   u32 uContiguousSegments;
+   u32 uRunningCrc;
+   u32 uSegmentsReceived;
+} t_sw_upload_state_header;
+
+static int _sw_upload_get_segment_length(u32 uTotalSize, int iSegmentSize, u32 uSegmentsCount, u32 uSegmentIndex)
+{
+   if ( uSegmentIndex < uSegmentsCount-1 )
+      return iSegmentSize;
+   return (int)(uTotalSize - uSegmentIndex * (u32)iSegmentSize);
+}
+
+//-----------------------------------------------------
+// Sender
+
+int sw_upload_sender_init(t_sw_upload_sender* pSender, u8* pData, u32 uSize, u8 uType, int iSegmentSize, int iFECData, int iFECParity, int iWindowSegments)
+{
+   if ( NULL == pSender )
+      return 0;
+   memset(pSender, 0, sizeof(t_sw_upload_sender));
+   if ( (NULL == pData) || (0 == uSize) || (uSize > SW_UPLOAD_MAX_TOTAL_SIZE) )
+      return 0;
+   if ( (iSegmentSize < 16) || (iSegmentSize > SW_UPLOAD_MAX_SEGMENT_SIZE) )
+      return 0;
+
+   if ( (iFECData <= 0) || (iFECParity <= 0) )
+   {
+      iFECData = 0;
+      iFECParity = 0;
+   }
+   if ( iFECData > SW_UPLOAD_MAX_FEC_DATA )
+      iFECData = SW_UPLOAD_MAX_FEC_DATA;
+   if ( iFECParity > SW_UPLOAD_MAX_FEC_PARITY )
+      iFECParity = SW_UPLOAD_MAX_FEC_PARITY;
+
+   // A lost segment must be able to get its FEC group sent (and then be retransmitted) within the window
+   if ( iWindowSegments < 2*iFECData )
+      iWindowSegments = 2*iFECData;
+   if ( iWindowSegments < 1 )
+      iWindowSegments = 1;
+   if ( iWindowSegments > SW_UPLOAD_MAX_WINDOW_SEGMENTS )
+      iWindowSegments = SW_UPLOAD_MAX_WINDOW_SEGMENTS;
+
+   pSender->uUploadId = base_compute_crc32(pData, (int)uSize);
+   pSender->uTotalSize = uSize;
+   pSender->iSegmentSize = iSegmentSize;
+   pSender->uSegmentsCount = (uSize + (u32)iSegmentSize - 1) / (u32)iSegmentSize;
+   pSender->iFECData = iFECData;
+   pSender->iFECParity = iFECParity;
+   if ( iFECData > 0 )
+      pSender->uFECGroups = (pSender->uSegmentsCount + (u32)iFECData - 1) / (u32)iFECData;
+   pSender->uType = uType;
+   pSender->pData = pData;
+   pSender->iWindowSegments = iWindowSegments;
+   pSender->iCachedFECGroup = -1;
+   pSender->uSmoothedRTTMs = 200;
+   pSender->uRemoteStatus = SW_UPLOAD_STATUS_IN_PROGRESS;
+
+   pSender->pSegmentAcked = (u8*) malloc(pSender->uSegmentsCount);
+   pSender->pSegmentSentSeq = (u32*) malloc(pSender->uSegmentsCount * sizeof(u32));
+   if ( (NULL == pSender->pSegmentAcked) || (NULL == pSender->pSegmentSentSeq) )
+   {
+      log_softerror_and_alarm("[SWUpload] Failed to allocate memory for sending %u segments.", pSender->uSegmentsCount);
+      sw_upload_sender_uninit(pSender);
+      return 0;
+   }
+   memset(pSender->pSegmentAcked, 0, pSender->uSegmentsCount);
+   memset(pSender->pSegmentSentSeq, 0, pSender->uSegmentsCount * sizeof(u32));
+
+   if ( pSender->uFECGroups > 0 )
+   {
+      pSender->pFECSent = (u8*) malloc(pSender->uFECGroups);
+      pSender->pFECGroupSentSeq = (u32*) malloc(pSender->uFECGroups * sizeof(u32));
+      pSender->pFECCache = (u8*) malloc(iFECParity * iSegmentSize);
+      pSender->pFECDataBuffer = (u8*) malloc(iFECData * iSegmentSize);
+      if ( (NULL == pSender->pFECSent) || (NULL == pSender->pFECGroupSentSeq) || (NULL == pSender->pFECCache) || (NULL == pSender->pFECDataBuffer) )
+      {
+         log_softerror_and_alarm("[SWUpload] Failed to allocate memory for %u FEC groups.", pSender->uFECGroups);
+         sw_upload_sender_uninit(pSender);
+         return 0;
+      }
+      memset(pSender->pFECSent, 0, pSender->uFECGroups);
+      memset(pSender->pFECGroupSentSeq, 0, pSender->uFECGroups * sizeof(u32));
+   }
+
+   log_line("[SWUpload] Sender: upload id %u, %u bytes, %u segments of %d bytes, FEC %d/%d, window %d segments.",
+      pSender->uUploadId, uSize, pSender->uSegmentsCount, iSegmentSize, iFECData, iFECParity, iWindowSegments);
+   return 1;
+}
+
+void sw_upload_sender_uninit(t_sw_upload_sender* pSender)
+{
+   if ( NULL == pSender )
+      return;
+   if ( NULL != pSender->pSegmentAcked )
+      free(pSender->pSegmentAcked);
+   if ( NULL != pSender->pSegmentSentSeq )
+      free(pSender->pSegmentSentSeq);
+   if ( NULL != pSender->pFECSent )
+      free(pSender->pFECSent);
+   if ( NULL != pSender->pFECGroupSentSeq )
+      free(pSender->pFECGroupSentSeq);
+   if ( NULL != pSender->pFECCache )
+      free(pSender->pFECCache);
+   if ( NULL != pSender->pFECDataBuffer )
+      free(pSender->pFECDataBuffer);
+   memset(pSender, 0, sizeof(t_sw_upload_sender));
+}
+
+static u32 _sw_upload_sender_get_retransmit_timeout(t_sw_upload_sender* pSender)
+{
+   u32 uTimeout = 2 * pSender->uSmoothedRTTMs + 20;
+   if ( uTimeout < SW_UPLOAD_MIN_RETRANSMIT_MS )
+      uTimeout = SW_UPLOAD_MIN_RETRANSMIT_MS;
+   if ( uTimeout > SW_UPLOAD_MAX_RETRANSMIT_MS )
+      uTimeout = SW_UPLOAD_MAX_RETRANSMIT_MS;
+   return uTimeout;
+}
+
+static int _sw_upload_sender_is_fec_group_acked(t_sw_upload_sender* pSender, u32 uGroup)
+{
+   u32 uFirst = uGroup * (u32)pSender->iFECData;
+   for( u32 u=uFirst; (u<uFirst + (u32)pSender->iFECData) && (u<pSender->uSegmentsCount); u++ )
+   {
+      if ( ! pSender->pSegmentAcked[u] )
+         return 0;
+   }
+   return 1;
+}
+
+// A segment is lost if an ack request sent after it got answered without it. With FEC, only once the FEC
+// segments of its group were sent before that ack request too (the receiver might still recover it).
+static int _sw_upload_sender_is_segment_lost(t_sw_upload_sender* pSender, u32 uSegment)
+{
+   if ( pSender->pSegmentAcked[uSegment] || (0 == pSender->pSegmentSentSeq[uSegment]) )
+      return 0;
+   if ( pSender->pSegmentSentSeq[uSegment] > pSender->uAckedRequestSeq )
+      return 0;
+   if ( pSender->uFECGroups > 0 )
+   {
+      u32 uFECSeq = pSender->pFECGroupSentSeq[uSegment / (u32)pSender->iFECData];
+      if ( (0 == uFECSeq) || (uFECSeq > pSender->uAckedRequestSeq) )
+         return 0;
+   }
+   return 1;
+}
+
+static void _sw_upload_sender_compute_fec(t_sw_upload_sender* pSender, u32 uGroup)
+{
+   if ( pSender->iCachedFECGroup == (int)uGroup )
+      return;
+
+   u8* pDataBlocks[SW_UPLOAD_MAX_FEC_DATA];
+   u8* pFECBlocks[SW_UPLOAD_MAX_FEC_PARITY];
+   u32 uFirst = uGroup * (u32)pSender->iFECData;
+   memset(pSender->pFECDataBuffer, 0, pSender->iFECData * pSender->iSegmentSize);
+   for( int i=0; i<pSender->iFECData; i++ )
+   {
+      pDataBlocks[i] = pSender->pFECDataBuffer + i * pSender->iSegmentSize;
+      if ( uFirst + (u32)i < pSender->uSegmentsCount )
+         memcpy(pDataBlocks[i], pSender->pData + (uFirst + (u32)i) * (u32)pSender->iSegmentSize,
+            _sw_upload_get_segment_length(pSender->uTotalSize, pSender->iSegmentSize, pSender->uSegmentsCount, uFirst + (u32)i));
+   }
+   for( int i=0; i<pSender->iFECParity; i++ )
+      pFECBlocks[i] = pSender->pFECCache + i * pSender->iSegmentSize;
+   fec_encode(pSender->iSegmentSize, pDataBlocks, pSender->iFECData, pFECBlocks, pSender->iFECParity);
+   pSender->iCachedFECGroup = (int)uGroup;
+}
+
+static int _sw_upload_sender_build_segment(t_sw_upload_sender* pSender, u32 uSegmentIndex, u32 uTimeNowMs, u8* pOutBuffer)
+{
+   command_packet_sw_upload_segment header;
+   memset(&header, 0, sizeof(header));
+   header.uUploadId = pSender->uUploadId;
+   header.uTotalSize = pSender->uTotalSize;
+   header.uSegmentIndex = uSegmentIndex;
+   header.uSegmentSize = (u16)pSender->iSegmentSize;
+   header.uFECData = (u8)pSender->iFECData;
+   header.uFECParity = (u8)pSender->iFECParity;
+   header.uType = pSender->uType;
+
+   u8* pData = NULL;
+   if ( SW_UPLOAD_PROBE_SEGMENT == uSegmentIndex )
+      header.uDataLength = 0;
+   else if ( uSegmentIndex < pSender->uSegmentsCount )
+   {
+      header.uDataLength = (u16)_sw_upload_get_segment_length(pSender->uTotalSize, pSender->iSegmentSize, pSender->uSegmentsCount, uSegmentIndex);
+      pData = pSender->pData + uSegmentIndex * (u32)pSender->iSegmentSize;
+   }
+   else
+   {
+      u32 uFECIndex = uSegmentIndex - pSender->uSegmentsCount;
+      _sw_upload_sender_compute_fec(pSender, uFECIndex / (u32)pSender->iFECParity);
+      header.uDataLength = (u16)pSender->iSegmentSize;
+      pData = pSender->pFECCache + (uFECIndex % (u32)pSender->iFECParity) * (u32)pSender->iSegmentSize;
+   }
+
+   pSender->uSegmentsSent++;
+   if ( (SW_UPLOAD_PROBE_SEGMENT == uSegmentIndex) || (pSender->uSegmentsSent - pSender->uLastAckRequestSeq >= SW_UPLOAD_ACK_EVERY_SEGMENTS) )
+   {
+      pSender->uAckRequestId++;
+      pSender->uAckRequestTime[pSender->uAckRequestId % SW_UPLOAD_ACK_REQUESTS_HISTORY] = uTimeNowMs;
+      pSender->uAckRequestSeq[pSender->uAckRequestId % SW_UPLOAD_ACK_REQUESTS_HISTORY] = pSender->uSegmentsSent;
+      pSender->uLastAckRequestTime = uTimeNowMs;
+      pSender->uLastAckRequestSeq = pSender->uSegmentsSent;
+      header.uAckRequestId = pSender->uAckRequestId;
+      header.uFlags |= SW_UPLOAD_FLAG_ACK_REQUEST;
+   }
+
+   memcpy(pOutBuffer, &header, sizeof(header));
+   if ( NULL != pData )
+      memcpy(pOutBuffer + sizeof(header), pData, header.uDataLength);
+   return (int)sizeof(header) + header.uDataLength;
+}
+
+int sw_upload_sender_get_next_segment(t_sw_upload_sender* pSender, u32 uTimeNowMs, u8* pOutBuffer, int iMaxLength)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pData) || (NULL == pOutBuffer) )
+      return 0;
+   if ( iMaxLength < (int)sizeof(command_packet_sw_upload_segment) + pSender->iSegmentSize )
+      return 0;
+   if ( SW_UPLOAD_STATUS_IN_PROGRESS != pSender->uRemoteStatus )
+      return 0;
+
+   u32 uTimeout = _sw_upload_sender_get_retransmit_timeout(pSender);
+   int bAckRequestPending = (pSender->uLastAckId != pSender->uAckRequestId)?1:0;
+
+   // Start with an ack request only: the receiver might already have part of this upload (resume)
+   if ( ! pSender->bGotFirstAck )
+   {
+      if ( (0 == pSender->uAckRequestId) || (uTimeNowMs >= pSender->uLastAckRequestTime + uTimeout) )
+         return _sw_upload_sender_build_segment(pSender, SW_UPLOAD_PROBE_SEGMENT, uTimeNowMs, pOutBuffer);
+      return 0;
+   }
+
+   // Lost segments first
+   for( u32 u=pSender->uContiguousAcked; u<pSender->uNextNewSegment; u++ )
+   {
+      if ( ! _sw_upload_sender_is_segment_lost(pSender, u) )
+         continue;
+      pSender->uRetransmissions++;
+      int iLength = _sw_upload_sender_build_segment(pSender, u, uTimeNowMs, pOutBuffer);
+      pSender->pSegmentSentSeq[u] = pSender->uSegmentsSent;
+      return iLength;
+   }
+
+   // FEC segments of the next FEC group with all its data segments sent
+   while ( pSender->uNextFECGroup < pSender->uFECGroups )
+   {
+      u32 uGroup = pSender->uNextFECGroup;
+      if ( pSender->uNextNewSegment < (uGroup+1) * (u32)pSender->iFECData )
+      if ( pSender->uNextNewSegment < pSender->uSegmentsCount )
+         break;
+      if ( _sw_upload_sender_is_fec_group_acked(pSender, uGroup) )
+      {
+         pSender->uNextFECGroup++;
+         continue;
+      }
+      u32 uSegmentIndex = pSender->uSegmentsCount + uGroup * (u32)pSender->iFECParity + pSender->pFECSent[uGroup];
+      int iLength = _sw_upload_sender_build_segment(pSender, uSegmentIndex, uTimeNowMs, pOutBuffer);
+      pSender->uFECSegmentsSent++;
+      pSender->pFECSent[uGroup]++;
+      if ( pSender->pFECSent[uGroup] >= pSender->iFECParity )
+      {
+         pSender->pFECGroupSentSeq[uGroup] = pSender->uSegmentsSent;
+         pSender->uNextFECGroup++;
+      }
+      return iLength;
+   }
+
+   // New segments, within the window
+   while ( (pSender->uNextNewSegment < pSender->uSegmentsCount) && pSender->pSegmentAcked[pSender->uNextNewSegment] )
+      pSender->uNextNewSegment++;
+   if ( (pSender->uNextNewSegment < pSender->uSegmentsCount) && (pSender->uNextNewSegment < pSender->uContiguousAcked + (u32)pSender->iWindowSegments) )
+   {
+      u32 uSegment = pSender->uNextNewSegment;
+      int iLength = _sw_upload_sender_build_segment(pSender, uSegment, uTimeNowMs, pOutBuffer);
+      pSender->pSegmentSentSeq[uSegment] = pSender->uSegmentsSent;
+      pSender->uNextNewSegment++;
+      return iLength;
+   }
+
+   // Nothing to send: ask for an ack if segments were sent after the last answered ack request,
+   // or again if the last ack request or its ack got lost
+   if ( bAckRequestPending )
+   {
+      if ( uTimeNowMs >= pSender->uLastAckRequestTime + uTimeout )
+         return _sw_upload_sender_build_segment(pSender, SW_UPLOAD_PROBE_SEGMENT, uTimeNowMs, pOutBuffer);
+      return 0;
+   }
+   if ( pSender->uSegmentsSent > pSender->uLastAckRequestSeq )
+      return _sw_upload_sender_build_segment(pSender, SW_UPLOAD_PROBE_SEGMENT, uTimeNowMs, pOutBuffer);
+   return 0;
+}
+
+static void _sw_upload_sender_set_acked(t_sw_upload_sender* pSender, u32 uSegment)
+{
+   if ( pSender->pSegmentAcked[uSegment] )
+      return;
+   pSender->pSegmentAcked[uSegment] = 1;
+   pSender->uSegmentsAcked++;
+}
+
+void sw_upload_sender_on_ack(t_sw_upload_sender* pSender, t_sw_upload_ack* pAck, u32 uTimeNowMs)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pData) || (NULL == pAck) )
+      return;
+   if ( pAck->uUploadId != pSender->uUploadId )
+      return;
+   if ( (pAck->uAckRequestId <= pSender->uLastAckId) || (pAck->uAckRequestId > pSender->uAckRequestId) )
+      return;
+
+   pSender->uAcksReceived++;
+   pSender->bGotFirstAck = 1;
+   pSender->uLastAckId = pAck->uAckRequestId;
+   pSender->uLastAckTime = uTimeNowMs;
+   pSender->uRemoteStatus = pAck->uStatus;
+
+   if ( pSender->uAckRequestId - pAck->uAckRequestId < SW_UPLOAD_ACK_REQUESTS_HISTORY )
+   {
+      u32 uIndex = pAck->uAckRequestId % SW_UPLOAD_ACK_REQUESTS_HISTORY;
+      u32 uRTT = uTimeNowMs - pSender->uAckRequestTime[uIndex];
+      if ( 1 == pSender->uAcksReceived )
+         pSender->uSmoothedRTTMs = uRTT;
+      else
+         pSender->uSmoothedRTTMs = (7 * pSender->uSmoothedRTTMs + uRTT) / 8;
+      pSender->uAckedRequestSeq = pSender->uAckRequestSeq[uIndex];
+   }
+
+   if ( SW_UPLOAD_STATUS_COMPLETED == pAck->uStatus )
+   {
+      memset(pSender->pSegmentAcked, 1, pSender->uSegmentsCount);
+      pSender->uSegmentsAcked = pSender->uSegmentsCount;
+      pSender->uContiguousAcked = pSender->uSegmentsCount;
+      pSender->uNextNewSegment = pSender->uSegmentsCount;
+      return;
+   }
+
+   u32 uContiguous = pAck->uContiguousSegments;
+   if ( uContiguous > pSender->uSegmentsCount )
+      uContiguous = pSender->uSegmentsCount;
+
+   // The receiver lost its state (restarted without it): send everything it doesn't have again
+   if ( uContiguous < pSender->uContiguousAcked )
+   {
+      log_line("[SWUpload] Receiver went back from %u to %u contiguous segments.", pSender->uContiguousAcked, uContiguous);
+      memset(pSender->pSegmentAcked, 0, pSender->uSegmentsCount);
+      pSender->uSegmentsAcked = 0;
+      pSender->uContiguousAcked = 0;
+      if ( pSender->uFECGroups > 0 )
+      {
+         memset(pSender->pFECSent, 0, pSender->uFECGroups);
+         memset(pSender->pFECGroupSentSeq, 0, pSender->uFECGroups * sizeof(u32));
+         pSender->uNextFECGroup = uContiguous / (u32)pSender->iFECData;
+      }
+   }
+
+   for( u32 u=pSender->uContiguousAcked; u<uContiguous; u++ )
+      _sw_upload_sender_set_acked(pSender, u);
+   for( u32 k=0; k<SW_UPLOAD_ACK_BITMAP_BYTES*8; k++ )
+   {
+      u32 uSegment = uContiguous + 1 + k;
+      if ( uSegment >= pSender->uSegmentsCount )
+         break;
+      if ( pAck->uBitmap[k/8] & (1<<(k%8)) )
+         _sw_upload_sender_set_acked(pSender, uSegment);
+   }
+
+   pSender->uContiguousAcked = uContiguous;
+   if ( pSender->uNextNewSegment < uContiguous )
+      pSender->uNextNewSegment = uContiguous;
+   if ( (pSender->uFECGroups > 0) && (pSender->uNextFECGroup < uContiguous / (u32)pSender->iFECData) )
+      pSender->uNextFECGroup = uContiguous / (u32)pSender->iFECData;
+}
+
+int sw_upload_sender_is_complete(t_sw_upload_sender* pSender)
+{
+   if ( NULL == pSender )
+      return 0;
+   return (SW_UPLOAD_STATUS_COMPLETED == pSender->uRemoteStatus)?1:0;
+}
+
+int sw_upload_sender_get_progress_percent(t_sw_upload_sender* pSender)
+{
+   if ( (NULL == pSender) || (0 == pSender->uSegmentsCount) )
+      return 0;
+   return (int)(((u64)pSender->uSegmentsAcked * 100) / pSender->uSegmentsCount);
+}
+
+//-----------------------------------------------------
+// Receiver
+
+void sw_upload_receiver_init(t_sw_upload_receiver* pReceiver)
+{
+   if ( NULL != pReceiver )
+      memset(pReceiver, 0, sizeof(t_sw_upload_receiver));
+}
+
+static int _sw_upload_receiver_is_received(t_sw_upload_receiver* pReceiver, u32 uSegment)
+{
+   return (pReceiver->pReceivedBitmap[uSegment/8] & (1<<(uSegment%8)))?1:0;
+}
+
+static void _sw_upload_receiver_free(t_sw_upload_receiver* pReceiver)
+{
+   if ( NULL != pReceiver->pFile )
+      fclose(pReceiver->pFile);
+   pReceiver->pFile = NULL;
+   if ( NULL != pReceiver->pReceivedBitmap )
+      free(pReceiver->pReceivedBitmap);
+   if ( NULL != pReceiver->pFECSegments )
+   {
+      for( u32 u=0; u<pReceiver->uFECGroups; u++ )
+      {
+         if ( NULL != pReceiver->pFECSegments[u] )
+            free(pReceiver->pFECSegments[u]);
+      }
+      free(pReceiver->pFECSegments);
+   }
+   if ( NULL != pReceiver->pFECReceivedMask )
+      free(pReceiver->pFECReceivedMask);
+   if ( NULL != pReceiver->pFECBuffer )
+      free(pReceiver->pFECBuffer);
+   if ( NULL != pReceiver->pSegmentBuffer )
+      free(pReceiver->pSegmentBuffer);
+   memset(pReceiver, 0, sizeof(t_sw_upload_receiver));
+}
+
+void sw_upload_receiver_close(t_sw_upload_receiver* pReceiver, int bRemoveFiles)
+{
+   if ( (NULL == pReceiver) || (! pReceiver->bActive) )
+      return;
+
+   if ( (! bRemoveFiles) && (SW_UPLOAD_STATUS_IN_PROGRESS == pReceiver->uStatus) )
+      sw_upload_receiver_save_state(pReceiver);
+   if ( NULL != pReceiver->pFile )
+      fclose(pReceiver->pFile);
+   pReceiver->pFile = NULL;
+
+   log_line("[SWUpload] Receiver: closed upload id %u, %u of %u segments received (%u resumed, %u recovered with FEC, %u duplicates), status %d%s.",
+      pReceiver->uUploadId, pReceiver->uSegmentsReceived, pReceiver->uSegmentsCount, pReceiver->uSegmentsResumed,
+      pReceiver->uSegmentsRecoveredWithFEC, pReceiver->uDuplicateSegments, pReceiver->uStatus, bRemoveFiles?", files removed":"");
+   if ( bRemoveFiles )
+   {
+      unlink(pReceiver->szArchiveFile);
+      unlink(pReceiver->szStateFile);
+   }
+   _sw_upload_receiver_free(pReceiver);
+}
+
+int sw_upload_receiver_save_state(t_sw_upload_receiver* pReceiver)
+{
+   if ( (NULL == pReceiver) || (! pReceiver->bActive) || (NULL == pReceiver->pFile) )
+      return 0;
+
+   // The saved state must not reference data still in the stdio buffers
+   if ( 0 != fflush(pReceiver->pFile) )
+      return 0;
+
+   t_sw_upload_state_header header;
+   header.uMagic = SW_UPLOAD_STATE_MAGIC;
+   header.uUploadId = pReceiver->uUploadId;
+   header.uTotalSize = pReceiver->uTotalSize;
+   header.uSegmentSize = (u32)pReceiver->iSegmentSize;
+   header.uSegmentsCount = pReceiver->uSegmentsCount;
+   header.uType = pReceiver->uType;
+   header.uContiguousSegments = pReceiver->uContiguousSegments;
+   header.uRunningCrc = pReceiver->uRunningCrc;
+   header.uSegmentsReceived = pReceiver->uSegmentsReceived;
+
+   char szTmpFile[MAX_FILE_PATH_SIZE+8];
+   snprintf(szTmpFile, sizeof(szTmpFile), "%s.tmp", pReceiver->szStateFile);
+   FILE* fd = fopen(szTmpFile, "wb");
+   if ( NULL == fd )
+      return 0;
+   u32 uBitmapSize = (pReceiver->uSegmentsCount + 7) / 8;
+   int bOk = (1 == fwrite(&header, sizeof(header), 1, fd))?1:0;
+   if ( bOk )
+      bOk = (uBitmapSize == fwrite(pReceiver->pReceivedBitmap, 1, uBitmapSize, fd))?1:0;
+   if ( 0 != fclose(fd) )
+      bOk = 0;
+   if ( (! bOk) || (0 != rename(szTmpFile, pReceiver->szStateFile)) )
+   {
+      unlink(szTmpFile);
+      return 0;
+   }
+   pReceiver->uSegmentsSinceStateSaved = 0;
+   return 1;
+}
+
+static int _sw_upload_receiver_load_state(t_sw_upload_receiver* pReceiver)
+{
+   FILE* fd = fopen(pReceiver->szStateFile, "rb");
+   if ( NULL == fd )
+      return 0;
+   t_sw_upload_state_header header;
+   u32 uBitmapSize = (pReceiver->uSegmentsCount + 7) / 8;
+   int bOk = (1 == fread(&header, sizeof(header), 1, fd))?1:0;
+   if ( bOk )
+   if ( (header.uMagic != SW_UPLOAD_STATE_MAGIC) || (header.uUploadId != pReceiver->uUploadId) ||
+        (header.uTotalSize != pReceiver->uTotalSize) || (header.uSegmentSize != (u32)pReceiver->iSegmentSize) ||
+        (header.uSegmentsCount != pReceiver->uSegmentsCount) || (header.uType != pReceiver->uType) ||
+        (header.uContiguousSegments > pReceiver->uSegmentsCount) || (header.uSegmentsReceived > pReceiver->uSegmentsCount) )
+      bOk = 0;
+   if ( bOk )
+      bOk = (uBitmapSize == fread(pReceiver->pReceivedBitmap, 1, uBitmapSize, fd))?1:0;
+   fclose(fd);
+   if ( ! bOk )
+   {
+      memset(pReceiver->pReceivedBitmap, 0, uBitmapSize);
+      return 0;
+   }
+
+   pReceiver->pFile = fopen(pReceiver->szArchiveFile, "r+b");
+   if ( NULL == pReceiver->pFile )
+   {
+      memset(pReceiver->pReceivedBitmap, 0, uBitmapSize);
+      return 0;
+   }
+   pReceiver->uContiguousSegments = header.uContiguousSegments;
+   pReceiver->uRunningCrc = header.uRunningCrc;
+   pReceiver->uSegmentsReceived = header.uSegmentsReceived;
+   pReceiver->bResumed = 1;
+   pReceiver->uSegmentsResumed = header.uSegmentsReceived;
+   return 1;
+}
+
+static int _sw_upload_receiver_start(t_sw_upload_receiver* pReceiver, const char* szFolder, command_packet_sw_upload_segment* pHeader)
+{
+   if ( pReceiver->bActive )
+      sw_upload_receiver_close(pReceiver, (pReceiver->uUploadId != pHeader->uUploadId)?1:0);
+   _sw_upload_receiver_free(pReceiver);
+
+   pReceiver->uUploadId = pHeader->uUploadId;
+   pReceiver->uTotalSize = pHeader->uTotalSize;
+   pReceiver->iSegmentSize = pHeader->uSegmentSize;
+   pReceiver->uSegmentsCount = (pHeader->uTotalSize + pHeader->uSegmentSize - 1) / pHeader->uSegmentSize;
+   pReceiver->iFECData = pHeader->uFECData;
+   pReceiver->iFECParity = pHeader->uFECParity;
+   if ( pReceiver->iFECData > 0 )
+      pReceiver->uFECGroups = (pReceiver->uSegmentsCount + (u32)pReceiver->iFECData - 1) / (u32)pReceiver->iFECData;
+   pReceiver->uType = pHeader->uType;
+   snprintf(pReceiver->szArchiveFile, sizeof(pReceiver->szArchiveFile), "%s%s", szFolder, (0 == pHeader->uType)?"ruby_update.zip":"ruby_update.tar");
+   snprintf(pReceiver->szStateFile, sizeof(pReceiver->szStateFile), "%s%s", szFolder, "ruby_update.state");
+   pReceiver->uStatus = SW_UPLOAD_STATUS_IN_PROGRESS;
+   pReceiver->bActive = 1;
+
+   u32 uBitmapSize = (pReceiver->uSegmentsCount + 7) / 8;
+   pReceiver->pReceivedBitmap = (u8*) malloc(uBitmapSize);
+   pReceiver->pSegmentBuffer = (u8*) malloc(pReceiver->iSegmentSize);
+   pReceiver->pFECBuffer = (u8*) malloc(((pReceiver->iFECData > 0)?pReceiver->iFECData:1) * pReceiver->iSegmentSize);
+   int bOk = ((NULL != pReceiver->pReceivedBitmap) && (NULL != pReceiver->pSegmentBuffer) && (NULL != pReceiver->pFECBuffer))?1:0;
+   if ( bOk && (pReceiver->uFECGroups > 0) )
+   {
+      pReceiver->pFECSegments = (u8**) malloc(pReceiver->uFECGroups * sizeof(u8*));
+      pReceiver->pFECReceivedMask = (u32*) malloc(pReceiver->uFECGroups * sizeof(u32));
+      if ( (NULL == pReceiver->pFECSegments) || (NULL == pReceiver->pFECReceivedMask) )
+         bOk = 0;
+      else
+      {
+         memset(pReceiver->pFECSegments, 0, pReceiver->uFECGroups * sizeof(u8*));
+         memset(pReceiver->pFECReceivedMask, 0, pReceiver->uFECGroups * sizeof(u32));
+      }
+   }
+   if ( ! bOk )
+   {
+      log_softerror_and_alarm("[SWUpload] Failed to allocate memory for receiving %u segments.", pReceiver->uSegmentsCount);
+      pReceiver->uStatus = SW_UPLOAD_STATUS_FAILED;
+      return 0;
+   }
+   memset(pReceiver->pReceivedBitmap, 0, uBitmapSize);
+
+   if ( _sw_upload_receiver_load_state(pReceiver) )
+   {
+      log_line("[SWUpload] Receiver: resuming upload id %u (%u bytes, %u segments) from saved state: %u segments already received.",
+         pReceiver->uUploadId, pReceiver->uTotalSize, pReceiver->uSegmentsCount, pReceiver->uSegmentsReceived);
+      return 1;
+   }
+
+   unlink(pReceiver->szStateFile);
+   pReceiver->uRunningCrc = 0;
+   pReceiver->pFile = fopen(pReceiver->szArchiveFile, "w+b");
+   if ( NULL == pReceiver->pFile )
+   {
+      log_softerror_and_alarm("[SWUpload] Failed to create the archive file (%s).", pReceiver->szArchiveFile);
+      pReceiver->uStatus = SW_UPLOAD_STATUS_FAILED_DISK_SPACE;
+      return 0;
+   }
+   log_line("[SWUpload] Receiver: started upload id %u (%u bytes, %u segments of %d bytes, FEC %d/%d) to file %s",
+      pReceiver->uUploadId, pReceiver->uTotalSize, pReceiver->uSegmentsCount, pReceiver->iSegmentSize,
+      pReceiver->iFECData, pReceiver->iFECParity, pReceiver->szArchiveFile);
+   return 1;
+}
+
+static int _sw_upload_receiver_read_segment(t_sw_upload_receiver* pReceiver, u32 uSegment, u8* pBuffer, int iLength)
+{
+   if ( 0 != fseek(pReceiver->pFile, (long)uSegment * pReceiver->iSegmentSize, SEEK_SET) )
+      return 0;
+   return ((size_t)iLength == fread(pBuffer, 1, iLength, pReceiver->pFile))?1:0;
+}
+
+// Stores a segment to disk and updates the running CRC over the contiguous received data
+static int _sw_upload_receiver_store_segment(t_sw_upload_receiver* pReceiver, u32 uSegment, u8* pData, int iLength)
+{
+   if ( (0 != fseek(pReceiver->pFile, (long)uSegment * pReceiver->iSegmentSize, SEEK_SET)) ||
+        ((size_t)iLength != fwrite(pData, 1, iLength, pReceiver->pFile)) )
+   {
+      log_softerror_and_alarm("[SWUpload] Failed to write segment %u to the archive file (%s).", uSegment, pReceiver->szArchiveFile);
+      pReceiver->uStatus = SW_UPLOAD_STATUS_FAILED_DISK_SPACE;
+      return -1;
+   }
+   pReceiver->pReceivedBitmap[uSegment/8] |= (1<<(uSegment%8));
+   pReceiver->uSegmentsReceived++;
+   pReceiver->uSegmentsSinceStateSaved++;
+
+   if ( uSegment != pReceiver->uContiguousSegments )
+      return 1;
+
+   pReceiver->uRunningCrc = base_compute_crc32_continue(pReceiver->uRunningCrc, pData, iLength);
+   pReceiver->uContiguousSegments++;
+
+   // Segments received out of order after it are on disk already
+   while ( (pReceiver->uContiguousSegments < pReceiver->uSegmentsCount) && _sw_upload_receiver_is_received(pReceiver, pReceiver->uContiguousSegments) )
+   {
+      u32 uNext = pReceiver->uContiguousSegments;
+      int iNextLength = _sw_upload_get_segment_length(pReceiver->uTotalSize, pReceiver->iSegmentSize, pReceiver->uSegmentsCount, uNext);
+      if ( ! _sw_upload_receiver_read_segment(pReceiver, uNext, pReceiver->pSegmentBuffer, iNextLength) )
+      {
+         log_softerror_and_alarm("[SWUpload] Failed to read back segment %u from the archive file (%s).", uNext, pReceiver->szArchiveFile);
+         pReceiver->uStatus = SW_UPLOAD_STATUS_FAILED;
+         return -1;
+      }
+      pReceiver->uRunningCrc = base_compute_crc32_continue(pReceiver->uRunningCrc, pReceiver->pSegmentBuffer, iNextLength);
+      pReceiver->uContiguousSegments++;
+   }
+   return 1;
+}
+
+static void _sw_upload_receiver_free_fec_group(t_sw_upload_receiver* pReceiver, u32 uGroup)
+{
+   if ( NULL != pReceiver->pFECSegments[uGroup] )
+      free(pReceiver->pFECSegments[uGroup]);
+   pReceiver->pFECSegments[uGroup] = NULL;
+   pReceiver->pFECReceivedMask[uGroup] = 0;
+}
+
+// Recovers the missing data segments of a FEC group once enough FEC segments are received for it
+static int _sw_upload_receiver_try_fec_decode(t_sw_upload_receiver* pReceiver, u32 uGroup)
+{
+   u32 uFirst = uGroup * (u32)pReceiver->iFECData;
+   unsigned int uErased[SW_UPLOAD_MAX_FEC_DATA];
+   unsigned int uFECIndexes[SW_UPLOAD_MAX_FEC_PARITY];
+   u8* pDataBlocks[SW_UPLOAD_MAX_FEC_DATA];
+   u8* pFECBlocks[SW_UPLOAD_MAX_FEC_PARITY];
+   int iCountErased = 0;
+   for( int i=0; i<pReceiver->iFECData; i++ )
+   {
+      if ( (uFirst + (u32)i < pReceiver->uSegmentsCount) && (! _sw_upload_receiver_is_received(pReceiver, uFirst + (u32)i)) )
+         uErased[iCountErased++] = i;
+   }
+   if ( 0 == iCountErased )
+   {
+      _sw_upload_receiver_free_fec_group(pReceiver, uGroup);
+      return 0;
+   }
+   if ( __builtin_popcount(pReceiver->pFECReceivedMask[uGroup]) < iCountErased )
+      return 0;
+
+   int iCountFEC = 0;
+   for( int i=0; (i<pReceiver->iFECParity) && (iCountFEC < iCountErased); i++ )
+   {
+      if ( ! (pReceiver->pFECReceivedMask[uGroup] & (1<<i)) )
+         continue;
+      uFECIndexes[iCountFEC] = i;
+      pFECBlocks[iCountFEC] = pReceiver->pFECSegments[uGroup] + i * pReceiver->iSegmentSize;
+      iCountFEC++;
+   }
+
+   // The FEC encoding used zero padded segments, and zero segments past the end of the data
+   memset(pReceiver->pFECBuffer, 0, pReceiver->iFECData * pReceiver->iSegmentSize);
+   for( int i=0; i<pReceiver->iFECData; i++ )
+   {
+      pDataBlocks[i] = pReceiver->pFECBuffer + i * pReceiver->iSegmentSize;
+      u32 uSegment = uFirst + (u32)i;
+      if ( (uSegment >= pReceiver->uSegmentsCount) || (! _sw_upload_receiver_is_received(pReceiver, uSegment)) )
+         continue;
+      int iLength = _sw_upload_get_segment_length(pReceiver->uTotalSize, pReceiver->iSegmentSize, pReceiver->uSegmentsCount, uSegment);
+      if ( ! _sw_upload_receiver_read_segment(pReceiver, uSegment, pDataBlocks[i], iLength) )
+         return 0;
+   }
+
+   fec_decode(pReceiver->iSegmentSize, pDataBlocks, pReceiver->iFECData, pFECBlocks, uFECIndexes, uErased, (unsigned short)iCountErased);
+   _sw_upload_receiver_free_fec_group(pReceiver, uGroup);
+
+   for( int i=0; i<iCountErased; i++ )
+   {
+      u32 uSegment = uFirst + uErased[i];
+      int iLength = _sw_upload_get_segment_length(pReceiver->uTotalSize, pReceiver->iSegmentSize, pReceiver->uSegmentsCount, uSegment);
+      if ( _sw_upload_receiver_store_segment(pReceiver, uSegment, pDataBlocks[uErased[i]], iLength) < 0 )
+         return -1;
+      pReceiver->uSegmentsRecoveredWithFEC++;
+   }
+   return 1;
+}
+
+int sw_upload_receiver_process_segment(t_sw_upload_receiver* pReceiver, const char* szFolder, u8* pData, int iLength)
+{
+   if ( (NULL == pReceiver) || (NULL == szFolder) || (NULL == pData) || (iLength < (int)sizeof(command_packet_sw_upload_segment)) )
+      return 0;
+
+   command_packet_sw_upload_segment header;
+   memcpy(&header, pData, sizeof(header));
+   u8* pSegmentData = pData + sizeof(header);
+   if ( (int)header.uDataLength != iLength - (int)sizeof(header) )
+      return 0;
+   if ( (0 == header.uTotalSize) || (header.uTotalSize > SW_UPLOAD_MAX_TOTAL_SIZE) )
+      return 0;
+   if ( (header.uSegmentSize < 16) || (header.uSegmentSize > SW_UPLOAD_MAX_SEGMENT_SIZE) )
+      return 0;
+   if ( (header.uFECData > SW_UPLOAD_MAX_FEC_DATA) || (header.uFECParity > SW_UPLOAD_MAX_FEC_PARITY) )
+      return 0;
+   if ( (0 == header.uFECData) != (0 == header.uFECParity) )
+      return 0;
+
+   if ( (! pReceiver->bActive) || (header.uUploadId != pReceiver->uUploadId) || (header.uTotalSize != pReceiver->uTotalSize) ||
+        ((int)header.uSegmentSize != pReceiver->iSegmentSize) || ((int)header.uFECData != pReceiver->iFECData) ||
+        ((int)header.uFECParity != pReceiver->iFECParity) || (header.uType != pReceiver->uType) )
+   if ( ! _sw_upload_receiver_start(pReceiver, szFolder, &header) )
+      return -1;
+
+   if ( SW_UPLOAD_STATUS_IN_PROGRESS != pReceiver->uStatus )
+      return 0;
+
+   int iResult = 1;
+   if ( SW_UPLOAD_PROBE_SEGMENT == header.uSegmentIndex )
+      iResult = 1;
+   else if ( header.uSegmentIndex < pReceiver->uSegmentsCount )
+   {
+      if ( (int)header.uDataLength != _sw_upload_get_segment_length(pReceiver->uTotalSize, pReceiver->iSegmentSize, pReceiver->uSegmentsCount, header.uSegmentIndex) )
+         return 0;
+      if ( _sw_upload_receiver_is_received(pReceiver, header.uSegmentIndex) )
+      {
+         pReceiver->uDuplicateSegments++;
+         iResult = 0;
+      }
+      else
+      {
+         iResult = _sw_upload_receiver_store_segment(pReceiver, header.uSegmentIndex, pSegmentData, header.uDataLength);
+         if ( (iResult > 0) && (pReceiver->uFECGroups > 0) )
+         {
+            u32 uGroup = header.uSegmentIndex / (u32)pReceiver->iFECData;
+            if ( NULL != pReceiver->pFECSegments[uGroup] )
+            if ( _sw_upload_receiver_try_fec_decode(pReceiver, uGroup) < 0 )
+               iResult = -1;
+         }
+      }
+   }
+   else
+   {
+      u32 uFECIndex = header.uSegmentIndex - pReceiver->uSegmentsCount;
+      u32 uGroup = uFECIndex / (u32)((pReceiver->iFECParity > 0)?pReceiver->iFECParity:1);
+      int iParity = (int)(uFECIndex % (u32)((pReceiver->iFECParity > 0)?pReceiver->iFECParity:1));
+      if ( (uGroup >= pReceiver->uFECGroups) || ((int)header.uDataLength != pReceiver->iSegmentSize) )
+         return 0;
+      if ( pReceiver->pFECReceivedMask[uGroup] & (1<<iParity) )
+      {
+         pReceiver->uDuplicateSegments++;
+         iResult = 0;
+      }
+      else
+      {
+         if ( NULL == pReceiver->pFECSegments[uGroup] )
+            pReceiver->pFECSegments[uGroup] = (u8*) malloc(pReceiver->iFECParity * pReceiver->iSegmentSize);
+         if ( NULL == pReceiver->pFECSegments[uGroup] )
+            return 0;
+         memcpy(pReceiver->pFECSegments[uGroup] + iParity * pReceiver->iSegmentSize, pSegmentData, pReceiver->iSegmentSize);
+         pReceiver->pFECReceivedMask[uGroup] |= (1<<iParity);
+         if ( _sw_upload_receiver_try_fec_decode(pReceiver, uGroup) < 0 )
+            iResult = -1;
+      }
+   }
+   if ( iResult < 0 )
+      return -1;
+
+   if ( pReceiver->uContiguousSegments >= pReceiver->uSegmentsCount )
+   {
+      if ( pReceiver->uRunningCrc == pReceiver->uUploadId )
+         pReceiver->uStatus = SW_UPLOAD_STATUS_COMPLETED;
+      else
+         pReceiver->uStatus = SW_UPLOAD_STATUS_FAILED;
+      log_line("[SWUpload] Receiver: received all %u segments (%u resumed, %u recovered with FEC, %u duplicates), archive CRC %u, expected %u: %s",
+         pReceiver->uSegmentsCount, pReceiver->uSegmentsResumed, pReceiver->uSegmentsRecoveredWithFEC, pReceiver->uDuplicateSegments,
+         pReceiver->uRunningCrc, pReceiver->uUploadId, (SW_UPLOAD_STATUS_COMPLETED == pReceiver->uStatus)?"ok":"failed");
+      fclose(pReceiver->pFile);
+      pReceiver->pFile = NULL;
+      unlink(pReceiver->szStateFile);
+      return iResult;
+   }
+
+   if ( pReceiver->uSegmentsSinceStateSaved >= SW_UPLOAD_STATE_SAVE_SEGMENTS )
+      sw_upload_receiver_save_state(pReceiver);
+   return iResult;
+}
+
+void sw_upload_receiver_get_ack(t_sw_upload_receiver* pReceiver, u32 uAckRequestId, t_sw_upload_ack* pAck)
+{
+   if ( NULL == pAck )
+      return;
+   memset(pAck, 0, sizeof(t_sw_upload_ack));
+   pAck->uAckRequestId = uAckRequestId;
+   if ( (NULL == pReceiver) || (! pReceiver->bActive) )
+   {
+      pAck->uStatus = SW_UPLOAD_STATUS_FAILED;
+      return;
+   }
+   pAck->uUploadId = pReceiver->uUploadId;
+   pAck->uSegmentsReceived = pReceiver->uSegmentsReceived;
+   pAck->uContiguousSegments = pReceiver->uContiguousSegments;
+   pAck->uStatus = pReceiver->uStatus;
+   for( u32 k=0; k<SW_UPLOAD_ACK_BITMAP_BYTES*8; k++ )
+   {
+      u32 uSegment = pReceiver->uContiguousSegments + 1 + k;
+      if ( uSegment >= pReceiver->uSegmentsCount )
+         break;
+      if ( _sw_upload_receiver_is_received(pReceiver, uSegment) )
+         pAck->uBitmap[k/8] |= (1<<(k%8));
+   }
+}
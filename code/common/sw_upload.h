@@ -0,0 +1,130 @@
+#pragma once
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/commands.h"
+
+// Windowed, resumable software upload (COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED).
+//
+// Sender (controller): keeps up to iWindowSegments data segments in flight past the first segment not
+// yet acked and asks for a selective ack every SW_UPLOAD_ACK_EVERY_SEGMENTS segments, without waiting
+// for it. Each ack is a snapshot of the receiver state (contiguous segments count + bitmap after it);
+// segments sent before an answered ack request but missing from its ack, or not acked after a retransmission
+// timeout (from the measured round trip time), are sent again. Optionally, after the data segments of each FEC
+// group, iFECParity FEC segments are sent so the receiver can recover lost segments without a round trip.
+//
+// Receiver (vehicle): writes each segment to the archive file at its offset as it arrives, keeps a
+// running CRC32 of the contiguous received data and saves its state (received bitmap, CRC) next to
+// the archive. An interrupted upload of the same archive (same CRC32, the upload id) resumes from it.
+// The upload is complete when all the data is received and the running CRC matches the upload id.
+
+#define SW_UPLOAD_DEFAULT_SEGMENT_SIZE 1100
+#define SW_UPLOAD_MAX_SEGMENT_SIZE 1200
+#define SW_UPLOAD_MAX_TOTAL_SIZE 50000000
+#define SW_UPLOAD_DEFAULT_WINDOW_SEGMENTS 128
+#define SW_UPLOAD_MAX_WINDOW_SEGMENTS (SW_UPLOAD_ACK_BITMAP_BYTES*8)
+#define SW_UPLOAD_ACK_EVERY_SEGMENTS 32
+#define SW_UPLOAD_MAX_FEC_DATA 32
+#define SW_UPLOAD_MAX_FEC_PARITY 16
+#define SW_UPLOAD_MIN_RETRANSMIT_MS 50
+#define SW_UPLOAD_MAX_RETRANSMIT_MS 1000
+#define SW_UPLOAD_ACK_REQUESTS_HISTORY 32
+#define SW_UPLOAD_STATE_SAVE_SEGMENTS 64
+#define SW_UPLOAD_PROBE_SEGMENT MAX_U32 // segment index of a packet with no data that just asks for an ack
+// First vehicle software build that handles COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED
+#define SW_UPLOAD_WINDOWED_MIN_SW_BUILD 255
+
+typedef struct
+{
+   u32 uUploadId;
+   u32 uTotalSize;
+   int iSegmentSize;
+   u32 uSegmentsCount;
+   int iFECData;
+   int iFECParity;
+   u32 uFECGroups;
+   u8 uType;
+   u8* pData; // the archive, owned by the caller
+   int iWindowSegments;
+
+   u8* pSegmentAcked;
+   u32* pSegmentSentSeq; // send sequence number of the last copy sent, 0 if not sent yet
+   u8* pFECSent; // FEC segments sent for each FEC group
+   u32* pFECGroupSentSeq; // send sequence number of the last FEC segment of each FEC group, 0 if not all sent yet
+   u32 uContiguousAcked;
+   u32 uSegmentsAcked;
+   u32 uNextNewSegment;
+   u32 uNextFECGroup;
+   int iCachedFECGroup;
+   u8* pFECCache; // iFECParity segments of iCachedFECGroup
+   u8* pFECDataBuffer; // zero padded data segments of a FEC group
+
+   u32 uAckRequestId;
+   u32 uAckRequestTime[SW_UPLOAD_ACK_REQUESTS_HISTORY];
+   u32 uAckRequestSeq[SW_UPLOAD_ACK_REQUESTS_HISTORY];
+   u32 uLastAckRequestTime;
+   u32 uLastAckRequestSeq;
+   u32 uLastAckId;
+   u32 uAckedRequestSeq; // of the last answered ack request: segments sent up to it and not acked are lost
+   u32 uLastAckTime;
+   int bGotFirstAck;
+   u32 uSmoothedRTTMs;
+   u8 uRemoteStatus;
+
+   u32 uSegmentsSent; // also the send sequence number of the last segment sent
+   u32 uRetransmissions;
+   u32 uFECSegmentsSent;
+   u32 uAcksReceived;
+} t_sw_upload_sender;
+
+typedef struct
+{
+   int bActive;
+   u32 uUploadId;
+   u32 uTotalSize;
+   int iSegmentSize;
+   u32 uSegmentsCount;
+   int iFECData;
+   int iFECParity;
+   u32 uFECGroups;
+   u8 uType;
+   char szArchiveFile[MAX_FILE_PATH_SIZE];
+   char szStateFile[MAX_FILE_PATH_SIZE];
+   FILE* pFile;
+
+   u8* pReceivedBitmap;
+   u32 uSegmentsReceived;
+   u32 uContiguousSegments;
+   u32 uRunningCrc; // of the contiguous segments
+   u8** pFECSegments; // received FEC segments of each FEC group, NULL if none
+   u32* pFECReceivedMask;
+   u8* pFECBuffer; // data segments of a FEC group, for decoding
+   u8* pSegmentBuffer;
+   u8 uStatus;
+   u32 uSegmentsSinceStateSaved;
+
+   int bResumed;
+   u32 uSegmentsResumed;
+   u32 uDuplicateSegments;
+   u32 uSegmentsRecoveredWithFEC;
+} t_sw_upload_receiver;
+
+// pData must stay valid until the sender is released. Returns 0 on invalid parameters or out of memory.
+int sw_upload_sender_init(t_sw_upload_sender* pSender, u8* pData, u32 uSize, u8 uType, int iSegmentSize, int iFECData, int iFECParity, int iWindowSegments);
+void sw_upload_sender_uninit(t_sw_upload_sender* pSender);
+// Builds the next segment to send (a command_packet_sw_upload_segment and its data) in pOutBuffer.
+// Returns its length, or 0 if nothing should be sent now (window full, waiting for an ack).
+int sw_upload_sender_get_next_segment(t_sw_upload_sender* pSender, u32 uTimeNowMs, u8* pOutBuffer, int iMaxLength);
+void sw_upload_sender_on_ack(t_sw_upload_sender* pSender, t_sw_upload_ack* pAck, u32 uTimeNowMs);
+int sw_upload_sender_is_complete(t_sw_upload_sender* pSender);
+int sw_upload_sender_get_progress_percent(t_sw_upload_sender* pSender);
+
+void sw_upload_receiver_init(t_sw_upload_receiver* pReceiver);
+// pData: a command_packet_sw_upload_segment and its data. Starts (or resumes from the state saved in szFolder)
+// the upload of a new archive, then stores the segment. Returns 1 if the segment was used, 0 if it was ignored
+// (invalid or duplicate), -1 on a disk error (the status is SW_UPLOAD_STATUS_FAILED_DISK_SPACE then).
+int sw_upload_receiver_process_segment(t_sw_upload_receiver* pReceiver, const char* szFolder, u8* pData, int iLength);
+void sw_upload_receiver_get_ack(t_sw_upload_receiver* pReceiver, u32 uAckRequestId, t_sw_upload_ack* pAck);
+int sw_upload_receiver_save_state(t_sw_upload_receiver* pReceiver);
+// Keeps the archive and the saved state (to resume later) unless bRemoveFiles is set.
+// A completed archive is kept, only its state is removed.
+void sw_upload_receiver_close(t_sw_upload_receiver* pReceiver, int bRemoveFiles);
@@ -108,6 +108,9 @@ static u32 s_uCountFileSegmentsDownloaded = 0;
 static u32 s_uLastFileSegmentRequestTime = 0;
 static u32 s_uLastTimeDownloadProgress = 0;
 
+static t_sw_upload_ack s_SWUploadLastAck;
+static u32 s_uSWUploadAcksCounter = 0;
+
 Menu* s_pMenuVehicleHWInfo = NULL;
 Menu* s_pMenuUSBInfoVehicle = NULL;
 
@@ -2223,6 +2226,18 @@ void handle_commands_on_response_received(u8* pPacketBuffer, int iLength)
       return;
    }
 
+   // Windowed SW upload acks are not responses to the current command, the upload loop polls them
+   if ( pPHCR->origin_command_type == COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED )
+   {
+      if ( pPH->total_length >= sizeof(t_packet_header) + sizeof(t_packet_header_command_response) + sizeof(t_sw_upload_ack) )
+      if ( pPHCR->command_response_flags & COMMAND_RESPONSE_FLAGS_OK )
+      {
+         memcpy(&s_SWUploadLastAck, pPacketBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_command_response), sizeof(t_sw_upload_ack));
+         s_uSWUploadAcksCounter++;
+      }
+      return;
+   }
+
    // Received a response to an old command? Ignore it
    if ( pPHCR->origin_command_counter != s_CommandCounter )
    {
@@ -2310,6 +2325,13 @@ void handle_commands_on_response_received(u8* pPacketBuffer, int iLength)
       s_bHasCommandInProgress = false;
 }
 
+u32 handle_commands_get_sw_upload_ack(t_sw_upload_ack* pAck)
+{
+   if ( (NULL != pAck) && (0 != s_uSWUploadAcksCounter) )
+      memcpy(pAck, &s_SWUploadLastAck, sizeof(t_sw_upload_ack));
+   return s_uSWUploadAcksCounter;
+}
+
 u32  handle_commands_get_last_command_id_response_received()
 {
    return s_CommandLastProcessedResponseToCommandCounter;
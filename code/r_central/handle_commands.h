@@ -13,6 +13,8 @@ void handle_commands_loop();
 
 void handle_commands_on_response_received(u8* pPacketBuffer, int iLength);
 u32  handle_commands_get_last_command_id_response_received();
+// Returns the count of windowed SW upload acks received so far; copies the last one to pAck
+u32 handle_commands_get_sw_upload_ack(t_sw_upload_ack* pAck);
 bool handle_commands_last_command_succeeded();
 
 u32 handle_commands_increment_command_counter();
@@ -35,6 +35,7 @@
 
 #include "../../base/utils.h"
 #include "../../base/hardware_files.h"
+#include "../../common/sw_upload.h"
 #include "../../radio/radiolink.h"
 #include "../osd/osd_common.h"
 #include "menu.h"
@@ -2202,7 +2203,18 @@ bool Menu::uploadSoftware()
    s_uTimeLastOTACounterChanged = 0;
 
    render_commands_set_custom_status("Uploading software. Please wait.");
-   if ( ! _uploadVehicleUpdate(szArchiveToUpload) )
+   int iUploadResult = -1;
+   if ( get_sw_version_build(g_pCurrentModel) >= SW_UPLOAD_WINDOWED_MIN_SW_BUILD )
+   {
+      iUploadResult = _uploadVehicleUpdateWindowed(szArchiveToUpload);
+      if ( iUploadResult < 0 )
+         log_line("Vehicle does not answer to windowed software upload. Using the 6.3 upload method.");
+   }
+   else
+      log_line("Vehicle software build %u does not support windowed software upload. Using the 6.3 upload method.", get_sw_version_build(g_pCurrentModel));
+   if ( iUploadResult < 0 )
+      iUploadResult = _uploadVehicleUpdate(szArchiveToUpload)?1:0;
+   if ( iUploadResult <= 0 )
    {
       render_commands_set_progress_percent(-1, true);
       ruby_resume_watchdog();
@@ -2473,6 +2485,152 @@ void Menu::selectMenuItemTxPowersValue(MenuItemSelect* pMenuItem, bool bHasAutoO
    }
 }
 
+// Returns 1 on success, 0 on failure, -1 if the vehicle never answered (it does not know the windowed upload)
+int Menu::_uploadVehicleUpdateWindowed(const char* szArchiveToUpload)
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_UPDATES);
+   strcat(szFile, szArchiveToUpload);
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+   {
+      addMessage("There was an error generating the software package.");
+      g_bUpdateInProgress = false;
+      return 0;
+   }
+   fseek(fd, 0, SEEK_END);
+   long lSize = ftell(fd);
+   fseek(fd, 0, SEEK_SET);
+
+   u8* pArchive = NULL;
+   if ( (lSize > 0) && (lSize <= SW_UPLOAD_MAX_TOTAL_SIZE) )
+      pArchive = (u8*) malloc(lSize);
+   if ( (NULL == pArchive) || (lSize != (long)fread(pArchive, 1, lSize, fd)) )
+   {
+      fclose(fd);
+      if ( NULL != pArchive )
+         free(pArchive);
+      addMessage("There was an error generating the upload package.");
+      g_bUpdateInProgress = false;
+      return 0;
+   }
+   fclose(fd);
+
+   t_sw_upload_sender sender;
+   memset(&sender, 0, sizeof(sender));
+   if ( ! sw_upload_sender_init(&sender, pArchive, (u32)lSize, 1, SW_UPLOAD_DEFAULT_SEGMENT_SIZE, 16, 2, SW_UPLOAD_DEFAULT_WINDOW_SEGMENTS) )
+   {
+      free(pArchive);
+      addMessage("There was an error generating the upload package.");
+      g_bUpdateInProgress = false;
+      return 0;
+   }
+
+   log_line("Sending to vehicle the update archive (windowed method): [%s], size: %d bytes, %u segments, upload id: %u",
+      szFile, (int)lSize, sender.uSegmentsCount, sender.uUploadId);
+
+   g_bUpdateInProgress = true;
+   send_control_message_to_router(PACKET_TYPE_LOCAL_CONTROL_UPDATE_STARTED,0);
+
+   g_TimeNow = get_current_timestamp_ms();
+   g_TimeNowMicros = get_current_timestamp_micros();
+   u32 uTimeStart = g_TimeNow;
+   u32 uTimeLastAck = g_TimeNow;
+   u32 uTimeLastRender = 0;
+   u32 uAcksCounter = handle_commands_get_sw_upload_ack(NULL);
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   int iResult = 1;
+
+   while ( ! sw_upload_sender_is_complete(&sender) )
+   {
+      g_TimeNow = get_current_timestamp_ms();
+      g_TimeNowMicros = get_current_timestamp_micros();
+      ruby_signal_alive();
+
+      if ( checkCancelUpload() )
+      {
+         command_packet_sw_upload_segment cancel;
+         memset(&cancel, 0, sizeof(cancel));
+         cancel.uUploadId = sender.uUploadId;
+         cancel.uTotalSize = sender.uTotalSize;
+         cancel.uSegmentIndex = SW_UPLOAD_PROBE_SEGMENT;
+         cancel.uSegmentSize = (u16)sender.iSegmentSize;
+         cancel.uFlags = SW_UPLOAD_FLAG_CANCEL;
+         cancel.uType = sender.uType;
+         for( int i=0; i<5; i++ )
+         {
+            handle_commands_send_single_oneway_command(0, COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED, 0, (u8*)&cancel, sizeof(cancel));
+            hardware_sleep_ms(20);
+         }
+         iResult = 0;
+         break;
+      }
+
+      if ( (! sender.bGotFirstAck) && (g_TimeNow > uTimeStart + 4000) )
+      {
+         iResult = -1;
+         break;
+      }
+      if ( g_TimeNow > uTimeLastAck + 10000 )
+      {
+         // The vehicle keeps the received segments, a new upload of the same archive resumes from them
+         log_softerror_and_alarm("Did not get a confirmation from vehicle about the software upload for 10 seconds.");
+         g_nFailedOTAUpdates++;
+         iResult = 0;
+         break;
+      }
+      if ( SW_UPLOAD_STATUS_IN_PROGRESS != sender.uRemoteStatus )
+      {
+         log_softerror_and_alarm("Vehicle failed to receive the software package (status %d).", sender.uRemoteStatus);
+         if ( SW_UPLOAD_STATUS_FAILED_DISK_SPACE == sender.uRemoteStatus )
+            addMessage("Vehicle failed to store the update. Not enough space on device.");
+         g_nFailedOTAUpdates++;
+         iResult = 0;
+         break;
+      }
+
+      int iLength = sw_upload_sender_get_next_segment(&sender, g_TimeNow, uBuffer, sizeof(uBuffer));
+      if ( iLength > 0 )
+      {
+         handle_commands_send_single_oneway_command(0, COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED, 0, uBuffer, iLength);
+         hardware_sleep_ms(1);
+      }
+      try_read_messages_from_router((iLength > 0)?0:5);
+
+      t_sw_upload_ack ack;
+      u32 uCounter = handle_commands_get_sw_upload_ack(&ack);
+      if ( (uCounter != uAcksCounter) && (ack.uUploadId == sender.uUploadId) )
+      {
+         g_TimeNow = get_current_timestamp_ms();
+         sw_upload_sender_on_ack(&sender, &ack, g_TimeNow);
+         uTimeLastAck = g_TimeNow;
+      }
+      uAcksCounter = uCounter;
+
+      if ( g_TimeNow > (uTimeLastRender+100) )
+      {
+         uTimeLastRender = g_TimeNow;
+         render_commands_set_progress_percent(sw_upload_sender_get_progress_percent(&sender), true);
+         g_pRenderEngine->startFrame();
+         popups_render();
+         render_commands();
+         popups_render_topmost();
+         g_pRenderEngine->endFrame();
+      }
+   }
+
+   log_line("Windowed software upload %s in %u ms: %u segments sent, %u retransmissions, %u FEC segments, %u acks, RTT %u ms",
+      (1 == iResult)?"completed":"stopped", g_TimeNow - uTimeStart, sender.uSegmentsSent, sender.uRetransmissions,
+      sender.uFECSegmentsSent, sender.uAcksReceived, sender.uSmoothedRTTMs);
+
+   sw_upload_sender_uninit(&sender);
+   free(pArchive);
+
+   if ( 0 == iResult )
+      send_control_message_to_router(PACKET_TYPE_LOCAL_CONTROL_UPDATE_STOPED,0);
+   return iResult;
+}
+
 bool Menu::_uploadVehicleUpdate(const char* szArchiveToUpload)
 {
    command_packet_sw_package cpswp_cancel;
@@ -244,6 +244,7 @@ class Menu
      void addUnsupportedMessageOpenIPCSigmaster(const char* szMessage);
      bool uploadSoftware();
      bool _generate_upload_archive(char* szArchiveName);
+     int _uploadVehicleUpdateWindowed(const char* szArchiveToUpload);
      bool _uploadVehicleUpdate(const char* szArchiveToUpload);
      bool checkCancelUpload();
 
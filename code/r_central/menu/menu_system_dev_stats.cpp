@@ -71,6 +71,12 @@ MenuSystemDevStats::MenuSystemDevStats(void)
    m_pItemsSelect[2]->setUseMultiViewLayout();
    m_IndexDevFullRXStats = addMenuItem(m_pItemsSelect[2]);
 
+   m_pItemsSelect[9] = new MenuItemSelect("Show Router Loop Profiler", "Shows the controller router loop sections timings (count, p50, p99, max) for the last second.");
+   m_pItemsSelect[9]->addSelection("Off");
+   m_pItemsSelect[9]->addSelection("On");
+   m_pItemsSelect[9]->setUseMultiViewLayout();
+   m_IndexDevRouterProfiler = addMenuItem(m_pItemsSelect[9]);
+
    m_pItemsSelect[7] = new MenuItemSelect("Show Controller Adaptive Video Info Stats", "");
    m_pItemsSelect[7]->addSelection("Off");
    m_pItemsSelect[7]->addSelection("On");
@@ -123,6 +129,7 @@ void MenuSystemDevStats::valuesToUI()
    m_pItemsSelect[0]->setSelectedIndex(pP->iDebugShowDevVideoStats);
    m_pItemsSelect[1]->setSelectedIndex(pP->iDebugShowDevRadioStats);
    m_pItemsSelect[2]->setSelectedIndex(pP->iDebugShowFullRXStats);
+   m_pItemsSelect[9]->setSelectedIndex(pP->iDebugShowRouterProfiler);
    
    m_pItemsSelect[3]->setSelectedIndex(0);
    if ( g_pCurrentModel->uDeveloperFlags & DEVELOPER_FLAGS_BIT_SEND_BACK_VEHICLE_TX_GAP )
@@ -198,6 +205,13 @@ void MenuSystemDevStats::onSelectItem()
       valuesToUI();
    }
 
+   if ( m_IndexDevRouterProfiler == m_SelectedIndex )
+   {
+      pP->iDebugShowRouterProfiler = m_pItemsSelect[9]->getSelectedIndex();
+      save_Preferences();
+      valuesToUI();
+   }
+
    if ( m_IndexShowControllerAdaptiveInfoStats == m_SelectedIndex )
    {
       osd_parameters_t params;
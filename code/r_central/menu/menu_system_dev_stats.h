@@ -25,4 +25,5 @@ class MenuSystemDevStats: public Menu
       int m_IndexDevVehicleVideoGraphs;
       int m_IndexDevVehicleVideoBitrateHistory;
       int m_IndexShowControllerAdaptiveInfoStats;
+      int m_IndexDevRouterProfiler;
 };
\ No newline at end of file
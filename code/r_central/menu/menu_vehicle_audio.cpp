@@ -58,6 +58,8 @@ MenuVehicleAudio::MenuVehicleAudio(void)
       addMenuItem(new MenuItemText("This vehicle doesn't have any audio capture device. Audio can't be used on this vehicle."));
       m_IndexVolume = -1;
       m_IndexQuality = -1;
+      m_IndexCodec = -1;
+      m_IndexLatency = -1;
       return;
    }
 
@@ -72,6 +74,16 @@ MenuVehicleAudio::MenuVehicleAudio(void)
    m_pItemsSelect[1]->addSelection("Highest");
    m_pItemsSelect[1]->setIsEditable();
    m_IndexQuality = addMenuItem(m_pItemsSelect[1]);
+
+   m_pItemsSelect[2] = new MenuItemSelect("Codec", "PCM sends the raw audio samples. ADPCM compresses the audio 4 times, using less radio bandwidth.");
+   m_pItemsSelect[2]->addSelection("PCM");
+   m_pItemsSelect[2]->addSelection("ADPCM");
+   m_pItemsSelect[2]->setIsEditable();
+   m_IndexCodec = addMenuItem(m_pItemsSelect[2]);
+
+   m_pItemsSlider[1] = new MenuItemSlider("Output Latency (ms)", "How much audio the controller buffers before playing it. Higher values play smoother on bad radio links, lower values have less delay.", 20, MAX_AUDIO_OUTPUT_LATENCY_MS, DEFAULT_AUDIO_OUTPUT_LATENCY_MS, 0.1);
+   m_pItemsSlider[1]->setStep(10);
+   m_IndexLatency = addMenuItem(m_pItemsSlider[1]);
 }
 
 MenuVehicleAudio::~MenuVehicleAudio()
@@ -93,14 +105,24 @@ void MenuVehicleAudio::valuesToUI()
    }
    m_pItemsSlider[0]->setEnabled(false);
    m_pItemsSelect[1]->setEnabled(false);
+   m_pItemsSelect[2]->setEnabled(false);
+   m_pItemsSlider[1]->setEnabled(false);
    if ( g_pCurrentModel->audio_params.enabled )
    {
       m_pItemsSlider[0]->setEnabled(true);
       m_pItemsSelect[1]->setEnabled(true);
+      m_pItemsSelect[2]->setEnabled(true);
+      m_pItemsSlider[1]->setEnabled(true);
    }
 
    m_pItemsSlider[0]->setCurrentValue(g_pCurrentModel->audio_params.volume);
    m_pItemsSelect[1]->setSelectedIndex(g_pCurrentModel->audio_params.quality);
+   m_pItemsSelect[2]->setSelectedIndex((g_pCurrentModel->audio_params.flags & AUDIO_FLAGS_CODEC_ADPCM)?1:0);
+
+   int iLatencyMs = 10 * ((g_pCurrentModel->audio_params.flags >> 24) & 0xFF);
+   if ( 0 == iLatencyMs )
+      iLatencyMs = DEFAULT_AUDIO_OUTPUT_LATENCY_MS;
+   m_pItemsSlider[1]->setCurrentValue(iLatencyMs);
 }
 
 void MenuVehicleAudio::Render()
@@ -122,9 +144,17 @@ void MenuVehicleAudio::sendParams()
    params.volume = m_pItemsSlider[0]->getCurrentValue();
    params.quality = m_pItemsSelect[1]->getSelectedIndex();
 
+   // Byte 2: codec flags, byte 3: controller output latency in 10 ms units
+   params.flags &= ~AUDIO_FLAGS_CODEC_ADPCM;
+   if ( 1 == m_pItemsSelect[2]->getSelectedIndex() )
+      params.flags |= AUDIO_FLAGS_CODEC_ADPCM;
+   params.flags &= 0x00FFFFFF;
+   params.flags |= ((u32)((m_pItemsSlider[1]->getCurrentValue()/10) & 0xFF)) << 24;
+
    if ( params.enabled == g_pCurrentModel->audio_params.enabled )
    if ( params.volume == g_pCurrentModel->audio_params.volume )
    if ( params.quality == g_pCurrentModel->audio_params.quality )
+   if ( params.flags == g_pCurrentModel->audio_params.flags )
       return;
 
    if ( ! handle_commands_send_to_vehicle(COMMAND_ID_SET_AUDIO_PARAMS, 0, (u8*)&params, sizeof(audio_parameters_t)) )
@@ -157,4 +187,14 @@ void MenuVehicleAudio::onSelectItem()
       sendParams();
       return;
    }
+   if ( m_IndexCodec == m_SelectedIndex && ! m_pMenuItems[m_SelectedIndex]->isEditing() )
+   {
+      sendParams();
+      return;
+   }
+   if ( m_IndexLatency == m_SelectedIndex && ! m_pMenuItems[m_SelectedIndex]->isEditing() )
+   {
+      sendParams();
+      return;
+   }
 }
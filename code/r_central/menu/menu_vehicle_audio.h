@@ -22,4 +22,6 @@ class MenuVehicleAudio: public Menu
       int m_IndexEnable;
       int m_IndexVolume;
       int m_IndexQuality;
+      int m_IndexCodec;
+      int m_IndexLatency;
 };
\ No newline at end of file
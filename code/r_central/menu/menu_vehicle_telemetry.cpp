@@ -125,6 +125,12 @@ MenuVehicleTelemetry::MenuVehicleTelemetry(void)
    m_pItemsSelect[4]->setIsEditable();
    m_IndexTelemetryRequestStreams = addMenuItem(m_pItemsSelect[4]);
 
+   m_pItemsSelect[12] = new MenuItemSelect("Compress Telemetry", "Vehicle sends only the changes of the telemetry data between periodic full updates. Uses less radio bandwidth. Serial radio links always get the full telemetry.");
+   m_pItemsSelect[12]->addSelection("No");
+   m_pItemsSelect[12]->addSelection("Yes");
+   m_pItemsSelect[12]->setIsEditable();
+   m_IndexTelemetryDeltaEncoding = addMenuItem(m_pItemsSelect[12]);
+
    m_pItemsRange[0] = new MenuItemRange("Controller MAVLink SysId", "Sets the MAVLink SysId for Ruby controller as it will be seen by the vehicle flight controller.", 1, 255, g_pCurrentModel->telemetry_params.controller_mavlink_id, 1 );  
    m_pItemsRange[0]->setSufix("");
    m_IndexTelemetryControllerSysId = addMenuItem(m_pItemsRange[0]);
@@ -279,6 +285,8 @@ void MenuVehicleTelemetry::valuesToUI()
    if ( g_pCurrentModel->telemetry_params.flags & TELEMETRY_FLAGS_REQUEST_DATA_STREAMS )
       m_pItemsSelect[4]->setSelection(1);
 
+   m_pItemsSelect[12]->setSelection((g_pCurrentModel->telemetry_params.flags & TELEMETRY_FLAGS_DISABLE_DELTA_ENCODING)?0:1);
+
    if ( -1 != m_IndexDataRate )
    {
       //m_pItemsSelect[6]->setSelection(0);
@@ -514,6 +522,20 @@ void MenuVehicleTelemetry::onSelectItem()
          valuesToUI();
    }
 
+   if ( m_IndexTelemetryDeltaEncoding == m_SelectedIndex )
+   {
+      telemetry_parameters_t params;
+      memcpy(&params, &g_pCurrentModel->telemetry_params, sizeof(telemetry_parameters_t));
+   
+      if ( 0 == m_pItemsSelect[12]->getSelectedIndex() )
+         params.flags |= TELEMETRY_FLAGS_DISABLE_DELTA_ENCODING;
+      else
+         params.flags &= (~TELEMETRY_FLAGS_DISABLE_DELTA_ENCODING);
+  
+      if ( ! handle_commands_send_to_vehicle(COMMAND_ID_SET_TELEMETRY_PARAMETERS, 0, (u8*)&params, sizeof(telemetry_parameters_t)) )
+         valuesToUI();
+   }
+
    if ( m_IndexTelemetryRequestStreams == m_SelectedIndex )
    {
       telemetry_parameters_t params;
@@ -22,6 +22,7 @@ class MenuVehicleTelemetry: public Menu
       int m_IndexTelemetryAnySystem;
       int m_IndexTelemetryNoFCMessages;
       int m_IndexTelemetryRequestStreams;
+      int m_IndexTelemetryDeltaEncoding;
       int m_IndexTelemetryControllerSysId;
       int m_IndexAlwaysArmed;
       int m_IndexInfoSysId;
@@ -3989,7 +3989,7 @@ void osd_render_stats_panels()
    if ( s_fOSDStatsMarginVTop < 0.01 )
       s_fOSDStatsMarginVTop = 0.01;
    
-   // Max id used: 19
+   // Max id used: 20
 
    if ( pModel->osd_params.osd_flags3[osd_get_current_layout_index()] & OSD_FLAG3_SHOW_RADIO_RX_HISTORY_CONTROLLER )
    {
@@ -4007,6 +4007,15 @@ void osd_render_stats_panels()
       s_iCountOSDStatsBoundingBoxes++;
    }
 
+   if ( pModel->bDeveloperMode || s_bDebugStatsShowAll )
+   if ( p->iDebugShowRouterProfiler )
+   {
+      s_iOSDStatsBoundingBoxesIds[s_iCountOSDStatsBoundingBoxes] = 20;
+      s_iOSDStatsBoundingBoxesW[s_iCountOSDStatsBoundingBoxes] = osd_render_stats_router_profiler_get_width();
+      s_iOSDStatsBoundingBoxesH[s_iCountOSDStatsBoundingBoxes] = osd_render_stats_router_profiler_get_height();
+      s_iCountOSDStatsBoundingBoxes++;
+   }
+
    if ( pModel->bDeveloperMode || s_bDebugStatsShowAll )
    if ( pModel->osd_params.osd_flags3[osd_get_current_layout_index()] & OSD_FLAG3_SHOW_CONTROLLER_ADAPTIVE_VIDEO_INFO )
    if ( NULL != g_pSM_RouterVehiclesRuntimeInfo )
@@ -4232,6 +4241,9 @@ void osd_render_stats_panels()
          osd_render_stats_radio_rx_history(s_iOSDStatsBoundingBoxesX[i], s_iOSDStatsBoundingBoxesY[i], false);
       if ( s_iOSDStatsBoundingBoxesIds[i] == 18 )
          osd_render_stats_radio_rx_history(s_iOSDStatsBoundingBoxesX[i], s_iOSDStatsBoundingBoxesY[i], true);
+
+      if ( s_iOSDStatsBoundingBoxesIds[i] == 20 )
+         osd_render_stats_router_profiler(s_iOSDStatsBoundingBoxesX[i], s_iOSDStatsBoundingBoxesY[i]);
       
       //char szBuff[32];
       //sprintf(szBuff, "%d", i);
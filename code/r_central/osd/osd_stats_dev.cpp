@@ -32,6 +32,8 @@
 #include "../../base/base.h"
 #include "../../base/utils.h"
 #include "../../common/string_utils.h"
+#include "../../base/shared_mem.h"
+#include "../../base/profiler.h"
 #include <math.h>
 #include "osd_stats_dev.h"
 #include "osd_common.h"
@@ -2407,3 +2409,132 @@ float osd_render_stats_dev_adaptive_video_info(float xPos, float yPos, float fWi
    osd_set_colors();
    return osd_render_stats_dev_adaptive_video_get_height();
 }
+
+static shared_mem_profiler* s_pOSDRouterProfiler = NULL;
+static int s_iOSDRouterProfilerProcessId = 0;
+static u32 s_uOSDRouterProfilerTimeLastOpen = 0;
+static u32 s_uOSDRouterProfilerTimeLastSnapshot = 0;
+static t_profiler_histogram s_OSDRouterProfilerLast[PROFILER_SECTIONS_COUNT];
+static t_profiler_histogram s_OSDRouterProfilerWindow[PROFILER_SECTIONS_COUNT];
+
+// The router histograms are cumulative: keep the difference between snapshots taken one second apart
+static void _osd_router_profiler_update()
+{
+   if ( NULL == s_pOSDRouterProfiler )
+   {
+      if ( (0 != s_uOSDRouterProfilerTimeLastOpen) && (g_TimeNow < s_uOSDRouterProfilerTimeLastOpen + 5000) )
+         return;
+      s_uOSDRouterProfilerTimeLastOpen = g_TimeNow;
+      s_pOSDRouterProfiler = shared_mem_profiler_open_for_read(SHARED_MEM_PROFILER_ROUTER_RX);
+      s_iOSDRouterProfilerProcessId = 0;
+      if ( NULL == s_pOSDRouterProfiler )
+         return;
+   }
+   if ( PROFILER_SHARED_MEM_VERSION != s_pOSDRouterProfiler->uVersion )
+      return;
+   if ( g_TimeNow < s_uOSDRouterProfilerTimeLastSnapshot + 1000 )
+      return;
+   s_uOSDRouterProfilerTimeLastSnapshot = g_TimeNow;
+
+   bool bRestarted = (s_iOSDRouterProfilerProcessId != s_pOSDRouterProfiler->iProcessId);
+   s_iOSDRouterProfilerProcessId = s_pOSDRouterProfiler->iProcessId;
+
+   for( int i=0; i<PROFILER_SECTIONS_COUNT; i++ )
+   {
+      t_profiler_histogram hist;
+      profiler_get_section_histogram(s_pOSDRouterProfiler, i, &hist);
+      t_profiler_histogram* pWindow = &s_OSDRouterProfilerWindow[i];
+      t_profiler_histogram* pLast = &s_OSDRouterProfilerLast[i];
+      if ( bRestarted || (hist.uCount < pLast->uCount) )
+         memset(pLast, 0, sizeof(t_profiler_histogram));
+      pWindow->uCount = hist.uCount - pLast->uCount;
+      pWindow->uTotalMicros = hist.uTotalMicros - pLast->uTotalMicros;
+      pWindow->uMaxMicros = hist.uMaxMicros;
+      for( int k=0; k<PROFILER_HISTOGRAM_BUCKETS; k++ )
+         pWindow->uBuckets[k] = hist.uBuckets[k] - pLast->uBuckets[k];
+      memcpy(pLast, &hist, sizeof(t_profiler_histogram));
+   }
+}
+
+float osd_render_stats_router_profiler_get_height()
+{
+   float height_text = g_pRenderEngine->textHeight(s_idFontStats);
+   float height = 2.0 *s_fOSDStatsMargin*1.1 + 0.9*height_text*s_OSDStatsLineSpacing;
+
+   if ( (NULL == s_pOSDRouterProfiler) || (PROFILER_SHARED_MEM_VERSION != s_pOSDRouterProfiler->uVersion) )
+   {
+      height += height_text*s_OSDStatsLineSpacing;
+      return height;
+   }
+   height += (1 + PROFILER_SECTIONS_COUNT)*height_text*s_OSDStatsLineSpacing;
+   return height;
+}
+
+float osd_render_stats_router_profiler_get_width()
+{
+   if ( g_fOSDStatsForcePanelWidth > 0.01 )
+      return g_fOSDStatsForcePanelWidth;
+   float width = g_pRenderEngine->textWidth(s_idFontStats, "AAAAAAAAAAAAAAAA 00000 00000 00000 00000");
+   width += 2.0*s_fOSDStatsMargin/g_pRenderEngine->getAspectRatio();
+   return width;
+}
+
+void osd_render_stats_router_profiler(float xPos, float yPos)
+{
+   _osd_router_profiler_update();
+
+   float height_text = g_pRenderEngine->textHeight(s_idFontStats);
+   float width = osd_render_stats_router_profiler_get_width();
+   float height = osd_render_stats_router_profiler_get_height();
+
+   char szBuff[64];
+
+   osd_set_colors_background_fill(g_fOSDStatsBgTransparency);
+   g_pRenderEngine->drawRoundRect(xPos, yPos, width, height, 1.5*POPUP_ROUND_MARGIN);
+   osd_set_colors();
+   g_pRenderEngine->setColors(get_Color_Dev());
+
+   xPos += s_fOSDStatsMargin/g_pRenderEngine->getAspectRatio();
+   yPos += s_fOSDStatsMargin*0.7;
+   width -= 2*s_fOSDStatsMargin/g_pRenderEngine->getAspectRatio();
+   float rightMargin = xPos + width;
+   float fColumnWidth = g_pRenderEngine->textWidth(s_idFontStats, " 00000");
+
+   g_pRenderEngine->drawText(xPos, yPos, s_idFontStats, "Router Loop Profiler (last second)");
+   float y = yPos + height_text*1.3*s_OSDStatsLineSpacing;
+
+   if ( (NULL == s_pOSDRouterProfiler) || (PROFILER_SHARED_MEM_VERSION != s_pOSDRouterProfiler->uVersion) )
+   {
+      g_pRenderEngine->drawText(xPos, y, s_idFontStats, "No Info Available");
+      osd_set_colors();
+      return;
+   }
+
+   g_pRenderEngine->drawText(xPos, y, s_idFontStats, "Section (us)");
+   g_pRenderEngine->drawTextLeft(rightMargin - 3.0*fColumnWidth, y, s_idFontStats, "Count");
+   g_pRenderEngine->drawTextLeft(rightMargin - 2.0*fColumnWidth, y, s_idFontStats, "P50");
+   g_pRenderEngine->drawTextLeft(rightMargin - fColumnWidth, y, s_idFontStats, "P99");
+   g_pRenderEngine->drawTextLeft(rightMargin, y, s_idFontStats, "Max");
+   y += height_text*s_OSDStatsLineSpacing;
+
+   for( int i=0; i<PROFILER_SECTIONS_COUNT; i++ )
+   {
+      t_profiler_histogram* pHist = &s_OSDRouterProfilerWindow[i];
+      g_pRenderEngine->drawText(xPos, y, s_idFontStats, profiler_get_section_name(i));
+      sprintf(szBuff, "%u", pHist->uCount);
+      g_pRenderEngine->drawTextLeft(rightMargin - 3.0*fColumnWidth, y, s_idFontStats, szBuff);
+      if ( 0 == pHist->uCount )
+         strcpy(szBuff, "-");
+      else
+         sprintf(szBuff, "%u", profiler_get_histogram_percentile(pHist, 50));
+      g_pRenderEngine->drawTextLeft(rightMargin - 2.0*fColumnWidth, y, s_idFontStats, szBuff);
+      if ( 0 != pHist->uCount )
+         sprintf(szBuff, "%u", profiler_get_histogram_percentile(pHist, 99));
+      g_pRenderEngine->drawTextLeft(rightMargin - fColumnWidth, y, s_idFontStats, szBuff);
+      if ( 0 != pHist->uCount )
+         sprintf(szBuff, "%u", profiler_get_histogram_percentile(pHist, 100));
+      g_pRenderEngine->drawTextLeft(rightMargin, y, s_idFontStats, szBuff);
+      y += height_text*s_OSDStatsLineSpacing;
+   }
+   osd_set_colors();
+}
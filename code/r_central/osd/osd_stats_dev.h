@@ -24,3 +24,7 @@ void  osd_render_stats_graphs_vehicle_tx_gap(float xPos, float yPos);
 
 float osd_render_stats_dev_adaptive_video_get_height();
 float osd_render_stats_dev_adaptive_video_info(float xPos, float yPos, float fWidth);
+
+float osd_render_stats_router_profiler_get_height();
+float osd_render_stats_router_profiler_get_width();
+void  osd_render_stats_router_profiler(float xPos, float yPos);
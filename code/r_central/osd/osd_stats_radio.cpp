@@ -180,6 +180,14 @@ void osd_render_stats_full_rx_port()
       g_pRenderEngine->drawTextLeft(xPos + widthCol - 2.0*padding, y, fontId, szBuff);
       y += lineHeight;
 
+      g_pRenderEngine->drawText(xPos, y, fontId, "Rx Diversity Score:");
+      if ( g_SM_RadioStats.radio_interfaces_local[i].iDiversityScore < 0 )
+         strcpy(szBuff, "N/A");
+      else
+         sprintf(szBuff, "%d (%u rescued)", g_SM_RadioStats.radio_interfaces_local[i].iDiversityScore, g_SM_RadioStats.radio_interfaces_local[i].uDiversityRescuedPackets);
+      g_pRenderEngine->drawTextLeft(xPos + widthCol - 2.0*padding, y, fontId, szBuff);
+      y += lineHeight;
+
       if ( iRadioLinkId >= 0 )
       {
          sprintf(szBuff, "TX Time/Sec (link %d):", iRadioLinkId+1);
@@ -0,0 +1,211 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "i2c_scheduler.h"
+
+typedef struct
+{
+   t_i2c_task_function pFunction;
+   void* pContext;
+   int iPriority;
+   u32 uPeriodMs;
+   u32 uDeadlineMs;
+   u32 uNextDueTime;
+   t_i2c_device_read_stats stats;
+} t_i2c_scheduler_task;
+
+static t_i2c_scheduler_task s_I2CSchedulerTasks[I2C_SCHEDULER_MAX_TASKS];
+static int s_iI2CSchedulerTasksCount = 0;
+
+void i2c_scheduler_reset()
+{
+   s_iI2CSchedulerTasksCount = 0;
+   memset(s_I2CSchedulerTasks, 0, sizeof(s_I2CSchedulerTasks));
+}
+
+int i2c_scheduler_add_task(const char* szName, u8 uI2CAddress, int iPriority, u32 uPeriodMs, u32 uDeadlineMs, t_i2c_task_function pFunction, void* pContext)
+{
+   if ( (NULL == pFunction) || (0 == uPeriodMs) )
+      return -1;
+   if ( s_iI2CSchedulerTasksCount >= I2C_SCHEDULER_MAX_TASKS )
+   {
+      log_softerror_and_alarm("[I2CScheduler] Can't add task (%s), too many tasks (%d).", (NULL != szName)?szName:"N/A", s_iI2CSchedulerTasksCount);
+      return -1;
+   }
+
+   t_i2c_scheduler_task* pTask = &s_I2CSchedulerTasks[s_iI2CSchedulerTasksCount];
+   memset(pTask, 0, sizeof(t_i2c_scheduler_task));
+   pTask->pFunction = pFunction;
+   pTask->pContext = pContext;
+   pTask->iPriority = iPriority;
+   pTask->uPeriodMs = uPeriodMs;
+   pTask->uDeadlineMs = uDeadlineMs;
+   if ( 0 == pTask->uDeadlineMs )
+      pTask->uDeadlineMs = uPeriodMs;
+   pTask->uNextDueTime = get_current_timestamp_ms();
+
+   if ( NULL != szName )
+      strncpy(pTask->stats.szName, szName, sizeof(pTask->stats.szName)-1);
+   pTask->stats.uI2CAddress = uI2CAddress;
+   pTask->stats.uPriority = (u8)iPriority;
+   pTask->stats.uPeriodMs = (u16)uPeriodMs;
+
+   log_line("[I2CScheduler] Added task %d: %s, I2C address 0x%02X, priority %d, period %u ms, deadline %u ms",
+      s_iI2CSchedulerTasksCount, pTask->stats.szName, uI2CAddress, iPriority, uPeriodMs, pTask->uDeadlineMs);
+   s_iI2CSchedulerTasksCount++;
+   return s_iI2CSchedulerTasksCount-1;
+}
+
+int i2c_scheduler_get_tasks_count()
+{
+   return s_iI2CSchedulerTasksCount;
+}
+
+static int _i2c_scheduler_is_due(t_i2c_scheduler_task* pTask, u32 uTimeNow)
+{
+   return ((int)(uTimeNow - pTask->uNextDueTime) >= 0)?1:0;
+}
+
+static void _i2c_scheduler_run_task(t_i2c_scheduler_task* pTask, u32 uTimeNow)
+{
+   u32 uDueTime = pTask->uNextDueTime;
+   u32 uScheduleDelayMicros = (uTimeNow - uDueTime) * 1000;
+   if ( uScheduleDelayMicros > pTask->stats.uMaxScheduleDelayMicros )
+      pTask->stats.uMaxScheduleDelayMicros = uScheduleDelayMicros;
+
+   u32 uTimeStartMicros = get_current_timestamp_micros();
+   int iResult = (*(pTask->pFunction))(uTimeNow, pTask->pContext);
+   u32 uLatencyMicros = get_current_timestamp_micros() - uTimeStartMicros;
+
+   pTask->stats.uReadsCount++;
+   if ( ! iResult )
+      pTask->stats.uReadsFailed++;
+   pTask->stats.uLastReadLatencyMicros = uLatencyMicros;
+   if ( uLatencyMicros > pTask->stats.uMaxReadLatencyMicros )
+      pTask->stats.uMaxReadLatencyMicros = uLatencyMicros;
+   if ( 1 == pTask->stats.uReadsCount )
+      pTask->stats.uAvgReadLatencyMicros = uLatencyMicros;
+   else
+      pTask->stats.uAvgReadLatencyMicros = (pTask->stats.uAvgReadLatencyMicros*7 + uLatencyMicros)/8;
+
+   if ( uScheduleDelayMicros + uLatencyMicros > pTask->uDeadlineMs * 1000 )
+      pTask->stats.uDeadlineMisses++;
+
+   // Keep the period phase; if we fell behind, do not try to catch up with a burst of reads
+   pTask->uNextDueTime = uDueTime + pTask->uPeriodMs;
+   if ( _i2c_scheduler_is_due(pTask, uTimeNow) )
+      pTask->uNextDueTime = uTimeNow + pTask->uPeriodMs;
+}
+
+int i2c_scheduler_run(u32 uTimeNow)
+{
+   u32 uRunMask = 0;
+   int iCountRun = 0;
+
+   while ( iCountRun < s_iI2CSchedulerTasksCount )
+   {
+      // Pick the most urgent due task: highest priority first, then earliest due time
+      int iBest = -1;
+      for( int i=0; i<s_iI2CSchedulerTasksCount; i++ )
+      {
+         if ( uRunMask & (1<<i) )
+            continue;
+         if ( ! _i2c_scheduler_is_due(&s_I2CSchedulerTasks[i], uTimeNow) )
+            continue;
+         if ( -1 == iBest )
+         {
+            iBest = i;
+            continue;
+         }
+         if ( s_I2CSchedulerTasks[i].iPriority < s_I2CSchedulerTasks[iBest].iPriority )
+            iBest = i;
+         else if ( s_I2CSchedulerTasks[i].iPriority == s_I2CSchedulerTasks[iBest].iPriority )
+         if ( (int)(s_I2CSchedulerTasks[i].uNextDueTime - s_I2CSchedulerTasks[iBest].uNextDueTime) < 0 )
+            iBest = i;
+      }
+      if ( -1 == iBest )
+         break;
+
+      _i2c_scheduler_run_task(&s_I2CSchedulerTasks[iBest], uTimeNow);
+      uRunMask |= (1<<iBest);
+      iCountRun++;
+
+      // Reads take time; re-evaluate what is due now, so a higher priority task that became due meanwhile goes next
+      uTimeNow = get_current_timestamp_ms();
+   }
+   return iCountRun;
+}
+
+u32 i2c_scheduler_get_wait_time_ms(u32 uTimeNow)
+{
+   u32 uWait = 100;
+   for( int i=0; i<s_iI2CSchedulerTasksCount; i++ )
+   {
+      if ( _i2c_scheduler_is_due(&s_I2CSchedulerTasks[i], uTimeNow) )
+         return 0;
+      u32 uDelta = s_I2CSchedulerTasks[i].uNextDueTime - uTimeNow;
+      if ( uDelta < uWait )
+         uWait = uDelta;
+   }
+   return uWait;
+}
+
+t_i2c_device_read_stats* i2c_scheduler_get_task_stats(int iTaskIndex)
+{
+   if ( (iTaskIndex < 0) || (iTaskIndex >= s_iI2CSchedulerTasksCount) )
+      return NULL;
+   return &(s_I2CSchedulerTasks[iTaskIndex].stats);
+}
+
+void i2c_scheduler_reset_stats()
+{
+   for( int i=0; i<s_iI2CSchedulerTasksCount; i++ )
+   {
+      t_i2c_device_read_stats* pStats = &(s_I2CSchedulerTasks[i].stats);
+      pStats->uReadsCount = 0;
+      pStats->uReadsFailed = 0;
+      pStats->uDeadlineMisses = 0;
+      pStats->uLastReadLatencyMicros = 0;
+      pStats->uAvgReadLatencyMicros = 0;
+      pStats->uMaxReadLatencyMicros = 0;
+      pStats->uMaxScheduleDelayMicros = 0;
+   }
+}
+
+void i2c_scheduler_publish_stats(t_shared_mem_i2c_devices_read_stats* pSMStats, u32 uTimeNow)
+{
+   if ( NULL == pSMStats )
+      return;
+   for( int i=0; i<s_iI2CSchedulerTasksCount; i++ )
+      memcpy(&(pSMStats->devices[i]), &(s_I2CSchedulerTasks[i].stats), sizeof(t_i2c_device_read_stats));
+   pSMStats->uDevicesCount = s_iI2CSchedulerTasksCount;
+   pSMStats->uLastUpdateTime = uTimeNow;
+}
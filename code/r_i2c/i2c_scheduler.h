@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/shared_mem_i2c.h"
+
+// Deadline based scheduler for the periodic I2C device reads.
+// Each device read is a task with a priority, a period and a deadline. When several tasks are due,
+// the one with the highest priority (lowest value) runs first, so RC input reads are never queued
+// behind slow housekeeping reads (i.e. current sensor).
+
+#define I2C_SCHEDULER_MAX_TASKS MAX_I2C_READ_STATS_DEVICES
+
+#define I2C_TASK_PRIORITY_RC_INPUT 0
+#define I2C_TASK_PRIORITY_USER_INPUT 1
+#define I2C_TASK_PRIORITY_HOUSEKEEPING 2
+
+// Returns 1 if the device read succeeded, 0 otherwise
+typedef int (*t_i2c_task_function)(u32 uTimeNow, void* pContext);
+
+void i2c_scheduler_reset();
+// Returns the task index or -1 on error
+int i2c_scheduler_add_task(const char* szName, u8 uI2CAddress, int iPriority, u32 uPeriodMs, u32 uDeadlineMs, t_i2c_task_function pFunction, void* pContext);
+int i2c_scheduler_get_tasks_count();
+
+// Runs the tasks that are due, most urgent first, each one at most once.
+// Returns the number of tasks that run.
+int i2c_scheduler_run(u32 uTimeNow);
+
+// Returns how many miliseconds until the next task is due (0 if a task is due now)
+u32 i2c_scheduler_get_wait_time_ms(u32 uTimeNow);
+
+t_i2c_device_read_stats* i2c_scheduler_get_task_stats(int iTaskIndex);
+void i2c_scheduler_reset_stats();
+void i2c_scheduler_publish_stats(t_shared_mem_i2c_devices_read_stats* pSMStats, u32 uTimeNow);
@@ -37,7 +37,9 @@
 #include "../base/ctrl_interfaces.h"
 #include "../base/ctrl_settings.h"
 #include "../base/shared_mem_i2c.h"
+#include "../base/hardware_i2c_bus.h"
 #include "ruby_i2c.h"
+#include "i2c_scheduler.h"
 
 #include <time.h>
 #include <sys/resource.h>
@@ -50,12 +52,9 @@
 bool g_bQuit = false;
 u32 g_TimeNow = 0;
 u32 g_TimeLastReloadCheck = 0;
-u32 g_TimeLastINARead = 0;
-u32 g_TimeLastRCInRead = 0;
 u32 g_TimeLastRCInFrameChange = 0;
 u32 g_TimeLastRCInReadFull = 0;
-
-u32 g_SleepTime = 50;
+u32 g_TimeLastStatsPublish = 0;
 
 bool g_bHasINA = false;
 int g_nINAAddress = 0;
@@ -76,10 +75,13 @@ t_i2c_device_settings* g_pListExternalDevices[MAX_I2C_DEVICES];
 
 u32 g_uListExternalDevicesFlags[MAX_I2C_DEVICES];
 bool g_bListExternalDevicesSetupCorrectly[MAX_I2C_DEVICES];
+bool g_bListExternalDevicesCombinedTransfers[MAX_I2C_DEVICES];
+int g_iListExternalDevicesCombinedTransfersFailures[MAX_I2C_DEVICES];
 
 t_shared_mem_i2c_current* g_pSMCurrent = NULL;
 t_shared_mem_i2c_controller_rc_in* g_pSMRCIn = NULL;
 t_shared_mem_i2c_rotary_encoder_buttons_events* g_pSMRotaryEncoderButtonsEvents = NULL;
+t_shared_mem_i2c_devices_read_stats* g_pSMDevicesReadStats = NULL;
 
 u16 s_lastRCReadVals[I2C_DEVICE_PARAM_MAX_CHANNELS];
 u8 s_uLastFrameNumber = 0;
@@ -106,7 +108,10 @@ void close_files()
          g_nListFilesExternalDevices[i] = -1;
       }
       g_bListExternalDevicesSetupCorrectly[i] = false;
+      g_bListExternalDevicesCombinedTransfers[i] = true;
+      g_iListExternalDevicesCombinedTransfersFailures[i] = 0;
    }
+   i2c_scheduler_reset();
 }
 
 void _init_INA()
@@ -158,6 +163,69 @@ void _init_INA()
 #endif
 }
 
+// Commands that only read the device state can be sent again. The others change it (reading the
+// rotary encoder or buttons events clears them, setting the RC flags reconfigures the device).
+static bool _external_device_command_can_resend(u8* pCommand, int iCommandLength)
+{
+   if ( iCommandLength < 2 )
+      return false;
+   if ( (pCommand[1] == I2C_COMMAND_ID_GET_FLAGS) || (pCommand[1] == I2C_COMMAND_ID_RC_GET_CHANNELS) )
+      return true;
+   return false;
+}
+
+// Sends a command to an external I2C device (Ruby I2C protocol) and reads the response, checking the response CRC (last byte).
+// Uses a single combined write/read transaction. If it fails, only read only commands are sent again
+// using byte transfers; state changing commands are never sent twice, so events are not lost or duplicated.
+// Devices that repeatedly fail to answer to combined transactions are switched to byte by byte transfers.
+// Returns 1 on success, 0 on I/O error, -1 on invalid response CRC
+int _external_device_command(int iIndex, u8* pCommand, int iCommandLength, u8* pResponse, int iResponseLength)
+{
+#ifdef HW_CAPABILITY_I2C
+   int iFile = g_nListFilesExternalDevices[iIndex];
+   if ( (iFile <= 0) || (NULL == g_pListExternalDevices[iIndex]) || (iResponseLength < 1) )
+      return 0;
+
+   if ( g_bListExternalDevicesCombinedTransfers[iIndex] )
+   {
+      int iResult = 0;
+      if ( 0 == hardware_i2c_bus_transfer(iFile, (u8)g_pListExternalDevices[iIndex]->nI2CAddress, pCommand, iCommandLength, pResponse, iResponseLength) )
+      {
+         if ( pResponse[iResponseLength-1] == base_compute_crc8(pResponse, iResponseLength-1) )
+         {
+            g_iListExternalDevicesCombinedTransfersFailures[iIndex] = 0;
+            return 1;
+         }
+         iResult = -1;
+      }
+
+      g_iListExternalDevicesCombinedTransfersFailures[iIndex]++;
+      if ( g_iListExternalDevicesCombinedTransfersFailures[iIndex] >= 5 )
+      {
+         log_line("I2C external device 0x%02X does not answer to combined I2C transactions. Using byte transfers for it.", g_pListExternalDevices[iIndex]->nI2CAddress);
+         g_bListExternalDevicesCombinedTransfers[iIndex] = false;
+      }
+      if ( ! _external_device_command_can_resend(pCommand, iCommandLength) )
+         return iResult;
+   }
+
+   for( int i=0; i<iCommandLength; i++ )
+      wiringPiI2CWrite(iFile, pCommand[i]);
+   for( int i=0; i<iResponseLength; i++ )
+   {
+      int iRes = wiringPiI2CRead(iFile);
+      if ( iRes < 0 )
+         return 0;
+      pResponse[i] = (u8)iRes;
+   }
+   if ( pResponse[iResponseLength-1] != base_compute_crc8(pResponse, iResponseLength-1) )
+      return -1;
+   return 1;
+#else
+   return 0;
+#endif
+}
+
 bool _setup_external_device(int iIndex)
 {
 #ifdef HW_CAPABILITY_I2C
@@ -177,30 +245,21 @@ bool _setup_external_device(int iIndex)
       bufferOut[0] = I2C_COMMAND_START_FLAG;
       bufferOut[1] = I2C_COMMAND_ID_GET_FLAGS;
       bufferOut[2] = base_compute_crc8(bufferOut,2);
-      wiringPiI2CWrite(g_nListFilesExternalDevices[iIndex], bufferOut[0]);
-      wiringPiI2CWrite(g_nListFilesExternalDevices[iIndex], bufferOut[1]);
-      wiringPiI2CWrite(g_nListFilesExternalDevices[iIndex], bufferOut[2]);
       g_uListExternalDevicesFlags[iIndex] = 0;
-      int res1 = wiringPiI2CRead(g_nListFilesExternalDevices[iIndex]);
-      int res2 = wiringPiI2CRead(g_nListFilesExternalDevices[iIndex]);
-      int res3 = wiringPiI2CRead(g_nListFilesExternalDevices[iIndex]);
-      if ( res1 < 0 || res2 < 0 || res3 < 0 )
+      int iRes = _external_device_command(iIndex, bufferOut, 3, bufferIn, 3);
+      if ( 0 == iRes )
       {
-         log_softerror_and_alarm("Failed to get I2C external device flags at address 0x%02X (external module), got: %d, %d, %d. Ignoring device.", g_pListExternalDevices[iIndex]->nI2CAddress, res1, res2, res3);
+         log_softerror_and_alarm("Failed to get I2C external device flags at address 0x%02X (external module). Ignoring device.", g_pListExternalDevices[iIndex]->nI2CAddress);
          continue;
       }
-      log_line("Got I2C external device (0x%02X) flags: %d, %d", g_pListExternalDevices[iIndex]->nI2CAddress, res1, res2);
-
-      bufferIn[0] = res1;
-      bufferIn[1] = res2;
-      bufferIn[2] = base_compute_crc8(bufferIn,2);
+      log_line("Got I2C external device (0x%02X) flags: %d, %d", g_pListExternalDevices[iIndex]->nI2CAddress, bufferIn[0], bufferIn[1]);
 
-      if ( bufferIn[2] != res3 )
+      if ( iRes < 0 )
       {
          log_softerror_and_alarm("Received incorrect CRC on I2C command flags response.");
          continue;
       }
-      g_uListExternalDevicesFlags[iIndex] = ((u32)res1) | (((u32)res2)<<8);
+      g_uListExternalDevicesFlags[iIndex] = ((u32)bufferIn[0]) | (((u32)bufferIn[1])<<8);
         
       log_line("Got I2C external device 0x%02X flags: %u. ", g_pListExternalDevices[iIndex]->nI2CAddress, g_uListExternalDevicesFlags[iIndex]);
       log_line("0x%02X supported flags: rotary: %s, buttons: %s", g_pListExternalDevices[iIndex]->nI2CAddress, (g_uListExternalDevicesFlags[iIndex] & I2C_CAPABILITY_FLAG_ROTARY)?"yes":"no", (g_uListExternalDevicesFlags[iIndex] & I2C_CAPABILITY_FLAG_BUTTONS)?"yes":"no");
@@ -246,35 +305,21 @@ bool _setup_external_device(int iIndex)
 
          bufferOut[3] = base_compute_crc8(bufferOut,3);
 
-         wiringPiI2CWrite(g_nListFilesExternalDevices[iIndex], bufferOut[0]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[iIndex], bufferOut[1]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[iIndex], bufferOut[2]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[iIndex], bufferOut[3]);
-         int res1 = wiringPiI2CRead(g_nListFilesExternalDevices[iIndex]);
-         int res2 = wiringPiI2CRead(g_nListFilesExternalDevices[iIndex]);
-         if ( res1 < 0 || res2 < 0 )
+         int iRes = _external_device_command(iIndex, bufferOut, 4, bufferIn, 2);
+         if ( 0 == iRes )
          {
-            log_softerror_and_alarm("Failed to get response to RC setup from I2C external device at address 0x%02X (external module), got: %d, %d.", g_pListExternalDevices[iIndex]->nI2CAddress, res1, res2);
+            log_softerror_and_alarm("Failed to get response to RC setup from I2C external device at address 0x%02X (external module).", g_pListExternalDevices[iIndex]->nI2CAddress);
             continue;
          }
-         else
+         if ( iRes < 0 )
          {
-         	  bufferIn[0] = res1;
-            bufferIn[1] = base_compute_crc8(bufferIn,1);
-
-            if ( bufferIn[1] != res2 )
-            {
-               log_softerror_and_alarm("Received incorrect CRC on I2C command set RC flags response.");
-               continue;
-            }
-            else
-            {
-               if ( res1 != 0 )
-               {
-                  log_softerror_and_alarm("Response to RC setup from I2C external device at address 0x%02X (external module) was: failed.", g_pListExternalDevices[iIndex]->nI2CAddress);
-                  continue;
-               }
-            }
+            log_softerror_and_alarm("Received incorrect CRC on I2C command set RC flags response.");
+            continue;
+         }
+         if ( bufferIn[0] != 0 )
+         {
+            log_softerror_and_alarm("Response to RC setup from I2C external device at address 0x%02X (external module) was: failed.", g_pListExternalDevices[iIndex]->nI2CAddress);
+            continue;
          }
          bSucceeded = true;
          break;
@@ -315,6 +360,8 @@ void _init_external_device(u8 i2cAddress)
    }
    log_line("Opened I2C device at address 0x%02X (external module).", i2cAddress);
 
+   g_bListExternalDevicesCombinedTransfers[g_nCountExternalDevices] = true;
+   g_iListExternalDevicesCombinedTransfersFailures[g_nCountExternalDevices] = 0;
    _setup_external_device(g_nCountExternalDevices);
  
    g_nCountExternalDevices++;
@@ -361,18 +408,12 @@ void _init_external_devices()
 
 void load_settings()
 {
-   g_SleepTime = 100;
-
    hardware_i2c_load_device_settings();
    load_ControllerSettings();
 
    _init_INA();
    _init_external_devices();
 
-   if ( g_iHasExternalRCInputDevice > 0 )
-   if ( g_SleepTime > 20 )
-      g_SleepTime = 20;
-
 #ifdef HW_CAPABILITY_I2C
  
    if ( hardware_has_i2c_device_id(I2C_DEVICE_ADDRESS_PICO_RC_IN) )
@@ -389,8 +430,6 @@ void load_settings()
          else
             log_line("Opened I2C device at address 0x%02X (Pico RC In module).", I2C_DEVICE_ADDRESS_PICO_RC_IN);
       }
-      if ( g_SleepTime > 25 )
-         g_SleepTime = 25;
    }
 
    if ( hardware_has_i2c_device_id(I2C_DEVICE_ADDRESS_PICO_EXTENDER) )
@@ -407,8 +446,6 @@ void load_settings()
          else
             log_line("Opened I2C device at address 0x%02X (Pico Extender module).", I2C_DEVICE_ADDRESS_PICO_EXTENDER);
       }
-      if ( g_SleepTime > 20 )
-         g_SleepTime = 20;
    }
 
    if ( g_nFileRCIn > 0 || g_nFilePicoExtender > 0 )
@@ -441,48 +478,56 @@ void load_settings()
 #endif
 }
 
-void checkReadINA()
+int _task_read_INA(u32 uTimeNow, void* pContext)
 {
 #ifdef HW_CAPABILITY_I2C
-   if (  g_TimeNow < g_TimeLastINARead )
-      g_TimeLastINARead = g_TimeNow;
-
-   if ( g_TimeNow < g_TimeLastINARead + 300 )
-      return;
-
-   g_TimeLastINARead = g_TimeNow;
+   g_TimeNow = uTimeNow;
+   if ( (g_nINAFd <= 0) || (NULL == g_pDeviceInfoINA) )
+      return 0;
 
-   if ( 0 < g_nINAFd )
+   int iResult = 1;
    if ( g_pDeviceInfoINA->uParams[0] == 0 || g_pDeviceInfoINA->uParams[0] == 2 )
    {
-      u32 valV  = wiringPiI2CReadReg16(g_nINAFd, 2); 
-      valV = revert_word(valV);
-      valV = (valV>>3)*4;
-      if ( NULL != g_pSMCurrent )
+      u16 uVal = 0;
+      if ( 0 != hardware_i2c_bus_read_reg16(g_nINAFd, (u8)g_nINAAddress, 2, &uVal) )
+         iResult = 0;
+      else
       {
-         g_pSMCurrent->voltage = valV;
-         g_pSMCurrent->lastSetTime = g_TimeNow;
+         u32 valV = revert_word(uVal);
+         valV = (valV>>3)*4;
+         if ( NULL != g_pSMCurrent )
+         {
+            g_pSMCurrent->voltage = valV;
+            g_pSMCurrent->lastSetTime = g_TimeNow;
+         }
       }
    }
-   if ( 0 < g_nINAFd )
    if ( g_pDeviceInfoINA->uParams[0] == 1 || g_pDeviceInfoINA->uParams[0] == 2 )
    {
       u32 val = 4096;
       val = ((val>>8) & 0xFF) | ((val & 0xFF) << 8);
-      wiringPiI2CWriteReg16 (g_nINAFd, 5, val); 
+      hardware_i2c_bus_write_reg16(g_nINAFd, (u8)g_nINAAddress, 5, (u16)val);
 
-      u32 valC  = wiringPiI2CReadReg16(g_nINAFd, 4); 
-      valC = revert_word(valC);
-      if ( NULL != g_pSMCurrent )
+      u16 uVal = 0;
+      if ( 0 != hardware_i2c_bus_read_reg16(g_nINAFd, (u8)g_nINAAddress, 4, &uVal) )
+         iResult = 0;
+      else
       {
-         g_pSMCurrent->current = valC;
-         g_pSMCurrent->lastSetTime = g_TimeNow;
+         u32 valC = revert_word(uVal);
+         if ( NULL != g_pSMCurrent )
+         {
+            g_pSMCurrent->current = valC;
+            g_pSMCurrent->lastSetTime = g_TimeNow;
+         }
       }
    }
+   return iResult;
+#else
+   return 0;
 #endif
 }
 
-void _read_RCIn_OldMethod()
+int _read_RCIn_OldMethod()
 {
 #ifdef HW_CAPABILITY_I2C
    if ( hardware_has_i2c_device_id(I2C_DEVICE_ADDRESS_PICO_RC_IN) )
@@ -490,7 +535,7 @@ void _read_RCIn_OldMethod()
    if ( NULL != g_pSMRCIn )
    {
       g_pSMRCIn->uFlags &= (~RC_IN_FLAG_HAS_INPUT); // No input
-      return;
+      return 0;
    }
 
    if (	hardware_has_i2c_device_id(I2C_DEVICE_ADDRESS_PICO_EXTENDER) )
@@ -498,34 +543,37 @@ void _read_RCIn_OldMethod()
    if ( NULL != g_pSMRCIn )
    {
       g_pSMRCIn->uFlags &= (~RC_IN_FLAG_HAS_INPUT); // No input
-      return;
+      return 0;
    }
 
    int file = g_nFileRCIn;
+   u8 uAddress = I2C_DEVICE_ADDRESS_PICO_RC_IN;
    if ( g_nFilePicoExtender > 0 )
+   {
       file = g_nFilePicoExtender;
+      uAddress = I2C_DEVICE_ADDRESS_PICO_EXTENDER;
+   }
 
-   int iFrameNumber = wiringPiI2CReadReg8(file, I2C_DEVICE_COMMAND_ID_RC_IN_GET_FRAME_NUMBER);
-
-   if ( iFrameNumber < 0 )
+   u8 uFrameNumber = 0;
+   if ( 0 != hardware_i2c_bus_read_reg8(file, uAddress, I2C_DEVICE_COMMAND_ID_RC_IN_GET_FRAME_NUMBER, &uFrameNumber) )
    {
       g_pSMRCIn->uFlags &= (~RC_IN_FLAG_HAS_INPUT); // No input
-      return;
+      return 0;
    }
 
-   s_uLastFrameNumber = (u8)iFrameNumber;
+   s_uLastFrameNumber = uFrameNumber;
 
-   if ( (u8)iFrameNumber == g_pSMRCIn->uFrameIndex )
+   if ( uFrameNumber == g_pSMRCIn->uFrameIndex )
    {
       if ( g_TimeNow > g_TimeLastRCInFrameChange + DEFAULT_RC_FAILSAFE_TIME )
       {
          //log_line("To Remove No ISBUS/SBUS input 3");
          g_pSMRCIn->uFlags &= (~RC_IN_FLAG_HAS_INPUT); // No input
       }
-      return;
+      return 1;
    }
 
-   //log_line("Frame: %d", iFrameNumber);
+   //log_line("Frame: %d", uFrameNumber);
    g_pSMRCIn->uFlags |= RC_IN_FLAG_HAS_INPUT; // Has input
    g_TimeLastRCInFrameChange =  g_TimeNow;
 
@@ -534,22 +582,35 @@ void _read_RCIn_OldMethod()
    if ( chToRead > I2C_DEVICE_PARAM_MAX_CHANNELS )
       chToRead = I2C_DEVICE_PARAM_MAX_CHANNELS;
 
-   for( int i=0; i<chToRead; i++ )
-   {
-      s_lastRCReadVals[i] = wiringPiI2CReadReg16(file, I2C_DEVICE_COMMAND_ID_RC_IN_GET_CHANNEL+i);
-      if ( NULL != g_pDeviceInfoPicoExtender && 0 == g_pDeviceInfoPicoExtender->uParams[0] ) // SBUS
-         s_lastRCReadVals[i] = 1000 + 1000 * (((int)s_lastRCReadVals[i])-200) / 1600;
-   }
+   // Read all the channels registers in a single I2C transaction
+   int chTotal = chToRead;
    if ( g_TimeNow >= g_TimeLastRCInReadFull + 100 )
    {
       g_TimeLastRCInReadFull = g_TimeNow;
-      for( int i=chToRead; i<I2C_DEVICE_PARAM_MAX_CHANNELS; i++ )
+      chTotal = I2C_DEVICE_PARAM_MAX_CHANNELS;
+   }
+
+   u8 uRegisters[I2C_DEVICE_PARAM_MAX_CHANNELS];
+   for( int i=0; i<chTotal; i++ )
+      uRegisters[i] = I2C_DEVICE_COMMAND_ID_RC_IN_GET_CHANNEL+i;
+
+   int iResult = 1;
+   int chRead = 0;
+   while ( chRead < chTotal )
+   {
+      int iCount = chTotal - chRead;
+      if ( iCount > I2C_BUS_MAX_REGS_PER_TRANSFER )
+         iCount = I2C_BUS_MAX_REGS_PER_TRANSFER;
+      if ( 0 != hardware_i2c_bus_read_regs16(file, uAddress, &uRegisters[chRead], iCount, &s_lastRCReadVals[chRead]) )
       {
-         s_lastRCReadVals[i] = wiringPiI2CReadReg16(file, I2C_DEVICE_COMMAND_ID_RC_IN_GET_CHANNEL+i);
-         if ( NULL != g_pDeviceInfoPicoExtender && 0 == g_pDeviceInfoPicoExtender->uParams[0] ) // SBUS
-            s_lastRCReadVals[i] = 1000 + 1000 * (((int)s_lastRCReadVals[i])-200) / 1600;
+         iResult = 0;
+         break;
       }
+      chRead += iCount;
    }
+   if ( NULL != g_pDeviceInfoPicoExtender && 0 == g_pDeviceInfoPicoExtender->uParams[0] ) // SBUS
+   for( int i=0; i<chRead; i++ )
+      s_lastRCReadVals[i] = 1000 + 1000 * (((int)s_lastRCReadVals[i])-200) / 1600;
 
    if ( NULL != g_pSMRCIn )
    {
@@ -558,7 +619,7 @@ void _read_RCIn_OldMethod()
          nCh = MAX_RC_CHANNELS;
 
       g_pSMRCIn->uTimeStamp = g_TimeNow;
-      g_pSMRCIn->uFrameIndex = (u8)iFrameNumber;
+      g_pSMRCIn->uFrameIndex = uFrameNumber;
       g_pSMRCIn->uChannelsCount = (u8)nCh;
       for( int i=0; i<nCh; i++ )
       {
@@ -572,7 +633,7 @@ void _read_RCIn_OldMethod()
    /*
    char szTmp[256];
    char szOut[256];
-   sprintf(szOut, "Fr %d: ", iFrameNumber);
+   sprintf(szOut, "Fr %d: ", uFrameNumber);
    for( int i=0; i<12; i++ )
    {
       sprintf(szTmp, "%d ", (int)g_pSMRCIn->uChannels[i] );
@@ -580,31 +641,24 @@ void _read_RCIn_OldMethod()
    }
    log_line(szOut);
    */
+   return iResult;
+#else
+   return 0;
 #endif
 }
 
-void checkReadRCIn()
+int _task_read_RCIn(u32 uTimeNow, void* pContext)
 {
 #ifdef HW_CAPABILITY_I2C
+   g_TimeNow = uTimeNow;
    if ( NULL == g_pDeviceInfoRCIn && NULL == g_pDeviceInfoPicoExtender && (g_iHasExternalRCInputDevice==0) )
-      return;
-
-   if (  g_TimeNow < g_TimeLastRCInRead )
-      g_TimeLastRCInRead = g_TimeNow;
-
-   if ( g_TimeNow < g_TimeLastRCInRead + g_SleepTime )
-      return;
+      return 0;
 
-   g_TimeLastRCInRead = g_TimeNow;
- 
    if ( NULL == g_pSMRCIn )
-      return;
+      return 0;
 
    if ( (g_nFileRCIn > 0) || (g_nFilePicoExtender > 0) )
-   {
-   	  _read_RCIn_OldMethod();
-      return;
-   }
+      return _read_RCIn_OldMethod();
 
    u8 bufferOut[64];
    u8 bufferIn[64];
@@ -617,33 +671,25 @@ void checkReadRCIn()
    	  if ( g_nListFilesExternalDevices[iDevice] <= 0 )
    	  {
    	     g_pSMRCIn->uFlags &= (~RC_IN_FLAG_HAS_INPUT); // No input
-   	     return;
+   	     return 0;
       }
 
       // Get device RC channels
       bufferOut[0] = I2C_COMMAND_START_FLAG;
       bufferOut[1] = I2C_COMMAND_ID_RC_GET_CHANNELS;
       bufferOut[2] = base_compute_crc8(bufferOut,2);
-      wiringPiI2CWrite(g_nListFilesExternalDevices[iDevice], bufferOut[0]);
-      wiringPiI2CWrite(g_nListFilesExternalDevices[iDevice], bufferOut[1]);
-      wiringPiI2CWrite(g_nListFilesExternalDevices[iDevice], bufferOut[2]);
-      for( int i=0; i<27; i++ )
+      int iRes = _external_device_command(iDevice, bufferOut, 3, bufferIn, 27);
+      if ( 0 == iRes )
       {
-         int res = wiringPiI2CRead(g_nListFilesExternalDevices[iDevice]);
-         if ( res < 0 )
-         {
-            log_softerror_and_alarm("Failed to get I2C external device RC channels at address 0x%02X (external module), got: %d. ", g_pListExternalDevices[iDevice]->nI2CAddress, res);
-            g_iReadRCInConsecutiveFailCount++;
-            return;
-         }
-         bufferIn[i] = res;
+         log_softerror_and_alarm("Failed to get I2C external device RC channels at address 0x%02X (external module).", g_pListExternalDevices[iDevice]->nI2CAddress);
+         g_iReadRCInConsecutiveFailCount++;
+         return 0;
       }
-      u8 uCRC = base_compute_crc8(bufferIn,26);
-      if ( uCRC != bufferIn[26] )
+      if ( iRes < 0 )
       {
          //log_softerror_and_alarm("Failed to get I2C external device RC channels at address 0x%02X (external module), invalid CRC in response.", g_pListExternalDevices[iDevice]->nI2CAddress);
          g_iReadRCInConsecutiveFailCount++;
-         return;      	
+         return 0;
       }
 
       g_iReadRCInConsecutiveFailCount = 0;
@@ -694,21 +740,26 @@ void checkReadRCIn()
          */
       }
    }
+   return 1;
+#else
+   return 0;
 #endif
 }
 
-void checkReadRotaryEncoderAndButtons()
+int _task_read_rotary_encoder_and_buttons(u32 uTimeNow, void* pContext)
 {
 #ifdef HW_CAPABILITY_I2C
+   g_TimeNow = uTimeNow;
    if ( NULL == g_pSMRotaryEncoderButtonsEvents )
-      return;
+      return 0;
 
    if ( NULL == g_pDeviceInfoPicoExtender && (! g_bHasExternalRotaryDevice) )
-      return;
+      return 0;
 
    ControllerSettings* pCS = get_ControllerSettings();
 
    int iDevicesSignaledCount = 0;
+   int iResult = 1;
 
    for( int i=0; i<g_nCountExternalDevices; i++ )
    {
@@ -734,22 +785,17 @@ void checkReadRotaryEncoderAndButtons()
          bufferOut[1] = I2C_COMMAND_ID_GET_ROTARY_EVENTS2;
          bufferOut[2] = base_compute_crc8(bufferOut,2);
 
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[0]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[1]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[2]);
-         int res1 = wiringPiI2CRead(g_nListFilesExternalDevices[i]);
-         int res2 = wiringPiI2CRead(g_nListFilesExternalDevices[i]);
-         if ( res1 < 0 || res2 < 0 )
+         int iRes = _external_device_command(i, bufferOut, 3, bufferIn, 2);
+         if ( 0 == iRes )
          {
-            log_softerror_and_alarm("Failed to get rotary events2 from I2C external device at address 0x%02X (external module), got: %d, %d.", g_pListExternalDevices[i]->nI2CAddress, res1, res2);
+            log_softerror_and_alarm("Failed to get rotary events2 from I2C external device at address 0x%02X (external module).", g_pListExternalDevices[i]->nI2CAddress);
+            iResult = 0;
             continue;
          }
-         bufferIn[0] = res1;
-         bufferIn[1] = base_compute_crc8(bufferIn,1);
-
-         if ( bufferIn[1] != res2 )
+         if ( iRes < 0 )
          {
-            //log_softerror_and_alarm("Got invalid CRC on get rotary events from I2C external device at address 0x%02X (external module), got: %d, %d.", g_pListExternalDevices[i]->nI2CAddress, res1, res2);
+            //log_softerror_and_alarm("Got invalid CRC on get rotary events from I2C external device at address 0x%02X (external module).", g_pListExternalDevices[i]->nI2CAddress);
+            iResult = 0;
             continue;
          }
 
@@ -767,22 +813,17 @@ void checkReadRotaryEncoderAndButtons()
          bufferOut[1] = I2C_COMMAND_ID_GET_ROTARY_EVENTS;
          bufferOut[2] = base_compute_crc8(bufferOut,2);
 
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[0]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[1]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[2]);
-         int res1 = wiringPiI2CRead(g_nListFilesExternalDevices[i]);
-         int res2 = wiringPiI2CRead(g_nListFilesExternalDevices[i]);
-         if ( res1 < 0 || res2 < 0 )
+         int iRes = _external_device_command(i, bufferOut, 3, bufferIn, 2);
+         if ( 0 == iRes )
          {
-            log_softerror_and_alarm("Failed to get rotary events from I2C external device at address 0x%02X (external module), got: %d, %d.", g_pListExternalDevices[i]->nI2CAddress, res1, res2);
+            log_softerror_and_alarm("Failed to get rotary events from I2C external device at address 0x%02X (external module).", g_pListExternalDevices[i]->nI2CAddress);
+            iResult = 0;
             continue;
          }
-         bufferIn[0] = res1;
-         bufferIn[1] = base_compute_crc8(bufferIn,1);
-
-         if ( bufferIn[1] != res2 )
+         if ( iRes < 0 )
          {
-            //log_softerror_and_alarm("Got invalid CRC on get rotary events from I2C external device at address 0x%02X (external module), got: %d, %d.", g_pListExternalDevices[i]->nI2CAddress, res1, res2);
+            //log_softerror_and_alarm("Got invalid CRC on get rotary events from I2C external device at address 0x%02X (external module).", g_pListExternalDevices[i]->nI2CAddress);
+            iResult = 0;
             continue;
          }
 
@@ -800,32 +841,17 @@ void checkReadRotaryEncoderAndButtons()
          bufferOut[1] = I2C_COMMAND_ID_GET_BUTTONS_EVENTS;
          bufferOut[2] = base_compute_crc8(bufferOut,2);
 
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[0]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[1]);
-         wiringPiI2CWrite(g_nListFilesExternalDevices[i], bufferOut[2]);
-         int res[5];
-         for( int k=0; k<5; k++ )
-            res[k] = wiringPiI2CRead(g_nListFilesExternalDevices[i]);
-
-         bool bFailed = false;
-
-         for( int k=0; k<5; k++ )
-         {
-            bufferIn[k] = (u8)res[k];
-            if ( res[k] < 0 )
-               bFailed = true;
-         }
-         if ( bFailed )
+         int iRes = _external_device_command(i, bufferOut, 3, bufferIn, 5);
+         if ( 0 == iRes )
          {
-            log_softerror_and_alarm("Failed to get buttons events from I2C external device at address 0x%02X (external module), got: %d, %d, %d, %d, %d.", g_pListExternalDevices[i]->nI2CAddress, res[0], res[1], res[2], res[3], res[4]);
+            log_softerror_and_alarm("Failed to get buttons events from I2C external device at address 0x%02X (external module).", g_pListExternalDevices[i]->nI2CAddress);
+            iResult = 0;
             continue;
          }
-
-         u8 uCRC = base_compute_crc8(bufferIn,4);
-
-         if ( bufferIn[4] != uCRC )
+         if ( iRes < 0 )
          {
-            //log_softerror_and_alarm("Got invalid CRC on get buttons events from I2C external device at address 0x%02X (external module), got: %d, %d, %d, %d, %d.", g_pListExternalDevices[i]->nI2CAddress, res[0], res[1], res[2], res[3], res[4]);
+            //log_softerror_and_alarm("Got invalid CRC on get buttons events from I2C external device at address 0x%02X (external module).", g_pListExternalDevices[i]->nI2CAddress);
+            iResult = 0;
             continue;
          }
 
@@ -834,7 +860,7 @@ void checkReadRotaryEncoderAndButtons()
          bool bHasEvents = false;
          for( int k=0; k<4; k++ )
          {
-            if ( res[k] > 0 )
+            if ( bufferIn[k] > 0 )
                bHasEvents = true;
          }
          if ( bHasEvents)
@@ -867,28 +893,28 @@ void checkReadRotaryEncoderAndButtons()
       g_pSMRotaryEncoderButtonsEvents->uEventIndex++;
       g_pSMRotaryEncoderButtonsEvents->uTimeStamp = g_TimeNow;
       g_pSMRotaryEncoderButtonsEvents->uCRC = base_compute_crc32((u8*)g_pSMRotaryEncoderButtonsEvents, sizeof(t_shared_mem_i2c_rotary_encoder_buttons_events) - sizeof(u32));
-      return;
+      return iResult;
    }
 
    if ( g_nFilePicoExtender <= 0 )
-      return;
+      return iResult;
 
 
-   int iValues = -1;
-   if ( pCS->nRotaryEncoderSpeed == 0 )
-      iValues = wiringPiI2CReadReg8(g_nFilePicoExtender, I2C_DEVICE_COMMAND_ID_PICO_EXTENDER_GET_ROTARY_ENCODER_ACTIONS);
-   else
-      iValues = wiringPiI2CReadReg8(g_nFilePicoExtender, I2C_DEVICE_COMMAND_ID_PICO_EXTENDER_GET_ROTARY_ENCODER_ACTIONS_SLOW);
+   u8 uValues = 0;
+   u8 uRegister = I2C_DEVICE_COMMAND_ID_PICO_EXTENDER_GET_ROTARY_ENCODER_ACTIONS;
+   if ( pCS->nRotaryEncoderSpeed != 0 )
+      uRegister = I2C_DEVICE_COMMAND_ID_PICO_EXTENDER_GET_ROTARY_ENCODER_ACTIONS_SLOW;
 
-   if ( iValues < 0 )
+   if ( 0 != hardware_i2c_bus_read_reg8(g_nFilePicoExtender, I2C_DEVICE_ADDRESS_PICO_EXTENDER, uRegister, &uValues) )
    {
       //log_line("Failed to read rotary encoder");
-      return;
+      return 0;
    }
+   int iValues = uValues;
 
    // No events ?
    if ( iValues == 0 || (iValues & 0xFF) == 0x80 )
-      return;
+      return iResult;
 
    g_pSMRotaryEncoderButtonsEvents->uButtonsEvents = 0;
    g_pSMRotaryEncoderButtonsEvents->uRotaryEncoderEvents = 0;
@@ -929,9 +955,39 @@ void checkReadRotaryEncoderAndButtons()
    }
    log_line(szBuff);
    */
+   return iResult;
+#else
+   return 0;
 #endif
 }
 
+void _setup_scheduler()
+{
+   i2c_scheduler_reset();
+
+   if ( (g_nFileRCIn > 0) || (g_nFilePicoExtender > 0) || (g_iHasExternalRCInputDevice > 0) )
+   {
+      u32 uPeriod = 20;
+      u8 uAddress = I2C_DEVICE_ADDRESS_PICO_EXTENDER;
+      if ( (g_nFileRCIn > 0) && (g_nFilePicoExtender <= 0) )
+      {
+         uPeriod = 25;
+         uAddress = I2C_DEVICE_ADDRESS_PICO_RC_IN;
+      }
+      if ( (g_nFileRCIn <= 0) && (g_nFilePicoExtender <= 0) )
+         uAddress = 0;
+      i2c_scheduler_add_task("RC In", uAddress, I2C_TASK_PRIORITY_RC_INPUT, uPeriod, 10, _task_read_RCIn, NULL);
+   }
+
+   if ( (NULL != g_pDeviceInfoPicoExtender) || g_bHasExternalRotaryDevice )
+      i2c_scheduler_add_task("Buttons", (g_nFilePicoExtender > 0)?I2C_DEVICE_ADDRESS_PICO_EXTENDER:0, I2C_TASK_PRIORITY_USER_INPUT, 20, 20, _task_read_rotary_encoder_and_buttons, NULL);
+
+   if ( g_nINAFd > 0 )
+      i2c_scheduler_add_task("INA219", (u8)g_nINAAddress, I2C_TASK_PRIORITY_HOUSEKEEPING, 300, 300, _task_read_INA, NULL);
+
+   log_line("Setup I2C devices scheduler with %d tasks.", i2c_scheduler_get_tasks_count());
+}
+
 void handle_sigint(int sig) 
 { 
    g_bQuit = true;
@@ -962,12 +1018,19 @@ int main(int argc, char *argv[])
       g_nListFilesExternalDevices[i] = -1;
       g_uListExternalDevicesFlags[i] = 0;
       g_bListExternalDevicesSetupCorrectly[i] = false;
+      g_bListExternalDevicesCombinedTransfers[i] = true;
+      g_iListExternalDevicesCombinedTransfersFailures[i] = 0;
    }
    g_nCountExternalDevices = 0;
 
    g_pSMCurrent = shared_mem_i2c_current_open_for_write();
    g_pSMRCIn = shared_mem_i2c_controller_rc_in_open_for_write();
    g_pSMRotaryEncoderButtonsEvents = shared_mem_i2c_rotary_encoder_buttons_events_open_for_write();
+   g_pSMDevicesReadStats = shared_mem_i2c_devices_read_stats_open_for_write();
+   if ( NULL != g_pSMDevicesReadStats )
+      memset(g_pSMDevicesReadStats, 0, sizeof(t_shared_mem_i2c_devices_read_stats));
+   else
+      log_softerror_and_alarm("Failed to open shared mem [%s] for writing.", SHARED_MEM_NAME_I2C_DEVICES_READ_STATS);
 
    if ( NULL != g_pSMRCIn )
    {
@@ -997,6 +1060,7 @@ int main(int argc, char *argv[])
       s_lastRCReadVals[i] = 0;
 
    load_settings();
+   _setup_scheduler();
 
    char szFile[128];
    strcpy(szFile, FOLDER_RUBY_TEMP);
@@ -1006,10 +1070,16 @@ int main(int argc, char *argv[])
    log_line("Initialization complete. Starting main loop...");
 
    g_TimeLastReloadCheck = g_TimeNow = get_current_timestamp_ms();
+   g_TimeLastStatsPublish = g_TimeNow;
 
    while ( !g_bQuit )
    {
-      hardware_sleep_ms(g_SleepTime);
+      // Sleep until the next device read is due (but check for settings changes at least every 50 ms)
+      u32 uWaitMs = i2c_scheduler_get_wait_time_ms(get_current_timestamp_ms());
+      if ( uWaitMs > 50 )
+         uWaitMs = 50;
+      if ( uWaitMs > 0 )
+         hardware_sleep_ms(uWaitMs);
       if ( g_bQuit )
          break;
 
@@ -1023,6 +1093,7 @@ int main(int argc, char *argv[])
          	  log_line("I2C devices settings changed. Reloading settings and setting up devices.");
             close_files();
             load_settings();
+            _setup_scheduler();
             char szBuff[128];
             sprintf(szBuff, "rm -rf %s%s 2>/dev/null", FOLDER_RUBY_TEMP, FILE_TEMP_I2C_UPDATED);
             hw_execute_bash_command_silent(szBuff, NULL);
@@ -1032,15 +1103,21 @@ int main(int argc, char *argv[])
       for( int i=0; i<g_nCountExternalDevices; i++ )
          if ( ! g_bListExternalDevicesSetupCorrectly[i] )
             _setup_external_device(i);
-      checkReadINA();
-      checkReadRCIn();
-      checkReadRotaryEncoderAndButtons();
+
+      i2c_scheduler_run(get_current_timestamp_ms());
 
       if ( g_iReadRCInConsecutiveFailCount > 10 )
       {
           g_iReadRCInConsecutiveFailCount = 0;
           close_files();
-          load_settings();            
+          load_settings();
+          _setup_scheduler();
+      }
+
+      if ( g_TimeNow >= g_TimeLastStatsPublish + 1000 )
+      {
+         g_TimeLastStatsPublish = g_TimeNow;
+         i2c_scheduler_publish_stats(g_pSMDevicesReadStats, g_TimeNow);
       }
    }
 
@@ -1048,6 +1125,7 @@ int main(int argc, char *argv[])
    shared_mem_i2c_current_close(g_pSMCurrent);
    shared_mem_i2c_controller_rc_in_close(g_pSMRCIn);
    shared_mem_i2c_rotary_encoder_buttons_events_close(g_pSMRotaryEncoderButtonsEvents);
+   shared_mem_i2c_devices_read_stats_close(g_pSMDevicesReadStats);
    log_line("Finished execution.Exit");
    return 0;
 } 
\ No newline at end of file
@@ -36,6 +36,7 @@
 #include "../common/string_utils.h"
 #include "../radio/radiopackets2.h"
 #include "../radio/radiopacketsqueue.h"
+#include "../radio/adaptive_fec.h"
 
 #include "adaptive_video.h"
 #include "shared_vars.h"
@@ -45,6 +46,8 @@
 extern t_packet_queue s_QueueRadioPacketsHighPrio;
 
 u32 s_uTimePauseAdaptiveVideoUntil = 0;
+u32 s_uTimeLastECRecoveryStats = 0;
+int s_iLastECRecoveryStatsRTIndex = -1;
 
 void adaptive_video_pause(u32 uMilisec)
 {
@@ -160,7 +163,8 @@ bool _adaptive_video_should_switch_lower(Model* pModel, type_global_state_vehicl
       iIntervalsToCheck = SYSTEM_RT_INFO_INTERVALS - 1;
    int iRTInfoIndex = g_SMControllerRTInfo.iCurrentIndex;
    
-   int iECScheme = pModel->video_link_profiles[pSMVideoStreamInfo->PHVF.uCurrentVideoLinkProfile].block_fecs;
+   // The vehicle can tune the EC scheme of the profile (auto EC scheme), so use the one received
+   int iECScheme = pSMVideoStreamInfo->PHVF.uCurrentBlockECPackets;
    
    if ( iECScheme > 0 )
    {
@@ -211,7 +215,8 @@ bool _adaptive_video_should_switch_higher(Model* pModel, type_global_state_vehic
       iIntervalsToCheck = SYSTEM_RT_INFO_INTERVALS - 1;
    int iRTInfoIndex = g_SMControllerRTInfo.iCurrentIndex;
    
-   int iECScheme = pModel->video_link_profiles[pSMVideoStreamInfo->PHVF.uCurrentVideoLinkProfile].block_fecs;
+   // The vehicle can tune the EC scheme of the profile (auto EC scheme), so use the one received
+   int iECScheme = pSMVideoStreamInfo->PHVF.uCurrentBlockECPackets;
    if ( iECScheme > 0 )
    {
       int iECThreshold = iECScheme-1;
@@ -244,6 +249,64 @@ bool _adaptive_video_should_switch_higher(Model* pModel, type_global_state_vehic
    return false;
 }
 
+// Adds up the video blocks recovery info from the controller runtime info slices completed since last time
+bool _adaptive_video_compute_ec_recovery_stats(t_packet_data_video_ec_recovery_stats* pStats)
+{
+   memset(pStats, 0, sizeof(t_packet_data_video_ec_recovery_stats));
+   
+   // Slices older than the runtime info history were overwritten, start over
+   if ( (-1 == s_iLastECRecoveryStatsRTIndex) || (g_TimeNow > s_uTimeLastECRecoveryStats + (SYSTEM_RT_INFO_INTERVALS/2) * g_SMControllerRTInfo.uUpdateIntervalMs) )
+   {
+      s_iLastECRecoveryStatsRTIndex = g_SMControllerRTInfo.iCurrentIndex;
+      s_uTimeLastECRecoveryStats = g_TimeNow;
+      return false;
+   }
+
+   pStats->uIntervalMs = g_TimeNow - s_uTimeLastECRecoveryStats;
+   int iIndex = s_iLastECRecoveryStatsRTIndex;
+   while ( iIndex != g_SMControllerRTInfo.iCurrentIndex )
+   {
+      pStats->uBlocksOutput += g_SMControllerRTInfo.uOutputedVideoBlocks[iIndex];
+      pStats->uBlocksLost += g_SMControllerRTInfo.uOutputedVideoPacketsSkippedBlocks[iIndex];
+      pStats->uBlocksECUsed[0] += g_SMControllerRTInfo.uOutputedVideoPacketsSingleECUsed[iIndex];
+      pStats->uBlocksECUsed[1] += g_SMControllerRTInfo.uOutputedVideoPacketsTwoECUsed[iIndex];
+      if ( g_SMControllerRTInfo.uOutputedVideoPacketsMultipleECUsed[iIndex] > 0 )
+      {
+         // Only the max is known for the blocks that needed more than two EC packets
+         int iECUsed = g_SMControllerRTInfo.uOutputedVideoPacketsMaxECUsed[iIndex];
+         if ( iECUsed < 3 )
+            iECUsed = 3;
+         if ( iECUsed > VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE )
+            iECUsed = VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE;
+         pStats->uBlocksECUsed[iECUsed-1] += g_SMControllerRTInfo.uOutputedVideoPacketsMultipleECUsed[iIndex];
+      }
+      iIndex++;
+      if ( iIndex >= SYSTEM_RT_INFO_INTERVALS )
+         iIndex = 0;
+   }
+   s_iLastECRecoveryStatsRTIndex = iIndex;
+   s_uTimeLastECRecoveryStats = g_TimeNow;
+   return true;
+}
+
+void _adaptive_video_send_ec_recovery_stats(t_packet_data_video_ec_recovery_stats* pStats, shared_mem_video_stream_stats* pSMVideoStreamInfo, u32 uVehicleId)
+{
+   pStats->uVideoStreamIndex = 0;
+   pStats->uBlockDataPackets = pSMVideoStreamInfo->PHVF.uCurrentBlockDataPackets;
+   pStats->uBlockECPackets = pSMVideoStreamInfo->PHVF.uCurrentBlockECPackets;
+
+   t_packet_header PH;
+   radio_packet_init(&PH, PACKET_COMPONENT_VIDEO, PACKET_TYPE_VIDEO_EC_RECOVERY_STATS, STREAM_ID_DATA);
+   PH.vehicle_id_src = g_uControllerId;
+   PH.vehicle_id_dest = uVehicleId;
+   PH.total_length = sizeof(t_packet_header) + sizeof(t_packet_data_video_ec_recovery_stats);
+
+   u8 packet[MAX_PACKET_TOTAL_SIZE];
+   memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
+   memcpy(packet+sizeof(t_packet_header), (u8*)pStats, sizeof(t_packet_data_video_ec_recovery_stats));
+   packets_queue_add_packet(&s_QueueRadioPacketsHighPrio, packet);
+}
+
 void _adaptive_video_check_vehicle(Model* pModel, type_global_state_vehicle_runtime_info* pRuntimeInfo, shared_mem_video_stream_stats* pSMVideoStreamInfo)
 {
    if ( (NULL == pRuntimeInfo) || (NULL == pSMVideoStreamInfo) || (NULL == pModel) )
@@ -294,6 +357,11 @@ void adaptive_video_periodic_loop(bool bForceSyncNow)
       log_line("[AdaptiveVideo] Resumed after pause.");
       s_uTimePauseAdaptiveVideoUntil = 0;
    }
+
+   t_packet_data_video_ec_recovery_stats ECRecoveryStats;
+   bool bSendECRecoveryStats = false;
+   if ( g_TimeNow >= s_uTimeLastECRecoveryStats + ADAPTIVE_FEC_STATS_INTERVAL_MS )
+      bSendECRecoveryStats = _adaptive_video_compute_ec_recovery_stats(&ECRecoveryStats);
    
    for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
    {
@@ -314,6 +382,11 @@ void adaptive_video_periodic_loop(bool bForceSyncNow)
       if ( (NULL == pSMVideoStreamInfo) || (NULL == pProcessorRxVideo) )
          continue;
 
+      if ( bSendECRecoveryStats )
+      if ( pSMVideoStreamInfo->PHVF.uCurrentVideoLinkProfile < MAX_VIDEO_LINK_PROFILES )
+      if ( pModel->video_link_profiles[pSMVideoStreamInfo->PHVF.uCurrentVideoLinkProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_AUTO_EC_SCHEME )
+         _adaptive_video_send_ec_recovery_stats(&ECRecoveryStats, pSMVideoStreamInfo, pModel->uVehicleId);
+
       if ( (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags) & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_LINK )
          _adaptive_video_check_vehicle(pModel, pRuntimeInfo, pSMVideoStreamInfo);
 
@@ -40,6 +40,7 @@
 #include "../radio/radiolink.h"
 #include "../radio/radiopackets2.h"
 #include "../radio/radio_tx.h"
+#include "../radio/radio_diversity.h"
 #include "../base/ctrl_interfaces.h"
 
 #include "radio_links_sik.h"
@@ -49,7 +50,7 @@
 #include "timers.h"
 #include "test_link_params.h"
 
-u8 s_RadioRawPacket[MAX_PACKET_TOTAL_SIZE];
+u8 s_RadioRawPacket[MAX_PACKET_LENGTH_PCAP];
 
 u32 s_StreamsTxPacketIndex[MAX_RADIO_STREAMS];
 u16 s_StreamsLastTxTime[MAX_RADIO_STREAMS];
@@ -147,6 +148,11 @@ void _computeBestTXCardsForEachLocalRadioLink(int* pIndexCardsForRadioLinks)
          continue;
       }
    
+      bool bIsCandidateCard[MAX_RADIO_INTERFACES];
+      int iBestScoreCard = -1;
+      for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+         bIsCandidateCard[i] = false;
+
       for( int i=0; i<hardware_get_radio_interfaces_count(); i++ )
       {
          radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(i);
@@ -167,6 +173,11 @@ void _computeBestTXCardsForEachLocalRadioLink(int* pIndexCardsForRadioLinks)
          if ( (iRadioLinkForCard < 0) || (iRadioLinkForCard != iRadioLink) )
             continue;
 
+         bIsCandidateCard[i] = true;
+         if ( g_SM_RadioStats.radio_interfaces_local[i].iDiversityScore >= 0 )
+         if ( (-1 == iBestScoreCard) || (g_SM_RadioStats.radio_interfaces_local[i].iDiversityScore > g_SM_RadioStats.radio_interfaces_local[iBestScoreCard].iDiversityScore) )
+            iBestScoreCard = i;
+
          if ( -1 == pIndexCardsForRadioLinks[iRadioLink] )
          {
             pIndexCardsForRadioLinks[iRadioLink] = i;
@@ -178,6 +189,23 @@ void _computeBestTXCardsForEachLocalRadioLink(int* pIndexCardsForRadioLinks)
             iBestRXQualityForRadioLink[iRadioLink] = g_SM_RadioStats.radio_interfaces[i].rxRelativeQuality;
          }
       }
+
+      // Use the card that receives best from the vehicle (receive diversity score), if scores are computed.
+      // Keep the current tx card unless another card is clearly better, so the tx card does not flip on each packet.
+      if ( iBestScoreCard >= 0 )
+      {
+         int iCurrentTxCard = g_SM_RadioStats.radio_links[iRadioLink].lastTxInterfaceIndex;
+         if ( (iCurrentTxCard >= 0) && (iCurrentTxCard < MAX_RADIO_INTERFACES) && (iCurrentTxCard != iBestScoreCard) && bIsCandidateCard[iCurrentTxCard] )
+         {
+            if ( g_SM_RadioStats.radio_interfaces_local[iCurrentTxCard].iDiversityScore + RADIO_DIVERSITY_TX_SWITCH_MARGIN > g_SM_RadioStats.radio_interfaces_local[iBestScoreCard].iDiversityScore )
+               iBestScoreCard = iCurrentTxCard;
+            else
+               log_line("Switching Tx card for local radio link %d from card %d to card %d (rx diversity score: %d, %d)",
+                  iRadioLink+1, iCurrentTxCard+1, iBestScoreCard+1,
+                  g_SM_RadioStats.radio_interfaces_local[iCurrentTxCard].iDiversityScore, g_SM_RadioStats.radio_interfaces_local[iBestScoreCard].iDiversityScore);
+         }
+         pIndexCardsForRadioLinks[iRadioLink] = iBestScoreCard;
+      }
       if ( s_bFirstTimeLogTxAssignment )
       {
          if ( -1 == pIndexCardsForRadioLinks[iRadioLink] )
@@ -411,7 +439,7 @@ bool _send_packet_to_serial_radio_interface(int iLocalRadioLinkId, int iRadioInt
    return bPacketsSent;
 }
 
-bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInterfaceIndex, u8* pPacketData, int nPacketLength)
+bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInterfaceIndex, u8* pPacketData, int nPacketLength, bool bHasHeadroom)
 {
    if ( (NULL == pPacketData) || (nPacketLength <= 0) || (NULL == g_pCurrentModel) )
       return false;
@@ -427,7 +455,6 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
    u32 microT = get_current_timestamp_micros();
 
    u32 radioFlags = g_pCurrentModel->radioLinksParams.link_radio_flags[iVehicleRadioLinkId];
-   radio_set_frames_flags(radioFlags);
 
    int nRateTx = compute_packet_uplink_datarate(iVehicleRadioLinkId, iRadioInterfaceIndex, &(g_pCurrentModel->radioLinksParams));
    
@@ -437,7 +464,7 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
    if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_FLAGS_MASK_COMPRESSED_HEADER )
    if ( pPH->packet_type == PACKET_TYPE_RUBY_PAIRING_REQUEST )
       nRateTx = DEFAULT_RADIO_DATARATE_LOWEST;
-   radio_set_out_datarate(nRateTx);
+   const t_radio_tx_template* pTxTemplate = radio_get_tx_template(nRateTx, radioFlags, RADIO_PORT_ROUTER_UPLINK);
 
    if ( test_link_is_in_progress() )
       log_line("Test link in progress. Sending radio packet using datarate: %d", nRateTx);
@@ -454,8 +481,14 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
    if ( hpp() )
       be = 1;
 
-   int totalLength = radio_build_new_raw_packet(iLocalRadioLinkId, s_RadioRawPacket, pPacketData, nPacketLength, RADIO_PORT_ROUTER_UPLINK, be);
-   if ( radio_write_raw_packet(iRadioInterfaceIndex, s_RadioRawPacket, totalLength) )
+   // Encrypted packets grow and must not change the caller's buffer, so they are always copied
+   u8* pRawPacket = s_RadioRawPacket;
+   int totalLength = 0;
+   if ( bHasHeadroom && (0 == be) )
+      totalLength = radio_build_new_raw_packet_in_headroom_with_template(pTxTemplate, iLocalRadioLinkId, pPacketData, nPacketLength, &pRawPacket);
+   else
+      totalLength = radio_build_new_raw_packet_with_template(pTxTemplate, iLocalRadioLinkId, s_RadioRawPacket, pPacketData, nPacketLength, be);
+   if ( (totalLength > 0) && radio_write_raw_packet(iRadioInterfaceIndex, pRawPacket, totalLength) )
    {
       radio_stats_update_on_packet_sent_on_radio_interface(&g_SM_RadioStats, g_TimeNow, iRadioInterfaceIndex, nPacketLength);
       radio_stats_set_tx_radio_datarate_for_packet(&g_SM_RadioStats, iRadioInterfaceIndex, iLocalRadioLinkId, nRateTx, 0);
@@ -513,7 +546,7 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
    return false;
 }
 
-int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, int iTraceSource)
+int _send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, int iTraceSource, bool bHasHeadroom)
 {
    if ( nPacketLength <= 0 )
       return -1;
@@ -669,7 +702,7 @@ int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSen
          bPacketSent |= _send_packet_to_serial_radio_interface(iLocalRadioLinkId, iRadioInterfaceIndex, pPacketData, nPacketLength);
       }
       else
-         bPacketSent |= _send_packet_to_wifi_radio_interface(iLocalRadioLinkId, iRadioInterfaceIndex, pPacketData, nPacketLength);
+         bPacketSent |= _send_packet_to_wifi_radio_interface(iLocalRadioLinkId, iRadioInterfaceIndex, pPacketData, nPacketLength, bHasHeadroom);
    }
 
 
@@ -733,6 +766,16 @@ int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSen
    return 0;
 }
 
+int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, int iTraceSource)
+{
+   return _send_packet_to_radio_interfaces(pPacketData, nPacketLength, iSendToSingleRadioLink, iTraceSource, false);
+}
+
+int send_packet_with_headroom_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, int iTraceSource)
+{
+   return _send_packet_to_radio_interfaces(pPacketData, nPacketLength, iSendToSingleRadioLink, iTraceSource, true);
+}
+
 int get_controller_radio_link_stats_size()
 {
    #ifdef FEATURE_VEHICLE_COMPUTES_ADAPTIVE_VIDEO
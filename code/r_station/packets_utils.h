@@ -7,6 +7,8 @@ void packet_utils_init();
 int compute_packet_uplink_datarate(int iVehicleRadioLink, int iRadioInterface, type_radio_links_parameters* pRadioLinksParams);
 
 int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, int iTraceSrouce);
+// pPacketData must have RADIO_PACKET_HEADROOM free bytes in front of it; radio headers are written there, without copying the packet
+int send_packet_with_headroom_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, int iTraceSrouce);
 
 int get_controller_radio_link_stats_size();
 void add_controller_radio_link_stats_to_buffer(u8* pDestBuffer);
@@ -43,6 +43,7 @@
 #include "../base/ruby_ipc.h"
 #include "../base/parser_h264.h"
 #include "../base/camera_utils.h"
+#include "../base/telemetry_delta.h"
 #include "../common/string_utils.h"
 #include "../common/radio_stats.h"
 #include "../common/models_connect_frequencies.h"
@@ -75,12 +76,17 @@ ParserH264 s_ParserH264RadioInput;
 u32 s_uLastReceivedAlarmsIndexes[MAX_ALARMS_HISTORY];
 u32 s_uTimeLastReceivedAlarm = 0;
 
+t_telemetry_delta_decoder s_TelemetryDeltaDecoder;
+u8 s_uTelemetryDeltaDecodedPacket[MAX_PACKET_TOTAL_SIZE];
+u32 s_uTimeLastTelemetryDeltaLog = 0;
+
 void init_radio_rx_structures()
 {
    for( int i=0; i<MAX_ALARMS_HISTORY; i++ )
       s_uLastReceivedAlarmsIndexes[i] = MAX_U32;
 
    s_ParserH264RadioInput.init();
+   telemetry_delta_decoder_init(&s_TelemetryDeltaDecoder);
 }
 
 int _process_received_ruby_message(int iInterfaceIndex, u8* pPacketBuffer)
@@ -618,6 +624,22 @@ void _check_update_first_pairing_done_if_needed(int iInterfaceIndex, u8* pPacket
 
 int process_received_single_radio_packet(int iInterfaceIndex, u8* pData, int iDataLength)
 {
+   // Delta encoded telemetry: rebuild the original packet, the rest of the processing only sees that
+   if ( (((t_packet_header*)pData)->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_TELEMETRY )
+   if ( ((t_packet_header*)pData)->packet_type == PACKET_TYPE_RUBY_TELEMETRY_DELTA )
+   {
+      int iLength = telemetry_delta_decode(&s_TelemetryDeltaDecoder, pData, iDataLength, s_uTelemetryDeltaDecodedPacket);
+      if ( g_TimeNow >= s_uTimeLastTelemetryDeltaLog + 10000 )
+      {
+         s_uTimeLastTelemetryDeltaLog = g_TimeNow;
+         telemetry_delta_decoder_log_info(&s_TelemetryDeltaDecoder);
+      }
+      if ( iLength <= 0 )
+         return 0;
+      pData = s_uTelemetryDeltaDecodedPacket;
+      iDataLength = iLength;
+   }
+
    t_packet_header* pPH = (t_packet_header*)pData;
    t_packet_header_compressed* pPHC = (t_packet_header_compressed*)pData;
 
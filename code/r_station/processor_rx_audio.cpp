@@ -32,6 +32,9 @@
 #include "../base/base.h"
 #include "../base/config.h"
 #include "../base/hw_procs.h"
+#include "../base/audio_codec.h"
+#include "../base/audio_jitter_buffer.h"
+#include "../base/audio_output.h"
 #include "processor_rx_audio.h"
 
 #include "../radio/radiopackets2.h"
@@ -43,14 +46,20 @@
 #include "shared_vars.h"
 #include "timers.h"
 
+// Max samples written to the audio output at once (fits in PIPE_BUF bytes)
+#define AUDIO_OUTPUT_CHUNK_SAMPLES 1024
+// Silence written when the output starts, so the player has some audio ahead
+#define AUDIO_OUTPUT_PREFILL_MS 20
+
 bool s_bHasAudioOutputDevice = false;
-int s_fPipeAudio = -1;
+bool s_bAudioPlayerStarted = false;
 
 u32 s_uCurrentRxAudioBlockIndex = MAX_U32;
 
 u32 s_AudioPacketsPerBlock = 0;
 u32 s_AudioFECPerBlock = 0;
 u32 s_AudioPacketSize = 0;
+bool s_bAudioCodecADPCM = false;
 
 u8 s_BufferAudioPackets[MAX_BUFFERED_AUDIO_PACKETS][MAX_PACKET_PAYLOAD];
 bool s_BufferAudioPacketsReceived[MAX_BUFFERED_AUDIO_PACKETS];
@@ -66,10 +75,16 @@ u8* fec_decode_audio_data_packets[MAX_TOTAL_PACKETS_IN_BLOCK];
 u8* fec_decode_audio_fec_packets[MAX_TOTAL_PACKETS_IN_BLOCK];
 unsigned int missing_audio_packets_count_for_fec = 0;
 
+t_audio_jitter_buffer s_AudioJitterBuffer;
+t_audio_output s_AudioOutput;
+t_audio_stream_parser s_AudioStreamParser;
+short s_sAudioDecodedSamples[MAX_PACKET_PAYLOAD*2 + AUDIO_STREAM_PARSER_MAX_HELD_BYTES];
+u32 s_uAudioOutputLastTimeMicros = 0;
+u64 s_uAudioOutputDueSamplesFrac = 0;
+u32 s_uTimeLastAudioLogInfo = 0;
+
 int s_iAudioRecordingSegment = 0;
 FILE* s_pFileAudioRecording = NULL;
-int s_iTokenPositionToCheck = 0;
-char s_szAudioToken[24];
 
 FILE* s_pFileRawStream = NULL;
 
@@ -81,9 +96,9 @@ void _stop_audio_player_and_pipe()
       return;
    }
 
-   if ( -1 != s_fPipeAudio )
-      close(s_fPipeAudio);
-   s_fPipeAudio = -1;
+   if ( s_bAudioPlayerStarted )
+      audio_output_close(&s_AudioOutput);
+   s_bAudioPlayerStarted = false;
 
    char szComm[256];
    char szOutput[128];
@@ -116,18 +131,51 @@ void _start_audio_player_and_pipe()
       return;
    }
 
-   char szComm[128];
-   sprintf(szComm, "aplay -c 1 --rate 44100 --format S16_LE %s 2>/dev/null &", FIFO_RUBY_AUDIO1);
-   hw_execute_bash_command(szComm, NULL);
+   #ifdef FEATURE_AUDIO_ALSA
+   if ( audio_output_open(&s_AudioOutput, AUDIO_OUTPUT_ALSA, AUDIO_SAMPLE_RATE, NULL) )
+      s_bAudioPlayerStarted = true;
+   else
+      log_softerror_and_alarm("[AudioRx] Failed to open ALSA audio output, use aplay.");
+   #endif
 
-   log_line("[AudioRx] Opening audio pipe write endpoint: %s", FIFO_RUBY_AUDIO1);
-   s_fPipeAudio = open(FIFO_RUBY_AUDIO1, O_WRONLY);
-   if ( s_fPipeAudio < 0 )
+   if ( ! s_bAudioPlayerStarted )
    {
-      log_error_and_alarm("[AudioRx] Failed to open audio pipe write endpoint: %s",FIFO_RUBY_AUDIO1);
-      return;
+      char szComm[128];
+      sprintf(szComm, "aplay -t raw -c 1 --rate %d --format S16_LE %s 2>/dev/null &", AUDIO_SAMPLE_RATE, FIFO_RUBY_AUDIO1);
+      hw_execute_bash_command(szComm, NULL);
+
+      log_line("[AudioRx] Opening audio pipe write endpoint: %s", FIFO_RUBY_AUDIO1);
+      if ( ! audio_output_open(&s_AudioOutput, AUDIO_OUTPUT_PIPE, AUDIO_SAMPLE_RATE, FIFO_RUBY_AUDIO1) )
+      {
+         log_error_and_alarm("[AudioRx] Failed to open audio pipe write endpoint: %s",FIFO_RUBY_AUDIO1);
+         return;
+      }
+      log_line("[AudioRx] Opened successfully audio pipe write endpoint: %s", FIFO_RUBY_AUDIO1);
+      s_bAudioPlayerStarted = true;
    }
-   log_line("[AudioRx] Opened successfully audio pipe write endpoint: %s", FIFO_RUBY_AUDIO1);
+
+   short sSilence[AUDIO_OUTPUT_CHUNK_SAMPLES];
+   memset(sSilence, 0, sizeof(sSilence));
+   int iPrefill = (AUDIO_SAMPLE_RATE * AUDIO_OUTPUT_PREFILL_MS) / 1000;
+   if ( iPrefill > AUDIO_OUTPUT_CHUNK_SAMPLES )
+      iPrefill = AUDIO_OUTPUT_CHUNK_SAMPLES;
+   audio_output_write(&s_AudioOutput, sSilence, iPrefill);
+   s_uAudioOutputLastTimeMicros = get_current_timestamp_micros();
+   s_uAudioOutputDueSamplesFrac = 0;
+}
+
+// Frames are sized by the vehicle EC scheme packet size
+void _init_audio_jitter_buffer()
+{
+   int iFrameSamples = s_AudioPacketSize / sizeof(short);
+   if ( s_bAudioCodecADPCM )
+      iFrameSamples = audio_adpcm_get_frame_samples(s_AudioPacketSize);
+
+   int iLatencyMs = DEFAULT_AUDIO_OUTPUT_LATENCY_MS;
+   if ( (NULL != g_pCurrentModel) && (0 != ((g_pCurrentModel->audio_params.flags >> 24) & 0xFF)) )
+      iLatencyMs = 10 * ((g_pCurrentModel->audio_params.flags >> 24) & 0xFF);
+   audio_jitter_buffer_init(&s_AudioJitterBuffer, AUDIO_SAMPLE_RATE, iFrameSamples, iLatencyMs, MAX_AUDIO_OUTPUT_LATENCY_MS);
+   audio_stream_parser_init(&s_AudioStreamParser);
 }
 
 void _reset_current_audio_rx_block()
@@ -138,77 +186,55 @@ void _reset_current_audio_rx_block()
    s_uReceivedECPacketsForCurrentBlock = 0;
 }
 
-void _output_audio_block(u32 uBlockIndex, u32 uPacketIndex, u32 uAudioSize)
+void _record_audio_samples(short* pSamples, int iCount, bool bBreakFound)
 {
-   s_uLastOutputedBlockIndex = uBlockIndex;
-   s_uLastOutputedPacketIndex = uPacketIndex;
-
-   int iBreakFoundPosition = -1;
-   u8* pData = &s_BufferAudioPackets[uPacketIndex][0];
-
-   for( int i=0; i<(int)uAudioSize; i++ )
-   {
-      if ( (*pData) != s_szAudioToken[s_iTokenPositionToCheck] )
-      {
-         s_iTokenPositionToCheck = 0;
-         pData++;
-         continue;
-      }
-      pData++;
-      s_iTokenPositionToCheck++;
-      if ( s_szAudioToken[s_iTokenPositionToCheck] == 0 )
-      {
-         iBreakFoundPosition = i+1;
-         break;
-      }
-   }
-
-   if ( iBreakFoundPosition == -1 )
-   {
-      if ( s_fPipeAudio != -1 )
-         write(s_fPipeAudio, &s_BufferAudioPackets[uPacketIndex][0], uAudioSize);
-      #ifdef FEATURE_LOCAL_AUDIO_RECORDING
-      if ( NULL != s_pFileAudioRecording )
-        fwrite(&s_BufferAudioPackets[uPacketIndex][0], 1, uAudioSize, s_pFileAudioRecording);
-      #endif
-      return;
-   }
-
    #ifdef FEATURE_LOCAL_AUDIO_RECORDING
-   if ( NULL != s_pFileAudioRecording )
+   if ( bBreakFound )
    {
-      fclose(s_pFileAudioRecording);
-      s_pFileAudioRecording = NULL;
+      if ( NULL != s_pFileAudioRecording )
+         fclose(s_pFileAudioRecording);
+      s_iAudioRecordingSegment++;
+      char szBuff[128];
+      sprintf(szBuff, "%s%s%d", FOLDER_RUBY_TEMP, FILE_TEMP_AUDIO_RECORDING, s_iAudioRecordingSegment);
+      s_pFileAudioRecording = fopen(szBuff, "wb");
    }
+   if ( (NULL != s_pFileAudioRecording) && (iCount > 0) )
+      fwrite(pSamples, sizeof(short), iCount, s_pFileAudioRecording);
    #endif
+}
 
-   if ( iBreakFoundPosition >= 0 )
-   {
-      _stop_audio_player_and_pipe();
-      _start_audio_player_and_pipe();
+// Decodes the audio packet and adds it to the jitter buffer
 
-      int iToOutput = (int)uAudioSize - iBreakFoundPosition;
+void _output_audio_block(u32 uBlockIndex, u32 uPacketIndex, u32 uAudioSize)
+{
+   s_uLastOutputedBlockIndex = uBlockIndex;
+   s_uLastOutputedPacketIndex = uPacketIndex;
 
-      if ( (iToOutput > 0) && (s_fPipeAudio != -1) )
-         write(s_fPipeAudio, &s_BufferAudioPackets[uPacketIndex][iBreakFoundPosition], iToOutput);
-   
-      #ifdef FEATURE_LOCAL_AUDIO_RECORDING
-      s_iAudioRecordingSegment++;
-      char szBuff[128];
-      sprintf(szBuff, "%s%s%d", FOLDER_RUBY_TEMP, FILE_TEMP_AUDIO_RECORDING, s_iAudioRecordingSegment);
-      s_pFileAudioRecording = fopen(szBuff, "wb");
+   if ( ! s_bAudioPlayerStarted )
+      return;
 
-      if ( NULL != s_pFileAudioRecording )
-      if ( iToOutput > 0 )
-         fwrite(&s_BufferAudioPackets[uPacketIndex][iBreakFoundPosition], 1, iToOutput, s_pFileAudioRecording);
-      #endif
+   u8* pData = &s_BufferAudioPackets[uPacketIndex][0];
+   int iCountSamples = 0;
+   bool bBreakFound = false;
+
+   if ( s_bAudioCodecADPCM )
+      iCountSamples = audio_adpcm_decode_frame(pData, (int)uAudioSize, s_sAudioDecodedSamples);
+   else
+   {
+      int iBreak = 0;
+      iCountSamples = audio_stream_parser_add(&s_AudioStreamParser, pData, (int)uAudioSize, s_sAudioDecodedSamples, &iBreak);
+      bBreakFound = (iBreak != 0);
    }
+   _record_audio_samples(s_sAudioDecodedSamples, iCountSamples, bBreakFound);
+
+   u32 uSequence = uBlockIndex * s_AudioPacketsPerBlock + uPacketIndex;
+   audio_jitter_buffer_push(&s_AudioJitterBuffer, uSequence, s_sAudioDecodedSamples, iCountSamples, get_current_timestamp_micros());
 }
 
 
 void _try_reconstruct_and_output_audio()
 {
-   if ( -1 == s_fPipeAudio )
+   if ( ! s_bAudioPlayerStarted )
       return;
 
    if ( s_uReceivedDataPacketsForCurrentBlock + s_uReceivedECPacketsForCurrentBlock < s_AudioPacketsPerBlock )
@@ -245,10 +271,26 @@ void _try_reconstruct_and_output_audio()
 
    fec_decode(s_AudioPacketSize, fec_decode_audio_data_packets, (unsigned int) s_AudioPacketsPerBlock, fec_decode_audio_fec_packets, fec_decode_audio_fec_indexes, fec_decode_audio_missing_packets, missing_audio_packets_count_for_fec );
 
-   for( u32 i=0; i<s_AudioPacketsPerBlock; i++ )
+   u32 uStart = 0;
+   if ( (s_uLastOutputedBlockIndex == s_uCurrentRxAudioBlockIndex) && (s_uLastOutputedPacketIndex != MAX_U32) )
+      uStart = s_uLastOutputedPacketIndex + 1;
+   for( u32 i=uStart; i<s_AudioPacketsPerBlock; i++ )
       _output_audio_block(s_uCurrentRxAudioBlockIndex, (u32)i, s_AudioPacketSize);
 }
 
+// Outputs the received data packets of the current block that are still pending. The missing ones are concealed.
+void _output_received_audio_packets_of_current_block()
+{
+   u32 uStart = 0;
+   if ( (s_uLastOutputedBlockIndex == s_uCurrentRxAudioBlockIndex) && (s_uLastOutputedPacketIndex != MAX_U32) )
+      uStart = s_uLastOutputedPacketIndex + 1;
+   for( u32 i=uStart; i<s_AudioPacketsPerBlock; i++ )
+   {
+      if ( s_BufferAudioPacketsReceived[i] )
+         _output_audio_block(s_uCurrentRxAudioBlockIndex, i, s_AudioPacketSize);
+   }
+}
+
 void init_processing_audio()
 {
    s_uCurrentRxAudioBlockIndex = MAX_U32;
@@ -259,14 +301,18 @@ void init_processing_audio()
 
    s_AudioPacketsPerBlock = 4;
    s_AudioFECPerBlock = 2;
+   s_AudioPacketSize = MAX_PACKET_PAYLOAD - 100;
+   s_bAudioCodecADPCM = false;
    if ( NULL != g_pCurrentModel )
    {
       s_AudioPacketsPerBlock = g_pCurrentModel->audio_params.flags & 0xFF;
       s_AudioFECPerBlock = (g_pCurrentModel->audio_params.flags >> 8) & 0xFF;
+      s_bAudioCodecADPCM = (g_pCurrentModel->audio_params.flags & AUDIO_FLAGS_CODEC_ADPCM)?true:false;
    }
 
-   s_fPipeAudio = -1;
+   s_bAudioPlayerStarted = false;
    s_bHasAudioOutputDevice = false;
+   _init_audio_jitter_buffer();
 
    if ( (NULL != g_pCurrentModel) && (! g_pCurrentModel->audio_params.has_audio_device) )
    {
@@ -286,11 +332,7 @@ void init_processing_audio()
 
 
    s_iAudioRecordingSegment = 0;
-
-   s_iTokenPositionToCheck = 0;
-   strcpy(s_szAudioToken, "0123456789");
-   s_szAudioToken[10] = 10;
-   s_szAudioToken[11] = 0;
+   log_line("[AudioRx] Audio codec: %s, EC scheme: %u/%u", s_bAudioCodecADPCM?"IMA ADPCM":"PCM", s_AudioPacketsPerBlock, s_AudioFECPerBlock);
   
    _start_audio_player_and_pipe();
 
@@ -302,12 +344,66 @@ void uninit_processing_audio()
 {
    _stop_audio_player_and_pipe();
 
+   #ifdef FEATURE_LOCAL_AUDIO_RECORDING
+   if ( NULL != s_pFileAudioRecording )
+      fclose(s_pFileAudioRecording);
+   s_pFileAudioRecording = NULL;
+   #endif
 
    if ( NULL != s_pFileRawStream )
       fclose(s_pFileRawStream);
    s_pFileRawStream = NULL;
 }
 
+// Plays the audio at the output sample rate, using the local clock
+
+void periodic_loop_processing_audio()
+{
+   if ( ! s_bAudioPlayerStarted )
+      return;
+
+   u32 uTimeNowMicros = get_current_timestamp_micros();
+   s_uAudioOutputDueSamplesFrac += (u64)(uTimeNowMicros - s_uAudioOutputLastTimeMicros) * AUDIO_SAMPLE_RATE;
+   s_uAudioOutputLastTimeMicros = uTimeNowMicros;
+   int iDueSamples = (int)(s_uAudioOutputDueSamplesFrac / 1000000);
+   s_uAudioOutputDueSamplesFrac -= (u64)iDueSamples * 1000000;
+
+   // Loop was stalled: skip the audio time that was missed instead of adding latency
+   if ( iDueSamples > AUDIO_SAMPLE_RATE/5 )
+   {
+      short sSkip[AUDIO_OUTPUT_CHUNK_SAMPLES];
+      int iSkip = iDueSamples - AUDIO_OUTPUT_CHUNK_SAMPLES;
+      while ( iSkip > 0 )
+      {
+         int iChunk = (iSkip > AUDIO_OUTPUT_CHUNK_SAMPLES)?AUDIO_OUTPUT_CHUNK_SAMPLES:iSkip;
+         audio_jitter_buffer_pull(&s_AudioJitterBuffer, sSkip, iChunk);
+         iSkip -= iChunk;
+      }
+      iDueSamples = AUDIO_OUTPUT_CHUNK_SAMPLES;
+   }
+
+   short sSamples[AUDIO_OUTPUT_CHUNK_SAMPLES];
+   while ( iDueSamples > 0 )
+   {
+      int iChunk = (iDueSamples > AUDIO_OUTPUT_CHUNK_SAMPLES)?AUDIO_OUTPUT_CHUNK_SAMPLES:iDueSamples;
+      audio_jitter_buffer_pull(&s_AudioJitterBuffer, sSamples, iChunk);
+      if ( audio_output_write(&s_AudioOutput, sSamples, iChunk) < 0 )
+      {
+         log_softerror_and_alarm("[AudioRx] Audio output failed. Restart audio player.");
+         _stop_audio_player_and_pipe();
+         _start_audio_player_and_pipe();
+         return;
+      }
+      iDueSamples -= iChunk;
+   }
+
+   if ( g_TimeNow >= s_uTimeLastAudioLogInfo + 10000 )
+   {
+      s_uTimeLastAudioLogInfo = g_TimeNow;
+      audio_jitter_buffer_log_info(&s_AudioJitterBuffer);
+   }
+}
+
 void process_received_audio_packet(u8* pPacketBuffer)
 {
    t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
@@ -317,14 +413,23 @@ void process_received_audio_packet(u8* pPacketBuffer)
    if ( NULL != s_pFileRawStream )
       fwrite(pPacketBuffer, 1, pPH->total_length, s_pFileRawStream);
 
+   if ( pPH->total_length <= sizeof(t_packet_header) + sizeof(u32) )
+      return;
+
    memcpy((u8*)&uAudioBlockSegmentIndex, pData, sizeof(u32));
    u32 uBlockIndex = uAudioBlockSegmentIndex>>8;
    u32 uPacketIndex = uAudioBlockSegmentIndex & 0xFF;
    pData += sizeof(u32);
 
-   u32 uAudioSize = pPH->total_length-sizeof(u32);
+   u32 uAudioSize = pPH->total_length - sizeof(t_packet_header) - sizeof(u32);
+   if ( uAudioSize > MAX_PACKET_PAYLOAD )
+      return;
 
-   s_AudioPacketSize = uAudioSize;
+   if ( uAudioSize != s_AudioPacketSize )
+   {
+      s_AudioPacketSize = uAudioSize;
+      _init_audio_jitter_buffer();
+   }
    
    if ( uPacketIndex >= MAX_BUFFERED_AUDIO_PACKETS )
       return;
@@ -346,11 +451,13 @@ void process_received_audio_packet(u8* pPacketBuffer)
 
    if ( uBlockIndex != s_uCurrentRxAudioBlockIndex )
    {
-      // Try reconstruction of last block if needed
-      if ( s_uLastOutputedPacketIndex < s_AudioPacketsPerBlock-1 )
-      if ( s_uReceivedDataPacketsForCurrentBlock + s_uReceivedECPacketsForCurrentBlock >= s_AudioPacketsPerBlock )
+      // Try reconstruction of last block if needed, or output what was received of it
+      if ( (s_uLastOutputedBlockIndex != s_uCurrentRxAudioBlockIndex) || (s_uLastOutputedPacketIndex < s_AudioPacketsPerBlock-1) )
       {
-         _try_reconstruct_and_output_audio();
+         if ( s_uReceivedDataPacketsForCurrentBlock + s_uReceivedECPacketsForCurrentBlock >= s_AudioPacketsPerBlock )
+            _try_reconstruct_and_output_audio();
+         else
+            _output_received_audio_packets_of_current_block();
       }
 
       s_uLastOutputedBlockIndex = s_uCurrentRxAudioBlockIndex;
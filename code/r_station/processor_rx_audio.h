@@ -6,3 +6,4 @@ void init_processing_audio();
 void uninit_processing_audio();
 
 void process_received_audio_packet(u8* pPacketBuffer);
+void periodic_loop_processing_audio();
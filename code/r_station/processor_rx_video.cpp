@@ -60,6 +60,7 @@
 #include "../radio/radiolink.h"
 #include "../radio/radiopackets2.h"
 #include "../radio/radiopacketsqueue.h"
+#include "../radio/video_nack.h"
 
 #include "shared_vars.h"
 #include "shared_vars_state.h"
@@ -889,37 +890,38 @@ int ProcessorRxVideo::handleReceivedVideoPacket(int interfaceNb, u8* pBuffer, in
 
       while ( m_pVideoRxBuffer->hasFirstVideoPacketInBuffer() )
       {
-         type_rx_video_packet_info* pVideoPacket = m_pVideoRxBuffer->getFirstVideoPacketInBuffer();
+         u8* pVideoPacket = m_pVideoRxBuffer->getFirstVideoPacketInBuffer();
          type_rx_video_block_info* pVideoBlock = m_pVideoRxBuffer->getFirstVideoBlockInBuffer();
-         if ( (NULL != pVideoBlock) && (NULL != pVideoPacket) && (NULL != pVideoPacket->pRawData) )
-         if ( ! pVideoPacket->bEmpty )
-         //if ( pVideoPacket->bEndOfFirstIFrameDetected )
-         if ( pVideoPacket->pPHVF->uCurrentBlockPacketIndex < pVideoPacket->pPHVF->uCurrentBlockDataPackets )
-         if ( NULL != pVideoPacket->pVideoData )
+         t_packet_header* pVideoPH = (t_packet_header*)pVideoPacket;
+         t_packet_header_video_full_98* pVideoPHVF = (NULL == pVideoPacket)?NULL:(t_packet_header_video_full_98*)(pVideoPacket + sizeof(t_packet_header));
+         if ( (NULL != pVideoBlock) && (NULL != pVideoPacket) )
+         if ( pVideoPHVF->uCurrentBlockPacketIndex < pVideoPHVF->uCurrentBlockDataPackets )
          {
-            u8* pVideoSource = pVideoPacket->pVideoData;
-            if ( pVideoPacket->pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
+            u8* pVideoSource = pVideoPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98);
+            if ( pVideoPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
             {
                //t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*)pVideoSource;
-               //log_line("DEBUG output skip debug info for [%u/%u], CRC %u", pVideoPacket->pPHVF->uCurrentBlockIndex, pVideoPacket->pPHVF->uCurrentBlockPacketIndex, pPHVFDebugInfo->uVideoCRC);
+               //log_line("DEBUG output skip debug info for [%u/%u], CRC %u", pVideoPHVF->uCurrentBlockIndex, pVideoPHVF->uCurrentBlockPacketIndex, pPHVFDebugInfo->uVideoCRC);
                pVideoSource += sizeof(t_packet_header_video_full_98_debug_info);
             }
 
              u16 uVideoSize = 0;
              memcpy(&uVideoSize, pVideoSource, sizeof(u16));
-             //u32 crc = base_compute_crc32(pVideoSource, pVideoPacket->pPHVF->uCurrentBlockPacketSize);
+             //u32 crc = base_compute_crc32(pVideoSource, pVideoPHVF->uCurrentBlockPacketSize);
              //log_line("DEBUG output [%u/%u] %d bytes, block size %d, packet length: %d, CRC %u", 
-             //   pVideoPacket->pPHVF->uCurrentBlockIndex, pVideoPacket->pPHVF->uCurrentBlockPacketIndex,
-             //    uVideoSize, pVideoPacket->pPHVF->uCurrentBlockPacketSize, pVideoPacket->pPH->total_length, crc);
+             //   pVideoPHVF->uCurrentBlockIndex, pVideoPHVF->uCurrentBlockPacketIndex,
+             //    uVideoSize, pVideoPHVF->uCurrentBlockPacketSize, pVideoPH->total_length, crc);
              pVideoSource += sizeof(u16);
 
              int iVideoWidth = getVideoWidth();
              int iVideoHeight = getVideoHeight();
 
-             rx_video_output_video_data(m_uVehicleId, (pVideoPacket->pPHVF->uVideoStreamIndexAndType >> 4) & 0x0F , iVideoWidth, iVideoHeight, pVideoSource, uVideoSize, pVideoPacket->pPH->total_length);
+             rx_video_output_video_data(m_uVehicleId, (pVideoPHVF->uVideoStreamIndexAndType >> 4) & 0x0F , iVideoWidth, iVideoHeight, pVideoSource, uVideoSize, pVideoPH->total_length);
 
              g_SMControllerRTInfo.uOutputedVideoPackets[g_SMControllerRTInfo.iCurrentIndex]++;
-             if ( pVideoPacket->pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED )
+             if ( 0 == pVideoPHVF->uCurrentBlockPacketIndex )
+                g_SMControllerRTInfo.uOutputedVideoBlocks[g_SMControllerRTInfo.iCurrentIndex]++;
+             if ( pVideoPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED )
                 g_SMControllerRTInfo.uOutputedVideoPacketsRetransmitted[g_SMControllerRTInfo.iCurrentIndex]++;
              if ( pVideoBlock->iReconstructedECUsed > 0 )
              {
@@ -1226,11 +1228,20 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
    char szDebug[1024];
    szDebug[0] = 0;
 
+   // Vehicles with older software only understand the list of (block, packet) requests
+   bool bUseBitmapRequest = (get_sw_version_build(pModel) >= VIDEO_NACK_MIN_SW_BUILD);
+
    u8 packet[MAX_PACKET_TOTAL_SIZE];
    m_uRequestRetransmissionUniqueId++;
    memcpy(packet + sizeof(t_packet_header), (u8*)&m_uRequestRetransmissionUniqueId, sizeof(u32));
    memcpy(packet + sizeof(t_packet_header) + sizeof(u32), (u8*)&m_uVideoStreamIndex, sizeof(u8));
    u8* pDataInfo = packet + sizeof(t_packet_header) + sizeof(u32) + 2*sizeof(u8);
+
+   t_video_nack_builder nackBuilder;
+   if ( bUseBitmapRequest )
+      video_nack_builder_init(&nackBuilder, packet + sizeof(t_packet_header), MAX_RETRANSMISSION_BITMAP_REQUEST_SIZE, m_uRequestRetransmissionUniqueId, (u8)m_uVideoStreamIndex);
+
+   // Oldest blocks first: they are the closest to their display deadline
    int iCountPacketsRequested = 0;
    int iCountBlocks = m_pVideoRxBuffer->getBlocksCountInBuffer();
    for( int i=0; i<iCountBlocks-1; i++ )
@@ -1239,44 +1250,72 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
       if ( NULL == pVideoBlock )
          continue;
       int iCountToRequestFromBlock = pVideoBlock->iBlockDataPackets - pVideoBlock->iRecvDataPackets - pVideoBlock->iRecvECPackets;
-      if ( iCountToRequestFromBlock > 0 )
-      {
-         for( int k=0; k<pVideoBlock->iBlockDataPackets; k++ )
-         {
-            if ( NULL == pVideoBlock->packets[k].pRawData )
-               continue;
-            if ( ! pVideoBlock->packets[k].bEmpty )
-               continue;
+      if ( iCountToRequestFromBlock <= 0 )
+         continue;
 
-            memcpy(pDataInfo, &pVideoBlock->uVideoBlockIndex, sizeof(u32));
-            pDataInfo += sizeof(u32);
-            u8 uPacketIndex = k;
-            memcpy(pDataInfo, &uPacketIndex, sizeof(u8));
-            pDataInfo += sizeof(u8);
+      u8 uMissingBitmap[VIDEO_NACK_BITMAP_BYTES];
+      memset(uMissingBitmap, 0, sizeof(uMissingBitmap));
+      int iCountMissing = 0;
+      u64 uMissingMask = video_rx_block_get_missing_data_packets(pVideoBlock);
+      while ( 0 != uMissingMask )
+      {
+         int k = __builtin_ctzll(uMissingMask);
+         uMissingMask &= uMissingMask - 1;
+         video_nack_set_packet_missing(uMissingBitmap, k);
+         iCountMissing++;
+         if ( iCountMissing == iCountToRequestFromBlock )
+            break;
+      }
+      if ( 0 == iCountMissing )
+         continue;
 
-            char szTmp[32];
-            sprintf(szTmp, "[%u/%d] ", pVideoBlock->uVideoBlockIndex, k);
-            strcat(szDebug, szTmp);
+      if ( bUseBitmapRequest )
+      {
+         if ( iCountPacketsRequested + iCountMissing > MAX_RETRANSMISSION_PACKETS_IN_BITMAP_REQUEST )
+            break;
+         if ( ! video_nack_builder_add_block(&nackBuilder, pVideoBlock->uVideoBlockIndex, uMissingBitmap) )
+            break;
+         iCountPacketsRequested += iCountMissing;
+         continue;
+      }
 
-            iCountToRequestFromBlock--;
-            iCountPacketsRequested++;
-            if ( iCountToRequestFromBlock == 0 )
-               break;
-            if ( iCountPacketsRequested > 20 )
-              break;
-         }
+      for( int k=0; k<pVideoBlock->iBlockDataPackets; k++ )
+      {
+         if ( ! video_nack_is_packet_missing(uMissingBitmap, k) )
+            continue;
+         memcpy(pDataInfo, &pVideoBlock->uVideoBlockIndex, sizeof(u32));
+         pDataInfo += sizeof(u32);
+         u8 uPacketIndex = k;
+         memcpy(pDataInfo, &uPacketIndex, sizeof(u8));
+         pDataInfo += sizeof(u8);
+
+         char szTmp[32];
+         sprintf(szTmp, "[%u/%d] ", pVideoBlock->uVideoBlockIndex, k);
+         strcat(szDebug, szTmp);
+
+         iCountPacketsRequested++;
+         if ( iCountPacketsRequested > MAX_RETRANSMISSION_PACKETS_IN_REQUEST )
+           break;
       }
-      if ( iCountPacketsRequested > 20 )
+      if ( iCountPacketsRequested > MAX_RETRANSMISSION_PACKETS_IN_REQUEST )
         break;
    }
 
    if ( iCountPacketsRequested == 0 )
       return 0;
 
-   u8 uCount = iCountPacketsRequested;
-   memcpy(packet + sizeof(t_packet_header) + sizeof(u32) + sizeof(u8), (u8*)&uCount, sizeof(u8));
-   PH.total_length = sizeof(t_packet_header) + sizeof(u32) + 2*sizeof(u8);
-   PH.total_length += iCountPacketsRequested*(sizeof(u32) + sizeof(u8)); 
+   if ( bUseBitmapRequest )
+   {
+      PH.packet_type = PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP;
+      PH.total_length = sizeof(t_packet_header) + video_nack_builder_get_length(&nackBuilder);
+   }
+   else
+   {
+      u8 uCount = iCountPacketsRequested;
+      memcpy(packet + sizeof(t_packet_header) + sizeof(u32) + sizeof(u8), (u8*)&uCount, sizeof(u8));
+      PH.total_length = sizeof(t_packet_header) + sizeof(u32) + 2*sizeof(u8);
+      PH.total_length += iCountPacketsRequested*(sizeof(u32) + sizeof(u8)); 
+   }
    memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
 
    m_uLastTimeRequestedRetransmission = g_TimeNow;
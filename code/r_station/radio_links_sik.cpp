@@ -36,6 +36,7 @@
 #include "../base/models.h"
 #include "../base/hardware_radio.h"
 #include "../base/hardware_radio_sik.h"
+#include "../base/hardware_serial.h"
 #include "../base/hw_procs.h"
 #include "../common/radio_stats.h"
 #include "../radio/radio_rx.h"
@@ -125,105 +126,195 @@ void radio_links_flag_reinit_sik_interface(int iInterfaceIndex)
    send_alarm_to_central(ALARM_ID_RADIO_INTERFACE_DOWN, g_SiKRadiosState.uSiKInterfaceIndexThatBrokeDown, 0);
 }
 
-static void * _reinit_sik_thread_func(void *ignored_argument)
+static t_sik_at_driver s_SiKATDriver;
+static bool s_bSiKATDriverActive = false;
+static int s_iSiKATDriverSerialPort = -1;
+static u32 s_uSiKATDriverFreqKhz = 0;
+static u32 s_uSiKATDriverDataRate = 0;
+static u32 s_uSiKATDriverTxPower = 0;
+static u32 s_uSiKATDriverECC = 0;
+static u32 s_uSiKATDriverLBT = 0;
+static u32 s_uSiKATDriverMCSTR = 0;
+static int s_iSiKATDriverFinalState = SIK_AT_STATE_IDLE;
+static u32 s_uSiKATDriverTimeFinished = 0;
+
+// After the radio reboot, how long to wait for its serial port to be back (i.e. USB radios)
+#define SIK_SERIAL_PORT_BACK_TIMEOUT_MS 5000
+
+static void _radio_links_sik_get_target_params(int iInterfaceIndex, radio_hw_info_t* pRadioHWInfo)
 {
-   log_line("[Router-SiKThread] Reinitializing SiK radio interfaces...");
+   t_ControllerRadioInterfaceInfo* pCRII = controllerGetRadioCardInfo(pRadioHWInfo->szMAC);
 
-   // radio serial ports are already closed at this point
+   s_uSiKATDriverFreqKhz = pRadioHWInfo->uHardwareParamsList[8];
+   s_uSiKATDriverDataRate = DEFAULT_RADIO_DATARATE_SIK_AIR;
+   s_uSiKATDriverTxPower = DEFAULT_RADIO_SIK_TX_POWER;
+   if ( NULL != pCRII )
+      s_uSiKATDriverTxPower = pCRII->iRawPowerLevel;
+   s_uSiKATDriverLBT = 0;
+   s_uSiKATDriverECC = 0;
+   s_uSiKATDriverMCSTR = 0;
 
-   if ( g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex >= 0 )
+   if ( NULL == g_pCurrentModel )
+      return;
+
+   int iRadioLink = g_pCurrentModel->radioInterfacesParams.interface_link_id[iInterfaceIndex];
+   if ( (iRadioLink < 0) || (iRadioLink >= g_pCurrentModel->radioLinksParams.links_count) )
+      return;
+
+   s_uSiKATDriverFreqKhz = g_pCurrentModel->radioLinksParams.link_frequency_khz[iRadioLink];
+   s_uSiKATDriverDataRate = g_pCurrentModel->radioLinksParams.link_datarate_data_bps[iRadioLink];
+   s_uSiKATDriverECC = (g_pCurrentModel->radioLinksParams.link_radio_flags[iRadioLink] & RADIO_FLAGS_SIK_ECC)? 1:0;
+   s_uSiKATDriverLBT = (g_pCurrentModel->radioLinksParams.link_radio_flags[iRadioLink] & RADIO_FLAGS_SIK_LBT)? 1:0;
+   s_uSiKATDriverMCSTR = (g_pCurrentModel->radioLinksParams.link_radio_flags[iRadioLink] & RADIO_FLAGS_SIK_MCSTR)? 1:0;
+
+   bool bDataRateOk = false;
+   for( int i=0; i<getSiKAirDataRatesCount(); i++ )
    {
-      log_line("[Router-SiKThread] Must reconfigure and reinitialize SiK radio interface %d...", g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1 );
-      if ( ! hardware_radio_index_is_sik_radio(g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex) )
-         log_softerror_and_alarm("[Router-SiKThread] Radio interface %d is not a SiK radio interface.", g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1 );
+      if ( (int)s_uSiKATDriverDataRate == getSiKAirDataRates()[i] )
+      {
+         bDataRateOk = true;
+         break;
+      }
+   }
+
+   if ( ! bDataRateOk )
+   {
+      log_softerror_and_alarm("[Router] Invalid radio datarate for SiK radio: %d bps. Revert to %d bps.", s_uSiKATDriverDataRate, DEFAULT_RADIO_DATARATE_SIK_AIR);
+      s_uSiKATDriverDataRate = DEFAULT_RADIO_DATARATE_SIK_AIR;
+   }
+}
+
+static void _radio_links_sik_on_reconfigure_finished(bool bSucceeded)
+{
+   if ( ! bSucceeded )
+   {
+      log_softerror_and_alarm("[Router] Failed to reconfigure SiK radio interface %d", g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1);
+      if ( g_SiKRadiosState.iThreadRetryCounter < 3 )
+         log_line("[Router] Will retry to reconfigure radio. Retry counter: %d", g_SiKRadiosState.iThreadRetryCounter);
       else
       {
-         radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex);
-         if ( NULL == pRadioHWInfo )
-            log_softerror_and_alarm("[Router-SiKThread] Failed to get radio hw info for radio interface %d.", g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1);
-         else
-         {
-            ControllerSettings* pCS = get_ControllerSettings();
-            ControllerInterfacesSettings* pCIS = get_ControllerInterfacesSettings();
-            t_ControllerRadioInterfaceInfo* pCRII = controllerGetRadioCardInfo(pRadioHWInfo->szMAC);
-
-            u32 uFreqKhz = pRadioHWInfo->uHardwareParamsList[8];
-            u32 uDataRate = DEFAULT_RADIO_DATARATE_SIK_AIR;
-            u32 uTxPower = DEFAULT_RADIO_SIK_TX_POWER;
-            if ( NULL != pCRII )
-               uTxPower = pCRII->iRawPowerLevel;
-            u32 uLBT = 0;
-            u32 uECC = 0;
-            u32 uMCSTR = 0;
-
-            if ( NULL != g_pCurrentModel )
-            {
-               int iRadioLink = g_pCurrentModel->radioInterfacesParams.interface_link_id[g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex];
-               if ( (iRadioLink >= 0) && (iRadioLink < g_pCurrentModel->radioLinksParams.links_count) )
-               {
-                  uFreqKhz = g_pCurrentModel->radioLinksParams.link_frequency_khz[iRadioLink];
-                  uDataRate = g_pCurrentModel->radioLinksParams.link_datarate_data_bps[iRadioLink];
-                  uECC = (g_pCurrentModel->radioLinksParams.link_radio_flags[iRadioLink] & RADIO_FLAGS_SIK_ECC)? 1:0;
-                  uLBT = (g_pCurrentModel->radioLinksParams.link_radio_flags[iRadioLink] & RADIO_FLAGS_SIK_LBT)? 1:0;
-                  uMCSTR = (g_pCurrentModel->radioLinksParams.link_radio_flags[iRadioLink] & RADIO_FLAGS_SIK_MCSTR)? 1:0;
-               
-                  bool bDataRateOk = false;
-                  for( int i=0; i<getSiKAirDataRatesCount(); i++ )
-                  {
-                     if ( (int)uDataRate == getSiKAirDataRates()[i] )
-                     {
-                        bDataRateOk = true;
-                        break;
-                     }
-                  }
-
-                  if ( ! bDataRateOk )
-                  {
-                     log_softerror_and_alarm("[Router-SiKThread] Invalid radio datarate for SiK radio: %d bps. Revert to %d bps.", uDataRate, DEFAULT_RADIO_DATARATE_SIK_AIR);
-                     uDataRate = DEFAULT_RADIO_DATARATE_SIK_AIR;
-                  }
-               }
-            }
-            int iRes = hardware_radio_sik_set_params(pRadioHWInfo, 
-                   uFreqKhz,
-                   DEFAULT_RADIO_SIK_FREQ_SPREAD, DEFAULT_RADIO_SIK_CHANNELS,
-                   DEFAULT_RADIO_SIK_NETID,
-                   uDataRate, uTxPower, 
-                   uECC, uLBT, uMCSTR,
-                   NULL);
-            if ( iRes != 1 )
-            {
-               log_softerror_and_alarm("[Router-SiKThread] Failed to reconfigure SiK radio interface %d", g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1);
-               if ( g_SiKRadiosState.iThreadRetryCounter < 3 )
-               {
-                  log_line("[Router-SiKThread] Will retry to reconfigure radio. Retry counter: %d", g_SiKRadiosState.iThreadRetryCounter);
-               }
-               else
-               {
-                  send_alarm_to_central(ALARM_ID_GENERIC_STATUS_UPDATE, ALARM_FLAG_GENERIC_STATUS_RECONFIGURED_RADIO_INTERFACE_FAILED, 0);
-                  radio_links_reopen_marked_sik_interfaces();
-  
-                  g_SiKRadiosState.bMustReinitSiKInterfaces = false;
-                  g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex = -1;
-                  g_SiKRadiosState.uSiKInterfaceIndexThatBrokeDown = MAX_U32;
-               }
-               log_line("[Router-SiKThread] Finished.");
-               g_SiKRadiosState.bConfiguringSiKThreadWorking = false;
-               return NULL;
-            }
-            else
-            {
-               log_line("[Router-SiKThread] Updated successfully SiK radio interface %d to txpower %d, airrate: %d bps, ECC/LBT/MCSTR: %d/%d/%d",
-                   g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1,
-                   uTxPower, uDataRate, uECC, uLBT, uMCSTR);
-               radio_stats_set_card_current_frequency(&g_SM_RadioStats, g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex, uFreqKhz);
-               if ( NULL != g_pSM_RadioStats )
-                  memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
-            }
-         }
+         send_alarm_to_central(ALARM_ID_GENERIC_STATUS_UPDATE, ALARM_FLAG_GENERIC_STATUS_RECONFIGURED_RADIO_INTERFACE_FAILED, 0);
+         radio_links_reopen_marked_sik_interfaces();
+
+         g_SiKRadiosState.bMustReinitSiKInterfaces = false;
+         g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex = -1;
+         g_SiKRadiosState.uSiKInterfaceIndexThatBrokeDown = MAX_U32;
       }
+      g_SiKRadiosState.bConfiguringSiKThreadWorking = false;
+      return;
+   }
+
+   log_line("[Router] Updated successfully SiK radio interface %d to txpower %u, airrate: %u bps, ECC/LBT/MCSTR: %u/%u/%u",
+       g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1,
+       s_uSiKATDriverTxPower, s_uSiKATDriverDataRate, s_uSiKATDriverECC, s_uSiKATDriverLBT, s_uSiKATDriverMCSTR);
+   radio_stats_set_card_current_frequency(&g_SM_RadioStats, g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex, s_uSiKATDriverFreqKhz);
+   if ( NULL != g_pSM_RadioStats )
+      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+
+   radio_links_reopen_marked_sik_interfaces();
+   send_alarm_to_central(ALARM_ID_GENERIC_STATUS_UPDATE, ALARM_FLAG_GENERIC_STATUS_RECONFIGURED_RADIO_INTERFACE, 0);
+
+   g_SiKRadiosState.bMustReinitSiKInterfaces = false;
+   g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex = -1;
+   g_SiKRadiosState.uSiKInterfaceIndexThatBrokeDown = MAX_U32;
+   g_SiKRadiosState.bConfiguringSiKThreadWorking = false;
+   radio_rx_reset_interfaces_broken_state();
+}
+
+// Starts reconfiguring the SiK radio flagged for reconfiguration, using the nonblocking AT commands driver.
+// Returns true if the AT driver was started, false if the reconfiguration finished (failed or nothing to change).
+
+static bool _radio_links_sik_start_reconfigure()
+{
+   int iInterfaceIndex = g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex;
+   log_line("[Router] Must reconfigure and reinitialize SiK radio interface %d...", iInterfaceIndex+1 );
+
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iInterfaceIndex);
+   if ( (NULL == pRadioHWInfo) || (! hardware_radio_is_sik_radio(pRadioHWInfo)) )
+   {
+      log_softerror_and_alarm("[Router] Radio interface %d is not a SiK radio interface.", iInterfaceIndex+1 );
+      _radio_links_sik_on_reconfigure_finished(true);
+      return false;
+   }
+
+   _radio_links_sik_get_target_params(iInterfaceIndex, pRadioHWInfo);
+
+   hardware_radio_sik_at_driver_init(&s_SiKATDriver, -1);
+   int iCountParams = hardware_radio_sik_at_driver_add_params(&s_SiKATDriver, pRadioHWInfo,
+       s_uSiKATDriverFreqKhz, DEFAULT_RADIO_SIK_FREQ_SPREAD, DEFAULT_RADIO_SIK_CHANNELS, DEFAULT_RADIO_SIK_NETID,
+       s_uSiKATDriverDataRate, s_uSiKATDriverTxPower, s_uSiKATDriverECC, s_uSiKATDriverLBT, s_uSiKATDriverMCSTR);
+
+   if ( 0 == iCountParams )
+   {
+      log_line("[Router] SiK radio interface %d params are unchanged.", iInterfaceIndex+1);
+      _radio_links_sik_on_reconfigure_finished(true);
+      return false;
+   }
+
+   hw_serial_port_info_t* pSerialPort = hardware_get_serial_port_info_from_serial_port_name(pRadioHWInfo->szDriver);
+   if ( NULL != pSerialPort )
+      s_iSiKATDriverSerialPort = hardware_open_serial_port(pRadioHWInfo->szDriver, pSerialPort->lPortSpeed);
+   if ( (NULL == pSerialPort) || (s_iSiKATDriverSerialPort <= 0) )
+   {
+      log_softerror_and_alarm("[Router] Failed to open serial port for SiK radio %s.", pRadioHWInfo->szDriver);
+      s_iSiKATDriverSerialPort = -1;
+      _radio_links_sik_on_reconfigure_finished(false);
+      return false;
+   }
+   s_SiKATDriver.iSerialPortFD = s_iSiKATDriverSerialPort;
+   s_bSiKATDriverActive = true;
+   s_uSiKATDriverTimeFinished = 0;
+   log_line("[Router] Started SiK AT commands driver to set %d params on SiK radio interface %d.", iCountParams, iInterfaceIndex+1);
+   return true;
+}
+
+static void _radio_links_sik_step_reconfigure()
+{
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex);
+
+   if ( 0 == s_uSiKATDriverTimeFinished )
+   {
+      int iState = hardware_radio_sik_at_driver_step(&s_SiKATDriver, g_TimeNow);
+      if ( (iState != SIK_AT_STATE_FINISHED) && (iState != SIK_AT_STATE_FAILED) )
+         return;
+
+      s_iSiKATDriverFinalState = iState;
+      s_uSiKATDriverTimeFinished = g_TimeNow;
+      if ( s_iSiKATDriverSerialPort > 0 )
+         close(s_iSiKATDriverSerialPort);
+      s_iSiKATDriverSerialPort = -1;
    }
-   else if ( 1 != hardware_radio_sik_reinitialize_serial_ports() )
+
+   // The radio was rebooted: do not reopen its serial port until it is back
+   if ( (NULL != pRadioHWInfo) && (0 != access(pRadioHWInfo->szDriver, R_OK | W_OK)) )
+   {
+      if ( g_TimeNow < s_uSiKATDriverTimeFinished + SIK_SERIAL_PORT_BACK_TIMEOUT_MS )
+         return;
+      log_softerror_and_alarm("[Router] Serial port %s of SiK radio interface %d is not back %d ms after the radio reboot.",
+         pRadioHWInfo->szDriver, g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex+1, SIK_SERIAL_PORT_BACK_TIMEOUT_MS);
+   }
+
+   int iState = s_iSiKATDriverFinalState;
+   s_bSiKATDriverActive = false;
+   s_uSiKATDriverTimeFinished = 0;
+
+   int iFailedParams = 0;
+   if ( NULL != pRadioHWInfo )
+   {
+      iFailedParams = hardware_radio_sik_at_driver_apply_params(&s_SiKATDriver, pRadioHWInfo);
+      hardware_radio_sik_save_configuration();
+      hardware_save_radio_info();
+   }
+   _radio_links_sik_on_reconfigure_finished((iState == SIK_AT_STATE_FINISHED) && (0 == iFailedParams));
+}
+
+static void * _reinit_sik_thread_func(void *ignored_argument)
+{
+   log_line("[Router-SiKThread] Reinitializing SiK radio interfaces...");
+
+   // radio serial ports are already closed at this point
+
+   if ( 1 != hardware_radio_sik_reinitialize_serial_ports() )
    {
       log_line("[Router-SiKThread] Reinitializing of SiK radio interfaces failed (not the same ones are present yet).");
       // Will restart the thread to try again
@@ -235,11 +326,7 @@ static void * _reinit_sik_thread_func(void *ignored_argument)
    log_line("[Router-SiKThread] Reinitialized SiK radio interfaces successfully.");
    
    radio_links_reopen_marked_sik_interfaces();
-
-   if ( g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex >= 0 )
-      send_alarm_to_central(ALARM_ID_GENERIC_STATUS_UPDATE, ALARM_FLAG_GENERIC_STATUS_RECONFIGURED_RADIO_INTERFACE, 0);
-   else
-      send_alarm_to_central(ALARM_ID_RADIO_INTERFACE_REINITIALIZED, g_SiKRadiosState.uSiKInterfaceIndexThatBrokeDown, 0);
+   send_alarm_to_central(ALARM_ID_RADIO_INTERFACE_REINITIALIZED, g_SiKRadiosState.uSiKInterfaceIndexThatBrokeDown, 0);
    
    g_SiKRadiosState.bMustReinitSiKInterfaces = false;
    g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex = -1;
@@ -253,6 +340,12 @@ static void * _reinit_sik_thread_func(void *ignored_argument)
 
 int radio_links_check_reinit_sik_interfaces()
 {
+   if ( s_bSiKATDriverActive )
+   {
+      _radio_links_sik_step_reconfigure();
+      return 0;
+   }
+
    if ( g_SiKRadiosState.bConfiguringToolInProgress && (g_SiKRadiosState.uTimeStartConfiguring != 0) )
    if ( g_TimeNow >= g_SiKRadiosState.uTimeStartConfiguring+500 )
    {
@@ -299,6 +392,19 @@ int radio_links_check_reinit_sik_interfaces()
    g_SiKRadiosState.uTimeIntervalSiKReinitCheck += 200;
 
    g_SiKRadiosState.bConfiguringSiKThreadWorking = true;
+
+   // Reconfiguring a SiK radio is done from the router loop, using the nonblocking AT commands driver.
+   // Only a full reinitialization (detection) of the SiK serial ports still uses a worker thread.
+   if ( g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex >= 0 )
+   {
+      if ( 0 == g_SiKRadiosState.iThreadRetryCounter )
+         send_alarm_to_central(ALARM_ID_GENERIC_STATUS_UPDATE, ALARM_FLAG_GENERIC_STATUS_RECONFIGURING_RADIO_INTERFACE, 0);
+      g_SiKRadiosState.iThreadRetryCounter++;
+      if ( _radio_links_sik_start_reconfigure() )
+         return 1;
+      return 0;
+   }
+
    static pthread_t pThreadSiKReinit;
 
    if ( 0 != pthread_create(&pThreadSiKReinit, NULL, &_reinit_sik_thread_func, NULL) )
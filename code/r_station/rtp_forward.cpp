@@ -0,0 +1,571 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../base/base.h"
+#include "../base/flags_video.h"
+#include "rtp_forward.h"
+
+#define RTP_HEADER_SIZE 12
+#define RTP_FORWARD_SEND_BATCH 64
+
+#define H264_NAL_TYPE_SEI 6
+#define H264_NAL_TYPE_SPS 7
+#define H264_NAL_TYPE_PPS 8
+#define H264_NAL_TYPE_AUD 9
+#define H264_NAL_TYPE_FU_A 28
+
+#define H265_NAL_TYPE_VPS 32
+#define H265_NAL_TYPE_SPS 33
+#define H265_NAL_TYPE_PPS 34
+#define H265_NAL_TYPE_AUD 35
+#define H265_NAL_TYPE_SEI_PREFIX 39
+#define H265_NAL_TYPE_FU 49
+
+typedef struct
+{
+   bool bUsed;
+   struct sockaddr_in sockAddr;
+   u32 uReadIndex;
+   t_rtp_forward_destination_stats stats;
+} t_rtp_forward_destination;
+
+static int s_iRTPForwardSocket = -1;
+static int s_iRTPForwardVideoType = VIDEO_TYPE_H264;
+static int s_iRTPForwardMaxPayload = RTP_FORWARD_MAX_PACKET_SIZE - RTP_HEADER_SIZE;
+
+static t_rtp_forward_destination s_RTPDestinations[RTP_FORWARD_MAX_DESTINATIONS];
+static t_rtp_forward_stats s_RTPForwardStats;
+
+// Packets ring, shared by all destinations. Indexes are free running counters.
+static u8 s_RTPPackets[RTP_FORWARD_MAX_QUEUED_PACKETS][RTP_FORWARD_MAX_PACKET_SIZE];
+static int s_iRTPPacketsLengths[RTP_FORWARD_MAX_QUEUED_PACKETS];
+static u32 s_uRTPWriteIndex = 0;
+
+static u16 s_uRTPSequence = 0;
+static u32 s_uRTPTimestamp = 0;
+static u32 s_uRTPSSRC = 0;
+
+// Annex-B parser state
+static bool s_bRTPInNAL = false;
+static u32 s_uRTPZeroBytes = 0;
+static u8 s_uRTPNALHeader[2];
+static bool s_bRTPFragmenting = false;
+static u8 s_RTPNALBuffer[RTP_FORWARD_MAX_PACKET_SIZE+4];
+static int s_iRTPNALBufferPos = 0;
+
+// The last packet of a NAL is built but not queued until the start of the next NAL tells if it ends the access unit (marker bit)
+static bool s_bRTPHasHeldPacket = false;
+static bool s_bRTPHeldPacketIsVCL = false;
+static bool s_bRTPAccessUnitStarted = false;
+static u32 s_uRTPTimeNowMs = 0;
+
+static u8 s_uRTPZeroes[64];
+
+static int _rtp_forward_nal_header_size()
+{
+   return (s_iRTPForwardVideoType == VIDEO_TYPE_H265)?2:1;
+}
+
+// Payload bytes of the NAL carried by each fragmentation unit
+static int _rtp_forward_fu_chunk_size()
+{
+   return s_iRTPForwardMaxPayload - ((s_iRTPForwardVideoType == VIDEO_TYPE_H265)?3:2);
+}
+
+static u8* _rtp_forward_start_packet()
+{
+   u8* pPacket = s_RTPPackets[s_uRTPWriteIndex % RTP_FORWARD_MAX_QUEUED_PACKETS];
+   pPacket[0] = 0x80;
+   pPacket[1] = RTP_FORWARD_PAYLOAD_TYPE;
+   pPacket[2] = s_uRTPSequence >> 8;
+   pPacket[3] = s_uRTPSequence & 0xFF;
+   pPacket[4] = (s_uRTPTimestamp >> 24) & 0xFF;
+   pPacket[5] = (s_uRTPTimestamp >> 16) & 0xFF;
+   pPacket[6] = (s_uRTPTimestamp >> 8) & 0xFF;
+   pPacket[7] = s_uRTPTimestamp & 0xFF;
+   pPacket[8] = (s_uRTPSSRC >> 24) & 0xFF;
+   pPacket[9] = (s_uRTPSSRC >> 16) & 0xFF;
+   pPacket[10] = (s_uRTPSSRC >> 8) & 0xFF;
+   pPacket[11] = s_uRTPSSRC & 0xFF;
+   s_uRTPSequence++;
+   return pPacket;
+}
+
+static void _rtp_forward_queue_packet(int iLength)
+{
+   s_iRTPPacketsLengths[s_uRTPWriteIndex % RTP_FORWARD_MAX_QUEUED_PACKETS] = iLength;
+   s_uRTPWriteIndex++;
+   s_RTPForwardStats.uPacketsQueued++;
+
+   // A destination that did not keep up loses its oldest packets
+   for( int i=0; i<RTP_FORWARD_MAX_DESTINATIONS; i++ )
+   {
+      if ( ! s_RTPDestinations[i].bUsed )
+         continue;
+      if ( s_uRTPWriteIndex - s_RTPDestinations[i].uReadIndex > RTP_FORWARD_MAX_QUEUED_PACKETS )
+      {
+         s_RTPDestinations[i].uReadIndex = s_uRTPWriteIndex - RTP_FORWARD_MAX_QUEUED_PACKETS;
+         s_RTPDestinations[i].stats.uPacketsDropped++;
+      }
+   }
+}
+
+static bool _rtp_forward_is_vcl_nal(u8 uNALHeader)
+{
+   if ( s_iRTPForwardVideoType == VIDEO_TYPE_H265 )
+      return ((uNALHeader >> 1) & 0x3F) < 32;
+   int iType = uNALHeader & 0x1F;
+   return (iType >= 1) && (iType <= 5);
+}
+
+static bool _rtp_forward_is_access_unit_start(u8* pNALStart, int iLength)
+{
+   if ( iLength < 1 )
+      return false;
+   if ( s_iRTPForwardVideoType == VIDEO_TYPE_H265 )
+   {
+      int iType = (pNALStart[0] >> 1) & 0x3F;
+      if ( (iType >= H265_NAL_TYPE_VPS) && (iType <= H265_NAL_TYPE_AUD) )
+         return true;
+      if ( iType == H265_NAL_TYPE_SEI_PREFIX )
+         return true;
+      // VCL NAL: first_slice_segment_in_pic_flag
+      if ( (iType < 32) && (iLength >= 3) )
+         return (pNALStart[2] & 0x80)?true:false;
+      return false;
+   }
+
+   int iType = pNALStart[0] & 0x1F;
+   if ( (iType >= H264_NAL_TYPE_SEI) && (iType <= H264_NAL_TYPE_AUD) )
+      return true;
+   // Slice: first_mb_in_slice == 0 (ue(v) coded as a single 1 bit)
+   if ( ((iType == 1) || (iType == 5)) && (iLength >= 2) )
+      return (pNALStart[1] & 0x80)?true:false;
+   return false;
+}
+
+// Queues the held packet once enough of the next NAL is known (or bForce is set)
+static void _rtp_forward_release_held_packet(u8* pNALStart, int iLength, bool bForce)
+{
+   if ( ! s_bRTPHasHeldPacket )
+      return;
+   if ( (! bForce) && (iLength < _rtp_forward_nal_header_size() + 1) )
+      return;
+
+   // Only the last slice of a picture ends the access unit; parameter sets and SEIs are sent with the next picture
+   u8* pPacket = s_RTPPackets[s_uRTPWriteIndex % RTP_FORWARD_MAX_QUEUED_PACKETS];
+   bool bAccessUnitStart = s_bRTPHeldPacketIsVCL && _rtp_forward_is_access_unit_start(pNALStart, iLength);
+   if ( bAccessUnitStart )
+      pPacket[1] |= 0x80;
+   _rtp_forward_queue_packet(s_iRTPPacketsLengths[s_uRTPWriteIndex % RTP_FORWARD_MAX_QUEUED_PACKETS]);
+   s_bRTPHasHeldPacket = false;
+   if ( bAccessUnitStart )
+      s_bRTPAccessUnitStarted = false;
+}
+
+static void _rtp_forward_start_nal()
+{
+   s_bRTPInNAL = true;
+   s_bRTPFragmenting = false;
+   s_iRTPNALBufferPos = 0;
+}
+
+static void _rtp_forward_check_new_access_unit()
+{
+   if ( s_bRTPAccessUnitStarted )
+      return;
+   s_bRTPAccessUnitStarted = true;
+   s_uRTPTimestamp = s_uRTPTimeNowMs * (RTP_FORWARD_CLOCK_RATE/1000);
+   s_RTPForwardStats.uAccessUnits++;
+}
+
+static u8* _rtp_forward_build_fu_packet(bool bStart, bool bEnd, int* piHeaderSize)
+{
+   u8* pPacket = _rtp_forward_start_packet();
+   u8* pPayload = pPacket + RTP_HEADER_SIZE;
+   u8 uFlags = (bStart?0x80:0) | (bEnd?0x40:0);
+   if ( s_iRTPForwardVideoType == VIDEO_TYPE_H265 )
+   {
+      pPayload[0] = (s_uRTPNALHeader[0] & 0x81) | (H265_NAL_TYPE_FU << 1);
+      pPayload[1] = s_uRTPNALHeader[1];
+      pPayload[2] = uFlags | ((s_uRTPNALHeader[0] >> 1) & 0x3F);
+      *piHeaderSize = RTP_HEADER_SIZE + 3;
+   }
+   else
+   {
+      pPayload[0] = (s_uRTPNALHeader[0] & 0xE0) | H264_NAL_TYPE_FU_A;
+      pPayload[1] = uFlags | (s_uRTPNALHeader[0] & 0x1F);
+      *piHeaderSize = RTP_HEADER_SIZE + 2;
+   }
+   s_RTPForwardStats.uFragmentPackets++;
+   return pPacket;
+}
+
+// Sends a fragmentation unit with the first iChunkSize bytes of the NAL buffer
+static void _rtp_forward_emit_fragment(int iChunkSize)
+{
+   _rtp_forward_check_new_access_unit();
+   int iHeaderSize = 0;
+   u8* pPacket = _rtp_forward_build_fu_packet(! s_bRTPFragmenting, false, &iHeaderSize);
+   int iOffset = s_bRTPFragmenting?0:_rtp_forward_nal_header_size();
+   memcpy(pPacket + iHeaderSize, s_RTPNALBuffer + iOffset, iChunkSize);
+   _rtp_forward_queue_packet(iHeaderSize + iChunkSize);
+
+   iOffset += iChunkSize;
+   s_iRTPNALBufferPos -= iOffset;
+   if ( s_iRTPNALBufferPos > 0 )
+      memmove(s_RTPNALBuffer, s_RTPNALBuffer + iOffset, s_iRTPNALBufferPos);
+   s_bRTPFragmenting = true;
+}
+
+static void _rtp_forward_append_nal_bytes(u8* pData, int iLength)
+{
+   while ( iLength > 0 )
+   {
+      int iLimit = s_bRTPFragmenting?_rtp_forward_fu_chunk_size():s_iRTPForwardMaxPayload;
+      int iCopy = iLimit + 1 - s_iRTPNALBufferPos;
+      if ( iCopy > iLength )
+         iCopy = iLength;
+      memcpy(s_RTPNALBuffer + s_iRTPNALBufferPos, pData, iCopy);
+      s_iRTPNALBufferPos += iCopy;
+      pData += iCopy;
+      iLength -= iCopy;
+
+      if ( s_bRTPHasHeldPacket && (! s_bRTPFragmenting) )
+         _rtp_forward_release_held_packet(s_RTPNALBuffer, s_iRTPNALBufferPos, false);
+
+      // Does not fit in a single NAL packet, or more data follows the current fragment
+      if ( s_iRTPNALBufferPos > iLimit )
+      {
+         if ( ! s_bRTPFragmenting )
+         {
+            _rtp_forward_release_held_packet(s_RTPNALBuffer, s_iRTPNALBufferPos, true);
+            s_uRTPNALHeader[0] = s_RTPNALBuffer[0];
+            s_uRTPNALHeader[1] = s_RTPNALBuffer[1];
+         }
+         _rtp_forward_emit_fragment(_rtp_forward_fu_chunk_size());
+      }
+   }
+}
+
+static void _rtp_forward_append_zero_bytes(u32 uCount)
+{
+   while ( uCount > 0 )
+   {
+      int iCount = (uCount > sizeof(s_uRTPZeroes))?(int)sizeof(s_uRTPZeroes):(int)uCount;
+      _rtp_forward_append_nal_bytes(s_uRTPZeroes, iCount);
+      uCount -= iCount;
+   }
+}
+
+static void _rtp_forward_end_nal()
+{
+   s_bRTPInNAL = false;
+   if ( ! s_bRTPFragmenting )
+   {
+      // Invalid/empty NAL
+      if ( s_iRTPNALBufferPos < _rtp_forward_nal_header_size() )
+         return;
+      _rtp_forward_release_held_packet(s_RTPNALBuffer, s_iRTPNALBufferPos, true);
+      _rtp_forward_check_new_access_unit();
+      u8* pPacket = _rtp_forward_start_packet();
+      memcpy(pPacket + RTP_HEADER_SIZE, s_RTPNALBuffer, s_iRTPNALBufferPos);
+      s_iRTPPacketsLengths[s_uRTPWriteIndex % RTP_FORWARD_MAX_QUEUED_PACKETS] = RTP_HEADER_SIZE + s_iRTPNALBufferPos;
+      s_RTPForwardStats.uSingleNALPackets++;
+   }
+   else
+   {
+      int iHeaderSize = 0;
+      u8* pPacket = _rtp_forward_build_fu_packet(false, true, &iHeaderSize);
+      memcpy(pPacket + iHeaderSize, s_RTPNALBuffer, s_iRTPNALBufferPos);
+      s_iRTPPacketsLengths[s_uRTPWriteIndex % RTP_FORWARD_MAX_QUEUED_PACKETS] = iHeaderSize + s_iRTPNALBufferPos;
+   }
+   s_bRTPHasHeldPacket = true;
+   s_bRTPHeldPacketIsVCL = _rtp_forward_is_vcl_nal(s_bRTPFragmenting?s_uRTPNALHeader[0]:s_RTPNALBuffer[0]);
+   s_iRTPNALBufferPos = 0;
+   s_RTPForwardStats.uNALUnits++;
+}
+
+static void _rtp_forward_reset_parser()
+{
+   s_bRTPInNAL = false;
+   s_bRTPFragmenting = false;
+   s_bRTPHasHeldPacket = false;
+   s_bRTPAccessUnitStarted = false;
+   s_uRTPZeroBytes = 0;
+   s_iRTPNALBufferPos = 0;
+}
+
+void rtp_forward_init(int iVideoType, int iMaxPacketSize)
+{
+   rtp_forward_uninit();
+
+   if ( iMaxPacketSize < RTP_FORWARD_MIN_PACKET_SIZE )
+      iMaxPacketSize = RTP_FORWARD_MIN_PACKET_SIZE;
+   if ( iMaxPacketSize > RTP_FORWARD_MAX_PACKET_SIZE )
+      iMaxPacketSize = RTP_FORWARD_MAX_PACKET_SIZE;
+   s_iRTPForwardMaxPayload = iMaxPacketSize - RTP_HEADER_SIZE;
+   s_iRTPForwardVideoType = (iVideoType == VIDEO_TYPE_H265)?VIDEO_TYPE_H265:VIDEO_TYPE_H264;
+
+   memset(s_RTPDestinations, 0, sizeof(s_RTPDestinations));
+   memset(&s_RTPForwardStats, 0, sizeof(s_RTPForwardStats));
+   memset(s_uRTPZeroes, 0, sizeof(s_uRTPZeroes));
+   s_uRTPWriteIndex = 0;
+   s_uRTPSequence = (u16)rand();
+   s_uRTPSSRC = ((u32)rand() << 16) ^ (u32)rand() ^ get_current_timestamp_micros();
+   _rtp_forward_reset_parser();
+
+   s_iRTPForwardSocket = socket(AF_INET, SOCK_DGRAM, 0);
+   if ( s_iRTPForwardSocket < 0 )
+   {
+      log_softerror_and_alarm("[RTPForward] Failed to create socket.");
+      s_iRTPForwardSocket = -1;
+      return;
+   }
+   int iBroadcastEnable = 1;
+   if ( 0 != setsockopt(s_iRTPForwardSocket, SOL_SOCKET, SO_BROADCAST, &iBroadcastEnable, sizeof(iBroadcastEnable)) )
+      log_softerror_and_alarm("[RTPForward] Failed to set the socket broadcast flag.");
+
+   log_line("[RTPForward] Init, video type: %s, max RTP packet size: %d bytes, SSRC: %08X",
+      (s_iRTPForwardVideoType == VIDEO_TYPE_H265)?"H265":"H264", iMaxPacketSize, s_uRTPSSRC);
+}
+
+void rtp_forward_uninit()
+{
+   if ( -1 != s_iRTPForwardSocket )
+   {
+      close(s_iRTPForwardSocket);
+      log_line("[RTPForward] Closed socket.");
+   }
+   s_iRTPForwardSocket = -1;
+   rtp_forward_remove_all_destinations();
+   _rtp_forward_reset_parser();
+}
+
+void rtp_forward_set_video_type(int iVideoType)
+{
+   if ( (iVideoType != VIDEO_TYPE_H264) && (iVideoType != VIDEO_TYPE_H265) )
+      return;
+   if ( iVideoType == s_iRTPForwardVideoType )
+      return;
+   log_line("[RTPForward] Video type changed to %s", (iVideoType == VIDEO_TYPE_H265)?"H265":"H264");
+   s_iRTPForwardVideoType = iVideoType;
+   _rtp_forward_reset_parser();
+}
+
+int rtp_forward_get_video_type()
+{
+   return s_iRTPForwardVideoType;
+}
+
+static int _rtp_forward_add_destination(u32 uAddress, int iPort)
+{
+   for( int i=0; i<RTP_FORWARD_MAX_DESTINATIONS; i++ )
+   {
+      if ( s_RTPDestinations[i].bUsed )
+         continue;
+      memset(&s_RTPDestinations[i], 0, sizeof(t_rtp_forward_destination));
+      s_RTPDestinations[i].sockAddr.sin_family = AF_INET;
+      s_RTPDestinations[i].sockAddr.sin_port = htons((u16)iPort);
+      s_RTPDestinations[i].sockAddr.sin_addr.s_addr = uAddress;
+      s_RTPDestinations[i].uReadIndex = s_uRTPWriteIndex;
+      s_RTPDestinations[i].bUsed = true;
+      return i;
+   }
+   log_softerror_and_alarm("[RTPForward] Can't add more than %d destinations.", RTP_FORWARD_MAX_DESTINATIONS);
+   return -1;
+}
+
+int rtp_forward_add_destination(const char* szIP, int iPort)
+{
+   if ( (NULL == szIP) || (iPort <= 0) || (iPort > 65535) )
+      return -1;
+   struct in_addr addr;
+   if ( 0 == inet_aton(szIP, &addr) )
+   {
+      log_softerror_and_alarm("[RTPForward] Invalid destination address: [%s]", szIP);
+      return -1;
+   }
+   int iIndex = _rtp_forward_add_destination(addr.s_addr, iPort);
+   if ( iIndex >= 0 )
+      log_line("[RTPForward] Added destination %d: %s:%d", iIndex, szIP, iPort);
+   return iIndex;
+}
+
+int rtp_forward_add_broadcast_destination(int iPort)
+{
+   if ( (iPort <= 0) || (iPort > 65535) )
+      return -1;
+   int iIndex = _rtp_forward_add_destination(htonl(INADDR_BROADCAST), iPort);
+   if ( iIndex >= 0 )
+      log_line("[RTPForward] Added destination %d: broadcast:%d", iIndex, iPort);
+   return iIndex;
+}
+
+void rtp_forward_remove_all_destinations()
+{
+   memset(s_RTPDestinations, 0, sizeof(s_RTPDestinations));
+}
+
+int rtp_forward_get_destinations_count()
+{
+   int iCount = 0;
+   for( int i=0; i<RTP_FORWARD_MAX_DESTINATIONS; i++ )
+   {
+      if ( s_RTPDestinations[i].bUsed )
+         iCount++;
+   }
+   return iCount;
+}
+
+void rtp_forward_on_video_data(u8* pData, int iLength, u32 uTimeNowMs)
+{
+   if ( (NULL == pData) || (iLength <= 0) )
+      return;
+
+   s_uRTPTimeNowMs = uTimeNowMs;
+   u8* pEnd = pData + iLength;
+   while ( pData < pEnd )
+   {
+      if ( 0 == *pData )
+      {
+         s_uRTPZeroBytes++;
+         pData++;
+         continue;
+      }
+      if ( 0 == s_uRTPZeroBytes )
+      {
+         // Fast path: copy everything up to the next zero byte
+         u8* pZero = (u8*)memchr(pData, 0, pEnd - pData);
+         if ( NULL == pZero )
+            pZero = pEnd;
+         if ( s_bRTPInNAL )
+            _rtp_forward_append_nal_bytes(pData, pZero - pData);
+         pData = pZero;
+         continue;
+      }
+      // Start code (00 00 01 or 00 00 00 01); zero bytes before it belong to no NAL.
+      // Zero bytes at the end of a chunk are only counted, they could be the start of a start code.
+      if ( (s_uRTPZeroBytes >= 2) && (1 == *pData) )
+      {
+         if ( s_bRTPInNAL )
+            _rtp_forward_end_nal();
+         _rtp_forward_start_nal();
+      }
+      else if ( s_bRTPInNAL )
+      {
+         _rtp_forward_append_zero_bytes(s_uRTPZeroBytes);
+         _rtp_forward_append_nal_bytes(pData, 1);
+      }
+      s_uRTPZeroBytes = 0;
+      pData++;
+   }
+}
+
+int rtp_forward_flush()
+{
+   if ( -1 == s_iRTPForwardSocket )
+      return 0;
+
+   static struct mmsghdr s_RTPMessages[RTP_FORWARD_SEND_BATCH];
+   static struct iovec s_RTPIOVectors[RTP_FORWARD_SEND_BATCH];
+   int iTotalSent = 0;
+
+   for( int i=0; i<RTP_FORWARD_MAX_DESTINATIONS; i++ )
+   {
+      t_rtp_forward_destination* pDest = &s_RTPDestinations[i];
+      if ( ! pDest->bUsed )
+         continue;
+      while ( pDest->uReadIndex != s_uRTPWriteIndex )
+      {
+         int iCount = 0;
+         u32 uIndex = pDest->uReadIndex;
+         while ( (uIndex != s_uRTPWriteIndex) && (iCount < RTP_FORWARD_SEND_BATCH) )
+         {
+            int iSlot = uIndex % RTP_FORWARD_MAX_QUEUED_PACKETS;
+            s_RTPIOVectors[iCount].iov_base = s_RTPPackets[iSlot];
+            s_RTPIOVectors[iCount].iov_len = s_iRTPPacketsLengths[iSlot];
+            memset(&s_RTPMessages[iCount], 0, sizeof(struct mmsghdr));
+            s_RTPMessages[iCount].msg_hdr.msg_name = &pDest->sockAddr;
+            s_RTPMessages[iCount].msg_hdr.msg_namelen = sizeof(pDest->sockAddr);
+            s_RTPMessages[iCount].msg_hdr.msg_iov = &s_RTPIOVectors[iCount];
+            s_RTPMessages[iCount].msg_hdr.msg_iovlen = 1;
+            iCount++;
+            uIndex++;
+         }
+
+         int iSent = sendmmsg(s_iRTPForwardSocket, s_RTPMessages, iCount, MSG_DONTWAIT);
+         pDest->stats.uSendCalls++;
+         if ( iSent <= 0 )
+         {
+            // Socket buffer full: keep the packets queued for the next flush
+            if ( (iSent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) )
+               break;
+            // Any other error: drop the batch
+            pDest->stats.uSendErrors++;
+            pDest->stats.uPacketsDropped += iCount;
+            pDest->uReadIndex += iCount;
+            break;
+         }
+         for( int k=0; k<iSent; k++ )
+            pDest->stats.uBytesSent += s_RTPMessages[k].msg_len;
+         pDest->stats.uPacketsSent += iSent;
+         pDest->uReadIndex += iSent;
+         iTotalSent += iSent;
+         if ( iSent < iCount )
+            break;
+      }
+   }
+   return iTotalSent;
+}
+
+t_rtp_forward_stats* rtp_forward_get_stats()
+{
+   return &s_RTPForwardStats;
+}
+
+t_rtp_forward_destination_stats* rtp_forward_get_destination_stats(int iDestinationIndex)
+{
+   if ( (iDestinationIndex < 0) || (iDestinationIndex >= RTP_FORWARD_MAX_DESTINATIONS) )
+      return NULL;
+   if ( ! s_RTPDestinations[iDestinationIndex].bUsed )
+      return NULL;
+   return &s_RTPDestinations[iDestinationIndex].stats;
+}
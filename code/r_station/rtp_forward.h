@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../base/base.h"
+
+// In process RTP packetizer and UDP forwarder for the received H264/H265 video stream.
+// The Annex-B byte stream is split into NAL units as it arrives and each NAL unit is sent either as a
+// single NAL unit packet or as fragmentation units (FU-A for H264, RFC 6184; FU for H265, RFC 7798).
+// Packets are queued in a shared ring; each destination has its own read position in the ring and
+// queued packets are sent in batches (sendmmsg) on flush.
+
+#define RTP_FORWARD_MAX_DESTINATIONS 4
+#define RTP_FORWARD_MAX_QUEUED_PACKETS 256
+#define RTP_FORWARD_MAX_PACKET_SIZE 1472
+#define RTP_FORWARD_MIN_PACKET_SIZE 200
+#define RTP_FORWARD_PAYLOAD_TYPE 96
+#define RTP_FORWARD_CLOCK_RATE 90000
+
+typedef struct
+{
+   u32 uPacketsSent;
+   u32 uBytesSent;
+   u32 uPacketsDropped;
+   u32 uSendCalls;
+   u32 uSendErrors;
+} t_rtp_forward_destination_stats;
+
+typedef struct
+{
+   u32 uNALUnits;
+   u32 uAccessUnits;
+   u32 uSingleNALPackets;
+   u32 uFragmentPackets;
+   u32 uPacketsQueued;
+} t_rtp_forward_stats;
+
+// iVideoType: VIDEO_TYPE_H264 or VIDEO_TYPE_H265. iMaxPacketSize: max RTP packet size (including RTP header)
+void rtp_forward_init(int iVideoType, int iMaxPacketSize);
+void rtp_forward_uninit();
+void rtp_forward_set_video_type(int iVideoType);
+int rtp_forward_get_video_type();
+
+// Returns the destination index or -1 on error
+int rtp_forward_add_destination(const char* szIP, int iPort);
+int rtp_forward_add_broadcast_destination(int iPort);
+void rtp_forward_remove_all_destinations();
+int rtp_forward_get_destinations_count();
+
+// Adds Annex-B video data (any chunk size). Packets are only queued here, use rtp_forward_flush to send them.
+void rtp_forward_on_video_data(u8* pData, int iLength, u32 uTimeNowMs);
+// Sends the queued packets to all destinations. Returns the number of packets sent.
+int rtp_forward_flush();
+
+t_rtp_forward_stats* rtp_forward_get_stats();
+t_rtp_forward_destination_stats* rtp_forward_get_destination_stats(int iDestinationIndex);
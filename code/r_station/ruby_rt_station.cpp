@@ -58,6 +58,7 @@
 #include "../utils/utils_controller.h"
 #include "../base/controller_rt_info.h"
 #include "../base/vehicle_rt_info.h"
+#include "../base/profiler.h"
 #include "../base/core_plugins_settings.h"
 #include "../common/models_connect_frequencies.h"
 
@@ -1107,6 +1108,7 @@ void _preprocess_radio_out_packet(u8* pPacketBuffer)
    }
 }
 
+// pPacketBuffer is a radio queue packet, with RADIO_PACKET_HEADROOM free bytes in front of it
 void _process_and_send_packet(u8* pPacketBuffer, int iPacketLength)
 {
    _check_for_atheros_datarate_change_command_to_vehicle(pPacketBuffer);
@@ -1146,7 +1148,7 @@ void _process_and_send_packet(u8* pPacketBuffer, int iPacketLength)
 
    for( int i=0; i<send_count; i++ )
    {
-      send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1, send_count);
+      send_packet_with_headroom_to_radio_interfaces(pPacketBuffer, iPacketLength, -1, send_count);
       if ( g_bDebugIsPacketsHistoryGraphOn && (!g_bDebugIsPacketsHistoryGraphPaused) )
          add_detailed_history_tx_packets(g_pDebug_SM_RouterPacketsStatsHistory, g_TimeNow % 1000, 0, 0, 0, 0, 0, 0);
    }
@@ -1369,6 +1371,9 @@ void init_shared_memory_objects()
    else
       log_line("Opened shared mem for video rx process watchdog stats for writing.");
 
+   if ( profiler_init(SHARED_MEM_PROFILER_ROUTER_RX) )
+      profiler_register_thread("main");
+
    if ( NULL != g_pProcessStats )
    {
       g_pProcessStats->alarmFlags = 0;
@@ -1545,10 +1550,13 @@ void _check_send_pairing_requests()
       radio_packet_init(&PH, PACKET_COMPONENT_RUBY, PACKET_TYPE_RUBY_PAIRING_REQUEST, STREAM_ID_DATA);
       PH.vehicle_id_src = g_uControllerId;
       PH.vehicle_id_dest = pModel->uVehicleId;
-      PH.total_length = sizeof(t_packet_header) + sizeof(u32);
+      PH.total_length = sizeof(t_packet_header) + 2*sizeof(u32);
+      // Retry count, then the controller software version (the vehicle adapts to what the controller can decode)
+      u32 uSwVersion = (SYSTEM_SW_VERSION_MAJOR * 256 + SYSTEM_SW_VERSION_MINOR) | (SYSTEM_SW_BUILD_NUMBER<<16);
       u8 packet[MAX_PACKET_TOTAL_SIZE];
       memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
       memcpy(packet + sizeof(t_packet_header), &(g_State.vehiclesRuntimeInfo[i].uPairingRequestId), sizeof(u32));
+      memcpy(packet + sizeof(t_packet_header) + sizeof(u32), &uSwVersion, sizeof(u32));
       if ( 0 == send_packet_to_radio_interfaces(packet, PH.total_length, -1, 500) )
       {
          if ( g_State.vehiclesRuntimeInfo[i].uPairingRequestId < 2 )
@@ -1570,6 +1578,8 @@ void _router_periodic_loop()
    if ( test_link_is_in_progress() )
       test_link_loop();
 
+   periodic_loop_processing_audio();
+
    #ifdef HW_PLATFORM_RADXA_ZERO3
    //if ( g_TimeNow > radio_linkgs_get_last_set_monitor_time() + 2000 )
    //   radio_links_set_monitor_mode();
@@ -2152,6 +2162,7 @@ int main(int argc, char *argv[])
          g_pProcessStats->lastActiveTime = g_TimeNow;
       }
 
+      PROFILER_BEGIN(PROFILER_SECTION_LOOP);
       if ( g_bSearching )
          _main_loop_searching();
       else if ( g_pCurrentModel->rxtx_sync_type == RXTX_SYNC_TYPE_ADV )
@@ -2160,6 +2171,7 @@ int main(int argc, char *argv[])
          _main_loop_basic_sync();
       else
          _main_loop_simple(true);
+      PROFILER_END(PROFILER_SECTION_LOOP);
       if ( g_bQuit )
          break;
    }
@@ -2184,6 +2196,7 @@ int main(int argc, char *argv[])
    shared_mem_controller_radio_stats_interfaces_rx_graphs_close(g_pSM_RadioStatsInterfacesRxGraph);
    shared_mem_controller_audio_decode_stats_close(g_pSM_AudioDecodeStats);
    shared_mem_process_stats_close(SHARED_MEM_WATCHDOG_ROUTER_RX, g_pProcessStats);
+   profiler_uninit();
    shared_mem_video_stream_stats_rx_processors_close(g_pSM_VideoDecodeStats);
    shared_mem_radio_rx_queue_info_close(g_pSM_RadioRxQueueInfo);
    g_pSM_RadioRxQueueInfo = NULL;
@@ -2317,12 +2330,20 @@ void _main_loop_searching()
 {
    g_TimeNow = get_current_timestamp_ms();
 
+   PROFILER_BEGIN(PROFILER_SECTION_RADIO_RX);
    _main_loop_try_recevive_video_data(NULL);
+   PROFILER_END(PROFILER_SECTION_RADIO_RX);
 
+   PROFILER_BEGIN(PROFILER_SECTION_PERIODIC);
    _router_periodic_loop();
+   PROFILER_END(PROFILER_SECTION_PERIODIC);
+   PROFILER_BEGIN(PROFILER_SECTION_STATS);
    _synchronize_shared_mems();
+   PROFILER_END(PROFILER_SECTION_STATS);
+   PROFILER_BEGIN(PROFILER_SECTION_IPC);
    _read_ipc_pipes(g_TimeNow);
    _consume_ipc_messages();
+   PROFILER_END(PROFILER_SECTION_IPC);
 
    s_iCountCPULoopOverflows = 0;
    u32 uTimeNow = get_current_timestamp_ms();
@@ -2342,10 +2363,13 @@ void _main_loop_simple(bool bNoTxSync)
    g_TimeNow = get_current_timestamp_ms();
    u32 tTime0 = g_TimeNow;
 
+   PROFILER_BEGIN(PROFILER_SECTION_RADIO_RX);
    _main_loop_try_recevive_video_data(NULL);
+   PROFILER_END(PROFILER_SECTION_RADIO_RX);
    
    u32 tTime1 = g_TimeNow;
 
+   PROFILER_BEGIN(PROFILER_SECTION_VIDEO_RX);
    for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
    {
       if ( g_pVideoProcessorRxList[i] == NULL )
@@ -2354,20 +2378,32 @@ void _main_loop_simple(bool bNoTxSync)
    }
    if ( controller_rt_info_will_advance_index(&g_SMControllerRTInfo, g_TimeNow) )
       adaptive_video_periodic_loop(false);
+   PROFILER_END(PROFILER_SECTION_VIDEO_RX);
 
+   PROFILER_BEGIN(PROFILER_SECTION_PERIODIC);
    _router_periodic_loop();
+   PROFILER_END(PROFILER_SECTION_PERIODIC);
+   PROFILER_BEGIN(PROFILER_SECTION_STATS);
    _synchronize_shared_mems();
+   PROFILER_END(PROFILER_SECTION_STATS);
    _check_rx_loop_consistency();
    _check_queue_ping();
+   PROFILER_BEGIN(PROFILER_SECTION_IPC);
    _read_ipc_pipes(tTime1);
    _consume_ipc_messages();
+   PROFILER_END(PROFILER_SECTION_IPC);
 
    if ( (NULL != g_pCurrentModel) && g_pCurrentModel->hasCamera() )
+   {
+      PROFILER_BEGIN(PROFILER_SECTION_VIDEO_OUTPUT);
       rx_video_output_periodic_loop();
+      PROFILER_END(PROFILER_SECTION_VIDEO_OUTPUT);
+   }
 
    g_TimeNow = get_current_timestamp_ms();
    u32 tTime2 = g_TimeNow;
 
+   PROFILER_BEGIN(PROFILER_SECTION_STATS);
    if ( controller_rt_info_will_advance_index(&g_SMControllerRTInfo, g_TimeNow) )
    {
       for( int i=0; i<hardware_get_radio_interfaces_count(); i++ )
@@ -2386,6 +2422,7 @@ void _main_loop_simple(bool bNoTxSync)
          radio_stats_reset_signal_info_for_card(&g_SM_RadioStats, i);
       }
    }
+   PROFILER_END(PROFILER_SECTION_STATS);
 
    g_TimeNow = get_current_timestamp_ms();
    u32 tTime3 = g_TimeNow;
@@ -2417,8 +2454,10 @@ void _main_loop_simple(bool bNoTxSync)
 
    if ( bSendNow )
    {
+      PROFILER_BEGIN(PROFILER_SECTION_RADIO_TX);
       _process_and_send_packets_individually(&s_QueueRadioPacketsHighPrio);
       _process_and_send_packets_individually(&s_QueueRadioPacketsRegPrio);
+      PROFILER_END(PROFILER_SECTION_RADIO_TX);
    }
 
    g_TimeNow = get_current_timestamp_ms();
@@ -2472,7 +2511,9 @@ void _main_loop_adv_sync()
    u32 tTime0 = g_TimeNow;
 
    u16 uEndOfVideoFrameId = 0;
+   PROFILER_BEGIN(PROFILER_SECTION_RADIO_RX);
    bool bEndOfVideoFrameDetected = _main_loop_try_recevive_video_data(&uEndOfVideoFrameId);
+   PROFILER_END(PROFILER_SECTION_RADIO_RX);
    
    if ( bEndOfVideoFrameDetected && (!g_pCurrentModel->isVideoLinkFixedOneWay()))
    {
@@ -2492,6 +2533,7 @@ void _main_loop_adv_sync()
    if ( s_bBoolRecvVideoDataThisLoop || bEndOfVideoFrameDetected )
       bForceSyncNow = true;
 
+   PROFILER_BEGIN(PROFILER_SECTION_VIDEO_RX);
    for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
    {
       if ( g_pVideoProcessorRxList[i] == NULL )
@@ -2502,20 +2544,32 @@ void _main_loop_adv_sync()
    }
    if ( bForceSyncNow || controller_rt_info_will_advance_index(&g_SMControllerRTInfo, g_TimeNow) )
       adaptive_video_periodic_loop(bForceSyncNow);
+   PROFILER_END(PROFILER_SECTION_VIDEO_RX);
 
+   PROFILER_BEGIN(PROFILER_SECTION_PERIODIC);
    _router_periodic_loop();
+   PROFILER_END(PROFILER_SECTION_PERIODIC);
+   PROFILER_BEGIN(PROFILER_SECTION_STATS);
    _synchronize_shared_mems();
+   PROFILER_END(PROFILER_SECTION_STATS);
    _check_rx_loop_consistency();
    _check_queue_ping();
+   PROFILER_BEGIN(PROFILER_SECTION_IPC);
    _read_ipc_pipes(tTime1);
    _consume_ipc_messages();
+   PROFILER_END(PROFILER_SECTION_IPC);
 
    if ( (NULL != g_pCurrentModel) && g_pCurrentModel->hasCamera() )
+   {
+      PROFILER_BEGIN(PROFILER_SECTION_VIDEO_OUTPUT);
       rx_video_output_periodic_loop();
+      PROFILER_END(PROFILER_SECTION_VIDEO_OUTPUT);
+   }
 
    g_TimeNow = get_current_timestamp_ms();
    u32 tTime2 = g_TimeNow;
 
+   PROFILER_BEGIN(PROFILER_SECTION_STATS);
    if ( controller_rt_info_will_advance_index(&g_SMControllerRTInfo, g_TimeNow) )
    {
       for( int i=0; i<hardware_get_radio_interfaces_count(); i++ )
@@ -2534,6 +2588,7 @@ void _main_loop_adv_sync()
          radio_stats_reset_signal_info_for_card(&g_SM_RadioStats, i);
       }
    }
+   PROFILER_END(PROFILER_SECTION_STATS);
 
    g_TimeNow = get_current_timestamp_ms();
    u32 tTime3 = g_TimeNow;
@@ -2565,8 +2620,10 @@ void _main_loop_adv_sync()
 
    if ( bSendNow )
    {
+      PROFILER_BEGIN(PROFILER_SECTION_RADIO_TX);
       _process_and_send_packets_individually(&s_QueueRadioPacketsHighPrio);
       _process_and_send_packets_individually(&s_QueueRadioPacketsRegPrio);
+      PROFILER_END(PROFILER_SECTION_RADIO_TX);
    }
 
    g_TimeNow = get_current_timestamp_ms();
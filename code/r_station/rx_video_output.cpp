@@ -64,6 +64,7 @@
 #include "shared_vars.h"
 #include "rx_video_output.h"
 #include "rx_video_recording.h"
+#include "rtp_forward.h"
 #include "packets_utils.h"
 #include "links_utils.h"
 #include "timers.h"
@@ -100,8 +101,7 @@ t_video_usb_output_info s_VideoUSBOutputInfo;
 
 typedef struct 
 {
-   bool s_bForwardETHPipeEnabled;
-   int s_ForwardETHVideoPipeFile;
+   bool s_bForwardETHRTPEnabled;
 
    bool s_bForwardIsETHForwardEnabled;
    int s_ForwardETHSocketVideo;
@@ -360,27 +360,27 @@ static void * _thread_rx_video_output_player(void *argument)
    return NULL;
 }
 
-void _processor_rx_video_forward_open_eth_pipe()
+void _processor_rx_video_forward_start_eth_rtp()
 {
-   log_line("[VideoOutput] Creating ETH pipes for video forward...");
-   char szComm[1024];
-   #ifdef HW_CAPABILITY_IONICE
-   sprintf(szComm, "ionice -c 1 -n 4 nice -n -5 cat %s | nice -n -5 gst-launch-1.0 fdsrc ! h264parse ! rtph264pay pt=96 config-interval=3 ! udpsink port=%d host=127.0.0.1 > /dev/null 2>&1 &", FIFO_RUBY_STATION_ETH_VIDEO_STREAM, g_pControllerSettings->nVideoForwardETHPort);
-   #else
-   sprintf(szComm, "nice -n -5 cat %s | nice -n -5 gst-launch-1.0 fdsrc ! h264parse ! rtph264pay pt=96 config-interval=3 ! udpsink port=%d host=127.0.0.1 > /dev/null 2>&1 &", FIFO_RUBY_STATION_ETH_VIDEO_STREAM, g_pControllerSettings->nVideoForwardETHPort);
-   #endif
-   hw_execute_bash_command(szComm, NULL);
-
-   log_line("[VideoOutput] Opening video output pipe write endpoint for ETH forward RTS: %s", FIFO_RUBY_STATION_ETH_VIDEO_STREAM);
-   s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile = open(FIFO_RUBY_STATION_ETH_VIDEO_STREAM, O_WRONLY);
-   if ( s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile < 0 )
+   log_line("[VideoOutput] Starting RTP forwarder for video forward on ETH...");
+   int iVideoType = VIDEO_TYPE_H264;
+   if ( (NULL != g_pCurrentModel) && (g_pCurrentModel->video_params.uVideoExtraFlags & VIDEO_FLAG_GENERATE_H265) )
+      iVideoType = VIDEO_TYPE_H265;
+   rtp_forward_init(iVideoType, g_pControllerSettings->nVideoForwardETHPacketSize);
+   if ( rtp_forward_add_destination("127.0.0.1", g_pControllerSettings->nVideoForwardETHPort) < 0 )
    {
-      log_error_and_alarm("[VideoOutput] Failed to open video output pipe write endpoint for ETH forward RTS: %s",FIFO_RUBY_STATION_ETH_VIDEO_STREAM);
+      log_softerror_and_alarm("[VideoOutput] Failed to start RTP forwarder for video forward on ETH.");
+      rtp_forward_uninit();
       return;
    }
-   log_line("[VideoOutput] Opened video output pipe write endpoint for ETH forward RTS: %s", FIFO_RUBY_STATION_ETH_VIDEO_STREAM);
-   log_line("[VideoOutput] Video output pipe to ETH flags: %s", str_get_pipe_flags(fcntl(s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile, F_GETFL)));
-   s_VideoETHOutputInfo.s_bForwardETHPipeEnabled = true;
+   s_VideoETHOutputInfo.s_bForwardETHRTPEnabled = true;
+}
+
+void _processor_rx_video_forward_stop_eth_rtp()
+{
+   if ( s_VideoETHOutputInfo.s_bForwardETHRTPEnabled )
+      rtp_forward_uninit();
+   s_VideoETHOutputInfo.s_bForwardETHRTPEnabled = false;
 }
 
 void _processor_rx_video_forward_create_eth_socket()
@@ -443,26 +443,23 @@ void rx_video_output_init()
    s_iLastUSBVideoForwardPort = g_pControllerSettings->iVideoForwardUSBPort;
    s_iLastUSBVideoForwardPacketSize = g_pControllerSettings->iVideoForwardUSBPacketSize;
 
-   s_VideoETHOutputInfo.s_bForwardETHPipeEnabled = false;
+   s_VideoETHOutputInfo.s_bForwardETHRTPEnabled = false;
    s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled = false;
-   s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile = -1;
    s_VideoETHOutputInfo.s_ForwardETHSocketVideo = -1;
    s_VideoETHOutputInfo.s_nBufferETHPos = 0;
    s_VideoETHOutputInfo.s_BufferETHPacketSize = 1024;
 
    if ( NULL != g_pControllerSettings && ( g_pControllerSettings->nVideoForwardETHType == 1 ) )
       s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled = true;
-   if ( NULL != g_pControllerSettings && ( g_pControllerSettings->nVideoForwardETHType == 2 ) )
-      s_VideoETHOutputInfo.s_bForwardETHPipeEnabled = true;
 
-   if ( s_VideoETHOutputInfo.s_bForwardETHPipeEnabled )
+   if ( NULL != g_pControllerSettings && ( g_pControllerSettings->nVideoForwardETHType == 2 ) )
    {
-      log_line("[VideoOutput] Video ETH forwarding is enabled, type Raw.");
-      _processor_rx_video_forward_open_eth_pipe();
+      log_line("[VideoOutput] Video ETH forwarding is enabled, type RTP.");
+      _processor_rx_video_forward_start_eth_rtp();
    }
    if ( s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled )
    {
-      log_line("[VideoOutput] Video ETH forwarding is enabled, type RTS.");
+      log_line("[VideoOutput] Video ETH forwarding is enabled, type Raw.");
       _processor_rx_video_forward_create_eth_socket();
    }
 
@@ -520,14 +517,8 @@ void rx_video_output_uninit()
       close(s_VideoETHOutputInfo.s_ForwardETHSocketVideo);
    s_VideoETHOutputInfo.s_ForwardETHSocketVideo = -1;
 
-   if ( -1 != s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile )
-      close(s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile);
-   s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile = -1;
-
-   if ( s_VideoETHOutputInfo.s_bForwardETHPipeEnabled )
-      hw_stop_process("gst-launch-1.0");
+   _processor_rx_video_forward_stop_eth_rtp();
    s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled = false;
-   s_VideoETHOutputInfo.s_bForwardETHPipeEnabled = false;
 
    if ( -1 != s_fPipeVideoOutToPlayer )
    {
@@ -880,8 +871,12 @@ void rx_video_output_video_data(u32 uVehicleId, u8 uVideoStreamType, int width,
    if ( -1 != s_iLocalVideoPlayerUDPSocket )
       _rx_video_output_to_local_video_player_udp(pBuffer, video_data_length);
 
-   if ( s_VideoETHOutputInfo.s_bForwardETHPipeEnabled && (-1 != s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile) )
-      write(s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile, pBuffer, video_data_length);
+   if ( s_VideoETHOutputInfo.s_bForwardETHRTPEnabled )
+   {
+      rtp_forward_set_video_type(uVideoStreamType);
+      rtp_forward_on_video_data(pBuffer, video_data_length, g_TimeNow);
+      rtp_forward_flush();
+   }
 
    rx_video_recording_on_new_data(pBuffer, video_data_length);
 
@@ -911,22 +906,13 @@ void rx_video_output_on_controller_settings_changed()
       if ( -1 != s_VideoETHOutputInfo.s_ForwardETHSocketVideo )
          close(s_VideoETHOutputInfo.s_ForwardETHSocketVideo);
       s_VideoETHOutputInfo.s_ForwardETHSocketVideo = -1;
-      if ( -1 != s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile )
-         close(s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile);
-      s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile = -1;
-
-      s_VideoETHOutputInfo.s_bForwardETHPipeEnabled = false;
+      _processor_rx_video_forward_stop_eth_rtp();
       s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled = false;
       log_line("[VideoOutput] Video ETH forwarding was disabled.");
    }
    else if ( g_pControllerSettings->nVideoForwardETHType == 1 )
    {
-      if ( -1 != s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile )
-         close(s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile);
-      s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile = -1;
-      if ( s_VideoETHOutputInfo.s_bForwardETHPipeEnabled )
-         hw_stop_process("gst-launch-1.0");
-      s_VideoETHOutputInfo.s_bForwardETHPipeEnabled = false;
+      _processor_rx_video_forward_stop_eth_rtp();
       s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled = true;
 
       log_line("[VideoOutput] Video ETH forwarding is enabled, type Raw.");
@@ -939,9 +925,8 @@ void rx_video_output_on_controller_settings_changed()
       s_VideoETHOutputInfo.s_ForwardETHSocketVideo = -1;
       s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled = false;
 
-      s_VideoETHOutputInfo.s_bForwardETHPipeEnabled = true;
-      log_line("[VideoOutput] Video ETH forwarding is enabled, type RTS.");
-      _processor_rx_video_forward_open_eth_pipe();
+      log_line("[VideoOutput] Video ETH forwarding is enabled, type RTP.");
+      _processor_rx_video_forward_start_eth_rtp();
    }
 
    s_iLastUSBVideoForwardPort = g_pControllerSettings->iVideoForwardUSBPort;
@@ -974,6 +959,13 @@ void rx_video_output_periodic_loop()
    if ( g_TimeNow >= s_uLastTimeComputedOutputBitrate + 1000 )
    {
       log_line("[VideoOutput] Output to pipe: %u bps, output to UDP: %u bps", s_uOutputBitrateToLocalVideoPlayerPipe, s_uOutputBitrateToLocalVideoPlayerUDP );
+      if ( s_VideoETHOutputInfo.s_bForwardETHRTPEnabled && (NULL != rtp_forward_get_destination_stats(0)) )
+      {
+         t_rtp_forward_stats* pStats = rtp_forward_get_stats();
+         t_rtp_forward_destination_stats* pDestStats = rtp_forward_get_destination_stats(0);
+         log_line("[VideoOutput] RTP forward: %u frames, %u NALs, %u packets sent (%u bytes) in %u calls, %u dropped, %u send errors",
+            pStats->uAccessUnits, pStats->uNALUnits, pDestStats->uPacketsSent, pDestStats->uBytesSent, pDestStats->uSendCalls, pDestStats->uPacketsDropped, pDestStats->uSendErrors);
+      }
       s_uLastTimeComputedOutputBitrate = g_TimeNow;
       s_uOutputBitrateToLocalVideoPlayerPipe = 0;
       s_uOutputBitrateToLocalVideoPlayerUDP = 0;
@@ -56,16 +56,11 @@ VideoRxPacketsBuffer::VideoRxPacketsBuffer(int iVideoStreamIndex, int iCameraInd
    m_iVideoStreamIndex = iVideoStreamIndex;
    m_iCameraIndex = iCameraIndex;
 
+   packet_pool_init(&m_PacketsPool, MAX_PACKET_TOTAL_SIZE, 0);
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
    {
+      m_VideoBlocks[i].uReceivedMask = 0;
       _empty_block_buffer_index(i);
-      for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
-      {
-         m_VideoBlocks[i].packets[k].pRawData = NULL;
-         m_VideoBlocks[i].packets[k].pPH = NULL;
-         m_VideoBlocks[i].packets[k].pPHVF = NULL;
-         m_VideoBlocks[i].packets[k].pVideoData = NULL;
-      }
    }
    m_uMaxVideoBlockIndexInBuffer = 0;
    m_bEndOfFirstIFrameDetected = false;
@@ -78,16 +73,8 @@ VideoRxPacketsBuffer::~VideoRxPacketsBuffer()
    uninit();
 
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
-   for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
-   {
-      if ( NULL != m_VideoBlocks[i].packets[k].pRawData )
-         free(m_VideoBlocks[i].packets[k].pRawData);
-
-      m_VideoBlocks[i].packets[k].pRawData = NULL;
-      m_VideoBlocks[i].packets[k].pPH = NULL;
-      m_VideoBlocks[i].packets[k].pPHVF = NULL;
-      m_VideoBlocks[i].packets[k].pVideoData = NULL;
-   }
+      _empty_block_buffer_index(i);
+   packet_pool_uninit(&m_PacketsPool);
 
    m_siVideoBuffersInstancesCount--;
 }
@@ -104,6 +91,7 @@ bool VideoRxPacketsBuffer::init(Model* pModel)
    }
    log_line("[VideoRXBuffer] Initialize video Rx buffer instance number %d.", m_iInstanceIndex+1);
    _empty_buffers("init", NULL, NULL);
+   _update_packets_pool(pModel);
    m_bInitialized = true;
    log_line("[VideoRXBuffer] Initialized video Tx buffer instance number %d.", m_iInstanceIndex+1);
    return true;
@@ -115,6 +103,7 @@ bool VideoRxPacketsBuffer::uninit()
       return true;
 
    log_line("[VideoRXBuffer] Uninitialize video Tx buffer instance number %d.", m_iInstanceIndex+1);
+   packet_pool_log_info(&m_PacketsPool, "VideoRXBuffer");
    
    m_bInitialized = false;
    return true;
@@ -125,41 +114,72 @@ void VideoRxPacketsBuffer::emptyBuffers(const char* szReason)
    _empty_buffers(szReason, NULL, NULL);
 }
 
-bool VideoRxPacketsBuffer::_check_allocate_video_block_in_buffer(int iBufferIndex)
+// Slots fit the largest video packet of the vehicle's video profiles; a single block of packets is kept
+// allocated as reserve, the rest follows the blocks in the buffer.
+void VideoRxPacketsBuffer::_update_packets_pool(Model* pModel)
 {
-   if ( (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) )
-      return false;
+   if ( NULL == pModel )
+      return;
 
-   for( int i=0; i<m_VideoBlocks[iBufferIndex].iBlockDataPackets + m_VideoBlocks[iBufferIndex].iBlockECPackets; i++ )
+   int iMaxVideoDataLength = 0;
+   int iMaxBlockPackets = 0;
+   for( int i=0; i<MAX_VIDEO_LINK_PROFILES; i++ )
    {
-      if ( NULL != m_VideoBlocks[iBufferIndex].packets[i].pRawData )
-         continue;
-
-      m_VideoBlocks[iBufferIndex].packets[i].pRawData = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
-      if ( NULL == m_VideoBlocks[iBufferIndex].packets[i].pRawData )
-      {
-         log_error_and_alarm("[VideoRXBuffer] Failed to allocate packet, buffer index: %d, packet index %d", iBufferIndex, i);
-         return false;
-      }
-      m_VideoBlocks[iBufferIndex].packets[i].pPH = (t_packet_header*)&(m_VideoBlocks[iBufferIndex].packets[i].pRawData[0]);
-      m_VideoBlocks[iBufferIndex].packets[i].pPHVF = (t_packet_header_video_full_98*)&(m_VideoBlocks[iBufferIndex].packets[i].pRawData[sizeof(t_packet_header)]);
-      m_VideoBlocks[iBufferIndex].packets[i].pVideoData = &(m_VideoBlocks[iBufferIndex].packets[i].pRawData[sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98)]);
-      _empty_block_buffer_packet_index(iBufferIndex, i);
+      if ( pModel->video_link_profiles[i].video_data_length > iMaxVideoDataLength )
+         iMaxVideoDataLength = pModel->video_link_profiles[i].video_data_length;
+      if ( pModel->video_link_profiles[i].block_packets + pModel->video_link_profiles[i].block_fecs > iMaxBlockPackets )
+         iMaxBlockPackets = pModel->video_link_profiles[i].block_packets + pModel->video_link_profiles[i].block_fecs;
    }
-   return true;
+   int iSlotSize = sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98) + sizeof(t_packet_header_video_full_98_debug_info) + iMaxVideoDataLength;
+   if ( (0 == m_PacketsPool.iUsedSlots) && (iSlotSize < m_PacketsPool.iSlotSize) )
+   {
+      packet_pool_uninit(&m_PacketsPool);
+      packet_pool_init(&m_PacketsPool, iSlotSize, iMaxBlockPackets);
+   }
+   _check_packets_pool_slot_size(iSlotSize);
+   packet_pool_set_reserve(&m_PacketsPool, iMaxBlockPackets);
+   log_line("[VideoRXBuffer] Packets pool slot size: %d bytes, reserve: %d packets", m_PacketsPool.iSlotSize, m_PacketsPool.iReserveSlots);
 }
 
-void VideoRxPacketsBuffer::_empty_block_buffer_packet_index(int iBufferIndex, int iPacketIndex)
+// Returns false if the pool had to be recreated with bigger slots (buffers are emptied)
+bool VideoRxPacketsBuffer::_check_packets_pool_slot_size(int iPacketSize)
 {
-   m_VideoBlocks[iBufferIndex].packets[iPacketIndex].uReceivedTime = 0;
-   m_VideoBlocks[iBufferIndex].packets[iPacketIndex].uRequestedTime = 0;
-   m_VideoBlocks[iBufferIndex].packets[iPacketIndex].bEndOfFirstIFrameDetected = m_bEndOfFirstIFrameDetected;
-   m_VideoBlocks[iBufferIndex].packets[iPacketIndex].bEmpty = true;
-   m_VideoBlocks[iBufferIndex].packets[iPacketIndex].bOutputed = false;
+   if ( iPacketSize > MAX_PACKET_TOTAL_SIZE )
+      iPacketSize = MAX_PACKET_TOTAL_SIZE;
+   if ( iPacketSize <= m_PacketsPool.iSlotSize )
+      return true;
+
+   log_line("[VideoRXBuffer] Packets pool slot size changes from %d to %d bytes.", m_PacketsPool.iSlotSize, iPacketSize);
+   if ( m_PacketsPool.iUsedSlots > 0 )
+      _empty_buffers("video packets size increased", NULL, NULL);
+   int iReserveSlots = m_PacketsPool.iReserveSlots;
+   packet_pool_uninit(&m_PacketsPool);
+   packet_pool_init(&m_PacketsPool, iPacketSize, iReserveSlots);
+   return false;
+}
+
+u8* VideoRxPacketsBuffer::_alloc_block_packet(int iBufferIndex, int iPacketIndex)
+{
+   u16 uSlot = packet_pool_alloc(&m_PacketsPool);
+   if ( PACKET_POOL_INVALID_SLOT == uSlot )
+   {
+      log_softerror_and_alarm("[VideoRXBuffer] Failed to allocate packet, buffer index: %d, packet index %d", iBufferIndex, iPacketIndex);
+      return NULL;
+   }
+   m_VideoBlocks[iBufferIndex].uPacketSlots[iPacketIndex] = uSlot;
+   m_VideoBlocks[iBufferIndex].uReceivedMask |= ((u64)1) << iPacketIndex;
+   return packet_pool_get(&m_PacketsPool, uSlot);
 }
 
 void VideoRxPacketsBuffer::_empty_block_buffer_index(int iBufferIndex)
 {
+   u64 uMask = m_VideoBlocks[iBufferIndex].uReceivedMask;
+   while ( uMask )
+   {
+      int iPacketIndex = __builtin_ctzll(uMask);
+      uMask &= uMask - 1;
+      packet_pool_free(&m_PacketsPool, m_VideoBlocks[iBufferIndex].uPacketSlots[iPacketIndex]);
+   }
    m_VideoBlocks[iBufferIndex].uReceivedTime = 0;
    m_VideoBlocks[iBufferIndex].uVideoBlockIndex = 0;
    m_VideoBlocks[iBufferIndex].iBlockDataSize = 0;
@@ -168,10 +188,26 @@ void VideoRxPacketsBuffer::_empty_block_buffer_index(int iBufferIndex)
    m_VideoBlocks[iBufferIndex].iRecvDataPackets = 0;
    m_VideoBlocks[iBufferIndex].iRecvECPackets = 0;
    m_VideoBlocks[iBufferIndex].iReconstructedECUsed = 0;
+   m_VideoBlocks[iBufferIndex].uReceivedMask = 0;
+   m_VideoBlocks[iBufferIndex].uOutputedMask = 0;
    for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
-   {
-      _empty_block_buffer_packet_index(iBufferIndex, k);
-   }
+      m_VideoBlocks[iBufferIndex].uPacketSlots[k] = PACKET_POOL_INVALID_SLOT;
+}
+
+void VideoRxPacketsBuffer::_log_block_first_packet(const char* szName, int iBufferIndex)
+{
+   u8* pPacket = getVideoPacket(&m_VideoBlocks[iBufferIndex], 0);
+   if ( NULL == pPacket )
+      return;
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   t_packet_header_video_full_98* pPHVF = (t_packet_header_video_full_98*)(pPacket + sizeof(t_packet_header));
+   log_line("[VRXBuffers] %s recv video block: %u = [%u/%u] (retr: %s), frame id: %u, stream id/packet index: %u, radio index: %u",
+      szName, m_VideoBlocks[iBufferIndex].uVideoBlockIndex,
+      pPHVF->uCurrentBlockIndex, pPHVF->uCurrentBlockPacketIndex,
+      (pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED)?"yes":"no",
+      pPHVF->uFrameId,
+      (pPH->stream_packet_idx & PACKET_FLAGS_MASK_STREAM_INDEX) >> PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX,
+      pPH->stream_packet_idx & PACKET_FLAGS_MASK_STREAM_PACKET_IDX, pPH->radio_link_packet_index );
 }
 
 void VideoRxPacketsBuffer::_empty_buffers(const char* szReason, t_packet_header* pPH, t_packet_header_video_full_98* pPHVF)
@@ -204,10 +240,9 @@ void VideoRxPacketsBuffer::_empty_buffers(const char* szReason, t_packet_header*
       if ( m_iBufferIndexFirstReceivedBlock != -1 )
       {
          if ( -1 != m_iBufferIndexFirstReceivedPacketIndex )
-            log_line("[VRXBuffers] buffer[%d][%d] is empty? %s, 0x%X",
+            log_line("[VRXBuffers] buffer[%d][%d] is empty? %s",
                m_iBufferIndexFirstReceivedBlock, m_iBufferIndexFirstReceivedPacketIndex,
-               m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].packets[m_iBufferIndexFirstReceivedPacketIndex].bEmpty?"yes":"no",
-               m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].packets[m_iBufferIndexFirstReceivedPacketIndex].pPH);
+               (NULL == getVideoPacket(&m_VideoBlocks[m_iBufferIndexFirstReceivedBlock], m_iBufferIndexFirstReceivedPacketIndex))?"yes":"no");
          int iBufferIndex = m_iBufferIndexFirstReceivedBlock;
          log_line("[VRXBuffers] First recv video block index: %u, received data/ec in this block: %d,%d, time now, recv: %u - %u = %u",
             m_VideoBlocks[iBufferIndex].uVideoBlockIndex,
@@ -216,15 +251,7 @@ void VideoRxPacketsBuffer::_empty_buffers(const char* szReason, t_packet_header*
             g_TimeNow, m_VideoBlocks[iBufferIndex].uReceivedTime,
             g_TimeNow - m_VideoBlocks[iBufferIndex].uReceivedTime);
 
-         if ( NULL != m_VideoBlocks[iBufferIndex].packets[0].pPH )
-         log_line("[VRXBuffers] First recv video block: %u = [%u/%u] (retr: %s), frame id: %u, stream id/packet index: %u, radio index: %u",
-            m_VideoBlocks[iBufferIndex].uVideoBlockIndex,
-            m_VideoBlocks[iBufferIndex].packets[0].pPHVF->uCurrentBlockIndex,
-            m_VideoBlocks[iBufferIndex].packets[0].pPHVF->uCurrentBlockPacketIndex,
-            (m_VideoBlocks[iBufferIndex].packets[0].pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED)?"yes":"no",
-            m_VideoBlocks[iBufferIndex].packets[0].pPHVF->uFrameId,
-            (m_VideoBlocks[iBufferIndex].packets[0].pPH->stream_packet_idx & PACKET_FLAGS_MASK_STREAM_INDEX) >> PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX,
-            m_VideoBlocks[iBufferIndex].packets[0].pPH->stream_packet_idx & PACKET_FLAGS_MASK_STREAM_PACKET_IDX, m_VideoBlocks[iBufferIndex].packets[0].pPH->radio_link_packet_index );
+         _log_block_first_packet("First", iBufferIndex);
          
          
          iBufferIndex = m_iBufferIndexFirstReceivedBlock+1;
@@ -237,15 +264,7 @@ void VideoRxPacketsBuffer::_empty_buffers(const char* szReason, t_packet_header*
             g_TimeNow,
             m_VideoBlocks[iBufferIndex].uReceivedTime,
             g_TimeNow - m_VideoBlocks[iBufferIndex].uReceivedTime);
-         if ( NULL != m_VideoBlocks[iBufferIndex].packets[0].pPH )
-         log_line("[VRXBuffers] Second recv video block: %u = [%u/%u] (retr: %s), frame id: %u, stream id/packet index: %u, radio index: %u",
-            m_VideoBlocks[iBufferIndex].uVideoBlockIndex,
-            m_VideoBlocks[iBufferIndex].packets[0].pPHVF->uCurrentBlockIndex,
-            m_VideoBlocks[iBufferIndex].packets[0].pPHVF->uCurrentBlockPacketIndex,
-            (m_VideoBlocks[iBufferIndex].packets[0].pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED)?"yes":"no",
-            m_VideoBlocks[iBufferIndex].packets[0].pPHVF->uFrameId,
-            (m_VideoBlocks[iBufferIndex].packets[0].pPH->stream_packet_idx & PACKET_FLAGS_MASK_STREAM_INDEX) >> PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX,
-            m_VideoBlocks[iBufferIndex].packets[0].pPH->stream_packet_idx & PACKET_FLAGS_MASK_STREAM_PACKET_IDX, m_VideoBlocks[iBufferIndex].packets[0].pPH->radio_link_packet_index );
+         _log_block_first_packet("Second", iBufferIndex);
       }
    }
 
@@ -268,150 +287,112 @@ void VideoRxPacketsBuffer::_check_do_ec_for_video_block(int iBufferIndex)
    if ( (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) )
       return;
 
-   if ( 0 == m_VideoBlocks[iBufferIndex].iBlockECPackets )
+   type_rx_video_block_info* pVideoBlock = &(m_VideoBlocks[iBufferIndex]);
+   if ( 0 == pVideoBlock->iBlockECPackets )
       return;
 
-   if ( m_VideoBlocks[iBufferIndex].iRecvDataPackets >= m_VideoBlocks[iBufferIndex].iBlockDataPackets )
+   if ( pVideoBlock->iRecvDataPackets >= pVideoBlock->iBlockDataPackets )
       return;
 
-   if ( m_VideoBlocks[iBufferIndex].iRecvDataPackets + m_VideoBlocks[iBufferIndex].iRecvECPackets < m_VideoBlocks[iBufferIndex].iBlockDataPackets )
+   if ( pVideoBlock->iRecvDataPackets + pVideoBlock->iRecvECPackets < pVideoBlock->iBlockDataPackets )
       return;
 
-   m_VideoBlocks[iBufferIndex].iReconstructedECUsed = m_VideoBlocks[iBufferIndex].iBlockDataPackets - m_VideoBlocks[iBufferIndex].iRecvDataPackets;
+   u64 uMissingMask = video_rx_block_get_missing_data_packets(pVideoBlock);
+   u64 uReceivedDataMask = pVideoBlock->uReceivedMask & (((((u64)1) << pVideoBlock->iBlockDataPackets) - 1));
 
-   //log_line("DEBUG do EC for block %u, buffer index %d, missing packets: %d, block data size: %d", m_VideoBlocks[iBufferIndex].uVideoBlockIndex, iBufferIndex, m_VideoBlocks[iBufferIndex].iReconstructedECUsed, m_VideoBlocks[iBufferIndex].iBlockDataSize);
+   // Find a good PH, PHVF and if there is (or not) video debug info in the block (from a data packet if possible)
+   int iGoodPacketIndex = -1;
+   if ( 0 != uReceivedDataMask )
+      iGoodPacketIndex = __builtin_ctzll(uReceivedDataMask);
+   else if ( 0 != pVideoBlock->uReceivedMask )
+      iGoodPacketIndex = __builtin_ctzll(pVideoBlock->uReceivedMask);
+   if ( -1 == iGoodPacketIndex )
+      return;
 
-   t_packet_header* pPHGood = NULL;
-   t_packet_header_video_full_98* pPHVFGood = NULL;
+   u8* pGoodPacket = getVideoPacket(pVideoBlock, iGoodPacketIndex);
+   t_packet_header* pPHGood = (t_packet_header*)pGoodPacket;
+   t_packet_header_video_full_98* pPHVFGood = (t_packet_header_video_full_98*)(pGoodPacket + sizeof(t_packet_header));
    t_packet_header_video_full_98_debug_info* pPHVFDebugInfoGood = NULL;
+   if ( pPHVFGood->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
+      pPHVFDebugInfoGood = (t_packet_header_video_full_98_debug_info*)(pGoodPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98));
 
-   // Find a good PH, PHVF and if there is (or not) video debug info in the block
-   for( int i=0; i<m_VideoBlocks[iBufferIndex].iBlockDataPackets; i++ )
-   {
-      if ( m_VideoBlocks[iBufferIndex].packets[i].bEmpty )
-         continue;
-      pPHGood = m_VideoBlocks[iBufferIndex].packets[i].pPH;
-      pPHVFGood = m_VideoBlocks[iBufferIndex].packets[i].pPHVF;
-      if ( pPHVFGood->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
-         pPHVFDebugInfoGood = (t_packet_header_video_full_98_debug_info*) m_VideoBlocks[iBufferIndex].packets[i].pVideoData;
-      break;
-   }
-
-   // Add existing data packets, mark and count the ones that are missing
+   // Add existing data packets; get buffers for the ones that are missing and count them
 
    s_FECRxInfo.missing_packets_count = 0;
-   for( int i=0; i<m_VideoBlocks[iBufferIndex].iBlockDataPackets; i++ )
+   for( int i=0; i<pVideoBlock->iBlockDataPackets; i++ )
    {
-      if ( m_VideoBlocks[iBufferIndex].packets[i].bEmpty )
+      u8* pPacket = NULL;
+      if ( uMissingMask & (((u64)1) << i) )
       {
-         u8* pVideoSource = m_VideoBlocks[iBufferIndex].packets[i].pVideoData;
-         if ( NULL != pPHVFDebugInfoGood )
-            pVideoSource += sizeof(t_packet_header_video_full_98_debug_info);
-         s_FECRxInfo.fec_decode_data_packets_pointers[i] = pVideoSource;
+         pPacket = _alloc_block_packet(iBufferIndex, i);
+         if ( NULL == pPacket )
+         {
+            // Give back the buffers taken so far for the missing packets
+            for( u32 k=0; k<s_FECRxInfo.missing_packets_count; k++ )
+            {
+               int iPacketIndex = s_FECRxInfo.fec_decode_missing_packets_indexes[k];
+               packet_pool_free(&m_PacketsPool, pVideoBlock->uPacketSlots[iPacketIndex]);
+               pVideoBlock->uPacketSlots[iPacketIndex] = PACKET_POOL_INVALID_SLOT;
+               pVideoBlock->uReceivedMask &= ~(((u64)1) << iPacketIndex);
+            }
+            return;
+         }
          s_FECRxInfo.fec_decode_missing_packets_indexes[s_FECRxInfo.missing_packets_count] = i;
          s_FECRxInfo.missing_packets_count++;
-         //log_line("DEBUG add packt index %d as missing", i);
+         s_FECRxInfo.fec_decode_data_packets_pointers[i] = pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98);
+         if ( NULL != pPHVFDebugInfoGood )
+            s_FECRxInfo.fec_decode_data_packets_pointers[i] += sizeof(t_packet_header_video_full_98_debug_info);
       }
       else
       {
-         t_packet_header_video_full_98* pPHVF = m_VideoBlocks[iBufferIndex].packets[i].pPHVF;
-         t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*) m_VideoBlocks[iBufferIndex].packets[i].pVideoData;
-
-         u8* pVideoSource = m_VideoBlocks[iBufferIndex].packets[i].pVideoData;
+         pPacket = getVideoPacket(pVideoBlock, i);
+         t_packet_header_video_full_98* pPHVF = (t_packet_header_video_full_98*)(pPacket + sizeof(t_packet_header));
+         s_FECRxInfo.fec_decode_data_packets_pointers[i] = pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98);
          if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
-            pVideoSource += sizeof(t_packet_header_video_full_98_debug_info);
-
-         s_FECRxInfo.fec_decode_data_packets_pointers[i] = pVideoSource;
-
-         u16 uVideoSize = 0;
-         memcpy(&uVideoSize, pVideoSource, sizeof(u16));
-         u32 crc = base_compute_crc32(pVideoSource, pPHVF->uCurrentBlockPacketSize);
-         //log_line("DEBUG add (%s) index %d to EC, video: %X size: %d-%d bytes, CRC %u = %u %s",
-         //   m_VideoBlocks[iBufferIndex].packets[i].bEmpty?"miss":"pkg",
-         //   i, pVideoSource, uVideoSize, pPHVF->uCurrentBlockPacketSize,
-         //   pPHVFDebugInfo->uVideoCRC, crc, (pPHVFDebugInfo->uVideoCRC == crc)?"equal":"different");
+            s_FECRxInfo.fec_decode_data_packets_pointers[i] += sizeof(t_packet_header_video_full_98_debug_info);
       }
    }
 
-   // To fix
-   /*
-   if ( s_FECInfo.missing_packets_count > g_PD_ControllerLinkStats.tmp_video_streams_blocks_max_ec_packets_used[0] )
-   {
-      // missing packets in a block can't be larger than 8 bits (config values for max EC/Data pachets)
-      g_PD_ControllerLinkStats.tmp_video_streams_blocks_max_ec_packets_used[0] = s_FECInfo.missing_packets_count;
-   }
-   */
+   pVideoBlock->iReconstructedECUsed = s_FECRxInfo.missing_packets_count;
 
    // Add the needed FEC packets to the list
    unsigned int pos = 0;
-   int iECDelta = m_VideoBlocks[iBufferIndex].iBlockDataPackets;
-   for( int i=0; i<m_VideoBlocks[iBufferIndex].iBlockECPackets; i++ )
+   int iECDelta = pVideoBlock->iBlockDataPackets;
+   u64 uReceivedECMask = pVideoBlock->uReceivedMask >> iECDelta;
+   while ( (0 != uReceivedECMask) && (pos < s_FECRxInfo.missing_packets_count) )
    {
-      if ( ! m_VideoBlocks[iBufferIndex].packets[i+iECDelta].bEmpty )
-      {
-         t_packet_header_video_full_98* pPHVF = m_VideoBlocks[iBufferIndex].packets[i+iECDelta].pPHVF;
-         t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*) m_VideoBlocks[iBufferIndex].packets[i+iECDelta].pVideoData;
-         u8* pVideoSource = m_VideoBlocks[iBufferIndex].packets[i+iECDelta].pVideoData;
-         if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
-            pVideoSource += sizeof(t_packet_header_video_full_98_debug_info);
-         s_FECRxInfo.fec_decode_fec_packets_pointers[pos] = pVideoSource;
-         s_FECRxInfo.fec_decode_fec_indexes[pos] = i;
-
-         u32 crc = base_compute_crc32(pVideoSource, m_VideoBlocks[iBufferIndex].packets[i+iECDelta].pPH->total_length - sizeof(t_packet_header) - sizeof(t_packet_header_video_full_98) - sizeof(t_packet_header_video_full_98_debug_info));
-         //log_line("DEBUG added EC packet index %d (%d total bytes) for decoding. CRC: %u = %u ? %s",
-         //      i + iECDelta, m_VideoBlocks[iBufferIndex].packets[i+iECDelta].pPH->total_length,
-         //      pPHVFDebugInfo->uVideoCRC, crc, (pPHVFDebugInfo->uVideoCRC == crc)?"equal":"different");
-
-         pos++;
-         if ( pos == s_FECRxInfo.missing_packets_count )
-            break;
-      }
+      int i = __builtin_ctzll(uReceivedECMask);
+      uReceivedECMask &= uReceivedECMask - 1;
+      if ( i >= pVideoBlock->iBlockECPackets )
+         break;
+      u8* pPacket = getVideoPacket(pVideoBlock, i+iECDelta);
+      t_packet_header_video_full_98* pPHVF = (t_packet_header_video_full_98*)(pPacket + sizeof(t_packet_header));
+      u8* pVideoSource = pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98);
+      if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
+         pVideoSource += sizeof(t_packet_header_video_full_98_debug_info);
+      s_FECRxInfo.fec_decode_fec_packets_pointers[pos] = pVideoSource;
+      s_FECRxInfo.fec_decode_fec_indexes[pos] = i;
+      pos++;
    }
 
-   //log_line("DEBUG do actual EC for block size %d...", m_VideoBlocks[iBufferIndex].iBlockDataSize );
-
-   fec_decode(m_VideoBlocks[iBufferIndex].iBlockDataSize, s_FECRxInfo.fec_decode_data_packets_pointers, m_VideoBlocks[iBufferIndex].iBlockDataPackets, s_FECRxInfo.fec_decode_fec_packets_pointers, s_FECRxInfo.fec_decode_fec_indexes, s_FECRxInfo.fec_decode_missing_packets_indexes, s_FECRxInfo.missing_packets_count );
-   //log_line("DEBUG done EC decoding for block size %d, missing packets: %d", m_VideoBlocks[iBufferIndex].iBlockDataSize, s_FECRxInfo.missing_packets_count);
+   fec_decode(pVideoBlock->iBlockDataSize, s_FECRxInfo.fec_decode_data_packets_pointers, pVideoBlock->iBlockDataPackets, s_FECRxInfo.fec_decode_fec_packets_pointers, s_FECRxInfo.fec_decode_fec_indexes, s_FECRxInfo.fec_decode_missing_packets_indexes, s_FECRxInfo.missing_packets_count );
    
-   // Mark all data packets reconstructed as received, set the right info in them (video header info)
+   // Reconstructed data packets are already marked as received; set the right info in them (video header info)
    for( u32 i=0; i<s_FECRxInfo.missing_packets_count; i++ )
    {
       int iPacketIndex = s_FECRxInfo.fec_decode_missing_packets_indexes[i];
-      //log_line("DEBUG recover packet index %d", iPacketIndex);
-      m_VideoBlocks[iBufferIndex].packets[iPacketIndex].bEmpty = false;
-      m_VideoBlocks[iBufferIndex].packets[iPacketIndex].bOutputed = false;
-      m_VideoBlocks[iBufferIndex].packets[iPacketIndex].bEndOfFirstIFrameDetected = m_bEndOfFirstIFrameDetected;
-      m_VideoBlocks[iBufferIndex].packets[iPacketIndex].uReceivedTime = g_TimeNow;
-      m_VideoBlocks[iBufferIndex].iRecvDataPackets++;
-
-      t_packet_header* pPH = m_VideoBlocks[iBufferIndex].packets[iPacketIndex].pPH;
-      t_packet_header_video_full_98* pPHVF = m_VideoBlocks[iBufferIndex].packets[iPacketIndex].pPHVF;
-      t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*) m_VideoBlocks[iBufferIndex].packets[iPacketIndex].pVideoData;
-      if ( NULL != pPHGood )
-         memcpy(pPH, pPHGood, sizeof(t_packet_header));
-      if ( NULL != pPHVFGood )
-         memcpy(pPHVF, pPHVFGood, sizeof(t_packet_header_video_full_98));
+      pVideoBlock->uOutputedMask &= ~(((u64)1) << iPacketIndex);
+      pVideoBlock->iRecvDataPackets++;
+
+      u8* pPacket = getVideoPacket(pVideoBlock, iPacketIndex);
+      t_packet_header* pPH = (t_packet_header*)pPacket;
+      t_packet_header_video_full_98* pPHVF = (t_packet_header_video_full_98*)(pPacket + sizeof(t_packet_header));
+      memcpy(pPH, pPHGood, sizeof(t_packet_header));
+      memcpy(pPHVF, pPHVFGood, sizeof(t_packet_header_video_full_98));
       if ( NULL != pPHVFDebugInfoGood )
-         memcpy(pPHVFDebugInfo, pPHVFDebugInfoGood, sizeof(t_packet_header_video_full_98_debug_info));
+         memcpy(pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98), pPHVFDebugInfoGood, sizeof(t_packet_header_video_full_98_debug_info));
 
       pPHVF->uCurrentBlockPacketIndex = iPacketIndex;
-
-      u8* pVideoSource = m_VideoBlocks[iBufferIndex].packets[iPacketIndex].pVideoData;
-      if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
-         pVideoSource += sizeof(t_packet_header_video_full_98_debug_info);
-
-      u16 uVideoDataSize = 0;
-      memcpy(&uVideoDataSize, pVideoSource, sizeof(u16));
-      u32 crc = base_compute_crc32(pVideoSource, pPHVF->uCurrentBlockPacketSize);
-      //log_line("DEBUG recovered data packet index %d [%u/%u] (%d total bytes, %d video data), CRC %u",
-      //   iPacketIndex, pPHVF->uCurrentBlockIndex, pPHVF->uCurrentBlockPacketIndex,
-      //   m_VideoBlocks[iBufferIndex].packets[iPacketIndex].pPH->total_length,
-      //   uVideoDataSize,
-      //   crc);
-      
-      // To fix
-      //if ( m_SM_VideoDecodeStats.currentPacketsInBuffers > m_SM_VideoDecodeStats.maxPacketsInBuffers )
-      //   m_SM_VideoDecodeStats.maxPacketsInBuffers = m_SM_VideoDecodeStats.currentPacketsInBuffers;
    }
 }
 
@@ -421,7 +402,6 @@ bool VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPa
    if ( (NULL == pPacket) || (iPacketLength < (int)(sizeof(t_packet_header)+sizeof(t_packet_header_video_full_98))) || (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) )
       return false;
 
-   t_packet_header* pPH = (t_packet_header*)pPacket;
    t_packet_header_video_full_98* pPHVF = (t_packet_header_video_full_98*)(pPacket + sizeof(t_packet_header));
    
    m_VideoBlocks[iBufferIndex].uVideoBlockIndex = pPHVF->uCurrentBlockIndex;
@@ -430,34 +410,13 @@ bool VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPa
    m_VideoBlocks[iBufferIndex].iBlockECPackets = pPHVF->uCurrentBlockECPackets;
    m_VideoBlocks[iBufferIndex].uReceivedTime = g_TimeNow;
 
-   if ( ! _check_allocate_video_block_in_buffer(iBufferIndex) )
+   int iPacketIndex = pPHVF->uCurrentBlockPacketIndex;
+   u64 uPacketBit = ((u64)1) << iPacketIndex;
+   if ( (m_VideoBlocks[iBufferIndex].uReceivedMask | m_VideoBlocks[iBufferIndex].uOutputedMask) & uPacketBit )
       return false;
 
-   /*
-   if ( pPHVF->uCurrentBlockPacketIndex == (iBufferIndex%5) )
-   {
-      log_line("DEBUG test");
-      m_VideoBlocks[iBufferIndex].packets[iBufferIndex%5].bEndOfFirstIFrameDetected = false;
-      m_VideoBlocks[iBufferIndex].packets[iBufferIndex%5].bEmpty = true;
-      m_VideoBlocks[iBufferIndex].packets[iBufferIndex%5].bOutputed = false;
-      m_VideoBlocks[iBufferIndex].packets[iBufferIndex%5].uReceivedTime = 0;
-      memset(m_VideoBlocks[iBufferIndex].packets[iBufferIndex%5].pRawData, 0, MAX_PACKET_TOTAL_SIZE);
-      //m_VideoBlocks[iBufferIndex].iRecvDataPackets--;
-      return;
-   }
-   */
-
-   if ( pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED )
-   {
-      //log_line("DEBUG vrx add retr on buf index %d: current state empty: %d, outputed: %d",
-      //    iBufferIndex,
-      //    m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].bEmpty,
-      //    m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].bOutputed );
-   }
-   
-   if ( ! m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].bEmpty )
-      return false;
-   if ( m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].bOutputed )
+   u8* pPacketBuffer = _alloc_block_packet(iBufferIndex, iPacketIndex);
+   if ( NULL == pPacketBuffer )
       return false;
 
    if ( pPHVF->uCurrentBlockIndex > m_uMaxVideoBlockIndexInBuffer )
@@ -467,7 +426,6 @@ bool VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPa
    //  pPHVF->uCurrentBlockIndex, pPHVF->uCurrentBlockPacketIndex,
    //  pPH->total_length, iPacketLength, iBufferIndex, pPHVF->uCurrentBlockPacketIndex, m_iBufferIndexFirstReceivedBlock, m_iBufferIndexFirstReceivedPacketIndex);
 
-   m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].bEndOfFirstIFrameDetected = m_bEndOfFirstIFrameDetected;
    if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_END_FRAME )
    if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_IS_IFRAME )
       m_bEndOfFirstIFrameDetected = true;
@@ -492,15 +450,11 @@ bool VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPa
   
    // End - Update Runtime Stats
 
-   m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].bEmpty = false;
-   m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].bOutputed = false;
-   
-   memcpy(m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].pRawData, pPacket, iPacketLength);
+   memcpy(pPacketBuffer, pPacket, iPacketLength);
    
    // Set remaining empty space to 0 as EC uses the good video data packets too.
    
-   t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*)m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].pVideoData;
-   u8* pVideoSource = m_VideoBlocks[iBufferIndex].packets[pPHVF->uCurrentBlockPacketIndex].pVideoData;
+   u8* pVideoSource = pPacketBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98);
    if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
       pVideoSource += sizeof(t_packet_header_video_full_98_debug_info);
 
@@ -511,10 +465,6 @@ bool VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPa
       //log_line("DEBUG fill %d empty bytes on %X", (int)pPHVF->uCurrentBlockPacketSize - sizeof(u16) - (int)uVideoDataSize, pVideoSource);
       memset(pVideoSource + sizeof(u16) + uVideoDataSize, 0, (int)pPHVF->uCurrentBlockPacketSize - sizeof(u16) - (int)uVideoDataSize );
    }
-   u32 crc = base_compute_crc32(pVideoSource, pPHVF->uCurrentBlockPacketSize);
-   //log_line("DEBUG video source size: %d (expected: %d - 2), CRC %u = %u %s",
-   //   uVideoDataSize, pPHVF->uCurrentBlockPacketSize,
-   //   pPHVFDebugInfo->uVideoCRC, crc, (pPHVFDebugInfo->uVideoCRC == crc)?"equal":"different");
 
    if ( pPHVF->uCurrentBlockPacketIndex < pPHVF->uCurrentBlockDataPackets )
       m_VideoBlocks[iBufferIndex].iRecvDataPackets++;
@@ -565,6 +515,17 @@ bool VideoRxPacketsBuffer::checkAddVideoPacket(u8* pPacket, int iPacketLength)
    }
    u16 uVideoSize = 0;
    memcpy(&uVideoSize, pVideoSource, sizeof(u16));
+
+   if ( (pPHVF->uCurrentBlockDataPackets > MAX_DATA_PACKETS_IN_BLOCK) || (pPHVF->uCurrentBlockECPackets > MAX_FECS_PACKETS_IN_BLOCK) ||
+        (pPHVF->uCurrentBlockPacketIndex >= MAX_TOTAL_PACKETS_IN_BLOCK) || (iPacketLength > MAX_PACKET_TOTAL_SIZE) ||
+        (pPHVF->uCurrentBlockPacketSize + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98) + sizeof(t_packet_header_video_full_98_debug_info) > MAX_PACKET_TOTAL_SIZE) )
+      return false;
+
+   // Empties the buffers if the pool has to change to bigger packets
+   int iStoredPacketSize = sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98) + sizeof(t_packet_header_video_full_98_debug_info) + pPHVF->uCurrentBlockPacketSize;
+   if ( iPacketLength > iStoredPacketSize )
+      iStoredPacketSize = iPacketLength;
+   _check_packets_pool_slot_size(iStoredPacketSize);
    
    if ( pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
    {
@@ -653,9 +614,6 @@ bool VideoRxPacketsBuffer::checkAddVideoPacket(u8* pPacket, int iPacketLength)
       m_VideoBlocks[iTargetBufferIndex].iBlockDataSize = pPHVF->uCurrentBlockPacketSize;
       m_VideoBlocks[iTargetBufferIndex].iBlockDataPackets = pPHVF->uCurrentBlockDataPackets;
       m_VideoBlocks[iTargetBufferIndex].iBlockECPackets = pPHVF->uCurrentBlockECPackets;
-
-      if ( ! _check_allocate_video_block_in_buffer(iTargetBufferIndex) )
-         return false;
       uVideoBlockIndex++;
       iTargetBufferIndex++;
       if ( iTargetBufferIndex >= MAX_RXTX_BLOCKS_BUFFER )
@@ -686,7 +644,7 @@ bool VideoRxPacketsBuffer::hasFirstVideoPacketInBuffer()
 {
    if ( -1 == m_iBufferIndexFirstReceivedBlock )
       return false;
-   return ! m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].packets[m_iBufferIndexFirstReceivedPacketIndex].bEmpty;
+   return 0 != (m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].uReceivedMask & (((u64)1) << m_iBufferIndexFirstReceivedPacketIndex));
 }
 
 bool VideoRxPacketsBuffer::hasIncompleteBlocks()
@@ -722,11 +680,20 @@ int VideoRxPacketsBuffer::getBlocksCountInBuffer()
    return iCountBlocks;
 }
 
-type_rx_video_packet_info* VideoRxPacketsBuffer::getFirstVideoPacketInBuffer()
+u8* VideoRxPacketsBuffer::getFirstVideoPacketInBuffer()
 {
    if ( -1 == m_iBufferIndexFirstReceivedBlock )
       return NULL;
-   return &(m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].packets[m_iBufferIndexFirstReceivedPacketIndex]);
+   return getVideoPacket(&(m_VideoBlocks[m_iBufferIndexFirstReceivedBlock]), m_iBufferIndexFirstReceivedPacketIndex);
+}
+
+u8* VideoRxPacketsBuffer::getVideoPacket(type_rx_video_block_info* pVideoBlock, int iPacketIndex)
+{
+   if ( (NULL == pVideoBlock) || (iPacketIndex < 0) || (iPacketIndex >= MAX_TOTAL_PACKETS_IN_BLOCK) )
+      return NULL;
+   if ( ! (pVideoBlock->uReceivedMask & (((u64)1) << iPacketIndex)) )
+      return NULL;
+   return packet_pool_get(&m_PacketsPool, pVideoBlock->uPacketSlots[iPacketIndex]);
 }
 
 type_rx_video_block_info* VideoRxPacketsBuffer::getFirstVideoBlockInBuffer()
@@ -753,7 +720,7 @@ void VideoRxPacketsBuffer::advanceStartPosition()
       return;
 
    u32 uFirstVideoBlockIndexInBuffer = m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].uVideoBlockIndex;
-   m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].packets[m_iBufferIndexFirstReceivedPacketIndex].bOutputed = true;
+   m_VideoBlocks[m_iBufferIndexFirstReceivedBlock].uOutputedMask |= ((u64)1) << m_iBufferIndexFirstReceivedPacketIndex;
    m_iBufferIndexFirstReceivedPacketIndex++;
    
    // Skip over the EC packets or empty blocks (iBlockDataPackets is 0)
@@ -3,25 +3,14 @@
 #include "../base/base.h"
 #include "../base/config.h"
 #include "../base/models.h"
+#include "../base/packet_pool.h"
 #include "../radio/radiopackets2.h"
 
+// The packets of a block are stored in the packets pool, only for the packets actually received (or
+// rebuilt with EC). The block keeps the pool slot of each packet and bitmaps of the packets state, so
+// checking a block for missing packets doesn't touch the packets memory.
 typedef struct
 {
-   t_packet_header* pPH; // pointer inside pRawData
-   t_packet_header_video_full_98* pPHVF; // pointer inside pRawData
-   u8* pVideoData; // pointer inside pRawData
-   u8* pRawData;
-   u32 uReceivedTime;
-   u32 uRequestedTime; // if requested for retransmission
-   bool bEndOfFirstIFrameDetected;
-   bool bEmpty;
-   bool bOutputed;
-}
-type_rx_video_packet_info;
-
-typedef struct
-{
-   type_rx_video_packet_info packets[MAX_TOTAL_PACKETS_IN_BLOCK];
    u32 uVideoBlockIndex;
    u32 uReceivedTime;
    int iBlockDataSize;
@@ -30,9 +19,21 @@ typedef struct
    int iRecvDataPackets;
    int iRecvECPackets;
    int iReconstructedECUsed;
+   u64 uReceivedMask; // bit k: packet k is in the buffer (has a pool slot)
+   u64 uOutputedMask;
+   u16 uPacketSlots[MAX_TOTAL_PACKETS_IN_BLOCK]; // PACKET_POOL_INVALID_SLOT if not received
 }
 type_rx_video_block_info;
 
+// Data packets of the block that are not received yet
+static inline u64 video_rx_block_get_missing_data_packets(type_rx_video_block_info* pVideoBlock)
+{
+   if ( pVideoBlock->iBlockDataPackets <= 0 )
+      return 0;
+   u64 uDataMask = (pVideoBlock->iBlockDataPackets >= 64) ? (~((u64)0)) : ((((u64)1) << pVideoBlock->iBlockDataPackets) - 1);
+   return uDataMask & (~pVideoBlock->uReceivedMask);
+}
+
 
 class VideoRxPacketsBuffer
 {
@@ -51,7 +52,10 @@ class VideoRxPacketsBuffer
       bool hasFirstVideoPacketInBuffer();
       bool hasIncompleteBlocks();
       int getBlocksCountInBuffer();
-      type_rx_video_packet_info* getFirstVideoPacketInBuffer();
+      // Returns the first packet to output (starting with its t_packet_header), NULL if not received yet
+      u8* getFirstVideoPacketInBuffer();
+      // Returns the packet (starting with its t_packet_header), NULL if not received
+      u8* getVideoPacket(type_rx_video_block_info* pVideoBlock, int iPacketIndex);
       type_rx_video_block_info* getFirstVideoBlockInBuffer();
       type_rx_video_block_info* getVideoBlockInBuffer(int iStartPosition);
       void advanceStartPosition();
@@ -63,9 +67,11 @@ class VideoRxPacketsBuffer
 
    protected:
 
-      bool _check_allocate_video_block_in_buffer(int iBufferIndex);
-      void _empty_block_buffer_packet_index(int iBufferIndex, int iPacketIndex);
+      void _update_packets_pool(Model* pModel);
+      bool _check_packets_pool_slot_size(int iPacketSize);
+      u8* _alloc_block_packet(int iBufferIndex, int iPacketIndex);
       void _empty_block_buffer_index(int iBufferIndex);
+      void _log_block_first_packet(const char* szName, int iBufferIndex);
       void _empty_buffers(const char* szReason, t_packet_header* pPH, t_packet_header_video_full_98* pPHVF);
       void _check_do_ec_for_video_block(int iBufferIndex);
       // Returns true if the packet has the highest video block/packet index received (in order)
@@ -85,6 +91,7 @@ class VideoRxPacketsBuffer
       int m_iBufferIndexFirstReceivedBlock;
       int m_iBufferIndexFirstReceivedPacketIndex;
       type_rx_video_block_info m_VideoBlocks[MAX_RXTX_BLOCKS_BUFFER];
+      t_packet_pool m_PacketsPool;
       u8 m_TempVideoBuffer[MAX_PACKET_TOTAL_SIZE];
 
       u32 m_uMaxVideoBlockIndexReceived;
@@ -0,0 +1,267 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/adaptive_fec.h"
+
+// Simulates a video stream over a lossy radio link and compares fixed EC schemes with the
+// adaptive EC scheme controller: airtime used for video data (throughput) versus video blocks
+// that could not be reconstructed. Retransmissions are not simulated.
+// Usage: test_adaptive_fec [-seconds n] [-seed n]
+
+#define SIM_PACKETS_PER_SECOND 900
+#define SIM_FEEDBACK_DELAY_MS 20
+
+int s_iFailed = 0;
+int s_iSimSeconds = 60;
+u64 s_uRandomState = 1;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u32 _random_per_thousand()
+{
+   s_uRandomState ^= s_uRandomState >> 12;
+   s_uRandomState ^= s_uRandomState << 25;
+   s_uRandomState ^= s_uRandomState >> 27;
+   return (u32)(((s_uRandomState * 2685821657736338717ULL) >> 32) % 1000);
+}
+
+typedef struct
+{
+   const char* szName;
+   // Gilbert-Elliott channel, per thousand packets; the loss in the good state changes over time
+   int iLossClean;
+   int iLossDegraded;
+   int iDegradedFromMs;
+   int iDegradedToMs;
+   int iBurstEnter;
+   int iBurstExit;
+   int iBurstLoss;
+} t_sim_channel;
+
+typedef struct
+{
+   u32 uBlocks;
+   u32 uBlocksLost;
+   u32 uDataPackets;
+   u32 uECPackets;
+   u32 uSchemeChanges;
+} t_sim_result;
+
+void _simulate(t_sim_channel* pChannel, int iDataPackets, int iECPackets, bool bAdaptive, u32 uSeed, t_sim_result* pResult)
+{
+   memset(pResult, 0, sizeof(t_sim_result));
+   s_uRandomState = 0x9E3779B97F4A7C15ULL ^ uSeed;
+
+   t_adaptive_fec_state state;
+   adaptive_fec_init(&state, iDataPackets, iECPackets);
+   int iData = iDataPackets;
+   int iEC = iECPackets;
+
+   t_packet_data_video_ec_recovery_stats stats;
+   memset(&stats, 0, sizeof(stats));
+   t_packet_data_video_ec_recovery_stats statsInFlight;
+   u32 uTimeStatsArrive = 0;
+   bool bStatsInFlight = false;
+   u32 uTimeLastStats = 0;
+   bool bBadState = false;
+
+   u64 uTimeMicros = 0;
+   u64 uEndMicros = (u64)s_iSimSeconds * 1000000;
+   while ( uTimeMicros < uEndMicros )
+   {
+      // Send one video block
+      int iReceivedData = 0;
+      int iReceivedEC = 0;
+      for( int i=0; i<iData+iEC; i++ )
+      {
+         u32 uTimeMs = (u32)(uTimeMicros/1000);
+         int iLoss = pChannel->iLossClean;
+         if ( ((int)uTimeMs >= pChannel->iDegradedFromMs) && ((int)uTimeMs < pChannel->iDegradedToMs) )
+            iLoss = pChannel->iLossDegraded;
+         if ( bBadState )
+         {
+            iLoss = pChannel->iBurstLoss;
+            if ( (int)_random_per_thousand() < pChannel->iBurstExit )
+               bBadState = false;
+         }
+         else if ( (int)_random_per_thousand() < pChannel->iBurstEnter )
+            bBadState = true;
+
+         if ( (int)_random_per_thousand() >= iLoss )
+         {
+            if ( i < iData )
+               iReceivedData++;
+            else
+               iReceivedEC++;
+         }
+         uTimeMicros += 1000000/SIM_PACKETS_PER_SECOND;
+      }
+      pResult->uBlocks++;
+      pResult->uDataPackets += iData;
+      pResult->uECPackets += iEC;
+
+      // Controller side
+      if ( iReceivedData + iReceivedEC < iData )
+      {
+         pResult->uBlocksLost++;
+         stats.uBlocksLost++;
+      }
+      else
+      {
+         stats.uBlocksOutput++;
+         int iECUsed = iData - iReceivedData;
+         if ( iECUsed > VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE )
+            iECUsed = VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE;
+         if ( iECUsed > 0 )
+            stats.uBlocksECUsed[iECUsed-1]++;
+      }
+      stats.uBlockDataPackets = iData;
+      stats.uBlockECPackets = iEC;
+
+      u32 uTimeMs = (u32)(uTimeMicros/1000);
+      if ( uTimeMs >= uTimeLastStats + ADAPTIVE_FEC_STATS_INTERVAL_MS )
+      {
+         stats.uIntervalMs = uTimeMs - uTimeLastStats;
+         uTimeLastStats = uTimeMs;
+         memcpy(&statsInFlight, &stats, sizeof(stats));
+         bStatsInFlight = true;
+         uTimeStatsArrive = uTimeMs + SIM_FEEDBACK_DELAY_MS;
+         memset(&stats, 0, sizeof(stats));
+      }
+
+      // Vehicle side: new EC scheme is used starting with the next block
+      if ( bAdaptive && bStatsInFlight && (uTimeMs >= uTimeStatsArrive) )
+      {
+         bStatsInFlight = false;
+         if ( adaptive_fec_on_recovery_stats(&state, &statsInFlight, uTimeMs) )
+         {
+            iData = state.iDataPackets;
+            iEC = state.iECPackets;
+            pResult->uSchemeChanges++;
+         }
+      }
+   }
+}
+
+// Returns the video data share of the airtime, in percents
+float _log_result(const char* szChannel, const char* szScheme, t_sim_result* pResult)
+{
+   float fDataShare = 100.0 * (float)pResult->uDataPackets / (float)(pResult->uDataPackets + pResult->uECPackets);
+   log_line("%-14s %-10s data airtime: %5.1f%%, unrecoverable blocks: %6u of %6u (%6.2f per thousand), scheme changes: %u",
+      szChannel, szScheme, fDataShare, pResult->uBlocksLost, pResult->uBlocks,
+      1000.0 * (float)pResult->uBlocksLost / (float)pResult->uBlocks, pResult->uSchemeChanges);
+   return fDataShare;
+}
+
+float _lost_per_thousand(t_sim_result* pResult)
+{
+   return 1000.0 * (float)pResult->uBlocksLost / (float)pResult->uBlocks;
+}
+
+void _test_controller_steps()
+{
+   t_adaptive_fec_state state;
+   adaptive_fec_init(&state, 9, 3);
+   t_packet_data_video_ec_recovery_stats stats;
+   memset(&stats, 0, sizeof(stats));
+   stats.uBlockDataPackets = 9;
+   stats.uBlockECPackets = 3;
+   stats.uBlocksOutput = 50;
+
+   // Clean link: goes down one EC packet at a time, after the hold time
+   u32 uTime = 1000;
+   _check_true("No change on first clean stats", 0 == adaptive_fec_on_recovery_stats(&state, &stats, uTime));
+   uTime += ADAPTIVE_FEC_DECREASE_AFTER_MS;
+   _check_true("Decrease after clean period", 1 == adaptive_fec_on_recovery_stats(&state, &stats, uTime) && (3-1 == state.iECPackets));
+   _check_true("Stats for the old scheme are ignored", 0 == adaptive_fec_on_recovery_stats(&state, &stats, uTime + 5000));
+
+   // Lost blocks: goes up right away
+   stats.uBlockECPackets = state.iECPackets;
+   stats.uBlocksLost = 3;
+   _check_true("Increase on lost blocks", 1 == adaptive_fec_on_recovery_stats(&state, &stats, uTime+100) && (state.iECPackets > 2));
+
+   // No decrease for a while after an increase
+   stats.uBlocksLost = 0;
+   int iEC = state.iECPackets;
+   for( int i=0; i<20; i++ )
+   {
+      stats.uBlockECPackets = state.iECPackets;
+      adaptive_fec_on_recovery_stats(&state, &stats, uTime + 200 + i*100);
+   }
+   _check_true("Hold after increase", state.iECPackets >= iEC);
+
+   // Heavy loss: larger blocks when EC would go over the data packets count
+   adaptive_fec_init(&state, 4, 4);
+   stats.uBlockDataPackets = 4;
+   stats.uBlockECPackets = 4;
+   stats.uBlocksLost = 10;
+   adaptive_fec_on_recovery_stats(&state, &stats, 1000);
+   _check_true("Larger blocks on heavy loss", (state.iDataPackets > 4) && (state.iECPackets <= state.iDataPackets) && (state.iDataPackets + state.iECPackets <= MAX_TOTAL_PACKETS_IN_BLOCK));
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestAdaptiveFEC");
+   log_enable_stdout();
+
+   u32 uSeed = 1;
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-seconds")) && (i+1 < argc) )
+         s_iSimSeconds = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i+1 < argc) )
+         uSeed = (u32)atoi(argv[++i]);
+   }
+   if ( s_iSimSeconds < 10 )
+      s_iSimSeconds = 10;
+
+   _test_controller_steps();
+
+   int iThird = s_iSimSeconds * 1000 / 3;
+   t_sim_channel channels[] =
+   {
+      { "clean",          0,  0, 0, 0,                  0,   0,   0 },
+      { "random 2%",     20, 20, 0, 0,                  0,   0,   0 },
+      { "random 10%",   100,100, 0, 0,                  0,   0,   0 },
+      { "bursts",         5,  5, 0, 0,                 10, 150, 700 },
+      { "degrading",      2, 80, iThird, 2*iThird,      0,   0,   0 }
+   };
+   int iFixedSchemes[3][2] = { {9, 1}, {9, DEFAULT_VIDEO_BLOCK_FECS_HQ}, {9, 6} };
+
+   for( int c=0; c<(int)(sizeof(channels)/sizeof(channels[0])); c++ )
+   {
+      t_sim_result resultsFixed[3];
+      char szScheme[32];
+      for( int k=0; k<3; k++ )
+      {
+         _simulate(&channels[c], iFixedSchemes[k][0], iFixedSchemes[k][1], false, uSeed, &resultsFixed[k]);
+         snprintf(szScheme, sizeof(szScheme), "fixed %d/%d", iFixedSchemes[k][0], iFixedSchemes[k][1]);
+         _log_result(channels[c].szName, szScheme, &resultsFixed[k]);
+      }
+      t_sim_result resultAdaptive;
+      _simulate(&channels[c], 9, DEFAULT_VIDEO_BLOCK_FECS_HQ, true, uSeed, &resultAdaptive);
+      float fAdaptiveShare = _log_result(channels[c].szName, "adaptive", &resultAdaptive);
+      float fProfileShare = 100.0 * (float)resultsFixed[1].uDataPackets / (float)(resultsFixed[1].uDataPackets + resultsFixed[1].uECPackets);
+
+      char szTest[128];
+      // Never worse than the profile EC scheme it starts from
+      snprintf(szTest, sizeof(szTest), "%s: unrecoverable blocks not above the profile EC scheme", channels[c].szName);
+      _check_true(szTest, _lost_per_thousand(&resultAdaptive) <= _lost_per_thousand(&resultsFixed[1]) + 1.0);
+      if ( (0 == channels[c].iLossClean) && (0 == channels[c].iLossDegraded) && (0 == channels[c].iBurstEnter) )
+      {
+         snprintf(szTest, sizeof(szTest), "%s: reclaims airtime on a clean link", channels[c].szName);
+         _check_true(szTest, fAdaptiveShare > fProfileShare);
+      }
+      snprintf(szTest, sizeof(szTest), "%s: unrecoverable blocks under 1%%", channels[c].szName);
+      _check_true(szTest, _lost_per_thousand(&resultAdaptive) < 10.0);
+   }
+
+   log_line("Adaptive FEC tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
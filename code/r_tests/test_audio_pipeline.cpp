@@ -0,0 +1,311 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/audio_codec.h"
+#include "../base/audio_jitter_buffer.h"
+#include "../base/audio_output.h"
+#include "../radio/radiopackets2.h"
+#include <math.h>
+
+// Checks the controller audio pipeline: IMA ADPCM round trip, removal of the break stamps and WAV headers
+// from the capture stream, and the jitter buffer playing a stream received with jitter, lost frames and
+// a capture clock faster/slower than the playback clock.
+// Usage: test_audio_pipeline [-seed n] [-jitter ms] [-loss percent] [-drift ppm]
+
+#define TEST_SAMPLE_RATE 44100
+#define TEST_PACKET_SIZE (MAX_PACKET_PAYLOAD - 100)
+#define TEST_LATENCY_MS 80
+#define TEST_DURATION_MS 60000
+#define TEST_PULL_INTERVAL_MICROS 2000
+
+int s_iFailed = 0;
+u64 s_uRandomState = 1;
+int s_iJitterMs = 30;
+int s_iLossPercent = 3;
+int s_iDriftPPM = 300;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u32 _random(u64* pState, u32 uMax)
+{
+   *pState ^= *pState >> 12;
+   *pState ^= *pState << 25;
+   *pState ^= *pState >> 27;
+   return (u32)(((*pState * 2685821657736338717ULL) >> 32) % uMax);
+}
+
+short _test_sample(int iIndex)
+{
+   double dT = (double)iIndex / (double)TEST_SAMPLE_RATE;
+   return (short)(8000.0 * sin(2.0 * M_PI * 440.0 * dT) + 3000.0 * sin(2.0 * M_PI * 1250.0 * dT));
+}
+
+void _test_adpcm()
+{
+   int iFrameSamples = audio_adpcm_get_frame_samples(TEST_PACKET_SIZE);
+   _check_true("ADPCM frame samples", iFrameSamples == 1 + (TEST_PACKET_SIZE - AUDIO_ADPCM_FRAME_HEADER_SIZE)*2);
+
+   t_audio_adpcm_state state;
+   audio_adpcm_init(&state);
+   static short s_sIn[MAX_PACKET_PAYLOAD*2];
+   static short s_sOut[MAX_PACKET_PAYLOAD*2];
+   u8 uFrame[MAX_PACKET_PAYLOAD];
+   double dSignal = 0.0;
+   double dNoise = 0.0;
+   int iIndex = 0;
+   int iBadFrames = 0;
+
+   for( int iFrame=0; iFrame<40; iFrame++ )
+   {
+      for( int i=0; i<iFrameSamples; i++ )
+         s_sIn[i] = _test_sample(iIndex++);
+      audio_adpcm_encode_frame(&state, s_sIn, uFrame, TEST_PACKET_SIZE);
+      if ( iFrameSamples != audio_adpcm_decode_frame(uFrame, TEST_PACKET_SIZE, s_sOut) )
+         iBadFrames++;
+      for( int i=0; i<iFrameSamples; i++ )
+      {
+         dSignal += (double)s_sIn[i] * (double)s_sIn[i];
+         dNoise += (double)(s_sIn[i] - s_sOut[i]) * (double)(s_sIn[i] - s_sOut[i]);
+      }
+      _check_true("ADPCM frame starts with the exact sample", s_sOut[0] == s_sIn[0]);
+   }
+   double dSNR = 10.0 * log10(dSignal / (dNoise + 1.0));
+   log_line("ADPCM: %d samples in %d bytes frames, SNR: %.1f dB", iFrameSamples, TEST_PACKET_SIZE, dSNR);
+   _check_true("ADPCM frames decode", 0 == iBadFrames);
+   _check_true("ADPCM SNR", dSNR > 25.0);
+   _check_true("ADPCM invalid frame", 0 == audio_adpcm_decode_frame(uFrame, 2, s_sOut));
+}
+
+// Capture stream: [WAV header][samples] stamp [WAV header][samples] ..., fed to the parser in random sized chunks
+void _test_stream_parser()
+{
+   static u8 s_uStream[64000];
+   int iLength = 0;
+   int iSegmentSamples[3] = { 1001, 2500, 777 };
+   int iIndex = 0;
+
+   for( int iSegment=0; iSegment<3; iSegment++ )
+   {
+      if ( iSegment > 0 )
+      {
+         memcpy(&s_uStream[iLength], AUDIO_STREAM_BREAK_STAMP, strlen(AUDIO_STREAM_BREAK_STAMP));
+         iLength += strlen(AUDIO_STREAM_BREAK_STAMP);
+      }
+      memcpy(&s_uStream[iLength], "RIFF", 4);
+      for( int i=4; i<AUDIO_STREAM_WAV_HEADER_SIZE; i++ )
+         s_uStream[iLength+i] = (u8)_random(&s_uRandomState, 256);
+      iLength += AUDIO_STREAM_WAV_HEADER_SIZE;
+      for( int i=0; i<iSegmentSamples[iSegment]; i++ )
+      {
+         short sSample = _test_sample(iIndex++);
+         memcpy(&s_uStream[iLength], &sSample, sizeof(short));
+         iLength += sizeof(short);
+      }
+   }
+
+   t_audio_stream_parser parser;
+   audio_stream_parser_init(&parser);
+   static short s_sSamples[32000];
+   short sTmp[(1200 + AUDIO_STREAM_PARSER_MAX_HELD_BYTES)/2];
+   int iCountSamples = 0;
+   int iBreaks = 0;
+   int iPos = 0;
+   while ( iPos < iLength )
+   {
+      int iChunk = 1 + (int)_random(&s_uRandomState, 1200);
+      if ( iChunk > iLength - iPos )
+         iChunk = iLength - iPos;
+      int iBreak = 0;
+      int iCount = audio_stream_parser_add(&parser, &s_uStream[iPos], iChunk, sTmp, &iBreak);
+      memcpy(&s_sSamples[iCountSamples], sTmp, iCount*sizeof(short));
+      iCountSamples += iCount;
+      iBreaks += iBreak;
+      iPos += iChunk;
+   }
+
+   int iMismatch = 0;
+   for( int i=0; (i<iCountSamples) && (i<iIndex); i++ )
+   {
+      if ( s_sSamples[i] != _test_sample(i) )
+         iMismatch++;
+   }
+   log_line("Stream parser: %d bytes -> %d samples (expected %d), %d breaks, %u headers skipped, %d mismatched samples",
+      iLength, iCountSamples, iIndex, iBreaks, parser.uHeadersSkipped, iMismatch);
+   _check_true("parser keeps all samples", iCountSamples == iIndex);
+   _check_true("parser samples aligned", 0 == iMismatch);
+   _check_true("parser finds breaks", 2 == iBreaks);
+   _check_true("parser skips headers", 3 == parser.uHeadersSkipped);
+}
+
+// Sender produces a frame every frame duration of the capture clock (drifted); frames arrive with random
+// delay and some are lost. The output pulls samples every 2 ms at the playback rate.
+void _test_jitter_buffer(int iJitterMs, int iLossPercent, int iDriftPPM, const char* szName)
+{
+   static t_audio_jitter_buffer s_Buffer;
+   int iFrameSamples = audio_adpcm_get_frame_samples(TEST_PACKET_SIZE);
+   audio_jitter_buffer_init(&s_Buffer, TEST_SAMPLE_RATE, iFrameSamples, TEST_LATENCY_MS, MAX_AUDIO_OUTPUT_LATENCY_MS);
+
+   #define TEST_MAX_FRAMES 2048
+   static u32 s_uArrivalMicros[TEST_MAX_FRAMES];
+   static int s_bLost[TEST_MAX_FRAMES];
+   double dFrameMicros = (double)iFrameSamples * 1000000.0 / (double)TEST_SAMPLE_RATE;
+   dFrameMicros = dFrameMicros * 1000000.0 / (1000000.0 + (double)iDriftPPM);
+   int iFrames = (int)((double)TEST_DURATION_MS * 1000.0 / dFrameMicros);
+   if ( iFrames > TEST_MAX_FRAMES )
+      iFrames = TEST_MAX_FRAMES;
+   for( int i=0; i<iFrames; i++ )
+   {
+      s_uArrivalMicros[i] = (u32)((double)(i+1) * dFrameMicros) + 5000 + _random(&s_uRandomState, (u32)iJitterMs*1000 + 1);
+      s_bLost[i] = ((int)_random(&s_uRandomState, 100) < iLossPercent)?1:0;
+   }
+
+   static short s_sFrame[MAX_PACKET_PAYLOAD*2];
+   short sOut[TEST_SAMPLE_RATE/100];
+   int iNextFrame = 0;
+   u64 uDueFrac = 0;
+   int iLatencyMin = 100000;
+   int iLatencyMax = 0;
+   long long lLatencySum = 0;
+   int iLatencyCount = 0;
+   u32 uReceivedSamples = 0;
+   u32 uEndMicros = (u32)((double)iFrames * dFrameMicros);
+
+   for( u32 uTime=0; uTime<uEndMicros; uTime += TEST_PULL_INTERVAL_MICROS )
+   {
+      // Frames can arrive out of order; late ones are dropped by the buffer
+      for( int i=iNextFrame; (i<iFrames) && (i < iNextFrame + 8); i++ )
+      {
+         if ( (s_uArrivalMicros[i] > uTime) || (s_uArrivalMicros[i] == 0) )
+            continue;
+         if ( ! s_bLost[i] )
+         {
+            for( int k=0; k<iFrameSamples; k++ )
+               s_sFrame[k] = _test_sample(i*iFrameSamples + k);
+            audio_jitter_buffer_push(&s_Buffer, (u32)i, s_sFrame, iFrameSamples, uTime);
+         }
+         s_uArrivalMicros[i] = 0;
+      }
+      while ( (iNextFrame < iFrames) && (0 == s_uArrivalMicros[iNextFrame]) )
+         iNextFrame++;
+
+      uDueFrac += (u64)TEST_PULL_INTERVAL_MICROS * TEST_SAMPLE_RATE;
+      int iDue = (int)(uDueFrac / 1000000);
+      uDueFrac -= (u64)iDue * 1000000;
+      uReceivedSamples += audio_jitter_buffer_pull(&s_Buffer, sOut, iDue);
+
+      // Skip the startup, the buffer adapts to the jitter in the first seconds
+      if ( uTime > 10000000 )
+      {
+         int iLatency = audio_jitter_buffer_get_latency_ms(&s_Buffer);
+         if ( iLatency < iLatencyMin )
+            iLatencyMin = iLatency;
+         if ( iLatency > iLatencyMax )
+            iLatencyMax = iLatency;
+         lLatencySum += iLatency;
+         iLatencyCount++;
+      }
+   }
+
+   int iAvgLatency = (iLatencyCount > 0)?(int)(lLatencySum/iLatencyCount):0;
+   int iTargetMs = (s_Buffer.iTargetSamples * 1000) / TEST_SAMPLE_RATE;
+   log_line("Jitter buffer (%s: jitter %d ms, loss %d%%, drift %d ppm): latency avg %d ms [%d..%d], target %d ms, underruns %u, lost %u, late %u, concealed %u, drift -%u/+%u",
+      szName, iJitterMs, iLossPercent, iDriftPPM, iAvgLatency, iLatencyMin, iLatencyMax, iTargetMs,
+      s_Buffer.uUnderruns, s_Buffer.uFramesLost, s_Buffer.uFramesLate, s_Buffer.uSamplesConcealed,
+      s_Buffer.uSamplesDriftDropped, s_Buffer.uSamplesDriftInserted);
+   audio_jitter_buffer_log_info(&s_Buffer);
+
+   char szTest[128];
+   sprintf(szTest, "%s: latency stays near target", szName);
+   _check_true(szTest, (iAvgLatency <= iTargetMs + 60) && (iAvgLatency + 60 >= iTargetMs));
+   sprintf(szTest, "%s: latency bounded", szName);
+   _check_true(szTest, iLatencyMax <= MAX_AUDIO_OUTPUT_LATENCY_MS + 60);
+   sprintf(szTest, "%s: audio played", szName);
+   _check_true(szTest, uReceivedSamples > (u32)(iFrames * iFrameSamples) / 2);
+   if ( iLossPercent > 0 )
+   {
+      sprintf(szTest, "%s: lost frames concealed", szName);
+      _check_true(szTest, (s_Buffer.uFramesLost > 0) && (s_Buffer.uSamplesConcealed > 0));
+   }
+   if ( iDriftPPM > 0 )
+   {
+      sprintf(szTest, "%s: fast capture clock compensated", szName);
+      _check_true(szTest, s_Buffer.uSamplesDriftDropped > 0);
+   }
+   if ( iDriftPPM < 0 )
+   {
+      sprintf(szTest, "%s: slow capture clock compensated", szName);
+      _check_true(szTest, s_Buffer.uSamplesDriftInserted > 0);
+   }
+   if ( 0 == iJitterMs )
+   {
+      sprintf(szTest, "%s: no underruns", szName);
+      _check_true(szTest, 0 == s_Buffer.uUnderruns);
+   }
+}
+
+void _test_wav_output()
+{
+   char szFile[128];
+   sprintf(szFile, "/tmp/test_audio_pipeline_%d.wav", (int)getpid());
+   t_audio_output output;
+   _check_true("WAV output opens", audio_output_open(&output, AUDIO_OUTPUT_WAV_FILE, TEST_SAMPLE_RATE, szFile));
+   short sSamples[1000];
+   for( int i=0; i<1000; i++ )
+      sSamples[i] = _test_sample(i);
+   _check_true("WAV output writes", 1000 == audio_output_write(&output, sSamples, 1000));
+   audio_output_close(&output);
+   _check_true("WAV output closed", ! audio_output_is_open(&output));
+
+   u8 uHeader[44];
+   FILE* fd = fopen(szFile, "rb");
+   int iRead = 0;
+   long lSize = 0;
+   if ( NULL != fd )
+   {
+      iRead = fread(uHeader, 1, 44, fd);
+      fseek(fd, 0, SEEK_END);
+      lSize = ftell(fd);
+      fclose(fd);
+   }
+   unlink(szFile);
+   u32 uDataSize = 0;
+   if ( 44 == iRead )
+      memcpy(&uDataSize, &uHeader[40], sizeof(u32));
+   _check_true("WAV file header", (44 == iRead) && (0 == memcmp(uHeader, "RIFF", 4)) && (0 == memcmp(&uHeader[8], "WAVE", 4)));
+   _check_true("WAV data size", (uDataSize == 2000) && (lSize == 2044));
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestAudioPipeline");
+   log_enable_stdout();
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-seed")) && (i+1 < argc) )
+         s_uRandomState = (u64)atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-jitter")) && (i+1 < argc) )
+         s_iJitterMs = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-loss")) && (i+1 < argc) )
+         s_iLossPercent = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-drift")) && (i+1 < argc) )
+         s_iDriftPPM = atoi(argv[++i]);
+   }
+   if ( s_uRandomState == 0 )
+      s_uRandomState = 1;
+
+   _test_adpcm();
+   _test_stream_parser();
+   _test_jitter_buffer(0, 0, 0, "clean link");
+   _test_jitter_buffer(s_iJitterMs, s_iLossPercent, s_iDriftPPM, "jitter, loss, fast capture");
+   _test_jitter_buffer(s_iJitterMs, s_iLossPercent, -s_iDriftPPM, "jitter, loss, slow capture");
+   _test_wav_output();
+
+   log_line("Audio pipeline tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,589 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware_radio.h"
+#include "../base/shared_mem.h"
+#include "../base/ruby_ipc.h"
+#include "../base/parser_h264.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radio_duplicate_det.h"
+#include "../radio/fec.h"
+#include "../common/radio_stats.h"
+#include <time.h>
+
+// Micro benchmarks of the hot paths of the radio/video pipeline, with packet sizes and loss patterns
+// close to a real video link. Each benchmark is timed in batches of operations; the per operation
+// time of the batches gives the percentiles. Results are written as JSON (one result per line) and can
+// be compared with a baseline JSON written by a previous run: a benchmark whose median time per
+// operation got slower by more than the threshold is flagged as a regression (exit code 1).
+// Usage: test_bench [-quick] [-filter text] [-o results.json] [-baseline baseline.json] [-threshold percent] [-seed n]
+
+#define BENCH_MAX_RESULTS 32
+#define BENCH_MAX_BATCHES 4000
+#define BENCH_WARMUP_BATCHES 50
+#define BENCH_VIDEO_PACKET_SIZE 1180
+#define BENCH_AUDIO_PACKET_SIZE 1150
+#define BENCH_FEC_MAX_PACKETS 16
+#define BENCH_PATTERNS 1024
+#define BENCH_H264_STREAM_SIZE (2*1024*1024)
+#define BENCH_IPC_CHANNEL_TYPE 99
+#define BENCH_IPC_MESSAGE_SIZE 300
+
+typedef struct
+{
+   char szName[64];
+   int iOps;
+   int iBytesPerOp;
+   double dNsPerOp;
+   double dP50Ns;
+   double dP90Ns;
+   double dP99Ns;
+   double dMaxNs;
+   double dBaselineP50Ns; // 0 if not in the baseline
+   double dChangePercent;
+   int bRegression;
+} t_bench_result;
+
+typedef struct
+{
+   const char* szName;
+   int iBytesPerOp;
+   int iBatchOps;
+   int (*pfInit)(); // returns 0 if the benchmark can't run here
+   void (*pfRun)(u32 uOpIndex);
+} t_bench;
+
+t_bench_result s_Results[BENCH_MAX_RESULTS];
+int s_iCountResults = 0;
+u64 s_uRandomState = 1;
+int s_iBatches = 2000;
+double s_dThresholdPercent = 10.0;
+const char* s_szFilter = NULL;
+volatile u32 s_uSink = 0;
+
+u32 _random(u64* pState, u32 uMax)
+{
+   *pState ^= *pState >> 12;
+   *pState ^= *pState << 25;
+   *pState ^= *pState >> 27;
+   return (u32)(((*pState * 2685821657736338717ULL) >> 32) % uMax);
+}
+
+u64 _time_nanos()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (u64)t.tv_sec * 1000000000ULL + (u64)t.tv_nsec;
+}
+
+int _compare_double(const void* pA, const void* pB)
+{
+   double dA = *(const double*)pA;
+   double dB = *(const double*)pB;
+   return (dA > dB) - (dA < dB);
+}
+
+// ----------------------------------------------------------------
+// CRC
+
+u8 s_uCRCBuffer[MAX_PACKET_TOTAL_SIZE];
+
+int _bench_crc_init()
+{
+   for( int i=0; i<(int)sizeof(s_uCRCBuffer); i++ )
+      s_uCRCBuffer[i] = (u8)_random(&s_uRandomState, 256);
+   return 1;
+}
+
+void _bench_crc_64(u32 uOpIndex)
+{
+   s_uSink += base_compute_crc32(s_uCRCBuffer + (uOpIndex & 0x0F), 64);
+}
+
+void _bench_crc_1250(u32 uOpIndex)
+{
+   s_uSink += base_compute_crc32(s_uCRCBuffer + (uOpIndex & 0x0F), MAX_PACKET_PAYLOAD);
+}
+
+// ----------------------------------------------------------------
+// FEC
+
+u8 s_uFECPackets[BENCH_FEC_MAX_PACKETS][MAX_PACKET_TOTAL_SIZE];
+u8 s_uFECECPackets[BENCH_FEC_MAX_PACKETS][MAX_PACKET_TOTAL_SIZE];
+u8* s_pFECData[BENCH_FEC_MAX_PACKETS];
+u8* s_pFECEC[BENCH_FEC_MAX_PACKETS];
+// Missing data packets for each decode, as a bitmask
+u32 s_uFECLossPatterns[BENCH_PATTERNS];
+
+int _bench_fec_init()
+{
+   fec_init();
+   for( int i=0; i<BENCH_FEC_MAX_PACKETS; i++ )
+   {
+      for( int k=0; k<MAX_PACKET_TOTAL_SIZE; k++ )
+         s_uFECPackets[i][k] = (u8)_random(&s_uRandomState, 256);
+      s_pFECData[i] = &s_uFECPackets[i][0];
+      s_pFECEC[i] = &s_uFECECPackets[i][0];
+   }
+   return 1;
+}
+
+void _bench_fec_encode_4_2(u32 uOpIndex)
+{
+   fec_encode(BENCH_AUDIO_PACKET_SIZE, s_pFECData, 4, s_pFECEC, 2);
+}
+
+void _bench_fec_encode_8_4(u32 uOpIndex)
+{
+   fec_encode(BENCH_VIDEO_PACKET_SIZE, s_pFECData, 8, s_pFECEC, 4);
+}
+
+void _bench_fec_encode_12_6(u32 uOpIndex)
+{
+   fec_encode(BENCH_VIDEO_PACKET_SIZE, s_pFECData, 12, s_pFECEC, 6);
+}
+
+void _bench_fec_decode(u32 uLossMask)
+{
+   unsigned int uErased[BENCH_FEC_MAX_PACKETS];
+   unsigned int uECIndexes[BENCH_FEC_MAX_PACKETS];
+   u8* pEC[BENCH_FEC_MAX_PACKETS];
+   unsigned int uCountMissing = 0;
+   for( int i=0; i<8; i++ )
+   {
+      if ( uLossMask & (1<<i) )
+         uErased[uCountMissing++] = i;
+   }
+   // Use the EC packets after the lost ones too, as the receiver does when some EC packets are lost as well
+   for( unsigned int i=0; i<uCountMissing; i++ )
+   {
+      uECIndexes[i] = (i + (uLossMask >> 8)) % 4;
+      pEC[i] = s_pFECEC[uECIndexes[i]];
+   }
+   fec_decode(BENCH_VIDEO_PACKET_SIZE, s_pFECData, 8, pEC, uECIndexes, uErased, (unsigned short)uCountMissing);
+}
+
+// Loss bursts of 1 or 2 packets (most common on a video link), some blocks with up to 4 lost packets
+int _bench_fec_decode_init()
+{
+   _bench_fec_init();
+   fec_encode(BENCH_VIDEO_PACKET_SIZE, s_pFECData, 8, s_pFECEC, 4);
+   for( int i=0; i<BENCH_PATTERNS; i++ )
+   {
+      u32 uMask = 0;
+      int iLost = 1 + (int)_random(&s_uRandomState, 2);
+      if ( 0 == _random(&s_uRandomState, 8) )
+         iLost = 3 + (int)_random(&s_uRandomState, 2);
+      u32 uStart = _random(&s_uRandomState, 8);
+      for( int k=0; k<iLost; k++ )
+         uMask |= 1 << ((uStart + k*(1+_random(&s_uRandomState, 2))) % 8);
+      s_uFECLossPatterns[i] = uMask | (_random(&s_uRandomState, 4) << 8);
+   }
+   return 1;
+}
+
+void _bench_fec_decode_8_4_burst(u32 uOpIndex)
+{
+   _bench_fec_decode(s_uFECLossPatterns[uOpIndex % BENCH_PATTERNS]);
+}
+
+void _bench_fec_decode_8_4_max(u32 uOpIndex)
+{
+   _bench_fec_decode((0x0F << (uOpIndex % 5)) & 0xFF);
+}
+
+// ----------------------------------------------------------------
+// H264 parser: stream of 60 fps, keyframe every 30 frames (SPS, PPS, 2 I slices), read in video packet sized chunks
+
+u8* s_pH264Stream = NULL;
+int s_iH264StreamSize = 0;
+ParserH264 s_ParserH264;
+
+void _bench_h264_add_nal(int* pPos, u8 uNALType, int iSize)
+{
+   if ( *pPos + iSize + 4 > BENCH_H264_STREAM_SIZE )
+      return;
+   s_pH264Stream[(*pPos)++] = 0;
+   s_pH264Stream[(*pPos)++] = 0;
+   s_pH264Stream[(*pPos)++] = 1;
+   s_pH264Stream[(*pPos)++] = 0x60 | uNALType;
+   for( int i=0; i<iSize; i++ )
+   {
+      // No start codes inside the NAL payload (emulation prevention)
+      u8 uByte = (u8)_random(&s_uRandomState, 256);
+      if ( uByte < 2 )
+         uByte = 2;
+      s_pH264Stream[(*pPos)++] = uByte;
+   }
+}
+
+int _bench_h264_init()
+{
+   if ( NULL == s_pH264Stream )
+      s_pH264Stream = (u8*) malloc(BENCH_H264_STREAM_SIZE);
+   if ( NULL == s_pH264Stream )
+      return 0;
+   int iPos = 0;
+   int iFrame = 0;
+   while ( iPos < BENCH_H264_STREAM_SIZE - 64000 )
+   {
+      if ( 0 == (iFrame % 30) )
+      {
+         _bench_h264_add_nal(&iPos, 7, 20);
+         _bench_h264_add_nal(&iPos, 8, 4);
+         _bench_h264_add_nal(&iPos, 5, 12000 + _random(&s_uRandomState, 4000));
+         _bench_h264_add_nal(&iPos, 5, 12000 + _random(&s_uRandomState, 4000));
+      }
+      else
+         _bench_h264_add_nal(&iPos, 1, 2000 + _random(&s_uRandomState, 3000));
+      iFrame++;
+   }
+   s_iH264StreamSize = iPos;
+   s_ParserH264.init();
+   return 1;
+}
+
+void _bench_h264_parse_chunk(u32 uOpIndex)
+{
+   int iChunks = s_iH264StreamSize / BENCH_VIDEO_PACKET_SIZE;
+   u8* pData = s_pH264Stream + (uOpIndex % iChunks) * BENCH_VIDEO_PACKET_SIZE;
+   int iParsePos = 0;
+   int iSizeLeft = BENCH_VIDEO_PACKET_SIZE;
+   while ( iSizeLeft > 0 )
+   {
+      int iParsed = s_ParserH264.parseDataUntillStartOfNextNAL(pData + iParsePos, iSizeLeft, uOpIndex);
+      if ( iParsed >= iSizeLeft )
+         break;
+      s_uSink += s_ParserH264.getCurrentFrameType();
+      iParsePos += iParsed+1;
+      iSizeLeft -= iParsed+1;
+   }
+}
+
+// ----------------------------------------------------------------
+// Radio rx: stats update and duplicate detection of video packets received on two interfaces,
+// with lost and reordered packets
+
+#define BENCH_RX_VEHICLE_ID 1234567
+u8 s_uRxPackets[BENCH_PATTERNS][sizeof(t_packet_header)];
+int s_iRxPacketsInterface[BENCH_PATTERNS];
+shared_mem_radio_stats s_BenchRadioStats;
+u32 s_uRxSequenceBase = 0;
+
+extern u32 s_uRadioRxTimeNow;
+
+int _bench_rx_init()
+{
+   static int s_bAddedEmulatedRadios = 0;
+   if ( ! s_bAddedEmulatedRadios )
+      hardware_radio_add_emulated_radios(2);
+   s_bAddedEmulatedRadios = 1;
+   if ( hardware_get_radio_interfaces_count() < 2 )
+      return 0;
+
+   radio_stats_reset(&s_BenchRadioStats, 100);
+   s_BenchRadioStats.radio_interfaces[0].assignedLocalRadioLinkId = 0;
+   s_BenchRadioStats.radio_interfaces[1].assignedLocalRadioLinkId = 0;
+   radio_duplicate_detection_init();
+
+   // Each packet is received on both interfaces; 2% of packets are lost on one interface, 3% are received
+   // a few packets later than the following ones
+   u32 uPacketIndex = 0;
+   u32 uRadioLinkPacketIndex[2] = { 1, 1 };
+   int iCount = 0;
+   while ( iCount < BENCH_PATTERNS )
+   {
+      u32 uIndex = uPacketIndex;
+      if ( (0 == _random(&s_uRandomState, 33)) && (uPacketIndex > 4) )
+         uIndex = uPacketIndex - 1 - _random(&s_uRandomState, 4);
+      for( int iInterface=0; (iInterface<2) && (iCount < BENCH_PATTERNS); iInterface++ )
+      {
+         uRadioLinkPacketIndex[iInterface]++;
+         if ( 0 == _random(&s_uRandomState, 50) )
+            continue;
+         memset(s_uRxPackets[iCount], 0, sizeof(t_packet_header));
+         t_packet_header* pPH = (t_packet_header*)s_uRxPackets[iCount];
+         pPH->packet_type = PACKET_TYPE_VIDEO_DATA_98;
+         pPH->vehicle_id_src = BENCH_RX_VEHICLE_ID;
+         pPH->stream_packet_idx = (STREAM_ID_VIDEO_1 << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX) | (uIndex & PACKET_FLAGS_MASK_STREAM_PACKET_IDX);
+         pPH->total_length = BENCH_VIDEO_PACKET_SIZE;
+         pPH->radio_link_packet_index = (u16)uRadioLinkPacketIndex[iInterface];
+         s_iRxPacketsInterface[iCount] = iInterface;
+         iCount++;
+      }
+      uPacketIndex++;
+   }
+   s_uRxSequenceBase = 0;
+   return 1;
+}
+
+void _bench_radio_stats_update(u32 uOpIndex)
+{
+   int iIndex = uOpIndex % BENCH_PATTERNS;
+   u32 uTime = 10000 + uOpIndex/8;
+   s_uSink += radio_stats_update_on_new_radio_packet_received(&s_BenchRadioStats, NULL, uTime, s_iRxPacketsInterface[iIndex], s_uRxPackets[iIndex], BENCH_VIDEO_PACKET_SIZE, 0, 1, 1);
+}
+
+// One graph slice (100 ms) of the rx stats: 16 packets, then the periodic update that closes the slice
+// and recomputes the rx quality of the interfaces
+int _bench_rx_slice_init()
+{
+   if ( ! _bench_rx_init() )
+      return 0;
+   s_BenchRadioStats.countLocalRadioInterfaces = 2;
+   s_BenchRadioStats.countLocalRadioLinks = 1;
+   return 1;
+}
+
+void _bench_radio_stats_slice(u32 uOpIndex)
+{
+   u32 uTime = 10000 + uOpIndex*100;
+   for( int i=0; i<16; i++ )
+   {
+      int iIndex = (uOpIndex*16 + i) % BENCH_PATTERNS;
+      s_uSink += radio_stats_update_on_new_radio_packet_received(&s_BenchRadioStats, NULL, uTime + i*6, s_iRxPacketsInterface[iIndex], s_uRxPackets[iIndex], BENCH_VIDEO_PACKET_SIZE, 0, 1, 1);
+   }
+   s_uSink += radio_stats_periodic_update(&s_BenchRadioStats, NULL, uTime + 100);
+}
+
+void _bench_dup_detection(u32 uOpIndex)
+{
+   int iIndex = uOpIndex % BENCH_PATTERNS;
+   t_packet_header* pPH = (t_packet_header*)s_uRxPackets[iIndex];
+
+   // Move the stream forward each time the patterns wrap, so the packets are not all duplicates
+   if ( (0 == iIndex) && (0 != uOpIndex) )
+      s_uRxSequenceBase += BENCH_PATTERNS;
+   u32 uSavedIndex = pPH->stream_packet_idx;
+   u32 uPacketIndex = ((uSavedIndex & PACKET_FLAGS_MASK_STREAM_PACKET_IDX) + s_uRxSequenceBase) & PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
+   pPH->stream_packet_idx = (uSavedIndex & (~PACKET_FLAGS_MASK_STREAM_PACKET_IDX)) | uPacketIndex;
+   u32 uTime = 10000 + uOpIndex/8;
+   s_uRadioRxTimeNow = uTime;
+   s_uSink += radio_dup_detection_is_duplicate(s_iRxPacketsInterface[iIndex], s_uRxPackets[iIndex], BENCH_VIDEO_PACKET_SIZE, uTime);
+   pPH->stream_packet_idx = uSavedIndex;
+}
+
+// ----------------------------------------------------------------
+// IPC: send a message and read it back, on a channel used only by the benchmark
+
+int s_iBenchIPCChannel = -1;
+u8 s_uIPCMessage[BENCH_IPC_MESSAGE_SIZE];
+u8 s_uIPCTempBuffer[MAX_PACKET_TOTAL_SIZE];
+u8 s_uIPCOutputBuffer[MAX_PACKET_TOTAL_SIZE];
+int s_iIPCTempBufferPos = 0;
+
+int _bench_ipc_init()
+{
+   if ( s_iBenchIPCChannel > 0 )
+      return 1;
+   s_iBenchIPCChannel = ruby_open_ipc_channel_write_endpoint(BENCH_IPC_CHANNEL_TYPE);
+   if ( s_iBenchIPCChannel <= 0 )
+   {
+      log_line("IPC channels can't be opened on this system, skip IPC benchmark.");
+      s_iBenchIPCChannel = -1;
+      return 0;
+   }
+   memset(s_uIPCMessage, 0, sizeof(s_uIPCMessage));
+   t_packet_header* pPH = (t_packet_header*)s_uIPCMessage;
+   pPH->packet_flags = PACKET_COMPONENT_LOCAL_CONTROL;
+   pPH->total_length = BENCH_IPC_MESSAGE_SIZE;
+   for( int i=sizeof(t_packet_header); i<BENCH_IPC_MESSAGE_SIZE; i++ )
+      s_uIPCMessage[i] = (u8)_random(&s_uRandomState, 256);
+   // Drain messages left by an interrupted run
+   while ( NULL != ruby_ipc_try_read_message(s_iBenchIPCChannel, s_uIPCTempBuffer, &s_iIPCTempBufferPos, s_uIPCOutputBuffer) ) {}
+   return 1;
+}
+
+void _bench_ipc_send_receive(u32 uOpIndex)
+{
+   ruby_ipc_channel_send_message(s_iBenchIPCChannel, s_uIPCMessage, BENCH_IPC_MESSAGE_SIZE);
+   if ( NULL != ruby_ipc_try_read_message(s_iBenchIPCChannel, s_uIPCTempBuffer, &s_iIPCTempBufferPos, s_uIPCOutputBuffer) )
+      s_uSink += s_uIPCOutputBuffer[sizeof(t_packet_header)];
+}
+
+// ----------------------------------------------------------------
+
+t_bench s_Benchmarks[] =
+{
+   { "crc32_64", 64, 64, _bench_crc_init, _bench_crc_64 },
+   { "crc32_1250", MAX_PACKET_PAYLOAD, 8, _bench_crc_init, _bench_crc_1250 },
+   { "fec_encode_4_2_1150", 4*BENCH_AUDIO_PACKET_SIZE, 1, _bench_fec_init, _bench_fec_encode_4_2 },
+   { "fec_encode_8_4_1180", 8*BENCH_VIDEO_PACKET_SIZE, 1, _bench_fec_init, _bench_fec_encode_8_4 },
+   { "fec_encode_12_6_1180", 12*BENCH_VIDEO_PACKET_SIZE, 1, _bench_fec_init, _bench_fec_encode_12_6 },
+   { "fec_decode_8_4_1180_burst_loss", 8*BENCH_VIDEO_PACKET_SIZE, 1, _bench_fec_decode_init, _bench_fec_decode_8_4_burst },
+   { "fec_decode_8_4_1180_max_loss", 8*BENCH_VIDEO_PACKET_SIZE, 1, _bench_fec_decode_init, _bench_fec_decode_8_4_max },
+   { "h264_parse_1180", BENCH_VIDEO_PACKET_SIZE, 4, _bench_h264_init, _bench_h264_parse_chunk },
+   { "radio_stats_rx_video_2if_loss", BENCH_VIDEO_PACKET_SIZE, 64, _bench_rx_init, _bench_radio_stats_update },
+   { "radio_stats_slice_16_rx_2if", 16*BENCH_VIDEO_PACKET_SIZE, 4, _bench_rx_slice_init, _bench_radio_stats_slice },
+   { "dup_detection_2if_loss_reorder", BENCH_VIDEO_PACKET_SIZE, 64, _bench_rx_init, _bench_dup_detection },
+   { "ipc_send_receive_300", BENCH_IPC_MESSAGE_SIZE, 1, _bench_ipc_init, _bench_ipc_send_receive },
+};
+
+void _run_benchmark(t_bench* pBench)
+{
+   if ( (NULL != s_szFilter) && (NULL == strstr(pBench->szName, s_szFilter)) )
+      return;
+   if ( s_iCountResults >= BENCH_MAX_RESULTS )
+      return;
+   if ( ! pBench->pfInit() )
+   {
+      log_line("Skipped benchmark %s", pBench->szName);
+      return;
+   }
+
+   static double s_dBatchNs[BENCH_MAX_BATCHES];
+   u32 uOpIndex = 0;
+   for( int i=0; i<BENCH_WARMUP_BATCHES*pBench->iBatchOps; i++ )
+      pBench->pfRun(uOpIndex++);
+
+   u64 uTotalNs = 0;
+   for( int iBatch=0; iBatch<s_iBatches; iBatch++ )
+   {
+      u64 uStart = _time_nanos();
+      for( int i=0; i<pBench->iBatchOps; i++ )
+         pBench->pfRun(uOpIndex++);
+      u64 uTime = _time_nanos() - uStart;
+      uTotalNs += uTime;
+      s_dBatchNs[iBatch] = (double)uTime / (double)pBench->iBatchOps;
+   }
+   qsort(s_dBatchNs, s_iBatches, sizeof(double), _compare_double);
+
+   t_bench_result* pResult = &s_Results[s_iCountResults++];
+   memset(pResult, 0, sizeof(t_bench_result));
+   strncpy(pResult->szName, pBench->szName, sizeof(pResult->szName)-1);
+   pResult->iOps = s_iBatches * pBench->iBatchOps;
+   pResult->iBytesPerOp = pBench->iBytesPerOp;
+   pResult->dNsPerOp = (double)uTotalNs / (double)pResult->iOps;
+   pResult->dP50Ns = s_dBatchNs[s_iBatches/2];
+   pResult->dP90Ns = s_dBatchNs[(s_iBatches*90)/100];
+   pResult->dP99Ns = s_dBatchNs[(s_iBatches*99)/100];
+   pResult->dMaxNs = s_dBatchNs[s_iBatches-1];
+
+   log_line("%-32s %10.1f ns/op, p50 %10.1f, p90 %10.1f, p99 %10.1f ns, %9.1f MB/s",
+      pResult->szName, pResult->dNsPerOp, pResult->dP50Ns, pResult->dP90Ns, pResult->dP99Ns,
+      (pResult->dNsPerOp > 0.0)?((double)pResult->iBytesPerOp * 1000.0 / pResult->dNsPerOp):0.0);
+}
+
+// Reads the median of each benchmark from a JSON file written by this program (one result per line)
+int _compare_with_baseline(const char* szFile)
+{
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("Failed to open baseline file %s", szFile);
+      return 0;
+   }
+   char szLine[1024];
+   int iCountFound = 0;
+   while ( NULL != fgets(szLine, sizeof(szLine), fd) )
+   {
+      char* pName = strstr(szLine, "\"name\": \"");
+      char* pP50 = strstr(szLine, "\"p50_ns\": ");
+      if ( (NULL == pName) || (NULL == pP50) )
+         continue;
+      pName += strlen("\"name\": \"");
+      char* pEnd = strchr(pName, '"');
+      if ( NULL == pEnd )
+         continue;
+      *pEnd = 0;
+      double dP50 = atof(pP50 + strlen("\"p50_ns\": "));
+
+      for( int i=0; i<s_iCountResults; i++ )
+      {
+         if ( 0 != strcmp(s_Results[i].szName, pName) )
+            continue;
+         if ( dP50 <= 0.0 )
+            break;
+         s_Results[i].dBaselineP50Ns = dP50;
+         s_Results[i].dChangePercent = (s_Results[i].dP50Ns - dP50) * 100.0 / dP50;
+         s_Results[i].bRegression = (s_Results[i].dChangePercent > s_dThresholdPercent)?1:0;
+         iCountFound++;
+         log_line("%-32s p50 %10.1f ns, baseline %10.1f ns: %+6.1f%% %s", s_Results[i].szName,
+            s_Results[i].dP50Ns, dP50, s_Results[i].dChangePercent, s_Results[i].bRegression?"REGRESSION":"");
+         break;
+      }
+   }
+   fclose(fd);
+   log_line("Compared %d of %d benchmarks with baseline %s (threshold %.1f%%)", iCountFound, s_iCountResults, szFile, s_dThresholdPercent);
+   return 1;
+}
+
+void _write_json(FILE* fd, int iCountRegressions)
+{
+   fprintf(fd, "{\n");
+   fprintf(fd, "\"suite\": \"ruby_hot_paths\", \"sw_version\": \"%d.%d\", \"batches\": %d, \"threshold_percent\": %.1f,\n",
+      SYSTEM_SW_VERSION_MAJOR, SYSTEM_SW_VERSION_MINOR, s_iBatches, s_dThresholdPercent);
+   fprintf(fd, "\"results\": [\n");
+   for( int i=0; i<s_iCountResults; i++ )
+   {
+      t_bench_result* pResult = &s_Results[i];
+      double dOpsPerSec = (pResult->dNsPerOp > 0.0)?(1000000000.0 / pResult->dNsPerOp):0.0;
+      fprintf(fd, "{\"name\": \"%s\", \"ops\": %d, \"bytes_per_op\": %d, \"ns_per_op\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f, \"ops_per_sec\": %.0f, \"mb_per_sec\": %.2f",
+         pResult->szName, pResult->iOps, pResult->iBytesPerOp, pResult->dNsPerOp,
+         pResult->dP50Ns, pResult->dP90Ns, pResult->dP99Ns, pResult->dMaxNs,
+         dOpsPerSec, dOpsPerSec * (double)pResult->iBytesPerOp / 1000000.0);
+      if ( pResult->dBaselineP50Ns > 0.0 )
+         fprintf(fd, ", \"baseline_p50_ns\": %.1f, \"change_percent\": %.1f, \"regression\": %s",
+            pResult->dBaselineP50Ns, pResult->dChangePercent, pResult->bRegression?"true":"false");
+      fprintf(fd, "}%s\n", (i < s_iCountResults-1)?",":"");
+   }
+   fprintf(fd, "],\n");
+   fprintf(fd, "\"regressions\": %d\n", iCountRegressions);
+   fprintf(fd, "}\n");
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestBench");
+   log_enable_stdout();
+
+   const char* szOutputFile = NULL;
+   const char* szBaselineFile = NULL;
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-quick") )
+         s_iBatches = 300;
+      else if ( (0 == strcmp(argv[i], "-filter")) && (i+1 < argc) )
+         s_szFilter = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-o")) && (i+1 < argc) )
+         szOutputFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-baseline")) && (i+1 < argc) )
+         szBaselineFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-threshold")) && (i+1 < argc) )
+         s_dThresholdPercent = atof(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i+1 < argc) )
+         s_uRandomState = (u64)atoi(argv[++i]);
+   }
+   if ( s_uRandomState == 0 )
+      s_uRandomState = 1;
+
+   for( int i=0; i<(int)(sizeof(s_Benchmarks)/sizeof(s_Benchmarks[0])); i++ )
+      _run_benchmark(&s_Benchmarks[i]);
+
+   if ( s_iBenchIPCChannel > 0 )
+      ruby_clear_all_ipc_channels();
+
+   if ( NULL != szBaselineFile )
+      _compare_with_baseline(szBaselineFile);
+
+   int iCountRegressions = 0;
+   for( int i=0; i<s_iCountResults; i++ )
+      iCountRegressions += s_Results[i].bRegression;
+
+   if ( NULL != szOutputFile )
+   {
+      FILE* fd = fopen(szOutputFile, "w");
+      if ( NULL == fd )
+         log_softerror_and_alarm("Failed to write results file %s", szOutputFile);
+      else
+      {
+         _write_json(fd, iCountRegressions);
+         fclose(fd);
+         log_line("Results written to %s", szOutputFile);
+      }
+   }
+   else
+      _write_json(stdout, iCountRegressions);
+
+   log_line("Benchmarks: %d run, %d regressions", s_iCountResults, iCountRegressions);
+   return (iCountRegressions > 0)?1:0;
+}
@@ -0,0 +1,329 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../base/hardware_radio.h"
+#include "../radio/radio_duplicate_det.h"
+
+// Checks the radio packets duplicate detection (duplicates, out of order packets, sequence jumps,
+// vehicle restarts) and compares its speed with the previous hash table implementation.
+
+extern u32 s_uRadioRxTimeNow;
+
+int s_iFailed = 0;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+int _is_dup(u32 uVehicleId, u32 uStreamIndex, u32 uPacketIndex, u8 uPacketType, u32 uTimeNow)
+{
+   u8 uPacket[sizeof(t_packet_header)];
+   memset(uPacket, 0, sizeof(uPacket));
+   t_packet_header* pPH = (t_packet_header*)uPacket;
+   pPH->packet_type = uPacketType;
+   pPH->vehicle_id_src = uVehicleId;
+   pPH->stream_packet_idx = (uStreamIndex << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX) | (uPacketIndex & PACKET_FLAGS_MASK_STREAM_PACKET_IDX);
+   pPH->total_length = sizeof(t_packet_header);
+   s_uRadioRxTimeNow = uTimeNow;
+   return radio_dup_detection_is_duplicate(0, uPacket, sizeof(uPacket), uTimeNow);
+}
+
+void _test_detection()
+{
+   radio_duplicate_detection_init();
+   u32 uTime = 10000;
+   u32 uVID = 1234567;
+
+   _check_true("First packet", ! _is_dup(uVID, STREAM_ID_VIDEO_1, 0, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Duplicate first packet", _is_dup(uVID, STREAM_ID_VIDEO_1, 0, PACKET_TYPE_VIDEO_DATA_98, uTime));
+
+   int iOk = 1;
+   for( u32 u=1; u<1000; u++ )
+      iOk = iOk && (! _is_dup(uVID, STREAM_ID_VIDEO_1, u, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("In order packets", iOk);
+   iOk = 1;
+   for( u32 u=0; u<1000; u++ )
+      iOk = iOk && _is_dup(uVID, STREAM_ID_VIDEO_1, u, PACKET_TYPE_VIDEO_DATA_98, uTime);
+   _check_true("Duplicate in order packets", iOk);
+
+   // Out of order: skip some packets, then receive them later
+   iOk = 1;
+   for( u32 u=1000; u<2000; u+=2 )
+      iOk = iOk && (! _is_dup(uVID, STREAM_ID_VIDEO_1, u, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   for( u32 u=1001; u<2000; u+=2 )
+      iOk = iOk && (! _is_dup(uVID, STREAM_ID_VIDEO_1, u, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Out of order packets", iOk);
+   _check_true("Duplicate out of order packet", _is_dup(uVID, STREAM_ID_VIDEO_1, 1501, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Max packet index", radio_dup_detection_get_max_received_packet_index_for_stream(uVID, STREAM_ID_VIDEO_1) == 1999);
+
+   // Streams are independent
+   _check_true("Other stream packet", ! _is_dup(uVID, STREAM_ID_DATA, 1500, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Invalid stream", _is_dup(uVID, 15, 1, PACKET_TYPE_VIDEO_DATA_98, uTime));
+
+   // Sequence jump larger than the window: everything before is forgotten
+   _check_true("Sequence jump", ! _is_dup(uVID, STREAM_ID_VIDEO_1, 100000, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Packet after jump", ! _is_dup(uVID, STREAM_ID_VIDEO_1, 99000, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Duplicate after jump", _is_dup(uVID, STREAM_ID_VIDEO_1, 99000, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("No restart on jump", ! radio_dup_detection_is_vehicle_restarted(uVID));
+
+   // Jump that wraps the window ring: old bits must be cleared
+   _check_true("Sequence jump inside ring", ! _is_dup(uVID, STREAM_ID_VIDEO_1, 100000 + 64*40, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Packet in cleared ring word", ! _is_dup(uVID, STREAM_ID_VIDEO_1, 100000 + 64*40 - 1, PACKET_TYPE_VIDEO_DATA_98, uTime));
+
+   // Ping clock packets are never duplicates
+   _check_true("Ping clock", ! _is_dup(uVID, STREAM_ID_DATA, 2000, PACKET_TYPE_RUBY_PING_CLOCK, uTime));
+   _check_true("Duplicate ping clock", ! _is_dup(uVID, STREAM_ID_DATA, 2000, PACKET_TYPE_RUBY_PING_CLOCK, uTime));
+
+   // Multiple vehicles
+   u32 uVID2 = 7654321;
+   _check_true("Second vehicle packet", ! _is_dup(uVID2, STREAM_ID_VIDEO_1, 5, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Second vehicle duplicate", _is_dup(uVID2, STREAM_ID_VIDEO_1, 5, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("First vehicle unaffected", _is_dup(uVID, STREAM_ID_VIDEO_1, 100000 + 64*40 - 1, PACKET_TYPE_VIDEO_DATA_98, uTime));
+
+   // Vehicle restart: stream index goes back more than the restart threshold
+   _check_true("Packet after restart", ! _is_dup(uVID, STREAM_ID_VIDEO_1, 3, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Restart detected", radio_dup_detection_is_vehicle_restarted(uVID));
+   _check_true("Other vehicle not restarted", ! radio_dup_detection_is_vehicle_restarted(uVID2));
+   _check_true("Duplicate after restart", _is_dup(uVID, STREAM_ID_VIDEO_1, 3, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   radio_dup_detection_reset_vehicle_restarted_flag(uVID);
+   _check_true("Restart flag cleared", ! radio_dup_detection_is_vehicle_restarted(uVID));
+
+   // Data stream restart after a long silence
+   _check_true("Data stream packet", ! _is_dup(uVID, STREAM_ID_DATA, 40, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Data stream old packet", _is_dup(uVID, STREAM_ID_DATA, 40, PACKET_TYPE_VIDEO_DATA_98, uTime + 1000));
+   _check_true("Data stream restart after silence", ! _is_dup(uVID, STREAM_ID_DATA, 20, PACKET_TYPE_VIDEO_DATA_98, uTime + 10000));
+
+   radio_duplicate_detection_remove_data_for_all_except(uVID2);
+   _check_true("Removed vehicle", 0 == radio_dup_detection_get_max_received_packet_index_for_stream(uVID, STREAM_ID_VIDEO_1));
+   _check_true("Kept vehicle", _is_dup(uVID2, STREAM_ID_VIDEO_1, 5, PACKET_TYPE_VIDEO_DATA_98, uTime));
+   _check_true("Vehicle added back", ! _is_dup(uVID, STREAM_ID_VIDEO_1, 5, PACKET_TYPE_VIDEO_DATA_98, uTime));
+}
+
+// The previous implementation (radio_duplicate_det.c before the sliding window), without its logs:
+// linear scan of the vehicles list, serial radio lookup for every packet, stream restart detection
+// and a 512 entries hash of packet indexes per stream
+#define LEGACY_HASH_SIZE 512
+#define LEGACY_HASH_MASK 0x01FF
+
+typedef struct
+{
+   u32 uMaxReceivedPacketIndex;
+   u32 uLastReceivedPacketIndex;
+   u32 uLastTimeReceivedPacket;
+   u32 packetsHashIndexes[LEGACY_HASH_SIZE];
+} ALIGN_STRUCT_SPEC_INFO t_legacy_stream_history;
+
+typedef struct
+{
+   u32 uVehicleId;
+   t_legacy_stream_history streamsPacketsHistory[MAX_RADIO_STREAMS];
+   int iRestartDetected;
+} ALIGN_STRUCT_SPEC_INFO t_legacy_vehicle_history;
+
+t_legacy_vehicle_history s_LegacyHistoryVehicles[MAX_CONCURENT_VEHICLES];
+
+void _legacy_reset_vehicle(int iVehicleIndex)
+{
+   s_LegacyHistoryVehicles[iVehicleIndex].uVehicleId = 0;
+   s_LegacyHistoryVehicles[iVehicleIndex].iRestartDetected = 0;
+   for( int k=0; k<MAX_RADIO_STREAMS; k++ )
+   {
+      s_LegacyHistoryVehicles[iVehicleIndex].streamsPacketsHistory[k].uMaxReceivedPacketIndex = 0;
+      s_LegacyHistoryVehicles[iVehicleIndex].streamsPacketsHistory[k].uLastReceivedPacketIndex = MAX_U32;
+      s_LegacyHistoryVehicles[iVehicleIndex].streamsPacketsHistory[k].uLastTimeReceivedPacket = 0;
+      memset((u8*)s_LegacyHistoryVehicles[iVehicleIndex].streamsPacketsHistory[k].packetsHashIndexes, 0xFF, LEGACY_HASH_SIZE * sizeof(u32));
+   }
+}
+
+void _legacy_init()
+{
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+      _legacy_reset_vehicle(i);
+}
+
+int _legacy_get_index_for_vid(u32 uVehicleId)
+{
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      if ( uVehicleId == s_LegacyHistoryVehicles[i].uVehicleId )
+         return i;
+   }
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      if ( 0 == s_LegacyHistoryVehicles[i].uVehicleId )
+      {
+         _legacy_reset_vehicle(i);
+         s_LegacyHistoryVehicles[i].uVehicleId = uVehicleId;
+         return i;
+      }
+   }
+   return -1;
+}
+
+int _legacy_is_dup(int iRadioInterfaceIndex, u8* pPacketBuffer, int iPacketLength, u32 uTimeNow)
+{
+   if ( (NULL == pPacketBuffer) || (iPacketLength <= 0) )
+      return 1;
+
+   t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
+   t_packet_header_compressed* pPHC = (t_packet_header_compressed*)pPacketBuffer;
+
+   u32 uVehicleId = 0;
+   u32 uStreamPacketIndex = 0;
+   u32 uStreamIndex = 0;
+   u8 uPacketType = 0;
+   if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_FLAGS_MASK_COMPRESSED_HEADER )
+   {
+      uVehicleId = pPHC->vehicle_id_src;
+      uStreamPacketIndex = (pPHC->stream_packet_idx) & PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
+      uStreamIndex = (pPHC->stream_packet_idx)>>PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
+      uPacketType = pPHC->packet_type;
+   }
+   else
+   {
+      uVehicleId = pPH->vehicle_id_src;
+      uStreamPacketIndex = (pPH->stream_packet_idx) & PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
+      uStreamIndex = (pPH->stream_packet_idx)>>PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
+      uPacketType = pPH->packet_type;
+   }
+
+   int iStatsIndex = _legacy_get_index_for_vid(uVehicleId);
+   if ( -1 == iStatsIndex )
+      return 1;
+
+   t_legacy_vehicle_history* pDupInfo = &s_LegacyHistoryVehicles[iStatsIndex];
+   pDupInfo->uVehicleId = uVehicleId;
+
+   u32 uMaxDeltaForVideoStream = 2000;
+   u32 uMaxDeltaForDataStream = 50;
+   if ( hardware_radio_index_is_serial_radio(iRadioInterfaceIndex) )
+      uMaxDeltaForDataStream = 200;
+
+   int iStreamRestarted = 0;
+
+   if ( (uStreamIndex >= STREAM_ID_VIDEO_1) || (uStreamIndex == STREAM_ID_COMPRESSED) )
+   if ( pDupInfo->streamsPacketsHistory[uStreamIndex].uMaxReceivedPacketIndex > uStreamPacketIndex + uMaxDeltaForVideoStream )
+      iStreamRestarted = 1;
+
+   if ( (uStreamIndex < STREAM_ID_VIDEO_1) && (uStreamIndex != STREAM_ID_COMPRESSED) )
+   if ( pDupInfo->streamsPacketsHistory[uStreamIndex].uMaxReceivedPacketIndex > uStreamPacketIndex + uMaxDeltaForDataStream )
+      iStreamRestarted = 1;
+
+   if ( 0 != pDupInfo->streamsPacketsHistory[uStreamIndex].uLastTimeReceivedPacket )
+   if ( pDupInfo->streamsPacketsHistory[uStreamIndex].uLastTimeReceivedPacket < uTimeNow - 8000 )
+   if ( uStreamPacketIndex+10 < pDupInfo->streamsPacketsHistory[uStreamIndex].uMaxReceivedPacketIndex )
+      iStreamRestarted = 1;
+
+   if ( iStreamRestarted )
+   {
+      _legacy_reset_vehicle(iStatsIndex);
+      pDupInfo->iRestartDetected = 1;
+      pDupInfo->uVehicleId = uVehicleId;
+   }
+
+   int bIsDuplicatePacket = 0;
+   int iHashIndex = uStreamPacketIndex & LEGACY_HASH_MASK;
+   if ( uStreamPacketIndex == pDupInfo->streamsPacketsHistory[uStreamIndex].packetsHashIndexes[iHashIndex] )
+      bIsDuplicatePacket = 1;
+
+   if ( (uPacketType == PACKET_TYPE_RUBY_PING_CLOCK) || (uPacketType == PACKET_TYPE_RUBY_PING_CLOCK_REPLY) )
+      bIsDuplicatePacket = 0;
+
+   if ( bIsDuplicatePacket )
+      return 1;
+
+   pDupInfo->streamsPacketsHistory[uStreamIndex].packetsHashIndexes[iHashIndex] = uStreamPacketIndex;
+   pDupInfo->streamsPacketsHistory[uStreamIndex].uLastReceivedPacketIndex = uStreamPacketIndex;
+   if ( uStreamPacketIndex > pDupInfo->streamsPacketsHistory[uStreamIndex].uMaxReceivedPacketIndex )
+      pDupInfo->streamsPacketsHistory[uStreamIndex].uMaxReceivedPacketIndex = uStreamPacketIndex;
+
+   pDupInfo->streamsPacketsHistory[uStreamIndex].uLastTimeReceivedPacket = s_uRadioRxTimeNow;
+   return 0;
+}
+
+#define BENCHMARK_RUNS 9
+
+// Video packets from iVehicles vehicles, each packet received on two radio interfaces, the second copy
+// arriving iDelay packets later (i.e. a slower relay or a second radio link with a longer queue)
+void _benchmark(int iVehicles, int iPackets, int iDelay)
+{
+   int iCount = iPackets * 2;
+   t_packet_header* pOriginals = (t_packet_header*)malloc(iPackets * sizeof(t_packet_header));
+   u8* pPackets = (u8*)malloc(iCount * sizeof(t_packet_header));
+   u32 uPacketIndex[MAX_CONCURENT_VEHICLES];
+   memset(uPacketIndex, 0, sizeof(uPacketIndex));
+   memset(pOriginals, 0, iPackets * sizeof(t_packet_header));
+   for( int i=0; i<iPackets; i++ )
+   {
+      int iVehicle = i % iVehicles;
+      pOriginals[i].packet_type = PACKET_TYPE_VIDEO_DATA_98;
+      pOriginals[i].vehicle_id_src = 1000 + iVehicle * 77;
+      pOriginals[i].stream_packet_idx = (STREAM_ID_VIDEO_1 << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX) | (uPacketIndex[iVehicle]++);
+   }
+   int iPos = 0;
+   for( int i=0; i<iPackets + iDelay; i++ )
+   {
+      if ( i < iPackets )
+         memcpy(pPackets + (iPos++) * sizeof(t_packet_header), &pOriginals[i], sizeof(t_packet_header));
+      if ( i >= iDelay )
+         memcpy(pPackets + (iPos++) * sizeof(t_packet_header), &pOriginals[i-iDelay], sizeof(t_packet_header));
+   }
+   free(pOriginals);
+
+   // Best of several runs, alternating the two implementations, each starting from an empty state
+   u32 uTime = 10000;
+   s_uRadioRxTimeNow = uTime;
+   int iUnique = 0;
+   int iUniqueLegacy = 0;
+   u32 uTimeNew = MAX_U32;
+   u32 uTimeLegacy = MAX_U32;
+   for( int iRun=0; iRun<BENCHMARK_RUNS; iRun++ )
+   {
+      radio_duplicate_detection_init();
+      iUnique = 0;
+      u32 uStart = get_current_timestamp_micros();
+      for( int i=0; i<iCount; i++ )
+      {
+         if ( ! radio_dup_detection_is_duplicate(0, pPackets + i * sizeof(t_packet_header), sizeof(t_packet_header), uTime) )
+            iUnique++;
+      }
+      u32 uDuration = get_current_timestamp_micros() - uStart;
+      if ( uDuration < uTimeNew )
+         uTimeNew = uDuration;
+
+      _legacy_init();
+      iUniqueLegacy = 0;
+      uStart = get_current_timestamp_micros();
+      for( int i=0; i<iCount; i++ )
+      {
+         if ( ! _legacy_is_dup(0, pPackets + i * sizeof(t_packet_header), sizeof(t_packet_header), uTime) )
+            iUniqueLegacy++;
+      }
+      uDuration = get_current_timestamp_micros() - uStart;
+      if ( uDuration < uTimeLegacy )
+         uTimeLegacy = uDuration;
+   }
+   free(pPackets);
+
+   _check_true("Benchmark unique packets", iUnique == iPackets);
+   log_line("%d vehicles, %d packets, duplicates delayed by %d packets, best of %d runs: sliding window: %u us (%u ns/packet, %d unique), legacy hash: %u us (%u ns/packet, %d unique)",
+      iVehicles, iCount, iDelay, BENCHMARK_RUNS, uTimeNew, (u32)((u64)uTimeNew*1000/iCount), iUnique, uTimeLegacy, (u32)((u64)uTimeLegacy*1000/iCount), iUniqueLegacy);
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestDuplicateDetection");
+   log_enable_stdout();
+
+   _test_detection();
+   _benchmark(1, 2000000, 4);
+   _benchmark(MAX_CONCURENT_VEHICLES, 2000000, 4);
+   _benchmark(1, 2000000, 1000);
+
+   log_line("Duplicate detection tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
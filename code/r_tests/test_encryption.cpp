@@ -0,0 +1,220 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/encr.h"
+#include "../base/aead.h"
+#include "../radio/radiolink.h"
+
+// Checks the ChaCha20-Poly1305 implementation against the RFC 8439 test vectors, checks the packet
+// encryption (round trip, forged and replayed packets) and compares its throughput with the old XOR scheme.
+
+int s_iFailed = 0;
+
+void _check(const char* szTest, const u8* pResult, const u8* pExpected, int iLength)
+{
+   if ( 0 == memcmp(pResult, pExpected, iLength) )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+void _test_vectors()
+{
+   // RFC 8439, 2.8.2
+   const char* szPlainText = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+   u8 uKey[32];
+   for( int i=0; i<32; i++ )
+      uKey[i] = 0x80 + i;
+   u8 uNonce[12] = { 0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47 };
+   u8 uAAD[12] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+   u8 uExpectedCipherText[114] = {
+      0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+      0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe, 0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+      0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+      0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+      0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c, 0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+      0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+      0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+      0x61, 0x16 };
+   u8 uExpectedTag[16] = { 0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a, 0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91 };
+
+   u8 uData[114];
+   u8 uTag[16];
+   memcpy(uData, szPlainText, 114);
+   aead_chacha20_poly1305_seal(uKey, uNonce, uAAD, 12, uData, 114, uTag);
+   _check("AEAD cipher text", uData, uExpectedCipherText, 114);
+   _check("AEAD tag", uTag, uExpectedTag, 16);
+   _check_true("AEAD open", aead_chacha20_poly1305_open(uKey, uNonce, uAAD, 12, uData, 114, uTag));
+   _check("AEAD decrypted text", uData, (const u8*)szPlainText, 114);
+
+   memcpy(uData, uExpectedCipherText, 114);
+   uData[57] ^= 0x01;
+   _check_true("AEAD rejects a modified cipher text", ! aead_chacha20_poly1305_open(uKey, uNonce, uAAD, 12, uData, 114, uTag));
+   _check_true("AEAD keeps rejected data unchanged", uData[57] == (uExpectedCipherText[57] ^ 0x01));
+
+   // RFC 8439, 2.5.2
+   u8 uPolyKey[32] = { 0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+      0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b };
+   u8 uExpectedPolyTag[16] = { 0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9 };
+   const char* szMessage = "Cryptographic Forum Research Group";
+   poly1305_mac(uPolyKey, (const u8*)szMessage, strlen(szMessage), uTag);
+   _check("Poly1305 tag", uTag, uExpectedPolyTag, 16);
+
+   // draft-irtf-cfrg-xchacha, 2.2.1
+   u8 uHKey[32];
+   for( int i=0; i<32; i++ )
+      uHKey[i] = i;
+   u8 uHInput[16] = { 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00, 0x31, 0x41, 0x59, 0x27 };
+   u8 uExpectedHOutput[32] = { 0x82, 0x41, 0x3b, 0x42, 0x27, 0xb2, 0x7b, 0xfe, 0xd3, 0x0e, 0x42, 0x50, 0x8a, 0x87, 0x7d, 0x73,
+      0xa0, 0xf9, 0xe4, 0xd5, 0x8a, 0x74, 0xa8, 0x53, 0xc1, 0x2e, 0xc4, 0x13, 0x26, 0xd3, 0xec, 0xdc };
+   u8 uHOutput[32];
+   hchacha20(uHKey, uHInput, uHOutput);
+   _check("HChaCha20", uHOutput, uExpectedHOutput, 32);
+}
+
+void _test_packets()
+{
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE + ENC_PACKET_TRAILER_SIZE];
+   u8 uOriginal[MAX_PACKET_TOTAL_SIZE];
+   u8 uSaved[MAX_PACKET_TOTAL_SIZE + ENC_PACKET_TRAILER_SIZE];
+   int iLength = 1200;
+   for( int i=0; i<iLength; i++ )
+      uOriginal[i] = rand() & 0xFF;
+
+   _check_true("No encryption without a pass phrase", ! epp(uPacket, 16, iLength, 0));
+   _check_true("Use pass phrase", upp("test pass phrase"));
+
+   memcpy(uPacket, uOriginal, iLength);
+   _check_true("Encrypt packet", epp(uPacket, 16, iLength, 1234));
+   _check("Clear header", uPacket, uOriginal, 16);
+   _check_true("Encrypted payload", 0 != memcmp(uPacket + 16, uOriginal + 16, iLength - 16));
+   memcpy(uSaved, uPacket, iLength + ENC_PACKET_TRAILER_SIZE);
+
+   _check_true("Reject other stream packet index", ! dpp(uPacket, 16, iLength + ENC_PACKET_TRAILER_SIZE, 1235, 0));
+   uPacket[3] ^= 0x10;
+   _check_true("Reject modified header", ! dpp(uPacket, 16, iLength + ENC_PACKET_TRAILER_SIZE, 1234, 0));
+   uPacket[3] ^= 0x10;
+   uPacket[iLength + ENC_PACKET_TRAILER_SIZE - 1] ^= 0x01;
+   _check_true("Reject modified tag", ! dpp(uPacket, 16, iLength + ENC_PACKET_TRAILER_SIZE, 1234, 0));
+   uPacket[iLength + ENC_PACKET_TRAILER_SIZE - 1] ^= 0x01;
+
+   _check_true("Decrypt packet", dpp(uPacket, 16, iLength + ENC_PACKET_TRAILER_SIZE, 1234, 0));
+   _check("Decrypted packet", uPacket, uOriginal, iLength);
+
+   memcpy(uPacket, uSaved, iLength + ENC_PACKET_TRAILER_SIZE);
+   _check_true("Reject replayed packet", ! dpp(uPacket, 16, iLength + ENC_PACKET_TRAILER_SIZE, 1234, 0));
+
+   // Out of order packets inside the replay window are accepted once
+   u8 uPackets[4][256 + ENC_PACKET_TRAILER_SIZE];
+   for( int i=0; i<4; i++ )
+   {
+      memcpy(uPackets[i], uOriginal, 256);
+      epp(uPackets[i], 16, 256, i);
+   }
+   int iOk = 1;
+   for( int i=3; i>=0; i-- )
+      iOk = iOk && dpp(uPackets[i], 16, 256 + ENC_PACKET_TRAILER_SIZE, i, 0);
+   _check_true("Decrypt out of order packets", iOk);
+   _check_true("Reject replayed out of order packet", ! dpp(uPackets[1], 16, 256 + ENC_PACKET_TRAILER_SIZE, 1, 0));
+
+   // A packet delayed while many packets are sent on other streams and links is still accepted,
+   // a packet older than the replay window is rejected
+   u8 uDelayed[2][256 + ENC_PACKET_TRAILER_SIZE];
+   memcpy(uDelayed[0], uOriginal, 256);
+   epp(uDelayed[0], 16, 256, 10);
+   memcpy(uDelayed[1], uOriginal, 256);
+   epp(uDelayed[1], 16, 256, 11);
+   u32 uOtherStream = ((u32)2) << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
+   iOk = 1;
+   for( int i=0; i<900; i++ )
+   {
+      memcpy(uPacket, uOriginal, 256);
+      epp(uPacket, 16, 256, uOtherStream | i);
+      iOk = iOk && dpp(uPacket, 16, 256 + ENC_PACKET_TRAILER_SIZE, uOtherStream | i, i%2);
+   }
+   _check_true("Decrypt packets on other streams and interfaces", iOk);
+   _check_true("Decrypt packet delayed by other streams", dpp(uDelayed[0], 16, 256 + ENC_PACKET_TRAILER_SIZE, 10, 0));
+   for( int i=0; i<1100; i++ )
+   {
+      memcpy(uPacket, uOriginal, 256);
+      epp(uPacket, 16, 256, 100 + i);
+      iOk = iOk && dpp(uPacket, 16, 256 + ENC_PACKET_TRAILER_SIZE, 100 + i, 0);
+   }
+   _check_true("Decrypt packets on the same stream", iOk);
+   _check_true("Reject packet older than the replay window", ! dpp(uDelayed[1], 16, 256 + ENC_PACKET_TRAILER_SIZE, 11, 0));
+
+   // A sender restart uses a new session
+   upp("test pass phrase");
+   memcpy(uPacket, uOriginal, iLength);
+   epp(uPacket, 16, iLength, 1234);
+   _check_true("Decrypt packet from a new session", dpp(uPacket, 16, iLength + ENC_PACKET_TRAILER_SIZE, 1234, 0));
+
+   // Other pass phrase
+   memcpy(uPacket, uOriginal, iLength);
+   epp(uPacket, 16, iLength, 1234);
+   upp("other pass phrase");
+   _check_true("Reject packet encrypted with another pass phrase", ! dpp(uPacket, 16, iLength + ENC_PACKET_TRAILER_SIZE, 1234, 0));
+}
+
+// The previous scheme: XOR with the pass phrase, one byte at a time
+void _legacy_xor(u8* pData, int iLength, u8* pPass, int iPassLength)
+{
+   int k = 0;
+   for( int i=0; i<iLength; i++ )
+   {
+      pData[i] ^= pPass[k];
+      k++;
+      if ( k >= iPassLength )
+         k = 0;
+   }
+}
+
+void _benchmark(int iPacketLength, int iPackets)
+{
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE + ENC_PACKET_TRAILER_SIZE];
+   for( int i=0; i<iPacketLength; i++ )
+      uPacket[i] = i;
+   upp("benchmark pass phrase");
+
+   u32 uStart = get_current_timestamp_micros();
+   for( int i=0; i<iPackets; i++ )
+      epp(uPacket, 16, iPacketLength, i);
+   u32 uTimeEncrypt = get_current_timestamp_micros() - uStart;
+
+   int iPassLength = 0;
+   u8* pPass = gpp(&iPassLength);
+   uStart = get_current_timestamp_micros();
+   for( int i=0; i<iPackets; i++ )
+      _legacy_xor(uPacket + 16, iPacketLength - 16, pPass, iPassLength);
+   u32 uTimeLegacy = get_current_timestamp_micros() - uStart;
+
+   if ( 0 == uTimeEncrypt )
+      uTimeEncrypt = 1;
+   if ( 0 == uTimeLegacy )
+      uTimeLegacy = 1;
+   log_line("%d packets of %d bytes: ChaCha20-Poly1305: %u us (%u Mbps, %u ns/packet), legacy XOR: %u us (%u Mbps)",
+      iPackets, iPacketLength, uTimeEncrypt, (u32)((u64)iPackets*iPacketLength*8/uTimeEncrypt), (u32)((u64)uTimeEncrypt*1000/iPackets),
+      uTimeLegacy, (u32)((u64)iPackets*iPacketLength*8/uTimeLegacy));
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestEncryption");
+   log_enable_stdout();
+
+   _test_vectors();
+   _test_packets();
+   _benchmark(1250, 20000);
+   _benchmark(100, 100000);
+
+   rpp();
+   log_line("Encryption tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
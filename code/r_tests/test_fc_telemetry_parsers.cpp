@@ -0,0 +1,888 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/parse_fc_telemetry.h"
+#include "../base/parse_fc_telemetry_ltm.h"
+#include "../base/telemetry_bulk_parser.h"
+
+// Checks the bulk FC telemetry parsers against the byte by byte parsers (mavlink_parse_char and the
+// LTM state machine the vehicle used before), on clean and noisy streams, read in one go or in random
+// size chunks, and compares their throughput.
+// Usage: test_fc_telemetry_parsers [-file recorded_mavlink_stream] [-record out_file] [-seed n]
+// Without -file, a generated stream is used (it can be saved with -record).
+
+#define TEST_MAX_STREAM (4*1024*1024)
+#define TEST_STREAM_MESSAGES 60000
+#define TEST_LTM_FRAMES 100000
+#define TEST_BENCH_MIN_MS 400
+
+#define CHANNEL_GENERATE MAVLINK_COMM_0
+#define CHANNEL_REFERENCE MAVLINK_COMM_1
+
+// A message id no dialect here knows
+#define TEST_UNKNOWN_MESSAGE_ID 42042
+
+int s_iFailed = 0;
+u64 s_uRandomState = 1;
+
+u8* s_pStream = NULL;
+int s_iStreamLength = 0;
+int s_iGeneratedHeartbeats = 0;
+int s_iGeneratedSysStatus = 0;
+int s_iLastLatitude = 0;
+
+// Messages the telemetry decodes; the rest are only framed
+static const u32 s_uRegisteredIds[] =
+{
+   MAVLINK_MSG_ID_HEARTBEAT, MAVLINK_MSG_ID_SYS_STATUS, MAVLINK_MSG_ID_STATUSTEXT, MAVLINK_MSG_ID_ATTITUDE,
+   MAVLINK_MSG_ID_GLOBAL_POSITION_INT, MAVLINK_MSG_ID_GPS_RAW_INT, MAVLINK_MSG_ID_VFR_HUD, MAVLINK_MSG_ID_RC_CHANNELS
+};
+
+typedef struct
+{
+   u32 uMessages;
+   u32 uRegistered;
+   u32 uHash;
+} t_parse_result;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u32 _random()
+{
+   s_uRandomState ^= s_uRandomState >> 12;
+   s_uRandomState ^= s_uRandomState << 25;
+   s_uRandomState ^= s_uRandomState >> 27;
+   return (u32)((s_uRandomState * 2685821657736338717ULL) >> 32);
+}
+
+u32 _hash(u32 uHash, u32 uValue)
+{
+   return (uHash ^ uValue) * 16777619;
+}
+
+u32 _hash_float(u32 uHash, float fValue)
+{
+   u32 uValue;
+   memcpy(&uValue, &fValue, sizeof(uValue));
+   return _hash(uHash, uValue);
+}
+
+u32 _hash_string(u32 uHash, const char* szText)
+{
+   while ( *szText )
+      uHash = _hash(uHash, (u8)*szText++);
+   return uHash;
+}
+
+bool _is_registered(u32 uMessageId)
+{
+   for( int i=0; i<(int)(sizeof(s_uRegisteredIds)/sizeof(s_uRegisteredIds[0])); i++ )
+   {
+      if ( s_uRegisteredIds[i] == uMessageId )
+         return true;
+   }
+   return false;
+}
+
+// The fields the telemetry uses, read with the generated MAVLink getters
+u32 _digest_reference(mavlink_message_t* pMsg)
+{
+   u32 uHash = 2166136261U;
+   char szText[64];
+   switch ( pMsg->msgid )
+   {
+      case MAVLINK_MSG_ID_HEARTBEAT:
+         uHash = _hash(uHash, mavlink_msg_heartbeat_get_custom_mode(pMsg));
+         uHash = _hash(uHash, mavlink_msg_heartbeat_get_base_mode(pMsg));
+         break;
+      case MAVLINK_MSG_ID_SYS_STATUS:
+         uHash = _hash(uHash, mavlink_msg_sys_status_get_voltage_battery(pMsg));
+         uHash = _hash(uHash, (u32)(int)mavlink_msg_sys_status_get_current_battery(pMsg));
+         break;
+      case MAVLINK_MSG_ID_STATUSTEXT:
+         memset(szText, 0, sizeof(szText));
+         mavlink_msg_statustext_get_text(pMsg, szText);
+         uHash = _hash_string(uHash, szText);
+         break;
+      case MAVLINK_MSG_ID_ATTITUDE:
+         uHash = _hash_float(uHash, mavlink_msg_attitude_get_roll(pMsg));
+         uHash = _hash_float(uHash, mavlink_msg_attitude_get_pitch(pMsg));
+         break;
+      case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+         uHash = _hash(uHash, (u32)mavlink_msg_global_position_int_get_alt(pMsg));
+         uHash = _hash(uHash, (u32)mavlink_msg_global_position_int_get_relative_alt(pMsg));
+         uHash = _hash(uHash, mavlink_msg_global_position_int_get_hdg(pMsg));
+         uHash = _hash(uHash, (u32)mavlink_msg_global_position_int_get_lat(pMsg));
+         break;
+      case MAVLINK_MSG_ID_GPS_RAW_INT:
+         uHash = _hash(uHash, mavlink_msg_gps_raw_int_get_fix_type(pMsg));
+         uHash = _hash(uHash, mavlink_msg_gps_raw_int_get_satellites_visible(pMsg));
+         uHash = _hash(uHash, mavlink_msg_gps_raw_int_get_eph(pMsg));
+         uHash = _hash(uHash, (u32)mavlink_msg_gps_raw_int_get_lon(pMsg));
+         break;
+      case MAVLINK_MSG_ID_VFR_HUD:
+         uHash = _hash(uHash, mavlink_msg_vfr_hud_get_throttle(pMsg));
+         uHash = _hash_float(uHash, mavlink_msg_vfr_hud_get_climb(pMsg));
+         uHash = _hash_float(uHash, mavlink_msg_vfr_hud_get_airspeed(pMsg));
+         break;
+      case MAVLINK_MSG_ID_RC_CHANNELS:
+         uHash = _hash(uHash, mavlink_msg_rc_channels_get_rssi(pMsg));
+         uHash = _hash(uHash, mavlink_msg_rc_channels_get_chan1_raw(pMsg));
+         uHash = _hash(uHash, mavlink_msg_rc_channels_get_chan14_raw(pMsg));
+         break;
+   }
+   return uHash;
+}
+
+// The same fields, read with the bulk parser extractors
+u32 _digest_bulk(const t_mavlink_bulk_message* pMessage)
+{
+   u32 uHash = 2166136261U;
+   char szText[64];
+   switch ( pMessage->uMessageId )
+   {
+      case MAVLINK_MSG_ID_HEARTBEAT:
+         uHash = _hash(uHash, mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(heartbeat, custom_mode)));
+         uHash = _hash(uHash, mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(heartbeat, base_mode)));
+         break;
+      case MAVLINK_MSG_ID_SYS_STATUS:
+         uHash = _hash(uHash, mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(sys_status, voltage_battery)));
+         uHash = _hash(uHash, (u32)(int)(int16_t)mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(sys_status, current_battery)));
+         break;
+      case MAVLINK_MSG_ID_STATUSTEXT:
+         mavlink_bulk_get_string(pMessage, MAVLINK_BULK_OFFSET(statustext, text), MAVLINK_MSG_STATUSTEXT_FIELD_TEXT_LEN, szText);
+         uHash = _hash_string(uHash, szText);
+         break;
+      case MAVLINK_MSG_ID_ATTITUDE:
+         uHash = _hash_float(uHash, mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(attitude, roll)));
+         uHash = _hash_float(uHash, mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(attitude, pitch)));
+         break;
+      case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+         uHash = _hash(uHash, mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(global_position_int, alt)));
+         uHash = _hash(uHash, mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(global_position_int, relative_alt)));
+         uHash = _hash(uHash, mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(global_position_int, hdg)));
+         uHash = _hash(uHash, mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(global_position_int, lat)));
+         break;
+      case MAVLINK_MSG_ID_GPS_RAW_INT:
+         uHash = _hash(uHash, mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, fix_type)));
+         uHash = _hash(uHash, mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, satellites_visible)));
+         uHash = _hash(uHash, mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, eph)));
+         uHash = _hash(uHash, mavlink_bulk_get_u32(pMessage, MAVLINK_BULK_OFFSET(gps_raw_int, lon)));
+         break;
+      case MAVLINK_MSG_ID_VFR_HUD:
+         uHash = _hash(uHash, mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, throttle)));
+         uHash = _hash_float(uHash, mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, climb)));
+         uHash = _hash_float(uHash, mavlink_bulk_get_float(pMessage, MAVLINK_BULK_OFFSET(vfr_hud, airspeed)));
+         break;
+      case MAVLINK_MSG_ID_RC_CHANNELS:
+         uHash = _hash(uHash, mavlink_bulk_get_u8(pMessage, MAVLINK_BULK_OFFSET(rc_channels, rssi)));
+         uHash = _hash(uHash, mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan1_raw)));
+         uHash = _hash(uHash, mavlink_bulk_get_u16(pMessage, MAVLINK_BULK_OFFSET(rc_channels, chan14_raw)));
+         break;
+   }
+   return uHash;
+}
+
+int _build_message(int iKind, u8* pBuffer)
+{
+   mavlink_message_t msg;
+   mavlink_status_t* pStatus = mavlink_get_channel_status(CHANNEL_GENERATE);
+   if ( (iKind != 10) && (0 == (_random() % 4)) )
+      pStatus->flags |= MAVLINK_STATUS_FLAG_OUT_MAVLINK1;
+   else
+      pStatus->flags &= ~MAVLINK_STATUS_FLAG_OUT_MAVLINK1;
+
+   switch ( iKind )
+   {
+      case 0:
+      {
+         mavlink_heartbeat_t data;
+         memset(&data, 0, sizeof(data));
+         data.custom_mode = _random() % 20;
+         data.base_mode = (_random() % 2) ? MAV_MODE_FLAG_SAFETY_ARMED : 0;
+         data.type = MAV_TYPE_QUADROTOR;
+         data.autopilot = MAV_AUTOPILOT_ARDUPILOTMEGA;
+         mavlink_msg_heartbeat_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         s_iGeneratedHeartbeats++;
+         break;
+      }
+      case 1:
+      {
+         mavlink_sys_status_t data;
+         memset(&data, 0, sizeof(data));
+         data.voltage_battery = 14000 + _random() % 3000;
+         data.current_battery = (int16_t)(_random() % 4000) - 100;
+         mavlink_msg_sys_status_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         s_iGeneratedSysStatus++;
+         break;
+      }
+      case 2:
+      {
+         mavlink_statustext_t data;
+         memset(&data, 0, sizeof(data));
+         // Full length texts have no null terminator. Few distinct texts, as the FC sends them
+         // (repeated texts are logged only once).
+         if ( _random() % 2 )
+            memset(data.text, 'A' + _random() % 4, sizeof(data.text));
+         else
+            snprintf(data.text, sizeof(data.text), "Status %u", _random() % 4);
+         mavlink_msg_statustext_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case 3:
+      {
+         mavlink_attitude_t data;
+         memset(&data, 0, sizeof(data));
+         data.roll = (float)(_random() % 6283) / 1000.0 - 3.14;
+         data.pitch = (float)(_random() % 3141) / 1000.0 - 1.57;
+         mavlink_msg_attitude_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case 4:
+      {
+         mavlink_global_position_int_t data;
+         memset(&data, 0, sizeof(data));
+         data.lat = 450000000 + (int)(_random() % 100000);
+         data.lon = 250000000 + (int)(_random() % 100000);
+         data.alt = _random() % 100000;
+         data.relative_alt = _random() % 50000;
+         data.hdg = _random() % 36000;
+         mavlink_msg_global_position_int_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         s_iLastLatitude = data.lat;
+         break;
+      }
+      case 5:
+      {
+         mavlink_gps_raw_int_t data;
+         memset(&data, 0, sizeof(data));
+         data.lat = 450000000 + (int)(_random() % 100000);
+         data.lon = 250000000 + (int)(_random() % 100000);
+         data.fix_type = GPS_FIX_TYPE_3D_FIX;
+         data.satellites_visible = _random() % 20;
+         data.eph = _random() % 300;
+         mavlink_msg_gps_raw_int_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         s_iLastLatitude = data.lat;
+         break;
+      }
+      case 6:
+      {
+         mavlink_vfr_hud_t data;
+         memset(&data, 0, sizeof(data));
+         data.throttle = _random() % 100;
+         data.climb = (float)(_random() % 200) / 10.0 - 10.0;
+         data.airspeed = (float)(_random() % 300) / 10.0;
+         mavlink_msg_vfr_hud_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case 7:
+      {
+         // Some with zero RSSI and high channels, truncated by MAVLink 2
+         mavlink_rc_channels_t data;
+         memset(&data, 0, sizeof(data));
+         data.chancount = 8;
+         data.chan1_raw = 1000 + _random() % 1000;
+         if ( _random() % 2 )
+         {
+            data.chancount = 16;
+            data.chan14_raw = 1000 + _random() % 1000;
+            data.rssi = _random() % 255;
+         }
+         mavlink_msg_rc_channels_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case 8:
+      {
+         mavlink_param_value_t data;
+         memset(&data, 0, sizeof(data));
+         snprintf(data.param_id, sizeof(data.param_id), "PARAM_%u", _random() % 1000);
+         data.param_count = 1000;
+         data.param_type = MAV_PARAM_TYPE_REAL32;
+         mavlink_msg_param_value_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case 9:
+      {
+         mavlink_raw_imu_t data;
+         memset(&data, 0, sizeof(data));
+         data.time_usec = _random();
+         data.xacc = _random() % 1000;
+         data.zgyro = _random() % 1000;
+         mavlink_msg_raw_imu_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      default:
+      {
+         // Other dialect message: CRC extra 0, as the MAVLink parser takes it
+         int iPayloadLength = 1 + _random() % 40;
+         pBuffer[0] = MAVLINK_STX;
+         pBuffer[1] = iPayloadLength;
+         pBuffer[2] = 0;
+         pBuffer[3] = 0;
+         pBuffer[4] = 0;
+         pBuffer[5] = 1;
+         pBuffer[6] = 1;
+         pBuffer[7] = TEST_UNKNOWN_MESSAGE_ID & 0xFF;
+         pBuffer[8] = (TEST_UNKNOWN_MESSAGE_ID >> 8) & 0xFF;
+         pBuffer[9] = (TEST_UNKNOWN_MESSAGE_ID >> 16) & 0xFF;
+         for( int i=0; i<iPayloadLength; i++ )
+            pBuffer[10+i] = 1 + _random() % 200;
+         u16 uCRC = crc_calculate(pBuffer+1, 9 + iPayloadLength);
+         crc_accumulate(0, &uCRC);
+         pBuffer[10+iPayloadLength] = uCRC & 0xFF;
+         pBuffer[11+iPayloadLength] = uCRC >> 8;
+         return 12 + iPayloadLength;
+      }
+   }
+   return mavlink_msg_to_send_buffer(pBuffer, &msg);
+}
+
+// Returns the number of intact registered messages in the stream
+int _generate_stream(int iNoisy)
+{
+   int iIntactRegistered = 0;
+   s_iStreamLength = 0;
+   s_iGeneratedHeartbeats = 0;
+   s_iGeneratedSysStatus = 0;
+   for( int i=0; i<TEST_STREAM_MESSAGES; i++ )
+   {
+      if ( s_iStreamLength + 2*MAVLINK_MAX_PACKET_LEN >= TEST_MAX_STREAM )
+         break;
+      if ( iNoisy && (0 == (_random() % 20)) )
+      {
+         // Line noise, with start bytes in it
+         int iNoise = 1 + _random() % 30;
+         for( int k=0; k<iNoise; k++ )
+         {
+            u32 uRand = _random();
+            s_pStream[s_iStreamLength++] = (0 == (uRand % 8)) ? MAVLINK_STX : (uRand >> 8) & 0xFF;
+         }
+      }
+      int iKind = _random() % 11;
+      u8* pMessage = s_pStream + s_iStreamLength;
+      int iLength = _build_message(iKind, pMessage);
+      s_iStreamLength += iLength;
+      if ( iNoisy && (0 == (_random() % 30)) )
+         pMessage[2 + _random() % (iLength-2)] ^= 1 << (_random() % 8);
+      else if ( iKind < 8 )
+         iIntactRegistered++;
+   }
+   return iIntactRegistered;
+}
+
+t_parse_result _parse_reference(u8* pData, int iLength)
+{
+   t_parse_result result;
+   memset(&result, 0, sizeof(result));
+   mavlink_message_t msg;
+   mavlink_status_t status;
+   mavlink_reset_channel_status(CHANNEL_REFERENCE);
+   for( int i=0; i<iLength; i++ )
+   {
+      if ( ! mavlink_parse_char(CHANNEL_REFERENCE, pData[i], &msg, &status) )
+         continue;
+      result.uMessages++;
+      if ( ! _is_registered(msg.msgid) )
+         continue;
+      result.uRegistered++;
+      result.uHash = _hash(result.uHash, msg.msgid);
+      result.uHash = _hash(result.uHash, _digest_reference(&msg));
+   }
+   return result;
+}
+
+void _on_bulk_message(const t_mavlink_bulk_message* pMessage, void* pContext)
+{
+   t_parse_result* pResult = (t_parse_result*)pContext;
+   pResult->uRegistered++;
+   pResult->uHash = _hash(pResult->uHash, pMessage->uMessageId);
+   pResult->uHash = _hash(pResult->uHash, _digest_bulk(pMessage));
+}
+
+void _on_bulk_unknown_message(const t_mavlink_bulk_message* pMessage, void* pContext)
+{
+}
+
+// iMaxChunk 0: all data at once
+// iForwardUnknown: take the unknown messages too, as the telemetry scheduler does
+t_parse_result _parse_bulk(u8* pData, int iLength, int iMaxChunk, int iForwardUnknown)
+{
+   static t_mavlink_bulk_parser s_Parser;
+   t_parse_result result;
+   memset(&result, 0, sizeof(result));
+   mavlink_bulk_init(&s_Parser);
+   for( int i=0; i<(int)(sizeof(s_uRegisteredIds)/sizeof(s_uRegisteredIds[0])); i++ )
+      mavlink_bulk_register(&s_Parser, s_uRegisteredIds[i], _on_bulk_message, &result);
+   if ( iForwardUnknown )
+      mavlink_bulk_set_default_handler(&s_Parser, _on_bulk_unknown_message, NULL);
+
+   int iPos = 0;
+   while ( iPos < iLength )
+   {
+      int iChunk = iLength - iPos;
+      if ( (iMaxChunk > 0) && (iChunk > iMaxChunk) )
+         iChunk = 1 + _random() % iMaxChunk;
+      if ( iChunk > iLength - iPos )
+         iChunk = iLength - iPos;
+      mavlink_bulk_parse(&s_Parser, pData + iPos, iChunk);
+      iPos += iChunk;
+   }
+   result.uMessages = s_Parser.uMessages;
+   return result;
+}
+
+void _test_mavlink(const char* szStream, int iIntactRegistered, int iNoisy)
+{
+   char szTest[256];
+   t_parse_result reference = _parse_reference(s_pStream, s_iStreamLength);
+   t_parse_result bulk = _parse_bulk(s_pStream, s_iStreamLength, 0, 0);
+   t_parse_result bulkChunks = _parse_bulk(s_pStream, s_iStreamLength, 1023, 0);
+   t_parse_result bulkSmallChunks = _parse_bulk(s_pStream, s_iStreamLength, 17, 0);
+   t_parse_result bulkForward = _parse_bulk(s_pStream, s_iStreamLength, 0, 1);
+   t_parse_result bulkForwardChunks = _parse_bulk(s_pStream, s_iStreamLength, 17, 1);
+   log_line("%s: %d bytes, %d intact registered messages, messages: reference %u (%u decoded), bulk %u (%u decoded), in chunks %u (%u decoded), in small chunks %u (%u decoded), with unknown ids %u (%u decoded)",
+      szStream, s_iStreamLength, iIntactRegistered, reference.uMessages, reference.uRegistered, bulk.uMessages, bulk.uRegistered,
+      bulkChunks.uMessages, bulkChunks.uRegistered, bulkSmallChunks.uMessages, bulkSmallChunks.uRegistered,
+      bulkForward.uMessages, bulkForward.uRegistered);
+
+   snprintf(szTest, sizeof(szTest), "%s: chunked reads parse the same as one read", szStream);
+   _check_true(szTest, (bulkChunks.uRegistered == bulk.uRegistered) && (bulkChunks.uHash == bulk.uHash) && (bulkChunks.uMessages == bulk.uMessages));
+   snprintf(szTest, sizeof(szTest), "%s: small chunked reads parse the same as one read", szStream);
+   _check_true(szTest, (bulkSmallChunks.uRegistered == bulk.uRegistered) && (bulkSmallChunks.uHash == bulk.uHash) && (bulkSmallChunks.uMessages == bulk.uMessages));
+   snprintf(szTest, sizeof(szTest), "%s: chunked reads parse the same as one read, with unknown ids", szStream);
+   _check_true(szTest, (bulkForwardChunks.uRegistered == bulkForward.uRegistered) && (bulkForwardChunks.uHash == bulkForward.uHash) && (bulkForwardChunks.uMessages == bulkForward.uMessages));
+   if ( ! iNoisy )
+   {
+      snprintf(szTest, sizeof(szTest), "%s: same messages and fields as the reference parser", szStream);
+      _check_true(szTest, (reference.uMessages == bulkForward.uMessages) && (reference.uRegistered == bulkForward.uRegistered) && (reference.uHash == bulkForward.uHash));
+      snprintf(szTest, sizeof(szTest), "%s: same fields without the unknown ids", szStream);
+      _check_true(szTest, (reference.uRegistered == bulk.uRegistered) && (reference.uHash == bulk.uHash));
+   }
+   if ( iIntactRegistered > 0 )
+   {
+      snprintf(szTest, sizeof(szTest), "%s: all intact messages decoded", szStream);
+      _check_true(szTest, ((int)bulk.uRegistered <= iIntactRegistered) && ((int)bulk.uRegistered >= iIntactRegistered - iIntactRegistered/1000));
+      snprintf(szTest, sizeof(szTest), "%s: at least as many messages decoded as the reference parser", szStream);
+      _check_true(szTest, bulk.uRegistered >= reference.uRegistered);
+   }
+}
+
+void _test_telemetry_from_fc()
+{
+   t_packet_header_fc_telemetry PHFCT;
+   t_packet_header_ruby_telemetry_extended_v3 PHRTE;
+   memset(&PHFCT, 0, sizeof(PHFCT));
+   memset(&PHRTE, 0, sizeof(PHRTE));
+   parse_telemetry_init(1, false);
+   reset_heartbeat_msg_count();
+   reset_system_msg_count();
+
+   int iPos = 0;
+   bool bParsed = false;
+   while ( iPos < s_iStreamLength )
+   {
+      int iChunk = 1 + _random() % 1023;
+      if ( iChunk > s_iStreamLength - iPos )
+         iChunk = s_iStreamLength - iPos;
+      if ( parse_telemetry_from_fc(s_pStream + iPos, iChunk, &PHFCT, &PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_MAVLINK) )
+         bParsed = true;
+      iPos += iChunk;
+   }
+   _check_true("Telemetry: messages found", bParsed);
+   _check_true("Telemetry: all heartbeats parsed", get_heartbeat_msg_count() == s_iGeneratedHeartbeats);
+   _check_true("Telemetry: all system status parsed", get_system_msg_count() == s_iGeneratedSysStatus);
+   _check_true("Telemetry: last position", (int)PHFCT.latitude == s_iLastLatitude);
+
+   // Status text split over two reads
+   u8 uBuffer[MAVLINK_MAX_PACKET_LEN];
+   mavlink_message_t msg;
+   mavlink_msg_statustext_pack_chan(1, 1, CHANNEL_GENERATE, &msg, MAV_SEVERITY_INFO, "Bulk parser test");
+   int iLength = mavlink_msg_to_send_buffer(uBuffer, &msg);
+   parse_telemetry_from_fc(uBuffer, 7, &PHFCT, &PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_MAVLINK);
+   parse_telemetry_from_fc(uBuffer + 7, iLength - 7, &PHFCT, &PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_MAVLINK);
+   _check_true("Telemetry: status text", (NULL != get_last_message()) && (0 == strcmp(get_last_message(), "Bulk parser test")));
+
+   // Messages from other systems are framed but not used
+   mavlink_msg_heartbeat_pack_chan(7, 1, CHANNEL_GENERATE, &msg, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_ARDUPILOTMEGA, 0, 0, 0);
+   iLength = mavlink_msg_to_send_buffer(uBuffer, &msg);
+   reset_heartbeat_msg_count();
+   _check_true("Telemetry: other system message framed", parse_telemetry_from_fc(uBuffer, iLength, &PHFCT, &PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_MAVLINK));
+   _check_true("Telemetry: other system message not used", 0 == get_heartbeat_msg_count());
+}
+
+// LTM
+
+int s_iLTMFrameLengths[6] = { 18, 10, 11, 18, 10, 10 };
+u8 s_uLTMFrameTypes[6] = { 'G', 'A', 'S', 'O', 'N', 'X' };
+int s_iLTMGeneratedG = 0;
+int s_iLTMGeneratedS = 0;
+int s_iLTMLastPitch = 0;
+
+void _generate_ltm_stream()
+{
+   s_iStreamLength = 0;
+   s_iLTMGeneratedG = 0;
+   s_iLTMGeneratedS = 0;
+   for( int i=0; i<TEST_LTM_FRAMES; i++ )
+   {
+      if ( 0 == (_random() % 20) )
+      {
+         int iNoise = 1 + _random() % 10;
+         for( int k=0; k<iNoise; k++ )
+            s_pStream[s_iStreamLength++] = (0 == (_random() % 4)) ? '$' : (_random() & 0xFF);
+      }
+      int iType = _random() % 6;
+      u8* pFrame = s_pStream + s_iStreamLength;
+      int iLength = s_iLTMFrameLengths[iType];
+      pFrame[0] = '$';
+      pFrame[1] = 'T';
+      pFrame[2] = s_uLTMFrameTypes[iType];
+      u8 uChecksum = 0;
+      for( int k=3; k<iLength-1; k++ )
+      {
+         pFrame[k] = _random() & 0xFF;
+         uChecksum ^= pFrame[k];
+      }
+      pFrame[iLength-1] = uChecksum;
+      s_iStreamLength += iLength;
+      if ( 0 == (_random() % 50) )
+      {
+         pFrame[3 + _random() % (iLength-3)] ^= 0x10;
+         continue;
+      }
+      if ( 'G' == pFrame[2] )
+         s_iLTMGeneratedG++;
+      if ( 'S' == pFrame[2] )
+         s_iLTMGeneratedS++;
+      if ( 'A' == pFrame[2] )
+         s_iLTMLastPitch = ((int16_t)(pFrame[3] | (pFrame[4] << 8)))*100 + 18000;
+   }
+}
+
+void _on_ltm_frame(u8 uFrameType, const u8* pPayload, int iPayloadLength, void* pContext)
+{
+   (*(int*)pContext)++;
+}
+
+// The byte by byte LTM parser the vehicle used before, frames only
+int _parse_ltm_reference(u8* pData, int iLength)
+{
+   int iState = 0;
+   int iFrameLength = 0;
+   int iIndex = 0;
+   u8 uChecksum = 0;
+   int iFrames = 0;
+   for( int i=0; i<iLength; i++ )
+   {
+      u8 c = pData[i];
+      if ( 0 == iState )
+         iState = (c == '$') ? 1 : 0;
+      else if ( 1 == iState )
+         iState = (c == 'T') ? 2 : 0;
+      else if ( 2 == iState )
+      {
+         iFrameLength = 0;
+         for( int k=0; k<6; k++ )
+         {
+            if ( s_uLTMFrameTypes[k] == c )
+               iFrameLength = s_iLTMFrameLengths[k];
+         }
+         iState = (iFrameLength > 0) ? 3 : 0;
+         iIndex = 0;
+      }
+      else
+      {
+         uChecksum = (0 == iIndex) ? c : (uChecksum ^ c);
+         if ( iIndex == iFrameLength-4 )
+         {
+            if ( 0 == uChecksum )
+               iFrames++;
+            iState = 0;
+         }
+         else
+            iIndex++;
+      }
+   }
+   return iFrames;
+}
+
+void _test_ltm()
+{
+   t_packet_header_fc_telemetry PHFCT;
+   t_packet_header_ruby_telemetry_extended_v3 PHRTE;
+   memset(&PHFCT, 0, sizeof(PHFCT));
+   memset(&PHRTE, 0, sizeof(PHRTE));
+   reset_heartbeat_msg_count();
+   reset_system_msg_count();
+
+   int iPos = 0;
+   while ( iPos < s_iStreamLength )
+   {
+      int iChunk = 1 + _random() % 255;
+      if ( iChunk > s_iStreamLength - iPos )
+         iChunk = s_iStreamLength - iPos;
+      parse_telemetry_from_fc(s_pStream + iPos, iChunk, &PHFCT, &PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_LTM);
+      iPos += iChunk;
+   }
+   log_line("LTM stream: %d bytes, G frames: %d generated, %d parsed; S frames: %d generated, %d parsed",
+      s_iStreamLength, s_iLTMGeneratedG, get_system_msg_count(), s_iLTMGeneratedS, get_heartbeat_msg_count());
+   _check_true("LTM: all G frames parsed", get_system_msg_count() >= s_iLTMGeneratedG - s_iLTMGeneratedG/1000);
+   _check_true("LTM: all S frames parsed", get_heartbeat_msg_count() >= s_iLTMGeneratedS - s_iLTMGeneratedS/1000);
+   _check_true("LTM: last attitude", (int)PHFCT.pitch == s_iLTMLastPitch);
+}
+
+// Benchmarks
+
+double _bench_rate_mb(u32 uStartMs, int iBytes)
+{
+   u32 uMs = get_current_timestamp_ms() - uStartMs;
+   if ( 0 == uMs )
+      uMs = 1;
+   return (double)iBytes / 1024.0 / 1024.0 * 1000.0 / (double)uMs;
+}
+
+// Reads of 256 bytes, as from the serial port
+void _bench()
+{
+   int iRead = 256;
+   u32 uStart;
+   int iBytes;
+
+   double fReference = 0;
+   uStart = get_current_timestamp_ms();
+   iBytes = 0;
+   do
+   {
+      t_parse_result result = _parse_reference(s_pStream, s_iStreamLength);
+      if ( 0 == result.uMessages )
+         break;
+      iBytes += s_iStreamLength;
+   }
+   while ( get_current_timestamp_ms() - uStart < TEST_BENCH_MIN_MS );
+   fReference = _bench_rate_mb(uStart, iBytes);
+
+   t_mavlink_bulk_parser* pParser = (t_mavlink_bulk_parser*)malloc(sizeof(t_mavlink_bulk_parser));
+   t_parse_result result;
+   memset(&result, 0, sizeof(result));
+   mavlink_bulk_init(pParser);
+   for( int i=0; i<(int)(sizeof(s_uRegisteredIds)/sizeof(s_uRegisteredIds[0])); i++ )
+      mavlink_bulk_register(pParser, s_uRegisteredIds[i], _on_bulk_message, &result);
+   uStart = get_current_timestamp_ms();
+   iBytes = 0;
+   do
+   {
+      for( int i=0; i<s_iStreamLength; i+=iRead )
+         mavlink_bulk_parse(pParser, s_pStream + i, (s_iStreamLength - i < iRead) ? (s_iStreamLength - i) : iRead);
+      iBytes += s_iStreamLength;
+   }
+   while ( get_current_timestamp_ms() - uStart < TEST_BENCH_MIN_MS );
+   double fBulk = _bench_rate_mb(uStart, iBytes);
+   free(pParser);
+
+   t_packet_header_fc_telemetry PHFCT;
+   t_packet_header_ruby_telemetry_extended_v3 PHRTE;
+   memset(&PHFCT, 0, sizeof(PHFCT));
+   memset(&PHRTE, 0, sizeof(PHRTE));
+   uStart = get_current_timestamp_ms();
+   iBytes = 0;
+   do
+   {
+      for( int i=0; i<s_iStreamLength; i+=iRead )
+         parse_telemetry_from_fc(s_pStream + i, (s_iStreamLength - i < iRead) ? (s_iStreamLength - i) : iRead, &PHFCT, &PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_MAVLINK);
+      iBytes += s_iStreamLength;
+   }
+   while ( get_current_timestamp_ms() - uStart < TEST_BENCH_MIN_MS );
+   double fTelemetry = _bench_rate_mb(uStart, iBytes);
+
+   log_line("Bench MAVLink (%d bytes reads): per byte parser + getters: %.1f MB/s, bulk parser + extractors: %.1f MB/s (x%.1f), FC telemetry parsing: %.1f MB/s",
+      iRead, fReference, fBulk, fBulk/fReference, fTelemetry);
+}
+
+void _bench_ltm()
+{
+   int iRead = 256;
+   u32 uStart = get_current_timestamp_ms();
+   int iBytes = 0;
+   do
+   {
+      if ( 0 == _parse_ltm_reference(s_pStream, s_iStreamLength) )
+         break;
+      iBytes += s_iStreamLength;
+   }
+   while ( get_current_timestamp_ms() - uStart < TEST_BENCH_MIN_MS );
+   double fReference = _bench_rate_mb(uStart, iBytes);
+
+   t_ltm_bulk_parser* pParser = (t_ltm_bulk_parser*)malloc(sizeof(t_ltm_bulk_parser));
+   int iFrames = 0;
+   ltm_bulk_init(pParser, _on_ltm_frame, &iFrames);
+   uStart = get_current_timestamp_ms();
+   iBytes = 0;
+   do
+   {
+      for( int i=0; i<s_iStreamLength; i+=iRead )
+         ltm_bulk_parse(pParser, s_pStream + i, (s_iStreamLength - i < iRead) ? (s_iStreamLength - i) : iRead);
+      iBytes += s_iStreamLength;
+   }
+   while ( get_current_timestamp_ms() - uStart < TEST_BENCH_MIN_MS );
+   double fBulk = _bench_rate_mb(uStart, iBytes);
+   free(pParser);
+
+   t_packet_header_fc_telemetry PHFCT;
+   t_packet_header_ruby_telemetry_extended_v3 PHRTE;
+   memset(&PHFCT, 0, sizeof(PHFCT));
+   memset(&PHRTE, 0, sizeof(PHRTE));
+   uStart = get_current_timestamp_ms();
+   iBytes = 0;
+   do
+   {
+      for( int i=0; i<s_iStreamLength; i+=iRead )
+         parse_telemetry_from_fc(s_pStream + i, (s_iStreamLength - i < iRead) ? (s_iStreamLength - i) : iRead, &PHFCT, &PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_LTM);
+      iBytes += s_iStreamLength;
+   }
+   while ( get_current_timestamp_ms() - uStart < TEST_BENCH_MIN_MS );
+   double fTelemetry = _bench_rate_mb(uStart, iBytes);
+   log_line("Bench LTM (%d bytes reads): per byte framing: %.1f MB/s, bulk framing: %.1f MB/s (x%.1f), FC telemetry parsing: %.1f MB/s",
+      iRead, fReference, fBulk, fBulk/fReference, fTelemetry);
+}
+
+// MSP
+
+int s_iMSPGeneratedFrames = 0;
+
+void _on_msp_frame(const t_msp_bulk_frame* pFrame, void* pContext)
+{
+   int* piFrames = (int*)pContext;
+   if ( (pFrame->iPayloadLength == pFrame->pData[3]) && (pFrame->uCommand == pFrame->pData[4]) )
+      (*piFrames)++;
+}
+
+void _generate_msp_stream()
+{
+   s_iStreamLength = 0;
+   s_iMSPGeneratedFrames = 0;
+   for( int i=0; i<TEST_LTM_FRAMES; i++ )
+   {
+      if ( 0 == (_random() % 20) )
+      {
+         int iNoise = 1 + _random() % 10;
+         for( int k=0; k<iNoise; k++ )
+            s_pStream[s_iStreamLength++] = (0 == (_random() % 4)) ? '$' : (_random() & 0xFF);
+      }
+      u8* pFrame = s_pStream + s_iStreamLength;
+      int iSize = _random() % 64;
+      pFrame[0] = '$';
+      pFrame[1] = 'M';
+      pFrame[2] = (_random() % 2) ? '>' : '<';
+      pFrame[3] = iSize;
+      pFrame[4] = _random() & 0xFF;
+      u8 uChecksum = pFrame[3] ^ pFrame[4];
+      for( int k=0; k<iSize; k++ )
+      {
+         pFrame[5+k] = _random() & 0xFF;
+         uChecksum ^= pFrame[5+k];
+      }
+      pFrame[5+iSize] = uChecksum;
+      s_iStreamLength += 6 + iSize;
+      if ( 0 == (_random() % 50) )
+      {
+         pFrame[4 + _random() % (iSize+2)] ^= 0x10;
+         continue;
+      }
+      s_iMSPGeneratedFrames++;
+   }
+}
+
+void _test_msp()
+{
+   t_msp_bulk_parser* pParser = (t_msp_bulk_parser*)malloc(sizeof(t_msp_bulk_parser));
+   int iFrames = 0;
+   msp_bulk_init(pParser, _on_msp_frame, &iFrames);
+   int iPos = 0;
+   while ( iPos < s_iStreamLength )
+   {
+      int iChunk = 1 + _random() % 255;
+      if ( iChunk > s_iStreamLength - iPos )
+         iChunk = s_iStreamLength - iPos;
+      msp_bulk_parse(pParser, s_pStream + iPos, iChunk);
+      iPos += iChunk;
+   }
+   log_line("MSP stream: %d bytes, frames: %d generated, %d parsed, %u checksum errors, %u bytes discarded",
+      s_iStreamLength, s_iMSPGeneratedFrames, iFrames, pParser->uChecksumErrors, pParser->uBytesDiscarded);
+   _check_true("MSP: all frames parsed", iFrames >= s_iMSPGeneratedFrames - s_iMSPGeneratedFrames/1000);
+   _check_true("MSP: no false frames", iFrames <= s_iMSPGeneratedFrames + s_iMSPGeneratedFrames/1000);
+   free(pParser);
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestFCTelemetryParsers");
+   log_enable_stdout();
+
+   const char* szFile = NULL;
+   const char* szRecord = NULL;
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-file")) && (i+1 < argc) )
+         szFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-record")) && (i+1 < argc) )
+         szRecord = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i+1 < argc) )
+         s_uRandomState = (u64)atoi(argv[++i]);
+   }
+   if ( 0 == s_uRandomState )
+      s_uRandomState = 1;
+
+   s_pStream = (u8*)malloc(TEST_MAX_STREAM);
+   if ( NULL == s_pStream )
+   {
+      log_error_and_alarm("Failed to allocate the stream buffer.");
+      return 1;
+   }
+
+   if ( NULL != szFile )
+   {
+      FILE* fd = fopen(szFile, "rb");
+      if ( NULL == fd )
+      {
+         log_error_and_alarm("Failed to open recorded stream %s", szFile);
+         return 1;
+      }
+      s_iStreamLength = fread(s_pStream, 1, TEST_MAX_STREAM, fd);
+      fclose(fd);
+      _test_mavlink("Recorded stream", 0, 1);
+      _bench();
+   }
+   else
+   {
+      int iIntact = _generate_stream(0);
+      if ( NULL != szRecord )
+      {
+         FILE* fd = fopen(szRecord, "wb");
+         if ( (NULL == fd) || (s_iStreamLength != (int)fwrite(s_pStream, 1, s_iStreamLength, fd)) )
+            log_softerror_and_alarm("Failed to save the stream to %s", szRecord);
+         if ( NULL != fd )
+            fclose(fd);
+      }
+      _test_mavlink("Clean stream", iIntact, 0);
+      _test_telemetry_from_fc();
+      _bench();
+
+      iIntact = _generate_stream(1);
+      _test_mavlink("Noisy stream", iIntact, 1);
+   }
+
+   _generate_ltm_stream();
+   _test_ltm();
+   _bench_ltm();
+
+   _generate_msp_stream();
+   _test_msp();
+
+   free(s_pStream);
+   log_line("FC telemetry parsers tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
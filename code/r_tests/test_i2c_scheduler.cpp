@@ -0,0 +1,232 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/hardware_i2c_bus.h"
+#include "../base/shared_mem_i2c.h"
+#include "../r_i2c/i2c_scheduler.h"
+
+#include <time.h>
+#include <sys/resource.h>
+
+// Runs the I2C devices scheduler against a mock I2C bus with a slow current sensor,
+// an RC input device and a buttons device, and reports the per device read latencies.
+// Also runs the same reads in the old fixed sleep loop, for comparison.
+
+#define MOCK_ADDRESS_INA 0x40
+#define MOCK_ADDRESS_RC_IN 0x19
+#define MOCK_ADDRESS_BUTTONS 0x20
+
+// Slow sensor (clock stretching); about 25 us per byte on a 400 kHz bus for the others
+#define MOCK_LATENCY_INA_MICROS 3000
+#define MOCK_LATENCY_PER_BYTE_MICROS 25
+
+// The mock RC input device gets a new RC frame every 10 ms
+#define MOCK_RC_FRAME_INTERVAL_MS 10
+
+bool bQuit = false;
+
+int s_iMockRCChannelErrors = 0;
+int s_iRCFrameChanges = 0;
+u32 s_uRCLastFrameTime = 0;
+u32 s_uRCMaxFrameIntervalMs = 0;
+u8 s_uRCLastFrame = 0;
+
+void handle_sigint(int sig)
+{
+   log_line("Caught signal to stop: %d\n", sig);
+   bQuit = true;
+}
+
+void _mock_bus_delay(u32 uMicros)
+{
+   u32 uStart = get_current_timestamp_micros();
+   while ( get_current_timestamp_micros() - uStart < uMicros )
+   {
+   }
+}
+
+int _mock_i2c_handler(u8 uAddress, u8* pWrite, int iWriteLength, u8* pRead, int iReadLength)
+{
+   _mock_bus_delay(MOCK_LATENCY_PER_BYTE_MICROS * (2 + iWriteLength + iReadLength));
+   if ( uAddress == MOCK_ADDRESS_INA )
+   {
+      _mock_bus_delay(MOCK_LATENCY_INA_MICROS);
+      for( int i=0; i<iReadLength; i++ )
+         pRead[i] = 0x10 + i;
+      return 0;
+   }
+   if ( uAddress == MOCK_ADDRESS_RC_IN )
+   {
+      if ( (iWriteLength < 1) || (iReadLength < 1) )
+         return -1;
+      // Frame number register, then one 16 bit register per channel (value = 1000 + 10 * channel index)
+      if ( pWrite[0] == I2C_DEVICE_COMMAND_ID_RC_IN_GET_FRAME_NUMBER )
+      {
+         pRead[0] = (u8)(get_current_timestamp_ms() / MOCK_RC_FRAME_INTERVAL_MS);
+         return 0;
+      }
+      if ( iReadLength < 2 )
+         return -1;
+      u16 uValue = 1000 + 10 * (pWrite[0] - I2C_DEVICE_COMMAND_ID_RC_IN_GET_CHANNEL);
+      pRead[0] = uValue & 0xFF;
+      pRead[1] = uValue >> 8;
+      return 0;
+   }
+   if ( uAddress == MOCK_ADDRESS_BUTTONS )
+   {
+      for( int i=0; i<iReadLength; i++ )
+         pRead[i] = 0;
+      return 0;
+   }
+   return -1;
+}
+
+int _task_read_ina(u32 uTimeNow, void* pContext)
+{
+   u16 uVoltage = 0, uCurrent = 0;
+   if ( 0 != hardware_i2c_bus_read_reg16(0, MOCK_ADDRESS_INA, 2, &uVoltage) )
+      return 0;
+   if ( 0 != hardware_i2c_bus_read_reg16(0, MOCK_ADDRESS_INA, 4, &uCurrent) )
+      return 0;
+   return 1;
+}
+
+int _task_read_rc_in(u32 uTimeNow, void* pContext)
+{
+   u8 uFrame = 0;
+   if ( 0 != hardware_i2c_bus_read_reg8(0, MOCK_ADDRESS_RC_IN, I2C_DEVICE_COMMAND_ID_RC_IN_GET_FRAME_NUMBER, &uFrame) )
+      return 0;
+   if ( uFrame != s_uRCLastFrame )
+   {
+      u32 uTime = get_current_timestamp_ms();
+      if ( (0 != s_uRCLastFrameTime) && (uTime - s_uRCLastFrameTime > s_uRCMaxFrameIntervalMs) )
+         s_uRCMaxFrameIntervalMs = uTime - s_uRCLastFrameTime;
+      s_uRCLastFrameTime = uTime;
+      s_uRCLastFrame = uFrame;
+      s_iRCFrameChanges++;
+   }
+
+   u8 uRegisters[16];
+   u16 uValues[16];
+   for( int i=0; i<16; i++ )
+      uRegisters[i] = I2C_DEVICE_COMMAND_ID_RC_IN_GET_CHANNEL + i;
+   if ( 0 != hardware_i2c_bus_read_regs16(0, MOCK_ADDRESS_RC_IN, uRegisters, 16, uValues) )
+      return 0;
+   for( int i=0; i<16; i++ )
+   {
+      if ( uValues[i] != 1000 + 10*i )
+         s_iMockRCChannelErrors++;
+   }
+   return 1;
+}
+
+int _task_read_buttons(u32 uTimeNow, void* pContext)
+{
+   u8 uCommand[3] = { I2C_COMMAND_START_FLAG, I2C_COMMAND_ID_GET_BUTTONS_EVENTS, 0 };
+   u8 uResponse[5];
+   if ( 0 != hardware_i2c_bus_transfer(0, MOCK_ADDRESS_BUTTONS, uCommand, 3, uResponse, 5) )
+      return 0;
+   return 1;
+}
+
+void _log_stats(const char* szTitle)
+{
+   log_line("%s:", szTitle);
+   for( int i=0; i<i2c_scheduler_get_tasks_count(); i++ )
+   {
+      t_i2c_device_read_stats* pStats = i2c_scheduler_get_task_stats(i);
+      log_line("  %-10s (0x%02X, prio %d, period %3d ms): %5u reads, %u failed, %u deadline misses, latency avg/max: %5u/%5u us, max start delay: %5u us",
+         pStats->szName, pStats->uI2CAddress, pStats->uPriority, pStats->uPeriodMs,
+         pStats->uReadsCount, pStats->uReadsFailed, pStats->uDeadlineMisses,
+         pStats->uAvgReadLatencyMicros, pStats->uMaxReadLatencyMicros, pStats->uMaxScheduleDelayMicros);
+   }
+}
+
+// The old ruby_i2c loop: fixed sleep, then read every device in a row. Returns the max RC frame interval seen.
+u32 _run_legacy_loop(int iDurationMs)
+{
+   s_uRCLastFrameTime = 0;
+   s_uRCMaxFrameIntervalMs = 0;
+   s_iRCFrameChanges = 0;
+   u32 uLastINARead = 0;
+   u32 uTimeStart = get_current_timestamp_ms();
+   while ( (! bQuit) && (get_current_timestamp_ms() < uTimeStart + iDurationMs) )
+   {
+      hardware_sleep_ms(20);
+      u32 uTimeNow = get_current_timestamp_ms();
+      if ( uTimeNow >= uLastINARead + 300 )
+      {
+         uLastINARead = uTimeNow;
+         _task_read_ina(uTimeNow, NULL);
+      }
+      _task_read_rc_in(uTimeNow, NULL);
+      _task_read_buttons(uTimeNow, NULL);
+   }
+   return s_uRCMaxFrameIntervalMs;
+}
+
+int main(int argc, char *argv[])
+{
+   signal(SIGINT, handle_sigint);
+   signal(SIGTERM, handle_sigint);
+   signal(SIGQUIT, handle_sigint);
+
+   log_init("TestI2CScheduler");
+   log_enable_stdout();
+
+   int iDurationMs = 3000;
+   if ( argc > 1 )
+      iDurationMs = atoi(argv[1]);
+
+   hardware_i2c_bus_set_mock_handler(_mock_i2c_handler);
+
+   i2c_scheduler_reset();
+   i2c_scheduler_add_task("INA219", MOCK_ADDRESS_INA, I2C_TASK_PRIORITY_HOUSEKEEPING, 300, 300, _task_read_ina, NULL);
+   i2c_scheduler_add_task("Buttons", MOCK_ADDRESS_BUTTONS, I2C_TASK_PRIORITY_USER_INPUT, 20, 20, _task_read_buttons, NULL);
+   int iTaskRC = i2c_scheduler_add_task("RC In", MOCK_ADDRESS_RC_IN, I2C_TASK_PRIORITY_RC_INPUT, MOCK_RC_FRAME_INTERVAL_MS, MOCK_RC_FRAME_INTERVAL_MS, _task_read_rc_in, NULL);
+
+   // Same main loop as ruby_i2c
+   u32 uTimeStart = get_current_timestamp_ms();
+   while ( (! bQuit) && (get_current_timestamp_ms() < uTimeStart + iDurationMs) )
+   {
+      u32 uWaitMs = i2c_scheduler_get_wait_time_ms(get_current_timestamp_ms());
+      if ( uWaitMs > 0 )
+         hardware_sleep_ms(uWaitMs);
+      i2c_scheduler_run(get_current_timestamp_ms());
+   }
+   _log_stats("Scheduler");
+
+   t_shared_mem_i2c_devices_read_stats smStats;
+   memset(&smStats, 0, sizeof(smStats));
+   i2c_scheduler_publish_stats(&smStats, get_current_timestamp_ms());
+
+   u32 uSchedulerMaxRCInterval = s_uRCMaxFrameIntervalMs;
+   t_i2c_device_read_stats* pRCStats = i2c_scheduler_get_task_stats(iTaskRC);
+   log_line("Scheduler: %d RC frames generated, %d seen, max interval between RC frame reads: %u ms, channel value errors: %d",
+      iDurationMs/MOCK_RC_FRAME_INTERVAL_MS, s_iRCFrameChanges, uSchedulerMaxRCInterval, s_iMockRCChannelErrors);
+
+   u32 uLegacyMaxRCInterval = _run_legacy_loop(iDurationMs);
+   log_line("Legacy loop: %d RC frames generated, %d seen, max interval between RC frame reads: %u ms", iDurationMs/MOCK_RC_FRAME_INTERVAL_MS, s_iRCFrameChanges, uLegacyMaxRCInterval);
+
+   int iFailed = 0;
+   if ( (NULL == pRCStats) || (smStats.uDevicesCount != 3) )
+      iFailed++;
+   // The slow INA reads (2 x 3 ms) can delay a RC read by at most one INA read
+   else if ( pRCStats->uMaxScheduleDelayMicros > 2*MOCK_LATENCY_INA_MICROS + 5000 )
+   {
+      log_line("FAILED: RC reads delayed too much (%u us)", pRCStats->uMaxScheduleDelayMicros);
+      iFailed++;
+   }
+   else if ( pRCStats->uDeadlineMisses * 50 > pRCStats->uReadsCount )
+   {
+      log_line("FAILED: too many RC reads deadline misses (%u of %u)", pRCStats->uDeadlineMisses, pRCStats->uReadsCount);
+      iFailed++;
+   }
+   if ( s_iMockRCChannelErrors > 0 )
+   {
+      log_line("FAILED: invalid RC channels values read from the bus");
+      iFailed++;
+   }
+   log_line("I2C scheduler tests: %s", iFailed?"FAILED":"PASSED");
+   return iFailed?1:0;
+}
@@ -0,0 +1,219 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/hw_procs.h"
+#include "../base/models.h"
+#include "../base/models_list.h"
+
+#include <time.h>
+#include <sys/stat.h>
+
+// Creates a full controller models list (controller and spectator models) in a temporary folder and
+// measures the controller models list load time with and without a valid models index.
+
+#define TEST_FOLDER_CONFIG "/tmp/ruby_test_models/"
+#define TEST_FOLDER_MODELS "/tmp/ruby_test_models/models/"
+
+bool bQuit = false;
+bool s_bChangedSystemTypeFile = false;
+bool s_bHadSystemTypeFile = false;
+char s_szSavedSystemType[128];
+
+void handle_sigint(int sig)
+{
+   log_line("Caught signal to stop: %d\n", sig);
+   bQuit = true;
+}
+
+// The models list is only loaded on controllers: run as a controller on any host (i.e. on a build
+// host detected as a vehicle), saving the current system type file so that it can be restored.
+void _force_controller_system_type()
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_RUBY_TEMP);
+   strcat(szFile, FILE_CONFIG_SYSTEM_TYPE);
+
+   int iIsVehicle = 0;
+   u32 uBoardType = 0;
+   s_szSavedSystemType[0] = 0;
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL != fd )
+   {
+      s_bHadSystemTypeFile = true;
+      if ( NULL == fgets(s_szSavedSystemType, sizeof(s_szSavedSystemType), fd) )
+         s_szSavedSystemType[0] = 0;
+      fclose(fd);
+      if ( 2 != sscanf(s_szSavedSystemType, "%d %u", &iIsVehicle, &uBoardType) )
+         uBoardType = 0;
+   }
+
+   char szComm[256];
+   sprintf(szComm, "mkdir -p %s", FOLDER_RUBY_TEMP);
+   hw_execute_bash_command(szComm, NULL);
+   fd = fopen(szFile, "w");
+   if ( NULL == fd )
+   {
+      log_line("Failed to write system type file [%s].", szFile);
+      return;
+   }
+   fprintf(fd, "0 %u\n", uBoardType);
+   fclose(fd);
+   s_bChangedSystemTypeFile = true;
+}
+
+void _restore_system_type()
+{
+   if ( ! s_bChangedSystemTypeFile )
+      return;
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_RUBY_TEMP);
+   strcat(szFile, FILE_CONFIG_SYSTEM_TYPE);
+   if ( ! s_bHadSystemTypeFile )
+   {
+      unlink(szFile);
+      return;
+   }
+   FILE* fd = fopen(szFile, "w");
+   if ( NULL == fd )
+   {
+      log_line("Failed to restore system type file [%s].", szFile);
+      return;
+   }
+   fputs(s_szSavedSystemType, fd);
+   fclose(fd);
+}
+
+u32 _create_models(int iCountControllerModels, int iCountSpectatorModels)
+{
+   hw_execute_bash_command("rm -rf " TEST_FOLDER_CONFIG, NULL);
+   hw_execute_bash_command("mkdir -p " TEST_FOLDER_MODELS, NULL);
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   u32 uCurrentVehicleId = 0;
+   Model model;
+   for( int i=0; i<iCountControllerModels + iCountSpectatorModels; i++ )
+   {
+      model.resetToDefaults(true);
+      model.is_spectator = (i >= iCountControllerModels);
+      sprintf(model.vehicle_name, "Test %d", i);
+      if ( model.is_spectator )
+         sprintf(szFile, TEST_FOLDER_MODELS FILE_VEHICLE_SPECTATOR, i - iCountControllerModels);
+      else
+         sprintf(szFile, TEST_FOLDER_MODELS FILE_VEHICLE_CONTROLL, i);
+      model.saveToFile(szFile, false);
+      if ( i == iCountControllerModels/2 )
+      {
+         uCurrentVehicleId = model.uVehicleId;
+         model.saveToFile(TEST_FOLDER_CONFIG FILE_CONFIG_CURRENT_VEHICLE_MODEL, false);
+      }
+   }
+   save_simple_config_fileI(TEST_FOLDER_CONFIG FILE_CONFIG_CURRENT_VEHICLE_COUNT, iCountControllerModels);
+   return uCurrentVehicleId;
+}
+
+u32 _time_load_models()
+{
+   u32 uStart = get_current_timestamp_micros();
+   loadAllModels();
+   return get_current_timestamp_micros() - uStart;
+}
+
+int main(int argc, char *argv[])
+{
+   signal(SIGINT, handle_sigint);
+   signal(SIGTERM, handle_sigint);
+   signal(SIGQUIT, handle_sigint);
+
+   log_init("TestModelsIndex");
+   log_enable_stdout();
+
+   _force_controller_system_type();
+   if ( hardware_is_vehicle() )
+   {
+      _restore_system_type();
+      log_line("FAILED: could not run as a controller, the models list is loaded only on controllers.");
+      log_line("Models index tests: FAILED");
+      return 1;
+   }
+
+   int iCountControllerModels = MAX_MODELS-1;
+   int iCountSpectatorModels = MAX_MODELS_SPECTATOR;
+   int iCountTotal = iCountControllerModels + iCountSpectatorModels;
+   setModelsListFolders(TEST_FOLDER_CONFIG, TEST_FOLDER_MODELS);
+   u32 uCurrentVehicleId = _create_models(iCountControllerModels, iCountSpectatorModels);
+
+   int iFailed = 0;
+   u32 uTimeCold = _time_load_models();
+   int iLoadedCold = getLoadedModelsCount();
+   if ( (getControllerModelsCount() != iCountControllerModels) || (getControllerModelsSpectatorCount() != iCountSpectatorModels) )
+   {
+      log_line("FAILED: loaded %d controller models, %d spectator models", getControllerModelsCount(), getControllerModelsSpectatorCount());
+      iFailed++;
+   }
+
+   u32 uTimeWarm = 0;
+   int iRuns = 5;
+   for( int i=0; i<iRuns; i++ )
+      uTimeWarm += _time_load_models();
+   uTimeWarm /= iRuns;
+   int iLoadedWarm = getLoadedModelsCount();
+
+   // Only the current model is loaded, the rest of the list comes from the index
+   if ( iLoadedWarm > 1 )
+   {
+      log_line("FAILED: %d models loaded after an indexed load", iLoadedWarm);
+      iFailed++;
+   }
+   if ( (NULL == getCurrentModel()) || (getCurrentModel()->uVehicleId != uCurrentVehicleId) || (getModelAtIndex(iCountControllerModels/2) != getCurrentModel()) )
+   {
+      log_line("FAILED: invalid current model");
+      iFailed++;
+   }
+
+   // Models are loaded on demand and match their index entries
+   for( int i=0; i<iCountControllerModels; i++ )
+   {
+      u32 uIndexVehicleId = getControllerModelIndexEntry(i)->uVehicleId;
+      Model* pModel = getModelAtIndex(i);
+      if ( (NULL == pModel) || (pModel->uVehicleId != uIndexVehicleId) || (0 != strcmp(pModel->vehicle_name, getControllerModelIndexEntry(i)->szVehicleName)) )
+      {
+         log_line("FAILED: controller model %d does not match its index entry (VID %u, name: [%s], index VID %u, name: [%s])", i,
+            (NULL != pModel)?pModel->uVehicleId:0, (NULL != pModel)?pModel->vehicle_name:"", uIndexVehicleId, getControllerModelIndexEntry(i)->szVehicleName);
+         iFailed++;
+         break;
+      }
+   }
+   for( int i=0; i<iCountSpectatorModels; i++ )
+   {
+      t_model_index_entry* pEntry = getSpectatorModelIndexEntry(i);
+      if ( (NULL == pEntry) || (! pEntry->uIsSpectator) || (findModelWithId(pEntry->uVehicleId, 0) != getSpectatorModel(i)) )
+      {
+         log_line("FAILED: spectator model %d does not match its index entry", i);
+         iFailed++;
+         break;
+      }
+   }
+
+   // A changed model file invalidates its index entry
+   Model model;
+   model.loadFromFile(TEST_FOLDER_MODELS "spect-0.mdl", true);
+   strcpy(model.vehicle_name, "Renamed");
+   hardware_sleep_ms(20);
+   model.saveToFile(TEST_FOLDER_MODELS "spect-0.mdl", false);
+   loadAllModels();
+   if ( (getLoadedModelsCount() != 2) || (0 != strcmp(getSpectatorModelIndexEntry(0)->szVehicleName, "Renamed")) )
+   {
+      log_line("FAILED: changed model file was not reloaded (%d models loaded, name: [%s])", getLoadedModelsCount(), getSpectatorModelIndexEntry(0)->szVehicleName);
+      iFailed++;
+   }
+
+   log_line("Models list of %d models: full load: %u us (%d models loaded), indexed load: %u us (%d models loaded), %u us/model => %u us/model",
+      iCountTotal, uTimeCold, iLoadedCold, uTimeWarm, iLoadedWarm, uTimeCold/iCountTotal, uTimeWarm/iCountTotal);
+   log_line("Estimated load time for 500 models: full load: %u ms, indexed load: %u ms",
+      uTimeCold/iCountTotal*500/1000, uTimeWarm/iCountTotal*500/1000);
+
+   hw_execute_bash_command("rm -rf " TEST_FOLDER_CONFIG, NULL);
+   _restore_system_type();
+   log_line("Models index tests: %s", iFailed?"FAILED":"PASSED");
+   return iFailed?1:0;
+}
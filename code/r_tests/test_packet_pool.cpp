@@ -0,0 +1,303 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/packet_pool.h"
+#include "../radio/radiopackets2.h"
+
+// Checks the packets pool used by the video tx/rx buffers: slots don't overlap, slabs are given back when
+// the packets are released, and the memory held follows the video bitrate and the retransmission window
+// instead of the whole blocks buffer. Compares scanning the blocks for missing packets using the old
+// per packet structs and the per block bitmaps.
+// Usage: test_packet_pool [-seed n] [-window ms]
+
+#define TEST_SLOT_SIZE (RADIO_PACKET_HEADROOM + 1300)
+#define TEST_DATA_PACKETS 8
+#define TEST_EC_PACKETS 4
+#define TEST_VIDEO_DATA_LENGTH 1180
+#define TEST_BLOCKS 4000
+#define TEST_MIN_WINDOW_BLOCKS 8
+
+int s_iFailed = 0;
+u64 s_uRandomState = 1;
+int s_iWindowMs = 200;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u32 _random(u64* pState, u32 uMax)
+{
+   *pState ^= *pState >> 12;
+   *pState ^= *pState << 25;
+   *pState ^= *pState >> 27;
+   return (u32)(((*pState * 2685821657736338717ULL) >> 32) % uMax);
+}
+
+void _test_alloc_free()
+{
+   t_packet_pool pool;
+   packet_pool_init(&pool, TEST_SLOT_SIZE, PACKET_POOL_SLOTS_PER_SLAB);
+   _check_true("slot size is aligned", (0 == (pool.iSlotSize % PACKET_POOL_SLOT_ALIGNMENT)) && (pool.iSlotSize >= TEST_SLOT_SIZE));
+   _check_true("no memory before the first packet", 0 == packet_pool_get_resident_bytes(&pool));
+
+   static u16 s_uSlots[MAX_RXTX_BLOCKS_BUFFER * MAX_TOTAL_PACKETS_IN_BLOCK];
+   int iCount = MAX_RXTX_BLOCKS_BUFFER * MAX_TOTAL_PACKETS_IN_BLOCK;
+   int iAllocated = 0;
+   for( int i=0; i<iCount; i++ )
+   {
+      s_uSlots[i] = packet_pool_alloc(&pool);
+      if ( PACKET_POOL_INVALID_SLOT == s_uSlots[i] )
+         break;
+      u8* pSlot = packet_pool_get(&pool, s_uSlots[i]);
+      memset(pSlot, (u8)(i & 0xFF), pool.iSlotSize);
+      iAllocated++;
+   }
+   _check_true("whole blocks buffer fits the pool", iAllocated == iCount);
+
+   int iCorrupted = 0;
+   for( int i=0; i<iAllocated; i++ )
+   {
+      u8* pSlot = packet_pool_get(&pool, s_uSlots[i]);
+      if ( ((u8)(i & 0xFF) != pSlot[0]) || ((u8)(i & 0xFF) != pSlot[pool.iSlotSize-1]) )
+         iCorrupted++;
+   }
+   _check_true("slots don't overlap", 0 == iCorrupted);
+
+   // Free in random order, the pool must end up with only the reserve
+   for( int i=iAllocated-1; i>0; i-- )
+   {
+      int k = _random(&s_uRandomState, i+1);
+      u16 uTmp = s_uSlots[i];
+      s_uSlots[i] = s_uSlots[k];
+      s_uSlots[k] = uTmp;
+   }
+   for( int i=0; i<iAllocated; i++ )
+      packet_pool_free(&pool, s_uSlots[i]);
+   _check_true("all slots freed", 0 == pool.iUsedSlots);
+   _check_true("free slabs released down to the reserve", pool.iCountSlabs <= 2);
+
+   u32 uReleases = pool.uSlabReleases;
+   u16 uSlot = packet_pool_alloc(&pool);
+   packet_pool_free(&pool, uSlot);
+   packet_pool_free(&pool, uSlot);
+   _check_true("double free is ignored", (0 == pool.iUsedSlots) && (uReleases == pool.uSlabReleases));
+
+   packet_pool_set_reserve(&pool, 0);
+   _check_true("no slabs without reserve", 0 == pool.iCountSlabs);
+   packet_pool_uninit(&pool);
+}
+
+// Video tx: each new block takes its packets from the pool and gives back the block that just left the
+// retransmission window (twice the window at the video bitrate, as the tx buffer does).
+int _run_tx(u32 uBitrateBPS, int* piWindowBlocks)
+{
+   int iBlockBytes = TEST_DATA_PACKETS * TEST_VIDEO_DATA_LENGTH;
+   int iWindowBlocks = (int)(2 * (((u64)uBitrateBPS/8) * s_iWindowMs / 1000) / iBlockBytes) + TEST_MIN_WINDOW_BLOCKS;
+   if ( iWindowBlocks > MAX_RXTX_BLOCKS_BUFFER )
+      iWindowBlocks = MAX_RXTX_BLOCKS_BUFFER;
+   *piWindowBlocks = iWindowBlocks;
+
+   static u16 s_uBlockSlots[MAX_RXTX_BLOCKS_BUFFER][MAX_TOTAL_PACKETS_IN_BLOCK];
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
+      s_uBlockSlots[i][k] = PACKET_POOL_INVALID_SLOT;
+
+   t_packet_pool pool;
+   packet_pool_init(&pool, TEST_SLOT_SIZE, 2*MAX_TOTAL_PACKETS_IN_BLOCK);
+   int iMaxResident = 0;
+   u32 uSlabAllocationsWarm = 0;
+   for( int iBlock=0; iBlock<TEST_BLOCKS; iBlock++ )
+   {
+      int iBufferIndex = iBlock % MAX_RXTX_BLOCKS_BUFFER;
+      int iOldBufferIndex = (iBlock - iWindowBlocks + MAX_RXTX_BLOCKS_BUFFER) % MAX_RXTX_BLOCKS_BUFFER;
+      for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
+      {
+         packet_pool_free(&pool, s_uBlockSlots[iBufferIndex][k]);
+         s_uBlockSlots[iBufferIndex][k] = PACKET_POOL_INVALID_SLOT;
+         if ( iBlock >= iWindowBlocks )
+         {
+            packet_pool_free(&pool, s_uBlockSlots[iOldBufferIndex][k]);
+            s_uBlockSlots[iOldBufferIndex][k] = PACKET_POOL_INVALID_SLOT;
+         }
+      }
+      for( int k=0; k<TEST_DATA_PACKETS + TEST_EC_PACKETS; k++ )
+         s_uBlockSlots[iBufferIndex][k] = packet_pool_alloc(&pool);
+
+      if ( packet_pool_get_resident_bytes(&pool) > iMaxResident )
+         iMaxResident = packet_pool_get_resident_bytes(&pool);
+      if ( iBlock == 2*MAX_RXTX_BLOCKS_BUFFER )
+         uSlabAllocationsWarm = pool.uSlabAllocations;
+   }
+   _check_true("tx: no failed allocations", 0 == pool.uAllocFailures);
+   _check_true("tx: no slab churn once warm", pool.uSlabAllocations - uSlabAllocationsWarm <= 2);
+   _check_true("tx: packets held match the window", pool.iPeakUsedSlots <= (iWindowBlocks + 1) * (TEST_DATA_PACKETS + TEST_EC_PACKETS));
+   packet_pool_uninit(&pool);
+   return iMaxResident;
+}
+
+void _test_tx_scaling()
+{
+   int iStaticBytes = MAX_RXTX_BLOCKS_BUFFER * MAX_TOTAL_PACKETS_IN_BLOCK * (RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE);
+   u32 uBitrates[] = { 2000000, 6000000, 12000000, 24000000 };
+   int iPrevResident = 0;
+   log_line("Video tx, %d ms retransmission window, EC %d/%d, static buffers: %d kb", s_iWindowMs, TEST_DATA_PACKETS, TEST_EC_PACKETS, iStaticBytes/1024);
+   for( int i=0; i<(int)(sizeof(uBitrates)/sizeof(uBitrates[0])); i++ )
+   {
+      int iWindowBlocks = 0;
+      int iResident = _run_tx(uBitrates[i], &iWindowBlocks);
+      log_line("   %2u Mbps: %3d blocks kept, max resident: %5d kb (%.1f%% of static)",
+         uBitrates[i]/1000000, iWindowBlocks, iResident/1024, 100.0*(double)iResident/(double)iStaticBytes);
+      _check_true("tx: memory grows with the bitrate", iResident >= iPrevResident);
+      _check_true("tx: memory below the static buffers", iResident < iStaticBytes);
+      iPrevResident = iResident;
+   }
+}
+
+// Video rx: packets get a slot only when received, blocks give them back once outputed
+void _test_rx_loss()
+{
+   static u16 s_uBlockSlots[MAX_RXTX_BLOCKS_BUFFER][MAX_TOTAL_PACKETS_IN_BLOCK];
+   static u64 s_uReceivedMask[MAX_RXTX_BLOCKS_BUFFER];
+   memset(s_uReceivedMask, 0, sizeof(s_uReceivedMask));
+
+   t_packet_pool pool;
+   packet_pool_init(&pool, MAX_PACKET_TOTAL_SIZE, TEST_DATA_PACKETS + TEST_EC_PACKETS);
+   int iBlocksInBuffer = 6;
+   int iReceived = 0;
+   for( int iBlock=0; iBlock<TEST_BLOCKS; iBlock++ )
+   {
+      int iBufferIndex = iBlock % MAX_RXTX_BLOCKS_BUFFER;
+      for( int k=0; k<TEST_DATA_PACKETS + TEST_EC_PACKETS; k++ )
+      {
+         if ( _random(&s_uRandomState, 100) < 10 )
+            continue;
+         s_uBlockSlots[iBufferIndex][k] = packet_pool_alloc(&pool);
+         s_uReceivedMask[iBufferIndex] |= ((u64)1) << k;
+         iReceived++;
+      }
+      if ( iBlock >= iBlocksInBuffer )
+      {
+         int iOutputIndex = (iBlock - iBlocksInBuffer) % MAX_RXTX_BLOCKS_BUFFER;
+         u64 uMask = s_uReceivedMask[iOutputIndex];
+         while ( uMask )
+         {
+            int k = __builtin_ctzll(uMask);
+            uMask &= uMask - 1;
+            packet_pool_free(&pool, s_uBlockSlots[iOutputIndex][k]);
+         }
+         s_uReceivedMask[iOutputIndex] = 0;
+      }
+   }
+   log_line("Video rx, 10%% loss, %d blocks in buffer: peak %d packets held, %d kb resident at the end",
+      iBlocksInBuffer, pool.iPeakUsedSlots, packet_pool_get_resident_bytes(&pool)/1024);
+   _check_true("rx: no failed allocations", 0 == pool.uAllocFailures);
+   _check_true("rx: packets held follow the blocks in buffer", pool.iPeakUsedSlots <= (iBlocksInBuffer+1) * (TEST_DATA_PACKETS + TEST_EC_PACKETS));
+   _check_true("rx: some packets were received", iReceived > 0);
+   packet_pool_uninit(&pool);
+}
+
+// Layout of the rx blocks before the pool: a struct per packet
+typedef struct
+{
+   t_packet_header* pPH;
+   t_packet_header_video_full_98* pPHVF;
+   u8* pVideoData;
+   u8* pRawData;
+   u32 uReceivedTime;
+   u32 uRequestedTime;
+   bool bEndOfFirstIFrameDetected;
+   bool bEmpty;
+   bool bOutputed;
+} type_old_packet_info;
+
+typedef struct
+{
+   type_old_packet_info packets[MAX_TOTAL_PACKETS_IN_BLOCK];
+   int iBlockDataPackets;
+} type_old_block_info;
+
+typedef struct
+{
+   int iBlockDataPackets;
+   u64 uReceivedMask;
+   u16 uPacketSlots[MAX_TOTAL_PACKETS_IN_BLOCK];
+} type_new_block_info;
+
+void _bench_missing_scan()
+{
+   static type_old_block_info s_OldBlocks[MAX_RXTX_BLOCKS_BUFFER];
+   static type_new_block_info s_NewBlocks[MAX_RXTX_BLOCKS_BUFFER];
+   static u8 s_uDummy[1];
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   {
+      s_OldBlocks[i].iBlockDataPackets = TEST_DATA_PACKETS;
+      s_NewBlocks[i].iBlockDataPackets = TEST_DATA_PACKETS;
+      s_NewBlocks[i].uReceivedMask = 0;
+      for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
+      {
+         bool bReceived = (_random(&s_uRandomState, 100) >= 10);
+         s_OldBlocks[i].packets[k].pRawData = s_uDummy;
+         s_OldBlocks[i].packets[k].bEmpty = ! bReceived;
+         if ( bReceived )
+            s_NewBlocks[i].uReceivedMask |= ((u64)1) << k;
+      }
+   }
+
+   int iRounds = 2000;
+   int iMissingOld = 0;
+   int iMissingNew = 0;
+   u64 uTimeStart = get_current_timestamp_micros();
+   for( int r=0; r<iRounds; r++ )
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   for( int k=0; k<s_OldBlocks[i].iBlockDataPackets; k++ )
+   {
+      if ( NULL == s_OldBlocks[i].packets[k].pRawData )
+         continue;
+      if ( s_OldBlocks[i].packets[k].bEmpty )
+         iMissingOld++;
+   }
+   u64 uTimeOld = get_current_timestamp_micros() - uTimeStart;
+
+   uTimeStart = get_current_timestamp_micros();
+   for( int r=0; r<iRounds; r++ )
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   {
+      u64 uDataMask = (((u64)1) << s_NewBlocks[i].iBlockDataPackets) - 1;
+      iMissingNew += __builtin_popcountll(uDataMask & (~s_NewBlocks[i].uReceivedMask));
+   }
+   u64 uTimeNew = get_current_timestamp_micros() - uTimeStart;
+
+   _check_true("bench: same missing packets found", iMissingOld == iMissingNew);
+   log_line("Missing packets scan of %d blocks: per packet structs: %.3f us, bitmaps: %.3f us; block metadata: %d bytes -> %d bytes",
+      MAX_RXTX_BLOCKS_BUFFER, (double)uTimeOld/(double)iRounds, (double)uTimeNew/(double)iRounds,
+      (int)sizeof(type_old_block_info), (int)sizeof(type_new_block_info));
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestPacketPool");
+   log_enable_stdout();
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-seed")) && (i+1 < argc) )
+         s_uRandomState = (u64)atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-window")) && (i+1 < argc) )
+         s_iWindowMs = atoi(argv[++i]);
+   }
+   if ( s_uRandomState == 0 )
+      s_uRandomState = 1;
+   if ( s_iWindowMs < 5 )
+      s_iWindowMs = 5;
+
+   _test_alloc_free();
+   _test_tx_scaling();
+   _test_rx_loss();
+   _bench_missing_scan();
+
+   log_line("Packet pool tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,308 @@
+#include <pthread.h>
+#include <sys/mman.h>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/shared_mem.h"
+#include "../base/profiler.h"
+
+// Checks the router tracepoints: events and histograms written to the per thread rings, the reader
+// while the rings wrap and while threads write concurrently, and the cost of a tracepoint.
+// Usage: test_profiler [-count n]
+
+#define TEST_SHARED_MEM_PROFILER "/SYSTEM_SHARED_MEM_PROFILER_TEST"
+
+int s_iFailed = 0;
+int s_iThreadEvents = 200000;
+volatile int s_iThreadsDone = 0;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+void _test_histogram()
+{
+   _check_true("bucket of 0 us", 0 == profiler_get_histogram_bucket(0));
+   _check_true("bucket of 1 us", 1 == profiler_get_histogram_bucket(1));
+   _check_true("bucket of 3 us", 2 == profiler_get_histogram_bucket(3));
+   _check_true("bucket of 4 us", 3 == profiler_get_histogram_bucket(4));
+   _check_true("bucket of 1000 us", 10 == profiler_get_histogram_bucket(1000));
+   _check_true("last bucket", (PROFILER_HISTOGRAM_BUCKETS-1) == profiler_get_histogram_bucket(0xFFFFFFFF));
+
+   t_profiler_histogram hist;
+   memset(&hist, 0, sizeof(hist));
+   _check_true("percentile of empty histogram", 0 == profiler_get_histogram_percentile(&hist, 50));
+   // 90 values of 5 us, 9 of 100 us, 1 of 3000 us
+   hist.uBuckets[profiler_get_histogram_bucket(5)] = 90;
+   hist.uBuckets[profiler_get_histogram_bucket(100)] = 9;
+   hist.uBuckets[profiler_get_histogram_bucket(3000)] = 1;
+   hist.uMaxMicros = 3000;
+   _check_true("p50", 8 == profiler_get_histogram_percentile(&hist, 50));
+   _check_true("p90", 8 == profiler_get_histogram_percentile(&hist, 90));
+   _check_true("p99", 128 == profiler_get_histogram_percentile(&hist, 99));
+   _check_true("p100 is the max", 3000 == profiler_get_histogram_percentile(&hist, 100));
+}
+
+void _test_events(shared_mem_profiler* pReader)
+{
+   PROFILER_BEGIN(PROFILER_SECTION_LOOP);
+   PROFILER_END(PROFILER_SECTION_LOOP);
+   _check_true("no events before the thread is registered", 0 == pReader->iThreadsCount);
+
+   _check_true("register main thread", 0 == profiler_register_thread("main"));
+   _check_true("register again keeps the slot", 0 == profiler_register_thread("main"));
+   _check_true("reader sees the thread", (1 == pReader->iThreadsCount) && (0 == strcmp(pReader->threads[0].szName, "main")));
+   _check_true("reader sees the section names", 0 == strcmp(pReader->szSectionNames[PROFILER_SECTION_RADIO_TX], "radio_tx"));
+
+   PROFILER_END(PROFILER_SECTION_IPC);
+   _check_true("end without begin is ignored", 0 == pReader->threads[0].uWriteIndex);
+
+   for( int i=0; i<100; i++ )
+   {
+      PROFILER_BEGIN(PROFILER_SECTION_LOOP);
+      PROFILER_BEGIN(PROFILER_SECTION_RADIO_RX);
+      hardware_sleep_micros(20);
+      PROFILER_END(PROFILER_SECTION_RADIO_RX);
+      PROFILER_BEGIN(PROFILER_SECTION_RADIO_TX);
+      PROFILER_END(PROFILER_SECTION_RADIO_TX);
+      PROFILER_END(PROFILER_SECTION_LOOP);
+   }
+
+   static t_profiler_event s_Events[PROFILER_RING_SIZE];
+   u32 uReadIndex = 0;
+   u32 uLost = 0;
+   int iCount = profiler_read_thread_events(pReader, 0, &uReadIndex, s_Events, &uLost);
+   _check_true("read all events", (300 == iCount) && (0 == uLost) && (300 == uReadIndex));
+
+   int iBadOrder = 0;
+   int iBadNesting = 0;
+   for( int i=0; i+2<iCount; i+=3 )
+   {
+      t_profiler_event* pRx = &s_Events[i];
+      t_profiler_event* pTx = &s_Events[i+1];
+      t_profiler_event* pLoop = &s_Events[i+2];
+      if ( (PROFILER_SECTION_RADIO_RX != pRx->uSection) || (PROFILER_SECTION_RADIO_TX != pTx->uSection) || (PROFILER_SECTION_LOOP != pLoop->uSection) )
+         iBadOrder++;
+      if ( (pRx->uStartTimeNs < pLoop->uStartTimeNs) || (pTx->uStartTimeNs + pTx->uDurationNs > pLoop->uStartTimeNs + pLoop->uDurationNs) ||
+           (pTx->uStartTimeNs < pRx->uStartTimeNs + pRx->uDurationNs) )
+         iBadNesting++;
+   }
+   _check_true("events in order", 0 == iBadOrder);
+   _check_true("nested sections inside the loop section", 0 == iBadNesting);
+   _check_true("nothing more to read", 0 == profiler_read_thread_events(pReader, 0, &uReadIndex, s_Events, &uLost));
+
+   t_profiler_histogram hist;
+   profiler_get_section_histogram(pReader, PROFILER_SECTION_RADIO_RX, &hist);
+   _check_true("histogram count", 100 == hist.uCount);
+   _check_true("histogram min duration", (hist.uTotalMicros >= 100*20) && (profiler_get_histogram_percentile(&hist, 50) >= 16));
+   profiler_get_section_histogram(pReader, PROFILER_SECTION_IPC, &hist);
+   _check_true("no histogram for unused section", 0 == hist.uCount);
+
+   // Ring wraps while nobody reads
+   int iWritten = 2*PROFILER_RING_SIZE + 10;
+   for( int i=0; i<iWritten; i++ )
+   {
+      PROFILER_BEGIN(PROFILER_SECTION_STATS);
+      PROFILER_END(PROFILER_SECTION_STATS);
+   }
+   iCount = profiler_read_thread_events(pReader, 0, &uReadIndex, s_Events, &uLost);
+   _check_true("read the last ring of events", PROFILER_RING_SIZE-1 == iCount);
+   _check_true("count the overwritten events", (u32)(iWritten - PROFILER_RING_SIZE + 1) == uLost);
+   int iNotStats = 0;
+   for( int i=0; i<iCount; i++ )
+   {
+      if ( PROFILER_SECTION_STATS != s_Events[i].uSection )
+         iNotStats++;
+      if ( (i > 0) && (s_Events[i].uStartTimeNs < s_Events[i-1].uStartTimeNs) )
+         iNotStats++;
+   }
+   _check_true("wrapped ring holds the newest events", 0 == iNotStats);
+}
+
+static void* _thread_writer(void* pArg)
+{
+   int iSection = *(int*)pArg;
+   char szName[32];
+   sprintf(szName, "writer_%d", iSection);
+   profiler_register_thread(szName);
+   for( int i=0; i<s_iThreadEvents; i++ )
+   {
+      profiler_begin(iSection);
+      profiler_end(iSection);
+   }
+   __sync_fetch_and_add(&s_iThreadsDone, 1);
+   return NULL;
+}
+
+void _test_concurrent_writers(shared_mem_profiler* pReader)
+{
+   static t_profiler_event s_Events[PROFILER_RING_SIZE];
+   int iSections[2] = { PROFILER_SECTION_VIDEO_TX, PROFILER_SECTION_CAMERA_READ };
+   pthread_t threads[2];
+   s_iThreadsDone = 0;
+   for( int i=0; i<2; i++ )
+      pthread_create(&threads[i], NULL, &_thread_writer, &iSections[i]);
+
+   u32 uReadIndex[PROFILER_MAX_THREADS];
+   u32 uLost[PROFILER_MAX_THREADS];
+   u32 uRead[PROFILER_MAX_THREADS];
+   u64 uLastStart[PROFILER_MAX_THREADS];
+   int iBad = 0;
+   memset(uReadIndex, 0, sizeof(uReadIndex));
+   memset(uLost, 0, sizeof(uLost));
+   memset(uRead, 0, sizeof(uRead));
+   memset(uLastStart, 0, sizeof(uLastStart));
+
+   bool bDone = false;
+   while ( ! bDone )
+   {
+      // Read once more after the writers finished
+      bDone = (2 == s_iThreadsDone);
+      int iThreads = __atomic_load_n(&pReader->iThreadsCount, __ATOMIC_ACQUIRE);
+      for( int t=1; t<iThreads; t++ )
+      {
+         int iCount = profiler_read_thread_events(pReader, t, &uReadIndex[t], s_Events, &uLost[t]);
+         int iExpectedSection = (0 == strcmp(pReader->threads[t].szName, "writer_4"))?PROFILER_SECTION_VIDEO_TX:PROFILER_SECTION_CAMERA_READ;
+         for( int i=0; i<iCount; i++ )
+         {
+            if ( s_Events[i].uSection != iExpectedSection )
+               iBad++;
+            if ( s_Events[i].uStartTimeNs < uLastStart[t] )
+               iBad++;
+            uLastStart[t] = s_Events[i].uStartTimeNs;
+         }
+         uRead[t] += iCount;
+      }
+      hardware_sleep_micros(500);
+   }
+   for( int i=0; i<2; i++ )
+      pthread_join(threads[i], NULL);
+
+   _check_true("writer threads registered", 3 == pReader->iThreadsCount);
+   for( int t=1; t<3; t++ )
+   {
+      log_line("Thread %s: %u events read, %u lost", pReader->threads[t].szName, uRead[t], uLost[t]);
+      _check_true("every event is read or counted as lost", (u32)s_iThreadEvents == uRead[t] + uLost[t]);
+   }
+   _check_true("concurrent reads return valid events only", 0 == iBad);
+}
+
+static void* _thread_restarted(void* pArg)
+{
+   *(int*)pArg = profiler_register_thread("radio_rx");
+   PROFILER_BEGIN(PROFILER_SECTION_RX_THREAD_READ);
+   PROFILER_END(PROFILER_SECTION_RX_THREAD_READ);
+   profiler_unregister_thread();
+   return NULL;
+}
+
+// A thread stopped and started again (radio links reconfiguration) keeps using the same slot
+void _test_thread_restarts(shared_mem_profiler* pReader)
+{
+   int iRestarts = PROFILER_MAX_THREADS + 2;
+   int iFirstSlot = -2;
+   int iSameSlot = 0;
+   for( int i=0; i<iRestarts; i++ )
+   {
+      int iSlot = -2;
+      pthread_t thread;
+      pthread_create(&thread, NULL, &_thread_restarted, &iSlot);
+      pthread_join(thread, NULL);
+      if ( 0 == i )
+         iFirstSlot = iSlot;
+      if ( (iSlot >= 0) && (iSlot == iFirstSlot) )
+         iSameSlot++;
+   }
+   _check_true("restarted thread registered", iFirstSlot >= 0);
+   _check_true("restarted thread reuses its slot", iRestarts == iSameSlot);
+   if ( iFirstSlot < 0 )
+      return;
+   _check_true("restarted thread events kept", (u32)iRestarts == pReader->threads[iFirstSlot].uWriteIndex);
+   _check_true("restarted thread histogram kept", (u32)iRestarts == pReader->threads[iFirstSlot].histograms[PROFILER_SECTION_RX_THREAD_READ].uCount);
+   _check_true("restarted thread slot free after exit", 0 == pReader->threads[iFirstSlot].iRegistered);
+}
+
+static void* _thread_register(void* pArg)
+{
+   *(int*)pArg = profiler_register_thread("extra");
+   return NULL;
+}
+
+// Runs after _test_thread_restarts: the free slot it left is given to a thread with another name
+void _test_thread_slots(shared_mem_profiler* pReader)
+{
+   int iSlots[2] = { -2, -2 };
+   for( int i=0; i<2; i++ )
+   {
+      pthread_t thread;
+      pthread_create(&thread, NULL, &_thread_register, &iSlots[i]);
+      pthread_join(thread, NULL);
+   }
+   _check_true("last free slot given", (PROFILER_MAX_THREADS-1) == iSlots[0]);
+   _check_true("free slot renamed", 0 == strcmp(pReader->threads[PROFILER_MAX_THREADS-1].szName, "extra"));
+   _check_true("no slot when all are used", -1 == iSlots[1]);
+}
+
+void _bench_tracepoint()
+{
+   int iCount = 1000000;
+   u64 uStart = profiler_get_time_ns();
+   for( int i=0; i<iCount; i++ )
+   {
+      PROFILER_BEGIN(PROFILER_SECTION_PERIODIC);
+      PROFILER_END(PROFILER_SECTION_PERIODIC);
+   }
+   u64 uTime = profiler_get_time_ns() - uStart;
+
+   uStart = profiler_get_time_ns();
+   for( int i=0; i<iCount; i++ )
+      profiler_get_time_ns();
+   u64 uTimeClock = profiler_get_time_ns() - uStart;
+
+   log_line("Traced section (begin + end): %.1f ns, of which clock reads: %.1f ns", (double)uTime/(double)iCount, 2.0*(double)uTimeClock/(double)iCount);
+   _check_true("traced section cost", uTime/iCount < 5000);
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestProfiler");
+   log_enable_stdout();
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-count")) && (i+1 < argc) )
+         s_iThreadEvents = atoi(argv[++i]);
+   }
+   if ( s_iThreadEvents < 1 )
+      s_iThreadEvents = 1;
+
+   _test_histogram();
+
+   if ( ! profiler_init(TEST_SHARED_MEM_PROFILER) )
+   {
+      log_line("Failed to init the profiler shared mem.");
+      log_line("Profiler tests: FAILED");
+      return 1;
+   }
+   shared_mem_profiler* pReader = shared_mem_profiler_open_for_read(TEST_SHARED_MEM_PROFILER);
+   _check_true("open for read", NULL != pReader);
+   if ( NULL != pReader )
+   {
+      _check_true("shared mem version", PROFILER_SHARED_MEM_VERSION == pReader->uVersion);
+      _test_events(pReader);
+      _test_concurrent_writers(pReader);
+      _test_thread_restarts(pReader);
+      _test_thread_slots(pReader);
+      _bench_tracepoint();
+      shared_mem_profiler_close(pReader);
+   }
+   profiler_uninit();
+   shm_unlink(TEST_SHARED_MEM_PROFILER);
+
+   log_line("Profiler tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
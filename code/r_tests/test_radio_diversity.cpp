@@ -0,0 +1,237 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radio_duplicate_det.h"
+#include "../radio/radio_diversity.h"
+
+// Simulates a vehicle video stream received by several radio cards with different loss, signal
+// and latency, passed through the duplicate detection and the receive diversity, as the radio rx
+// thread does. Checks the cards scores and read order, and the rescued packets counters.
+
+extern u32 s_uRadioRxTimeNow;
+
+#define SIM_CARDS 3
+#define SIM_VEHICLE_ID 1234567
+// Packets in flight, must be more than the largest card lag (one packet each ms)
+#define SIM_RING_SIZE 64
+
+int s_iFailed = 0;
+u64 s_uRandomState = 1;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u32 _random_per_thousand()
+{
+   s_uRandomState ^= s_uRandomState >> 12;
+   s_uRandomState ^= s_uRandomState << 25;
+   s_uRandomState ^= s_uRandomState >> 27;
+   return (u32)(((s_uRandomState * 2685821657736338717ULL) >> 32) % 1000);
+}
+
+typedef struct
+{
+   int iLossPerThousand;
+   int iBadFramesPerThousand;
+   int iDbm;
+   u32 uLagMs;
+} t_sim_card;
+
+u32 s_uTimeNow = 10000;
+u32 s_uStreamPacketIndex = 0;
+u32 s_uExpectedRescued[SIM_CARDS];
+
+void _receive(int iCard, u32 uStreamPacketIndex)
+{
+   u8 uPacket[sizeof(t_packet_header)];
+   memset(uPacket, 0, sizeof(uPacket));
+   t_packet_header* pPH = (t_packet_header*)uPacket;
+   pPH->packet_flags = PACKET_COMPONENT_VIDEO;
+   pPH->packet_type = PACKET_TYPE_VIDEO_DATA_98;
+   pPH->vehicle_id_src = SIM_VEHICLE_ID;
+   pPH->stream_packet_idx = (STREAM_ID_VIDEO_1 << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX) | (uStreamPacketIndex & PACKET_FLAGS_MASK_STREAM_PACKET_IDX);
+   pPH->total_length = sizeof(t_packet_header);
+
+   s_uRadioRxTimeNow = s_uTimeNow;
+   int iIsDuplicate = radio_dup_detection_is_duplicate(iCard, uPacket, sizeof(uPacket), s_uTimeNow);
+   radio_diversity_on_rx_packet(iCard, uPacket, sizeof(uPacket), iIsDuplicate, s_uTimeNow);
+}
+
+// One packet each ms; each card gets its copy uLagMs later
+void _simulate(t_sim_card* pCards, u32 uDurationMs)
+{
+   // For each packet in flight: bit 0..7 good copy on card, bit 8..15 bad frame on card
+   u32 uRing[SIM_RING_SIZE];
+   u32 uRingIndex[SIM_RING_SIZE];
+   memset(uRing, 0, sizeof(uRing));
+   for( int i=0; i<SIM_RING_SIZE; i++ )
+      uRingIndex[i] = MAX_U32;
+
+   for( u32 uTick=0; uTick<uDurationMs+SIM_RING_SIZE; uTick++ )
+   {
+      s_uTimeNow++;
+      if ( uTick < uDurationMs )
+      {
+         u32 uIndex = s_uStreamPacketIndex++;
+         u32 uMask = 0;
+         u32 uMinLag = MAX_U32;
+         int iCountListening = 0;
+         for( int i=0; i<SIM_CARDS; i++ )
+         {
+            if ( pCards[i].iLossPerThousand < 1000 )
+               iCountListening++;
+            if ( (int)_random_per_thousand() < pCards[i].iLossPerThousand )
+               continue;
+            if ( (int)_random_per_thousand() < pCards[i].iBadFramesPerThousand )
+               uMask |= 1<<(8+i);
+            else
+            {
+               uMask |= 1<<i;
+               if ( pCards[i].uLagMs < uMinLag )
+                  uMinLag = pCards[i].uLagMs;
+            }
+         }
+         // Rescued: the only card with a copy within the window of the first copy
+         int iCountInWindow = 0;
+         int iCardInWindow = -1;
+         for( int i=0; i<SIM_CARDS; i++ )
+         {
+            if ( (uMask & (1<<i)) && (pCards[i].uLagMs - uMinLag <= RADIO_DIVERSITY_WINDOW_MS) )
+            {
+               iCountInWindow++;
+               iCardInWindow = i;
+            }
+         }
+         if ( (1 == iCountInWindow) && (iCountListening > 1) )
+            s_uExpectedRescued[iCardInWindow]++;
+         uRing[uTick % SIM_RING_SIZE] = uMask;
+         uRingIndex[uTick % SIM_RING_SIZE] = uIndex;
+      }
+      else
+      {
+         uRing[uTick % SIM_RING_SIZE] = 0;
+         uRingIndex[uTick % SIM_RING_SIZE] = MAX_U32;
+      }
+
+      for( int i=0; i<SIM_CARDS; i++ )
+      {
+         if ( uTick < pCards[i].uLagMs )
+            continue;
+         u32 uSlot = (uTick - pCards[i].uLagMs) % SIM_RING_SIZE;
+         if ( MAX_U32 == uRingIndex[uSlot] )
+            continue;
+         if ( uRing[uSlot] & (1<<(8+i)) )
+            radio_diversity_on_rx_frame(i, 0, pCards[i].iDbm, s_uTimeNow);
+         if ( uRing[uSlot] & (1<<i) )
+         {
+            radio_diversity_on_rx_frame(i, 1, pCards[i].iDbm, s_uTimeNow);
+            _receive(i, uRingIndex[uSlot]);
+         }
+      }
+      radio_diversity_periodic_update(s_uTimeNow);
+   }
+   // Let all tracked packets expire
+   s_uTimeNow += RADIO_DIVERSITY_SCORE_INTERVAL_MS + RADIO_DIVERSITY_WINDOW_MS;
+   radio_diversity_periodic_update(s_uTimeNow);
+}
+
+void _reset()
+{
+   radio_duplicate_detection_init();
+   radio_diversity_init();
+   s_uStreamPacketIndex = 0;
+   s_uTimeNow += 10000;
+   memset(s_uExpectedRescued, 0, sizeof(s_uExpectedRescued));
+}
+
+void _log_cards(const char* szScenario)
+{
+   log_line("%s:", szScenario);
+   for( int i=0; i<SIM_CARDS; i++ )
+   {
+      t_radio_diversity_card_stats* pCard = radio_diversity_get_card_stats(i);
+      log_line("   card %d: score %4d, delivered %4d/1000, bad frames %4d/1000, %d dbm, lag %d ms, first copies %u, rescued %u (expected %u), late copies %u",
+         i+1, pCard->iScore, pCard->iDeliveryPerThousand, pCard->iFrameErrorsPerThousand, pCard->iDbm, pCard->iAvgLagMs,
+         pCard->uTotalFirstCopies, pCard->uTotalRescuedPackets, s_uExpectedRescued[i], pCard->uTotalLateCopies);
+   }
+}
+
+void _check_rescued(const char* szScenario)
+{
+   char szTest[128];
+   for( int i=0; i<SIM_CARDS; i++ )
+   {
+      snprintf(szTest, sizeof(szTest), "%s: rescued packets on card %d", szScenario, i+1);
+      _check_true(szTest, radio_diversity_get_card_stats(i)->uTotalRescuedPackets == s_uExpectedRescued[i]);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestRadioDiversity");
+   log_enable_stdout();
+
+   // Three cards of different quality
+   _reset();
+   t_sim_card cards[SIM_CARDS] =
+   {
+      { 20,  0, -50, 0 },
+      { 150, 20, -72, 3 },
+      { 400, 100, -86, 8 }
+   };
+   _simulate(cards, 10000);
+   _log_cards("Good, average and poor cards");
+   _check_true("Scores follow the cards quality", (radio_diversity_get_card_score(0) > radio_diversity_get_card_score(1)) && (radio_diversity_get_card_score(1) > radio_diversity_get_card_score(2)));
+   _check_true("Read order follows the scores", (radio_diversity_get_rx_order()[0] == 0) && (radio_diversity_get_rx_order()[1] == 1) && (radio_diversity_get_rx_order()[2] == 2));
+   _check_true("Good card delivers almost all packets", radio_diversity_get_card_stats(0)->iDeliveryPerThousand >= 950);
+   _check_rescued("Three cards");
+   _check_true("Good card rescues the most packets", radio_diversity_get_card_stats(0)->uTotalRescuedPackets > radio_diversity_get_card_stats(1)->uTotalRescuedPackets);
+   _check_true("Poor card still rescues packets", radio_diversity_get_card_stats(2)->uTotalRescuedPackets > 0);
+
+   // The best card degrades and the poor one gets better: the order follows
+   cards[0].iLossPerThousand = 500;
+   cards[0].iDbm = -85;
+   cards[2].iLossPerThousand = 10;
+   cards[2].iBadFramesPerThousand = 0;
+   cards[2].iDbm = -45;
+   cards[2].uLagMs = 0;
+   _simulate(cards, 5000);
+   _log_cards("Cards quality swapped");
+   _check_true("Best card changes when the link changes", radio_diversity_get_rx_order()[0] == 2);
+   _check_rescued("Cards quality swapped");
+
+   // Single card receiving: nothing is rescued, other cards have no score
+   _reset();
+   t_sim_card cardsSingle[SIM_CARDS] =
+   {
+      { 50,  0,  -60, 0 },
+      { 1000, 0, -60, 0 },
+      { 1000, 0, -60, 0 }
+   };
+   _simulate(cardsSingle, 3000);
+   _log_cards("Single card");
+   _check_rescued("Single card");
+   _check_true("No score for silent cards", (radio_diversity_get_card_score(0) >= 0) && (radio_diversity_get_card_score(1) < 0) && (radio_diversity_get_card_score(2) < 0));
+
+   // Copies arriving after the window are late and do not count as delivered
+   _reset();
+   t_sim_card cardsLate[SIM_CARDS] =
+   {
+      { 30, 0, -60, 0 },
+      { 30, 0, -60, RADIO_DIVERSITY_WINDOW_MS + 10 },
+      { 1000, 0, -60, 0 }
+   };
+   _simulate(cardsLate, 3000);
+   _log_cards("Late card");
+   _check_true("Late copies counted", radio_diversity_get_card_stats(1)->uTotalLateCopies > 2000);
+   _check_true("Late card scores lower", radio_diversity_get_card_score(1) < radio_diversity_get_card_score(0));
+   _check_rescued("Late card");
+
+   log_line("Radio diversity tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
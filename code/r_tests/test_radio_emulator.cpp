@@ -0,0 +1,592 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware_radio.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radioflags.h"
+#include "../radio/radiolink.h"
+#include "../radio/radio_emulator.h"
+#include "../radio/fec.h"
+
+#include <sys/select.h>
+#include <sys/wait.h>
+
+// Runs a vehicle (video sender) process and a controller (receiver) process over the emulated
+// radio medium, using the regular radiolink.c tx/rx path and the video FEC, and reports for each
+// link scenario: the recovered video blocks, the capture to decode latency and the CPU used by each process.
+// Optionally also reports the CPU used by other processes on the same medium (i.e. ruby_rt_vehicle, ruby_rt_station).
+//
+// test_radio_emulator                       run the default scenarios and checks
+// test_radio_emulator [options]             run one scenario:
+//    -blocks n -data n -fec n -size bytes -kbps n -mcs n
+//    -seed n -loss n -burst enter exit loss -latency us -jitter us -noairtime
+//    -record file.pcap -replay file.pcap -pid pid
+
+#define BENCH_FREQUENCY_KHZ 5805000
+#define BENCH_MAX_PACKETS_IN_BLOCK 32
+#define BENCH_BLOCKS_RING 64
+#define BENCH_END_BLOCK 0xFFFFFFFF
+#define BENCH_MAX_PIDS 8
+
+typedef struct
+{
+   u32 uBlockIndex;
+   u8 uPacketIndex;
+   u8 uDataPackets;
+   u8 uFECPackets;
+   u8 uReserved;
+   u64 uCaptureTimeMicros;
+} __attribute__((packed)) t_bench_packet_info;
+
+typedef struct
+{
+   const char* szName;
+   int iBlocks;
+   int iDataPackets;
+   int iFECPackets;
+   int iPacketSize;
+   int iVideoKbps;
+   int iDataRate;
+   t_radio_emulator_params emulatorParams;
+   char szReplayFile[MAX_FILE_PATH_SIZE];
+} t_bench_scenario;
+
+typedef struct
+{
+   int iBlocksRecovered;
+   int iBlocksRecoveredWithFEC;
+   int iBlocksCorrupted;
+   int iPacketsReceived;
+   int iPacketsBadCRC;
+   u32 uLatencyAvgMicros;
+   u32 uLatencyP50Micros;
+   u32 uLatencyP95Micros;
+   u32 uLatencyMaxMicros;
+   u32 uCPUMs;
+} t_bench_rx_result;
+
+typedef struct
+{
+   u32 uBlockIndex;
+   u32 uReceivedMask;
+   int iReceived;
+   int bDone;
+   u64 uCaptureTimeMicros;
+   u8* pPackets[BENCH_MAX_PACKETS_IN_BLOCK];
+} t_bench_rx_block;
+
+int s_iFailed = 0;
+int s_iCountPids = 0;
+int s_iPids[BENCH_MAX_PIDS];
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u64 _now_micros()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return ((u64)t.tv_sec)*1000000LL + ((u64)t.tv_nsec)/1000LL;
+}
+
+// CPU time (user + system) used so far by a process, from /proc/<pid>/stat
+
+u32 _get_process_cpu_ms(int iPid)
+{
+   char szFile[64];
+   char szBuff[1024];
+   sprintf(szFile, "/proc/%d/stat", iPid);
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+      return 0;
+   int iRead = fread(szBuff, 1, sizeof(szBuff)-1, fd);
+   fclose(fd);
+   if ( iRead <= 0 )
+      return 0;
+   szBuff[iRead] = 0;
+
+   // Fields after the process name: state is field 3, utime is 14, stime is 15
+   char* pPos = strrchr(szBuff, ')');
+   if ( NULL == pPos )
+      return 0;
+   unsigned long uUserTicks = 0, uSystemTicks = 0;
+   if ( 2 != sscanf(pPos + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &uUserTicks, &uSystemTicks) )
+      return 0;
+   long lTicksPerSec = sysconf(_SC_CLK_TCK);
+   if ( lTicksPerSec <= 0 )
+      lTicksPerSec = 100;
+   return (u32)((uUserTicks + uSystemTicks) * 1000 / lTicksPerSec);
+}
+
+u8 _get_pattern_byte(u32 uBlockIndex, int iPacketIndex, int iByte)
+{
+   return (u8)(uBlockIndex*13 + iPacketIndex*7 + iByte);
+}
+
+int _open_emulated_interface()
+{
+   // The receiver processes are forked from the sender, so they get its radio interfaces too
+   static int s_bAddedEmulatedRadio = 0;
+   if ( ! s_bAddedEmulatedRadio )
+      hardware_radio_add_emulated_radios(1);
+   s_bAddedEmulatedRadio = 1;
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(0);
+   if ( NULL == pRadioHWInfo )
+      return 0;
+   pRadioHWInfo->uCurrentFrequencyKhz = BENCH_FREQUENCY_KHZ;
+   return 1;
+}
+
+int _compare_u32(const void* pA, const void* pB)
+{
+   u32 uA = *(const u32*)pA;
+   u32 uB = *(const u32*)pB;
+   return (uA > uB) - (uA < uB);
+}
+
+// Returns 1 if the block was recovered, -1 if the recovered data is wrong
+
+int _decode_block(t_bench_scenario* pScenario, t_bench_rx_block* pBlock, t_bench_rx_result* pResult)
+{
+   int iHeaders = sizeof(t_packet_header) + sizeof(t_bench_packet_info);
+   int iFECSize = pScenario->iPacketSize - iHeaders;
+   int iDataPackets = pScenario->iDataPackets;
+
+   unsigned int uErased[BENCH_MAX_PACKETS_IN_BLOCK];
+   unsigned int uFECIndexes[BENCH_MAX_PACKETS_IN_BLOCK];
+   u8* pDataBlocks[BENCH_MAX_PACKETS_IN_BLOCK];
+   u8* pFECBlocks[BENCH_MAX_PACKETS_IN_BLOCK];
+   int iCountErased = 0;
+   for( int i=0; i<iDataPackets; i++ )
+   {
+      pDataBlocks[i] = pBlock->pPackets[i] + iHeaders;
+      if ( ! (pBlock->uReceivedMask & (1<<i)) )
+         uErased[iCountErased++] = i;
+   }
+
+   if ( iCountErased > 0 )
+   {
+      int iCountFEC = 0;
+      for( int i=0; (i<pScenario->iFECPackets) && (iCountFEC < iCountErased); i++ )
+      {
+         if ( ! (pBlock->uReceivedMask & (1<<(iDataPackets+i))) )
+            continue;
+         uFECIndexes[iCountFEC] = i;
+         pFECBlocks[iCountFEC] = pBlock->pPackets[iDataPackets+i] + iHeaders;
+         iCountFEC++;
+      }
+      fec_decode(iFECSize, pDataBlocks, iDataPackets, pFECBlocks, uFECIndexes, uErased, iCountErased);
+      pResult->iBlocksRecoveredWithFEC++;
+   }
+
+   for( int i=0; i<iCountErased; i++ )
+   for( int k=0; k<iFECSize; k++ )
+   {
+      if ( pDataBlocks[uErased[i]][k] != _get_pattern_byte(pBlock->uBlockIndex, uErased[i], k) )
+         return -1;
+   }
+   return 1;
+}
+
+void _run_receiver(t_bench_scenario* pScenario, int iPipeReady, int iPipeResult)
+{
+   t_bench_rx_result result;
+   memset(&result, 0, sizeof(result));
+
+   radio_init_link_structures();
+   int iSocket = -1;
+   if ( _open_emulated_interface() )
+      iSocket = radio_open_interface_for_read(0, RADIO_PORT_ROUTER_DOWNLINK);
+   u8 uReady = (iSocket >= 0)?1:0;
+   write(iPipeReady, &uReady, 1);
+   if ( iSocket < 0 )
+      exit(1);
+
+   t_bench_rx_block* pBlocks = (t_bench_rx_block*) malloc(BENCH_BLOCKS_RING*sizeof(t_bench_rx_block));
+   u32* pLatencies = (u32*) malloc((pScenario->iBlocks+1)*sizeof(u32));
+   for( int i=0; i<BENCH_BLOCKS_RING; i++ )
+   {
+      pBlocks[i].uBlockIndex = BENCH_END_BLOCK;
+      for( int k=0; k<BENCH_MAX_PACKETS_IN_BLOCK; k++ )
+         pBlocks[i].pPackets[k] = (u8*) malloc(MAX_PACKET_TOTAL_SIZE);
+   }
+
+   u64 uLatencyTotal = 0;
+   u64 uLastRxTime = _now_micros();
+   int bEnd = 0;
+   while ( ! bEnd )
+   {
+      fd_set readSet;
+      FD_ZERO(&readSet);
+      FD_SET(iSocket, &readSet);
+      struct timeval timeout = { 0, 100000 };
+      if ( select(iSocket+1, &readSet, NULL, NULL, &timeout) <= 0 )
+      {
+         if ( _now_micros() > uLastRxTime + 3000000 )
+            break;
+         continue;
+      }
+      uLastRxTime = _now_micros();
+
+      int iLength = 0;
+      u8* pBuffer = NULL;
+      while ( NULL != (pBuffer = radio_process_wlan_data_in(0, &iLength)) )
+      {
+         int bCRCOk = 0;
+         packet_process_and_check(0, pBuffer, iLength, &bCRCOk);
+         if ( ! bCRCOk )
+         {
+            result.iPacketsBadCRC++;
+            continue;
+         }
+         result.iPacketsReceived++;
+         t_packet_header* pPH = (t_packet_header*)pBuffer;
+         if ( (pPH->packet_type != PACKET_TYPE_VIDEO_DATA_98) || (pPH->total_length != pScenario->iPacketSize) )
+            continue;
+         t_bench_packet_info* pInfo = (t_bench_packet_info*)(pBuffer + sizeof(t_packet_header));
+         if ( pInfo->uBlockIndex == BENCH_END_BLOCK )
+         {
+            bEnd = 1;
+            break;
+         }
+         if ( (pInfo->uBlockIndex >= (u32)pScenario->iBlocks) || (pInfo->uPacketIndex >= pScenario->iDataPackets + pScenario->iFECPackets) )
+            continue;
+
+         t_bench_rx_block* pBlock = &pBlocks[pInfo->uBlockIndex % BENCH_BLOCKS_RING];
+         if ( pBlock->uBlockIndex != pInfo->uBlockIndex )
+         {
+            pBlock->uBlockIndex = pInfo->uBlockIndex;
+            pBlock->uReceivedMask = 0;
+            pBlock->iReceived = 0;
+            pBlock->bDone = 0;
+            pBlock->uCaptureTimeMicros = pInfo->uCaptureTimeMicros;
+         }
+         if ( pBlock->bDone || (pBlock->uReceivedMask & (1<<pInfo->uPacketIndex)) )
+            continue;
+         memcpy(pBlock->pPackets[pInfo->uPacketIndex], pBuffer, pScenario->iPacketSize);
+         pBlock->uReceivedMask |= 1<<pInfo->uPacketIndex;
+         pBlock->iReceived++;
+         if ( pBlock->iReceived < pScenario->iDataPackets )
+            continue;
+
+         pBlock->bDone = 1;
+         if ( _decode_block(pScenario, pBlock, &result) < 0 )
+         {
+            result.iBlocksCorrupted++;
+            continue;
+         }
+         u32 uLatency = (u32)(_now_micros() - pBlock->uCaptureTimeMicros);
+         pLatencies[result.iBlocksRecovered] = uLatency;
+         uLatencyTotal += uLatency;
+         result.iBlocksRecovered++;
+      }
+   }
+
+   if ( result.iBlocksRecovered > 0 )
+   {
+      qsort(pLatencies, result.iBlocksRecovered, sizeof(u32), _compare_u32);
+      result.uLatencyAvgMicros = (u32)(uLatencyTotal / result.iBlocksRecovered);
+      result.uLatencyP50Micros = pLatencies[result.iBlocksRecovered/2];
+      result.uLatencyP95Micros = pLatencies[(result.iBlocksRecovered*95)/100];
+      result.uLatencyMaxMicros = pLatencies[result.iBlocksRecovered-1];
+   }
+   radio_close_interface_for_read(0);
+   result.uCPUMs = _get_process_cpu_ms(getpid());
+   write(iPipeResult, &result, sizeof(result));
+   exit(0);
+}
+
+void _send_packet(t_bench_scenario* pScenario, u8* pPacket, u32 uStreamPacketIndex)
+{
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   radio_packet_init(pPH, PACKET_COMPONENT_VIDEO, PACKET_TYPE_VIDEO_DATA_98, STREAM_ID_VIDEO_1);
+   pPH->vehicle_id_src = 1234;
+   pPH->vehicle_id_dest = 0;
+   pPH->total_length = pScenario->iPacketSize;
+   pPH->stream_packet_idx |= uStreamPacketIndex & PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
+
+   u8 uRawPacket[MAX_PACKET_LENGTH_PCAP];
+   int iLength = radio_build_new_raw_packet(0, uRawPacket, pPacket, pScenario->iPacketSize, RADIO_PORT_ROUTER_DOWNLINK, 0);
+   radio_write_raw_packet(0, uRawPacket, iLength);
+}
+
+// Sends the video blocks at the scenario video bitrate; returns the sender CPU time used
+
+u32 _run_sender(t_bench_scenario* pScenario)
+{
+   u32 uCPUStart = _get_process_cpu_ms(getpid());
+   int iHeaders = sizeof(t_packet_header) + sizeof(t_bench_packet_info);
+   int iFECSize = pScenario->iPacketSize - iHeaders;
+   int iTotalPackets = pScenario->iDataPackets + pScenario->iFECPackets;
+   u8 uPackets[BENCH_MAX_PACKETS_IN_BLOCK][MAX_PACKET_TOTAL_SIZE];
+   u8* pDataBlocks[BENCH_MAX_PACKETS_IN_BLOCK];
+   u8* pFECBlocks[BENCH_MAX_PACKETS_IN_BLOCK];
+   for( int i=0; i<pScenario->iDataPackets; i++ )
+      pDataBlocks[i] = uPackets[i] + iHeaders;
+   for( int i=0; i<pScenario->iFECPackets; i++ )
+      pFECBlocks[i] = uPackets[pScenario->iDataPackets + i] + iHeaders;
+
+   u32 uStreamPacketIndex = 0;
+   if ( 0 != pScenario->szReplayFile[0] )
+      radio_emulator_replay_pcap(pScenario->szReplayFile, BENCH_FREQUENCY_KHZ, 100);
+   else
+   {
+      u64 uBlockIntervalMicros = ((u64)pScenario->iDataPackets) * pScenario->iPacketSize * 8LL * 1000LL / pScenario->iVideoKbps;
+      u64 uStartTime = _now_micros();
+      for( int iBlock=0; iBlock<pScenario->iBlocks; iBlock++ )
+      {
+         u64 uCaptureTime = uStartTime + iBlock * uBlockIntervalMicros;
+         u64 uTimeNow = _now_micros();
+         if ( uCaptureTime > uTimeNow )
+            hardware_sleep_micros((u32)(uCaptureTime - uTimeNow));
+         uCaptureTime = _now_micros();
+
+         for( int i=0; i<pScenario->iDataPackets; i++ )
+         for( int k=0; k<iFECSize; k++ )
+            pDataBlocks[i][k] = _get_pattern_byte(iBlock, i, k);
+         fec_encode(iFECSize, pDataBlocks, pScenario->iDataPackets, pFECBlocks, pScenario->iFECPackets);
+
+         for( int i=0; i<iTotalPackets; i++ )
+         {
+            t_bench_packet_info* pInfo = (t_bench_packet_info*)(uPackets[i] + sizeof(t_packet_header));
+            pInfo->uBlockIndex = iBlock;
+            pInfo->uPacketIndex = i;
+            pInfo->uDataPackets = pScenario->iDataPackets;
+            pInfo->uFECPackets = pScenario->iFECPackets;
+            pInfo->uReserved = 0;
+            pInfo->uCaptureTimeMicros = uCaptureTime;
+            _send_packet(pScenario, uPackets[i], uStreamPacketIndex++);
+         }
+      }
+   }
+   u32 uCPUUsed = _get_process_cpu_ms(getpid()) - uCPUStart;
+   radio_emulator_flush(2000);
+
+   // End markers, on a clean link
+   t_radio_emulator_params params;
+   radio_emulator_reset_params(&params);
+   params.iEmulateAirtime = 0;
+   radio_emulator_set_params(&params);
+   t_bench_packet_info* pInfo = (t_bench_packet_info*)(uPackets[0] + sizeof(t_packet_header));
+   pInfo->uBlockIndex = BENCH_END_BLOCK;
+   for( int i=0; i<3; i++ )
+      _send_packet(pScenario, uPackets[0], uStreamPacketIndex++);
+   return uCPUUsed;
+}
+
+// Returns 0 on failure
+
+int _run_scenario(t_bench_scenario* pScenario, t_bench_rx_result* pResult, t_radio_emulator_stats* pStats)
+{
+   memset(pResult, 0, sizeof(t_bench_rx_result));
+   memset(pStats, 0, sizeof(t_radio_emulator_stats));
+   if ( (pScenario->iDataPackets + pScenario->iFECPackets > BENCH_MAX_PACKETS_IN_BLOCK) ||
+        (pScenario->iPacketSize <= (int)(sizeof(t_packet_header) + sizeof(t_bench_packet_info))) || (pScenario->iPacketSize > MAX_PACKET_TOTAL_SIZE) )
+   {
+      log_line("Invalid scenario parameters.");
+      return 0;
+   }
+
+   int iPipeReady[2];
+   int iPipeResult[2];
+   if ( (0 != pipe(iPipeReady)) || (0 != pipe(iPipeResult)) )
+      return 0;
+
+   int iPid = fork();
+   if ( iPid < 0 )
+      return 0;
+   if ( 0 == iPid )
+      _run_receiver(pScenario, iPipeReady[1], iPipeResult[1]);
+
+   u8 uReady = 0;
+   if ( (1 != read(iPipeReady[0], &uReady, 1)) || (0 == uReady) )
+   {
+      log_line("The receiver process failed to open the emulated radio interface.");
+      waitpid(iPid, NULL, 0);
+      return 0;
+   }
+
+   u32 uPidsCPU[BENCH_MAX_PIDS];
+   for( int i=0; i<s_iCountPids; i++ )
+      uPidsCPU[i] = _get_process_cpu_ms(s_iPids[i]);
+
+   radio_init_link_structures();
+   radio_set_frames_flags(RADIO_FLAGS_FRAME_TYPE_DATA);
+   radio_set_out_datarate(pScenario->iDataRate);
+   radio_emulator_set_params(&pScenario->emulatorParams);
+   radio_emulator_reset_stats();
+   if ( (! _open_emulated_interface()) || (radio_open_interface_for_write(0) < 0) )
+   {
+      log_line("Failed to open the emulated radio interface for write.");
+      kill(iPid, SIGTERM);
+      waitpid(iPid, NULL, 0);
+      return 0;
+   }
+   u32 uCPUSender = _run_sender(pScenario);
+   radio_emulator_get_stats(pStats);
+
+   int iRead = read(iPipeResult[0], pResult, sizeof(t_bench_rx_result));
+   waitpid(iPid, NULL, 0);
+   radio_close_interface_for_write(0);
+   close(iPipeReady[0]);
+   close(iPipeReady[1]);
+   close(iPipeResult[0]);
+   close(iPipeResult[1]);
+   if ( iRead != (int)sizeof(t_bench_rx_result) )
+   {
+      log_line("Failed to get the receiver results.");
+      return 0;
+   }
+
+   log_line("[%s] blocks: %d sent, %d recovered (%.1f%%, %d using FEC, %d corrupted); frames: %u sent, %u lost (%u in bursts), %u dropped (tx queue full)",
+      pScenario->szName, pScenario->iBlocks, pResult->iBlocksRecovered, 100.0*pResult->iBlocksRecovered/pScenario->iBlocks,
+      pResult->iBlocksRecoveredWithFEC, pResult->iBlocksCorrupted,
+      pStats->uFramesSent, pStats->uFramesLost, pStats->uFramesLostInBursts, pStats->uFramesDroppedQueueFull);
+   log_line("[%s] capture to decode latency: avg %.2f ms, p50 %.2f ms, p95 %.2f ms, max %.2f ms; CPU: sender %u ms, receiver %u ms",
+      pScenario->szName, pResult->uLatencyAvgMicros/1000.0, pResult->uLatencyP50Micros/1000.0, pResult->uLatencyP95Micros/1000.0, pResult->uLatencyMaxMicros/1000.0,
+      uCPUSender, pResult->uCPUMs);
+   for( int i=0; i<s_iCountPids; i++ )
+      log_line("[%s] CPU of process %d: %u ms", pScenario->szName, s_iPids[i], _get_process_cpu_ms(s_iPids[i]) - uPidsCPU[i]);
+   return 1;
+}
+
+void _init_scenario(t_bench_scenario* pScenario, const char* szName)
+{
+   memset(pScenario, 0, sizeof(t_bench_scenario));
+   pScenario->szName = szName;
+   pScenario->iBlocks = 200;
+   pScenario->iDataPackets = 8;
+   pScenario->iFECPackets = 4;
+   pScenario->iPacketSize = 1200;
+   pScenario->iVideoKbps = 8000;
+   pScenario->iDataRate = -4; // MCS 3
+   radio_emulator_reset_params(&pScenario->emulatorParams);
+}
+
+void _run_default_scenarios()
+{
+   t_bench_scenario scenario;
+   t_bench_rx_result result;
+   t_radio_emulator_stats stats;
+   char szRecordFile[] = "/tmp/test_radio_emulator.pcap";
+
+   _init_scenario(&scenario, "clean");
+   strcpy(scenario.emulatorParams.szRecordFile, szRecordFile);
+   _check_true("Clean link runs", _run_scenario(&scenario, &result, &stats));
+   _check_true("Clean link: all blocks recovered", result.iBlocksRecovered == scenario.iBlocks);
+   _check_true("Clean link: no FEC needed", result.iBlocksRecoveredWithFEC == 0);
+   _check_true("Clean link: no lost frames", (stats.uFramesLost == 0) && (stats.uFramesDelivered == stats.uFramesSent));
+
+   _init_scenario(&scenario, "replay");
+   strcpy(scenario.szReplayFile, szRecordFile);
+   _check_true("Replay runs", _run_scenario(&scenario, &result, &stats));
+   _check_true("Replay: all blocks recovered", result.iBlocksRecovered == scenario.iBlocks);
+   unlink(szRecordFile);
+
+   _init_scenario(&scenario, "loss 5%");
+   scenario.emulatorParams.uSeed = 7;
+   scenario.emulatorParams.iLossPerThousand = 50;
+   _check_true("Random loss runs", _run_scenario(&scenario, &result, &stats));
+   u32 uLostFirstRun = stats.uFramesLost;
+   _check_true("Random loss: frames are lost", stats.uFramesLost > 0);
+   _check_true("Random loss: FEC recovers blocks", (result.iBlocksRecoveredWithFEC > 0) && (result.iBlocksRecovered >= scenario.iBlocks*95/100));
+   _check_true("Random loss: no corrupted blocks", result.iBlocksCorrupted == 0);
+   _check_true("Random loss: same seed, same losses", _run_scenario(&scenario, &result, &stats) && (stats.uFramesLost == uLostFirstRun));
+
+   _init_scenario(&scenario, "burst loss");
+   scenario.emulatorParams.uSeed = 7;
+   scenario.emulatorParams.iBurstEnterPerThousand = 20;
+   scenario.emulatorParams.iBurstExitPerThousand = 150;
+   scenario.emulatorParams.iBurstLossPerThousand = 900;
+   _check_true("Burst loss runs", _run_scenario(&scenario, &result, &stats));
+   _check_true("Burst loss: frames are lost in bursts", stats.uFramesLostInBursts > 0);
+   _check_true("Burst loss: no corrupted blocks", result.iBlocksCorrupted == 0);
+
+   _init_scenario(&scenario, "latency + jitter");
+   scenario.emulatorParams.uSeed = 7;
+   scenario.emulatorParams.iLossPerThousand = 20;
+   scenario.emulatorParams.iLatencyMicros = 5000;
+   scenario.emulatorParams.iJitterMicros = 3000;
+   _check_true("Latency runs", _run_scenario(&scenario, &result, &stats));
+   _check_true("Latency: latency is added", result.uLatencyP50Micros >= 5000);
+   _check_true("Latency: no corrupted blocks", result.iBlocksCorrupted == 0);
+
+   _init_scenario(&scenario, "slow datarate");
+   scenario.iDataRate = 6000000;
+   _check_true("Slow datarate runs", _run_scenario(&scenario, &result, &stats));
+   _check_true("Slow datarate: tx queue overflows", stats.uFramesDroppedQueueFull > 0);
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestRadioEmulator");
+   log_enable_stdout();
+   fec_init();
+
+   t_bench_scenario scenario;
+   _init_scenario(&scenario, "custom");
+   int bCustom = 0;
+   for( int i=1; i<argc; i++ )
+   {
+      int bHasValue = (i+1 < argc);
+      if ( bHasValue && (0 == strcmp(argv[i], "-blocks")) )
+         scenario.iBlocks = atoi(argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-data")) )
+         scenario.iDataPackets = atoi(argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-fec")) )
+         scenario.iFECPackets = atoi(argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-size")) )
+         scenario.iPacketSize = atoi(argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-kbps")) )
+         scenario.iVideoKbps = atoi(argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-mcs")) )
+         scenario.iDataRate = -atoi(argv[++i])-1;
+      else if ( bHasValue && (0 == strcmp(argv[i], "-seed")) )
+         scenario.emulatorParams.uSeed = (u32)atoi(argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-loss")) )
+         scenario.emulatorParams.iLossPerThousand = atoi(argv[++i]);
+      else if ( (i+3 < argc) && (0 == strcmp(argv[i], "-burst")) )
+      {
+         scenario.emulatorParams.iBurstEnterPerThousand = atoi(argv[++i]);
+         scenario.emulatorParams.iBurstExitPerThousand = atoi(argv[++i]);
+         scenario.emulatorParams.iBurstLossPerThousand = atoi(argv[++i]);
+      }
+      else if ( bHasValue && (0 == strcmp(argv[i], "-latency")) )
+         scenario.emulatorParams.iLatencyMicros = atoi(argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-jitter")) )
+         scenario.emulatorParams.iJitterMicros = atoi(argv[++i]);
+      else if ( 0 == strcmp(argv[i], "-noairtime") )
+         scenario.emulatorParams.iEmulateAirtime = 0;
+      else if ( bHasValue && (0 == strcmp(argv[i], "-record")) )
+         strcpy(scenario.emulatorParams.szRecordFile, argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-replay")) )
+         strcpy(scenario.szReplayFile, argv[++i]);
+      else if ( bHasValue && (0 == strcmp(argv[i], "-pid")) && (s_iCountPids < BENCH_MAX_PIDS) )
+      {
+         s_iPids[s_iCountPids++] = atoi(argv[++i]);
+         continue;
+      }
+      else
+      {
+         log_line("Invalid parameter: %s", argv[i]);
+         return -1;
+      }
+      bCustom = 1;
+   }
+
+   if ( bCustom )
+   {
+      t_bench_rx_result result;
+      t_radio_emulator_stats stats;
+      _check_true("Scenario runs", _run_scenario(&scenario, &result, &stats));
+   }
+   else
+      _run_default_scenarios();
+
+   log_line("Radio emulator tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,254 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radioflags.h"
+#include "../radio/radiolink.h"
+#include <pthread.h>
+
+// Checks that radio frames built in the packet headroom are the same as the copied ones
+// and compares the throughput of the two ways of building radio frames.
+// Checks the radio tx templates: same frames as the global datarate/frames flags state, and
+// correct headers when building frames from multiple threads at the same time.
+
+#define TEST_TX_THREADS 4
+#define TEST_TX_THREAD_FRAMES 200000
+
+int s_iFailed = 0;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+int _add_packet(u8* pBuffer, u8 uFlags, u8 uPacketType, int iLength)
+{
+   t_packet_header* pPH = (t_packet_header*)pBuffer;
+   memset(pPH, 0, sizeof(t_packet_header));
+   pPH->packet_flags = uFlags;
+   pPH->packet_type = uPacketType;
+   pPH->vehicle_id_src = 1234;
+   pPH->vehicle_id_dest = 5678;
+   pPH->total_length = iLength;
+   for( int i=sizeof(t_packet_header); i<iLength; i++ )
+      pBuffer[i] = i & 0xFF;
+   return iLength;
+}
+
+void _test_frames(u32 uFrameFlags, int iDataRate)
+{
+   radio_set_frames_flags(uFrameFlags);
+   radio_set_out_datarate(iDataRate);
+
+   u8 uPacket[RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE];
+   u8* pPacketData = uPacket + RADIO_PACKET_HEADROOM;
+   int iLength = _add_packet(pPacketData, PACKET_COMPONENT_VIDEO | PACKET_FLAGS_BIT_HEADERS_ONLY_CRC, PACKET_TYPE_VIDEO_DATA_98, 1000);
+   iLength += _add_packet(pPacketData + iLength, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_RUBY_TELEMETRY_SHORT, 100);
+
+   // Use two radio links, so both frames get the same radio link packet index
+   u8 uRawCopied[MAX_PACKET_LENGTH_PCAP];
+   int iCopiedLength = radio_build_new_raw_packet(0, uRawCopied, pPacketData, iLength, RADIO_PORT_ROUTER_DOWNLINK, 0);
+   u8* pRawInPlace = NULL;
+   int iInPlaceLength = radio_build_new_raw_packet_in_headroom(1, pPacketData, iLength, RADIO_PORT_ROUTER_DOWNLINK, &pRawInPlace);
+
+   _check_true("Same frame length", (iCopiedLength == iInPlaceLength) && (iCopiedLength > iLength));
+   _check_true("Frame starts in the headroom", (pRawInPlace >= uPacket) && (pRawInPlace + (iInPlaceLength - iLength) == pPacketData));
+   if ( (iCopiedLength != iInPlaceLength) || (NULL == pRawInPlace) )
+      return;
+
+   // The IEEE sequence number is different for each frame
+   int iHeadersLength = iCopiedLength - iLength;
+   int iRadiotapLength = uRawCopied[2];
+   for( int i=0; i<iHeadersLength; i++ )
+   {
+      if ( (uFrameFlags & RADIO_FLAGS_FRAME_TYPE_DATA) && (i >= iRadiotapLength + 22) )
+         break;
+      if ( uRawCopied[i] != pRawInPlace[i] )
+      {
+         _check_true("Same radio headers", 0);
+         break;
+      }
+   }
+   _check_true("Same packets", 0 == memcmp(uRawCopied + iHeadersLength, pRawInPlace + iHeadersLength, iLength));
+}
+
+// Checks a raw frame headers against the datarate, frames flags and port it was built for
+int _check_frame_headers(u8* pRawPacket, int iDataRate, u32 uFrameFlags, int iPort)
+{
+   int iRadiotapLength = pRawPacket[2];
+   if ( (iDataRate < 0) || (uFrameFlags & RADIO_FLAGS_MCS_MASK) )
+   {
+      if ( (iRadiotapLength != 13) || (pRawPacket[12] != (u8)((iDataRate < 0)?(-iDataRate-1):0)) )
+         return 0;
+   }
+   else if ( (iRadiotapLength != 12) || (pRawPacket[8] != (u8)(iDataRate/1000/1000*2)) )
+      return 0;
+   return pRawPacket[iRadiotapLength + 4] == (u8)((iPort<<4) | 0x0F);
+}
+
+void _test_templates()
+{
+   const t_radio_tx_template* pTemplate = radio_get_tx_template(-3, RADIO_FLAGS_FRAME_TYPE_DATA, RADIO_PORT_ROUTER_DOWNLINK);
+   _check_true("Template is reused", pTemplate == radio_get_tx_template(-3, RADIO_FLAGS_FRAME_TYPE_DATA, RADIO_PORT_ROUTER_DOWNLINK));
+   _check_true("Template per port", pTemplate != radio_get_tx_template(-3, RADIO_FLAGS_FRAME_TYPE_DATA, RADIO_PORT_ROUTER_UPLINK));
+   _check_true("Template per datarate", pTemplate != radio_get_tx_template(-4, RADIO_FLAGS_FRAME_TYPE_DATA, RADIO_PORT_ROUTER_DOWNLINK));
+   _check_true("Template per frames flags", pTemplate != radio_get_tx_template(-3, RADIO_FLAGS_FRAME_TYPE_DATA | RADIO_FLAG_SGI_VEHICLE, RADIO_PORT_ROUTER_DOWNLINK));
+
+   int iDataRates[] = { -1, -3, -8, 6000000, 18000000, 54000000 };
+   u32 uFrameFlags[] = { RADIO_FLAGS_FRAME_TYPE_DATA, RADIO_FLAGS_FRAME_TYPE_DATA | RADIO_FLAG_HT40_VEHICLE | RADIO_FLAG_LDPC_VEHICLE, RADIO_FLAGS_FRAME_TYPE_DATA_SHORT, RADIO_FLAGS_FRAME_TYPE_RTS };
+   int iPorts[] = { RADIO_PORT_ROUTER_DOWNLINK, RADIO_PORT_ROUTER_UPLINK };
+
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE];
+   int iLength = _add_packet(uPacket, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_RUBY_TELEMETRY_SHORT, 100);
+   u8 uRawGlobal[MAX_PACKET_LENGTH_PCAP];
+   u8 uRawTemplate[MAX_PACKET_LENGTH_PCAP];
+
+   for( int r=0; r<(int)(sizeof(iDataRates)/sizeof(iDataRates[0])); r++ )
+   for( int f=0; f<(int)(sizeof(uFrameFlags)/sizeof(uFrameFlags[0])); f++ )
+   for( int p=0; p<(int)(sizeof(iPorts)/sizeof(iPorts[0])); p++ )
+   {
+      radio_set_frames_flags(uFrameFlags[f]);
+      radio_set_out_datarate(iDataRates[r]);
+      int iGlobalLength = radio_build_new_raw_packet(0, uRawGlobal, uPacket, iLength, iPorts[p], 0);
+      pTemplate = radio_get_tx_template(iDataRates[r], uFrameFlags[f], iPorts[p]);
+      int iTemplateLength = radio_build_new_raw_packet_with_template(pTemplate, 1, uRawTemplate, uPacket, iLength, 0);
+
+      _check_true("Template frame length", (iGlobalLength == iTemplateLength) && (iTemplateLength == pTemplate->iHeadersLength + iLength));
+      _check_true("Template frame headers", _check_frame_headers(uRawTemplate, iDataRates[r], uFrameFlags[f], iPorts[p]));
+      if ( iGlobalLength != iTemplateLength )
+         continue;
+      // Only the IEEE sequence number differs
+      int iSame = 1;
+      for( int i=0; i<iTemplateLength; i++ )
+      {
+         if ( (pTemplate->iSeqNumberOffset >= 0) && ((i == pTemplate->iSeqNumberOffset) || (i == pTemplate->iSeqNumberOffset+1)) )
+            continue;
+         if ( uRawGlobal[i] != uRawTemplate[i] )
+            iSame = 0;
+      }
+      _check_true("Template frame same as global state frame", iSame);
+      if ( pTemplate->iSeqNumberOffset >= 0 )
+      {
+         u16 uSeqGlobal = uRawGlobal[pTemplate->iSeqNumberOffset] | (uRawGlobal[pTemplate->iSeqNumberOffset+1] << 8);
+         u16 uSeqTemplate = uRawTemplate[pTemplate->iSeqNumberOffset] | (uRawTemplate[pTemplate->iSeqNumberOffset+1] << 8);
+         _check_true("IEEE sequence number increases", (u16)(uSeqTemplate - uSeqGlobal) == 16);
+      }
+   }
+}
+
+typedef struct
+{
+   int iDataRate;
+   int iPort;
+   int iBadFrames;
+} t_test_tx_thread;
+
+void* _thread_build_frames(void* pParam)
+{
+   t_test_tx_thread* pThread = (t_test_tx_thread*)pParam;
+   const t_radio_tx_template* pTemplate = radio_get_tx_template(pThread->iDataRate, RADIO_FLAGS_FRAME_TYPE_DATA, pThread->iPort);
+   u8 uPacket[RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE];
+   u8* pPacketData = uPacket + RADIO_PACKET_HEADROOM;
+   _add_packet(pPacketData, PACKET_COMPONENT_VIDEO | PACKET_FLAGS_BIT_HEADERS_ONLY_CRC, PACKET_TYPE_VIDEO_DATA_98, 1000);
+   for( int i=0; i<TEST_TX_THREAD_FRAMES; i++ )
+   {
+      u8* pRawPacket = NULL;
+      if ( radio_build_new_raw_packet_in_headroom_with_template(pTemplate, 0, pPacketData, 1000, &pRawPacket) <= 0 )
+         pThread->iBadFrames++;
+      else if ( ! _check_frame_headers(pRawPacket, pThread->iDataRate, RADIO_FLAGS_FRAME_TYPE_DATA, pThread->iPort) )
+         pThread->iBadFrames++;
+   }
+   return NULL;
+}
+
+void _test_templates_threads()
+{
+   pthread_t threads[TEST_TX_THREADS];
+   t_test_tx_thread params[TEST_TX_THREADS];
+   int iDataRates[TEST_TX_THREADS] = { -1, -5, 6000000, 24000000 };
+   for( int i=0; i<TEST_TX_THREADS; i++ )
+   {
+      params[i].iDataRate = iDataRates[i];
+      params[i].iPort = (i%2)?RADIO_PORT_ROUTER_UPLINK:RADIO_PORT_ROUTER_DOWNLINK;
+      params[i].iBadFrames = 0;
+      pthread_create(&threads[i], NULL, &_thread_build_frames, &params[i]);
+   }
+   int iBadFrames = 0;
+   for( int i=0; i<TEST_TX_THREADS; i++ )
+   {
+      pthread_join(threads[i], NULL);
+      iBadFrames += params[i].iBadFrames;
+   }
+   log_line("%d threads built %d frames each, %d frames with wrong headers", TEST_TX_THREADS, TEST_TX_THREAD_FRAMES, iBadFrames);
+   _check_true("Frames built from multiple threads have the right headers", 0 == iBadFrames);
+}
+
+void _benchmark(int iPacketLength, int iPackets)
+{
+   radio_set_frames_flags(RADIO_FLAGS_FRAME_TYPE_DATA);
+   radio_set_out_datarate(-3);
+
+   u8 uPacket[RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE];
+   u8* pPacketData = uPacket + RADIO_PACKET_HEADROOM;
+   _add_packet(pPacketData, PACKET_COMPONENT_VIDEO | PACKET_FLAGS_BIT_HEADERS_ONLY_CRC, PACKET_TYPE_VIDEO_DATA_98, iPacketLength);
+   u8 uRawPacket[MAX_PACKET_LENGTH_PCAP];
+   u32 uCheck = 0;
+
+   u32 uStart = get_current_timestamp_micros();
+   for( int i=0; i<iPackets; i++ )
+   {
+      int iLength = radio_build_new_raw_packet(0, uRawPacket, pPacketData, iPacketLength, RADIO_PORT_ROUTER_DOWNLINK, 0);
+      uCheck += uRawPacket[iLength-1];
+   }
+   u32 uTimeCopied = get_current_timestamp_micros() - uStart;
+
+   uStart = get_current_timestamp_micros();
+   for( int i=0; i<iPackets; i++ )
+   {
+      u8* pRawPacket = NULL;
+      int iLength = radio_build_new_raw_packet_in_headroom(0, pPacketData, iPacketLength, RADIO_PORT_ROUTER_DOWNLINK, &pRawPacket);
+      uCheck += pRawPacket[iLength-1];
+   }
+   u32 uTimeInPlace = get_current_timestamp_micros() - uStart;
+
+   const t_radio_tx_template* pTemplate = radio_get_tx_template(-3, RADIO_FLAGS_FRAME_TYPE_DATA, RADIO_PORT_ROUTER_DOWNLINK);
+   uStart = get_current_timestamp_micros();
+   for( int i=0; i<iPackets; i++ )
+   {
+      u8* pRawPacket = NULL;
+      int iLength = radio_build_new_raw_packet_in_headroom_with_template(pTemplate, 0, pPacketData, iPacketLength, &pRawPacket);
+      uCheck += pRawPacket[iLength-1];
+   }
+   u32 uTimeTemplate = get_current_timestamp_micros() - uStart;
+
+   if ( 0 == uTimeCopied )
+      uTimeCopied = 1;
+   if ( 0 == uTimeInPlace )
+      uTimeInPlace = 1;
+   if ( 0 == uTimeTemplate )
+      uTimeTemplate = 1;
+   log_line("%d frames of %d bytes: copied: %u us (%u ns/frame, %d bytes copied/frame), in headroom: %u us (%u ns/frame, 0 bytes copied/frame), in headroom with tx template: %u us (%u ns/frame) (%u)",
+      iPackets, iPacketLength, uTimeCopied, (u32)((u64)uTimeCopied*1000/iPackets), iPacketLength,
+      uTimeInPlace, (u32)((u64)uTimeInPlace*1000/iPackets),
+      uTimeTemplate, (u32)((u64)uTimeTemplate*1000/iPackets), uCheck & 0x01);
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestRadioHeadroom");
+   log_enable_stdout();
+   radio_init_link_structures();
+
+   _test_frames(RADIO_FLAGS_FRAME_TYPE_DATA, -3);
+   _test_frames(RADIO_FLAGS_FRAME_TYPE_DATA_SHORT, 18000000);
+   _test_frames(RADIO_FLAGS_FRAME_TYPE_RTS, -1);
+   _test_templates();
+   _test_templates_threads();
+   _benchmark(1250, 500000);
+   _benchmark(200, 500000);
+
+   log_line("Radio headroom tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
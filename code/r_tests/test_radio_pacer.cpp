@@ -0,0 +1,441 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware_radio.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radioflags.h"
+#include "../radio/radiolink.h"
+#include "../radio/radio_emulator.h"
+#include "../radio/radio_pacer.h"
+
+#include <sys/select.h>
+#include <sys/wait.h>
+
+// Sends a video stream with large I-frames and a 100 Hz telemetry stream from a vehicle process to a
+// receiver process over the emulated radio medium (with airtime emulation), without and then with
+// the radio airtime pacer, and reports for each: the telemetry latency, the video frames latency, the
+// frames queued in the emulated radio card and the pacer bursts stats.
+// Usage: test_radio_pacer [-seconds n] [-mcs n] [-iframe packets]
+
+#define BENCH_FREQUENCY_KHZ 5825000
+#define BENCH_FPS 30
+#define BENCH_KEYFRAME_INTERVAL 15
+#define BENCH_PFRAME_PACKETS 8
+#define BENCH_VIDEO_PACKET_SIZE 1200
+#define BENCH_TELEMETRY_HZ 100
+#define BENCH_TELEMETRY_PACKET_SIZE 80
+#define BENCH_MAX_FRAME_PACKETS 200
+#define BENCH_VIDEO_FIFO 4096
+#define BENCH_FRAMES_RING 64
+#define BENCH_END_MARKER 0xFFFFFFFF
+
+typedef struct
+{
+   u32 uIndex; // frame index for video, packet index for telemetry
+   u16 uPacketIndex;
+   u16 uPacketsInFrame;
+   u64 uCreateTimeMicros;
+} __attribute__((packed)) t_bench_info;
+
+typedef struct
+{
+   int iVideoFrames;
+   int iTelemetryPackets;
+   u32 uVideoLatencyAvgMicros;
+   u32 uVideoLatencyMaxMicros;
+   u32 uTelemetryLatencyAvgMicros;
+   u32 uTelemetryLatencyP95Micros;
+   u32 uTelemetryLatencyMaxMicros;
+} t_bench_rx_result;
+
+typedef struct
+{
+   u32 uFrameIndex;
+   int iReceived;
+} t_bench_rx_frame;
+
+int s_iFailed = 0;
+int s_iSeconds = 4;
+int s_iDataRate = -3; // MCS 2
+int s_iIFramePackets = 60;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u64 _now_micros()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return ((u64)t.tv_sec)*1000000LL + ((u64)t.tv_nsec)/1000LL;
+}
+
+int _compare_u32(const void* pA, const void* pB)
+{
+   u32 uA = *(const u32*)pA;
+   u32 uB = *(const u32*)pB;
+   return (uA > uB) - (uA < uB);
+}
+
+int _open_emulated_interface()
+{
+   // The receiver process is forked from the sender, so it gets its radio interfaces too
+   static int s_bAddedEmulatedRadio = 0;
+   if ( ! s_bAddedEmulatedRadio )
+      hardware_radio_add_emulated_radios(1);
+   s_bAddedEmulatedRadio = 1;
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(0);
+   if ( NULL == pRadioHWInfo )
+      return 0;
+   pRadioHWInfo->uCurrentFrequencyKhz = BENCH_FREQUENCY_KHZ;
+   return 1;
+}
+
+void _run_receiver(int iPipeReady, int iPipeResult)
+{
+   t_bench_rx_result result;
+   memset(&result, 0, sizeof(result));
+
+   radio_init_link_structures();
+   int iSocket = -1;
+   if ( _open_emulated_interface() )
+      iSocket = radio_open_interface_for_read(0, RADIO_PORT_ROUTER_DOWNLINK);
+   u8 uReady = (iSocket >= 0)?1:0;
+   write(iPipeReady, &uReady, 1);
+   if ( iSocket < 0 )
+      exit(1);
+
+   t_bench_rx_frame frames[BENCH_FRAMES_RING];
+   for( int i=0; i<BENCH_FRAMES_RING; i++ )
+      frames[i].uFrameIndex = BENCH_END_MARKER;
+   int iMaxTelemetry = s_iSeconds * BENCH_TELEMETRY_HZ + 100;
+   u32* pTelemetryLatencies = (u32*) malloc(iMaxTelemetry*sizeof(u32));
+   u64 uVideoLatencyTotal = 0;
+   u64 uTelemetryLatencyTotal = 0;
+   u64 uLastRxTime = _now_micros();
+   int bEnd = 0;
+   while ( ! bEnd )
+   {
+      fd_set readSet;
+      FD_ZERO(&readSet);
+      FD_SET(iSocket, &readSet);
+      struct timeval timeout = { 0, 100000 };
+      if ( select(iSocket+1, &readSet, NULL, NULL, &timeout) <= 0 )
+      {
+         if ( _now_micros() > uLastRxTime + 3000000 )
+            break;
+         continue;
+      }
+      uLastRxTime = _now_micros();
+
+      int iLength = 0;
+      u8* pBuffer = NULL;
+      while ( NULL != (pBuffer = radio_process_wlan_data_in(0, &iLength)) )
+      {
+         int bCRCOk = 0;
+         packet_process_and_check(0, pBuffer, iLength, &bCRCOk);
+         if ( ! bCRCOk )
+            continue;
+         u64 uTimeNow = _now_micros();
+         t_packet_header* pPH = (t_packet_header*)pBuffer;
+         t_bench_info* pInfo = (t_bench_info*)(pBuffer + sizeof(t_packet_header));
+         if ( pInfo->uIndex == BENCH_END_MARKER )
+         {
+            bEnd = 1;
+            break;
+         }
+         if ( pPH->packet_type == PACKET_TYPE_RUBY_TELEMETRY_SHORT )
+         {
+            if ( result.iTelemetryPackets >= iMaxTelemetry )
+               continue;
+            u32 uLatency = (u32)(uTimeNow - pInfo->uCreateTimeMicros);
+            pTelemetryLatencies[result.iTelemetryPackets++] = uLatency;
+            uTelemetryLatencyTotal += uLatency;
+            if ( uLatency > result.uTelemetryLatencyMaxMicros )
+               result.uTelemetryLatencyMaxMicros = uLatency;
+            continue;
+         }
+         if ( pPH->packet_type != PACKET_TYPE_VIDEO_DATA_98 )
+            continue;
+
+         t_bench_rx_frame* pFrame = &frames[pInfo->uIndex % BENCH_FRAMES_RING];
+         if ( pFrame->uFrameIndex != pInfo->uIndex )
+         {
+            pFrame->uFrameIndex = pInfo->uIndex;
+            pFrame->iReceived = 0;
+         }
+         pFrame->iReceived++;
+         if ( pFrame->iReceived != pInfo->uPacketsInFrame )
+            continue;
+         // Whole frame received
+         u32 uLatency = (u32)(uTimeNow - pInfo->uCreateTimeMicros);
+         uVideoLatencyTotal += uLatency;
+         result.iVideoFrames++;
+         if ( uLatency > result.uVideoLatencyMaxMicros )
+            result.uVideoLatencyMaxMicros = uLatency;
+      }
+   }
+
+   if ( result.iVideoFrames > 0 )
+      result.uVideoLatencyAvgMicros = (u32)(uVideoLatencyTotal / result.iVideoFrames);
+   if ( result.iTelemetryPackets > 0 )
+   {
+      qsort(pTelemetryLatencies, result.iTelemetryPackets, sizeof(u32), _compare_u32);
+      result.uTelemetryLatencyAvgMicros = (u32)(uTelemetryLatencyTotal / result.iTelemetryPackets);
+      result.uTelemetryLatencyP95Micros = pTelemetryLatencies[(result.iTelemetryPackets*95)/100];
+   }
+   radio_close_interface_for_read(0);
+   write(iPipeResult, &result, sizeof(result));
+   exit(0);
+}
+
+void _send_packet(u8* pPacket, int iLength, bool bIsVideo, u32 uStreamPacketIndex)
+{
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   if ( bIsVideo )
+      radio_packet_init(pPH, PACKET_COMPONENT_VIDEO, PACKET_TYPE_VIDEO_DATA_98, STREAM_ID_VIDEO_1);
+   else
+      radio_packet_init(pPH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_RUBY_TELEMETRY_SHORT, STREAM_ID_TELEMETRY);
+   pPH->vehicle_id_src = 1234;
+   pPH->vehicle_id_dest = 0;
+   pPH->total_length = iLength;
+   pPH->stream_packet_idx |= uStreamPacketIndex & PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
+
+   u8 uRawPacket[MAX_PACKET_LENGTH_PCAP];
+   int iRawLength = radio_build_new_raw_packet(0, uRawPacket, pPacket, iLength, RADIO_PORT_ROUTER_DOWNLINK, 0);
+   radio_write_raw_packet(0, uRawPacket, iRawLength);
+   radio_pacer_on_packet_sent(0, iLength, getRealDataRateFromRadioDataRate(s_iDataRate, 0), bIsVideo?0:1, (u32)_now_micros());
+}
+
+// Video packets wait in a FIFO, as in the vehicle video tx buffers, and are sent when the pacer allows it
+
+void _run_sender()
+{
+   u8 uTelemetryPacket[BENCH_TELEMETRY_PACKET_SIZE];
+   memset(uTelemetryPacket, 0, sizeof(uTelemetryPacket));
+   u8 uVideoPacket[BENCH_VIDEO_PACKET_SIZE];
+   memset(uVideoPacket, 0, sizeof(uVideoPacket));
+   t_bench_info* pFifo = (t_bench_info*) malloc(BENCH_VIDEO_FIFO*sizeof(t_bench_info));
+   int iFifoStart = 0;
+   int iFifoCount = 0;
+
+   u32 uStreamPacketIndex = 0;
+   u32 uFrameIndex = 0;
+   u32 uTelemetryIndex = 0;
+   u64 uTimeStart = _now_micros();
+   u64 uTimeEnd = uTimeStart + (u64)s_iSeconds * 1000000LL;
+   u64 uTimeNextFrame = uTimeStart;
+   u64 uTimeNextTelemetry = uTimeStart + 1000;
+
+   while ( (_now_micros() < uTimeEnd) || (iFifoCount > 0) )
+   {
+      u64 uTimeNow = _now_micros();
+      if ( (uTimeNow >= uTimeNextFrame) && (uTimeNow < uTimeEnd) )
+      {
+         uTimeNextFrame += 1000000/BENCH_FPS;
+         int iPackets = (0 == (uFrameIndex % BENCH_KEYFRAME_INTERVAL))?s_iIFramePackets:BENCH_PFRAME_PACKETS;
+         for( int i=0; (i<iPackets) && (iFifoCount < BENCH_VIDEO_FIFO); i++ )
+         {
+            t_bench_info* pInfo = &pFifo[(iFifoStart + iFifoCount) % BENCH_VIDEO_FIFO];
+            pInfo->uIndex = uFrameIndex;
+            pInfo->uPacketIndex = i;
+            pInfo->uPacketsInFrame = iPackets;
+            pInfo->uCreateTimeMicros = uTimeNow;
+            iFifoCount++;
+         }
+         uFrameIndex++;
+      }
+
+      if ( (uTimeNow >= uTimeNextTelemetry) && (uTimeNow < uTimeEnd) )
+      {
+         uTimeNextTelemetry += 1000000/BENCH_TELEMETRY_HZ;
+         t_bench_info* pInfo = (t_bench_info*)(uTelemetryPacket + sizeof(t_packet_header));
+         pInfo->uIndex = uTelemetryIndex++;
+         pInfo->uCreateTimeMicros = uTimeNow;
+         _send_packet(uTelemetryPacket, sizeof(uTelemetryPacket), false, uStreamPacketIndex++);
+      }
+
+      while ( (iFifoCount > 0) && radio_pacer_can_send_video((u32)_now_micros()) )
+      {
+         memcpy(uVideoPacket + sizeof(t_packet_header), &pFifo[iFifoStart], sizeof(t_bench_info));
+         iFifoStart = (iFifoStart + 1) % BENCH_VIDEO_FIFO;
+         iFifoCount--;
+         _send_packet(uVideoPacket, sizeof(uVideoPacket), true, uStreamPacketIndex++);
+      }
+      hardware_sleep_micros(200);
+   }
+   free(pFifo);
+   radio_emulator_flush(2000);
+
+   // End markers, on a clean link
+   t_radio_emulator_params params;
+   radio_emulator_reset_params(&params);
+   params.iEmulateAirtime = 0;
+   radio_emulator_set_params(&params);
+   t_bench_info* pInfo = (t_bench_info*)(uTelemetryPacket + sizeof(t_packet_header));
+   pInfo->uIndex = BENCH_END_MARKER;
+   for( int i=0; i<3; i++ )
+      _send_packet(uTelemetryPacket, sizeof(uTelemetryPacket), false, uStreamPacketIndex++);
+}
+
+// Returns 0 on failure
+
+int _run_bench(bool bPaced, t_bench_rx_result* pResult, t_radio_emulator_stats* pStats, t_radio_pacer_link_stats* pPacerStats)
+{
+   memset(pResult, 0, sizeof(t_bench_rx_result));
+   int iPipeReady[2];
+   int iPipeResult[2];
+   if ( (0 != pipe(iPipeReady)) || (0 != pipe(iPipeResult)) )
+      return 0;
+
+   // Do not duplicate the buffered log output in the receiver process
+   fflush(stdout);
+   int iPid = fork();
+   if ( iPid < 0 )
+      return 0;
+   if ( 0 == iPid )
+      _run_receiver(iPipeReady[1], iPipeResult[1]);
+
+   u8 uReady = 0;
+   if ( (1 != read(iPipeReady[0], &uReady, 1)) || (0 == uReady) )
+   {
+      log_line("The receiver process failed to open the emulated radio interface.");
+      waitpid(iPid, NULL, 0);
+      return 0;
+   }
+
+   radio_init_link_structures();
+   radio_set_frames_flags(RADIO_FLAGS_FRAME_TYPE_DATA);
+   radio_set_out_datarate(s_iDataRate);
+   t_radio_emulator_params params;
+   radio_emulator_reset_params(&params);
+   radio_emulator_set_params(&params);
+   radio_emulator_reset_stats();
+   radio_pacer_init();
+   radio_pacer_set_enabled(bPaced?1:0);
+   if ( (! _open_emulated_interface()) || (radio_open_interface_for_write(0) < 0) )
+   {
+      log_line("Failed to open the emulated radio interface for write.");
+      kill(iPid, SIGTERM);
+      waitpid(iPid, NULL, 0);
+      return 0;
+   }
+   _run_sender();
+   radio_emulator_get_stats(pStats);
+   memcpy(pPacerStats, radio_pacer_get_link_stats(0), sizeof(t_radio_pacer_link_stats));
+
+   int iRead = read(iPipeResult[0], pResult, sizeof(t_bench_rx_result));
+   waitpid(iPid, NULL, 0);
+   radio_close_interface_for_write(0);
+   close(iPipeReady[0]);
+   close(iPipeReady[1]);
+   close(iPipeResult[0]);
+   close(iPipeResult[1]);
+   if ( iRead != (int)sizeof(t_bench_rx_result) )
+   {
+      log_line("Failed to get the receiver results.");
+      return 0;
+   }
+
+   const char* szName = bPaced?"paced":"unpaced";
+   log_line("[%s] telemetry: %d packets, latency avg %.2f ms, p95 %.2f ms, max %.2f ms; video: %d frames, latency avg %.2f ms, max %.2f ms",
+      szName, pResult->iTelemetryPackets, pResult->uTelemetryLatencyAvgMicros/1000.0, pResult->uTelemetryLatencyP95Micros/1000.0, pResult->uTelemetryLatencyMaxMicros/1000.0,
+      pResult->iVideoFrames, pResult->uVideoLatencyAvgMicros/1000.0, pResult->uVideoLatencyMaxMicros/1000.0);
+   log_line("[%s] radio card: max %u frames queued, %u dropped (queue full), %u ms airtime; pacer: bursts avg %u packets, max %u packets, max backlog %.2f ms, video held %u times",
+      szName, pStats->uMaxQueuedFrames, pStats->uFramesDroppedQueueFull, (u32)(pStats->uAirtimeMicros/1000),
+      (pPacerStats->uBursts > 0)?(pPacerStats->uBurstsPackets/pPacerStats->uBursts):0, pPacerStats->uMaxBurstPackets,
+      pPacerStats->uMaxBacklogMicros/1000.0, pPacerStats->uVideoDeferrals);
+   return 1;
+}
+
+void _test_token_bucket()
+{
+   radio_pacer_init();
+   radio_pacer_set_enabled(1);
+   u32 uRate = 12000000;
+   u32 uAirtime = radio_pacer_get_packet_airtime_micros(1200, uRate);
+   _check_true("Airtime of a packet", (uAirtime > 800) && (uAirtime < 900));
+
+   // A full bucket lets a short burst through, then holds video
+   u32 uTime = 5000000;
+   int iSent = 0;
+   while ( radio_pacer_can_send_video(uTime) && (iSent < 100) )
+   {
+      radio_pacer_on_packet_sent(0, 1200, uRate, 0, uTime);
+      iSent++;
+   }
+   _check_true("Burst limited by the bucket depth", (iSent >= RADIO_PACER_VIDEO_BURST_MICROS/(int)uAirtime) && (iSent <= RADIO_PACER_VIDEO_BURST_MICROS/(int)uAirtime + 1));
+
+   // Priority packets are not held, and use the reserved share first
+   for( int i=0; i<3; i++ )
+      radio_pacer_on_packet_sent(0, 100, uRate, 1, uTime);
+   _check_true("Priority within the reserved share", 0 == radio_pacer_get_link_stats(0)->uPacketsPriorityOverShare);
+
+   // Over one second, video gets the paced share of the airtime
+   u32 uVideoAirtime = 0;
+   for( u32 uStep=0; uStep<1000000; uStep += 250 )
+   {
+      uTime += 250;
+      while ( radio_pacer_can_send_video(uTime) )
+      {
+         radio_pacer_on_packet_sent(0, 1200, uRate, 0, uTime);
+         uVideoAirtime += uAirtime;
+      }
+   }
+   int iExpected = 10000 * (RADIO_PACER_AIRTIME_PERCENT);
+   _check_true("Video airtime follows the pacing rate", ((int)uVideoAirtime > iExpected - 20000) && ((int)uVideoAirtime < iExpected + 20000));
+
+   // Heavy priority traffic goes over its share and takes airtime from video
+   for( int i=0; i<20; i++ )
+      radio_pacer_on_packet_sent(0, 1200, uRate, 1, uTime);
+   _check_true("Priority over the reserved share", radio_pacer_get_link_stats(0)->uPacketsPriorityOverShare > 0);
+   _check_true("Video held after priority burst", 0 == radio_pacer_can_send_video(uTime));
+
+   // Disabled pacer never holds video
+   radio_pacer_set_enabled(0);
+   _check_true("Disabled pacer", 1 == radio_pacer_can_send_video(uTime));
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestRadioPacer");
+   log_enable_stdout();
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-seconds")) && (i+1 < argc) )
+         s_iSeconds = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-mcs")) && (i+1 < argc) )
+         s_iDataRate = -1 - atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-iframe")) && (i+1 < argc) )
+         s_iIFramePackets = atoi(argv[++i]);
+   }
+   if ( s_iSeconds < 1 )
+      s_iSeconds = 1;
+   if ( s_iIFramePackets > BENCH_MAX_FRAME_PACKETS )
+      s_iIFramePackets = BENCH_MAX_FRAME_PACKETS;
+
+   _test_token_bucket();
+
+   t_bench_rx_result resultUnpaced, resultPaced;
+   t_radio_emulator_stats statsUnpaced, statsPaced;
+   t_radio_pacer_link_stats pacerUnpaced, pacerPaced;
+   _check_true("Unpaced run", _run_bench(false, &resultUnpaced, &statsUnpaced, &pacerUnpaced));
+   _check_true("Paced run", _run_bench(true, &resultPaced, &statsPaced, &pacerPaced));
+
+   int iFrames = s_iSeconds * BENCH_FPS;
+   _check_true("All video frames received", (resultUnpaced.iVideoFrames >= iFrames - 1) && (resultPaced.iVideoFrames >= iFrames - 1));
+   _check_true("No frames dropped by the radio card when paced", 0 == statsPaced.uFramesDroppedQueueFull);
+   _check_true("Smaller radio card queue when paced", statsPaced.uMaxQueuedFrames < statsUnpaced.uMaxQueuedFrames);
+   _check_true("Smaller bursts when paced", pacerPaced.uMaxBurstPackets < pacerUnpaced.uMaxBurstPackets);
+   _check_true("Lower telemetry max latency when paced", resultPaced.uTelemetryLatencyMaxMicros < resultUnpaced.uTelemetryLatencyMaxMicros);
+   _check_true("Telemetry p95 latency under 10 ms when paced", resultPaced.uTelemetryLatencyP95Micros < 10000);
+   // Smoothing delays the end of large frames a bit, by up to the airtime held back
+   _check_true("Video latency kept when paced", resultPaced.uVideoLatencyAvgMicros < resultUnpaced.uVideoLatencyAvgMicros + 1000000/BENCH_FPS);
+
+   log_line("Radio pacer tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,245 @@
+#include <vector>
+#include <algorithm>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/shared_mem.h"
+#include "../common/radio_stats_window.h"
+
+// Checks the incrementally updated rx stats window against a brute force recomputation over the last
+// slices, for random packet streams (signal, gaps, bad and lost packets, idle slices) and window sizes.
+// Usage: test_radio_stats_window [-slices n] [-seed n]
+
+typedef struct
+{
+   int iDbm;
+   u32 uGapMs;
+   int iIsBad;
+} t_test_packet;
+
+typedef struct
+{
+   std::vector<t_test_packet> packets;
+   u32 uLost;
+} t_test_slice;
+
+int s_iFailed = 0;
+int s_iTestSlices = 2000;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+static int _get_dbm_bucket(int iDbm)
+{
+   int iBucket = (iDbm - RADIO_STATS_WINDOW_DBM_MIN) / RADIO_STATS_WINDOW_DBM_BUCKET_SIZE;
+   if ( iDbm < RADIO_STATS_WINDOW_DBM_MIN )
+      iBucket = 0;
+   if ( iBucket >= RADIO_STATS_WINDOW_DBM_BUCKETS )
+      iBucket = RADIO_STATS_WINDOW_DBM_BUCKETS-1;
+   return iBucket;
+}
+
+static int _get_gap_bucket(u32 uGapMs)
+{
+   int iBucket = 0;
+   while ( uGapMs > 0 )
+   {
+      iBucket++;
+      uGapMs >>= 1;
+   }
+   if ( iBucket >= RADIO_STATS_WINDOW_GAP_BUCKETS )
+      iBucket = RADIO_STATS_WINDOW_GAP_BUCKETS-1;
+   return iBucket;
+}
+
+// The window reports the histogram bucket of the exact percentile value, clamped to the window min/max
+static int _get_expected_dbm_percentile(std::vector<int>& values, int iPercentile)
+{
+   u32 uTarget = ((u32)values.size() * (u32)iPercentile + 99) / 100;
+   if ( uTarget < 1 )
+      uTarget = 1;
+   int iBucket = _get_dbm_bucket(values[uTarget-1]);
+   int iDbm = RADIO_STATS_WINDOW_DBM_MIN + iBucket * RADIO_STATS_WINDOW_DBM_BUCKET_SIZE + RADIO_STATS_WINDOW_DBM_BUCKET_SIZE/2;
+   iDbm = std::max(iDbm, values.front());
+   iDbm = std::min(iDbm, values.back());
+   return iDbm;
+}
+
+static u32 _get_expected_gap_percentile(std::vector<u32>& values, int iPercentile)
+{
+   u32 uTarget = ((u32)values.size() * (u32)iPercentile + 99) / 100;
+   if ( uTarget < 1 )
+      uTarget = 1;
+   int iBucket = _get_gap_bucket(values[uTarget-1]);
+   u32 uGapMs = (0 == iBucket)?0:(((u32)1)<<iBucket) - 1;
+   return std::min(uGapMs, values.back());
+}
+
+static void _check_summary(const char* szTest, t_radio_stats_window* pWindow, std::vector<t_test_slice>& slices, int iSlices)
+{
+   int iFirst = std::max(0, (int)slices.size() - iSlices);
+   u32 uPackets = 0, uBad = 0, uLost = 0, uGapSum = 0;
+   int iDbmSum = 0;
+   std::vector<int> dbms;
+   std::vector<u32> gaps;
+   for( int i=iFirst; i<(int)slices.size(); i++ )
+   {
+      uLost += slices[i].uLost;
+      for( size_t k=0; k<slices[i].packets.size(); k++ )
+      {
+         t_test_packet* pPacket = &slices[i].packets[k];
+         uPackets++;
+         if ( pPacket->iIsBad )
+            uBad++;
+         if ( pPacket->iDbm < 500 )
+         {
+            dbms.push_back(pPacket->iDbm);
+            iDbmSum += pPacket->iDbm;
+         }
+         if ( pPacket->uGapMs != MAX_U32 )
+         {
+            gaps.push_back(pPacket->uGapMs);
+            uGapSum += pPacket->uGapMs;
+         }
+      }
+   }
+   std::sort(dbms.begin(), dbms.end());
+   std::sort(gaps.begin(), gaps.end());
+
+   shared_mem_radio_stats_window_summary* pSummary = &pWindow->summary;
+   int iOk = 1;
+   iOk = iOk && (pSummary->uWindowSlices == (u32)std::min((int)slices.size(), iSlices));
+   iOk = iOk && (pSummary->uPackets == uPackets) && (pSummary->uPacketsBad == uBad) && (pSummary->uPacketsLost == uLost);
+   int iQuality = 0;
+   if ( uPackets > 0 )
+      iQuality = 100 - (100*(uLost + uBad))/(uPackets + uLost);
+   iOk = iOk && (pSummary->iQuality == iQuality);
+
+   if ( dbms.empty() )
+      iOk = iOk && (pSummary->iDbmAvg == 1000) && (pSummary->iDbmMin == 1000) && (pSummary->iDbmMax == 1000) && (pSummary->iDbmP10 == 1000) && (pSummary->iDbmP50 == 1000);
+   else
+   {
+      iOk = iOk && (pSummary->iDbmAvg == iDbmSum/(int)dbms.size());
+      iOk = iOk && (pSummary->iDbmMin == dbms.front()) && (pSummary->iDbmMax == dbms.back());
+      iOk = iOk && (pSummary->iDbmP10 == _get_expected_dbm_percentile(dbms, 10));
+      iOk = iOk && (pSummary->iDbmP50 == _get_expected_dbm_percentile(dbms, 50));
+   }
+
+   if ( gaps.empty() )
+      iOk = iOk && (pSummary->uGapAvgMs == 0) && (pSummary->uGapMaxMs == 0) && (pSummary->uGapP50Ms == 0);
+   else
+   {
+      iOk = iOk && (pSummary->uGapAvgMs == uGapSum/(u32)gaps.size()) && (pSummary->uGapMaxMs == gaps.back());
+      iOk = iOk && (pSummary->uGapP50Ms == _get_expected_gap_percentile(gaps, 50));
+      iOk = iOk && (pSummary->uGapP90Ms == _get_expected_gap_percentile(gaps, 90));
+      iOk = iOk && (pSummary->uGapP99Ms == _get_expected_gap_percentile(gaps, 99));
+   }
+
+   if ( ! iOk )
+   {
+      log_line("%s: slice %d, window %d slices: packets %u/%u bad %u/%u lost %u/%u quality %d/%d dbm min %d/%d max %d/%d gap max %u/%u",
+         szTest, (int)slices.size(), iSlices, pSummary->uPackets, uPackets, pSummary->uPacketsBad, uBad, pSummary->uPacketsLost, uLost,
+         pSummary->iQuality, iQuality, pSummary->iDbmMin, dbms.empty()?1000:dbms.front(), pSummary->iDbmMax, dbms.empty()?1000:dbms.back(),
+         pSummary->uGapMaxMs, gaps.empty()?0:gaps.back());
+   }
+   _check_true(szTest, iOk);
+}
+
+void _test_empty_window()
+{
+   t_radio_stats_window window;
+   radio_stats_window_reset(&window, 10);
+   _check_true("reset: no slices", 0 == window.summary.uWindowSlices);
+   _check_true("reset: no quality", 0 == window.summary.iQuality);
+   _check_true("reset: no signal", (1000 == window.summary.iDbmMin) && (1000 == window.summary.iDbmMax) && (1000 == window.summary.iDbmAvg));
+
+   radio_stats_window_reset(&window, 1000);
+   _check_true("window size is clamped", RADIO_STATS_WINDOW_MAX_SLICES == window.iSlices);
+
+   radio_stats_window_reset(&window, 3);
+   radio_stats_window_set_bad_data(&window);
+   radio_stats_window_complete_slice(&window);
+   _check_true("bad data slice", (1 == window.summary.uPacketsBad) && (1 == window.summary.uPacketsLost));
+   for( int i=0; i<3; i++ )
+      radio_stats_window_complete_slice(&window);
+   _check_true("bad data slice leaves the window", (0 == window.summary.uPacketsBad) && (0 == window.summary.uPacketsLost) && (3 == window.summary.uWindowSlices));
+}
+
+void _test_random_stream(int iSlices)
+{
+   char szTest[128];
+   sprintf(szTest, "random stream, window of %d slices", iSlices);
+
+   t_radio_stats_window window;
+   radio_stats_window_reset(&window, iSlices);
+   int iWindowSlices = window.iSlices;
+   std::vector<t_test_slice> slices;
+   int iDbmBase = -60;
+   int iFailedBefore = s_iFailed;
+
+   for( int s=0; (s<s_iTestSlices) && (s_iFailed == iFailedBefore); s++ )
+   {
+      t_test_slice slice;
+      slice.uLost = 0;
+      // Signal drifts slowly, with fades and idle periods, to exercise the min/max queues
+      iDbmBase += (rand() % 7) - 3;
+      iDbmBase = std::max(-120, std::min(-5, iDbmBase));
+      int iMode = rand() % 20;
+      int iPackets = (0 == iMode)?0:(rand() % 200);
+      for( int k=0; k<iPackets; k++ )
+      {
+         t_test_packet packet;
+         packet.iDbm = iDbmBase + (rand() % 11) - 5;
+         if ( (1 == iMode) || (0 == (rand() % 50)) )
+            packet.iDbm = 1000;
+         packet.uGapMs = (u32)(rand() % 8);
+         if ( 0 == (rand() % 40) )
+            packet.uGapMs = (u32)(rand() % 3000);
+         if ( (0 == s) && (0 == k) )
+            packet.uGapMs = MAX_U32;
+         packet.iIsBad = (0 == (rand() % 30))?1:0;
+         slice.packets.push_back(packet);
+         radio_stats_window_add_packet(&window, packet.iDbm, packet.uGapMs, packet.iIsBad);
+         if ( 0 == (rand() % 25) )
+         {
+            u32 uLost = 1 + (u32)(rand() % 5);
+            slice.uLost += uLost;
+            radio_stats_window_add_lost(&window, uLost);
+         }
+      }
+      slices.push_back(slice);
+      radio_stats_window_complete_slice(&window);
+      _check_summary(szTest, &window, slices, iWindowSlices);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestRadioStatsWindow");
+   log_enable_stdout();
+
+   int iSeed = 1;
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-slices")) && (i < argc-1) )
+         s_iTestSlices = atoi(argv[++i]);
+      if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+   }
+   srand(iSeed);
+
+   _test_empty_window();
+   _test_random_stream(1);
+   _test_random_stream(3);
+   _test_random_stream(20);
+   _test_random_stream(RADIO_STATS_WINDOW_MAX_SLICES);
+   _test_random_stream(RADIO_STATS_WINDOW_MAX_SLICES+10);
+
+   log_line("Radio stats window tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
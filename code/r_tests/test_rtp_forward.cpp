@@ -0,0 +1,344 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/flags_video.h"
+#include "../r_station/rtp_forward.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+
+// Feeds synthetic H264/H265 Annex-B streams to the RTP forwarder in random sized chunks, receives the RTP
+// packets on two local UDP sinks, depacketizes them and checks the NAL units, sequence numbers and marker bits.
+// Also reports the packetizing/sending throughput.
+
+#define TEST_PORT 5610
+#define TEST_MAX_NALS 8000
+#define TEST_STREAM_SIZE (24*1024*1024)
+
+typedef struct
+{
+   int iOffset;
+   int iLength;
+   bool bLastInFrame;
+} t_test_nal;
+
+u8* s_pStream = NULL;
+int s_iStreamLength = 0;
+t_test_nal s_NALs[TEST_MAX_NALS];
+int s_iNALsCount = 0;
+int s_iFramesCount = 0;
+
+typedef struct
+{
+   int iSocket;
+   u8 uNAL[1024*1024];
+   int iNALLength;
+   bool bInFU;
+   int iNextNAL;
+   bool bHasSequence;
+   u16 uLastSequence;
+   u32 uLastTimestamp;
+   u32 uSSRC;
+   int iPackets;
+   int iMarkers;
+   int iErrors;
+} t_test_sink;
+
+t_test_sink s_Sinks[2];
+
+void _add_bytes(const u8* pData, int iLength)
+{
+   memcpy(s_pStream + s_iStreamLength, pData, iLength);
+   s_iStreamLength += iLength;
+}
+
+// NAL payload bytes are random values, with some single zero bytes and emulation prevention sequences.
+// A NAL never ends with a zero byte (rbsp trailing bits).
+void _add_nal(int iVideoType, int iType, bool bFirstSlice, int iLength, bool bLastInFrame)
+{
+   static int s_iStartCodeToggle = 0;
+   const u8 uStartCode[4] = { 0, 0, 0, 1 };
+   s_iStartCodeToggle++;
+   if ( s_iStartCodeToggle & 1 )
+      _add_bytes(uStartCode, 4);
+   else
+      _add_bytes(uStartCode+1, 3);
+
+   t_test_nal* pNAL = &s_NALs[s_iNALsCount++];
+   pNAL->iOffset = s_iStreamLength;
+   pNAL->iLength = iLength;
+   pNAL->bLastInFrame = bLastInFrame;
+
+   u8* pData = s_pStream + s_iStreamLength;
+   int iPos = 0;
+   if ( iVideoType == VIDEO_TYPE_H265 )
+   {
+      pData[iPos++] = (iType << 1);
+      pData[iPos++] = 1;
+   }
+   else
+      pData[iPos++] = 0x60 | iType;
+   pData[iPos++] = bFirstSlice?0x80:0x40;
+   while ( iPos < iLength )
+   {
+      bool bAfterZero = (0 == pData[iPos-1]);
+      if ( (iPos + 4 < iLength) && (! bAfterZero) && (0 == (rand() % 500)) )
+      {
+         pData[iPos++] = 0;
+         pData[iPos++] = 0;
+         pData[iPos++] = 3;
+         continue;
+      }
+      if ( (iPos + 1 < iLength) && (! bAfterZero) && (0 == (rand() % 300)) )
+         pData[iPos++] = 0;
+      else
+         pData[iPos++] = 1 + (rand() % 255);
+   }
+   s_iStreamLength += iLength;
+}
+
+void _build_stream(int iVideoType, int iFrames)
+{
+   s_iStreamLength = 0;
+   s_iNALsCount = 0;
+   s_iFramesCount = iFrames;
+   bool bH265 = (iVideoType == VIDEO_TYPE_H265);
+   for( int i=0; i<iFrames; i++ )
+   {
+      if ( 0 == (i % 30) )
+      {
+         if ( bH265 )
+            _add_nal(iVideoType, 32, false, 24, false);
+         _add_nal(iVideoType, bH265?33:7, false, 20, false);
+         _add_nal(iVideoType, bH265?34:8, false, 6, false);
+         // I frame in two slices
+         _add_nal(iVideoType, bH265?19:5, true, 30000 + rand() % 20000, false);
+         _add_nal(iVideoType, bH265?19:5, false, 20000 + rand() % 10000, true);
+      }
+      else
+         _add_nal(iVideoType, 1, true, 200 + rand() % 8000, true);
+   }
+   // Next access unit delimiter, so that the last frame is complete
+   const u8 uAUD264[6] = { 0, 0, 0, 1, 0x09, 0xF0 };
+   const u8 uAUD265[7] = { 0, 0, 0, 1, 0x46, 0x01, 0x50 };
+   if ( bH265 )
+      _add_bytes(uAUD265, 7);
+   else
+      _add_bytes(uAUD264, 6);
+}
+
+int _create_sink(int iPort)
+{
+   int iSocket = socket(AF_INET, SOCK_DGRAM, 0);
+   int iBufferSize = 8*1024*1024;
+   setsockopt(iSocket, SOL_SOCKET, SO_RCVBUFFORCE, &iBufferSize, sizeof(iBufferSize));
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(iPort);
+   addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+   if ( 0 != bind(iSocket, (struct sockaddr*)&addr, sizeof(addr)) )
+   {
+      log_line("FAILED: can't bind sink socket on port %d", iPort);
+      close(iSocket);
+      return -1;
+   }
+   fcntl(iSocket, F_SETFL, O_NONBLOCK);
+   return iSocket;
+}
+
+void _sink_on_nal(t_test_sink* pSink)
+{
+   if ( pSink->iNextNAL >= s_iNALsCount )
+   {
+      pSink->iErrors++;
+      return;
+   }
+   t_test_nal* pNAL = &s_NALs[pSink->iNextNAL];
+   if ( (pNAL->iLength != pSink->iNALLength) || (0 != memcmp(s_pStream + pNAL->iOffset, pSink->uNAL, pNAL->iLength)) )
+   {
+      if ( pSink->iErrors < 5 )
+         log_line("FAILED: NAL %d mismatch (length %d, expected %d)", pSink->iNextNAL, pSink->iNALLength, pNAL->iLength);
+      pSink->iErrors++;
+   }
+   pSink->iNextNAL++;
+}
+
+void _sink_on_packet(t_test_sink* pSink, int iVideoType, u8* pPacket, int iLength)
+{
+   pSink->iPackets++;
+   if ( (iLength < 13) || (pPacket[0] != 0x80) || ((pPacket[1] & 0x7F) != RTP_FORWARD_PAYLOAD_TYPE) )
+   {
+      pSink->iErrors++;
+      return;
+   }
+   u16 uSequence = (pPacket[2] << 8) | pPacket[3];
+   u32 uTimestamp = (pPacket[4] << 24) | (pPacket[5] << 16) | (pPacket[6] << 8) | pPacket[7];
+   u32 uSSRC = (pPacket[8] << 24) | (pPacket[9] << 16) | (pPacket[10] << 8) | pPacket[11];
+   bool bMarker = (pPacket[1] & 0x80)?true:false;
+   if ( pSink->bHasSequence )
+   {
+      if ( (uSequence != (u16)(pSink->uLastSequence + 1)) || (uSSRC != pSink->uSSRC) )
+      {
+         if ( pSink->iErrors < 5 )
+            log_line("FAILED: sequence gap %u -> %u", pSink->uLastSequence, uSequence);
+         pSink->iErrors++;
+      }
+   }
+   pSink->bHasSequence = true;
+   pSink->uLastSequence = uSequence;
+   pSink->uSSRC = uSSRC;
+   pSink->uLastTimestamp = uTimestamp;
+
+   u8* pPayload = pPacket + 12;
+   int iPayload = iLength - 12;
+   int iType = (iVideoType == VIDEO_TYPE_H265)?((pPayload[0] >> 1) & 0x3F):(pPayload[0] & 0x1F);
+   int iFUType = (iVideoType == VIDEO_TYPE_H265)?49:28;
+   if ( iType != iFUType )
+   {
+      memcpy(pSink->uNAL, pPayload, iPayload);
+      pSink->iNALLength = iPayload;
+      _sink_on_nal(pSink);
+   }
+   else
+   {
+      int iFUHeaderPos = (iVideoType == VIDEO_TYPE_H265)?2:1;
+      u8 uFU = pPayload[iFUHeaderPos];
+      if ( uFU & 0x80 )
+      {
+         if ( iVideoType == VIDEO_TYPE_H265 )
+         {
+            pSink->uNAL[0] = (pPayload[0] & 0x81) | ((uFU & 0x3F) << 1);
+            pSink->uNAL[1] = pPayload[1];
+            pSink->iNALLength = 2;
+         }
+         else
+         {
+            pSink->uNAL[0] = (pPayload[0] & 0xE0) | (uFU & 0x1F);
+            pSink->iNALLength = 1;
+         }
+         pSink->bInFU = true;
+      }
+      if ( ! pSink->bInFU )
+      {
+         pSink->iErrors++;
+         return;
+      }
+      memcpy(pSink->uNAL + pSink->iNALLength, pPayload + iFUHeaderPos + 1, iPayload - iFUHeaderPos - 1);
+      pSink->iNALLength += iPayload - iFUHeaderPos - 1;
+      if ( uFU & 0x40 )
+      {
+         pSink->bInFU = false;
+         _sink_on_nal(pSink);
+      }
+   }
+
+   // The marker bit must be set exactly on the last packet of each frame
+   bool bEndOfFrame = (! pSink->bInFU) && (pSink->iNextNAL > 0) && s_NALs[pSink->iNextNAL-1].bLastInFrame;
+   if ( bMarker != bEndOfFrame )
+   {
+      if ( pSink->iErrors < 5 )
+         log_line("FAILED: invalid marker bit on packet %u (NAL %d)", uSequence, pSink->iNextNAL);
+      pSink->iErrors++;
+   }
+   if ( bMarker )
+      pSink->iMarkers++;
+}
+
+void _drain_sinks(int iVideoType)
+{
+   u8 uPacket[2048];
+   for( int i=0; i<2; i++ )
+   {
+      while ( true )
+      {
+         int iLength = recv(s_Sinks[i].iSocket, uPacket, sizeof(uPacket), 0);
+         if ( iLength <= 0 )
+            break;
+         _sink_on_packet(&s_Sinks[i], iVideoType, uPacket, iLength);
+      }
+   }
+}
+
+int _run_test(int iVideoType, int iPacketSize, int iFrames, int iMaxChunkSize)
+{
+   _build_stream(iVideoType, iFrames);
+   for( int i=0; i<2; i++ )
+   {
+      int iSocket = s_Sinks[i].iSocket;
+      memset(&s_Sinks[i], 0, sizeof(t_test_sink));
+      s_Sinks[i].iSocket = iSocket;
+   }
+
+   rtp_forward_init(iVideoType, iPacketSize);
+   rtp_forward_add_destination("127.0.0.1", TEST_PORT);
+   rtp_forward_add_destination("127.0.0.1", TEST_PORT+1);
+
+   u32 uTimeSending = 0;
+   int iPos = 0;
+   u32 uTimeMs = 1000;
+   while ( iPos < s_iStreamLength )
+   {
+      // Mix of tiny chunks (start codes split across chunks) and larger chunks
+      int iChunk = (0 == (rand() % 4))?(1 + rand() % 8):(1 + rand() % iMaxChunkSize);
+      if ( iChunk > s_iStreamLength - iPos )
+         iChunk = s_iStreamLength - iPos;
+      u32 uStart = get_current_timestamp_micros();
+      rtp_forward_on_video_data(s_pStream + iPos, iChunk, uTimeMs);
+      rtp_forward_flush();
+      uTimeSending += get_current_timestamp_micros() - uStart;
+      iPos += iChunk;
+      uTimeMs += (rand() % 3);
+      _drain_sinks(iVideoType);
+   }
+   hardware_sleep_ms(20);
+   _drain_sinks(iVideoType);
+
+   int iFailed = 0;
+   t_rtp_forward_stats* pStats = rtp_forward_get_stats();
+   for( int i=0; i<2; i++ )
+   {
+      t_rtp_forward_destination_stats* pDestStats = rtp_forward_get_destination_stats(i);
+      if ( (s_Sinks[i].iErrors > 0) || (s_Sinks[i].iNextNAL != s_iNALsCount) || (s_Sinks[i].iMarkers != s_iFramesCount) || (pDestStats->uPacketsDropped > 0) )
+      {
+         log_line("FAILED: sink %d: %d errors, %d of %d NALs, %d of %d frames, %u dropped", i, s_Sinks[i].iErrors, s_Sinks[i].iNextNAL, s_iNALsCount, s_Sinks[i].iMarkers, s_iFramesCount, pDestStats->uPacketsDropped);
+         iFailed++;
+      }
+   }
+   t_rtp_forward_destination_stats* pDestStats = rtp_forward_get_destination_stats(0);
+   log_line("%s, %d bytes packets, chunks up to %d bytes: %d frames, %d NALs, %u single NAL packets, %u FU packets, %u sendmmsg calls (%.1f packets/call), %.1f MB/s (%u us for %d bytes)",
+      (iVideoType == VIDEO_TYPE_H265)?"H265":"H264", iPacketSize, iMaxChunkSize, pStats->uAccessUnits, pStats->uNALUnits,
+      pStats->uSingleNALPackets, pStats->uFragmentPackets, pDestStats->uSendCalls, (float)pDestStats->uPacketsSent/(float)(pDestStats->uSendCalls?pDestStats->uSendCalls:1),
+      (float)s_iStreamLength/(float)(uTimeSending?uTimeSending:1), uTimeSending, s_iStreamLength);
+   rtp_forward_uninit();
+   return iFailed;
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestRTPForward");
+   log_enable_stdout();
+   srand(1234);
+
+   s_pStream = (u8*)malloc(TEST_STREAM_SIZE);
+   s_Sinks[0].iSocket = _create_sink(TEST_PORT);
+   s_Sinks[1].iSocket = _create_sink(TEST_PORT+1);
+   if ( (NULL == s_pStream) || (s_Sinks[0].iSocket < 0) || (s_Sinks[1].iSocket < 0) )
+      return 1;
+
+   int iFailed = 0;
+   iFailed += _run_test(VIDEO_TYPE_H264, 1400, 300, 1400);
+   iFailed += _run_test(VIDEO_TYPE_H265, 1400, 300, 1400);
+   iFailed += _run_test(VIDEO_TYPE_H264, 500, 100, 1400);
+   iFailed += _run_test(VIDEO_TYPE_H265, 1472, 100, 1400);
+   // Whole frames at once: packets are sent in batches
+   iFailed += _run_test(VIDEO_TYPE_H264, 1400, 300, 64000);
+
+   close(s_Sinks[0].iSocket);
+   close(s_Sinks[1].iSocket);
+   free(s_pStream);
+   log_line("RTP forward tests: %s", iFailed?"FAILED":"PASSED");
+   return iFailed?1:0;
+}
@@ -0,0 +1,242 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/hardware_serial_io.h"
+#include "../base/hardware_radio_sik.h"
+#include "../radio/radiopackets_short.h"
+#include "../radio/radiopackets2.h"
+
+#include <time.h>
+#include <termios.h>
+#include <sys/resource.h>
+
+// Loopback test for the serial I/O engine, using a pseudo terminal pair instead of a SiK radio:
+// the pty slave is the "radio" serial port, the pty master plays the remote end (and the SiK firmware for AT commands).
+
+bool bQuit = false;
+
+void handle_sigint(int sig)
+{
+   log_line("Caught signal to stop: %d\n", sig);
+   bQuit = true;
+}
+
+int _open_pty_pair(int* piMaster, int* piSlave)
+{
+   int iMaster = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+   if ( iMaster < 0 )
+      return 0;
+   if ( (0 != grantpt(iMaster)) || (0 != unlockpt(iMaster)) )
+   {
+      close(iMaster);
+      return 0;
+   }
+   int iSlave = open(ptsname(iMaster), O_RDWR | O_NOCTTY | O_NONBLOCK);
+   if ( iSlave < 0 )
+   {
+      close(iMaster);
+      return 0;
+   }
+   struct termios options;
+   tcgetattr(iSlave, &options);
+   cfmakeraw(&options);
+   tcsetattr(iSlave, TCSANOW, &options);
+   *piMaster = iMaster;
+   *piSlave = iSlave;
+   return 1;
+}
+
+int _test_throughput(int iAirRate, int iDurationMs, int iMessageSize)
+{
+   int iMaster = -1, iSlave = -1;
+   if ( ! _open_pty_pair(&iMaster, &iSlave) )
+   {
+      log_line("Failed to open pty pair.");
+      return 0;
+   }
+
+   serial_io_add_port(iSlave, SERIAL_IO_FLAG_TX, iAirRate);
+
+   u8 uMessage[MAX_PACKET_TOTAL_SIZE];
+   for( int i=0; i<iMessageSize; i++ )
+      uMessage[i] = (u8)(i*7+3);
+
+   u8 uFrames[MAX_PACKET_TOTAL_SIZE*2];
+   u8 uRxBuffer[8192];
+   int iRxBufferPos = 0;
+   int iQueuedMessages = 0;
+   int iRxValidFrames = 0;
+   int iRxBytes = 0;
+   int iFramesPerMessage = 0;
+
+   u32 uTimeStart = get_current_timestamp_ms();
+   while ( (! bQuit) && (get_current_timestamp_ms() < uTimeStart + iDurationMs) )
+   {
+      // Keep the tx queue fed, like the radio tx thread does for a saturated link
+      while ( serial_io_get_tx_pending_bytes(iSlave) < iAirRate/10 + 2*MAX_PACKET_TOTAL_SIZE )
+      {
+         int iLen = radio_packets_short_build_frames(0, uMessage, iMessageSize, DEFAULT_SIK_PACKET_SIZE, uFrames, sizeof(uFrames));
+         if ( iLen <= 0 )
+            break;
+         if ( 0 == iFramesPerMessage )
+            iFramesPerMessage = (iLen - iMessageSize)/(int)sizeof(t_packet_header_short);
+         if ( serial_io_queue_write(iSlave, uFrames, iLen) != iLen )
+            break;
+         iQueuedMessages++;
+      }
+      serial_io_poll(5);
+
+      int iRead = read(iMaster, &uRxBuffer[iRxBufferPos], sizeof(uRxBuffer) - iRxBufferPos);
+      if ( iRead <= 0 )
+         continue;
+      iRxBytes += iRead;
+      iRxBufferPos += iRead;
+
+      int iPos = 0;
+      while ( iPos + (int)sizeof(t_packet_header_short) <= iRxBufferPos )
+      {
+         if ( ! radio_buffer_is_valid_short_packet(&uRxBuffer[iPos], iRxBufferPos - iPos) )
+         {
+            iPos++;
+            continue;
+         }
+         iRxValidFrames++;
+         iPos += sizeof(t_packet_header_short) + ((t_packet_header_short*)&uRxBuffer[iPos])->data_length;
+      }
+      memmove(uRxBuffer, &uRxBuffer[iPos], iRxBufferPos - iPos);
+      iRxBufferPos -= iPos;
+   }
+   u32 uDuration = get_current_timestamp_ms() - uTimeStart;
+
+   t_serial_io_port_stats stats;
+   u32 uWrites = serial_io_get_port_stats(iSlave, &stats)?stats.uTotalTxWrites:0;
+   serial_io_remove_port(iSlave);
+   close(iSlave);
+   close(iMaster);
+
+   int iRate = (int)(((u64)iRxBytes * 1000) / (uDuration?uDuration:1));
+   log_line("Air rate %6d bytes/sec: received %d bytes in %u ms => %d bytes/sec (%d%% of air rate), %d valid frames (%d frames/msg), %u writes, %d msgs queued.",
+      iAirRate, iRxBytes, uDuration, iRate, (iAirRate > 0)?(iRate*100/iAirRate):0, iRxValidFrames, iFramesPerMessage, uWrites, iQueuedMessages);
+
+   if ( iAirRate <= 0 )
+      return (iRxValidFrames > 0)?1:0;
+   // The link must be saturated, but not exceeded (allowing for the initial burst credit)
+   int iMaxBytes = iAirRate * (int)uDuration / 1000 + iAirRate * SERIAL_IO_MAX_BURST_MS / 1000 + 64;
+   if ( iRate < iAirRate * 90 / 100 )
+      return 0;
+   if ( iRxBytes > iMaxBytes )
+      return 0;
+   return 1;
+}
+
+int _test_at_driver()
+{
+   int iMaster = -1, iSlave = -1;
+   if ( ! _open_pty_pair(&iMaster, &iSlave) )
+   {
+      log_line("Failed to open pty pair.");
+      return 0;
+   }
+
+   radio_hw_info_t radioInfo;
+   memset(&radioInfo, 0, sizeof(radioInfo));
+
+   t_sik_at_driver driver;
+   hardware_radio_sik_at_driver_init(&driver, iSlave);
+   int iCount = hardware_radio_sik_at_driver_add_params(&driver, &radioInfo, 433000, DEFAULT_RADIO_SIK_FREQ_SPREAD, DEFAULT_RADIO_SIK_CHANNELS, DEFAULT_RADIO_SIK_NETID, 64000, 11, 0, 0, 0);
+   log_line("AT driver: %d params to set, %d commands.", iCount, driver.iCommandsCount);
+
+   char szLine[256];
+   int iLinePos = 0;
+   int iCommandsAnswered = 0;
+   int iMaxLoopTimeMs = 0;
+   u32 uTimeStart = get_current_timestamp_ms();
+   u32 uTimeReboot = 0;
+   int iState = SIK_AT_STATE_IDLE;
+   while ( (! bQuit) && (get_current_timestamp_ms() < uTimeStart + 5000) )
+   {
+      u32 uT1 = get_current_timestamp_ms();
+      iState = hardware_radio_sik_at_driver_step(&driver, uT1);
+      int iDT = get_current_timestamp_ms() - uT1;
+      if ( iDT > iMaxLoopTimeMs )
+         iMaxLoopTimeMs = iDT;
+      if ( (iState == SIK_AT_STATE_FINISHED) || (iState == SIK_AT_STATE_FAILED) )
+         break;
+
+      // Fake SiK firmware on the other end of the pty
+      u8 c;
+      while ( 1 == read(iMaster, &c, 1) )
+      {
+         if ( iLinePos < (int)sizeof(szLine)-1 )
+            szLine[iLinePos++] = c;
+         szLine[iLinePos] = 0;
+         if ( 0 == strcmp(szLine, "+++") )
+         {
+            write(iMaster, "OK\r\n", 4);
+            iLinePos = 0;
+         }
+         else if ( c == '\r' )
+         {
+            // The radio reboots, it does not answer
+            if ( 0 == strcmp(szLine, "ATZ\r") )
+            {
+               uTimeReboot = get_current_timestamp_ms();
+               iLinePos = 0;
+               continue;
+            }
+            char szResponse[300];
+            snprintf(szResponse, sizeof(szResponse), "%s\nOK\r\n", szLine);
+            write(iMaster, szResponse, strlen(szResponse));
+            iCommandsAnswered++;
+            iLinePos = 0;
+         }
+      }
+      hardware_sleep_ms(2);
+   }
+
+   u32 uTimeFinished = get_current_timestamp_ms();
+   int iFailed = hardware_radio_sik_at_driver_apply_params(&driver, &radioInfo);
+   close(iSlave);
+   close(iMaster);
+   log_line("AT driver: final state %d, %d commands answered, %d failed params, max step time: %d ms, freq param: %u, finished %u ms after reboot",
+      iState, iCommandsAnswered, iFailed, iMaxLoopTimeMs, radioInfo.uHardwareParamsList[8], (0 != uTimeReboot)?(uTimeFinished - uTimeReboot):0);
+   // Must not finish before the radio had the time to reboot
+   if ( (0 == uTimeReboot) || (uTimeFinished < uTimeReboot + SIK_AT_REBOOT_TIME_MS) )
+      return 0;
+   return ((iState == SIK_AT_STATE_FINISHED) && (0 == iFailed) && (radioInfo.uHardwareParamsList[8] == 433000))?1:0;
+}
+
+int main(int argc, char *argv[])
+{
+   signal(SIGINT, handle_sigint);
+   signal(SIGTERM, handle_sigint);
+   signal(SIGQUIT, handle_sigint);
+
+   log_init("TestSerialIO");
+   log_enable_stdout();
+
+   int iDurationMs = 2000;
+   if ( argc > 1 )
+      iDurationMs = atoi(argv[1]);
+
+   serial_io_init();
+   int iFailed = 0;
+   int iAirRates[] = { 500, 2000, 8000, 16000 };
+   for( int i=0; i<(int)(sizeof(iAirRates)/sizeof(iAirRates[0])); i++ )
+   {
+      if ( ! _test_throughput(iAirRates[i], iDurationMs, 100) )
+      {
+         log_line("FAILED: throughput test at air rate %d bytes/sec", iAirRates[i]);
+         iFailed++;
+      }
+   }
+   if ( ! _test_at_driver() )
+   {
+      log_line("FAILED: AT commands driver test");
+      iFailed++;
+   }
+   serial_io_uninit();
+
+   log_line("Serial I/O tests: %s", iFailed?"FAILED":"PASSED");
+   return iFailed?1:0;
+}
@@ -0,0 +1,108 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../common/string_utils.h"
+#include "../radio/radiopackets2.h"
+
+#include <pthread.h>
+
+// Checks the packet types/components names tables and the frequency/datarate formatting helpers,
+// measures their cost and checks that concurrent callers don't overwrite each other's results.
+
+int s_iFailed = 0;
+
+void _check(const char* szResult, const char* szExpected)
+{
+   if ( 0 == strcmp(szResult, szExpected) )
+      return;
+   log_line("FAILED: got [%s], expected [%s]", szResult, szExpected);
+   s_iFailed++;
+}
+
+void* _thread_format_frequencies(void* pParam)
+{
+   u32 uFrequencyKhz = *((u32*)pParam);
+   char szExpected[32];
+   strcpy(szExpected, str_format_frequency(uFrequencyKhz));
+   for( int i=0; i<200000; i++ )
+   {
+      char* szFreq = str_format_frequency(uFrequencyKhz);
+      const char* szType = str_get_packet_type(240 + (uFrequencyKhz & 0x07));
+      if ( (0 != strcmp(szFreq, szExpected)) || (0 != strncmp(szType, "Unknown", 7)) )
+      {
+         log_line("FAILED: frequency formatting clobbered by another thread: [%s]", szFreq);
+         s_iFailed++;
+         break;
+      }
+   }
+   return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestStrings");
+   log_enable_stdout();
+
+   _check(str_get_packet_type(PACKET_TYPE_COMMAND), "PACKET_TYPE_COMMAND");
+   _check(str_get_packet_type(PACKET_TYPE_OTA_UPDATE_STATUS), "PACKET_TYPE_OTA_UPDATE_STATUS");
+   _check(str_get_packet_type(PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SEND_MODEL_SETTINGS), "PACKET_TYPE_LOCAL_CONTROL_VEHICLE_SEND_MODEL_SETTINGS");
+   _check(str_get_packet_type(251), "Unknown 251");
+   _check(str_get_packet_type(-1), "Unknown -1");
+   char szBuff[64];
+   _check(str_format_packet_type(PACKET_TYPE_VIDEO_DATA_98, szBuff, 16), "PACKET_TYPE_VID");
+   _check(str_get_component_id(PACKET_COMPONENT_AUDIO), "PACKET_COMPONENT_AUDIO");
+   _check(str_get_component_id(PACKET_COMPONENT_LOCAL_CONTROL), "PACKET_COMPONENT_LOCAL_CONTROL");
+   _check(str_get_component_id(7), "INVALID");
+
+   _check(str_format_frequency(5745000), "5745 Mhz");
+   _check(str_format_frequency(2412), "2412 Mhz");
+   _check(str_format_frequency(433500), "433.5 Mhz");
+   _check(str_format_frequency(433250), "433.25 Mhz");
+   _check(str_format_frequency(433050), "433.05 Mhz");
+   _check(str_format_frequency(868125), "868.125 Mhz");
+   _check(str_format_frequency_no_sufix(915500), "915.5");
+
+   str_getDataRateDescription(-1, 0, szBuff);
+   _check(szBuff, "MCS-0 6 Mb");
+   str_getDataRateDescription(-4, 1, szBuff);
+   _check(szBuff, "MCS-3 52 Mb");
+   str_getDataRateDescription(18, 0, szBuff);
+   _check(szBuff, "*18 Mbps");
+   str_getDataRateDescription(64000, 0, szBuff);
+   _check(szBuff, "64 kbps");
+   str_getDataRateDescription(2000000, 0, szBuff);
+   _check(szBuff, "2 Mbps");
+   str_getDataRateDescription(9600, 0, szBuff);
+   _check(szBuff, "9600 bps");
+
+   int iLoops = 1000000;
+   u32 uLength = 0;
+   u32 uStart = get_current_timestamp_micros();
+   for( int i=0; i<iLoops; i++ )
+      uLength += strlen(str_get_packet_type(i & 0xFF));
+   u32 uTimePacketTypes = get_current_timestamp_micros() - uStart;
+
+   uStart = get_current_timestamp_micros();
+   for( int i=0; i<iLoops; i++ )
+      uLength += strlen(str_format_frequency(2400000 + (i & 0xFF)*5));
+   u32 uTimeFrequencies = get_current_timestamp_micros() - uStart;
+
+   uStart = get_current_timestamp_micros();
+   for( int i=0; i<iLoops; i++ )
+   {
+      str_getDataRateDescription(-1 - (i % (MAX_MCS_INDEX+1)), i & 1, szBuff);
+      uLength += strlen(szBuff);
+   }
+   u32 uTimeDatarates = get_current_timestamp_micros() - uStart;
+
+   log_line("%d lookups: packet types: %u us, frequencies: %u us, datarates: %u us (%u chars)", iLoops, uTimePacketTypes, uTimeFrequencies, uTimeDatarates, uLength);
+
+   pthread_t pThreads[2];
+   u32 uFrequencies[2] = { 2412000, 5745125 };
+   for( int i=0; i<2; i++ )
+      pthread_create(&pThreads[i], NULL, &_thread_format_frequencies, &uFrequencies[i]);
+   for( int i=0; i<2; i++ )
+      pthread_join(pThreads[i], NULL);
+
+   log_line("Strings tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
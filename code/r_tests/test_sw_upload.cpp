@@ -0,0 +1,755 @@
+#include <deque>
+#include <vector>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware_radio.h"
+#include "../base/hw_procs.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radioflags.h"
+#include "../radio/radiolink.h"
+#include "../radio/radio_emulator.h"
+#include "../radio/fec.h"
+#include "../common/sw_upload.h"
+
+#include <sys/select.h>
+#include <sys/wait.h>
+
+// Checks the windowed software upload (common/sw_upload.h) over a simulated lossy link: the received
+// archive, FEC recovery, resume from the saved state and the failed CRC check. Then uploads the same
+// archive over the emulated radio medium, with the previous stop-and-wait upload (ack every
+// DEFAULT_UPLOAD_PACKET_CONFIRMATION_FREQUENCY segments, each segment sent twice) and with the windowed
+// upload, and compares the transfer times.
+// Usage: test_sw_upload [-size bytes] [-loss per thousand] [-latency us] [-seed n]
+
+#define TEST_FOLDER "/tmp/test_sw_upload/"
+#define TEST_FREQUENCY_KHZ 5805000
+
+#define TEST_PACKET_OLD_SEGMENT 1
+#define TEST_PACKET_OLD_RESPONSE 2
+#define TEST_PACKET_SEGMENT 3
+#define TEST_PACKET_ACK 4
+#define TEST_PACKET_END 5
+
+typedef struct
+{
+   u8 uKind;
+   u8 uWantsResponse;
+   u8 uResponseOk;
+   u8 uReserved;
+   u32 uCounter;
+} __attribute__((packed)) t_test_packet_header;
+
+typedef struct
+{
+   int iLossPercent;
+   int iLatencyMs;
+   int iFECData;
+   int iFECParity;
+   u32 uStopAfterMs; // interrupts the upload, 0 for none
+} t_test_sim_params;
+
+typedef struct
+{
+   int bCompleted;
+   u32 uTimeMs;
+   u32 uDataSegmentsSent;
+   u32 uRetransmissions;
+   u32 uFECSegmentsSent;
+   u32 uRecoveredWithFEC;
+   int bResumed;
+   u32 uSegmentsResumed;
+   u8 uReceiverStatus;
+} t_test_sim_result;
+
+typedef struct
+{
+   u32 uDeliveryTime;
+   std::vector<u8> data;
+} t_test_sim_packet;
+
+int s_iFailed = 0;
+u32 s_uEmulatedSize = 400000;
+int s_iEmulatedLossPerThousand = 100;
+int s_iEmulatedLatencyMicros = 15000;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u64 _now_micros()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return ((u64)t.tv_sec)*1000000LL + ((u64)t.tv_nsec)/1000LL;
+}
+
+void _fill_archive(std::vector<u8>& archive, u32 uSize)
+{
+   archive.resize(uSize);
+   for( u32 u=0; u<uSize; u++ )
+      archive[u] = (u8)(rand() & 0xFF);
+}
+
+int _is_received_archive_ok(const char* szFile, std::vector<u8>& archive)
+{
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+      return 0;
+   std::vector<u8> received(archive.size() + 1);
+   size_t uRead = fread(&received[0], 1, received.size(), fd);
+   fclose(fd);
+   return ((uRead == archive.size()) && (0 == memcmp(&received[0], &archive[0], archive.size())))?1:0;
+}
+
+void _clean_test_folder()
+{
+   char szComm[256];
+   sprintf(szComm, "rm -rf %s; mkdir -p %s", TEST_FOLDER, TEST_FOLDER);
+   hw_execute_bash_command_silent(szComm, NULL);
+}
+
+// One segment per millisecond on the link, iLatencyMs each way, random loss in both directions
+
+void _simulate_upload(t_test_sim_params* pParams, std::vector<u8>& archive, t_sw_upload_receiver* pReceiver, t_test_sim_result* pResult)
+{
+   memset(pResult, 0, sizeof(t_test_sim_result));
+   t_sw_upload_sender sender;
+   if ( ! sw_upload_sender_init(&sender, &archive[0], (u32)archive.size(), 1, SW_UPLOAD_DEFAULT_SEGMENT_SIZE, pParams->iFECData, pParams->iFECParity, SW_UPLOAD_DEFAULT_WINDOW_SEGMENTS) )
+      return;
+
+   std::deque<t_test_sim_packet> uplink;
+   std::deque<t_test_sim_packet> downlink;
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   u32 uTimeStart = 1000;
+   u32 uTimeNow = uTimeStart;
+   while ( (! sw_upload_sender_is_complete(&sender)) && (uTimeNow < uTimeStart + 600000) )
+   {
+      if ( (0 != pParams->uStopAfterMs) && (uTimeNow >= uTimeStart + pParams->uStopAfterMs) )
+         break;
+      if ( SW_UPLOAD_STATUS_IN_PROGRESS != sender.uRemoteStatus )
+         break;
+      uTimeNow++;
+
+      while ( (! uplink.empty()) && (uplink.front().uDeliveryTime <= uTimeNow) )
+      {
+         t_test_sim_packet packet = uplink.front();
+         uplink.pop_front();
+         sw_upload_receiver_process_segment(pReceiver, TEST_FOLDER, &packet.data[0], (int)packet.data.size());
+         command_packet_sw_upload_segment* pSegment = (command_packet_sw_upload_segment*)&packet.data[0];
+         if ( ! (pSegment->uFlags & SW_UPLOAD_FLAG_ACK_REQUEST) )
+            continue;
+         t_test_sim_packet ack;
+         ack.uDeliveryTime = uTimeNow + (u32)pParams->iLatencyMs;
+         ack.data.resize(sizeof(t_sw_upload_ack));
+         sw_upload_receiver_get_ack(pReceiver, pSegment->uAckRequestId, (t_sw_upload_ack*)&ack.data[0]);
+         if ( (rand() % 100) >= pParams->iLossPercent )
+            downlink.push_back(ack);
+      }
+      while ( (! downlink.empty()) && (downlink.front().uDeliveryTime <= uTimeNow) )
+      {
+         sw_upload_sender_on_ack(&sender, (t_sw_upload_ack*)&downlink.front().data[0], uTimeNow);
+         downlink.pop_front();
+      }
+
+      int iLength = sw_upload_sender_get_next_segment(&sender, uTimeNow, uBuffer, sizeof(uBuffer));
+      if ( iLength <= 0 )
+         continue;
+      command_packet_sw_upload_segment* pSegment = (command_packet_sw_upload_segment*)uBuffer;
+      if ( pSegment->uSegmentIndex < sender.uSegmentsCount )
+         pResult->uDataSegmentsSent++;
+      if ( (rand() % 100) < pParams->iLossPercent )
+         continue;
+      t_test_sim_packet packet;
+      packet.uDeliveryTime = uTimeNow + (u32)pParams->iLatencyMs;
+      packet.data.assign(uBuffer, uBuffer + iLength);
+      uplink.push_back(packet);
+   }
+
+   pResult->bCompleted = sw_upload_sender_is_complete(&sender);
+   pResult->uTimeMs = uTimeNow - uTimeStart;
+   pResult->uRetransmissions = sender.uRetransmissions;
+   pResult->uFECSegmentsSent = sender.uFECSegmentsSent;
+   pResult->uRecoveredWithFEC = pReceiver->uSegmentsRecoveredWithFEC;
+   pResult->bResumed = pReceiver->bResumed;
+   pResult->uSegmentsResumed = pReceiver->uSegmentsResumed;
+   pResult->uReceiverStatus = pReceiver->uStatus;
+   log_line("Simulated upload (loss %d%%, latency %d ms, FEC %d/%d): %s in %u ms, %u of %u data segments sent, %u retransmissions, %u FEC segments sent, %u recovered with FEC, %u resumed, RTT %u ms",
+      pParams->iLossPercent, pParams->iLatencyMs, pParams->iFECData, pParams->iFECParity, pResult->bCompleted?"completed":"not completed",
+      pResult->uTimeMs, pResult->uDataSegmentsSent, sender.uSegmentsCount, pResult->uRetransmissions, pResult->uFECSegmentsSent,
+      pResult->uRecoveredWithFEC, pResult->uSegmentsResumed, sender.uSmoothedRTTMs);
+   sw_upload_sender_uninit(&sender);
+}
+
+void _test_simulated_link()
+{
+   std::vector<u8> archive;
+   _fill_archive(archive, 600000 + 123);
+   u32 uSegments = (u32)(archive.size() + SW_UPLOAD_DEFAULT_SEGMENT_SIZE - 1) / SW_UPLOAD_DEFAULT_SEGMENT_SIZE;
+   t_sw_upload_receiver receiver;
+   t_test_sim_params params;
+   t_test_sim_result result;
+   char szArchive[MAX_FILE_PATH_SIZE];
+   sprintf(szArchive, "%sruby_update.tar", TEST_FOLDER);
+
+   _clean_test_folder();
+   sw_upload_receiver_init(&receiver);
+   memset(&params, 0, sizeof(params));
+   params.iLatencyMs = 20;
+   _simulate_upload(&params, archive, &receiver, &result);
+   _check_true("clean link: completed", result.bCompleted && (SW_UPLOAD_STATUS_COMPLETED == result.uReceiverStatus));
+   _check_true("clean link: no retransmissions", (0 == result.uRetransmissions) && (result.uDataSegmentsSent == uSegments));
+   _check_true("clean link: bounded by throughput", result.uTimeMs < uSegments + 10*(u32)params.iLatencyMs);
+   sw_upload_receiver_close(&receiver, 0);
+   _check_true("clean link: archive ok", _is_received_archive_ok(szArchive, archive));
+
+   _clean_test_folder();
+   sw_upload_receiver_init(&receiver);
+   params.iLossPercent = 10;
+   _simulate_upload(&params, archive, &receiver, &result);
+   _check_true("10% loss: completed", result.bCompleted && (SW_UPLOAD_STATUS_COMPLETED == result.uReceiverStatus));
+   _check_true("10% loss: bounded by throughput", result.uTimeMs < (uSegments * 13)/10 + 20*(u32)params.iLatencyMs);
+   u32 uRetransmissionsNoFEC = result.uRetransmissions;
+   sw_upload_receiver_close(&receiver, 0);
+   _check_true("10% loss: archive ok", _is_received_archive_ok(szArchive, archive));
+
+   _clean_test_folder();
+   sw_upload_receiver_init(&receiver);
+   params.iFECData = 16;
+   params.iFECParity = 4;
+   _simulate_upload(&params, archive, &receiver, &result);
+   _check_true("10% loss, FEC: completed", result.bCompleted && (SW_UPLOAD_STATUS_COMPLETED == result.uReceiverStatus));
+   _check_true("10% loss, FEC: segments recovered", result.uRecoveredWithFEC > 0);
+   _check_true("10% loss, FEC: fewer retransmissions", result.uRetransmissions < uRetransmissionsNoFEC);
+   sw_upload_receiver_close(&receiver, 0);
+   _check_true("10% loss, FEC: archive ok", _is_received_archive_ok(szArchive, archive));
+
+   // Interrupted half way (controller and vehicle restarted), then resumed
+   _clean_test_folder();
+   sw_upload_receiver_init(&receiver);
+   params.iFECData = 0;
+   params.iFECParity = 0;
+   params.uStopAfterMs = uSegments/2;
+   _simulate_upload(&params, archive, &receiver, &result);
+   _check_true("interrupted: not completed", (! result.bCompleted) && (SW_UPLOAD_STATUS_IN_PROGRESS == receiver.uStatus));
+   sw_upload_receiver_close(&receiver, 0);
+   sw_upload_receiver_init(&receiver);
+   params.uStopAfterMs = 0;
+   _simulate_upload(&params, archive, &receiver, &result);
+   _check_true("resumed: completed", result.bCompleted && (SW_UPLOAD_STATUS_COMPLETED == result.uReceiverStatus));
+   _check_true("resumed: from saved state", result.bResumed && (result.uSegmentsResumed > uSegments/4));
+   _check_true("resumed: sent only the missing segments", result.uDataSegmentsSent < (uSegments*3)/4);
+   sw_upload_receiver_close(&receiver, 0);
+   _check_true("resumed: archive ok", _is_received_archive_ok(szArchive, archive));
+
+   // Interrupted, then another archive is uploaded: starts from zero
+   _clean_test_folder();
+   sw_upload_receiver_init(&receiver);
+   params.iLossPercent = 0;
+   params.uStopAfterMs = uSegments/2;
+   _simulate_upload(&params, archive, &receiver, &result);
+   sw_upload_receiver_close(&receiver, 0);
+   archive[10] ^= 0x55;
+   sw_upload_receiver_init(&receiver);
+   params.uStopAfterMs = 0;
+   _simulate_upload(&params, archive, &receiver, &result);
+   _check_true("other archive: not resumed", (! result.bResumed) && (result.uDataSegmentsSent == uSegments));
+   sw_upload_receiver_close(&receiver, 0);
+   _check_true("other archive: archive ok", _is_received_archive_ok(szArchive, archive));
+
+   // Data changed after the upload id was computed: the CRC check fails
+   _clean_test_folder();
+   sw_upload_receiver_init(&receiver);
+   t_sw_upload_sender sender;
+   sw_upload_sender_init(&sender, &archive[0], (u32)archive.size(), 1, SW_UPLOAD_DEFAULT_SEGMENT_SIZE, 0, 0, SW_UPLOAD_DEFAULT_WINDOW_SEGMENTS);
+   archive[archive.size()-1] ^= 0x01;
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   u32 uTimeNow = 1000;
+   int iLength = 0;
+   t_sw_upload_ack ack;
+   for( int i=0; (i<100000) && (SW_UPLOAD_STATUS_IN_PROGRESS == receiver.uStatus); i++ )
+   {
+      uTimeNow++;
+      while ( (iLength = sw_upload_sender_get_next_segment(&sender, uTimeNow, uBuffer, sizeof(uBuffer))) > 0 )
+      {
+         sw_upload_receiver_process_segment(&receiver, TEST_FOLDER, uBuffer, iLength);
+         command_packet_sw_upload_segment* pSegment = (command_packet_sw_upload_segment*)uBuffer;
+         if ( ! (pSegment->uFlags & SW_UPLOAD_FLAG_ACK_REQUEST) )
+            continue;
+         sw_upload_receiver_get_ack(&receiver, pSegment->uAckRequestId, &ack);
+         sw_upload_sender_on_ack(&sender, &ack, uTimeNow);
+      }
+   }
+   _check_true("bad CRC: upload failed", (SW_UPLOAD_STATUS_FAILED == receiver.uStatus) && (SW_UPLOAD_STATUS_FAILED == sender.uRemoteStatus));
+   _check_true("bad CRC: not complete", ! sw_upload_sender_is_complete(&sender));
+   sw_upload_sender_uninit(&sender);
+   sw_upload_receiver_close(&receiver, 1);
+   _check_true("bad CRC: files removed", 0 != access(szArchive, F_OK));
+}
+
+//-----------------------------------------------------
+// Emulated radio link
+
+int _open_emulated_interface(int iPort)
+{
+   // The receiver process is forked from the sender, so it gets its radio interfaces too
+   static int s_bAddedEmulatedRadio = 0;
+   if ( ! s_bAddedEmulatedRadio )
+      hardware_radio_add_emulated_radios(1);
+   s_bAddedEmulatedRadio = 1;
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(0);
+   if ( NULL == pRadioHWInfo )
+      return -1;
+   pRadioHWInfo->uCurrentFrequencyKhz = TEST_FREQUENCY_KHZ;
+
+   radio_init_link_structures();
+   radio_set_frames_flags(RADIO_FLAGS_FRAME_TYPE_DATA);
+   radio_set_out_datarate(-4);
+   t_radio_emulator_params params;
+   radio_emulator_reset_params(&params);
+   params.uSeed = (u32)getpid();
+   params.iLossPerThousand = s_iEmulatedLossPerThousand;
+   params.iLatencyMicros = s_iEmulatedLatencyMicros;
+   radio_emulator_set_params(&params);
+
+   int iSocket = radio_open_interface_for_read(0, iPort);
+   if ( (iSocket < 0) || (radio_open_interface_for_write(0) < 0) )
+      return -1;
+   return iSocket;
+}
+
+void _send_packet(int iPort, t_test_packet_header* pHeader, u8* pData, int iLength)
+{
+   static u32 s_uStreamPacketIndex = 0;
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE];
+   t_packet_header* pPH = (t_packet_header*)uPacket;
+   radio_packet_init(pPH, PACKET_COMPONENT_COMMANDS, (RADIO_PORT_ROUTER_UPLINK == iPort)?PACKET_TYPE_COMMAND:PACKET_TYPE_COMMAND_RESPONSE, STREAM_ID_DATA);
+   pPH->vehicle_id_src = 1234;
+   pPH->vehicle_id_dest = 0;
+   pPH->total_length = sizeof(t_packet_header) + sizeof(t_test_packet_header) + iLength;
+   pPH->stream_packet_idx |= (s_uStreamPacketIndex++) & PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
+   memcpy(uPacket + sizeof(t_packet_header), pHeader, sizeof(t_test_packet_header));
+   if ( iLength > 0 )
+      memcpy(uPacket + sizeof(t_packet_header) + sizeof(t_test_packet_header), pData, iLength);
+
+   u8 uRawPacket[MAX_PACKET_LENGTH_PCAP];
+   int iRawLength = radio_build_new_raw_packet(0, uRawPacket, uPacket, pPH->total_length, iPort, 0);
+   radio_write_raw_packet(0, uRawPacket, iRawLength);
+}
+
+// Returns the next received test packet (header followed by its data) or NULL after the timeout
+
+u8* _receive_packet(int iSocket, u32 uTimeoutMicros, int* piDataLength)
+{
+   u64 uTimeEnd = _now_micros() + uTimeoutMicros;
+   while ( 1 )
+   {
+      int iLength = 0;
+      u8* pBuffer = radio_process_wlan_data_in(0, &iLength);
+      if ( NULL == pBuffer )
+      {
+         u64 uTimeNow = _now_micros();
+         if ( uTimeNow >= uTimeEnd )
+            return NULL;
+         fd_set readSet;
+         FD_ZERO(&readSet);
+         FD_SET(iSocket, &readSet);
+         struct timeval timeout;
+         timeout.tv_sec = (uTimeEnd - uTimeNow) / 1000000;
+         timeout.tv_usec = (uTimeEnd - uTimeNow) % 1000000;
+         select(iSocket+1, &readSet, NULL, NULL, &timeout);
+         continue;
+      }
+      int bCRCOk = 0;
+      packet_process_and_check(0, pBuffer, iLength, &bCRCOk);
+      t_packet_header* pPH = (t_packet_header*)pBuffer;
+      if ( (! bCRCOk) || (pPH->total_length < sizeof(t_packet_header) + sizeof(t_test_packet_header)) || (pPH->total_length > iLength) )
+         continue;
+      *piDataLength = (int)pPH->total_length - (int)(sizeof(t_packet_header) + sizeof(t_test_packet_header));
+      return pBuffer + sizeof(t_packet_header);
+   }
+   return NULL;
+}
+
+// Vehicle side, for both upload methods; returns 1 if the archive was received correctly
+
+int _run_emulated_receiver(std::vector<u8>& archive, int bWindowed, int iPipeReady)
+{
+   int iSocket = _open_emulated_interface(RADIO_PORT_ROUTER_UPLINK);
+   u8 uReady = (iSocket >= 0)?1:0;
+   write(iPipeReady, &uReady, 1);
+   if ( iSocket < 0 )
+      return 0;
+
+   t_sw_upload_receiver receiver;
+   sw_upload_receiver_init(&receiver);
+   std::vector<u8> received(archive.size());
+   std::vector<u8> receivedFlags(archive.size()/SW_UPLOAD_DEFAULT_SEGMENT_SIZE + 1, 0);
+   int bDone = 0;
+   int bOk = 0;
+   u64 uTimeLastRx = _now_micros();
+   while ( _now_micros() < uTimeLastRx + 5000000 )
+   {
+      int iLength = 0;
+      u8* pPacket = _receive_packet(iSocket, 100000, &iLength);
+      if ( NULL == pPacket )
+         continue;
+      uTimeLastRx = _now_micros();
+      t_test_packet_header* pHeader = (t_test_packet_header*)pPacket;
+      u8* pData = pPacket + sizeof(t_test_packet_header);
+      t_test_packet_header response;
+      memset(&response, 0, sizeof(response));
+      response.uCounter = pHeader->uCounter;
+      if ( TEST_PACKET_END == pHeader->uKind )
+         break;
+
+      if ( (TEST_PACKET_SEGMENT == pHeader->uKind) && bWindowed )
+      {
+         sw_upload_receiver_process_segment(&receiver, TEST_FOLDER, pData, iLength);
+         command_packet_sw_upload_segment* pSegment = (command_packet_sw_upload_segment*)pData;
+         if ( ! (pSegment->uFlags & SW_UPLOAD_FLAG_ACK_REQUEST) )
+            continue;
+         t_sw_upload_ack ack;
+         sw_upload_receiver_get_ack(&receiver, pSegment->uAckRequestId, &ack);
+         response.uKind = TEST_PACKET_ACK;
+         _send_packet(RADIO_PORT_ROUTER_DOWNLINK, &response, (u8*)&ack, sizeof(ack));
+         if ( SW_UPLOAD_STATUS_COMPLETED == receiver.uStatus )
+            bDone = 1;
+         continue;
+      }
+
+      if ( (TEST_PACKET_OLD_SEGMENT != pHeader->uKind) || bWindowed )
+         continue;
+
+      // Same checks as the vehicle does for COMMAND_ID_UPLOAD_SW_TO_VEHICLE63
+      command_packet_sw_package* pParams = (command_packet_sw_package*)pData;
+      u32 uIndex = pParams->file_block_index;
+      if ( uIndex >= receivedFlags.size() )
+         continue;
+      memcpy(&received[uIndex*SW_UPLOAD_DEFAULT_SEGMENT_SIZE], pData + sizeof(command_packet_sw_package), pParams->block_length);
+      receivedFlags[uIndex] = 1;
+      if ( ! pHeader->uWantsResponse )
+         continue;
+
+      int bAllPrevOk = 1;
+      if ( ! pParams->is_last_block )
+      {
+         int iIndexCheck = (int)uIndex;
+         int iCount = DEFAULT_UPLOAD_PACKET_CONFIRMATION_FREQUENCY;
+         while ( (iIndexCheck >= 0) && (iCount >= 0) )
+         {
+            if ( ! receivedFlags[iIndexCheck] )
+            {
+               bAllPrevOk = 0;
+               break;
+            }
+            iIndexCheck--;
+            iCount--;
+         }
+      }
+      else
+      {
+         for( size_t i=0; i<receivedFlags.size(); i++ )
+         {
+            if ( ! receivedFlags[i] )
+               bAllPrevOk = 0;
+         }
+      }
+      response.uKind = TEST_PACKET_OLD_RESPONSE;
+      response.uResponseOk = bAllPrevOk?1:0;
+      for( int i=0; i<(pParams->is_last_block?10:2); i++ )
+         _send_packet(RADIO_PORT_ROUTER_DOWNLINK, &response, NULL, 0);
+      if ( pParams->is_last_block && bAllPrevOk )
+         bDone = 1;
+   }
+
+   if ( bWindowed )
+   {
+      char szArchive[MAX_FILE_PATH_SIZE];
+      strcpy(szArchive, receiver.szArchiveFile);
+      sw_upload_receiver_close(&receiver, 0);
+      bOk = bDone && _is_received_archive_ok(szArchive, archive);
+   }
+   else
+      bOk = bDone && (0 == memcmp(&received[0], &archive[0], archive.size()));
+   radio_emulator_flush(1000);
+   radio_close_interface_for_read(0);
+   radio_close_interface_for_write(0);
+   return bOk;
+}
+
+// Controller side, the previous upload method (as in Menu::_uploadVehicleUpdate)
+
+int _run_old_sender(int iSocket, std::vector<u8>& archive)
+{
+   u32 uBlockSize = SW_UPLOAD_DEFAULT_SEGMENT_SIZE;
+   int iPackets = (int)((archive.size() + uBlockSize - 1) / uBlockSize);
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE];
+   command_packet_sw_package* pParams = (command_packet_sw_package*)uPacket;
+   t_test_packet_header header;
+   memset(&header, 0, sizeof(header));
+   header.uKind = TEST_PACKET_OLD_SEGMENT;
+
+   int iLastAcknowledgedPacket = -1;
+   int iPacketToSend = 0;
+   int iCountMaxRetriesForCurrentSegments = 10;
+   while ( iPacketToSend < iPackets )
+   {
+      u32 uOffset = (u32)iPacketToSend * uBlockSize;
+      pParams->type = 1;
+      pParams->total_size = (u32)archive.size();
+      pParams->file_block_index = (u32)iPacketToSend;
+      pParams->block_length = (int)std::min((size_t)uBlockSize, archive.size() - uOffset);
+      pParams->is_last_block = (iPacketToSend == iPackets-1);
+      memcpy(uPacket + sizeof(command_packet_sw_package), &archive[uOffset], pParams->block_length);
+      int iLength = sizeof(command_packet_sw_package) + pParams->block_length;
+
+      if ( (! pParams->is_last_block) && ((iPacketToSend % DEFAULT_UPLOAD_PACKET_CONFIRMATION_FREQUENCY) != 0) )
+      {
+         header.uWantsResponse = 0;
+         for( int k=0; k<2; k++ )
+            _send_packet(RADIO_PORT_ROUTER_UPLINK, &header, uPacket, iLength);
+         hardware_sleep_ms(2);
+         iPacketToSend++;
+         continue;
+      }
+
+      header.uWantsResponse = 1;
+      header.uCounter++;
+      int iWaitReplyTime = 100;
+      int iResendCounter = 0;
+      int bGotResponse = 0;
+      int bResponseOk = 0;
+      do
+      {
+         _send_packet(RADIO_PORT_ROUTER_UPLINK, &header, uPacket, iLength);
+         iResendCounter++;
+         u64 uTimeEnd = _now_micros() + iWaitReplyTime * 1000;
+         while ( (! bGotResponse) && (_now_micros() < uTimeEnd) )
+         {
+            int iDataLength = 0;
+            t_test_packet_header* pResponse = (t_test_packet_header*)_receive_packet(iSocket, (u32)(uTimeEnd - _now_micros()), &iDataLength);
+            if ( (NULL != pResponse) && (TEST_PACKET_OLD_RESPONSE == pResponse->uKind) && (pResponse->uCounter == header.uCounter) )
+            {
+               bGotResponse = 1;
+               bResponseOk = pResponse->uResponseOk;
+            }
+         }
+         if ( ! bGotResponse )
+            iWaitReplyTime = std::min(iWaitReplyTime + 50, 500);
+      }
+      while ( (iResendCounter < 15) && (! bGotResponse) );
+
+      if ( ! bGotResponse )
+         return 0;
+      if ( ! bResponseOk )
+      {
+         iPacketToSend = iLastAcknowledgedPacket;
+         iCountMaxRetriesForCurrentSegments--;
+         if ( iCountMaxRetriesForCurrentSegments < 0 )
+            return 0;
+      }
+      else
+      {
+         iCountMaxRetriesForCurrentSegments = 10;
+         iLastAcknowledgedPacket = iPacketToSend;
+      }
+      iPacketToSend++;
+   }
+   return 1;
+}
+
+// Controller side, the windowed upload paced at about one segment every iPacingMicros
+
+int _run_windowed_sender(int iSocket, std::vector<u8>& archive, u32 uPacingMicros, t_sw_upload_sender* pSender)
+{
+   if ( ! sw_upload_sender_init(pSender, &archive[0], (u32)archive.size(), 1, SW_UPLOAD_DEFAULT_SEGMENT_SIZE, 16, 2, SW_UPLOAD_DEFAULT_WINDOW_SEGMENTS) )
+      return 0;
+   t_test_packet_header header;
+   memset(&header, 0, sizeof(header));
+   header.uKind = TEST_PACKET_SEGMENT;
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   u64 uTimeStart = _now_micros();
+   u64 uTimeLastAck = uTimeStart;
+   u64 uTimeNextSend = uTimeStart;
+   while ( ! sw_upload_sender_is_complete(pSender) )
+   {
+      u64 uTimeNow = _now_micros();
+      if ( (uTimeNow > uTimeLastAck + 10000000) || (SW_UPLOAD_STATUS_IN_PROGRESS != pSender->uRemoteStatus) )
+         return 0;
+      int iDataLength = 0;
+      u32 uWait = (uTimeNextSend > uTimeNow)?(u32)(uTimeNextSend - uTimeNow):0;
+      u8* pPacket = _receive_packet(iSocket, uWait, &iDataLength);
+      if ( NULL != pPacket )
+      {
+         if ( (TEST_PACKET_ACK == ((t_test_packet_header*)pPacket)->uKind) && (iDataLength == (int)sizeof(t_sw_upload_ack)) )
+         {
+            sw_upload_sender_on_ack(pSender, (t_sw_upload_ack*)(pPacket + sizeof(t_test_packet_header)), (u32)(_now_micros()/1000));
+            uTimeLastAck = _now_micros();
+         }
+         continue;
+      }
+      int iLength = sw_upload_sender_get_next_segment(pSender, (u32)(_now_micros()/1000), uBuffer, sizeof(uBuffer));
+      if ( iLength <= 0 )
+      {
+         uTimeNextSend = _now_micros() + 1000;
+         continue;
+      }
+      _send_packet(RADIO_PORT_ROUTER_UPLINK, &header, uBuffer, iLength);
+      uTimeNextSend += uPacingMicros;
+      if ( uTimeNextSend < _now_micros() )
+         uTimeNextSend = _now_micros();
+   }
+   return 1;
+}
+
+// Controller side process: writes the upload time in milliseconds (0 on failure) to the pipe
+
+void _run_emulated_sender(std::vector<u8>& archive, int bWindowed, int iPipeResult)
+{
+   u32 uTimeMs = 0;
+   int iSocket = _open_emulated_interface(RADIO_PORT_ROUTER_DOWNLINK);
+   if ( iSocket >= 0 )
+   {
+      t_sw_upload_sender sender;
+      memset(&sender, 0, sizeof(sender));
+      u64 uTimeStart = _now_micros();
+      int bSent = 0;
+      if ( bWindowed )
+         bSent = _run_windowed_sender(iSocket, archive, 1000, &sender);
+      else
+         bSent = _run_old_sender(iSocket, archive);
+      if ( bSent )
+         uTimeMs = (u32)((_now_micros() - uTimeStart)/1000);
+      if ( bWindowed )
+         log_line("[windowed] %u segments sent, %u retransmissions, %u FEC segments, %u acks, RTT %u ms",
+            sender.uSegmentsSent, sender.uRetransmissions, sender.uFECSegmentsSent, sender.uAcksReceived, sender.uSmoothedRTTMs);
+      sw_upload_sender_uninit(&sender);
+
+      t_test_packet_header header;
+      memset(&header, 0, sizeof(header));
+      header.uKind = TEST_PACKET_END;
+      t_radio_emulator_params params;
+      radio_emulator_reset_params(&params);
+      radio_emulator_set_params(&params);
+      for( int i=0; i<3; i++ )
+         _send_packet(RADIO_PORT_ROUTER_UPLINK, &header, NULL, 0);
+      radio_emulator_flush(1000);
+      radio_close_interface_for_read(0);
+      radio_close_interface_for_write(0);
+   }
+   write(iPipeResult, &uTimeMs, sizeof(uTimeMs));
+}
+
+// Both sides run in their own processes (the emulator tx thread does not survive a fork).
+// Returns the upload time in milliseconds, 0 on failure
+
+u32 _run_emulated_upload(std::vector<u8>& archive, int bWindowed)
+{
+   _clean_test_folder();
+   int iPipeReady[2];
+   int iPipeResult[2];
+   int iPipeTime[2];
+   if ( (0 != pipe(iPipeReady)) || (0 != pipe(iPipeResult)) || (0 != pipe(iPipeTime)) )
+      return 0;
+   fflush(stdout);
+   int iPidReceiver = fork();
+   if ( iPidReceiver < 0 )
+      return 0;
+   if ( 0 == iPidReceiver )
+   {
+      u8 uResult = (u8)_run_emulated_receiver(archive, bWindowed, iPipeReady[1]);
+      write(iPipeResult[1], &uResult, 1);
+      exit(0);
+   }
+
+   u8 uReady = 0;
+   if ( (1 != read(iPipeReady[0], &uReady, 1)) || (0 == uReady) )
+   {
+      log_line("The receiver process failed to open the emulated radio interface.");
+      waitpid(iPidReceiver, NULL, 0);
+      return 0;
+   }
+   fflush(stdout);
+   int iPidSender = fork();
+   if ( iPidSender < 0 )
+   {
+      kill(iPidReceiver, SIGTERM);
+      waitpid(iPidReceiver, NULL, 0);
+      return 0;
+   }
+   if ( 0 == iPidSender )
+   {
+      _run_emulated_sender(archive, bWindowed, iPipeTime[1]);
+      exit(0);
+   }
+
+   u32 uTimeMs = 0;
+   u8 uResult = 0;
+   if ( sizeof(uTimeMs) != read(iPipeTime[0], &uTimeMs, sizeof(uTimeMs)) )
+      uTimeMs = 0;
+   if ( 1 != read(iPipeResult[0], &uResult, 1) )
+      uResult = 0;
+   waitpid(iPidSender, NULL, 0);
+   waitpid(iPidReceiver, NULL, 0);
+   close(iPipeReady[0]);
+   close(iPipeReady[1]);
+   close(iPipeResult[0]);
+   close(iPipeResult[1]);
+   close(iPipeTime[0]);
+   close(iPipeTime[1]);
+
+   log_line("[%s] %u bytes in %u ms: %s", bWindowed?"windowed":"stop-and-wait", (u32)archive.size(), uTimeMs, ((0 != uTimeMs) && uResult)?"ok":"failed");
+   if ( 0 == uResult )
+      return 0;
+   return uTimeMs;
+}
+
+void _test_emulated_link()
+{
+   std::vector<u8> archive;
+   _fill_archive(archive, s_uEmulatedSize);
+   log_line("Uploading %u bytes over the emulated radio link: %d.%d%% loss, %d ms latency each way",
+      s_uEmulatedSize, s_iEmulatedLossPerThousand/10, s_iEmulatedLossPerThousand%10, s_iEmulatedLatencyMicros/1000);
+   u32 uTimeOld = _run_emulated_upload(archive, 0);
+   u32 uTimeNew = _run_emulated_upload(archive, 1);
+   _check_true("emulated link: stop-and-wait upload completed", 0 != uTimeOld);
+   _check_true("emulated link: windowed upload completed", 0 != uTimeNew);
+   _check_true("emulated link: windowed upload is faster", (0 != uTimeNew) && ((0 == uTimeOld) || (uTimeNew < uTimeOld)));
+   if ( (0 != uTimeOld) && (0 != uTimeNew) )
+      log_line("Windowed upload is %.1f times faster.", (float)uTimeOld/(float)uTimeNew);
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestSWUpload");
+   log_enable_stdout();
+   fec_init();
+
+   int iSeed = 1;
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-size")) && (i < argc-1) )
+         s_uEmulatedSize = (u32)atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-loss")) && (i < argc-1) )
+         s_iEmulatedLossPerThousand = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-latency")) && (i < argc-1) )
+         s_iEmulatedLatencyMicros = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+   }
+   srand(iSeed);
+
+   _test_simulated_link();
+   _test_emulated_link();
+
+   char szComm[256];
+   sprintf(szComm, "rm -rf %s", TEST_FOLDER);
+   hw_execute_bash_command_silent(szComm, NULL);
+
+   log_line("SW upload tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,644 @@
+#include <stddef.h>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/shared_mem.h"
+#include "../base/telemetry_delta.h"
+#include "../radio/radiopackets2.h"
+#include "../public/telemetry_info.h"
+
+// Checks the delta encoding of the telemetry downlink: the controller must get back exactly the packets
+// the vehicle router sent, or nothing, with radio loss, reordering, corrupted packets and vehicle restarts.
+// Reports the downlink bytes/sec before and after the encoding and the encoding speed.
+// Usage: test_telemetry_delta [-file recorded_packets] [-record out_file] [-seconds n] [-loss per_thousand] [-seed n]
+// The recorded file has the telemetry packets as the vehicle router sends them (whole packets, framed by
+// their t_packet_header total length), each one preceded by its u32 send time in miliseconds.
+// Without -file, a generated flight (Ruby telemetry, FC telemetry, radio cards stats) is used.
+
+#define TEST_MAX_STREAM (32*1024*1024)
+#define TEST_MAX_PACKETS 200000
+#define TEST_TICK_MS 10
+#define TEST_VEHICLE_ID 0x1A2B3C4D
+#define TEST_RADIO_INTERFACES 1
+
+int s_iFailed = 0;
+u64 s_uRandomState = 1;
+int s_iSeconds = 120;
+int s_iLossPerThousand = 50;
+int s_iReorderPerThousand = 20;
+bool s_bGenerated = true;
+
+u8* s_pStream = NULL;
+int s_iStreamLength = 0;
+int s_iPacketOffset[TEST_MAX_PACKETS];
+u32 s_uPacketTime[TEST_MAX_PACKETS];
+int s_iCountPackets = 0;
+u32 s_uStreamPacketIndex = 0;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u32 _random(u64* pState, u32 uMax)
+{
+   *pState ^= *pState >> 12;
+   *pState ^= *pState << 25;
+   *pState ^= *pState >> 27;
+   return (u32)(((*pState * 2685821657736338717ULL) >> 32) % uMax);
+}
+
+u8* _get_packet(int iIndex)
+{
+   return s_pStream + s_iPacketOffset[iIndex];
+}
+
+int _get_packet_length(int iIndex)
+{
+   return ((t_packet_header*)_get_packet(iIndex))->total_length;
+}
+
+void _add_packet(u32 uTimeMs, t_packet_header* pPH, const u8* pPayload, int iPayloadLength)
+{
+   if ( (s_iCountPackets >= TEST_MAX_PACKETS) || (s_iStreamLength + (int)sizeof(t_packet_header) + iPayloadLength > TEST_MAX_STREAM) )
+      return;
+   pPH->vehicle_id_src = TEST_VEHICLE_ID;
+   pPH->stream_packet_idx = (STREAM_ID_TELEMETRY << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX) | ((s_uStreamPacketIndex++) & PACKET_FLAGS_MASK_STREAM_PACKET_IDX);
+   pPH->total_length = (u16)(sizeof(t_packet_header) + iPayloadLength);
+   u8* pPacket = s_pStream + s_iStreamLength;
+   memcpy(pPacket, pPH, sizeof(t_packet_header));
+   memcpy(pPacket + sizeof(t_packet_header), pPayload, iPayloadLength);
+   radio_packet_compute_crc(pPacket, pPH->total_length);
+   s_iPacketOffset[s_iCountPackets] = s_iStreamLength;
+   s_uPacketTime[s_iCountPackets] = uTimeMs;
+   s_iCountPackets++;
+   s_iStreamLength += pPH->total_length;
+}
+
+// A flight: Ruby and FC telemetry at 10 Hz, the vehicle radio cards stats at 5 Hz
+void _generate_packets()
+{
+   u64 uState = s_uRandomState ^ 0x5DEECE66DULL;
+   t_packet_header PH;
+   u8 uPayload[MAX_PACKET_PAYLOAD];
+
+   t_packet_header_ruby_telemetry_extended_v3 PHRTE;
+   t_packet_header_ruby_telemetry_extended_extra_info PHExtraInfo;
+   t_packet_header_ruby_telemetry_extended_extra_info_retransmissions PHRetransmissions;
+   memset(&PHRTE, 0, sizeof(PHRTE));
+   memset(&PHExtraInfo, 0, sizeof(PHExtraInfo));
+   memset(&PHRetransmissions, 0, sizeof(PHRetransmissions));
+   PHRTE.flags = FLAG_RUBY_TELEMETRY_VEHICLE_HAS_CAMERA;
+   PHRTE.version = (SYSTEM_SW_VERSION_MAJOR<<4) | SYSTEM_SW_VERSION_MINOR;
+   PHRTE.uVehicleId = TEST_VEHICLE_ID;
+   PHRTE.vehicle_type = MODEL_TYPE_DRONE;
+   strcpy((char*)PHRTE.vehicle_name, "Test quad");
+   PHRTE.radio_links_count = 1;
+   PHRTE.uRadioFrequenciesKhz[0] = 5825000;
+   PHRTE.cpu_mhz = 1200;
+   PHRTE.temperature = 45;
+   PHExtraInfo.flags = FLAG_RUBY_TELEMETRY_EXTRA_INFO_IS_VALID;
+
+   t_packet_header_fc_telemetry PHFC;
+   memset(&PHFC, 0, sizeof(PHFC));
+   PHFC.fc_telemetry_type = TELEMETRY_TYPE_MAVLINK;
+   PHFC.flight_mode = FLIGHT_MODE_ARMED | FLIGHT_MODE_STAB;
+   PHFC.voltage = 16800;
+   PHFC.satelites = 14;
+   PHFC.gps_fix_type = 3; // 3D fix
+   PHFC.hdop = 80;
+   PHFC.latitude = 451234567;
+   PHFC.longitude = 251234567;
+   PHFC.temperature = 130;
+   PHFC.extra_info[1] = 0xFF;
+   PHFC.extra_info[2] = 0xFF;
+
+   shared_mem_radio_stats_radio_interface cards[TEST_RADIO_INTERFACES];
+   memset(cards, 0, sizeof(cards));
+   for( int i=0; i<TEST_RADIO_INTERFACES; i++ )
+   {
+      cards[i].assignedLocalRadioLinkId = 0;
+      cards[i].assignedVehicleRadioLinkId = 0;
+      cards[i].uCurrentFrequencyKhz = 5825000;
+      cards[i].openedForRead = 1;
+      cards[i].openedForWrite = 1;
+      cards[i].signalInfo.iAntennaCount = 2;
+      cards[i].lastRecvDataRate = -2;
+      cards[i].lastSentDataRateVideo = -3;
+      cards[i].lastSentDataRateData = -1;
+   }
+
+   int iTicks = s_iSeconds * 1000 / TEST_TICK_MS;
+   for( int t=0; t<iTicks; t++ )
+   {
+      u32 uTimeMs = t * TEST_TICK_MS;
+
+      if ( (uTimeMs % 100) == 0 )
+      {
+         PHRTE.downlink_tx_video_bitrate_bps = 6000000 + _random(&uState, 800000);
+         PHRTE.downlink_tx_video_all_bitrate_bps = PHRTE.downlink_tx_video_bitrate_bps * 3 / 2;
+         PHRTE.downlink_tx_data_bitrate_bps = 20000 + _random(&uState, 5000);
+         PHRTE.downlink_tx_video_packets_per_sec = 900 + _random(&uState, 100);
+         PHRTE.downlink_tx_data_packets_per_sec = 40 + _random(&uState, 10);
+         PHRTE.cpu_load = 30 + _random(&uState, 30);
+         if ( (uTimeMs % 10000) == 0 )
+            PHRTE.temperature = 45 + uTimeMs/60000;
+         PHRTE.last_sent_datarate_bps[0][0] = -3;
+         PHRTE.last_sent_datarate_bps[0][1] = -1;
+         PHRTE.last_recv_datarate_bps[0] = -2;
+         PHRTE.uplink_rssi_dbm[0] = 200 - 55 - _random(&uState, 4);
+         PHRTE.uplink_link_quality[0] = 98 + _random(&uState, 3);
+         PHRTE.uplink_rc_rssi = 255;
+         PHRTE.uplink_mavlink_rc_rssi = 255;
+         PHRTE.uplink_mavlink_rx_rssi = 255;
+         PHRTE.txTimePerSec = 300 + _random(&uState, 50);
+         PHRTE.extraSize = 0;
+         PHExtraInfo.uTimeNow = uTimeMs;
+         PHExtraInfo.uThrottleInput = 1400 + _random(&uState, 50);
+         PHExtraInfo.uThrottleOutput = 40 + _random(&uState, 5);
+         if ( 0 == _random(&uState, 5) )
+         {
+            PHRetransmissions.totalReceivedRetransmissionsRequestsUnique++;
+            PHRetransmissions.totalReceivedRetransmissionsRequestsSegmentsUnique += 1 + _random(&uState, 3);
+         }
+
+         int iPos = 0;
+         memcpy(uPayload, &PHRTE, sizeof(PHRTE));
+         iPos += sizeof(PHRTE);
+         memcpy(uPayload + iPos, &PHExtraInfo, sizeof(PHExtraInfo));
+         iPos += sizeof(PHExtraInfo);
+         memcpy(uPayload + iPos, &PHRetransmissions, sizeof(PHRetransmissions));
+         iPos += sizeof(PHRetransmissions);
+         radio_packet_init(&PH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_RUBY_TELEMETRY_EXTENDED, STREAM_ID_TELEMETRY);
+         _add_packet(uTimeMs, &PH, uPayload, iPos);
+      }
+
+      if ( (uTimeMs % 100) == 50 )
+      {
+         PHFC.arm_time = uTimeMs/1000;
+         PHFC.throttle = 40 + _random(&uState, 5);
+         PHFC.voltage = 16800 - uTimeMs/100;
+         PHFC.current = 12000 + _random(&uState, 2000);
+         PHFC.mah = uTimeMs/300;
+         PHFC.altitude = 100000 + 5000 + (uTimeMs/100) % 3000;
+         PHFC.altitude_abs = PHFC.altitude + 12000;
+         PHFC.distance = uTimeMs/10;
+         PHFC.total_distance = uTimeMs/8;
+         PHFC.vspeed = 100000 + _random(&uState, 200);
+         PHFC.hspeed = 100000 + 1200 + _random(&uState, 100);
+         PHFC.roll = 18000 + _random(&uState, 400);
+         PHFC.pitch = 18000 + _random(&uState, 400);
+         PHFC.heading = (uTimeMs/1000) % 360;
+         PHFC.latitude += 3;
+         PHFC.longitude += 2;
+         PHFC.fc_hudmsgpersec = 0x11;
+         PHFC.fc_kbps = 6;
+         PHFC.extra_info[5]++;
+         PHFC.extra_info[6] = 80 + _random(&uState, 10);
+         radio_packet_init(&PH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_FC_TELEMETRY, STREAM_ID_TELEMETRY);
+         _add_packet(uTimeMs, &PH, (u8*)&PHFC, sizeof(PHFC));
+      }
+
+      if ( (uTimeMs % 200) == 20 )
+      {
+         for( int i=0; i<TEST_RADIO_INTERFACES; i++ )
+         {
+            u32 uRxPackets = 8 + _random(&uState, 4);
+            cards[i].totalRxPackets += uRxPackets;
+            cards[i].totalRxBytes += uRxPackets * 60;
+            cards[i].totalTxPackets += 190 + _random(&uState, 20);
+            cards[i].totalTxBytes += 220000 + _random(&uState, 20000);
+            cards[i].rxPacketsPerSec = uRxPackets * 5;
+            cards[i].rxBytesPerSec = uRxPackets * 300;
+            cards[i].txPacketsPerSec = 1000 + _random(&uState, 50);
+            cards[i].txBytesPerSec = 1100000 + _random(&uState, 50000);
+            cards[i].lastReceivedRadioLinkPacketIndex += uRxPackets;
+            cards[i].timeLastRxPacket = uTimeMs - _random(&uState, 20);
+            cards[i].timeLastTxPacket = uTimeMs - _random(&uState, 2);
+            cards[i].timeNow = uTimeMs;
+            cards[i].rxQuality = 97 + _random(&uState, 4);
+            cards[i].signalInfo.dbmValuesAll.iDbmLast[0] = -55 - (int)_random(&uState, 4);
+            cards[i].signalInfo.dbmValuesAll.iDbmLast[1] = -57 - (int)_random(&uState, 4);
+            cards[i].signalInfo.iDbmBest = cards[i].signalInfo.dbmValuesAll.iDbmLast[0];
+            for( int k=MAX_HISTORY_RADIO_STATS_RECV_SLICES-1; k>0; k-- )
+            {
+               cards[i].hist_rxPacketsCount[k] = cards[i].hist_rxPacketsCount[k-1];
+               cards[i].hist_rxGapMiliseconds[k] = cards[i].hist_rxGapMiliseconds[k-1];
+            }
+            cards[i].hist_rxPacketsCount[0] = (u8)uRxPackets;
+            cards[i].hist_rxGapMiliseconds[0] = 20 + _random(&uState, 10);
+            cards[i].uSlicesUpdated = 1;
+         }
+         u8 uCount = TEST_RADIO_INTERFACES;
+         uPayload[0] = uCount;
+         memcpy(uPayload + 1, cards, sizeof(cards));
+         radio_packet_init(&PH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS, STREAM_ID_TELEMETRY);
+         PH.packet_flags_extended |= PACKET_FLAGS_EXTENDED_BIT_SEND_ON_HIGH_CAPACITY_LINK_ONLY;
+         _add_packet(uTimeMs, &PH, uPayload, 1 + (int)sizeof(cards));
+      }
+   }
+   log_line("Generated %d seconds of telemetry: %d packets, %d bytes", s_iSeconds, s_iCountPackets, s_iStreamLength);
+}
+
+int _load_packets(const char* szFile)
+{
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+   {
+      log_line("Failed to open recorded telemetry %s", szFile);
+      return 0;
+   }
+   u32 uTimeMs = 0;
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE];
+   while ( 1 == fread(&uTimeMs, sizeof(u32), 1, fd) )
+   {
+      if ( 1 != fread(uPacket, sizeof(t_packet_header), 1, fd) )
+         break;
+      t_packet_header* pPH = (t_packet_header*)uPacket;
+      if ( (pPH->total_length < sizeof(t_packet_header)) || (pPH->total_length > MAX_PACKET_TOTAL_SIZE) )
+      {
+         log_line("Invalid packet length (%d bytes) in recorded telemetry, after %d packets", pPH->total_length, s_iCountPackets);
+         break;
+      }
+      int iPayloadLength = pPH->total_length - sizeof(t_packet_header);
+      if ( (iPayloadLength > 0) && (1 != fread(uPacket + sizeof(t_packet_header), iPayloadLength, 1, fd)) )
+         break;
+      if ( (s_iCountPackets >= TEST_MAX_PACKETS) || (s_iStreamLength + pPH->total_length > TEST_MAX_STREAM) )
+         break;
+      memcpy(s_pStream + s_iStreamLength, uPacket, pPH->total_length);
+      s_iPacketOffset[s_iCountPackets] = s_iStreamLength;
+      s_uPacketTime[s_iCountPackets] = uTimeMs;
+      s_iCountPackets++;
+      s_iStreamLength += pPH->total_length;
+   }
+   fclose(fd);
+   log_line("Loaded recorded telemetry %s: %d packets, %d bytes", szFile, s_iCountPackets, s_iStreamLength);
+   return (s_iCountPackets > 0)?1:0;
+}
+
+void _save_packets(const char* szFile)
+{
+   FILE* fd = fopen(szFile, "wb");
+   if ( NULL == fd )
+   {
+      log_line("Failed to save the telemetry to %s", szFile);
+      return;
+   }
+   for( int i=0; i<s_iCountPackets; i++ )
+   {
+      fwrite(&s_uPacketTime[i], sizeof(u32), 1, fd);
+      fwrite(_get_packet(i), _get_packet_length(i), 1, fd);
+   }
+   fclose(fd);
+   log_line("Saved %d telemetry packets to %s", s_iCountPackets, szFile);
+}
+
+// Encodes a packet the way the vehicle router sends it. Returns the length sent on the radio.
+int _encode(t_telemetry_delta_encoder* pEncoder, int iIndex, u8* pOutput)
+{
+   int iLength = telemetry_delta_encode(pEncoder, _get_packet(iIndex), _get_packet_length(iIndex), pOutput, s_uPacketTime[iIndex]);
+   if ( 0 == iLength )
+   {
+      iLength = _get_packet_length(iIndex);
+      memcpy(pOutput, _get_packet(iIndex), iLength);
+   }
+   radio_packet_compute_crc(pOutput, iLength);
+   return iLength;
+}
+
+// Gets a received packet the way the controller router does. Returns the length of the packet handed to
+// the consumers, 0 if none. Any packet handed out must be the original one.
+int _receive(t_telemetry_delta_decoder* pDecoder, int iIndex, u8* pReceived, int iLength, int* piWrongPackets)
+{
+   if ( ((t_packet_header*)pReceived)->packet_type != PACKET_TYPE_RUBY_TELEMETRY_DELTA )
+      return iLength;
+   u8 uDecoded[MAX_PACKET_TOTAL_SIZE];
+   int iDecodedLength = telemetry_delta_decode(pDecoder, pReceived, iLength, uDecoded);
+   if ( iDecodedLength <= 0 )
+      return 0;
+   if ( (iDecodedLength != _get_packet_length(iIndex)) || (0 != memcmp(uDecoded, _get_packet(iIndex), iDecodedLength)) ||
+        (! radio_packet_check_crc(uDecoded, iDecodedLength)) )
+      (*piWrongPackets)++;
+   return iDecodedLength;
+}
+
+void _test_lossless()
+{
+   t_telemetry_delta_encoder encoder;
+   t_telemetry_delta_decoder decoder;
+   telemetry_delta_encoder_init(&encoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS, 1);
+   telemetry_delta_decoder_init(&decoder);
+
+   u8 uEncoded[MAX_PACKET_TOTAL_SIZE];
+   u64 uBytesIn = 0;
+   u64 uBytesOut = 0;
+   int iWrongPackets = 0;
+   int iMissing = 0;
+   for( int i=0; i<s_iCountPackets; i++ )
+   {
+      int iLength = _encode(&encoder, i, uEncoded);
+      uBytesIn += _get_packet_length(i);
+      uBytesOut += iLength;
+      if ( 0 == _receive(&decoder, i, uEncoded, iLength, &iWrongPackets) )
+         iMissing++;
+   }
+   _check_true("lossless link: all packets rebuilt", 0 == iMissing);
+   _check_true("lossless link: rebuilt packets are the original ones", 0 == iWrongPackets);
+   _check_true("lossless link: no loss or reordering detected", (0 == decoder.uPacketsLost) && (0 == decoder.uPacketsOutOfOrder) && (0 == decoder.uPacketsInvalid));
+
+   u32 uDurationMs = s_uPacketTime[s_iCountPackets-1] - s_uPacketTime[0];
+   if ( uDurationMs < 1000 )
+      uDurationMs = 1000;
+   int iSavedPercent = (int)(100 - (uBytesOut*100)/uBytesIn);
+   log_line("Telemetry downlink: %d bytes/sec before, %d bytes/sec delta encoded (%d%% saved), %u keyframes out of %u packets",
+      (int)(uBytesIn*1000/uDurationMs), (int)(uBytesOut*1000/uDurationMs), iSavedPercent, encoder.uKeyframes, encoder.uPackets);
+   if ( s_bGenerated )
+      _check_true("delta encoding saves at least half of the telemetry downlink", iSavedPercent >= 50);
+}
+
+// Random loss and reordering. Checks that no wrong packet is ever handed out and that each stream is
+// rebuilt again from the first keyframe received after its keyframe was lost.
+void _test_lossy()
+{
+   t_telemetry_delta_encoder encoder;
+   t_telemetry_delta_decoder decoder;
+   telemetry_delta_encoder_init(&encoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS, 2);
+   telemetry_delta_decoder_init(&decoder);
+   u64 uState = s_uRandomState ^ 0x9E3779B97F4A7C15ULL;
+
+   u8 uEncoded[MAX_PACKET_TOTAL_SIZE];
+   u8 uHeld[MAX_PACKET_TOTAL_SIZE];
+   int iHeldLength = 0;
+   int iHeldIndex = -1;
+   int iWrongPackets = 0;
+   int iSent = 0;
+   int iDelivered = 0;
+   int iRebuilt = 0;
+   int iKeyframesNotRebuilt = 0;
+
+   // Per packet type: time of the first packet not rebuilt after a rebuilt one
+   u32 uTimeGapStart[256];
+   int iInGap[256];
+   u32 uLongestGapMs = 0;
+   u32 uGapsSumMs = 0;
+   int iGaps = 0;
+   memset(iInGap, 0, sizeof(iInGap));
+
+   for( int i=0; i<s_iCountPackets; i++ )
+   {
+      int iLength = _encode(&encoder, i, uEncoded);
+      iSent++;
+      if ( (int)_random(&uState, 1000) < s_iLossPerThousand )
+         continue;
+
+      // Reordering: this packet is held and delivered after the next one
+      if ( (iHeldIndex < 0) && ((int)_random(&uState, 1000) < s_iReorderPerThousand) )
+      {
+         memcpy(uHeld, uEncoded, iLength);
+         iHeldLength = iLength;
+         iHeldIndex = i;
+         continue;
+      }
+
+      for( int k=0; k<2; k++ )
+      {
+         u8* pReceived = (0 == k)?uEncoded:uHeld;
+         int iReceivedLength = (0 == k)?iLength:iHeldLength;
+         int iIndex = (0 == k)?i:iHeldIndex;
+         if ( (1 == k) && (iHeldIndex < 0) )
+            break;
+
+         iDelivered++;
+         t_packet_header* pPH = (t_packet_header*)pReceived;
+         t_packet_header_telemetry_delta* pPHTD = (t_packet_header_telemetry_delta*)(pReceived + sizeof(t_packet_header));
+         u8 uType = _get_packet(iIndex)[offsetof(t_packet_header, packet_type)];
+         int iResult = _receive(&decoder, iIndex, pReceived, iReceivedLength, &iWrongPackets);
+         if ( iResult > 0 )
+         {
+            iRebuilt++;
+            if ( iInGap[uType] && (0 == k) )
+            {
+               u32 uGap = s_uPacketTime[iIndex] - uTimeGapStart[uType];
+               uGapsSumMs += uGap;
+               iGaps++;
+               if ( uGap > uLongestGapMs )
+                  uLongestGapMs = uGap;
+               iInGap[uType] = 0;
+            }
+         }
+         else if ( 0 == k )
+         {
+            // An in order keyframe is always usable
+            if ( (pPH->packet_type == PACKET_TYPE_RUBY_TELEMETRY_DELTA) && (pPHTD->uFlags & FLAG_TELEMETRY_DELTA_KEYFRAME) )
+               iKeyframesNotRebuilt++;
+            if ( ! iInGap[uType] )
+            {
+               iInGap[uType] = 1;
+               uTimeGapStart[uType] = s_uPacketTime[iIndex];
+            }
+         }
+      }
+      iHeldIndex = -1;
+   }
+
+   log_line("Lossy link (%d/1000 lost, %d/1000 reordered): %d sent, %d delivered, %d rebuilt (%d%% of delivered)",
+      s_iLossPerThousand, s_iReorderPerThousand, iSent, iDelivered, iRebuilt, (iDelivered > 0)?(iRebuilt*100/iDelivered):0);
+   log_line("Lossy link: decoder counted %u lost, %u out of order, %u skipped (keyframe lost)",
+      decoder.uPacketsLost, decoder.uPacketsOutOfOrder, decoder.uPacketsNoKeyframe);
+   log_line("Keyframe loss recovery: %d gaps, average %d ms, longest %u ms (keyframe interval: %d ms)",
+      iGaps, (iGaps > 0)?(int)(uGapsSumMs/iGaps):0, uLongestGapMs, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS);
+   _check_true("lossy link: rebuilt packets are the original ones", 0 == iWrongPackets);
+   _check_true("lossy link: in order keyframes are always rebuilt", 0 == iKeyframesNotRebuilt);
+   if ( s_bGenerated && (s_iLossPerThousand <= 100) )
+      _check_true("lossy link: most delivered packets are rebuilt", iRebuilt * 100 >= iDelivered * 80);
+}
+
+// The vehicle restarts (new encoder session, sequences start over) and the first keyframes of the new
+// session are lost: the deltas of the new session must not be applied on the keyframes of the old one.
+void _test_vehicle_restart()
+{
+   t_telemetry_delta_encoder encoder;
+   t_telemetry_delta_decoder decoder;
+   telemetry_delta_encoder_init(&encoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS, 3);
+   telemetry_delta_decoder_init(&decoder);
+
+   u8 uEncoded[MAX_PACKET_TOTAL_SIZE];
+   int iWrongPackets = 0;
+   int iRestartIndex = s_iCountPackets/2;
+   int iRebuiltAfterRestart = 0;
+   u32 uTimeFirstRebuilt = 0;
+   for( int i=0; i<s_iCountPackets; i++ )
+   {
+      if ( i == iRestartIndex )
+         telemetry_delta_encoder_init(&encoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS, 4);
+      int iLength = _encode(&encoder, i, uEncoded);
+      t_packet_header_telemetry_delta* pPHTD = (t_packet_header_telemetry_delta*)(uEncoded + sizeof(t_packet_header));
+      // The first keyframes after the restart are lost
+      if ( (i >= iRestartIndex) && (pPHTD->uSequence == 1) )
+         continue;
+      int iResult = _receive(&decoder, i, uEncoded, iLength, &iWrongPackets);
+      if ( (i >= iRestartIndex) && (iResult > 0) )
+      {
+         if ( 0 == iRebuiltAfterRestart )
+            uTimeFirstRebuilt = s_uPacketTime[i];
+         iRebuiltAfterRestart++;
+      }
+   }
+   log_line("Vehicle restart: rebuilding resumed %u ms after the restart, %u session changes", uTimeFirstRebuilt - s_uPacketTime[iRestartIndex], decoder.uSessionsChanged);
+   _check_true("vehicle restart: rebuilt packets are the original ones", 0 == iWrongPackets);
+   _check_true("vehicle restart: packets are rebuilt again after the next keyframes", iRebuiltAfterRestart > 0);
+}
+
+// Corrupted packets (that passed the radio CRC check) must never make the decoder read or write out of bounds
+void _test_corrupted()
+{
+   t_telemetry_delta_encoder encoder;
+   t_telemetry_delta_decoder decoder;
+   telemetry_delta_encoder_init(&encoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS, 5);
+   telemetry_delta_decoder_init(&decoder);
+   u64 uState = s_uRandomState ^ 0x2545F4914F6CDD1DULL;
+
+   u8 uEncoded[MAX_PACKET_TOTAL_SIZE];
+   u8 uDecoded[MAX_PACKET_TOTAL_SIZE];
+   int iBadLengths = 0;
+   int iCount = (s_iCountPackets < 20000)?s_iCountPackets:20000;
+   for( int i=0; i<iCount; i++ )
+   {
+      int iLength = _encode(&encoder, i, uEncoded);
+      if ( ((t_packet_header*)uEncoded)->packet_type != PACKET_TYPE_RUBY_TELEMETRY_DELTA )
+         continue;
+      if ( 0 != (i % 3) )
+      {
+         int iFlips = 1 + _random(&uState, 4);
+         for( int k=0; k<iFlips; k++ )
+         {
+            int iPos = sizeof(t_packet_header) + _random(&uState, iLength - sizeof(t_packet_header));
+            uEncoded[iPos] ^= (u8)(1 + _random(&uState, 255));
+         }
+         if ( 0 == (i % 7) )
+         {
+            iLength = sizeof(t_packet_header) + _random(&uState, iLength - sizeof(t_packet_header));
+            ((t_packet_header*)uEncoded)->total_length = (u16)iLength;
+         }
+      }
+      int iResult = telemetry_delta_decode(&decoder, uEncoded, iLength, uDecoded);
+      if ( (iResult > MAX_PACKET_TOTAL_SIZE) || ((iResult > 0) && (iResult != ((t_packet_header*)uDecoded)->total_length)) )
+         iBadLengths++;
+   }
+   log_line("Corrupted packets: %u invalid, %u skipped, %u rebuilt", decoder.uPacketsInvalid, decoder.uPacketsNoKeyframe + decoder.uPacketsOutOfOrder, decoder.uPackets - decoder.uPacketsNoKeyframe - decoder.uPacketsOutOfOrder);
+   _check_true("corrupted packets: rebuilt lengths are valid", 0 == iBadLengths);
+   _check_true("corrupted packets: detected as invalid", decoder.uPacketsInvalid > 0);
+}
+
+void _bench()
+{
+   t_telemetry_delta_encoder encoder;
+   t_telemetry_delta_decoder decoder;
+   u8 uEncoded[MAX_PACKET_TOTAL_SIZE];
+   u8 uDecoded[MAX_PACKET_TOTAL_SIZE];
+   int iRounds = 5;
+
+   u8* pEncodedAll = (u8*)malloc(s_iStreamLength + s_iCountPackets * sizeof(t_packet_header_telemetry_delta));
+   int* pEncodedOffsets = (int*)malloc((s_iCountPackets+1) * sizeof(int));
+   if ( (NULL == pEncodedAll) || (NULL == pEncodedOffsets) )
+      return;
+
+   u64 uTimeEncode = 0;
+   u64 uTimeDecode = 0;
+   for( int r=0; r<iRounds; r++ )
+   {
+      telemetry_delta_encoder_init(&encoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS, (u8)r);
+      int iPos = 0;
+      u64 uStart = get_current_timestamp_micros();
+      for( int i=0; i<s_iCountPackets; i++ )
+      {
+         int iLength = telemetry_delta_encode(&encoder, _get_packet(i), _get_packet_length(i), uEncoded, s_uPacketTime[i]);
+         if ( 0 == iLength )
+         {
+            iLength = _get_packet_length(i);
+            memcpy(uEncoded, _get_packet(i), iLength);
+         }
+         pEncodedOffsets[i] = iPos;
+         memcpy(pEncodedAll + iPos, uEncoded, iLength);
+         iPos += iLength;
+      }
+      pEncodedOffsets[s_iCountPackets] = iPos;
+      uTimeEncode += get_current_timestamp_micros() - uStart;
+
+      telemetry_delta_decoder_init(&decoder);
+      uStart = get_current_timestamp_micros();
+      for( int i=0; i<s_iCountPackets; i++ )
+      {
+         u8* pPacket = pEncodedAll + pEncodedOffsets[i];
+         if ( ((t_packet_header*)pPacket)->packet_type == PACKET_TYPE_RUBY_TELEMETRY_DELTA )
+            telemetry_delta_decode(&decoder, pPacket, pEncodedOffsets[i+1] - pEncodedOffsets[i], uDecoded);
+      }
+      uTimeDecode += get_current_timestamp_micros() - uStart;
+   }
+   free(pEncodedAll);
+   free(pEncodedOffsets);
+
+   u64 uPackets = (u64)s_iCountPackets * iRounds;
+   if ( 0 == uTimeEncode )
+      uTimeEncode = 1;
+   if ( 0 == uTimeDecode )
+      uTimeDecode = 1;
+   log_line("Bench: encode %.2f us/packet, decode (incl. CRC) %.2f us/packet",
+      (double)uTimeEncode/(double)uPackets, (double)uTimeDecode/(double)uPackets);
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestTelemetryDelta");
+   log_enable_stdout();
+
+   const char* szFile = NULL;
+   const char* szRecord = NULL;
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-file")) && (i+1 < argc) )
+         szFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-record")) && (i+1 < argc) )
+         szRecord = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-seconds")) && (i+1 < argc) )
+         s_iSeconds = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-loss")) && (i+1 < argc) )
+         s_iLossPerThousand = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i+1 < argc) )
+         s_uRandomState = (u64)atoi(argv[++i]);
+   }
+   if ( s_iSeconds < 5 )
+      s_iSeconds = 5;
+   if ( s_iSeconds > 1200 )
+      s_iSeconds = 1200;
+   if ( s_uRandomState == 0 )
+      s_uRandomState = 1;
+
+   s_pStream = (u8*)malloc(TEST_MAX_STREAM);
+   if ( NULL == s_pStream )
+      return 1;
+   if ( NULL != szFile )
+   {
+      s_bGenerated = false;
+      if ( ! _load_packets(szFile) )
+         return 1;
+   }
+   else
+      _generate_packets();
+
+   if ( NULL != szRecord )
+      _save_packets(szRecord);
+
+   _test_lossless();
+   _test_lossy();
+   _test_vehicle_restart();
+   _test_corrupted();
+   _bench();
+
+   free(s_pStream);
+   log_line("Telemetry delta tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
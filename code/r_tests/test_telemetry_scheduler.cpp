@@ -0,0 +1,681 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/telemetry_scheduler.h"
+#include "../../mavlink/common/mavlink.h"
+#include <pthread.h>
+#include <termios.h>
+
+// Checks the MAVLink telemetry scheduler (framing, classes, coalescing, priorities) and replays a
+// FC telemetry stream through a pty, at the serial port speed, read the same way the vehicle reads
+// the FC serial port. The stream is sent to a lossy radio link both the old way (fixed size chunks)
+// and through the scheduler, and the controller side parses what it gets.
+// Usage: test_telemetry_scheduler [-file recorded_fc_stream] [-record out_file] [-seconds n] [-baud n] [-loss per_thousand] [-seed n]
+// Without -file, a generated ArduPilot like stream is used (it can be saved with -record).
+
+#define TEST_SEGMENT_LENGTH 300
+#define TEST_TICK_MS 10
+#define TEST_MAX_STREAM (4*1024*1024)
+#define TEST_MAX_TRACKED 100000
+
+// Parsers channels
+#define CHANNEL_GENERATE MAVLINK_COMM_0
+#define CHANNEL_REFERENCE MAVLINK_COMM_1
+#define CHANNEL_CONTROLLER_CHUNKS MAVLINK_COMM_2
+#define CHANNEL_CONTROLLER_SCHEDULER MAVLINK_COMM_3
+#define CHANNEL_SEGMENT_CHECK 4
+
+int s_iFailed = 0;
+u64 s_uRandomState = 1;
+int s_iSeconds = 5;
+int s_iBaudRate = 115200;
+int s_iLossPerThousand = 50;
+
+u8* s_pStream = NULL;
+int s_iStreamLength = 0;
+// Stream bytes at each tick, for the generated stream; -1 for a recorded stream, paced by the baud rate
+int s_iTickEnd[100000];
+int s_iTicks = -1;
+
+int s_fdPtyMaster = -1;
+int s_fdPtySlave = -1;
+
+void _check_true(const char* szTest, int iResult)
+{
+   if ( iResult )
+      return;
+   log_line("FAILED: %s", szTest);
+   s_iFailed++;
+}
+
+u32 _random_per_thousand(u64* pState)
+{
+   *pState ^= *pState >> 12;
+   *pState ^= *pState << 25;
+   *pState ^= *pState >> 27;
+   return (u32)(((*pState * 2685821657736338717ULL) >> 32) % 1000);
+}
+
+int _build_message(u32 uMessageId, int iIndex, u8* pBuffer)
+{
+   mavlink_message_t msg;
+   switch ( uMessageId )
+   {
+      case MAVLINK_MSG_ID_HEARTBEAT:
+      {
+         mavlink_heartbeat_t data;
+         memset(&data, 0, sizeof(data));
+         data.type = MAV_TYPE_QUADROTOR;
+         data.autopilot = MAV_AUTOPILOT_ARDUPILOTMEGA;
+         mavlink_msg_heartbeat_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_SYS_STATUS:
+      {
+         mavlink_sys_status_t data;
+         memset(&data, 0, sizeof(data));
+         data.voltage_battery = 16000 - iIndex;
+         mavlink_msg_sys_status_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_STATUSTEXT:
+      {
+         mavlink_statustext_t data;
+         memset(&data, 0, sizeof(data));
+         snprintf(data.text, sizeof(data.text), "EKF status message %d", iIndex);
+         mavlink_msg_statustext_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_ATTITUDE:
+      {
+         mavlink_attitude_t data;
+         memset(&data, 0, sizeof(data));
+         data.time_boot_ms = iIndex;
+         data.roll = 0.001 * iIndex;
+         mavlink_msg_attitude_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+      {
+         mavlink_global_position_int_t data;
+         memset(&data, 0, sizeof(data));
+         data.time_boot_ms = iIndex;
+         data.lat = 450000000 + iIndex;
+         mavlink_msg_global_position_int_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_GPS_RAW_INT:
+      {
+         mavlink_gps_raw_int_t data;
+         memset(&data, 0, sizeof(data));
+         data.time_usec = iIndex;
+         data.satellites_visible = 12;
+         mavlink_msg_gps_raw_int_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_VFR_HUD:
+      {
+         mavlink_vfr_hud_t data;
+         memset(&data, 0, sizeof(data));
+         data.alt = 0.1 * iIndex;
+         mavlink_msg_vfr_hud_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_RC_CHANNELS:
+      {
+         mavlink_rc_channels_t data;
+         memset(&data, 0, sizeof(data));
+         data.time_boot_ms = iIndex;
+         data.chancount = 16;
+         mavlink_msg_rc_channels_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_RAW_IMU:
+      {
+         mavlink_raw_imu_t data;
+         memset(&data, 0, sizeof(data));
+         data.time_usec = iIndex;
+         data.xacc = iIndex % 100;
+         mavlink_msg_raw_imu_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
+      {
+         mavlink_servo_output_raw_t data;
+         memset(&data, 0, sizeof(data));
+         data.time_usec = iIndex;
+         data.servo1_raw = 1500;
+         mavlink_msg_servo_output_raw_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_BATTERY_STATUS:
+      {
+         mavlink_battery_status_t data;
+         memset(&data, 0, sizeof(data));
+         data.id = iIndex % 4;
+         data.current_consumed = iIndex;
+         data.battery_remaining = 80;
+         mavlink_msg_battery_status_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      case MAVLINK_MSG_ID_PARAM_VALUE:
+      {
+         mavlink_param_value_t data;
+         memset(&data, 0, sizeof(data));
+         snprintf(data.param_id, sizeof(data.param_id), "PARAM_%d", iIndex);
+         data.param_count = 1000;
+         data.param_index = iIndex;
+         data.param_type = MAV_PARAM_TYPE_REAL32;
+         mavlink_msg_param_value_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+      default:
+      {
+         mavlink_named_value_float_t data;
+         memset(&data, 0, sizeof(data));
+         snprintf(data.name, sizeof(data.name), "VAL%d", iIndex % 4);
+         data.value = iIndex;
+         mavlink_msg_named_value_float_encode_chan(1, 1, CHANNEL_GENERATE, &msg, &data);
+         break;
+      }
+   }
+   return mavlink_msg_to_send_buffer(pBuffer, &msg);
+}
+
+// ArduPilot like stream: flight data, raw IMU, status texts and a parameters download
+void _generate_stream()
+{
+   typedef struct { u32 uMessageId; int iPeriodMs; } t_stream;
+   t_stream streams[] =
+   {
+      { MAVLINK_MSG_ID_HEARTBEAT, 1000 },
+      { MAVLINK_MSG_ID_SYS_STATUS, 500 },
+      { MAVLINK_MSG_ID_STATUSTEXT, 700 },
+      { MAVLINK_MSG_ID_ATTITUDE, 40 },
+      { MAVLINK_MSG_ID_GLOBAL_POSITION_INT, 100 },
+      { MAVLINK_MSG_ID_GPS_RAW_INT, 200 },
+      { MAVLINK_MSG_ID_VFR_HUD, 100 },
+      { MAVLINK_MSG_ID_RC_CHANNELS, 200 },
+      { MAVLINK_MSG_ID_RAW_IMU, 20 },
+      { MAVLINK_MSG_ID_SERVO_OUTPUT_RAW, 100 },
+      { MAVLINK_MSG_ID_NAMED_VALUE_FLOAT, 50 }
+   };
+   s_iStreamLength = 0;
+   s_iTicks = s_iSeconds * 1000 / TEST_TICK_MS;
+   int iParamIndex = 0;
+   for( int t=0; t<s_iTicks; t++ )
+   {
+      int iTimeMs = t * TEST_TICK_MS;
+      for( int i=0; i<(int)(sizeof(streams)/sizeof(streams[0])); i++ )
+      {
+         if ( (iTimeMs % streams[i].iPeriodMs) == 0 )
+            s_iStreamLength += _build_message(streams[i].uMessageId, iTimeMs/streams[i].iPeriodMs, s_pStream + s_iStreamLength);
+      }
+      // Parameters download during the second and third second, 30 params/second
+      if ( (iTimeMs >= 1000) && (iTimeMs < 3000) && ((t % 2) == 0) && (iParamIndex < 1000) )
+      if ( (iTimeMs % 100) < 60 )
+         s_iStreamLength += _build_message(MAVLINK_MSG_ID_PARAM_VALUE, iParamIndex++, s_pStream + s_iStreamLength);
+      s_iTickEnd[t] = s_iStreamLength;
+   }
+   log_line("Generated FC stream: %d seconds, %d bytes (%d bytes/sec)", s_iSeconds, s_iStreamLength, s_iStreamLength/s_iSeconds);
+}
+
+// Writes the stream to the pty master, no faster than the serial port speed
+void* _thread_write_fc_stream(void* pParam)
+{
+   int iBytesPerTick = s_iBaudRate / 10 * TEST_TICK_MS / 1000;
+   u32 uTimeStart = get_current_timestamp_ms();
+   int iPos = 0;
+   int iTick = 0;
+   while ( iPos < s_iStreamLength )
+   {
+      int iEnd = iPos + iBytesPerTick;
+      if ( (s_iTicks > 0) && (iTick < s_iTicks) && (s_iTickEnd[iTick] < iEnd) )
+         iEnd = s_iTickEnd[iTick];
+      if ( iEnd > s_iStreamLength )
+         iEnd = s_iStreamLength;
+      while ( iPos < iEnd )
+      {
+         int iWritten = write(s_fdPtyMaster, s_pStream + iPos, iEnd - iPos);
+         if ( iWritten <= 0 )
+         {
+            hardware_sleep_ms(1);
+            continue;
+         }
+         iPos += iWritten;
+      }
+      iTick++;
+      u32 uTimeNext = uTimeStart + iTick * TEST_TICK_MS;
+      u32 uTimeNow = get_current_timestamp_ms();
+      if ( uTimeNext > uTimeNow )
+         hardware_sleep_ms(uTimeNext - uTimeNow);
+   }
+   return NULL;
+}
+
+int _open_pty()
+{
+   s_fdPtyMaster = posix_openpt(O_RDWR | O_NOCTTY);
+   if ( s_fdPtyMaster < 0 )
+      return 0;
+   if ( (0 != grantpt(s_fdPtyMaster)) || (0 != unlockpt(s_fdPtyMaster)) )
+      return 0;
+   s_fdPtySlave = open(ptsname(s_fdPtyMaster), O_RDWR | O_NOCTTY);
+   if ( s_fdPtySlave < 0 )
+      return 0;
+   struct termios tio;
+   tcgetattr(s_fdPtySlave, &tio);
+   cfmakeraw(&tio);
+   tcsetattr(s_fdPtySlave, TCSANOW, &tio);
+   tcgetattr(s_fdPtyMaster, &tio);
+   cfmakeraw(&tio);
+   tcsetattr(s_fdPtyMaster, TCSANOW, &tio);
+   return 1;
+}
+
+typedef struct
+{
+   u32 uMessages[TELEMETRY_CLASSES];
+   u32 uLatencySumMicros[TELEMETRY_CLASSES];
+   u32 uLatencyMaxMicros[TELEMETRY_CLASSES];
+   u32 uLatencyCount[TELEMETRY_CLASSES];
+   u32 uSegments;
+   u32 uSegmentsLost;
+   u32 uBrokenMessages;
+} t_test_results;
+
+// Whole messages read from the serial port, for the latency of the old segmenting
+typedef struct
+{
+   int iEndOffset;
+   u32 uTimeReadMicros;
+   int iClass;
+} t_tracked_message;
+
+t_tracked_message s_TrackedMessages[TEST_MAX_TRACKED];
+int s_iTrackedCount = 0;
+int s_iTrackedDone = 0;
+t_test_results s_ResultsOffered;
+t_test_results s_ResultsChunks;
+t_test_results s_ResultsScheduler;
+u64 s_uLossStateChunks = 1;
+u64 s_uLossStateScheduler = 1;
+int s_iSchedulerSegmentsNotWhole = 0;
+
+void _controller_receive(t_test_results* pResults, int iChannel, u64* pLossState, u8* pSegment, int iLength)
+{
+   pResults->uSegments++;
+   if ( (int)_random_per_thousand(pLossState) < s_iLossPerThousand )
+   {
+      pResults->uSegmentsLost++;
+      return;
+   }
+   mavlink_message_t msg;
+   mavlink_status_t status;
+   for( int i=0; i<iLength; i++ )
+   {
+      if ( mavlink_parse_char(iChannel, pSegment[i], &msg, &status) )
+         pResults->uMessages[telemetry_scheduler_get_message_class(msg.msgid)]++;
+      // Parse errors since the previous call
+      pResults->uBrokenMessages += status.packet_rx_drop_count;
+   }
+}
+
+// Each scheduler segment must hold only whole messages
+void _check_whole_messages(u8* pSegment, int iLength)
+{
+   mavlink_status_t* pStatus = mavlink_get_channel_status(CHANNEL_SEGMENT_CHECK);
+   memset(pStatus, 0, sizeof(mavlink_status_t));
+   mavlink_message_t msg;
+   mavlink_status_t status;
+   int iMessagesEnd = 0;
+   int iErrors = 0;
+   for( int i=0; i<iLength; i++ )
+   {
+      if ( mavlink_parse_char(CHANNEL_SEGMENT_CHECK, pSegment[i], &msg, &status) )
+         iMessagesEnd = i+1;
+      iErrors += status.packet_rx_drop_count;
+   }
+   if ( (iMessagesEnd != iLength) || (0 != iErrors) )
+      s_iSchedulerSegmentsNotWhole++;
+}
+
+void _add_latency(t_test_results* pResults, int iClass, u32 uLatencyMicros)
+{
+   pResults->uLatencySumMicros[iClass] += uLatencyMicros;
+   pResults->uLatencyCount[iClass]++;
+   if ( uLatencyMicros > pResults->uLatencyMaxMicros[iClass] )
+      pResults->uLatencyMaxMicros[iClass] = uLatencyMicros;
+}
+
+void _replay()
+{
+   if ( ! _open_pty() )
+   {
+      log_line("Failed to open a pty, error: %s", strerror(errno));
+      s_iFailed++;
+      return;
+   }
+   memset(&s_ResultsOffered, 0, sizeof(t_test_results));
+   memset(&s_ResultsChunks, 0, sizeof(t_test_results));
+   memset(&s_ResultsScheduler, 0, sizeof(t_test_results));
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+
+   pthread_t thread;
+   pthread_create(&thread, NULL, &_thread_write_fc_stream, NULL);
+
+   u8 uSerialBuffer[1024];
+   u8 uChunk[RAW_TELEMETRY_MAX_BUFFER];
+   int iChunkLength = 0;
+   u32 uTimeLastChunkMs = get_current_timestamp_ms();
+   u8 uSegment[RAW_TELEMETRY_MAX_BUFFER];
+   int iTotalRead = 0;
+   int iTotalChunksSent = 0;
+   u32 uTimeLastData = get_current_timestamp_ms();
+   int iSleepMs = 15;
+
+   while ( get_current_timestamp_ms() < uTimeLastData + 500 )
+   {
+      // Same as the vehicle telemetry main loop
+      hardware_sleep_ms(iSleepMs);
+      iSleepMs = 15;
+      struct timeval to;
+      to.tv_sec = 0;
+      to.tv_usec = 2000;
+      fd_set readset;
+      FD_ZERO(&readset);
+      FD_SET(s_fdPtySlave, &readset);
+      int iLength = 0;
+      if ( select(s_fdPtySlave+1, &readset, NULL, NULL, &to) > 0 )
+         iLength = read(s_fdPtySlave, uSerialBuffer, 1023);
+      u32 uTimeNowMicros = get_current_timestamp_micros();
+      u32 uTimeNowMs = get_current_timestamp_ms();
+      if ( iLength > 0 )
+      {
+         iSleepMs = 5;
+         uTimeLastData = uTimeNowMs;
+         mavlink_message_t msg;
+         mavlink_status_t status;
+         for( int i=0; i<iLength; i++ )
+         {
+            if ( ! mavlink_parse_char(CHANNEL_REFERENCE, uSerialBuffer[i], &msg, &status) )
+               continue;
+            int iClass = telemetry_scheduler_get_message_class(msg.msgid);
+            s_ResultsOffered.uMessages[iClass]++;
+            if ( s_iTrackedCount < TEST_MAX_TRACKED )
+            {
+               s_TrackedMessages[s_iTrackedCount].iEndOffset = iTotalRead + i + 1;
+               s_TrackedMessages[s_iTrackedCount].uTimeReadMicros = uTimeNowMicros;
+               s_TrackedMessages[s_iTrackedCount].iClass = iClass;
+               s_iTrackedCount++;
+            }
+         }
+
+         // Old way: fixed size chunks
+         u8* pData = uSerialBuffer;
+         int iLeft = iLength;
+         while ( iLeft > 0 )
+         {
+            int iCopy = TEST_SEGMENT_LENGTH - iChunkLength;
+            if ( iCopy > iLeft )
+               iCopy = iLeft;
+            memcpy(uChunk + iChunkLength, pData, iCopy);
+            iChunkLength += iCopy;
+            pData += iCopy;
+            iLeft -= iCopy;
+            if ( iChunkLength < TEST_SEGMENT_LENGTH )
+               break;
+            iTotalChunksSent += iChunkLength;
+            _controller_receive(&s_ResultsChunks, CHANNEL_CONTROLLER_CHUNKS, &s_uLossStateChunks, uChunk, iChunkLength);
+            iChunkLength = 0;
+            uTimeLastChunkMs = uTimeNowMs;
+            while ( (s_iTrackedDone < s_iTrackedCount) && (s_TrackedMessages[s_iTrackedDone].iEndOffset <= iTotalChunksSent) )
+            {
+               _add_latency(&s_ResultsChunks, s_TrackedMessages[s_iTrackedDone].iClass, uTimeNowMicros - s_TrackedMessages[s_iTrackedDone].uTimeReadMicros);
+               s_iTrackedDone++;
+            }
+         }
+         iTotalRead += iLength;
+
+         telemetry_scheduler_add_serial_data(uSerialBuffer, iLength, uTimeNowMicros);
+      }
+
+      // Periodic loop
+      if ( (iChunkLength >= RAW_TELEMETRY_MIN_SEND_LENGTH) || ((iChunkLength > 0) && (uTimeNowMs >= uTimeLastChunkMs + RAW_TELEMETRY_SEND_TIMEOUT)) )
+      {
+         iTotalChunksSent += iChunkLength;
+         _controller_receive(&s_ResultsChunks, CHANNEL_CONTROLLER_CHUNKS, &s_uLossStateChunks, uChunk, iChunkLength);
+         iChunkLength = 0;
+         uTimeLastChunkMs = uTimeNowMs;
+         while ( (s_iTrackedDone < s_iTrackedCount) && (s_TrackedMessages[s_iTrackedDone].iEndOffset <= iTotalChunksSent) )
+         {
+            _add_latency(&s_ResultsChunks, s_TrackedMessages[s_iTrackedDone].iClass, uTimeNowMicros - s_TrackedMessages[s_iTrackedDone].uTimeReadMicros);
+            s_iTrackedDone++;
+         }
+      }
+
+      for( int i=0; i<4; i++ )
+      {
+         int iSegmentLength = telemetry_scheduler_get_segment(uSegment, uTimeNowMicros);
+         if ( iSegmentLength <= 0 )
+            break;
+         _check_whole_messages(uSegment, iSegmentLength);
+         _controller_receive(&s_ResultsScheduler, CHANNEL_CONTROLLER_SCHEDULER, &s_uLossStateScheduler, uSegment, iSegmentLength);
+      }
+   }
+   pthread_join(thread, NULL);
+   close(s_fdPtySlave);
+   close(s_fdPtyMaster);
+   log_line("Replayed %d bytes from the FC stream, read %d bytes from the pty", s_iStreamLength, iTotalRead);
+   _check_true("All the FC stream was read from the pty", iTotalRead == s_iStreamLength);
+}
+
+void _log_results()
+{
+   const char* szClasses[TELEMETRY_CLASSES] = { "critical", "flight", "normal", "bulk" };
+   shared_mem_telemetry_scheduler_stats* pStats = telemetry_scheduler_update_stats(get_current_timestamp_ms());
+   log_line("Radio loss: %d/1000 packets. Fixed chunks: %u packets (%u lost), %u broken messages. Scheduler: %u packets (%u lost), %u broken messages",
+      s_iLossPerThousand, s_ResultsChunks.uSegments, s_ResultsChunks.uSegmentsLost, s_ResultsChunks.uBrokenMessages,
+      s_ResultsScheduler.uSegments, s_ResultsScheduler.uSegmentsLost, s_ResultsScheduler.uBrokenMessages);
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      shared_mem_telemetry_scheduler_class_stats* pClass = &pStats->classes[i];
+      log_line("%-8s read %5u msg | fixed chunks: delivered %5u, latency avg/max %6u/%6u us | scheduler: delivered %5u (coalesced %u, dropped %u), latency avg/max %6u/%6u us, %u bytes",
+         szClasses[i], s_ResultsOffered.uMessages[i],
+         s_ResultsChunks.uMessages[i],
+         s_ResultsChunks.uLatencyCount[i]?(s_ResultsChunks.uLatencySumMicros[i]/s_ResultsChunks.uLatencyCount[i]):0,
+         s_ResultsChunks.uLatencyMaxMicros[i],
+         s_ResultsScheduler.uMessages[i], pClass->uMessagesCoalesced, pClass->uMessagesDropped,
+         pClass->uLatencyAvgMicrosLastInterval, pClass->uLatencyMaxMicros, pClass->uBytesSent);
+   }
+
+   _check_true("Scheduler segments hold only whole messages", 0 == s_iSchedulerSegmentsNotWhole);
+   _check_true("No broken messages at the controller from the scheduler", 0 == s_ResultsScheduler.uBrokenMessages);
+   _check_true("No critical message coalesced or dropped", (0 == pStats->classes[TELEMETRY_CLASS_CRITICAL].uMessagesCoalesced) && (0 == pStats->classes[TELEMETRY_CLASS_CRITICAL].uMessagesDropped));
+   _check_true("Scheduler got all the messages", pStats->classes[TELEMETRY_CLASS_CRITICAL].uMessagesIn + pStats->classes[TELEMETRY_CLASS_FLIGHT].uMessagesIn +
+      pStats->classes[TELEMETRY_CLASS_NORMAL].uMessagesIn + pStats->classes[TELEMETRY_CLASS_BULK].uMessagesIn ==
+      s_ResultsOffered.uMessages[0] + s_ResultsOffered.uMessages[1] + s_ResultsOffered.uMessages[2] + s_ResultsOffered.uMessages[3]);
+   for( int i=0; i<TELEMETRY_CLASSES; i++ )
+   {
+      shared_mem_telemetry_scheduler_class_stats* pClass = &pStats->classes[i];
+      char szTest[128];
+      snprintf(szTest, sizeof(szTest), "%s: all messages accounted for", szClasses[i]);
+      _check_true(szTest, pClass->uMessagesIn == pClass->uMessagesSent + pClass->uMessagesCoalesced + pClass->uMessagesDropped + pClass->uQueuedMessages);
+      if ( (i == TELEMETRY_CLASS_CRITICAL) || (i == TELEMETRY_CLASS_FLIGHT) )
+      if ( s_ResultsChunks.uLatencyCount[i] > 0 )
+      {
+         snprintf(szTest, sizeof(szTest), "%s: lower average latency than fixed chunks", szClasses[i]);
+         _check_true(szTest, pClass->uLatencyAvgMicrosLastInterval < s_ResultsChunks.uLatencySumMicros[i]/s_ResultsChunks.uLatencyCount[i]);
+      }
+   }
+}
+
+void _test_scheduler()
+{
+   u8 uStream[4096];
+   u8 uSegment[RAW_TELEMETRY_MAX_BUFFER];
+   int iLength = 0;
+   u32 uTime = get_current_timestamp_micros();
+
+   // A critical message fed one byte at a time is queued once and sent right away
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+   iLength = _build_message(MAVLINK_MSG_ID_HEARTBEAT, 0, uStream);
+   for( int i=0; i<iLength; i++ )
+   {
+      telemetry_scheduler_add_serial_data(&uStream[i], 1, uTime);
+      if ( i < iLength-1 )
+         _check_true("No segment before the message is complete", 0 == telemetry_scheduler_get_segment(uSegment, uTime));
+   }
+   _check_true("Critical message sent right away", iLength == telemetry_scheduler_get_segment(uSegment, uTime));
+   _check_true("Critical message sent unchanged", 0 == memcmp(uSegment, uStream, iLength));
+
+   // Garbage and corrupted messages are discarded
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+   u8 uGarbage[5] = { 0x11, 0x22, 0x33, 0x44, 0x55 };
+   telemetry_scheduler_add_serial_data(uGarbage, 5, uTime);
+   iLength = _build_message(MAVLINK_MSG_ID_STATUSTEXT, 1, uStream);
+   uStream[iLength-1] ^= 0xFF;
+   telemetry_scheduler_add_serial_data(uStream, iLength, uTime);
+   iLength = _build_message(MAVLINK_MSG_ID_STATUSTEXT, 2, uStream);
+   telemetry_scheduler_add_serial_data(uStream, iLength, uTime);
+   _check_true("Valid message after garbage and a corrupted message", iLength == telemetry_scheduler_get_segment(uSegment, uTime));
+   _check_true("Garbage and corrupted message counted", telemetry_scheduler_get_stats()->uBytesDiscarded >= 5 + (u32)iLength - 1);
+
+   // Stream messages are coalesced, flight messages wait up to their max delay
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+   int iLength1 = _build_message(MAVLINK_MSG_ID_ATTITUDE, 1, uStream);
+   telemetry_scheduler_add_serial_data(uStream, iLength1, uTime);
+   int iLength2 = _build_message(MAVLINK_MSG_ID_ATTITUDE, 2, uStream);
+   telemetry_scheduler_add_serial_data(uStream, iLength2, uTime + 1000);
+   _check_true("Flight message waits", 0 == telemetry_scheduler_get_segment(uSegment, uTime + 2000));
+   _check_true("Coalesced flight message sent after max delay", iLength2 == telemetry_scheduler_get_segment(uSegment, uTime + TELEMETRY_SCHEDULER_MAX_DELAY_MS_FLIGHT*1000));
+   _check_true("Latest value sent", 0 == memcmp(uSegment, uStream, iLength2));
+   _check_true("Coalesced counted", 1 == telemetry_scheduler_get_stats()->classes[TELEMETRY_CLASS_FLIGHT].uMessagesCoalesced);
+
+   // Multi instance messages (battery ids, value names) arriving together are not coalesced
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+   iLength = 0;
+   iLength += _build_message(MAVLINK_MSG_ID_BATTERY_STATUS, 0, uStream + iLength);
+   iLength += _build_message(MAVLINK_MSG_ID_BATTERY_STATUS, 1, uStream + iLength);
+   iLength += _build_message(MAVLINK_MSG_ID_NAMED_VALUE_FLOAT, 0, uStream + iLength);
+   iLength += _build_message(MAVLINK_MSG_ID_NAMED_VALUE_FLOAT, 1, uStream + iLength);
+   telemetry_scheduler_add_serial_data(uStream, iLength, uTime);
+   int iSent = 0;
+   int iSentSegment = 0;
+   while ( (iSentSegment = telemetry_scheduler_get_segment(uSegment, uTime + TELEMETRY_SCHEDULER_MAX_DELAY_MS_NORMAL*1000)) > 0 )
+      iSent += iSentSegment;
+   _check_true("All battery ids and named values sent", iSent == iLength);
+   _check_true("Battery ids not coalesced", (0 == telemetry_scheduler_get_stats()->classes[TELEMETRY_CLASS_FLIGHT].uMessagesCoalesced) && (2 == telemetry_scheduler_get_stats()->classes[TELEMETRY_CLASS_FLIGHT].uMessagesSent));
+   _check_true("Named values not coalesced", (0 == telemetry_scheduler_get_stats()->classes[TELEMETRY_CLASS_NORMAL].uMessagesCoalesced) && (2 == telemetry_scheduler_get_stats()->classes[TELEMETRY_CLASS_NORMAL].uMessagesSent));
+
+   // Params are never coalesced; critical messages go first
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+   iLength = 0;
+   iLength += _build_message(MAVLINK_MSG_ID_PARAM_VALUE, 1, uStream + iLength);
+   iLength += _build_message(MAVLINK_MSG_ID_PARAM_VALUE, 2, uStream + iLength);
+   int iHeartbeatLength = _build_message(MAVLINK_MSG_ID_HEARTBEAT, 3, uStream + iLength);
+   telemetry_scheduler_add_serial_data(uStream, iLength + iHeartbeatLength, uTime);
+   int iSegmentLength = telemetry_scheduler_get_segment(uSegment, uTime);
+   _check_true("Critical message first", (iSegmentLength > iHeartbeatLength) && (0 == memcmp(uSegment, uStream + iLength, iHeartbeatLength)));
+   _check_true("Params not coalesced", (iSegmentLength == iLength + iHeartbeatLength) && (2 == telemetry_scheduler_get_stats()->classes[TELEMETRY_CLASS_BULK].uMessagesSent));
+
+   // Segments never split messages
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+   iLength = 0;
+   for( int i=0; i<60; i++ )
+      iLength += _build_message(MAVLINK_MSG_ID_STATUSTEXT, i, uStream + iLength);
+   telemetry_scheduler_add_serial_data(uStream, iLength, uTime);
+   int iTotal = 0;
+   s_iSchedulerSegmentsNotWhole = 0;
+   while ( (iSegmentLength = telemetry_scheduler_get_segment(uSegment, uTime)) > 0 )
+   {
+      _check_true("Segment fits", iSegmentLength <= TEST_SEGMENT_LENGTH);
+      _check_whole_messages(uSegment, iSegmentLength);
+      iTotal += iSegmentLength;
+   }
+   _check_true("Whole messages in each segment", 0 == s_iSchedulerSegmentsNotWhole);
+   _check_true("All messages sent", iTotal == iLength);
+
+   // Bulk rate limit
+   telemetry_scheduler_init(TEST_SEGMENT_LENGTH);
+   uTime = get_current_timestamp_micros();
+   telemetry_scheduler_set_rate_limit(TELEMETRY_CLASS_BULK, 1000);
+   iTotal = 0;
+   for( int t=0; t<2000; t+=10 )
+   {
+      u32 uNow = uTime + t*1000;
+      iLength = _build_message(MAVLINK_MSG_ID_PARAM_VALUE, t, uStream);
+      telemetry_scheduler_add_serial_data(uStream, iLength, uNow);
+      while ( (iSegmentLength = telemetry_scheduler_get_segment(uSegment, uNow)) > 0 )
+         iTotal += iSegmentLength;
+   }
+   log_line("Bulk class limited to 1000 bytes/sec: sent %d bytes in 2 seconds", iTotal);
+   _check_true("Bulk rate limit", (iTotal <= 2000 + TEST_SEGMENT_LENGTH + MAVLINK_MAX_PACKET_LEN) && (iTotal >= 1500));
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestTelemetryScheduler");
+   log_enable_stdout();
+
+   const char* szFile = NULL;
+   const char* szRecord = NULL;
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-file")) && (i+1 < argc) )
+         szFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-record")) && (i+1 < argc) )
+         szRecord = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-seconds")) && (i+1 < argc) )
+         s_iSeconds = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-baud")) && (i+1 < argc) )
+         s_iBaudRate = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-loss")) && (i+1 < argc) )
+         s_iLossPerThousand = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i+1 < argc) )
+         s_uRandomState = (u64)atoi(argv[++i]);
+   }
+   if ( s_iSeconds < 1 )
+      s_iSeconds = 1;
+   if ( s_iSeconds > 600 )
+      s_iSeconds = 600;
+   if ( s_iBaudRate < 9600 )
+      s_iBaudRate = 9600;
+   s_uLossStateChunks = 0x9E3779B97F4A7C15ULL ^ s_uRandomState;
+   s_uLossStateScheduler = 0x9E3779B97F4A7C15ULL ^ s_uRandomState;
+
+   _test_scheduler();
+
+   s_pStream = (u8*)malloc(TEST_MAX_STREAM);
+   if ( NULL != szFile )
+   {
+      FILE* fd = fopen(szFile, "rb");
+      if ( NULL == fd )
+      {
+         log_line("Failed to open recorded FC stream %s", szFile);
+         return 1;
+      }
+      s_iStreamLength = fread(s_pStream, 1, TEST_MAX_STREAM, fd);
+      fclose(fd);
+      s_iTicks = -1;
+      log_line("Loaded recorded FC stream %s: %d bytes, replayed at %d bps", szFile, s_iStreamLength, s_iBaudRate);
+   }
+   else
+      _generate_stream();
+
+   if ( NULL != szRecord )
+   {
+      FILE* fd = fopen(szRecord, "wb");
+      if ( (NULL == fd) || (s_iStreamLength != (int)fwrite(s_pStream, 1, s_iStreamLength, fd)) )
+         log_line("Failed to save the FC stream to %s", szRecord);
+      if ( NULL != fd )
+         fclose(fd);
+   }
+
+   _replay();
+   _log_results();
+   free(s_pStream);
+
+   log_line("Telemetry scheduler tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,390 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/video_nack.h"
+
+// Checks the bitmap retransmission requests encoding, then runs a video link loss simulator (bursty
+// Gilbert-Elliott losses) with both the legacy (block, packet) list requests and the bitmap requests
+// and compares the uplink bytes per recovered packet and the time from a packet loss to its recovery.
+
+#define SIM_DATA_PACKETS 12
+#define SIM_EC_PACKETS 4
+#define SIM_BLOCK_INTERVAL_MS 1
+#define SIM_REQUEST_INTERVAL_MS 15
+#define SIM_WINDOW_BLOCKS 100
+#define SIM_LEGACY_MAX_PACKETS 20
+#define SIM_BITMAP_MAX_PACKETS 120
+#define SIM_BITMAP_MAX_SIZE 200
+
+int s_iFailed = 0;
+
+typedef struct
+{
+   u32 uBlockIndex;
+   u32 uTimeCreated;
+   bool bReceived[SIM_DATA_PACKETS + SIM_EC_PACKETS];
+   int iRecv;
+   bool bDone;
+} t_sim_block;
+
+typedef struct
+{
+   u32 uRequests;
+   u32 uUplinkBytes;
+   u32 uPacketsRequested;
+   u32 uPacketsResent;
+   u32 uPacketsRecovered;
+   u32 uBlocksRecovered;
+   u32 uBlocksLost;
+   u64 uTotalLatencyMs;
+   u32 uMaxLatencyMs;
+   u32 uParseMicros;
+} t_sim_stats;
+
+t_sim_block s_Blocks[SIM_WINDOW_BLOCKS];
+int s_iCountBlocks = 0;
+u32 s_uRandom = 12345;
+u32 s_uSimTime = 0;
+t_sim_stats* s_pStats = NULL;
+
+u32 _random()
+{
+   s_uRandom = s_uRandom * 1103515245 + 12345;
+   return (s_uRandom >> 8) & 0xFFFF;
+}
+
+bool _random_lost(int iPercent)
+{
+   return (int)(_random() % 1000) < iPercent*10;
+}
+
+// Gilbert-Elliott channel: 2% losses in the good state, 70% in the bad state (about 30 packets long bursts)
+bool s_bChannelBad = false;
+bool _channel_lost()
+{
+   if ( s_bChannelBad )
+   {
+      if ( _random_lost(3) )
+         s_bChannelBad = false;
+   }
+   else if ( _random() % 1000 < 8 )
+      s_bChannelBad = true;
+   return _random_lost(s_bChannelBad?70:2);
+}
+
+t_sim_block* _find_block(u32 uBlockIndex)
+{
+   for( int i=0; i<s_iCountBlocks; i++ )
+      if ( s_Blocks[i].uBlockIndex == uBlockIndex )
+         return &s_Blocks[i];
+   return NULL;
+}
+
+// Vehicle side: resend a packet; the resent packet goes over the same channel
+void _resend_packet(u32 uBlockIndex, int iPacketIndex)
+{
+   s_pStats->uPacketsResent++;
+   if ( _channel_lost() )
+      return;
+   t_sim_block* pBlock = _find_block(uBlockIndex);
+   if ( (NULL == pBlock) || pBlock->bDone || pBlock->bReceived[iPacketIndex] )
+      return;
+   pBlock->bReceived[iPacketIndex] = true;
+   pBlock->iRecv++;
+   s_pStats->uPacketsRecovered++;
+   u32 uLatency = s_uSimTime - pBlock->uTimeCreated;
+   s_pStats->uTotalLatencyMs += uLatency;
+   if ( uLatency > s_pStats->uMaxLatencyMs )
+      s_pStats->uMaxLatencyMs = uLatency;
+}
+
+void _on_nack_block(u32 uRequestId, u32 uVideoBlockIndex, const u8* pMissingBitmap, void* pContext)
+{
+   for( int i=0; i<SIM_DATA_PACKETS + SIM_EC_PACKETS; i++ )
+   {
+      if ( video_nack_is_packet_missing(pMissingBitmap, i) )
+         _resend_packet(uVideoBlockIndex, i);
+   }
+}
+
+void _parse_legacy_request(u8* pData, int iLength)
+{
+   u8 uCount = pData[sizeof(u32) + sizeof(u8)];
+   u8* pDataPackets = pData + sizeof(u32) + 2*sizeof(u8);
+   for( int i=0; i<(int)uCount; i++ )
+   {
+      u32 uBlockId = 0;
+      memcpy(&uBlockId, pDataPackets, sizeof(u32));
+      pDataPackets += sizeof(u32);
+      int iPacketIndex = (int) *pDataPackets;
+      pDataPackets++;
+      _resend_packet(uBlockId, iPacketIndex);
+   }
+}
+
+// Controller side: same packets selection as ProcessorRxVideo::checkAndRequestMissingPackets
+void _send_request(bool bBitmap, u32 uRequestId)
+{
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   u8* pDataInfo = uBuffer + sizeof(u32) + 2*sizeof(u8);
+   t_video_nack_builder nackBuilder;
+   if ( bBitmap )
+      video_nack_builder_init(&nackBuilder, uBuffer, SIM_BITMAP_MAX_SIZE, uRequestId, 0);
+
+   int iCountPacketsRequested = 0;
+   for( int i=0; i<s_iCountBlocks-1; i++ )
+   {
+      t_sim_block* pBlock = &s_Blocks[i];
+      int iCountToRequestFromBlock = SIM_DATA_PACKETS - pBlock->iRecv;
+      if ( pBlock->bDone || (iCountToRequestFromBlock <= 0) )
+         continue;
+
+      u8 uMissingBitmap[VIDEO_NACK_BITMAP_BYTES];
+      memset(uMissingBitmap, 0, sizeof(uMissingBitmap));
+      int iCountMissing = 0;
+      for( int k=0; k<SIM_DATA_PACKETS; k++ )
+      {
+         if ( pBlock->bReceived[k] )
+            continue;
+         video_nack_set_packet_missing(uMissingBitmap, k);
+         iCountMissing++;
+         if ( iCountMissing == iCountToRequestFromBlock )
+            break;
+      }
+
+      if ( bBitmap )
+      {
+         if ( iCountPacketsRequested + iCountMissing > SIM_BITMAP_MAX_PACKETS )
+            break;
+         if ( ! video_nack_builder_add_block(&nackBuilder, pBlock->uBlockIndex, uMissingBitmap) )
+            break;
+         iCountPacketsRequested += iCountMissing;
+      }
+      else
+      {
+         for( int k=0; k<SIM_DATA_PACKETS; k++ )
+         {
+            if ( ! video_nack_is_packet_missing(uMissingBitmap, k) )
+               continue;
+            memcpy(pDataInfo, &pBlock->uBlockIndex, sizeof(u32));
+            pDataInfo += sizeof(u32);
+            *pDataInfo = (u8)k;
+            pDataInfo++;
+            iCountPacketsRequested++;
+            if ( iCountPacketsRequested > SIM_LEGACY_MAX_PACKETS )
+               break;
+         }
+         if ( iCountPacketsRequested > SIM_LEGACY_MAX_PACKETS )
+            break;
+      }
+   }
+   if ( 0 == iCountPacketsRequested )
+      return;
+
+   int iLength = 0;
+   if ( bBitmap )
+      iLength = video_nack_builder_get_length(&nackBuilder);
+   else
+   {
+      uBuffer[sizeof(u32) + sizeof(u8)] = (u8)iCountPacketsRequested;
+      iLength = sizeof(u32) + 2*sizeof(u8) + iCountPacketsRequested*(sizeof(u32) + sizeof(u8));
+   }
+   s_pStats->uRequests++;
+   s_pStats->uPacketsRequested += iCountPacketsRequested;
+   s_pStats->uUplinkBytes += sizeof(t_packet_header) + iLength;
+
+   u32 uStart = get_current_timestamp_micros();
+   if ( bBitmap )
+      video_nack_parse(uBuffer, iLength, _on_nack_block, NULL);
+   else
+      _parse_legacy_request(uBuffer, iLength);
+   s_pStats->uParseMicros += get_current_timestamp_micros() - uStart;
+}
+
+void _run_simulation(bool bBitmap, int iDurationMs, t_sim_stats* pStats)
+{
+   memset(pStats, 0, sizeof(t_sim_stats));
+   s_pStats = pStats;
+   s_uRandom = 12345;
+   s_bChannelBad = false;
+   s_iCountBlocks = 0;
+   u32 uNextBlockIndex = 1;
+   u32 uRequestId = 0;
+
+   for( s_uSimTime = 1; s_uSimTime < (u32)iDurationMs; s_uSimTime++ )
+   {
+      if ( 0 == (s_uSimTime % SIM_BLOCK_INTERVAL_MS) )
+      {
+         // Drop the oldest block (past its display deadline) when the window is full
+         if ( s_iCountBlocks == SIM_WINDOW_BLOCKS )
+         {
+            if ( ! s_Blocks[0].bDone )
+            {
+               if ( s_Blocks[0].iRecv >= SIM_DATA_PACKETS )
+                  pStats->uBlocksRecovered++;
+               else
+                  pStats->uBlocksLost++;
+            }
+            memmove(&s_Blocks[0], &s_Blocks[1], (SIM_WINDOW_BLOCKS-1)*sizeof(t_sim_block));
+            s_iCountBlocks--;
+         }
+         t_sim_block* pBlock = &s_Blocks[s_iCountBlocks];
+         memset(pBlock, 0, sizeof(t_sim_block));
+         pBlock->uBlockIndex = uNextBlockIndex++;
+         pBlock->uTimeCreated = s_uSimTime;
+         for( int i=0; i<SIM_DATA_PACKETS + SIM_EC_PACKETS; i++ )
+         {
+            if ( _channel_lost() )
+               continue;
+            pBlock->bReceived[i] = true;
+            pBlock->iRecv++;
+         }
+         // Complete blocks (directly or with EC packets) are sent to output right away
+         if ( pBlock->iRecv >= SIM_DATA_PACKETS )
+            pBlock->bDone = true;
+         s_iCountBlocks++;
+      }
+
+      for( int i=0; i<s_iCountBlocks; i++ )
+      {
+         if ( (! s_Blocks[i].bDone) && (s_Blocks[i].iRecv >= SIM_DATA_PACKETS) )
+         {
+            s_Blocks[i].bDone = true;
+            pStats->uBlocksRecovered++;
+         }
+      }
+
+      if ( 0 == (s_uSimTime % SIM_REQUEST_INTERVAL_MS) )
+      {
+         uRequestId++;
+         _send_request(bBitmap, uRequestId);
+      }
+   }
+}
+
+void _log_stats(const char* szName, t_sim_stats* pStats)
+{
+   log_line("%s: %u requests, %u packets requested, %u resent, %u recovered, %u blocks recovered, %u blocks lost",
+      szName, pStats->uRequests, pStats->uPacketsRequested, pStats->uPacketsResent, pStats->uPacketsRecovered, pStats->uBlocksRecovered, pStats->uBlocksLost);
+   log_line("%s: uplink: %u bytes, %.1f bytes/request, %.2f bytes/recovered packet; loss to resend latency avg/max: %.1f/%u ms; parse time: %u us",
+      szName, pStats->uUplinkBytes, (float)pStats->uUplinkBytes/(float)(pStats->uRequests?pStats->uRequests:1),
+      (float)pStats->uUplinkBytes/(float)(pStats->uPacketsRecovered?pStats->uPacketsRecovered:1),
+      (float)pStats->uTotalLatencyMs/(float)(pStats->uPacketsRecovered?pStats->uPacketsRecovered:1), pStats->uMaxLatencyMs, pStats->uParseMicros);
+}
+
+u32 s_uRoundTripRequestId = 0;
+u8 s_uRoundTripBitmaps[300][VIDEO_NACK_BITMAP_BYTES];
+
+void _on_round_trip_block(u32 uRequestId, u32 uVideoBlockIndex, const u8* pMissingBitmap, void* pContext)
+{
+   s_uRoundTripRequestId = uRequestId;
+   if ( (uVideoBlockIndex >= 1000) && (uVideoBlockIndex < 1300) )
+      memcpy(s_uRoundTripBitmaps[uVideoBlockIndex-1000], pMissingBitmap, VIDEO_NACK_BITMAP_BYTES);
+}
+
+void _test_encoding()
+{
+   u8 uBitmaps[300][VIDEO_NACK_BITMAP_BYTES];
+   u8 uBuffer[2000];
+   for( int iRun=0; iRun<500; iRun++ )
+   {
+      memset(uBitmaps, 0, sizeof(uBitmaps));
+      memset(s_uRoundTripBitmaps, 0, sizeof(s_uRoundTripBitmaps));
+      t_video_nack_builder nackBuilder;
+      video_nack_builder_init(&nackBuilder, uBuffer, sizeof(uBuffer), 77 + iRun, 0);
+      int iCountPackets = 0;
+      int iBlocks = 1 + _random() % 250;
+      for( int i=0; i<iBlocks; i++ )
+      {
+         // Random bitmaps, bursts and repeated patterns
+         int iType = _random() % 4;
+         if ( (iType == 0) && (i > 0) )
+            memcpy(uBitmaps[i], uBitmaps[i-1], VIDEO_NACK_BITMAP_BYTES);
+         else if ( iType == 1 )
+         {
+            int iStart = _random() % VIDEO_NACK_MAX_PACKETS_IN_BLOCK;
+            int iCount = 1 + _random() % 10;
+            for( int k=iStart; (k<iStart+iCount) && (k<VIDEO_NACK_MAX_PACKETS_IN_BLOCK); k++ )
+               video_nack_set_packet_missing(uBitmaps[i], k);
+         }
+         else if ( iType == 2 )
+         {
+            for( int k=0; k<VIDEO_NACK_MAX_PACKETS_IN_BLOCK; k++ )
+               if ( 0 == (_random() % 5) )
+                  video_nack_set_packet_missing(uBitmaps[i], k);
+         }
+         if ( ! video_nack_builder_add_block(&nackBuilder, 1000 + i, uBitmaps[i]) )
+         {
+            log_line("FAILED: block %d does not fit in the request", i);
+            s_iFailed++;
+            return;
+         }
+         for( int k=0; k<VIDEO_NACK_MAX_PACKETS_IN_BLOCK; k++ )
+            iCountPackets += video_nack_is_packet_missing(uBitmaps[i], k);
+      }
+      int iLength = video_nack_builder_get_length(&nackBuilder);
+      int iParsed = 0;
+      if ( iLength > 0 )
+         iParsed = video_nack_parse(uBuffer, iLength, _on_round_trip_block, NULL);
+      if ( (iParsed != iCountPackets) || (0 != memcmp(uBitmaps, s_uRoundTripBitmaps, sizeof(uBitmaps))) || ((iParsed > 0) && (s_uRoundTripRequestId != (u32)(77 + iRun))) )
+      {
+         log_line("FAILED: round trip of %d blocks, %d packets (parsed %d packets)", iBlocks, iCountPackets, iParsed);
+         s_iFailed++;
+         return;
+      }
+      // Truncated requests are rejected
+      if ( (iLength > (int)VIDEO_NACK_HEADER_SIZE) && (video_nack_parse(uBuffer, iLength - 1, NULL, NULL) >= 0) )
+      {
+         log_line("FAILED: truncated request accepted");
+         s_iFailed++;
+         return;
+      }
+   }
+
+   // The request is full: blocks are rejected, the request stays valid
+   t_video_nack_builder nackBuilder;
+   video_nack_builder_init(&nackBuilder, uBuffer, 30, 1, 0);
+   u8 uBitmap[VIDEO_NACK_BITMAP_BYTES];
+   memset(uBitmap, 0x55, sizeof(uBitmap));
+   int iAdded = 0;
+   while ( video_nack_builder_add_block(&nackBuilder, 10 + 2*iAdded, uBitmap) )
+      iAdded++;
+   if ( (iAdded != 1) || (video_nack_parse(uBuffer, video_nack_builder_get_length(&nackBuilder), NULL, NULL) != 32) )
+   {
+      log_line("FAILED: full request (%d blocks added)", iAdded);
+      s_iFailed++;
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   log_init("TestVideoNack");
+   log_enable_stdout();
+
+   _test_encoding();
+
+   int iDurationMs = 60000;
+   if ( argc > 1 )
+      iDurationMs = atoi(argv[1]);
+
+   t_sim_stats statsLegacy, statsBitmap;
+   _run_simulation(false, iDurationMs, &statsLegacy);
+   _run_simulation(true, iDurationMs, &statsBitmap);
+   _log_stats("Legacy", &statsLegacy);
+   _log_stats("Bitmap", &statsBitmap);
+
+   float fLegacy = (float)statsLegacy.uUplinkBytes/(float)(statsLegacy.uPacketsRecovered?statsLegacy.uPacketsRecovered:1);
+   float fBitmap = (float)statsBitmap.uUplinkBytes/(float)(statsBitmap.uPacketsRecovered?statsBitmap.uPacketsRecovered:1);
+   if ( fBitmap >= fLegacy )
+   {
+      log_line("FAILED: bitmap requests use more uplink bytes per recovered packet");
+      s_iFailed++;
+   }
+   if ( statsBitmap.uTotalLatencyMs*(u64)statsLegacy.uPacketsRecovered > statsLegacy.uTotalLatencyMs*(u64)statsBitmap.uPacketsRecovered )
+   {
+      log_line("FAILED: bitmap requests recover lost packets slower");
+      s_iFailed++;
+   }
+   log_line("Video NACK tests: %s", s_iFailed?"FAILED":"PASSED");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,295 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Collects the router processes tracepoints (see base/profiler.h).
+// Dumps them as Chrome trace JSON (open in ui.perfetto.dev or chrome://tracing) and/or prints the
+// sections latency histograms.
+//
+// ruby_trace [-t seconds] [-o file.json] [-hist] [-station] [-vehicle]
+//   -t: capture duration after dumping the events already in the rings (default 5, 0: rings only)
+//   -o: output file (default /tmp/ruby_trace.json)
+//   -hist: print the histograms only, no trace
+//   -station / -vehicle: trace only that router (default: the one(s) running here)
+
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/shared_mem.h"
+#include "../base/profiler.h"
+
+#define TRACE_MAX_SOURCES 2
+
+typedef struct
+{
+   const char* szSharedMemName;
+   const char* szProcessName;
+   shared_mem_profiler* pProfiler;
+   int iProcessId;
+   int iThreadsNamed;
+   int iNamedThreadId[PROFILER_MAX_THREADS]; // a slot gets a new thread id when its thread is restarted
+   u32 uLastIndex[PROFILER_MAX_THREADS];
+   u32 uEvents;
+   u32 uLostEvents;
+} t_trace_source;
+
+bool g_bQuit = false;
+static t_trace_source s_TraceSources[TRACE_MAX_SOURCES];
+static int s_iCountTraceSources = 0;
+static FILE* s_pTraceFile = NULL;
+static int s_iTraceEventsWritten = 0;
+
+void handle_sigint(int sig) 
+{ 
+   g_bQuit = true;
+} 
+
+static void _trace_write_event(const char* szJSON)
+{
+   if ( NULL == s_pTraceFile )
+      return;
+   fprintf(s_pTraceFile, "%s\n%s", (s_iTraceEventsWritten > 0)?",":"", szJSON);
+   s_iTraceEventsWritten++;
+}
+
+static void _trace_write_names(t_trace_source* pSource)
+{
+   char szBuff[256];
+   if ( 0 == pSource->iThreadsNamed )
+   {
+      snprintf(szBuff, sizeof(szBuff), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}", pSource->iProcessId, pSource->szProcessName);
+      _trace_write_event(szBuff);
+   }
+   int iThreads = __atomic_load_n(&pSource->pProfiler->iThreadsCount, __ATOMIC_ACQUIRE);
+   if ( iThreads > PROFILER_MAX_THREADS )
+      iThreads = PROFILER_MAX_THREADS;
+   for( int i=0; i<iThreads; i++ )
+   {
+      if ( (i < pSource->iThreadsNamed) && (pSource->iNamedThreadId[i] == pSource->pProfiler->threads[i].iThreadId) )
+         continue;
+      pSource->iNamedThreadId[i] = pSource->pProfiler->threads[i].iThreadId;
+      snprintf(szBuff, sizeof(szBuff), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pSource->iProcessId, pSource->pProfiler->threads[i].iThreadId, pSource->pProfiler->threads[i].szName);
+      _trace_write_event(szBuff);
+   }
+   pSource->iThreadsNamed = iThreads;
+}
+
+static void _trace_reset_source(t_trace_source* pSource, bool bKeepRings)
+{
+   pSource->iProcessId = pSource->pProfiler->iProcessId;
+   pSource->iThreadsNamed = 0;
+   for( int i=0; i<PROFILER_MAX_THREADS; i++ )
+   {
+      u32 uWrite = __atomic_load_n(&pSource->pProfiler->threads[i].uWriteIndex, __ATOMIC_ACQUIRE);
+      pSource->uLastIndex[i] = 0;
+      if ( bKeepRings && (uWrite > PROFILER_RING_SIZE-1) )
+         pSource->uLastIndex[i] = uWrite - (PROFILER_RING_SIZE-1);
+   }
+}
+
+static void _trace_read_source(t_trace_source* pSource)
+{
+   static t_profiler_event s_Events[PROFILER_RING_SIZE];
+   shared_mem_profiler* pProfiler = pSource->pProfiler;
+   if ( PROFILER_SHARED_MEM_VERSION != __atomic_load_n(&pProfiler->uVersion, __ATOMIC_ACQUIRE) )
+      return;
+
+   if ( pProfiler->iProcessId != pSource->iProcessId )
+   {
+      log_line("Process %s (re)started (pid %d).", pSource->szProcessName, pProfiler->iProcessId);
+      _trace_reset_source(pSource, true);
+   }
+   _trace_write_names(pSource);
+
+   char szBuff[256];
+   for( int iThread=0; iThread<pSource->iThreadsNamed; iThread++ )
+   {
+      int iCount = profiler_read_thread_events(pProfiler, iThread, &pSource->uLastIndex[iThread], s_Events, &pSource->uLostEvents);
+      int iThreadId = pProfiler->threads[iThread].iThreadId;
+      for( int i=0; i<iCount; i++ )
+      {
+         t_profiler_event* pEvent = &s_Events[i];
+         if ( pEvent->uStartTimeNs < pProfiler->uStartTimeNs )
+            continue;
+         u64 uStart = pEvent->uStartTimeNs - pProfiler->uStartTimeNs;
+         snprintf(szBuff, sizeof(szBuff), "{\"name\":\"%s\",\"cat\":\"router\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u,\"dur\":%u.%03u}",
+            profiler_get_section_name(pEvent->uSection), pSource->iProcessId, iThreadId,
+            (unsigned long long)(uStart/1000), (unsigned int)(uStart%1000), pEvent->uDurationNs/1000, pEvent->uDurationNs%1000);
+         _trace_write_event(szBuff);
+         pSource->uEvents++;
+      }
+   }
+}
+
+static void _trace_print_histograms(t_trace_source* pSource)
+{
+   shared_mem_profiler* pProfiler = pSource->pProfiler;
+   printf("\n%s (pid %d), %d threads:\n", pSource->szProcessName, pProfiler->iProcessId, pProfiler->iThreadsCount);
+   printf("%-20s %10s %9s %9s %9s %9s %9s\n", "Section", "Count", "Avg(us)", "P50(us)", "P90(us)", "P99(us)", "Max(us)");
+   for( int i=0; i<pProfiler->iSectionsCount && i<PROFILER_MAX_SECTIONS; i++ )
+   {
+      t_profiler_histogram hist;
+      profiler_get_section_histogram(pProfiler, i, &hist);
+      if ( 0 == hist.uCount )
+         continue;
+      printf("%-20s %10u %9u %9u %9u %9u %9u\n", pProfiler->szSectionNames[i], hist.uCount, (u32)(hist.uTotalMicros/hist.uCount),
+         profiler_get_histogram_percentile(&hist, 50), profiler_get_histogram_percentile(&hist, 90),
+         profiler_get_histogram_percentile(&hist, 99), hist.uMaxMicros);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   signal(SIGINT, handle_sigint);
+   signal(SIGTERM, handle_sigint);
+   signal(SIGQUIT, handle_sigint);
+
+   log_init("RubyTrace");
+   log_enable_stdout();
+
+   int iDurationSec = 5;
+   bool bOnlyHistograms = false;
+   bool bStation = true;
+   bool bVehicle = true;
+   char szFileOut[MAX_FILE_PATH_SIZE];
+   strcpy(szFileOut, "/tmp/ruby_trace.json");
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( (0 == strcmp(argv[i], "-t")) && (i < argc-1) )
+         iDurationSec = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-o")) && (i < argc-1) )
+      {
+         strncpy(szFileOut, argv[++i], sizeof(szFileOut)-1);
+         szFileOut[sizeof(szFileOut)-1] = 0;
+      }
+      else if ( 0 == strcmp(argv[i], "-hist") )
+         bOnlyHistograms = true;
+      else if ( 0 == strcmp(argv[i], "-station") )
+         bVehicle = false;
+      else if ( 0 == strcmp(argv[i], "-vehicle") )
+         bStation = false;
+      else
+      {
+         printf("Usage: ruby_trace [-t seconds] [-o file.json] [-hist] [-station] [-vehicle]\n");
+         return -1;
+      }
+   }
+   if ( iDurationSec < 0 )
+      iDurationSec = 0;
+   if ( iDurationSec > 120 )
+      iDurationSec = 120;
+
+   if ( bVehicle )
+   {
+      s_TraceSources[s_iCountTraceSources].szSharedMemName = SHARED_MEM_PROFILER_ROUTER_TX;
+      s_TraceSources[s_iCountTraceSources].szProcessName = "ruby_rt_vehicle";
+      s_iCountTraceSources++;
+   }
+   if ( bStation )
+   {
+      s_TraceSources[s_iCountTraceSources].szSharedMemName = SHARED_MEM_PROFILER_ROUTER_RX;
+      s_TraceSources[s_iCountTraceSources].szProcessName = "ruby_rt_station";
+      s_iCountTraceSources++;
+   }
+
+   int iOpened = 0;
+   for( int i=0; i<s_iCountTraceSources; i++ )
+   {
+      s_TraceSources[i].pProfiler = shared_mem_profiler_open_for_read(s_TraceSources[i].szSharedMemName);
+      if ( NULL == s_TraceSources[i].pProfiler )
+         continue;
+      if ( PROFILER_SHARED_MEM_VERSION != s_TraceSources[i].pProfiler->uVersion )
+      {
+         log_softerror_and_alarm("Profiler of %s is not initialized or has a different version.", s_TraceSources[i].szProcessName);
+         shared_mem_profiler_close(s_TraceSources[i].pProfiler);
+         s_TraceSources[i].pProfiler = NULL;
+         continue;
+      }
+      _trace_reset_source(&s_TraceSources[i], true);
+      iOpened++;
+   }
+
+   if ( 0 == iOpened )
+   {
+      log_softerror_and_alarm("No router profiler found. Is the router running?");
+      return -1;
+   }
+
+   if ( ! bOnlyHistograms )
+   {
+      s_pTraceFile = fopen(szFileOut, "wb");
+      if ( NULL == s_pTraceFile )
+      {
+         log_softerror_and_alarm("Failed to create output file: %s", szFileOut);
+         return -1;
+      }
+      fprintf(s_pTraceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+      log_line("Capturing for %d seconds to %s ...", iDurationSec, szFileOut);
+      u32 uTimeEnd = get_current_timestamp_ms() + iDurationSec*1000;
+      do
+      {
+         for( int i=0; i<s_iCountTraceSources; i++ )
+         {
+            if ( NULL != s_TraceSources[i].pProfiler )
+               _trace_read_source(&s_TraceSources[i]);
+         }
+         if ( get_current_timestamp_ms() >= uTimeEnd )
+            break;
+         hardware_sleep_ms(20);
+      }
+      while ( ! g_bQuit );
+
+      fprintf(s_pTraceFile, "\n]}\n");
+      fclose(s_pTraceFile);
+      s_pTraceFile = NULL;
+
+      for( int i=0; i<s_iCountTraceSources; i++ )
+      {
+         if ( NULL != s_TraceSources[i].pProfiler )
+            log_line("%s: %u events, %u lost.", s_TraceSources[i].szProcessName, s_TraceSources[i].uEvents, s_TraceSources[i].uLostEvents);
+      }
+      log_line("Saved trace to %s", szFileOut);
+   }
+
+   for( int i=0; i<s_iCountTraceSources; i++ )
+   {
+      if ( NULL == s_TraceSources[i].pProfiler )
+         continue;
+      _trace_print_histograms(&s_TraceSources[i]);
+      shared_mem_profiler_close(s_TraceSources[i].pProfiler);
+   }
+   return 0;
+}
@@ -34,6 +34,7 @@
 #include "../base/models.h"
 #include "../base/utils.h"
 #include "../common/string_utils.h"
+#include "../radio/adaptive_fec.h"
 #include "adaptive_video.h"
 #include "shared_vars.h"
 #include "timers.h"
@@ -55,6 +56,9 @@ u32 s_uTimeSetPendingAdaptiveRadioDataRate = 0;
 u32 s_uLastAdaptiveAppliedVideoBitrate = 0;
 int s_iLastIPQuantizationSet = -1000;
 
+t_adaptive_fec_state s_AdaptiveFEC;
+int s_iAdaptiveFECVideoProfile = -1;
+
 void adaptive_video_init()
 {
    log_line("[AdaptiveVideo] Init...");
@@ -142,6 +146,48 @@ void adaptive_video_set_last_profile_requested_by_controller(int iVideoProfile)
    s_uTimeLastVideoProfileRequestedByController = g_TimeNow;
 }
 
+void adaptive_video_get_ec_scheme(int iVideoProfile, int* piDataPackets, int* piECPackets)
+{
+   int iDataPackets = g_pCurrentModel->video_link_profiles[iVideoProfile].block_packets;
+   int iECPackets = g_pCurrentModel->video_link_profiles[iVideoProfile].block_fecs;
+
+   // Start over from the profile EC scheme when the video profile or its settings changed
+   if ( (iVideoProfile != s_iAdaptiveFECVideoProfile) || (iDataPackets != s_AdaptiveFEC.iBaseDataPackets) || (iECPackets != s_AdaptiveFEC.iBaseECPackets) )
+   {
+      adaptive_fec_init(&s_AdaptiveFEC, iDataPackets, iECPackets);
+      s_iAdaptiveFECVideoProfile = iVideoProfile;
+   }
+   else if ( g_pCurrentModel->video_link_profiles[iVideoProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_AUTO_EC_SCHEME )
+   {
+      iDataPackets = s_AdaptiveFEC.iDataPackets;
+      iECPackets = s_AdaptiveFEC.iECPackets;
+   }
+
+   if ( NULL != piDataPackets )
+      *piDataPackets = iDataPackets;
+   if ( NULL != piECPackets )
+      *piECPackets = iECPackets;
+}
+
+void adaptive_video_on_ec_recovery_stats(t_packet_data_video_ec_recovery_stats* pStats)
+{
+   if ( (NULL == pStats) || (NULL == g_pVideoTxBuffers) )
+      return;
+   int iVideoProfile = adaptive_video_get_current_active_video_profile();
+   if ( iVideoProfile != s_iAdaptiveFECVideoProfile )
+      return;
+   if ( ! (g_pCurrentModel->video_link_profiles[iVideoProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_AUTO_EC_SCHEME) )
+      return;
+
+   if ( ! adaptive_fec_on_recovery_stats(&s_AdaptiveFEC, pStats, g_TimeNow) )
+      return;
+
+   log_line("[AdaptiveVideo] Set EC scheme to %d/%d (profile %s: %d/%d), last %u ms: %u blocks output, %u lost",
+      s_AdaptiveFEC.iDataPackets, s_AdaptiveFEC.iECPackets, str_get_video_profile_name(iVideoProfile),
+      s_AdaptiveFEC.iBaseDataPackets, s_AdaptiveFEC.iBaseECPackets, pStats->uIntervalMs, pStats->uBlocksOutput, pStats->uBlocksLost);
+   g_pVideoTxBuffers->setECScheme(s_AdaptiveFEC.iDataPackets, s_AdaptiveFEC.iECPackets);
+}
+
 int adaptive_video_get_current_active_video_profile()
 {
    int iVideoProfile = g_pCurrentModel->video_params.user_selected_video_link_profile;
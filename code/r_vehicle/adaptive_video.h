@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../radio/radiopackets2.h"
+
 void adaptive_video_init();
 
 void adaptive_video_set_kf_for_current_video_profile(u16 uKeyframe);
@@ -9,3 +11,7 @@ u16 adaptive_video_get_current_kf();
 void adaptive_video_on_capture_restarted();
 void adaptive_video_on_new_camera_read(bool bEndOfFrame, bool bIsInsideIFrame);
 void adaptive_video_periodic_loop();
+
+// EC scheme to use for the video profile: the profile one, or the one tuned from the controller EC recovery stats
+void adaptive_video_get_ec_scheme(int iVideoProfile, int* piDataPackets, int* piECPackets);
+void adaptive_video_on_ec_recovery_stats(t_packet_data_video_ec_recovery_stats* pStats);
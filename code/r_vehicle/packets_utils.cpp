@@ -30,11 +30,13 @@
 */
 
 #include "packets_utils.h"
+#include <pthread.h>
 #include "../base/base.h"
 #include "../base/config.h"
 #include "../base/flags.h"
 #include "../base/encr.h"
 #include "../base/commands.h"
+#include "../base/telemetry_delta.h"
 #include "../common/radio_stats.h"
 #include "../common/string_utils.h"
 #include "ruby_rt_vehicle.h"
@@ -46,8 +48,9 @@
 #include "../radio/radiopackets2.h"
 #include "../radio/radiolink.h"
 #include "../radio/radio_tx.h"
+#include "../radio/radio_pacer.h"
 
-u8 s_RadioRawPacket[MAX_PACKET_TOTAL_SIZE];
+u8 s_RadioRawPacket[MAX_PACKET_LENGTH_PCAP];
 
 u32 s_StreamsTxPacketIndex[MAX_RADIO_STREAMS];
 
@@ -58,6 +61,11 @@ u32 s_uTimeStartTxDataRateDivergence = 0;
 
 u32 s_VehicleLogSegmentIndex = 0;
 
+t_telemetry_delta_encoder s_TelemetryDeltaEncoder;
+
+// Radio interfaces writes (tx interfaces can be closed by the main thread while other threads write)
+pthread_mutex_t s_MutexRadioTx = PTHREAD_MUTEX_INITIALIZER;
+
 
 typedef struct
 {
@@ -85,6 +93,42 @@ void packet_utils_init()
       s_LastTxDataRatesVideo[i] = 0;
       s_LastTxDataRatesData[i] = 0;
    }
+   radio_pacer_init();
+   // Different on each router start, so the controller drops the keyframes of the previous run
+   telemetry_delta_encoder_init(&s_TelemetryDeltaEncoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL_MS, (u8)(get_current_timestamp_micros() ^ (u32)getpid()));
+}
+
+// Returns the length of the delta encoded packet written to pOutput, or 0 if the packet must be sent as it is
+static int _packet_utils_delta_encode_telemetry(u8* pPacketData, int nPacketLength, u8* pOutput)
+{
+   if ( (NULL == g_pCurrentModel) || (g_pCurrentModel->telemetry_params.flags & TELEMETRY_FLAGS_DISABLE_DELTA_ENCODING) )
+      return 0;
+   // Older controllers can't decode delta packets
+   if ( ((g_uControllerSwVersion >> 16) & 0xFFFF) < TELEMETRY_DELTA_MIN_SW_BUILD )
+      return 0;
+   if ( (((t_packet_header*)pPacketData)->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_COMPONENT_TELEMETRY )
+      return 0;
+   return telemetry_delta_encode(&s_TelemetryDeltaEncoder, pPacketData, nPacketLength, pOutput, g_TimeNow);
+}
+
+void packet_utils_force_telemetry_keyframes()
+{
+   telemetry_delta_encoder_force_keyframes(&s_TelemetryDeltaEncoder);
+}
+
+void packet_utils_log_telemetry_delta_info()
+{
+   telemetry_delta_encoder_log_info(&s_TelemetryDeltaEncoder);
+}
+
+void packet_utils_lock_radio_tx()
+{
+   pthread_mutex_lock(&s_MutexRadioTx);
+}
+
+void packet_utils_unlock_radio_tx()
+{
+   pthread_mutex_unlock(&s_MutexRadioTx);
 }
 
 void packet_utils_set_adaptive_video_datarate(int iDatarateBPS)
@@ -292,6 +336,13 @@ bool _send_packet_to_serial_radio_interface(int iLocalRadioLinkId, int iRadioInt
    while ( nLength > 0 )
    {
       t_packet_header* pPH = (t_packet_header*)pData;
+      // Delta telemetry forwarded for a relayed vehicle: the slow link rate limit would drop most of its keyframes
+      if ( pPH->packet_type == PACKET_TYPE_RUBY_TELEMETRY_DELTA )
+      {
+         nLength -= pPH->total_length;
+         pData += pPH->total_length;
+         continue;
+      }
       if ( ! radio_can_send_packet_on_slow_link(iLocalRadioLinkId, pPH->packet_type, 0, g_TimeNow) )
       {
          nLength -= pPH->total_length;
@@ -376,7 +427,7 @@ bool _send_packet_to_serial_radio_interface(int iLocalRadioLinkId, int iRadioInt
    return bPacketsSent;
 }
 
-bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInterfaceIndex, u8* pPacketData, int nPacketLength, bool bHasVideoPacket, bool bIsRetransmited)
+bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInterfaceIndex, u8* pPacketData, int nPacketLength, bool bHasVideoPacket, bool bIsRetransmited, bool bHasHeadroom)
 {
    if ( (NULL == pPacketData) || (nPacketLength <= 0) || (NULL == g_pCurrentModel) )
       return false;
@@ -398,8 +449,6 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
       //log_line("DBG Switched video data rate to %d (retransmitted: %s)", nRateTx, bIsRetransmited?"yes":"no");
    }
 
-   radio_set_out_datarate(nRateTx);
-
    if ( test_link_is_in_progress() )
    {
       t_packet_header* pPH = (t_packet_header*)pPacketData;
@@ -407,7 +456,7 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
          log_line("Test link in progress. Sending radio packet using datarate: %d", nRateTx);
    }
    u32 radioFlags = g_pCurrentModel->radioInterfacesParams.interface_current_radio_flags[iRadioInterfaceIndex];
-   radio_set_frames_flags(radioFlags);
+   const t_radio_tx_template* pTxTemplate = radio_get_tx_template(nRateTx, radioFlags, RADIO_PORT_ROUTER_DOWNLINK);
 
    int be = 0;
    if ( g_pCurrentModel->enc_flags != MODEL_ENC_FLAGS_NONE )
@@ -440,14 +489,28 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
    }
   */ 
 
-   int totalLength = radio_build_new_raw_packet(iLocalRadioLinkId, s_RadioRawPacket, pPacketData, nPacketLength, RADIO_PORT_ROUTER_DOWNLINK, be);
+   // Encrypted packets grow and must not change the caller's buffer, so they are always copied
+   u8* pRawPacket = s_RadioRawPacket;
+   int totalLength = 0;
+   if ( bHasHeadroom && (0 == be) )
+      totalLength = radio_build_new_raw_packet_in_headroom_with_template(pTxTemplate, iLocalRadioLinkId, pPacketData, nPacketLength, &pRawPacket);
+   else
+      totalLength = radio_build_new_raw_packet_with_template(pTxTemplate, iLocalRadioLinkId, s_RadioRawPacket, pPacketData, nPacketLength, be);
 
    u32 microT1 = get_current_timestamp_micros();
    u32 uPacketType = 0;
    u32 uStreamId = 0;
    int iSinglePacketLength = 0;
 
-   if ( radio_write_raw_packet(iRadioInterfaceIndex, s_RadioRawPacket, totalLength) )
+   int iWritten = 0;
+   if ( totalLength > 0 )
+   {
+      packet_utils_lock_radio_tx();
+      iWritten = radio_write_raw_packet(iRadioInterfaceIndex, pRawPacket, totalLength);
+      packet_utils_unlock_radio_tx();
+   }
+
+   if ( iWritten )
    {       
       u32 microT2 = get_current_timestamp_micros();
       if ( microT2 > microT1 )
@@ -459,6 +522,10 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
       radio_stats_update_on_packet_sent_on_radio_interface(&g_SM_RadioStats, g_TimeNow, iRadioInterfaceIndex, nPacketLength);
       radio_stats_set_tx_radio_datarate_for_packet(&g_SM_RadioStats, iRadioInterfaceIndex, iLocalRadioLinkId, nRateTx, bHasVideoPacket?1:0);
 
+      // Video retransmissions are priority traffic too, they are not paced
+      int iHT40 = (g_pCurrentModel->radioLinksParams.link_radio_flags[iVehicleRadioLinkId] & RADIO_FLAG_HT40_VEHICLE)?1:0;
+      radio_pacer_on_packet_sent(iLocalRadioLinkId, nPacketLength, getRealDataRateFromRadioDataRate(nRateTx, iHT40), (bHasVideoPacket && (!bIsRetransmited))?0:1, microT2);
+
       int iCountChainedPackets[MAX_RADIO_STREAMS];
       int iTotalBytesOnEachStream[MAX_RADIO_STREAMS];
       memset(iCountChainedPackets, 0, MAX_RADIO_STREAMS*sizeof(int));
@@ -506,7 +573,7 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
 
 // Sends a radio packet to all posible radio interfaces or just to a single radio link
 
-int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink)
+int _send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, bool bHasHeadroom)
 {
    if ( nPacketLength <= 0 )
       return -1;
@@ -645,6 +712,11 @@ int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSen
 
    bool bPacketSent = false;
 
+   // Periodic telemetry goes as deltas on WiFi links; serial links keep getting the full (rate limited) packets
+   u8 uDeltaBuffer[RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE];
+   u8* pDeltaPacket = uDeltaBuffer + RADIO_PACKET_HEADROOM;
+   int iDeltaPacketLength = -1;
+
    for( int iRadioLinkId=0; iRadioLinkId<g_pCurrentModel->radioLinksParams.links_count; iRadioLinkId++ )
    {
       int iVehicleRadioLinkId = g_SM_RadioStats.radio_links[iRadioLinkId].matchingVehicleRadioLinkId;
@@ -722,7 +794,15 @@ int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSen
       {
          if ( bHasLowCapacityLinkOnlyPackets )
             continue;
-         if ( _send_packet_to_wifi_radio_interface(iRadioLinkId, iRadioInterfaceIndex, pPacketData, nPacketLength, bHasVideoPacket, bIsRetransmited) )
+         // Encoded once for all the WiFi links this packet goes on
+         if ( iDeltaPacketLength < 0 )
+            iDeltaPacketLength = _packet_utils_delta_encode_telemetry(pPacketData, nPacketLength, pDeltaPacket);
+         bool bSent = false;
+         if ( iDeltaPacketLength > 0 )
+            bSent = _send_packet_to_wifi_radio_interface(iRadioLinkId, iRadioInterfaceIndex, pDeltaPacket, iDeltaPacketLength, bHasVideoPacket, bIsRetransmited, true);
+         else
+            bSent = _send_packet_to_wifi_radio_interface(iRadioLinkId, iRadioInterfaceIndex, pPacketData, nPacketLength, bHasVideoPacket, bIsRetransmited, bHasHeadroom);
+         if ( bSent )
          {
             bPacketSent = true;
             if ( bHasCommandParamsZipResponse )
@@ -892,6 +972,16 @@ int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSen
    return 0;
 }
 
+int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink)
+{
+   return _send_packet_to_radio_interfaces(pPacketData, nPacketLength, iSendToSingleRadioLink, false);
+}
+
+int send_packet_with_headroom_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink)
+{
+   return _send_packet_to_radio_interfaces(pPacketData, nPacketLength, iSendToSingleRadioLink, true);
+}
+
 void send_packet_vehicle_log(u8* pBuffer, int length)
 {
    t_packet_header PH;
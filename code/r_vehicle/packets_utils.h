@@ -4,12 +4,22 @@
 void packet_utils_init();
 void packet_utils_set_adaptive_video_datarate(int iDatarateBPS);
 int packet_utils_get_last_set_adaptive_video_datarate();
+// Serializes writes to the radio interfaces between the router threads (main loop and relay fast path)
+void packet_utils_lock_radio_tx();
+void packet_utils_unlock_radio_tx();
+
+// Delta encodes the periodic telemetry packets (see base/telemetry_delta.h), in place: pPacketData must have
+// room for MAX_PACKET_TOTAL_SIZE bytes. Returns the packet length after encoding.
+void packet_utils_force_telemetry_keyframes();
+void packet_utils_log_telemetry_delta_info();
 
 int get_last_tx_used_datarate_bps_video(int iInterface);
 int get_last_tx_used_datarate_bps_data(int iInterface);
 int get_last_tx_minimum_video_radio_datarate_bps();
 
 int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink);
+// pPacketData must have RADIO_PACKET_HEADROOM free bytes in front of it; radio headers are written there, without copying the packet
+int send_packet_with_headroom_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink);
 void send_packet_vehicle_log(u8* pBuffer, int length);
 
 void send_alarm_to_controller(u32 uAlarm, u32 uFlags1, u32 uFlags2, u32 uRepeatCount);
@@ -44,6 +44,7 @@
 
 #include "../radio/radiopackets2.h"
 #include "../radio/radiopacketsqueue.h"
+#include "../radio/radio_pacer.h"
 
 #include <ctype.h>
 #include "shared_vars.h"
@@ -52,6 +53,7 @@
 #include "test_link_params.h"
 #include "packets_utils.h"
 #include "processor_relay.h"
+#include "relay_fast_path.h"
 #include "launchers_vehicle.h"
 #include "video_source_csi.h"
 
@@ -60,6 +62,8 @@ u32 s_debugFramesCount = 0;
 u32 s_uTimeLastCheckForRelayedVehicleRubyTelemetryAlarm = 0;
 u32 s_MinVideoBlocksGapMilisec = 1;
 long s_lLastLiveLogFileOffset = -1;
+u32 s_uTimeLastRadioPacerLog = 0;
+u32 s_uTimeLastRelayFastPathUpdate = 0;
 
 extern u16 s_countTXVideoPacketsOutPerSec[2];
 extern u16 s_countTXDataPacketsOutPerSec[2];
@@ -830,6 +834,14 @@ int _update_debug_stats()
       g_TimeLastDebugFPSComputeTime = g_TimeNow;
       s_debugFramesCount = 0;
 
+      if ( g_TimeNow >= s_uTimeLastRadioPacerLog + 10000 )
+      {
+         s_uTimeLastRadioPacerLog = g_TimeNow;
+         radio_pacer_log_info();
+         relay_fast_path_log_info();
+         packet_utils_log_telemetry_delta_info();
+      }
+
 
       if (( g_TimeNow > g_TimeStart+50000 ) || g_bReceivedPairingRequest )
       {
@@ -952,5 +964,12 @@ int periodicLoop()
       g_TimeLastNotificationRelayParamsChanged = 0;
    }
 
+   // Picks up radio links changes (datarates, radio flags) for the relay fast path
+   if ( g_TimeNow >= s_uTimeLastRelayFastPathUpdate + 1000 )
+   {
+      s_uTimeLastRelayFastPathUpdate = g_TimeNow;
+      relay_fast_path_update_params();
+   }
+
    return 0;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
 #pragma once
 
 void process_received_single_radio_packet(int iRadioInterface, u8* pData, int dataLength );
+void _mark_link_from_controller_present();
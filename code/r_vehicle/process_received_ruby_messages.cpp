@@ -118,10 +118,15 @@ int process_received_ruby_message(int iInterfaceIndex, u8* pPacketBuffer)
    if ( pPH->packet_type == PACKET_TYPE_RUBY_PAIRING_REQUEST )
    {
       u32 uResendCount = 0;
+      u32 uControllerSwVersion = 0;
       if ( pPH->total_length >= sizeof(t_packet_header) + sizeof(u32) )
          memcpy(&uResendCount, pPacketBuffer + sizeof(t_packet_header), sizeof(u32));
+      if ( pPH->total_length >= sizeof(t_packet_header) + 2*sizeof(u32) )
+         memcpy(&uControllerSwVersion, pPacketBuffer + sizeof(t_packet_header) + sizeof(u32), sizeof(u32));
 
-      log_line("Received pairing request from controller (received resend count: %u). CID: %u, VID: %u.", uResendCount, pPH->vehicle_id_src, pPH->vehicle_id_dest);
+      log_line("Received pairing request from controller (received resend count: %u, controller version: %d.%d (b%d)). CID: %u, VID: %u.", uResendCount,
+         (uControllerSwVersion >> 8) & 0xFF, (uControllerSwVersion & 0xFF)/10, uControllerSwVersion >> 16, pPH->vehicle_id_src, pPH->vehicle_id_dest);
+      g_uControllerSwVersion = uControllerSwVersion;
       
       if (g_uControllerId != pPH->vehicle_id_src )
       {
@@ -156,6 +161,8 @@ int process_received_ruby_message(int iInterfaceIndex, u8* pPacketBuffer)
       }
 
       g_bReceivedPairingRequest = true;
+      // The controller (re)connected: let it rebuild the delta encoded telemetry right away
+      packet_utils_force_telemetry_keyframes();
 
       if ( g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId >= 0 )
       if ( g_pCurrentModel->relay_params.uRelayedVehicleId != 0 )
@@ -37,6 +37,7 @@
 #include "../base/hardware_radio.h"
 #include "../base/hw_procs.h"
 #include "../base/ruby_ipc.h"
+#include "../common/sw_upload.h"
 
 #include <pthread.h>
 #include "launchers_vehicle.h"
@@ -67,6 +68,8 @@ u32* s_pSWPacketsSize = NULL;
 u32 s_uSWPacketsCount = 0;
 u32 s_uSWPacketsMaxSize = 0;
 
+t_sw_upload_receiver s_SWUploadReceiver;
+
 pthread_t s_pThreadProcessUpload;
 bool s_bUpdateInProgress = false;
 bool s_bProcessUploadInProgress = false;
@@ -111,6 +114,9 @@ void _sw_update_close_remove_temp_files()
    s_uSWPacketsCount = 0;
    s_uSWPacketsMaxSize = 0;
 
+   // Keeps a partially received windowed upload and its state, to resume it
+   sw_upload_receiver_close(&s_SWUploadReceiver, 0);
+
    char szComm[256];
    sprintf(szComm, "rm -rf %s%s", FOLDER_RUBY_TEMP, FILE_TEMP_UPDATE_IN_PROGRESS);
    hw_execute_bash_command(szComm, NULL);
@@ -138,6 +144,8 @@ void process_sw_upload_init()
    s_pSWPacketsSize = NULL;
    s_uSWPacketsCount = 0;
    s_uSWPacketsMaxSize = 0;
+
+   sw_upload_receiver_init(&s_SWUploadReceiver);
 }
 
 void _process_upload_send_status_to_controller(u8 uStatus, int iRepeatCount)
@@ -167,6 +175,28 @@ void _process_upload_send_status_to_controller(u8 uStatus, int iRepeatCount)
    log_line("ProcessUpload: Send OTA status %d (counter %u) to controller CID: %u", uStatus, uStatusCounterProcessUpload, g_pCurrentModel->uControllerId);
 }
 
+// Stops the video pipeline and frees some disk space on the first received software segment
+void _process_upload_pause_vehicle()
+{
+   if ( s_bSoftwareUpdateStoppedVideoPipeline )
+      return;
+
+   char szComm[256];
+   sprintf(szComm, "touch %s%s", FOLDER_RUBY_TEMP, FILE_TEMP_UPDATE_IN_PROGRESS);
+   hw_execute_bash_command(szComm, NULL);
+   s_bSoftwareUpdateStoppedVideoPipeline = true;
+   sendControlMessage(PACKET_TYPE_LOCAL_CONTROL_PAUSE_VIDEO, 0);
+
+   sprintf(szComm, "rm -rf %slog_system_*", FOLDER_LOGS);
+   hw_execute_bash_command(szComm, NULL);
+   sprintf(szComm, "rm -rf %slog_errors_*", FOLDER_LOGS);
+   hw_execute_bash_command(szComm, NULL);
+   sprintf(szComm, "rm -rf %slog_video_*", FOLDER_LOGS);
+   hw_execute_bash_command(szComm, NULL);
+   int iFreeSpaceKb = hardware_get_free_space_kb();
+   log_line("Free space on disk: %d Mb", iFreeSpaceKb/1000);
+}
+
 static void * _thread_process_archive(void *argument)
 {
    s_bThreadProcessArchiveFinished = false;
@@ -424,6 +454,17 @@ static void * _thread_process_upload(void *argument)
 }
 
 
+void _process_upload_apply_archive()
+{
+   if ( 0 != pthread_create(&s_pThreadProcessUpload, NULL, &_thread_process_upload, NULL) )
+   {
+      log_softerror_and_alarm("Failed to create worker thread to process upload.");
+      s_bUpdateInProgress = false;
+      s_bProcessUploadInProgress = false;
+      _process_upload_send_status_to_controller(OTA_UPDATE_STATUS_FAILED, 10);
+   }
+}
+
 void process_sw_upload_new(u32 command_param, u8* pBuffer, int length)
 {
    if ( (NULL == pBuffer) || (length < (int)(sizeof(t_packet_header) + sizeof(t_packet_header_command) + sizeof(command_packet_sw_package))) )
@@ -466,22 +507,7 @@ void process_sw_upload_new(u32 command_param, u8* pBuffer, int length)
       return;             
    }
 
-   if ( ! s_bSoftwareUpdateStoppedVideoPipeline )
-   {
-      sprintf(szComm, "touch %s%s", FOLDER_RUBY_TEMP, FILE_TEMP_UPDATE_IN_PROGRESS);
-      hw_execute_bash_command(szComm, NULL);
-      s_bSoftwareUpdateStoppedVideoPipeline = true;
-      sendControlMessage(PACKET_TYPE_LOCAL_CONTROL_PAUSE_VIDEO, 0);
-
-      sprintf(szComm, "rm -rf %slog_system_*", FOLDER_LOGS);
-      hw_execute_bash_command(szComm, NULL);
-      sprintf(szComm, "rm -rf %slog_errors_*", FOLDER_LOGS);
-      hw_execute_bash_command(szComm, NULL);
-      sprintf(szComm, "rm -rf %slog_video_*", FOLDER_LOGS);
-      hw_execute_bash_command(szComm, NULL);
-      int iFreeSpaceKb = hardware_get_free_space_kb();
-      log_line("Free space on disk: %d Mb", iFreeSpaceKb/1000);
-   }
+   _process_upload_pause_vehicle();
 
    if ( NULL == s_pSWPackets )
    {
@@ -649,15 +675,80 @@ void process_sw_upload_new(u32 command_param, u8* pBuffer, int length)
    sync();
 
    log_line("Received software package correctly (6.3 method). Update file: [%s]. Applying it.", s_szUpdateArchiveFile);
+   _process_upload_apply_archive();
+}
 
-   if ( 0 != pthread_create(&s_pThreadProcessUpload, NULL, &_thread_process_upload, NULL) )
+void process_sw_upload_windowed(u8* pBuffer, int length)
+{
+   int iHeadersLength = (int)(sizeof(t_packet_header) + sizeof(t_packet_header_command));
+   if ( (NULL == pBuffer) || (length < iHeadersLength + (int)sizeof(command_packet_sw_upload_segment)) )
    {
-      log_softerror_and_alarm("Failed to create worker thread to process upload.");
-      s_bUpdateInProgress = false;
-      s_bProcessUploadInProgress = false;
-      _process_upload_send_status_to_controller(OTA_UPDATE_STATUS_FAILED, 10);
+      log_softerror_and_alarm("Received windowed SW upload packet of invalid size: %d bytes", length);
+      return;
+   }
+
+   u8* pData = pBuffer + iHeadersLength;
+   command_packet_sw_upload_segment segment;
+   memcpy(&segment, pData, sizeof(segment));
+
+   if ( NULL != g_pProcessStats )
+      g_pProcessStats->lastActiveTime = g_TimeNow;
+   s_uLastTimeReceivedAnySoftwareBlock = g_TimeNow;
+
+   if ( segment.uFlags & SW_UPLOAD_FLAG_CANCEL )
+   {
+      log_line("Windowed SW upload canceled.");
+      if ( ! s_bUpdateInProgress )
+      {
+         sw_upload_receiver_close(&s_SWUploadReceiver, 1);
+         _sw_update_close_remove_temp_files();
+      }
+      return;
+   }
+
+   // The received archive is being applied: just answer the ack requests (the receiver keeps the completed status)
+   if ( ! s_bUpdateInProgress )
+   {
+      if ( ! s_SWUploadReceiver.bActive )
+      {
+         char szComm[256];
+         sprintf(szComm, "mkdir -p %s", FOLDER_UPDATES);
+         hw_execute_bash_command(szComm, NULL);
+         sprintf(szComm, "chmod 777 %s", FOLDER_UPDATES);
+         hw_execute_bash_command(szComm, NULL);
+      }
+      _process_upload_pause_vehicle();
+      sw_upload_receiver_process_segment(&s_SWUploadReceiver, FOLDER_UPDATES, pData, length - iHeadersLength);
+   }
+
+   if ( segment.uFlags & SW_UPLOAD_FLAG_ACK_REQUEST )
+   {
+      t_sw_upload_ack ack;
+      sw_upload_receiver_get_ack(&s_SWUploadReceiver, segment.uAckRequestId, &ack);
+      setCommandReplyBuffer((u8*)&ack, sizeof(ack));
+      sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+   }
+
+   if ( s_bUpdateInProgress || (! s_SWUploadReceiver.bActive) )
+      return;
+
+   if ( (SW_UPLOAD_STATUS_FAILED == s_SWUploadReceiver.uStatus) || (SW_UPLOAD_STATUS_FAILED_DISK_SPACE == s_SWUploadReceiver.uStatus) )
+   {
+      log_softerror_and_alarm("Windowed SW upload failed (status %d). Removing the received data.", s_SWUploadReceiver.uStatus);
+      sw_upload_receiver_close(&s_SWUploadReceiver, 1);
       return;
    }
+
+   if ( SW_UPLOAD_STATUS_COMPLETED != s_SWUploadReceiver.uStatus )
+      return;
+
+   s_bUpdateInProgress = true;
+   strcpy(s_szUpdateArchiveFile, s_SWUploadReceiver.szArchiveFile);
+   sync();
+   log_enable_full();
+   log_line("Received software package correctly (windowed method, %u bytes, %u segments resumed, %u recovered with FEC). Update file: [%s]. Applying it.",
+      s_SWUploadReceiver.uTotalSize, s_SWUploadReceiver.uSegmentsResumed, s_SWUploadReceiver.uSegmentsRecoveredWithFEC, s_szUpdateArchiveFile);
+   _process_upload_apply_archive();
 }
 
 bool process_sw_upload_is_started()
@@ -40,6 +40,8 @@
 #include "../radio/radio_rx.h"
 #include "../utils/utils_vehicle.h"
 #include "processor_relay.h"
+#include "relay_fast_path.h"
+#include "packets_utils.h"
 #include "ruby_rt_vehicle.h"
 #include "radio_links.h"
 #include "shared_vars.h"
@@ -244,6 +246,17 @@ void relay_process_received_radio_packet_from_relayed_vehicle(int iRadioLink, in
          bPacketContainsDataToForward = true;
       }
 
+      // Delta encoded telemetry is forwarded as is, the controller rebuilds it
+      if ( (uPacketFlags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_TELEMETRY )
+      if ( uPacketType == PACKET_TYPE_RUBY_TELEMETRY_DELTA )
+      if ( iTotalLength >= (int)(sizeof(t_packet_header) + sizeof(t_packet_header_telemetry_delta)) )
+      {
+         t_packet_header_telemetry_delta* pPHTD = (t_packet_header_telemetry_delta*)(pData + sizeof(t_packet_header));
+         if ( pPHTD->uPacketType == PACKET_TYPE_RUBY_TELEMETRY_EXTENDED )
+            _process_received_ruby_telemetry_from_relayed_vehicle(pData, iTotalLength);
+         bPacketContainsDataToForward = true;
+      }
+
       if ( (uPacketType == PACKET_TYPE_RUBY_PING_CLOCK) ||
            (uPacketType == PACKET_TYPE_RUBY_PING_CLOCK_REPLY) )
       {
@@ -341,6 +354,7 @@ void relay_on_relay_params_changed()
    //if ( g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId >= 0 )
    //if ( 0 != g_pCurrentModel->relay_params.uRelayedVehicleId )
    radio_rx_start_rx_thread(&g_SM_RadioStats, NULL, 0, uAcceptedFirmwareType);
+   relay_fast_path_update_params();
    
    log_line("[Relay] Done processing notification that relay parameters where updated by user command. Notify all local components about new radio config.");
    
@@ -371,11 +385,13 @@ void relay_on_relay_mode_changed(u8 uOldMode, u8 uNewMode)
    }
 
    g_iDebugShowKeyFramesAfterRelaySwitch = 6;
+   relay_fast_path_update_params();
 }
 
 void relay_on_relay_flags_changed(u32 uNewFlags)
 {
    log_line("[Relay] Relay flags changed to: %u, %s", uNewFlags, str_format_relay_flags(uNewFlags));
+   relay_fast_path_update_params();
 }
 
 void relay_on_relayed_vehicle_id_changed(u32 uNewVehicleId)
@@ -385,6 +401,7 @@ void relay_on_relayed_vehicle_id_changed(u32 uNewVehicleId)
     (s_bHasEverReceivedDataFromRelayedVehicle?"Yes":"No") );
 
    s_bHasEverReceivedDataFromRelayedVehicle = false;
+   relay_fast_path_update_params();
 }
 
 void relay_send_packet_to_controller(u8* pBufferData, int iBufferLength)
@@ -476,14 +493,19 @@ void relay_send_packet_to_controller(u8* pBufferData, int iBufferLength)
          continue;
       
       int nRateTx = g_pCurrentModel->radioLinksParams.link_datarate_video_bps[iRadioLinkId];
-      radio_set_out_datarate(nRateTx);
-
       u32 radioFlags = g_pCurrentModel->radioInterfacesParams.interface_current_radio_flags[iRadioInterfaceIndex];
-      radio_set_frames_flags(radioFlags);
+      const t_radio_tx_template* pTxTemplate = radio_get_tx_template(nRateTx, radioFlags, RADIO_PORT_ROUTER_DOWNLINK);
 
-      int totalLength = radio_build_new_raw_packet(iRadioLinkId, s_RadioRawPacketRelayed, pBufferData, iBufferLength, RADIO_PORT_ROUTER_DOWNLINK, 0);
+      int totalLength = radio_build_new_raw_packet_with_template(pTxTemplate, iRadioLinkId, s_RadioRawPacketRelayed, pBufferData, iBufferLength, 0);
+      int iWritten = 0;
+      if ( totalLength > 0 )
+      {
+         packet_utils_lock_radio_tx();
+         iWritten = radio_write_raw_packet(iRadioInterfaceIndex, s_RadioRawPacketRelayed, totalLength);
+         packet_utils_unlock_radio_tx();
+      }
 
-      if ( (totalLength >0) && radio_write_raw_packet(iRadioInterfaceIndex, s_RadioRawPacketRelayed, totalLength) )
+      if ( iWritten )
       {           
          bPacketSent = true;
          g_SM_RadioStats.radio_links[iRadioLinkId].totalTxPackets++;
@@ -575,14 +597,19 @@ void relay_send_single_packet_to_relayed_vehicle(u8* pBufferData, int iBufferLen
          continue;
       
       int nRateTx = g_pCurrentModel->radioLinksParams.link_datarate_data_bps[iRadioLinkId];
-      radio_set_out_datarate(nRateTx);
-
       u32 radioFlags = g_pCurrentModel->radioInterfacesParams.interface_current_radio_flags[iRadioInterfaceIndex];
-      radio_set_frames_flags(radioFlags);
+      const t_radio_tx_template* pTxTemplate = radio_get_tx_template(nRateTx, radioFlags, RADIO_PORT_ROUTER_UPLINK);
 
-      int totalLength = radio_build_new_raw_packet(iRadioLinkId, s_RadioRawPacketRelayed, pBufferData, iBufferLength, RADIO_PORT_ROUTER_UPLINK, 0);
+      int totalLength = radio_build_new_raw_packet_with_template(pTxTemplate, iRadioLinkId, s_RadioRawPacketRelayed, pBufferData, iBufferLength, 0);
+      int iWritten = 0;
+      if ( totalLength > 0 )
+      {
+         packet_utils_lock_radio_tx();
+         iWritten = radio_write_raw_packet(iRadioInterfaceIndex, s_RadioRawPacketRelayed, totalLength);
+         packet_utils_unlock_radio_tx();
+      }
 
-      if ( (totalLength>0) && radio_write_raw_packet(iRadioInterfaceIndex, s_RadioRawPacketRelayed, totalLength) )
+      if ( iWritten )
       {           
          bPacketSent = true;
          g_SM_RadioStats.radio_links[iRadioLinkId].totalTxPackets++;
@@ -69,6 +69,11 @@ ProcessorTxAudio::ProcessorTxAudio()
    m_uSchemeDataPackets = 4;
    m_uSchemeECPackets = 2;
 
+   m_bCodecADPCM = false;
+   m_iInputFrameSamplesCount = 0;
+   audio_adpcm_init(&m_ADPCMState);
+   audio_stream_parser_init(&m_InputStreamParser);
+
    strcpy(m_szBreakStamp, "0123456789");
    m_szBreakStamp[10] = 10;
    m_szBreakStamp[11] = 0;
@@ -138,6 +143,15 @@ int ProcessorTxAudio::openAudioStream()
    log_line("[Audio-Tx] Current EC scheme: data/EC: %u/%u, packet size: %d bytes",
        m_uSchemeDataPackets, m_uSchemeECPackets, m_iSchemePacketSize);
 
+   m_bCodecADPCM = (g_pCurrentModel->audio_params.flags & AUDIO_FLAGS_CODEC_ADPCM)?true:false;
+   m_iInputFrameSamplesCount = 0;
+   audio_adpcm_init(&m_ADPCMState);
+   audio_stream_parser_init(&m_InputStreamParser);
+   if ( m_bCodecADPCM )
+      log_line("[Audio-Tx] Audio codec: IMA ADPCM, %d samples/packet", audio_adpcm_get_frame_samples(m_iSchemePacketSize));
+   else
+      log_line("[Audio-Tx] Audio codec: PCM");
+
    #ifdef FEATURE_LOCAL_AUDIO_RECORDING
    startLocalRecording();
    #endif
@@ -300,29 +314,69 @@ int ProcessorTxAudio::tryReadAudioInputStream()
       _localRecordBuffer(buffer, countRead);
 #endif
 
-   while ( countRead > 0 )
+   if ( m_bCodecADPCM )
+      _addInputToPacketsADPCM(buffer, countRead);
+   else
+      _addInputToPackets(buffer, countRead);
+   return 1;
+}
+
+void ProcessorTxAudio::_moveToNextInputPacket()
+{
+   m_iCurrentInputReadPacketPosition = 0;
+   m_iCurrentInputReadPacketIndex++;
+   if ( m_iCurrentInputReadPacketIndex >= MAX_BUFFERED_AUDIO_PACKETS )
+      m_iCurrentInputReadPacketIndex = 0;
+}
+
+// Raw capture stream goes as it is into the audio packets
+
+void ProcessorTxAudio::_addInputToPackets(u8* pBuffer, int iLength)
+{
+   while ( iLength > 0 )
    {
       // Still room in the current input packet ?
-      if ( m_iCurrentInputReadPacketPosition + countRead <= m_iSchemePacketSize )
+      if ( m_iCurrentInputReadPacketPosition + iLength <= m_iSchemePacketSize )
       {
-         memcpy(&m_ListBufferedInputPackets[m_iCurrentInputReadPacketIndex][m_iCurrentInputReadPacketPosition], buffer, countRead );
-         m_iCurrentInputReadPacketPosition += countRead;
-         countRead = 0;
+         memcpy(&m_ListBufferedInputPackets[m_iCurrentInputReadPacketIndex][m_iCurrentInputReadPacketPosition], pBuffer, iLength );
+         m_iCurrentInputReadPacketPosition += iLength;
          break;
       }
 
       int iAvailableRoom = m_iSchemePacketSize - m_iCurrentInputReadPacketPosition;
-      memcpy(&m_ListBufferedInputPackets[m_iCurrentInputReadPacketIndex][m_iCurrentInputReadPacketPosition], buffer, iAvailableRoom );
-      m_iCurrentInputReadPacketPosition = 0;
-      m_iCurrentInputReadPacketIndex++;
-      if ( m_iCurrentInputReadPacketIndex >= MAX_BUFFERED_AUDIO_PACKETS )
-         m_iCurrentInputReadPacketIndex = 0;
-
-      countRead -= iAvailableRoom;
-      for( int i=0; i<=countRead; i++ )
-         buffer[i] = buffer[i+iAvailableRoom];
+      memcpy(&m_ListBufferedInputPackets[m_iCurrentInputReadPacketIndex][m_iCurrentInputReadPacketPosition], pBuffer, iAvailableRoom );
+      _moveToNextInputPacket();
+
+      iLength -= iAvailableRoom;
+      pBuffer += iAvailableRoom;
+   }
+}
+
+// Samples of the capture stream (break stamps and WAV headers removed) are encoded, one ADPCM frame per audio packet
+
+void ProcessorTxAudio::_addInputToPacketsADPCM(u8* pBuffer, int iLength)
+{
+   int iFrameSamples = audio_adpcm_get_frame_samples(m_iSchemePacketSize);
+   short sSamples[(MAX_PACKET_PAYLOAD + AUDIO_STREAM_PARSER_MAX_HELD_BYTES)/2];
+   int iCountSamples = audio_stream_parser_add(&m_InputStreamParser, pBuffer, iLength, sSamples, NULL);
+   int iPos = 0;
+
+   while ( iPos < iCountSamples )
+   {
+      int iCopy = iFrameSamples - m_iInputFrameSamplesCount;
+      if ( iCopy > iCountSamples - iPos )
+         iCopy = iCountSamples - iPos;
+      memcpy(&m_sInputFrameSamples[m_iInputFrameSamplesCount], &sSamples[iPos], iCopy*sizeof(short));
+      m_iInputFrameSamplesCount += iCopy;
+      iPos += iCopy;
+
+      if ( m_iInputFrameSamplesCount < iFrameSamples )
+         break;
+
+      audio_adpcm_encode_frame(&m_ADPCMState, m_sInputFrameSamples, &m_ListBufferedInputPackets[m_iCurrentInputReadPacketIndex][0], m_iSchemePacketSize);
+      m_iInputFrameSamplesCount = 0;
+      _moveToNextInputPacket();
    }
-   return 1;
 }
 
 void ProcessorTxAudio::_localRecordBuffer(u8* pBuffer, int iLength)
@@ -2,6 +2,7 @@
 
 #include "../base/base.h"
 #include "../base/config.h"
+#include "../base/audio_codec.h"
 #include "../radio/radiopackets2.h"
 
 class ProcessorTxAudio
@@ -24,6 +25,9 @@ class ProcessorTxAudio
 
    protected:
       void _localRecordBuffer(u8* pBuffer, int iLength);
+      void _addInputToPackets(u8* pBuffer, int iLength);
+      void _addInputToPacketsADPCM(u8* pBuffer, int iLength);
+      void _moveToNextInputPacket();
       void _sendAudioPacket(u8* pBuffer, int iLength, u32 uAudioPacketIndex);
 
       int m_iAudioStream;
@@ -47,6 +51,12 @@ class ProcessorTxAudio
       u8 m_ListBufferedInputECPackets[10][MAX_PACKET_PAYLOAD];
       int m_iCurrentInputReadPacketIndex;
       int m_iCurrentInputReadPacketPosition;
+
+      bool m_bCodecADPCM;
+      t_audio_adpcm_state m_ADPCMState;
+      t_audio_stream_parser m_InputStreamParser;
+      short m_sInputFrameSamples[MAX_PACKET_PAYLOAD*2];
+      int m_iInputFrameSamplesCount;
       
       int m_iCurrentInputBufferPacketToSend;
       u32 m_uCurrentTxAudioBlockIndex;
@@ -35,6 +35,7 @@
 #include "../radio/radiolink.h"
 #include "../radio/radiopackets2.h"
 #include "../radio/fec.h"
+#include "../radio/video_nack.h"
 #include "../base/camera_utils.h"
 #include "../base/parser_h264.h"
 #include "../common/string_utils.h"
@@ -1333,6 +1334,11 @@ void _process_command_resend_packets(u8* pPacketBuffer, u8 packetType)
 
 extern bool bDebugNoVideoOutput;
 
+void _on_video_nack_block(u32 uRequestId, u32 uVideoBlockIndex, const u8* pMissingBitmap, void* pContext)
+{
+   ((VideoTxPacketsBuffer*)pContext)->resendVideoPackets(uRequestId, uVideoBlockIndex, pMissingBitmap);
+}
+
 bool process_data_tx_video_command(int iRadioInterface, u8* pPacketBuffer)
 {
 /*
@@ -1369,6 +1375,26 @@ bool process_data_tx_video_command(int iRadioInterface, u8* pPacketBuffer)
       }
    }
 
+   if ( pPH->packet_type == PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP )
+   {
+      if ( NULL == g_pVideoTxBuffers )
+         return true;
+      int iCount = video_nack_parse(pPacketBuffer + sizeof(t_packet_header), pPH->total_length - sizeof(t_packet_header), _on_video_nack_block, g_pVideoTxBuffers);
+      if ( iCount < 0 )
+         log_softerror_and_alarm("[VideoTx] Received invalid retransmission request (%d bytes).", pPH->total_length);
+      return true;
+   }
+
+   if ( pPH->packet_type == PACKET_TYPE_VIDEO_EC_RECOVERY_STATS )
+   {
+      if ( pPH->total_length < sizeof(t_packet_header) + sizeof(t_packet_data_video_ec_recovery_stats) )
+         return true;
+      t_packet_data_video_ec_recovery_stats stats;
+      memcpy(&stats, pPacketBuffer + sizeof(t_packet_header), sizeof(t_packet_data_video_ec_recovery_stats));
+      adaptive_video_on_ec_recovery_stats(&stats);
+      return true;
+   }
+
    if ( pPH->packet_type == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL )
    {
       if ( pPH->total_length < sizeof(t_packet_header) + 2*sizeof(u8) )
@@ -38,6 +38,7 @@
 #include "../common/radio_stats.h"
 #include "../radio/radio_tx.h"
 #include "shared_vars.h"
+#include "packets_utils.h"
 #include "timers.h"
 
 
@@ -288,12 +289,15 @@ void radio_links_close_rxtx_radio_interfaces()
          hardware_radio_serial_close(i);
    }
 
+   // The relay fast path thread can be writing to the interfaces
+   packet_utils_lock_radio_tx();
    for( int i=0; i<hardware_get_radio_interfaces_count(); i++ )
    {
       radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(i);
       if ( pRadioHWInfo->openedForWrite )
          radio_close_interface_for_write(i);
    }
+   packet_utils_unlock_radio_tx();
 
    radio_close_interfaces_for_read();
 
@@ -0,0 +1,527 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hw_procs.h"
+#include "../base/hardware_radio.h"
+#include "../base/models.h"
+#include "../common/relay_utils.h"
+#include "../radio/radiolink.h"
+#include "../radio/radio_rx.h"
+#include "relay_fast_path.h"
+#include "packets_utils.h"
+#include "process_radio_in_packets.h"
+#include "shared_vars.h"
+#include "timers.h"
+#include <pthread.h>
+
+typedef struct
+{
+   u8  headroom[RADIO_PACKET_HEADROOM]; // Radio headers are written here when the packet is sent
+   u8  packet[MAX_PACKET_TOTAL_SIZE];
+   int iLength;
+   int iDirection;
+   u32 uTimeQueuedMicros;
+} t_relay_fast_path_slot;
+
+typedef struct
+{
+   int iCount;
+   int iRadioInterface[MAX_RADIO_INTERFACES];
+   int iRadioLink[MAX_RADIO_INTERFACES];
+   const t_radio_tx_template* pTxTemplate[MAX_RADIO_INTERFACES];
+} t_relay_fast_path_tx_targets;
+
+typedef struct
+{
+   int iEnabled;
+   u32 uRelayedVehicleId;
+   int iForwardVideo;
+   int iForwardTelemetry;
+   int iIsRelayInterface[MAX_RADIO_INTERFACES];
+   t_relay_fast_path_tx_targets txTargets[RELAY_FAST_PATH_DIRECTIONS];
+} t_relay_fast_path_params;
+
+static t_relay_fast_path_slot s_RelayFastPathSlots[RELAY_FAST_PATH_QUEUE_SIZE];
+static int s_iRelayFastPathQueueHead = 0;
+static int s_iRelayFastPathQueueCount = 0;
+
+static t_relay_fast_path_params s_RelayFastPathParams;
+
+// Guards the queue, the params and the stats; never held while writing to the radio interfaces
+static pthread_mutex_t s_MutexRelayFastPath = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_CondRelayFastPath = PTHREAD_COND_INITIALIZER;
+static pthread_t s_pThreadRelayFastPath;
+static bool s_bRelayFastPathStarted = false;
+static bool s_bRelayFastPathStop = false;
+static int s_iRelayFastPathThreadPriority = -1;
+
+static shared_mem_relay_fast_path_stats s_RelayFastPathStats;
+static shared_mem_relay_fast_path_stats* s_pSMRelayFastPathStats = NULL;
+static u32 s_uRelayFastPathTmpLatencySumMicros[RELAY_FAST_PATH_DIRECTIONS];
+static u32 s_uRelayFastPathTmpLatencyCount[RELAY_FAST_PATH_DIRECTIONS];
+static u32 s_uRelayFastPathTmpLatencyMaxMicros[RELAY_FAST_PATH_DIRECTIONS];
+static u32 s_uRelayFastPathTimeLastStatsUpdate = 0;
+
+// Router state updates for the packets handled by the fast path, applied from the main thread
+static u32 s_uRelayFastPathPendingTxPackets[MAX_RADIO_INTERFACES];
+static u32 s_uRelayFastPathPendingTxBytes[MAX_RADIO_INTERFACES];
+static u32 s_uRelayFastPathPendingControllerPackets = 0;
+
+static void _relay_fast_path_compute_tx_targets(t_relay_fast_path_tx_targets* pTargets, bool bToRelayedVehicle)
+{
+   pTargets->iCount = 0;
+   for( int iRadioLinkId=0; iRadioLinkId<g_pCurrentModel->radioLinksParams.links_count; iRadioLinkId++ )
+   {
+      u32 uLinkFlags = g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId];
+      if ( uLinkFlags & RADIO_HW_CAPABILITY_FLAG_DISABLED )
+         continue;
+      if ( !(uLinkFlags & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
+         continue;
+      if ( bToRelayedVehicle )
+      {
+         if ( ! (uLinkFlags & RADIO_HW_CAPABILITY_FLAG_USED_FOR_RELAY) )
+            continue;
+      }
+      else
+      {
+         if ( (uLinkFlags & RADIO_HW_CAPABILITY_FLAG_USED_FOR_RELAY) || (g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId == iRadioLinkId) )
+            continue;
+      }
+
+      // Same as the regular relay tx: first radio interface assigned to the radio link
+      int iRadioInterfaceIndex = -1;
+      for( int k=0; k<g_pCurrentModel->radioInterfacesParams.interfaces_count; k++ )
+      {
+         if ( g_pCurrentModel->radioInterfacesParams.interface_link_id[k] == iRadioLinkId )
+         {
+            iRadioInterfaceIndex = k;
+            break;
+         }
+      }
+      if ( iRadioInterfaceIndex < 0 )
+         continue;
+      if ( g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_DISABLED )
+         continue;
+      if ( !(g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
+         continue;
+
+      pTargets->iRadioInterface[pTargets->iCount] = iRadioInterfaceIndex;
+      pTargets->iRadioLink[pTargets->iCount] = iRadioLinkId;
+      u32 uFramesFlags = g_pCurrentModel->radioInterfacesParams.interface_current_radio_flags[iRadioInterfaceIndex];
+      if ( bToRelayedVehicle )
+         pTargets->pTxTemplate[pTargets->iCount] = radio_get_tx_template(g_pCurrentModel->radioLinksParams.link_datarate_data_bps[iRadioLinkId], uFramesFlags, RADIO_PORT_ROUTER_UPLINK);
+      else
+         pTargets->pTxTemplate[pTargets->iCount] = radio_get_tx_template(g_pCurrentModel->radioLinksParams.link_datarate_video_bps[iRadioLinkId], uFramesFlags, RADIO_PORT_ROUTER_DOWNLINK);
+      pTargets->iCount++;
+   }
+}
+
+void relay_fast_path_update_params()
+{
+   t_relay_fast_path_params params;
+   memset(&params, 0, sizeof(params));
+
+   if ( NULL != g_pCurrentModel )
+   if ( g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId >= 0 )
+   if ( g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId < g_pCurrentModel->radioLinksParams.links_count )
+   if ( (0 != g_pCurrentModel->relay_params.uRelayedVehicleId) && (MAX_U32 != g_pCurrentModel->relay_params.uRelayedVehicleId) )
+   if ( g_pCurrentModel->relay_params.uRelayedVehicleId != g_pCurrentModel->uVehicleId )
+   {
+      params.iEnabled = 1;
+      params.uRelayedVehicleId = g_pCurrentModel->relay_params.uRelayedVehicleId;
+      params.iForwardVideo = relay_vehicle_must_forward_relayed_video(g_pCurrentModel)?1:0;
+      params.iForwardTelemetry = (g_pCurrentModel->relay_params.uRelayCapabilitiesFlags & RELAY_CAPABILITY_TRANSPORT_TELEMETRY)?1:0;
+      for( int i=0; i<g_pCurrentModel->radioInterfacesParams.interfaces_count; i++ )
+      {
+         if ( g_pCurrentModel->radioInterfacesParams.interface_link_id[i] == g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId )
+            params.iIsRelayInterface[i] = 1;
+         if ( g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[i] & RADIO_HW_CAPABILITY_FLAG_USED_FOR_RELAY )
+            params.iIsRelayInterface[i] = 1;
+      }
+      _relay_fast_path_compute_tx_targets(&params.txTargets[RELAY_FAST_PATH_TO_CONTROLLER], false);
+      _relay_fast_path_compute_tx_targets(&params.txTargets[RELAY_FAST_PATH_TO_RELAYED_VEHICLE], true);
+   }
+
+   pthread_mutex_lock(&s_MutexRelayFastPath);
+   if ( (params.iEnabled != s_RelayFastPathParams.iEnabled) || (params.uRelayedVehicleId != s_RelayFastPathParams.uRelayedVehicleId) )
+      log_line("[RelayFastPath] %s, relayed VID: %u, forward video: %s, tx links to controller: %d, tx links to relayed vehicle: %d",
+         params.iEnabled?"Enabled":"Disabled", params.uRelayedVehicleId, params.iForwardVideo?"yes":"no",
+         params.txTargets[RELAY_FAST_PATH_TO_CONTROLLER].iCount, params.txTargets[RELAY_FAST_PATH_TO_RELAYED_VEHICLE].iCount);
+   memcpy(&s_RelayFastPathParams, &params, sizeof(t_relay_fast_path_params));
+   s_RelayFastPathStats.iEnabled = params.iEnabled;
+   s_RelayFastPathStats.uRelayedVehicleId = params.uRelayedVehicleId;
+   pthread_mutex_unlock(&s_MutexRelayFastPath);
+}
+
+// Header only classification. Returns the direction to forward the packet to, -1 to leave the packet
+// to the main loop, -2 to drop it. Called with the lock held.
+static int _relay_fast_path_classify(int iRadioInterfaceIndex, u8* pPacketData, int iPacketLength)
+{
+   t_packet_header* pPH = (t_packet_header*)pPacketData;
+   t_packet_header_compressed* pPHC = (t_packet_header_compressed*)pPacketData;
+   u32 uVehicleIdSrc = 0;
+   u32 uVehicleIdDest = 0;
+   int iTotalLength = 0;
+   u8 uPacketType = 0;
+   u8 uComponent = 0;
+
+   if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_FLAGS_MASK_COMPRESSED_HEADER )
+   {
+      if ( iPacketLength < (int)sizeof(t_packet_header_compressed) )
+         return -1;
+      uVehicleIdSrc = pPHC->vehicle_id_src;
+      uVehicleIdDest = pPHC->vehicle_id_dest;
+      iTotalLength = pPHC->total_length;
+      uPacketType = pPHC->packet_type;
+      uComponent = pPHC->uExtraBits & PACKET_FLAGS_MASK_MODULE;
+   }
+   else
+   {
+      if ( iPacketLength < (int)sizeof(t_packet_header) )
+         return -1;
+      uVehicleIdSrc = pPH->vehicle_id_src;
+      uVehicleIdDest = pPH->vehicle_id_dest;
+      iTotalLength = pPH->total_length;
+      uPacketType = pPH->packet_type;
+      uComponent = pPH->packet_flags & PACKET_FLAGS_MASK_MODULE;
+   }
+
+   if ( s_RelayFastPathParams.iIsRelayInterface[iRadioInterfaceIndex] )
+   {
+      if ( uVehicleIdSrc != s_RelayFastPathParams.uRelayedVehicleId )
+         return -1;
+      if ( iTotalLength != iPacketLength )
+         return -1;
+
+      int iDirection = -1;
+      if ( (uComponent == PACKET_COMPONENT_VIDEO) || ((uComponent == PACKET_COMPONENT_AUDIO) && (uPacketType == PACKET_TYPE_AUDIO_SEGMENT)) )
+      {
+         if ( s_RelayFastPathParams.iForwardVideo )
+            iDirection = RELAY_FAST_PATH_TO_CONTROLLER;
+         else if ( (uPacketType == PACKET_TYPE_VIDEO_DATA_98) || (uPacketType == PACKET_TYPE_AUDIO_SEGMENT) )
+            return -2;
+      }
+      // Ruby telemetry is also used by the relay vehicle, it goes through the main loop
+      if ( uComponent == PACKET_COMPONENT_TELEMETRY )
+      if ( (uPacketType != PACKET_TYPE_RUBY_TELEMETRY_EXTENDED) && (uPacketType != PACKET_TYPE_RUBY_TELEMETRY_SHORT) && (uPacketType != PACKET_TYPE_RUBY_TELEMETRY_DELTA) )
+      if ( s_RelayFastPathParams.iForwardTelemetry || (uPacketType == PACKET_TYPE_FC_TELEMETRY) || (uPacketType == PACKET_TYPE_FC_TELEMETRY_EXTENDED) )
+         iDirection = RELAY_FAST_PATH_TO_CONTROLLER;
+
+      if ( iDirection < 0 )
+         s_RelayFastPathStats.directions[RELAY_FAST_PATH_TO_CONTROLLER].uPacketsSlowPath++;
+      return iDirection;
+   }
+
+   if ( uVehicleIdDest != s_RelayFastPathParams.uRelayedVehicleId )
+      return -1;
+
+   // Pings to the relayed vehicle set the relay link used for the ping replies
+   if ( uPacketType == PACKET_TYPE_RUBY_PING_CLOCK )
+   {
+      s_RelayFastPathStats.directions[RELAY_FAST_PATH_TO_RELAYED_VEHICLE].uPacketsSlowPath++;
+      return -1;
+   }
+   return RELAY_FAST_PATH_TO_RELAYED_VEHICLE;
+}
+
+// Runs in the radio rx thread
+static int _relay_fast_path_on_rx_packet(int iRadioInterfaceIndex, u8* pPacketData, int iPacketLength)
+{
+   if ( (NULL == pPacketData) || (iPacketLength <= 0) || (iPacketLength > MAX_PACKET_TOTAL_SIZE) )
+      return 0;
+   if ( (iRadioInterfaceIndex < 0) || (iRadioInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return 0;
+
+   pthread_mutex_lock(&s_MutexRelayFastPath);
+   if ( ! s_RelayFastPathParams.iEnabled )
+   {
+      pthread_mutex_unlock(&s_MutexRelayFastPath);
+      return 0;
+   }
+
+   int iDirection = _relay_fast_path_classify(iRadioInterfaceIndex, pPacketData, iPacketLength);
+   if ( iDirection < 0 )
+   {
+      pthread_mutex_unlock(&s_MutexRelayFastPath);
+      return (-2 == iDirection)?1:0;
+   }
+   if ( RELAY_FAST_PATH_TO_RELAYED_VEHICLE == iDirection )
+      s_uRelayFastPathPendingControllerPackets++;
+
+   if ( s_iRelayFastPathQueueCount >= RELAY_FAST_PATH_QUEUE_SIZE )
+   {
+      s_RelayFastPathStats.directions[iDirection].uPacketsDroppedQueueFull++;
+      pthread_mutex_unlock(&s_MutexRelayFastPath);
+      return 1;
+   }
+
+   t_relay_fast_path_slot* pSlot = &s_RelayFastPathSlots[(s_iRelayFastPathQueueHead + s_iRelayFastPathQueueCount) % RELAY_FAST_PATH_QUEUE_SIZE];
+   memcpy(pSlot->packet, pPacketData, iPacketLength);
+   pSlot->iLength = iPacketLength;
+   pSlot->iDirection = iDirection;
+   pSlot->uTimeQueuedMicros = get_current_timestamp_micros();
+   s_iRelayFastPathQueueCount++;
+   if ( (u32)s_iRelayFastPathQueueCount > s_RelayFastPathStats.directions[iDirection].uMaxQueuedPackets )
+      s_RelayFastPathStats.directions[iDirection].uMaxQueuedPackets = s_iRelayFastPathQueueCount;
+
+   pthread_cond_signal(&s_CondRelayFastPath);
+   pthread_mutex_unlock(&s_MutexRelayFastPath);
+   return 1;
+}
+
+// Called with the lock held
+static void _relay_fast_path_update_stats(u32 uTimeNow)
+{
+   if ( uTimeNow < s_uRelayFastPathTimeLastStatsUpdate + RELAY_FAST_PATH_STATS_INTERVAL_MS )
+      return;
+   s_uRelayFastPathTimeLastStatsUpdate = uTimeNow;
+
+   for( int i=0; i<RELAY_FAST_PATH_DIRECTIONS; i++ )
+   {
+      s_RelayFastPathStats.directions[i].uLatencyAvgMicrosLastInterval = 0;
+      if ( s_uRelayFastPathTmpLatencyCount[i] > 0 )
+         s_RelayFastPathStats.directions[i].uLatencyAvgMicrosLastInterval = s_uRelayFastPathTmpLatencySumMicros[i] / s_uRelayFastPathTmpLatencyCount[i];
+      s_RelayFastPathStats.directions[i].uLatencyMaxMicrosLastInterval = s_uRelayFastPathTmpLatencyMaxMicros[i];
+      s_uRelayFastPathTmpLatencySumMicros[i] = 0;
+      s_uRelayFastPathTmpLatencyCount[i] = 0;
+      s_uRelayFastPathTmpLatencyMaxMicros[i] = 0;
+   }
+   s_RelayFastPathStats.iQueuedPackets = s_iRelayFastPathQueueCount;
+   s_RelayFastPathStats.uTimeLastUpdate = uTimeNow;
+   if ( NULL != s_pSMRelayFastPathStats )
+      memcpy(s_pSMRelayFastPathStats, &s_RelayFastPathStats, sizeof(shared_mem_relay_fast_path_stats));
+}
+
+// Returns a bit mask of the tx targets the packet was written to
+static u32 _relay_fast_path_send(t_relay_fast_path_slot* pSlot, t_relay_fast_path_tx_targets* pTargets)
+{
+   u32 uSentMask = 0;
+   for( int i=0; i<pTargets->iCount; i++ )
+   {
+      int iRadioInterfaceIndex = pTargets->iRadioInterface[i];
+      radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iRadioInterfaceIndex);
+      if ( NULL == pRadioHWInfo )
+         continue;
+
+      u8* pRawPacket = NULL;
+      int iTotalLength = radio_build_new_raw_packet_in_headroom_with_template(pTargets->pTxTemplate[i], pTargets->iRadioLink[i], pSlot->packet, pSlot->iLength, &pRawPacket);
+      if ( iTotalLength <= 0 )
+         continue;
+
+      packet_utils_lock_radio_tx();
+      if ( pRadioHWInfo->openedForWrite )
+      if ( radio_write_raw_packet(iRadioInterfaceIndex, pRawPacket, iTotalLength) )
+         uSentMask |= ((u32)1) << i;
+      packet_utils_unlock_radio_tx();
+   }
+   return uSentMask;
+}
+
+static void* _thread_relay_fast_path(void* pArgument)
+{
+   log_line("[RelayFastPath] Thread started.");
+   if ( s_iRelayFastPathThreadPriority > 0 )
+      hw_increase_current_thread_priority("[RelayFastPath]", s_iRelayFastPathThreadPriority);
+
+   t_relay_fast_path_tx_targets targets;
+
+   pthread_mutex_lock(&s_MutexRelayFastPath);
+   while ( ! s_bRelayFastPathStop )
+   {
+      _relay_fast_path_update_stats(get_current_timestamp_ms());
+
+      if ( 0 == s_iRelayFastPathQueueCount )
+      {
+         struct timespec ts;
+         clock_gettime(CLOCK_REALTIME, &ts);
+         ts.tv_nsec += 200*1000*1000;
+         if ( ts.tv_nsec >= 1000*1000*1000 )
+         {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000*1000*1000;
+         }
+         pthread_cond_timedwait(&s_CondRelayFastPath, &s_MutexRelayFastPath, &ts);
+         continue;
+      }
+
+      // The head slot stays owned by this thread until it's released below
+      t_relay_fast_path_slot* pSlot = &s_RelayFastPathSlots[s_iRelayFastPathQueueHead];
+      memcpy(&targets, &s_RelayFastPathParams.txTargets[pSlot->iDirection], sizeof(t_relay_fast_path_tx_targets));
+      pthread_mutex_unlock(&s_MutexRelayFastPath);
+
+      u32 uSentMask = _relay_fast_path_send(pSlot, &targets);
+      u32 uLatencyMicros = get_current_timestamp_micros() - pSlot->uTimeQueuedMicros;
+
+      pthread_mutex_lock(&s_MutexRelayFastPath);
+      shared_mem_relay_fast_path_direction_stats* pStats = &s_RelayFastPathStats.directions[pSlot->iDirection];
+      if ( 0 != uSentMask )
+      {
+         for( int i=0; i<targets.iCount; i++ )
+         {
+            if ( ! (uSentMask & (((u32)1) << i)) )
+               continue;
+            s_uRelayFastPathPendingTxPackets[targets.iRadioLink[i]]++;
+            s_uRelayFastPathPendingTxBytes[targets.iRadioLink[i]] += pSlot->iLength;
+         }
+         pStats->uPacketsForwarded++;
+         pStats->uBytesForwarded += pSlot->iLength;
+         s_uRelayFastPathTmpLatencySumMicros[pSlot->iDirection] += uLatencyMicros;
+         s_uRelayFastPathTmpLatencyCount[pSlot->iDirection]++;
+         if ( uLatencyMicros > s_uRelayFastPathTmpLatencyMaxMicros[pSlot->iDirection] )
+            s_uRelayFastPathTmpLatencyMaxMicros[pSlot->iDirection] = uLatencyMicros;
+         if ( uLatencyMicros > pStats->uLatencyMaxMicros )
+            pStats->uLatencyMaxMicros = uLatencyMicros;
+      }
+      else
+         pStats->uPacketsDroppedTxFailed++;
+
+      s_iRelayFastPathQueueHead = (s_iRelayFastPathQueueHead + 1) % RELAY_FAST_PATH_QUEUE_SIZE;
+      s_iRelayFastPathQueueCount--;
+   }
+   pthread_mutex_unlock(&s_MutexRelayFastPath);
+   log_line("[RelayFastPath] Thread stopped.");
+   return NULL;
+}
+
+bool relay_fast_path_start(int iThreadPriority)
+{
+   if ( s_bRelayFastPathStarted )
+      return true;
+
+   s_iRelayFastPathQueueHead = 0;
+   s_iRelayFastPathQueueCount = 0;
+   memset(&s_RelayFastPathStats, 0, sizeof(shared_mem_relay_fast_path_stats));
+   for( int i=0; i<RELAY_FAST_PATH_DIRECTIONS; i++ )
+   {
+      s_uRelayFastPathTmpLatencySumMicros[i] = 0;
+      s_uRelayFastPathTmpLatencyCount[i] = 0;
+      s_uRelayFastPathTmpLatencyMaxMicros[i] = 0;
+   }
+   s_uRelayFastPathTimeLastStatsUpdate = 0;
+   memset(s_uRelayFastPathPendingTxPackets, 0, sizeof(s_uRelayFastPathPendingTxPackets));
+   memset(s_uRelayFastPathPendingTxBytes, 0, sizeof(s_uRelayFastPathPendingTxBytes));
+   s_uRelayFastPathPendingControllerPackets = 0;
+
+   s_pSMRelayFastPathStats = shared_mem_relay_fast_path_stats_open_for_write();
+   if ( NULL == s_pSMRelayFastPathStats )
+      log_softerror_and_alarm("[RelayFastPath] Failed to open relay fast path stats shared memory for write.");
+   else
+      memset(s_pSMRelayFastPathStats, 0, sizeof(shared_mem_relay_fast_path_stats));
+
+   relay_fast_path_update_params();
+
+   s_iRelayFastPathThreadPriority = iThreadPriority;
+   s_bRelayFastPathStop = false;
+   if ( 0 != pthread_create(&s_pThreadRelayFastPath, NULL, &_thread_relay_fast_path, NULL) )
+   {
+      log_error_and_alarm("[RelayFastPath] Failed to create thread.");
+      shared_mem_relay_fast_path_stats_close(s_pSMRelayFastPathStats);
+      s_pSMRelayFastPathStats = NULL;
+      return false;
+   }
+   s_bRelayFastPathStarted = true;
+   radio_rx_set_fast_path_callback(&_relay_fast_path_on_rx_packet);
+   log_line("[RelayFastPath] Started (queue size: %d packets).", RELAY_FAST_PATH_QUEUE_SIZE);
+   return true;
+}
+
+void relay_fast_path_stop()
+{
+   if ( ! s_bRelayFastPathStarted )
+      return;
+
+   radio_rx_set_fast_path_callback(NULL);
+
+   pthread_mutex_lock(&s_MutexRelayFastPath);
+   s_bRelayFastPathStop = true;
+   pthread_cond_signal(&s_CondRelayFastPath);
+   pthread_mutex_unlock(&s_MutexRelayFastPath);
+   pthread_join(s_pThreadRelayFastPath, NULL);
+   s_bRelayFastPathStarted = false;
+
+   relay_fast_path_log_info();
+   shared_mem_relay_fast_path_stats_close(s_pSMRelayFastPathStats);
+   s_pSMRelayFastPathStats = NULL;
+}
+
+void relay_fast_path_apply_pending_updates()
+{
+   if ( ! s_bRelayFastPathStarted )
+      return;
+
+   u32 uTxPackets[MAX_RADIO_INTERFACES];
+   u32 uTxBytes[MAX_RADIO_INTERFACES];
+   pthread_mutex_lock(&s_MutexRelayFastPath);
+   memcpy(uTxPackets, s_uRelayFastPathPendingTxPackets, sizeof(uTxPackets));
+   memcpy(uTxBytes, s_uRelayFastPathPendingTxBytes, sizeof(uTxBytes));
+   u32 uControllerPackets = s_uRelayFastPathPendingControllerPackets;
+   memset(s_uRelayFastPathPendingTxPackets, 0, sizeof(s_uRelayFastPathPendingTxPackets));
+   memset(s_uRelayFastPathPendingTxBytes, 0, sizeof(s_uRelayFastPathPendingTxBytes));
+   s_uRelayFastPathPendingControllerPackets = 0;
+   pthread_mutex_unlock(&s_MutexRelayFastPath);
+
+   bool bSent = false;
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      if ( 0 == uTxPackets[i] )
+         continue;
+      bSent = true;
+      g_SM_RadioStats.radio_links[i].totalTxPackets += uTxPackets[i];
+      g_SM_RadioStats.radio_links[i].totalTxBytes += uTxBytes[i];
+   }
+   if ( bSent && (NULL != g_pProcessStats) )
+      g_pProcessStats->lastRadioTxTime = g_TimeNow;
+
+   // Same as the slow path for the controller packets relayed to the relayed vehicle
+   if ( 0 != uControllerPackets )
+      _mark_link_from_controller_present();
+}
+
+void relay_fast_path_log_info()
+{
+   shared_mem_relay_fast_path_stats stats;
+   pthread_mutex_lock(&s_MutexRelayFastPath);
+   memcpy(&stats, &s_RelayFastPathStats, sizeof(shared_mem_relay_fast_path_stats));
+   pthread_mutex_unlock(&s_MutexRelayFastPath);
+
+   if ( ! stats.iEnabled )
+      return;
+   const char* szDirections[RELAY_FAST_PATH_DIRECTIONS] = { "to controller", "to relayed vehicle" };
+   for( int i=0; i<RELAY_FAST_PATH_DIRECTIONS; i++ )
+      log_line("[RelayFastPath] %s: forwarded %u packets (%u bytes), dropped %u (queue full) %u (tx failed), slow path: %u, latency avg/max: %u/%u us (max total: %u us), max queued: %u",
+         szDirections[i], stats.directions[i].uPacketsForwarded, stats.directions[i].uBytesForwarded,
+         stats.directions[i].uPacketsDroppedQueueFull, stats.directions[i].uPacketsDroppedTxFailed,
+         stats.directions[i].uPacketsSlowPath,
+         stats.directions[i].uLatencyAvgMicrosLastInterval, stats.directions[i].uLatencyMaxMicrosLastInterval,
+         stats.directions[i].uLatencyMaxMicros, stats.directions[i].uMaxQueuedPackets);
+}
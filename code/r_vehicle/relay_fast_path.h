@@ -0,0 +1,23 @@
+#pragma once
+#include "../base/base.h"
+#include "../base/shared_mem.h"
+
+// Fast path for relayed traffic.
+// The radio rx thread classifies each received packet by its header only. Video, audio and telemetry
+// from the relayed vehicle to the controller, and the controller packets for the relayed vehicle, are
+// copied once into a bounded queue and sent from a dedicated thread, with the radio headers built in the
+// slot headroom. They never go through the router main loop.
+// Everything else on the relay paths (pings, pairing, radio links negotiation, Ruby telemetry, chained
+// packets) still goes through the regular relay processing in the main loop.
+
+#define RELAY_FAST_PATH_QUEUE_SIZE 128
+#define RELAY_FAST_PATH_STATS_INTERVAL_MS 1000
+
+bool relay_fast_path_start(int iThreadPriority);
+void relay_fast_path_stop();
+// Takes a snapshot of the relay and radio params used by the fast path. Call it from the main thread.
+void relay_fast_path_update_params();
+// Applies the router state updates for the packets handled by the fast path since the last call:
+// radio links tx stats, last radio tx time and the link to controller presence. Call it from the main thread.
+void relay_fast_path_apply_pending_updates();
+void relay_fast_path_log_info();
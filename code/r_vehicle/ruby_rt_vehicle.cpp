@@ -64,6 +64,7 @@
 #include "../base/camera_utils.h"
 #include "../base/vehicle_settings.h"
 #include "../base/vehicle_rt_info.h"
+#include "../base/profiler.h"
 #include "../base/hardware_radio_serial.h"
 #include "../common/string_utils.h"
 #include "../common/radio_stats.h"
@@ -93,6 +94,7 @@
 #include "events.h"
 #include "process_local_packets.h"
 #include "processor_relay.h"
+#include "relay_fast_path.h"
 #include "test_link_params.h"
 #include "adaptive_video.h"
 #include "video_source_csi.h"
@@ -855,7 +857,7 @@ void process_and_send_packets()
       if ( pPH->packet_type == PACKET_TYPE_RUBY_PAIRING_CONFIRMATION )
          log_line("Sending pairing request confirmation to controller (from VID %u to CID %u)", pPH->vehicle_id_src, pPH->vehicle_id_dest);
 
-      send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
+      send_packet_with_headroom_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
       
       if ( bMustInjectVideoDevStats )
          _inject_video_link_dev_stats_packet();
@@ -1232,6 +1234,9 @@ int main(int argc, char *argv[])
    else
       log_line("Start sequence: Opened shared mem for router process watchdog for writing.");
 
+   if ( profiler_init(SHARED_MEM_PROFILER_ROUTER_TX) )
+      profiler_register_thread("main");
+
    loadAllModels();
    g_pCurrentModel = getCurrentModel();
 
@@ -1492,6 +1497,7 @@ int main(int argc, char *argv[])
 
    radio_duplicate_detection_init();
    radio_rx_start_rx_thread(&g_SM_RadioStats, NULL, 0, g_pCurrentModel->getVehicleFirmwareType());
+   relay_fast_path_start(g_pCurrentModel->processesPriorities.iThreadPriorityRouter);
    
    send_radio_config_to_controller();
 
@@ -1560,7 +1566,9 @@ int main(int argc, char *argv[])
          g_pProcessStats->uLoopCounter++;
          g_pProcessStats->lastActiveTime = g_TimeNow;
       }
+      PROFILER_BEGIN(PROFILER_SECTION_LOOP);
       _main_loop();
+      PROFILER_END(PROFILER_SECTION_LOOP);
       if ( g_bQuit )
          break;
    }
@@ -1571,6 +1579,7 @@ int main(int argc, char *argv[])
    log_line("Stopping...");
 
    radio_rx_stop_rx_thread();
+   relay_fast_path_stop();
    radio_link_cleanup();
 
    radio_links_close_rxtx_radio_interfaces();
@@ -1587,6 +1596,7 @@ int main(int argc, char *argv[])
    //shared_mem_video_frames_stats_close(g_pSM_VideoInfoStatsCameraOutput);
    //shared_mem_video_frames_stats_radio_out_close(g_pSM_VideoInfoStatsRadioOut);
    shared_mem_process_stats_close(SHARED_MEM_WATCHDOG_ROUTER_TX, g_pProcessStats);
+   profiler_uninit();
    log_line("Stopped.Exit now. (PID %d)", getpid());
    log_line("---------------------\n");
    return 0;
@@ -1675,6 +1685,7 @@ void _main_loop()
    int iRadioInterfaceIndex = 0;
    u8* pPacket = NULL;
 
+   PROFILER_BEGIN(PROFILER_SECTION_RADIO_RX_HIGH_PRIO);
    while ( (iCountConsumedHighPrio < 10) && (!g_bQuit) )
    {
       pPacket = radio_rx_wait_get_next_received_high_prio_packet(0, &iPacketLength, &iPacketIsShort, &iRadioInterfaceIndex);
@@ -1686,6 +1697,9 @@ void _main_loop()
       process_received_single_radio_packet(iRadioInterfaceIndex, pPacket, iPacketLength);      
       shared_mem_radio_stats_rx_hist_update(&g_SM_HistoryRxStats, iRadioInterfaceIndex, pPacket, g_TimeNow);
    }
+   PROFILER_END(PROFILER_SECTION_RADIO_RX_HIGH_PRIO);
+
+   relay_fast_path_apply_pending_updates();
 
    //--------------------------------------------
    // Video/camera read
@@ -1724,12 +1738,16 @@ void _main_loop()
 
             if ( g_pCurrentModel->isActiveCameraCSICompatible() || g_pCurrentModel->isActiveCameraVeye() )
             {
+               PROFILER_BEGIN(PROFILER_SECTION_CAMERA_READ);
                pVideoData = video_source_csi_read(&iReadSize, &bIsInsideIFrame);
+               PROFILER_END(PROFILER_SECTION_CAMERA_READ);
                if ( iReadSize > 0 )
                {
                   int iBuffSize = video_source_csi_get_buffer_size();
                   bEndOfFrame = (iReadSize < iBuffSize)?true:false;
-                  g_pVideoTxBuffers->fillVideoPackets(pVideoData, iReadSize, bEndOfFrame, bIsInsideIFrame);
+                  PROFILER_BEGIN(PROFILER_SECTION_VIDEO_TX);
+                  g_pVideoTxBuffers->fillVideoPackets(pVideoData, iReadSize, bEndOfFrame, bIsInsideIFrame, 0);
+                  PROFILER_END(PROFILER_SECTION_VIDEO_TX);
                   if ( iReadSize < iBuffSize )
                      iMaxRepeatCount = 0;
                }
@@ -1739,14 +1757,21 @@ void _main_loop()
             
             if ( g_pCurrentModel->isActiveCameraOpenIPC() )
             {
+               PROFILER_BEGIN(PROFILER_SECTION_CAMERA_READ);
                pVideoData = video_source_majestic_read(&iReadSize, true);
+               PROFILER_END(PROFILER_SECTION_CAMERA_READ);
                if ( iReadSize > 0 )
                {
                   bool bSingle = video_source_majestic_last_read_is_single_nal();
                   bool bEnd = video_source_majestic_last_read_is_end_nal();
                   bIsInsideIFrame = video_source_majestic_is_inside_iframe();
                   bEndOfFrame = (bSingle || bEnd);
-                  g_pVideoTxBuffers->fillVideoPackets(pVideoData, iReadSize, bEndOfFrame, bIsInsideIFrame);
+                  PROFILER_BEGIN(PROFILER_SECTION_VIDEO_TX);
+                  g_pVideoTxBuffers->fillVideoPackets(pVideoData, iReadSize, bEndOfFrame, bIsInsideIFrame, video_source_majestic_last_read_capture_time_micros());
+                  PROFILER_END(PROFILER_SECTION_VIDEO_TX);
+                  // Consume the whole received batch before polling the socket again
+                  if ( (0 == iMaxRepeatCount) && (video_source_majestic_get_pending_reads() > 0) )
+                     iMaxRepeatCount = 1;
                }
                else
                   iMaxRepeatCount = 0;
@@ -1757,14 +1782,23 @@ void _main_loop()
             // Send telemetry/commands/etc before video data
             if ( g_pVideoTxBuffers->hasPendingPacketsToSend() )
             if ( packets_queue_has_packets(&g_QueueRadioPacketsOut) )
+            {
+               PROFILER_BEGIN(PROFILER_SECTION_RADIO_TX);
                process_and_send_packets();
+               PROFILER_END(PROFILER_SECTION_RADIO_TX);
+            }
 
             // Intermix video packets and try again to see if we got any new high priority packets
             while ( g_pVideoTxBuffers->hasPendingPacketsToSend() )
             {
                int iPending = g_pVideoTxBuffers->hasPendingPacketsToSend();
+               PROFILER_BEGIN(PROFILER_SECTION_VIDEO_TX);
                int iCountSent = g_pVideoTxBuffers->sendAvailablePackets(10);
+               PROFILER_END(PROFILER_SECTION_VIDEO_TX);
                g_TimeNow = get_current_timestamp_ms();
+               // Held by the radio pacer; the remaining packets are sent on the next loops
+               if ( 0 == iCountSent )
+                  break;
                int iCount2 = 0;
                while ( (iCount2 < 3) && (!g_bQuit) )
                {
@@ -1794,6 +1828,7 @@ void _main_loop()
    u32 uTimeStart = get_current_timestamp_ms();
 
    int iCountConsumedRegPrio = 0;
+   PROFILER_BEGIN(PROFILER_SECTION_RADIO_RX);
    while ( (iCountConsumedRegPrio < 50) && (!g_bQuit) )
    {
       pPacket = radio_rx_wait_get_next_received_reg_prio_packet(200, &iPacketLength, &iPacketIsShort, &iRadioInterfaceIndex);
@@ -1820,6 +1855,7 @@ void _main_loop()
          _read_ipc_pipes(uTime);
       }
    }
+   PROFILER_END(PROFILER_SECTION_RADIO_RX);
 
 
    // Check Radio Rx state
@@ -1861,8 +1897,10 @@ void _main_loop()
    g_TimeNow = get_current_timestamp_ms();
    s_uMainLoopIPCCheckLastTime = g_TimeNow;
 
+   PROFILER_BEGIN(PROFILER_SECTION_IPC);
    _read_ipc_pipes(g_TimeNow);
    _consume_ipc_messages();
+   PROFILER_END(PROFILER_SECTION_IPC);
 
    // Send radio packets rightaway if there is no camera (video feed)
    bool bNoVideoData = false;
@@ -1871,7 +1909,11 @@ void _main_loop()
        bNoVideoData = true;
    if ( (! g_pCurrentModel->hasCamera()) || bNoVideoData )
    if ( packets_queue_has_packets(&g_QueueRadioPacketsOut) )
+   {
+      PROFILER_BEGIN(PROFILER_SECTION_RADIO_TX);
       process_and_send_packets();
+      PROFILER_END(PROFILER_SECTION_RADIO_TX);
+   }
 
    //------------------------------------------
    // Periodic loops
@@ -1885,6 +1927,7 @@ void _main_loop()
    g_TimeNow = get_current_timestamp_ms();
    s_uMainLoopPeriodicCheckLastTime = g_TimeNow;
 
+   PROFILER_BEGIN(PROFILER_SECTION_PERIODIC);
    process_data_tx_video_loop();
 
    if ( g_pCurrentModel->hasCamera() )
@@ -1897,7 +1940,9 @@ void _main_loop()
 
    _check_rx_loop_consistency();
    
-   if ( periodicLoop() )
+   int iReinitRadio = periodicLoop();
+   PROFILER_END(PROFILER_SECTION_PERIODIC);
+   if ( iReinitRadio )
    {
       reinit_radio_interfaces();
       return;
@@ -1906,7 +1951,9 @@ void _main_loop()
    //To fix video_stats_overwrites_periodic_loop();
    //To fix video_link_auto_keyframe_periodic_loop();
 
+   PROFILER_BEGIN(PROFILER_SECTION_STATS);
    _synchronize_shared_mems();
+   PROFILER_END(PROFILER_SECTION_STATS);
    send_pending_alarms_to_controller();
 
    if ( NULL != g_pProcessorTxAudio )
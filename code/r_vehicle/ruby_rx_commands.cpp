@@ -3574,6 +3574,14 @@ bool process_command(u8* pBuffer, int length)
       return true;
    }
 
+   if ( uCommandType == COMMAND_ID_UPLOAD_SW_TO_VEHICLE_WINDOWED )
+   {
+      // Segments are sent as one way commands; the ones asking for an ack are answered with the receiver state
+      lastRecvCommandType &= ~COMMAND_TYPE_FLAG_NO_RESPONSE_NEEDED;
+      process_sw_upload_windowed(pBuffer, length);
+      return true;
+   }
+
    if ( uCommandType == COMMAND_ID_RESET_ALL_DEVELOPER_FLAGS )
    {
       for( int i=0; i<20; i++ )
@@ -3,6 +3,7 @@
 
 void signalReboot();
 void sendControlMessage(u8 packet_type, u32 extraParam);
+void setCommandReplyBuffer(u8* pData, int length);
 void sendCommandReply(u8 responseFlags, int iResponseExtraParam, int delayMiliSec);
 
 int r_start_commands_rx(int argc, char* argv[]);
\ No newline at end of file
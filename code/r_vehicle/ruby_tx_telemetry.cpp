@@ -1555,6 +1555,7 @@ int main(int argc, char *argv[])
 
    close_datalink_serial_port();
    telemetry_close_serial_port();
+   telemetry_uninit();
 
    if ( -1 != s_fSerialToFC )
       close(s_fSerialToFC);
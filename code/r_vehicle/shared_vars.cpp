@@ -54,6 +54,7 @@ bool g_bHasSentVehicleSettingsAtLeastOnce = false;
 bool g_bNegociatingRadioLinks = false;
 
 u32  g_uControllerId = 0;
+u32  g_uControllerSwVersion = 0; // as sent in the pairing requests, 0 for older controllers
 
 t_packet_header_ruby_telemetry_extended_extra_info_retransmissions g_PHTE_Retransmissions;
 t_packet_header_vehicle_tx_history g_PHVehicleTxStats;
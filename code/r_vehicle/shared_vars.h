@@ -82,6 +82,7 @@ extern bool g_bHasSentVehicleSettingsAtLeastOnce;
 extern bool g_bNegociatingRadioLinks;
 
 extern u32 g_uControllerId;
+extern u32 g_uControllerSwVersion;
 
 extern t_packet_header_ruby_telemetry_extended_extra_info_retransmissions g_PHTE_Retransmissions;
 extern t_packet_header_vehicle_tx_history g_PHVehicleTxStats;
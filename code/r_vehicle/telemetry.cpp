@@ -37,6 +37,7 @@
 #include "timers.h"
 #include "../base/ruby_ipc.h"
 #include "../base/parse_fc_telemetry.h"
+#include "../base/telemetry_scheduler.h"
 #include "../radio/radiopackets2.h"
 #include "../common/string_utils.h"
 
@@ -67,6 +68,9 @@ u32 s_uRawTelemetryDownloadSegmentIndex = 0;
 u32 s_CountMessagesFromFCPerSecond = 0;
 u32 s_CountMessagesFromFCPerSecondTemp = 0;
 
+shared_mem_telemetry_scheduler_stats* s_pSMTelemetrySchedulerStats = NULL;
+u32 s_uTelemetrySchedulerSecondsCounter = 0;
+
 void telemetry_init()
 {
    memset(&sPHFCT, 0, sizeof(sPHFCT));
@@ -105,6 +109,22 @@ void telemetry_init()
    telemetryBufferFromFCFilledBytes = 0;
    telemetryBufferFromFCLastSendTime = g_TimeNow;
    log_line("[Telem] Telemetry from FC chunk size: %d", telemetryBufferFromFCMaxSize);
+
+   telemetry_scheduler_init(telemetryBufferFromFCMaxSize);
+   if ( NULL == s_pSMTelemetrySchedulerStats )
+   {
+      s_pSMTelemetrySchedulerStats = shared_mem_telemetry_scheduler_stats_open_for_write();
+      if ( NULL == s_pSMTelemetrySchedulerStats )
+         log_softerror_and_alarm("[Telem] Failed to open telemetry scheduler stats shared memory for write.");
+      else
+         memcpy(s_pSMTelemetrySchedulerStats, telemetry_scheduler_get_stats(), sizeof(shared_mem_telemetry_scheduler_stats));
+   }
+}
+
+void telemetry_uninit()
+{
+   shared_mem_telemetry_scheduler_stats_close(s_pSMTelemetrySchedulerStats);
+   s_pSMTelemetrySchedulerStats = NULL;
 }
 
 t_packet_header_fc_telemetry* telemetry_get_fc_telemetry_header()
@@ -333,6 +353,21 @@ bool _telemetry_must_send_raw_telemetry_to_controller()
    return false;
 }
 
+// MAVLink telemetry goes through the telemetry scheduler, segmented on messages boundaries
+void _telemetry_send_scheduled_segments()
+{
+   // Bounded, in case the rate limits let a lot of queued data through at once
+   for( int i=0; i<4; i++ )
+   {
+      int iLength = telemetry_scheduler_get_segment(telemetryBufferFromFC, get_current_timestamp_micros());
+      if ( iLength <= 0 )
+         return;
+      telemetryBufferFromFCFilledBytes = iLength;
+      _send_raw_telemetry_packet_to_controller();
+      telemetryBufferFromFCFilledBytes = 0;
+   }
+}
+
 void _telemetry_addSerialDataToFCTelemetryBuffer(u8* pData, int dataLength)
 {
    if ( NULL == g_pCurrentModel )
@@ -341,6 +376,13 @@ void _telemetry_addSerialDataToFCTelemetryBuffer(u8* pData, int dataLength)
    if ( ! _telemetry_must_send_raw_telemetry_to_controller() )
       return;
 
+   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
+   {
+      telemetry_scheduler_add_serial_data(pData, dataLength, get_current_timestamp_micros());
+      _telemetry_send_scheduled_segments();
+      return;
+   }
+
    while ( dataLength > 0 )
    {
       if ( telemetryBufferFromFCFilledBytes + dataLength < telemetryBufferFromFCMaxSize )
@@ -442,6 +484,24 @@ void telemetry_periodic_loop()
       if ( (g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK) ||
            (g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_LTM) )
          telemetry_mavlink_on_second_lapse();
+
+      if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
+      {
+         shared_mem_telemetry_scheduler_stats* pStats = telemetry_scheduler_update_stats(g_TimeNow);
+         if ( NULL != s_pSMTelemetrySchedulerStats )
+            memcpy(s_pSMTelemetrySchedulerStats, pStats, sizeof(shared_mem_telemetry_scheduler_stats));
+         s_uTelemetrySchedulerSecondsCounter++;
+         if ( (s_uTelemetrySchedulerSecondsCounter % 10) == 0 )
+         if ( _telemetry_must_send_raw_telemetry_to_controller() )
+            telemetry_scheduler_log_info();
+      }
+   }
+
+   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
+   {
+      if ( _telemetry_must_send_raw_telemetry_to_controller() )
+         _telemetry_send_scheduled_segments();
+      return;
    }
 
    if ( _telemetry_must_send_raw_telemetry_to_controller() )
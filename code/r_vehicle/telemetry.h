@@ -4,6 +4,7 @@
 #include "../radio/radiopackets2.h"
 
 void telemetry_init();
+void telemetry_uninit();
 
 bool telemetry_detect_serial_port_to_use();
 int telemetry_open_serial_port();
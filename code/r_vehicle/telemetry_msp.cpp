@@ -35,21 +35,24 @@
 #include "timers.h"
 #include "../base/ruby_ipc.h"
 #include "../base/msp.h"
+#include "../base/telemetry_bulk_parser.h"
 
 bool isRadioLinksInitInProgress();
 extern int s_fIPCToRouter;
 
-u8 s_uMSPRawStream[256]; // Max size is one byte long
-int s_iMSPRawStreamFilledBytes = 0;
-int s_iMSPState = 0;
+// The MSP frame being parsed: points in the serial read buffer, or in the parser carry buffer
+// if the frame was split between two reads
+t_msp_bulk_parser s_MSPBulkParser;
+const u8* s_pMSPRawFrame = NULL;
+int s_iMSPRawFrameLength = 0;
 int s_iMSPDirection = 0;
 int s_iMSPCommandDataSize = 0;
-int s_iMSPParsedDataSize = 0;
-u8 s_uMSPCommandData[256]; // Max size is one byte long
-u8 s_uMSPChecksum = 0;
+const u8* s_pMSPCommandData = NULL;
 u8 s_uMSPCommand = 0;
 u32 s_uLastMSPCommandReceivedTime = 0;
 
+static void _telemetry_msp_on_frame(const t_msp_bulk_frame* pFrame, void* pContext);
+
 u8 s_uMSPOutputBuffer[MAX_PACKET_PAYLOAD];
 int s_iMSPOutputBufferFilledBytes = 0;
 t_packet_header_telemetry_msp s_PHTMSP;
@@ -96,9 +99,8 @@ void _send_msp_to_fc(u8 uCommand, u8* pData, int iDataLength)
 
 void telemetry_msp_on_open_port(int iSerialPortFile)
 {
-   s_iMSPRawStreamFilledBytes = 0;
+   msp_bulk_init(&s_MSPBulkParser, _telemetry_msp_on_frame, NULL);
    s_iMSPOutputBufferFilledBytes = 0;
-   s_iMSPState = MSP_STATE_NONE;
    s_bMSPGotFCInfo = false;
    s_uMSPLastRequestBatteryInfoTime = 0;
 
@@ -161,7 +163,7 @@ void _send_msp_telemetry_packet_to_controller()
    s_iMSPOutputBufferFilledBytes = 0;
 }
 
-void _add_msp_data_to_output(u8* pData, int iDataLength, bool bSendNow)
+void _add_msp_data_to_output(const u8* pData, int iDataLength, bool bSendNow)
 {
    if ( (NULL == pData) || (iDataLength <= 0) || (iDataLength > 255) )
       return;
@@ -184,12 +186,13 @@ void _parse_msp_osd_command()
    
    bool bSendNow = false;
 
-   switch ( s_uMSPCommandData[0] )
+   switch ( s_pMSPCommandData[0] )
    {
       case MSP_DISPLAYPORT_DRAW_STRING:
+         if ( s_iMSPCommandDataSize >= 3 )
          {
-            int x = s_uMSPCommandData[2];
-            int y = s_uMSPCommandData[1];
+            int x = s_pMSPCommandData[2];
+            int y = s_pMSPCommandData[1];
             if ( x >= s_PHTMSP.uCols )
             {
                if ( x >= 50 )
@@ -217,22 +220,22 @@ void _parse_msp_osd_command()
          {
             if ( s_iMSPCommandDataSize >= 3 )
             {
-               if ( s_uMSPCommandData[2] == MSP_SD_OPTION_30_16 )
+               if ( s_pMSPCommandData[2] == MSP_SD_OPTION_30_16 )
                {
                   s_PHTMSP.uCols = 30;
                   s_PHTMSP.uRows = 16;
                }
-               if ( s_uMSPCommandData[2] == MSP_HD_OPTION_50_18 )
+               if ( s_pMSPCommandData[2] == MSP_HD_OPTION_50_18 )
                {
                   s_PHTMSP.uCols = 50;
                   s_PHTMSP.uRows = 18;
                }
-               if ( s_uMSPCommandData[2] == MSP_HD_OPTION_30_16 )
+               if ( s_pMSPCommandData[2] == MSP_HD_OPTION_30_16 )
                {
                   s_PHTMSP.uCols = 30;
                   s_PHTMSP.uRows = 16;
                }
-               if ( s_uMSPCommandData[2] == MSP_HD_OPTION_60_22 )
+               if ( s_pMSPCommandData[2] == MSP_HD_OPTION_60_22 )
                {
                   s_PHTMSP.uCols = 60;
                   s_PHTMSP.uRows = 22;
@@ -248,7 +251,7 @@ void _parse_msp_osd_command()
       default: break;
    }
 
-   _add_msp_data_to_output(s_uMSPRawStream, s_iMSPRawStreamFilledBytes, bSendNow);
+   _add_msp_data_to_output(s_pMSPRawFrame, s_iMSPRawFrameLength, bSendNow);
 }
 
 void _parse_msp_command()
@@ -261,13 +264,13 @@ void _parse_msp_command()
       case MSP_CMD_FC_VARIANT:
          {
             char szBuff[5];
-            strncpy(szBuff, (char*)s_uMSPCommandData, 4);
-            szBuff[4] = 0;
+            memset(szBuff, 0, sizeof(szBuff));
+            memcpy(szBuff, s_pMSPCommandData, (s_iMSPCommandDataSize < 4)?s_iMSPCommandDataSize:4);
             log_line("[Telem] Got MSP FC variant: (%s)", szBuff);
             s_PHTMSP.uFlags &= ~MSP_FLAGS_FC_TYPE_MASK;
-            if ( strncmp("BTFL", (char*)s_uMSPCommandData, s_iMSPCommandDataSize) == 0 )
+            if ( strncmp("BTFL", (const char*)s_pMSPCommandData, s_iMSPCommandDataSize) == 0 )
                s_PHTMSP.uFlags |= MSP_FLAGS_FC_TYPE_BETAFLIGHT;
-            else if ( strncmp("ARDU", (char*)s_uMSPCommandData, s_iMSPCommandDataSize) == 0 )
+            else if ( strncmp("ARDU", (const char*)s_pMSPCommandData, s_iMSPCommandDataSize) == 0 )
                s_PHTMSP.uFlags |= MSP_FLAGS_FC_TYPE_ARDUPILOT;
             else // "INAV"
                s_PHTMSP.uFlags |= MSP_FLAGS_FC_TYPE_INAV;
@@ -280,7 +283,7 @@ void _parse_msp_command()
          {
             s_bMSPGotFCInfo = true;
             for( int i=0; i<s_iMSPCommandDataSize; i++ )
-               log_line("[Telem] Got MSP API version, byte[%d]=%d", i, s_uMSPCommandData[i]);
+               log_line("[Telem] Got MSP API version, byte[%d]=%d", i, s_pMSPCommandData[i]);
             u8 uBuffer[2];
             uBuffer[0] = 60;
             uBuffer[1] = 22;
@@ -291,97 +294,24 @@ void _parse_msp_command()
    }
 }
 
+static void _telemetry_msp_on_frame(const t_msp_bulk_frame* pFrame, void* pContext)
+{
+   s_pMSPRawFrame = pFrame->pData;
+   s_iMSPRawFrameLength = pFrame->iLength;
+   s_iMSPDirection = (pFrame->uDirection == '>') ? MSP_DIR_FROM_FC : MSP_DIR_TO_FC;
+   s_iMSPCommandDataSize = pFrame->iPayloadLength;
+   s_uMSPCommand = pFrame->uCommand;
+   s_pMSPCommandData = pFrame->pPayload;
+   s_uLastMSPCommandReceivedTime = g_TimeNow;
+   if ( s_uMSPCommand == MSP_CMD_DISPLAYPORT )
+      _parse_msp_osd_command();
+   else
+      _parse_msp_command();
+}
+
 bool telemetry_msp_on_new_serial_data(u8* pData, int iDataLength)
 {
    if ( (NULL == pData) || (iDataLength <= 0) )
       return false;
-   
-   for( int i=0; i<iDataLength; i++ )
-   {
-      s_uMSPRawStream[s_iMSPRawStreamFilledBytes] = *pData;
-      s_iMSPRawStreamFilledBytes++;
-      if ( s_iMSPRawStreamFilledBytes >= 256 )
-         s_iMSPRawStreamFilledBytes = 0;
-
-      switch(s_iMSPState)
-      {
-         case MSP_STATE_NONE:
-         case MSP_STATE_ERROR:
-            s_iMSPRawStreamFilledBytes = 0;
-            if ( *pData == '$' )
-            {
-               s_uMSPRawStream[0] = *pData;
-               s_iMSPRawStreamFilledBytes = 1;
-               s_iMSPState = MSP_STATE_WAIT_HEADER;
-            }
-            break;
-
-         case MSP_STATE_WAIT_HEADER:
-            if ( *pData == 'M' )
-               s_iMSPState = MSP_STATE_WAIT_DIR;
-            else
-            {
-               s_iMSPState = MSP_STATE_ERROR;
-            }
-            break;
-
-         case MSP_STATE_WAIT_DIR:
-            if ( *pData == '<' )
-            {
-               s_iMSPState = MSP_STATE_WAIT_SIZE;
-               s_iMSPDirection = MSP_DIR_TO_FC;
-            }
-            else if ( *pData == '>' )
-            {
-               s_iMSPState = MSP_STATE_WAIT_SIZE;
-               s_iMSPDirection = MSP_DIR_FROM_FC;
-            }
-            else
-            {
-               s_iMSPState = MSP_STATE_NONE;
-            }
-            break;
-
-         case MSP_STATE_WAIT_SIZE:
-            s_iMSPCommandDataSize = (int) *pData;
-            s_uMSPChecksum = *pData;
-            s_iMSPState = MSP_STATE_WAIT_TYPE;
-            break;
-
-         case MSP_STATE_WAIT_TYPE:
-            s_uMSPCommand = *pData;
-            s_uMSPChecksum ^= *pData;
-            s_iMSPParsedDataSize = 0;
-            if ( s_iMSPCommandDataSize > 0 )
-               s_iMSPState = MSP_STATE_PARSE_DATA;
-            else
-               s_iMSPState = MSP_STATE_WAIT_CHECKSUM;
-            break;
-
-         case MSP_STATE_PARSE_DATA:
-            s_uMSPCommandData[s_iMSPParsedDataSize] = *pData;
-            s_iMSPParsedDataSize++;
-            s_uMSPChecksum ^= *pData;
-            if ( s_iMSPParsedDataSize >= s_iMSPCommandDataSize )
-               s_iMSPState = MSP_STATE_WAIT_CHECKSUM;
-            break;
-
-         case MSP_STATE_WAIT_CHECKSUM:
-            if ( s_uMSPChecksum == *pData )
-            {
-               s_uLastMSPCommandReceivedTime = g_TimeNow;
-               if ( s_uMSPCommand == MSP_CMD_DISPLAYPORT )
-                  _parse_msp_osd_command();
-               else
-                  _parse_msp_command();
-            }
-            s_iMSPState = MSP_STATE_NONE;
-            break;
-
-         default:
-            break;
-      }
-      pData++;
-   }
-   return false;
+   return msp_bulk_parse(&s_MSPBulkParser, pData, iDataLength) > 0;
 }
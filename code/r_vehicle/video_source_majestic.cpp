@@ -46,6 +46,7 @@
 #include <sys/socket.h> 
 #include <getopt.h>
 #include <poll.h>
+#include <linux/net_tstamp.h>
 
 #include "video_source_majestic.h"
 #include "events.h"
@@ -62,12 +63,37 @@ int s_iInputVideoStreamUDPPort = 5600;
 u32 s_uTimeStartVideoInput = 0;
 bool s_bLogStartOfInputVideoData = true;
 
-u8 s_uInputVideoUDPBuffer[MAX_PACKET_TOTAL_SIZE];
+// Ring of received RTP datagrams. It is filled by a single recvmmsg call when empty, then each
+// video_source_majestic_read call parses the next datagram from it.
+#define MAJESTIC_RECV_BATCH_SIZE 32
+#define MAJESTIC_RECV_CONTROL_SIZE (CMSG_SPACE(sizeof(u32)) + CMSG_SPACE(3*sizeof(struct timespec)))
+
+typedef struct
+{
+   u8 uControl[MAJESTIC_RECV_CONTROL_SIZE] __attribute__((aligned(8))); // SO_RXQ_OVFL, kernel rx timestamp
+   u8 uData[MAX_PACKET_TOTAL_SIZE];
+   int iDataLength;
+   u32 uCaptureTimeMicros; // kernel rx time, converted to get_current_timestamp_micros() time
+} type_majestic_recv_buffer;
+
+type_majestic_recv_buffer s_MajesticRecvBuffers[MAJESTIC_RECV_BATCH_SIZE];
+struct mmsghdr s_MajesticRecvMsgs[MAJESTIC_RECV_BATCH_SIZE];
+struct iovec s_MajesticRecvIOVecs[MAJESTIC_RECV_BATCH_SIZE];
+int s_iMajesticRecvCount = 0;
+int s_iMajesticRecvNextIndex = 0;
+// 0: no kernel timestamps, 1: SO_TIMESTAMPING, 2: SO_TIMESTAMPNS
+int s_iMajesticRecvTimestampingMode = 0;
+u32 s_uLastReadCaptureTimeMicros = 0;
+
 u8 s_uOutputUDPNALFrameSegment[MAX_PACKET_TOTAL_SIZE];
 
 u32 s_uDebugTimeLastUDPVideoInputCheck = 0;
 u32 s_uDebugUDPInputBytes = 0;
 u32 s_uDebugUDPInputReads = 0;
+u32 s_uDebugUDPInputBatches = 0;
+int s_iDebugUDPInputMaxBatch = 0;
+u32 s_uDebugUDPInputKernelDelaySumMicros = 0;
+u32 s_uDebugUDPInputKernelDelayMaxMicros = 0;
 
 bool s_bRequestedVideoMajesticCaptureUpdate = false;
 u32 s_uRequestedVideoMajesticCaptureUpdateReason = 0;
@@ -193,6 +219,8 @@ void video_source_majestic_close()
    else
       log_line("[VideoSourceUDP] No input UDP socket to close.");
    s_fInputVideoStreamUDPSocket = -1;
+   s_iMajesticRecvCount = 0;
+   s_iMajesticRecvNextIndex = 0;
 }
 
 int video_source_majestic_open(int iUDPPort)
@@ -217,6 +245,17 @@ int video_source_majestic_open(int iUDPPort)
 
    if ( 0 != setsockopt(s_fInputVideoStreamUDPSocket, SOL_SOCKET, SO_RXQ_OVFL, (const void *)&optval , sizeof(optval)) )
        log_softerror_and_alarm("[VideoSourceUDP] Unable to set SO_RXQ_OVFL: %s", strerror(errno));
+
+   // Kernel rx timestamps: hardware ones if the interface has them, software ones otherwise
+   s_iMajesticRecvTimestampingMode = 0;
+   int iTimestampingFlags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+   if ( 0 == setsockopt(s_fInputVideoStreamUDPSocket, SOL_SOCKET, SO_TIMESTAMPING, (const void *)&iTimestampingFlags, sizeof(iTimestampingFlags)) )
+      s_iMajesticRecvTimestampingMode = 1;
+   else if ( 0 == setsockopt(s_fInputVideoStreamUDPSocket, SOL_SOCKET, SO_TIMESTAMPNS, (const void *)&optval, sizeof(optval)) )
+      s_iMajesticRecvTimestampingMode = 2;
+   else
+      log_softerror_and_alarm("[VideoSourceUDP] Unable to enable kernel rx timestamps: %s", strerror(errno));
+   log_line("[VideoSourceUDP] Kernel rx timestamps: %s", (1 == s_iMajesticRecvTimestampingMode)?"SO_TIMESTAMPING":((2 == s_iMajesticRecvTimestampingMode)?"SO_TIMESTAMPNS":"none"));
    
    int iRecvSize = 0;
    socklen_t iParamLen = sizeof(iRecvSize);
@@ -245,6 +284,8 @@ int video_source_majestic_open(int iUDPPort)
       return -1;
    }
    s_uTimeStartVideoInput = g_TimeNow;
+   s_iMajesticRecvCount = 0;
+   s_iMajesticRecvNextIndex = 0;
 
    log_line("[VideoSourceUDP] Opened read socket on port %d for reading video stream. socket fd = %d", s_iInputVideoStreamUDPPort, s_fInputVideoStreamUDPSocket);
    
@@ -305,18 +346,68 @@ void video_source_majestic_request_update_program(u32 uChangeReason)
    s_uRequestedVideoMajesticCaptureUpdateReason = uChangeReason;
 }
 
-uint32_t extract_udp_rxq_overflow(struct msghdr *msg)
+// Returns true if the control data has a kernel rx timestamp
+
+bool _video_source_majestic_parse_recv_control(struct msghdr* pMsg, u32* puRxqOverflow, struct timespec* pTimestamp)
+{
+   bool bHasTimestamp = false;
+   for( struct cmsghdr* pCMsg = CMSG_FIRSTHDR(pMsg); NULL != pCMsg; pCMsg = CMSG_NXTHDR(pMsg, pCMsg) )
+   {
+      if ( pCMsg->cmsg_level != SOL_SOCKET )
+         continue;
+      if ( pCMsg->cmsg_type == SO_RXQ_OVFL )
+         memcpy(puRxqOverflow, CMSG_DATA(pCMsg), sizeof(u32));
+      else if ( pCMsg->cmsg_type == SCM_TIMESTAMPNS )
+      {
+         memcpy(pTimestamp, CMSG_DATA(pCMsg), sizeof(struct timespec));
+         bHasTimestamp = true;
+      }
+      else if ( pCMsg->cmsg_type == SCM_TIMESTAMPING )
+      {
+         // Software timestamp, unused, raw hardware timestamp
+         struct timespec tStamps[3];
+         memcpy(tStamps, CMSG_DATA(pCMsg), sizeof(tStamps));
+         if ( (0 != tStamps[2].tv_sec) || (0 != tStamps[2].tv_nsec) )
+            *pTimestamp = tStamps[2];
+         else
+            *pTimestamp = tStamps[0];
+         bHasTimestamp = (0 != pTimestamp->tv_sec) || (0 != pTimestamp->tv_nsec);
+      }
+   }
+   return bHasTimestamp;
+}
+
+void _video_source_majestic_on_rxq_overflow(u32 uCurrentRxqOverflow)
 {
-    struct cmsghdr *cmsg;
-    uint32_t rtn;
-
-    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
-        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
-            memcpy(&rtn, CMSG_DATA(cmsg), sizeof(rtn));
-            return rtn;
-        }
-    }
-    return 0;
+   static u32 s_uLastRxqOverflow = 0;
+   if ( uCurrentRxqOverflow == s_uLastRxqOverflow )
+      return;
+
+   u32 uDroppedCount = uCurrentRxqOverflow - s_uLastRxqOverflow;
+   log_softerror_and_alarm("[VideoSourceUDP] UDP rxq overflow: %u packets dropped (from %u to %u)", uDroppedCount, s_uLastRxqOverflow, uCurrentRxqOverflow);
+   
+   if ( g_TimeNow > s_uLastAlarmUDPOveflowTimestamp + 10000 )
+   if ( g_TimeNow > g_TimeStart + 10000 )
+   if ( g_TimeNow > s_uLastTimeMajesticUpdate + 3000 )
+   {
+      s_uLastAlarmUDPOveflowTimestamp = g_TimeNow;
+      u32 uFlags2 = 0;
+      u32 uDelta = s_uLastVideoSourceReadTimestamps[0] - s_uLastVideoSourceReadTimestamps[1];
+      if ( uDelta > 255 )
+         uDelta = 255;
+      uFlags2 |= uDelta & 0xFF;
+      uDelta = s_uLastVideoSourceReadTimestamps[1] - s_uLastVideoSourceReadTimestamps[2];
+      if ( uDelta > 255 )
+         uDelta = 255;
+      uFlags2 |= (uDelta & 0xFF) << 8;
+      uDelta = s_uLastVideoSourceReadTimestamps[2] - s_uLastVideoSourceReadTimestamps[3];
+      if ( uDelta > 255 )
+         uDelta = 255;
+      uFlags2 |= (uDelta & 0xFF) << 16;
+      
+      send_alarm_to_controller(ALARM_ID_VIDEO_CAPTURE_MALFUNCTION, 0x0002 | ((uDroppedCount & 0xFF) << 8), uFlags2, 5);
+   }
+   s_uLastRxqOverflow = uCurrentRxqOverflow;
 }
 
 void video_source_majestic_set_keyframe_value(float fGOP)
@@ -357,16 +448,18 @@ void video_source_majestic_set_qpdelta_value(int iqpdelta)
    s_uLastTimeMajesticUpdate = g_TimeNow;
 }
 
+// Fills the ring of received datagrams. Returns the number of datagrams received, 0 if none, -1 on error.
+
 int _video_source_majestic_try_read_input_udp_data(bool bAsync)
 {
    if ( -1 == s_fInputVideoStreamUDPSocket )
       return -1;
 
-   int nRecvBytes = 0;
+   s_iMajesticRecvCount = 0;
+   s_iMajesticRecvNextIndex = 0;
+
    if ( bAsync )
    {
-      static uint8_t cmsgbuf[CMSG_SPACE(sizeof(uint32_t))];
-
       static int nfds = 1;
       static struct pollfd fds[2];
       static bool s_bFirstVideoUDPReadSetup = true;
@@ -400,23 +493,24 @@ int _video_source_majestic_try_read_input_udp_data(bool bAsync)
       }
       if ( ! (fds[0].revents & POLLIN) )
          return 0;
-    
-      struct iovec iov = { .iov_base = (void*)s_uInputVideoUDPBuffer,
-                                            .iov_len = sizeof(s_uInputVideoUDPBuffer) };
-      struct msghdr msghdr = { .msg_name = NULL,
-                               .msg_namelen = 0,
-                               .msg_iov = &iov,
-                               .msg_iovlen = 1,
-                               .msg_control = &cmsgbuf,
-                               .msg_controllen = sizeof(cmsgbuf),
-                               .msg_flags = 0 };
-
-      memset(cmsgbuf, '\0', sizeof(cmsgbuf));
-
-      nRecvBytes = recvmsg(s_fInputVideoStreamUDPSocket, &msghdr, 0);
-      if ( nRecvBytes < 0 )
+
+      for( int i=0; i<MAJESTIC_RECV_BATCH_SIZE; i++ )
+      {
+         s_MajesticRecvIOVecs[i].iov_base = s_MajesticRecvBuffers[i].uData;
+         s_MajesticRecvIOVecs[i].iov_len = sizeof(s_MajesticRecvBuffers[i].uData);
+         memset(&s_MajesticRecvMsgs[i], 0, sizeof(struct mmsghdr));
+         s_MajesticRecvMsgs[i].msg_hdr.msg_iov = &s_MajesticRecvIOVecs[i];
+         s_MajesticRecvMsgs[i].msg_hdr.msg_iovlen = 1;
+         s_MajesticRecvMsgs[i].msg_hdr.msg_control = s_MajesticRecvBuffers[i].uControl;
+         s_MajesticRecvMsgs[i].msg_hdr.msg_controllen = sizeof(s_MajesticRecvBuffers[i].uControl);
+      }
+
+      int iCountMsgs = recvmmsg(s_fInputVideoStreamUDPSocket, s_MajesticRecvMsgs, MAJESTIC_RECV_BATCH_SIZE, MSG_DONTWAIT, NULL);
+      if ( iCountMsgs < 0 )
       {
-         log_softerror_and_alarm("[VideoSourceUDP] Failed to recvmsg from UDP socket, error: %s", strerror(errno));
+         if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+            return 0;
+         log_softerror_and_alarm("[VideoSourceUDP] Failed to recvmmsg from UDP socket, error: %s", strerror(errno));
          return -1;
       }
 
@@ -424,42 +518,52 @@ int _video_source_majestic_try_read_input_udp_data(bool bAsync)
          s_uLastVideoSourceReadTimestamps[i] = s_uLastVideoSourceReadTimestamps[i-1];
       s_uLastVideoSourceReadTimestamps[0] = g_TimeNow;
 
-      if ( nRecvBytes > MAX_PACKET_TOTAL_SIZE )
-      {
-         log_softerror_and_alarm("[VideoSourceUDP] Read too much data %d bytes from UDP socket", nRecvBytes);
-         nRecvBytes = MAX_PACKET_TOTAL_SIZE;
-      }
+      // Kernel timestamps are CLOCK_REALTIME; move them to the local micros clock using their age
+      struct timespec tRealTimeNow;
+      clock_gettime(CLOCK_REALTIME, &tRealTimeNow);
+      u32 uTimeNowMicros = get_current_timestamp_micros();
 
-      static uint32_t rxq_overflow = 0;
-      uint32_t cur_rxq_overflow = extract_udp_rxq_overflow(&msghdr);
-      if (cur_rxq_overflow != rxq_overflow)
+      u32 uRxqOverflow = 0;
+      bool bHasRxqOverflow = false;
+      for( int i=0; i<iCountMsgs; i++ )
       {
-          u32 uDroppedCount = cur_rxq_overflow - rxq_overflow;
-          log_softerror_and_alarm("[VideoSourceUDP] UDP rxq overflow: %u packets dropped (from %u to %u)", uDroppedCount, rxq_overflow, cur_rxq_overflow);
-          
-          if ( g_TimeNow > s_uLastAlarmUDPOveflowTimestamp + 10000 )
-          if ( g_TimeNow > g_TimeStart + 10000 )
-          if ( g_TimeNow > s_uLastTimeMajesticUpdate + 3000 )
-          {
-             s_uLastAlarmUDPOveflowTimestamp = g_TimeNow;
-             u32 uFlags2 = 0;
-             u32 uDelta = s_uLastVideoSourceReadTimestamps[0] - s_uLastVideoSourceReadTimestamps[1];
-             if ( uDelta > 255 )
-                uDelta = 255;
-             uFlags2 |= uDelta & 0xFF;
-             uDelta = s_uLastVideoSourceReadTimestamps[1] - s_uLastVideoSourceReadTimestamps[2];
-             if ( uDelta > 255 )
-                uDelta = 255;
-             uFlags2 |= (uDelta & 0xFF) << 8;
-             uDelta = s_uLastVideoSourceReadTimestamps[2] - s_uLastVideoSourceReadTimestamps[3];
-             if ( uDelta > 255 )
-                uDelta = 255;
-             uFlags2 |= (uDelta & 0xFF) << 16;
-             
-             send_alarm_to_controller(ALARM_ID_VIDEO_CAPTURE_MALFUNCTION, 0x0002 | ((uDroppedCount & 0xFF) << 8), uFlags2, 5);
-          }
-          rxq_overflow = cur_rxq_overflow;
+         type_majestic_recv_buffer* pBuffer = &s_MajesticRecvBuffers[i];
+         pBuffer->iDataLength = (int)s_MajesticRecvMsgs[i].msg_len;
+         if ( s_MajesticRecvMsgs[i].msg_hdr.msg_flags & MSG_TRUNC )
+         {
+            log_softerror_and_alarm("[VideoSourceUDP] Read too much data %d bytes from UDP socket", pBuffer->iDataLength);
+            pBuffer->iDataLength = MAX_PACKET_TOTAL_SIZE;
+         }
+         pBuffer->uCaptureTimeMicros = uTimeNowMicros;
+
+         struct timespec tKernelTime;
+         u32 uOverflow = 0;
+         if ( _video_source_majestic_parse_recv_control(&s_MajesticRecvMsgs[i].msg_hdr, &uOverflow, &tKernelTime) )
+         {
+            long long lAgeMicros = (tRealTimeNow.tv_sec - tKernelTime.tv_sec)*1000LL*1000LL + (tRealTimeNow.tv_nsec - tKernelTime.tv_nsec)/1000LL;
+            // Ignore it on wall clock changes
+            if ( (lAgeMicros >= 0) && (lAgeMicros < 1000000) )
+            {
+               pBuffer->uCaptureTimeMicros = uTimeNowMicros - (u32)lAgeMicros;
+               s_uDebugUDPInputKernelDelaySumMicros += (u32)lAgeMicros;
+               if ( (u32)lAgeMicros > s_uDebugUDPInputKernelDelayMaxMicros )
+                  s_uDebugUDPInputKernelDelayMaxMicros = (u32)lAgeMicros;
+            }
+         }
+         // The counter is only present once the queue overflowed at least once
+         if ( 0 != uOverflow )
+         {
+            uRxqOverflow = uOverflow;
+            bHasRxqOverflow = true;
+         }
       }
+      if ( bHasRxqOverflow )
+         _video_source_majestic_on_rxq_overflow(uRxqOverflow);
+
+      s_iMajesticRecvCount = iCountMsgs;
+      s_uDebugUDPInputBatches++;
+      if ( iCountMsgs > s_iDebugUDPInputMaxBatch )
+         s_iDebugUDPInputMaxBatch = iCountMsgs;
    }
    else
    {
@@ -491,7 +595,7 @@ int _video_source_majestic_try_read_input_udp_data(bool bAsync)
       client_addr.sin_addr.s_addr = INADDR_ANY;
       client_addr.sin_port = htons( s_iInputVideoStreamUDPPort );
 
-      nRecvBytes = recvfrom(s_fInputVideoStreamUDPSocket, s_uInputVideoUDPBuffer, sizeof(s_uInputVideoUDPBuffer)/sizeof(s_uInputVideoUDPBuffer[0]), 
+      int nRecvBytes = recvfrom(s_fInputVideoStreamUDPSocket, s_MajesticRecvBuffers[0].uData, sizeof(s_MajesticRecvBuffers[0].uData), 
                 MSG_WAITALL, ( struct sockaddr *) &client_addr,
                 &len);
       //int nRecv = recv(socket_server, szBuff, 1024, )
@@ -502,8 +606,11 @@ int _video_source_majestic_try_read_input_udp_data(bool bAsync)
       }
       if ( nRecvBytes == 0 )
          return 0;
+      s_MajesticRecvBuffers[0].iDataLength = nRecvBytes;
+      s_MajesticRecvBuffers[0].uCaptureTimeMicros = get_current_timestamp_micros();
+      s_iMajesticRecvCount = 1;
    }
-   return nRecvBytes;
+   return s_iMajesticRecvCount;
 }
 
 // Parse input raw bytes and returns a NAL packet (in s_uOutputUDPNALFrameSegment)
@@ -671,7 +778,14 @@ u8* video_source_majestic_read(int* piReadSize, bool bAsync)
 
    *piReadSize = 0;
 
-   int iRecvBytes = _video_source_majestic_try_read_input_udp_data(bAsync);
+   // Parse the datagrams already received before reading the socket again
+   if ( s_iMajesticRecvNextIndex >= s_iMajesticRecvCount )
+   if ( _video_source_majestic_try_read_input_udp_data(bAsync) <= 0 )
+      return NULL;
+
+   type_majestic_recv_buffer* pBuffer = &s_MajesticRecvBuffers[s_iMajesticRecvNextIndex];
+   s_iMajesticRecvNextIndex++;
+   int iRecvBytes = pBuffer->iDataLength;
    if ( iRecvBytes <= 0 )
       return NULL;
 
@@ -684,7 +798,8 @@ u8* video_source_majestic_read(int* piReadSize, bool bAsync)
    s_uDebugUDPInputReads++;
 
    //log_line("DEBUG recv %d bytes from camera", iRecvBytes);
-   int iOutputBytes = _video_source_majestic_parse_rtp_data(s_uInputVideoUDPBuffer, iRecvBytes);
+   int iOutputBytes = _video_source_majestic_parse_rtp_data(pBuffer->uData, iRecvBytes);
+   s_uLastReadCaptureTimeMicros = pBuffer->uCaptureTimeMicros;
    static int siMinP = 10000;
    static int siMaxP = 0;
    if ( iOutputBytes > siMaxP )
@@ -698,6 +813,16 @@ u8* video_source_majestic_read(int* piReadSize, bool bAsync)
    return s_uOutputUDPNALFrameSegment;
 }
 
+u32 video_source_majestic_last_read_capture_time_micros()
+{
+   return s_uLastReadCaptureTimeMicros;
+}
+
+int video_source_majestic_get_pending_reads()
+{
+   return s_iMajesticRecvCount - s_iMajesticRecvNextIndex;
+}
+
 bool video_source_majestic_last_read_is_single_nal()
 {
    return s_bLastReadIsSingleNAL;
@@ -833,12 +958,17 @@ void video_source_majestic_periodic_checks()
       char szBitrate[64];
       str_format_bitrate(s_uDebugUDPInputBytes/10*8, szBitrate);
 
-      log_line("[VideoSourceUDP] Input video data: %u bytes/sec, %s, %u reads/sec",
-         s_uDebugUDPInputBytes/10, szBitrate, s_uDebugUDPInputReads/10);
+      log_line("[VideoSourceUDP] Input video data: %u bytes/sec, %s, %u reads/sec, %u recv batches/sec (max %d datagrams), kernel to recv delay: avg %u us, max %u us",
+         s_uDebugUDPInputBytes/10, szBitrate, s_uDebugUDPInputReads/10, s_uDebugUDPInputBatches/10, s_iDebugUDPInputMaxBatch,
+         (s_uDebugUDPInputReads > 0)?(s_uDebugUDPInputKernelDelaySumMicros/s_uDebugUDPInputReads):0, s_uDebugUDPInputKernelDelayMaxMicros);
       s_uDebugTimeLastUDPVideoInputCheck = g_TimeNow;
       // To fix log_line("[VideoSourceUDP] Detected video stream fps: %d, slices: %d", (int)s_ParserH264CameraOutput.getDetectedFPS(), s_ParserH264CameraOutput.getDetectedSlices());
       s_uDebugUDPInputBytes = 0;
       s_uDebugUDPInputReads = 0;
+      s_uDebugUDPInputBatches = 0;
+      s_iDebugUDPInputMaxBatch = 0;
+      s_uDebugUDPInputKernelDelaySumMicros = 0;
+      s_uDebugUDPInputKernelDelayMaxMicros = 0;
    }
 
    if ( g_TimeNow > s_uTimeLastCheckMajestic + 5000 )
@@ -14,10 +14,15 @@ void video_source_majestic_set_keyframe_value(float fGOP);
 void video_source_majestic_set_videobitrate_value(u32 uBitrate);
 void video_source_majestic_set_qpdelta_value(int iqpdelta);
 
-// Returns the buffer and number of bytes read
+// Returns the buffer and number of bytes read (one RTP datagram parsed). The socket is read in
+// batches (recvmmsg), so most calls only parse an already received datagram.
 u8* video_source_majestic_read(int* piReadSize, bool bAsync);
 bool video_source_majestic_last_read_is_single_nal();
 bool video_source_majestic_last_read_is_end_nal();
 bool video_source_majestic_is_inside_iframe();
 bool video_source_majestic_las_read_is_picture_frame();
+// Kernel rx time of the datagram of the last read, in get_current_timestamp_micros() time
+u32 video_source_majestic_last_read_capture_time_micros();
+// Datagrams already received and not yet parsed
+int video_source_majestic_get_pending_reads();
 void video_source_majestic_periodic_checks();
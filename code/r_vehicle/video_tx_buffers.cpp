@@ -33,11 +33,15 @@
 #include "timers.h"
 #include "packets_utils.h"
 #include "../radio/fec.h"
+#include "../radio/radiolink.h"
+#include "../radio/radio_pacer.h"
 #include "adaptive_video.h"
 #include "processor_tx_video.h"
 #include "processor_relay.h"
 
 #define MAX_PACKETS_TO_SEND_IN_ONE_SLICE 40
+// Sent blocks kept for retransmissions, on top of the ones needed for the retransmission window
+#define MIN_RETRANSMISSION_WINDOW_BLOCKS 8
 
 typedef struct
 {
@@ -64,14 +68,17 @@ VideoTxPacketsBuffer::VideoTxPacketsBuffer(int iVideoStreamIndex, int iCameraInd
    m_iVideoStreamIndex = iVideoStreamIndex;
    m_iCameraIndex = iCameraIndex;
 
+   packet_pool_init(&m_PacketsPool, RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE, 0);
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
-   for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
    {
-      m_VideoPackets[i][k].pRawData = NULL;
-      m_VideoPackets[i][k].pPH = NULL;
-      m_VideoPackets[i][k].pPHVF = NULL;
-      m_VideoPackets[i][k].pVideoData = NULL;
+      m_VideoBlocks[i].uAllocatedMask = 0;
+      for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
+      {
+         m_VideoBlocks[i].uPacketSlots[k] = PACKET_POOL_INVALID_SLOT;
+         m_VideoBlocks[i].uTimeReadyMicros[k] = 0;
+      }
    }
+   m_iRetransmissionWindowBlocks = MAX_RXTX_BLOCKS_BUFFER;
    m_uCurrentFrameId = 0;
    m_iCurrentBufferIndexToSend = 0;
    m_iCurrentBufferPacketIndexToSend = 0;
@@ -93,16 +100,8 @@ VideoTxPacketsBuffer::~VideoTxPacketsBuffer()
    uninit();
 
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
-   for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
-   {
-      if ( NULL != m_VideoPackets[i][k].pRawData )
-         free(m_VideoPackets[i][k].pRawData);
-
-      m_VideoPackets[i][k].pRawData = NULL;
-      m_VideoPackets[i][k].pPH = NULL;
-      m_VideoPackets[i][k].pPHVF = NULL;
-      m_VideoPackets[i][k].pVideoData = NULL;
-   }
+      _releaseBlock(i);
+   packet_pool_uninit(&m_PacketsPool);
 
    m_siVideoBuffersInstancesCount--;
 }
@@ -123,6 +122,7 @@ bool VideoTxPacketsBuffer::init(Model* pModel)
    updateVideoHeader(pModel);
    
    m_iTempVideoBufferFilledBytes = 0;
+   m_uTempVideoBufferCaptureTimeMicros = 0;
    m_iNextBufferIndexToFill = 0;
    m_iNextBufferPacketIndexToFill = 0;
    m_iCurrentBufferIndexToSend = 0;
@@ -139,6 +139,7 @@ bool VideoTxPacketsBuffer::uninit()
       return true;
 
    log_line("[VideoTXBuffer] Uninitialize video Tx buffer instance number %d.", m_iInstanceIndex+1);
+   packet_pool_log_info(&m_PacketsPool, "VideoTXBuffer");
    
    m_bInitialized = false;
    return true;
@@ -150,37 +151,145 @@ void VideoTxPacketsBuffer::discardBuffer()
    m_uNextVideoBlockPacketIndexToGenerate = 0;
    
    m_iTempVideoBufferFilledBytes = 0;
+   m_uTempVideoBufferCaptureTimeMicros = 0;
    m_iNextBufferIndexToFill = 0;
    m_iNextBufferPacketIndexToFill = 0;
    m_iCurrentBufferIndexToSend = 0;
    m_iCurrentBufferPacketIndexToSend = 0;
    m_iCountReadyToSend = 0;
+
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+      _releaseBlock(i);
    
    log_softerror_and_alarm("[VideoTXBuffer] Discarded buffer");
 }
 
 
-void VideoTxPacketsBuffer::_checkAllocatePacket(int iBufferIndex, int iPacketIndex)
+// Slots fit the largest video packet of the video profiles. The sent blocks are kept for twice the
+// retransmission window of the active profile at its bitrate, to cover the I-frames bursts and the time
+// the retransmission requests take to arrive.
+void VideoTxPacketsBuffer::_updatePacketsPool(Model* pModel, int iVideoProfile, int iDataPackets)
+{
+   int iMaxVideoDataLength = 0;
+   for( int i=0; i<MAX_VIDEO_LINK_PROFILES; i++ )
+   {
+      if ( pModel->video_link_profiles[i].video_data_length > iMaxVideoDataLength )
+         iMaxVideoDataLength = pModel->video_link_profiles[i].video_data_length;
+   }
+   int iSlotSize = RADIO_PACKET_HEADROOM + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98) + sizeof(t_packet_header_video_full_98_debug_info) + iMaxVideoDataLength;
+   if ( iSlotSize > RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE )
+      iSlotSize = RADIO_PACKET_HEADROOM + MAX_PACKET_TOTAL_SIZE;
+
+   // Bigger packets need new slots; smaller ones only while the pool is not used
+   if ( (iSlotSize > m_PacketsPool.iSlotSize) || ((0 == m_PacketsPool.iUsedSlots) && (iSlotSize + PACKET_POOL_SLOT_ALIGNMENT <= m_PacketsPool.iSlotSize)) )
+   {
+      log_line("[VideoTXBuffer] Packets pool slot size changes from %d to %d bytes.", m_PacketsPool.iSlotSize, iSlotSize);
+      if ( m_PacketsPool.iUsedSlots > 0 )
+         discardBuffer();
+      packet_pool_uninit(&m_PacketsPool);
+      packet_pool_init(&m_PacketsPool, iSlotSize, m_PacketsPool.iReserveSlots);
+   }
+
+   int iWindowMs = ((pModel->video_link_profiles[iVideoProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_MAX_RETRANSMISSION_WINDOW_MASK) >> 8) * 5;
+   u32 uBitrateBPS = pModel->video_link_profiles[iVideoProfile].bitrate_fixed_bps;
+   if ( 0 == uBitrateBPS )
+      uBitrateBPS = DEFAULT_VIDEO_BITRATE;
+   int iBlockBytes = iDataPackets * pModel->video_link_profiles[iVideoProfile].video_data_length;
+   if ( iBlockBytes <= 0 )
+      iBlockBytes = DEFAULT_VIDEO_DATA_LENGTH_HP;
+
+   u64 uWindowBytes = ((u64)uBitrateBPS / 8) * (u64)iWindowMs / 1000;
+   m_iRetransmissionWindowBlocks = (int)(2 * uWindowBytes / iBlockBytes) + MIN_RETRANSMISSION_WINDOW_BLOCKS;
+   if ( m_iRetransmissionWindowBlocks > MAX_RXTX_BLOCKS_BUFFER )
+      m_iRetransmissionWindowBlocks = MAX_RXTX_BLOCKS_BUFFER;
+
+   // Keep two blocks of free slots, so the pool doesn't free and allocate slabs on each block
+   packet_pool_set_reserve(&m_PacketsPool, 2*MAX_TOTAL_PACKETS_IN_BLOCK);
+   log_line("[VideoTXBuffer] Packets pool slot size: %d bytes, retransmission window: %d ms, %d blocks kept after sending",
+      m_PacketsPool.iSlotSize, iWindowMs, m_iRetransmissionWindowBlocks);
+}
+
+bool VideoTxPacketsBuffer::_checkAllocatePacket(int iBufferIndex, int iPacketIndex)
 {
    if ( (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) || (iPacketIndex < 0) || (iPacketIndex >= MAX_TOTAL_PACKETS_IN_BLOCK) )
-      return;
-   if ( NULL != m_VideoPackets[iBufferIndex][iPacketIndex].pRawData )
-      return;
+      return false;
+   if ( m_VideoBlocks[iBufferIndex].uAllocatedMask & (((u64)1) << iPacketIndex) )
+      return true;
 
-   m_VideoPackets[iBufferIndex][iPacketIndex].pRawData = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
-   if ( NULL == m_VideoPackets[iBufferIndex][iPacketIndex].pRawData )
+   // The slot keeps room in front of the packet for the radio headers, so it's sent without copying it
+   u16 uSlot = packet_pool_alloc(&m_PacketsPool);
+   if ( PACKET_POOL_INVALID_SLOT == uSlot )
    {
       log_error_and_alarm("Failed to allocate video buffer at index: [%d/%d]", iPacketIndex, iBufferIndex);
-      return;
+      return false;
    }
-   m_VideoPackets[iBufferIndex][iPacketIndex].pPH = (t_packet_header*)&(m_VideoPackets[iBufferIndex][iPacketIndex].pRawData[0]);
-   m_VideoPackets[iBufferIndex][iPacketIndex].pPHVF = (t_packet_header_video_full_98*)&(m_VideoPackets[iBufferIndex][iPacketIndex].pRawData[sizeof(t_packet_header)]);
-   m_VideoPackets[iBufferIndex][iPacketIndex].pVideoData = &(m_VideoPackets[iBufferIndex][iPacketIndex].pRawData[sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98)]);
+   m_VideoBlocks[iBufferIndex].uPacketSlots[iPacketIndex] = uSlot;
+   m_VideoBlocks[iBufferIndex].uAllocatedMask |= ((u64)1) << iPacketIndex;
+   return true;
+}
+
+void VideoTxPacketsBuffer::_releaseBlock(int iBufferIndex)
+{
+   u64 uMask = m_VideoBlocks[iBufferIndex].uAllocatedMask;
+   while ( uMask )
+   {
+      int iPacketIndex = __builtin_ctzll(uMask);
+      uMask &= uMask - 1;
+      packet_pool_free(&m_PacketsPool, m_VideoBlocks[iBufferIndex].uPacketSlots[iPacketIndex]);
+      m_VideoBlocks[iBufferIndex].uPacketSlots[iPacketIndex] = PACKET_POOL_INVALID_SLOT;
+   }
+   m_VideoBlocks[iBufferIndex].uAllocatedMask = 0;
+}
+
+// Called when a new block is started at m_iNextBufferIndexToFill
+void VideoTxPacketsBuffer::_releaseBlocksOutsideRetransmissionWindow()
+{
+   // Blocks not sent yet are kept, whatever their age
+   int iBlocksToSend = m_iNextBufferIndexToFill - m_iCurrentBufferIndexToSend;
+   if ( iBlocksToSend < 0 )
+      iBlocksToSend += MAX_RXTX_BLOCKS_BUFFER;
+   int iBlocksBack = m_iRetransmissionWindowBlocks;
+   if ( iBlocksBack <= iBlocksToSend )
+      iBlocksBack = iBlocksToSend + 1;
+
+   // Older blocks are already released, up to the first one without packets
+   for( ; iBlocksBack < MAX_RXTX_BLOCKS_BUFFER; iBlocksBack++ )
+   {
+      int iBufferIndex = m_iNextBufferIndexToFill - iBlocksBack;
+      if ( iBufferIndex < 0 )
+         iBufferIndex += MAX_RXTX_BLOCKS_BUFFER;
+      if ( 0 == m_VideoBlocks[iBufferIndex].uAllocatedMask )
+         break;
+      _releaseBlock(iBufferIndex);
+   }
+}
+
+t_packet_header* VideoTxPacketsBuffer::_getPH(int iBufferIndex, int iPacketIndex)
+{
+   if ( ! (m_VideoBlocks[iBufferIndex].uAllocatedMask & (((u64)1) << iPacketIndex)) )
+      return NULL;
+   return (t_packet_header*)(packet_pool_get(&m_PacketsPool, m_VideoBlocks[iBufferIndex].uPacketSlots[iPacketIndex]) + RADIO_PACKET_HEADROOM);
+}
+
+t_packet_header_video_full_98* VideoTxPacketsBuffer::_getPHVF(int iBufferIndex, int iPacketIndex)
+{
+   u8* pPacket = (u8*)_getPH(iBufferIndex, iPacketIndex);
+   if ( NULL == pPacket )
+      return NULL;
+   return (t_packet_header_video_full_98*)(pPacket + sizeof(t_packet_header));
+}
+
+u8* VideoTxPacketsBuffer::_getVideoData(int iBufferIndex, int iPacketIndex)
+{
+   u8* pPacket = (u8*)_getPH(iBufferIndex, iPacketIndex);
+   if ( NULL == pPacket )
+      return NULL;
+   return pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98);
 }
 
 void VideoTxPacketsBuffer::_fillVideoPacketHeaders(int iBufferIndex, int iPacketIndex, int iVideoSize, bool bEndOfFrame, bool bIsInsideIFrame)
 {
-   t_packet_header* pCurrentPacketHeader = m_VideoPackets[iBufferIndex][iPacketIndex].pPH;
+   t_packet_header* pCurrentPacketHeader = _getPH(iBufferIndex, iPacketIndex);
    memcpy(pCurrentPacketHeader, &m_PacketHeader, sizeof(t_packet_header));
 
    pCurrentPacketHeader->total_length = sizeof(t_packet_header)+sizeof(t_packet_header_video_full_98);
@@ -188,7 +297,7 @@ void VideoTxPacketsBuffer::_fillVideoPacketHeaders(int iBufferIndex, int iPacket
    if ( m_PacketHeaderVideo.uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
       pCurrentPacketHeader->total_length += sizeof(t_packet_header_video_full_98_debug_info);
 
-   t_packet_header_video_full_98* pCurrentVideoPacketHeader = m_VideoPackets[iBufferIndex][iPacketIndex].pPHVF;
+   t_packet_header_video_full_98* pCurrentVideoPacketHeader = _getPHVF(iBufferIndex, iPacketIndex);
    memcpy(pCurrentVideoPacketHeader, &m_PacketHeaderVideo, sizeof(t_packet_header_video_full_98));
    pCurrentVideoPacketHeader->uFrameId = m_uCurrentFrameId;
    pCurrentVideoPacketHeader->uCurrentBlockIndex = m_uNextVideoBlockIndexToGenerate;
@@ -253,12 +362,15 @@ void VideoTxPacketsBuffer::updateVideoHeader(Model* pModel)
    m_PacketHeader.vehicle_id_dest = 0;
 
    int iVideoProfile = adaptive_video_get_current_active_video_profile();
+   int iDataPackets = 0;
+   int iECPackets = 0;
+   adaptive_video_get_ec_scheme(iVideoProfile, &iDataPackets, &iECPackets);
 
    if ( 0 == m_iNextBufferPacketIndexToFill )
    {
       m_PacketHeaderVideo.uCurrentBlockPacketSize = pModel->video_link_profiles[iVideoProfile].video_data_length;
-      m_PacketHeaderVideo.uCurrentBlockDataPackets = pModel->video_link_profiles[iVideoProfile].block_packets;
-      m_PacketHeaderVideo.uCurrentBlockECPackets = pModel->video_link_profiles[iVideoProfile].block_fecs;
+      m_PacketHeaderVideo.uCurrentBlockDataPackets = iDataPackets;
+      m_PacketHeaderVideo.uCurrentBlockECPackets = iECPackets;
    
       m_uNextBlockPacketSize = m_PacketHeaderVideo.uCurrentBlockPacketSize;
       m_uNextBlockDataPackets = m_PacketHeaderVideo.uCurrentBlockDataPackets;
@@ -269,8 +381,8 @@ void VideoTxPacketsBuffer::updateVideoHeader(Model* pModel)
    else
    {
       m_uNextBlockPacketSize = pModel->video_link_profiles[iVideoProfile].video_data_length;
-      m_uNextBlockDataPackets = pModel->video_link_profiles[iVideoProfile].block_packets;
-      m_uNextBlockECPackets = pModel->video_link_profiles[iVideoProfile].block_fecs;
+      m_uNextBlockDataPackets = iDataPackets;
+      m_uNextBlockECPackets = iECPackets;
       log_line("[VideoTXBuffer] Next EC scheme to use: %d/%d (%d bytes)", m_uNextBlockDataPackets, m_uNextBlockECPackets, m_uNextBlockPacketSize);
    }
 
@@ -294,6 +406,20 @@ void VideoTxPacketsBuffer::updateVideoHeader(Model* pModel)
    m_PacketHeaderVideo.uVideoStatusFlags2 = 0;
    if ( pModel->bDeveloperMode )
       m_PacketHeaderVideo.uVideoStatusFlags2 |= VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS;
+
+   _updatePacketsPool(pModel, iVideoProfile, iDataPackets);
+}
+
+void VideoTxPacketsBuffer::setECScheme(int iDataPackets, int iECPackets)
+{
+   if ( (iDataPackets <= 0) || (iECPackets < 0) || (iDataPackets > MAX_DATA_PACKETS_IN_BLOCK) || (iECPackets > MAX_FECS_PACKETS_IN_BLOCK) || (iDataPackets + iECPackets > MAX_TOTAL_PACKETS_IN_BLOCK) )
+   {
+      log_softerror_and_alarm("[VideoTXBuffer] Tried to set invalid EC scheme: %d/%d", iDataPackets, iECPackets);
+      return;
+   }
+   // Used starting with the next video block
+   m_uNextBlockDataPackets = iDataPackets;
+   m_uNextBlockECPackets = iECPackets;
 }
 
 void VideoTxPacketsBuffer::updateCurrentKFValue()
@@ -301,7 +427,7 @@ void VideoTxPacketsBuffer::updateCurrentKFValue()
    m_PacketHeaderVideo.uCurrentVideoKeyframeIntervalMs = adaptive_video_get_current_kf();
 }
 
-void VideoTxPacketsBuffer::fillVideoPackets(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame)
+void VideoTxPacketsBuffer::fillVideoPackets(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame, u32 uCaptureTimeMicros)
 {
    if ( (NULL == pVideoData) || (iDataSize <= 0) )
       return;
@@ -311,6 +437,8 @@ void VideoTxPacketsBuffer::fillVideoPackets(u8* pVideoData, int iDataSize, bool
 
    while ( iDataSize > 0 )
    {
+      if ( 0 == m_iTempVideoBufferFilledBytes )
+         m_uTempVideoBufferCaptureTimeMicros = uCaptureTimeMicros;
       int iSizeLeftToFillInCurrentPacket = m_PacketHeaderVideo.uCurrentBlockPacketSize - m_iTempVideoBufferFilledBytes - sizeof(u16);
 
       if ( iDataSize <= iSizeLeftToFillInCurrentPacket )
@@ -319,8 +447,9 @@ void VideoTxPacketsBuffer::fillVideoPackets(u8* pVideoData, int iDataSize, bool
          m_iTempVideoBufferFilledBytes += iDataSize;
          if ( bEndOfFrame )
          {
-            addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, bEndOfFrame, bIsInsideIFrame);
+            addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, bEndOfFrame, bIsInsideIFrame, m_uTempVideoBufferCaptureTimeMicros);
             m_iTempVideoBufferFilledBytes = 0;
+   m_uTempVideoBufferCaptureTimeMicros = 0;
             m_uCurrentFrameId++;
          }
          return;
@@ -330,33 +459,42 @@ void VideoTxPacketsBuffer::fillVideoPackets(u8* pVideoData, int iDataSize, bool
       m_iTempVideoBufferFilledBytes += iSizeLeftToFillInCurrentPacket;
       pVideoData += iSizeLeftToFillInCurrentPacket;
       iDataSize -= iSizeLeftToFillInCurrentPacket;
-      addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, false, bIsInsideIFrame);
+      addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, false, bIsInsideIFrame, m_uTempVideoBufferCaptureTimeMicros);
       m_iTempVideoBufferFilledBytes = 0;
+   m_uTempVideoBufferCaptureTimeMicros = 0;
 
       //sendAvailablePackets();
    }
 }
 
-void VideoTxPacketsBuffer::addNewVideoPacket(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame)
+void VideoTxPacketsBuffer::addNewVideoPacket(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame, u32 uCaptureTimeMicros)
 {
    if ( (! m_bInitialized) || (NULL == pVideoData) || (iDataSize <= 0) || (iDataSize > MAX_PACKET_PAYLOAD) )
       return;
 
-   _checkAllocatePacket(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill);
-
    // Started a new video block? Set the pending EC scheme and clear the state of the block
    if ( 0 == m_iNextBufferPacketIndexToFill )
    {
       m_PacketHeaderVideo.uCurrentBlockPacketSize = m_uNextBlockPacketSize;
       m_PacketHeaderVideo.uCurrentBlockDataPackets = m_uNextBlockDataPackets;
       m_PacketHeaderVideo.uCurrentBlockECPackets = m_uNextBlockECPackets;
+
+      _releaseBlock(m_iNextBufferIndexToFill);
+      _releaseBlocksOutsideRetransmissionWindow();
    }
 
+   if ( RADIO_PACKET_HEADROOM + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98) + sizeof(t_packet_header_video_full_98_debug_info) + m_PacketHeaderVideo.uCurrentBlockPacketSize > (u32)m_PacketsPool.iSlotSize )
+   {
+      log_softerror_and_alarm("[VideoTXBuffer] Video packet size (%d bytes) does not fit the packets pool slots (%d bytes).", m_PacketHeaderVideo.uCurrentBlockPacketSize, m_PacketsPool.iSlotSize);
+      return;
+   }
+   if ( ! _checkAllocatePacket(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill) )
+      return;
+
    // Update packet headers
    _fillVideoPacketHeaders(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill, iDataSize + sizeof(u16), bEndOfFrame, bIsInsideIFrame);
-   //t_packet_header* pCurrentPacketHeader = m_VideoPackets[m_iNextBufferIndexToFill][m_iNextBufferPacketIndexToFill].pPH;
-   t_packet_header_video_full_98* pCurrentVideoPacketHeader = m_VideoPackets[m_iNextBufferIndexToFill][m_iNextBufferPacketIndexToFill].pPHVF;
-   u8* pVideoDestination = m_VideoPackets[m_iNextBufferIndexToFill][m_iNextBufferPacketIndexToFill].pVideoData;
+   t_packet_header_video_full_98* pCurrentVideoPacketHeader = _getPHVF(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill);
+   u8* pVideoDestination = _getVideoData(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill);
    if ( m_PacketHeaderVideo.uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
       pVideoDestination += sizeof(t_packet_header_video_full_98_debug_info);
 
@@ -373,11 +511,15 @@ void VideoTxPacketsBuffer::addNewVideoPacket(u8* pVideoData, int iDataSize, bool
 
    if ( m_PacketHeaderVideo.uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
    {
-      t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*)(m_VideoPackets[m_iNextBufferIndexToFill][m_iNextBufferPacketIndexToFill].pVideoData);
+      t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*)_getVideoData(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill);
       pPHVFDebugInfo->uVideoCRC = base_compute_crc32(pVideoDestination, pCurrentVideoPacketHeader->uCurrentBlockPacketSize);
    }
 
    // Update state
+   if ( 0 != uCaptureTimeMicros )
+      m_VideoBlocks[m_iNextBufferIndexToFill].uTimeReadyMicros[m_iNextBufferPacketIndexToFill] = uCaptureTimeMicros;
+   else
+      m_VideoBlocks[m_iNextBufferIndexToFill].uTimeReadyMicros[m_iNextBufferPacketIndexToFill] = get_current_timestamp_micros();
    m_iNextBufferPacketIndexToFill++;
    m_iCountReadyToSend++;
    m_uNextVideoBlockPacketIndexToGenerate++;
@@ -391,8 +533,9 @@ void VideoTxPacketsBuffer::addNewVideoPacket(u8* pVideoData, int iDataSize, bool
 
       for( int i=0; i<m_PacketHeaderVideo.uCurrentBlockDataPackets; i++ )
       {
-         _checkAllocatePacket(m_iNextBufferIndexToFill, i);
-         pVideoDestination = m_VideoPackets[m_iNextBufferIndexToFill][i].pVideoData;
+         if ( ! _checkAllocatePacket(m_iNextBufferIndexToFill, i) )
+            return;
+         pVideoDestination = _getVideoData(m_iNextBufferIndexToFill, i);
          if ( m_PacketHeaderVideo.uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
             pVideoDestination += sizeof(t_packet_header_video_full_98_debug_info);
          p_fec_data_packets[i] = pVideoDestination;
@@ -400,8 +543,9 @@ void VideoTxPacketsBuffer::addNewVideoPacket(u8* pVideoData, int iDataSize, bool
       int iECDelta = m_PacketHeaderVideo.uCurrentBlockDataPackets;
       for( int i=0; i<m_PacketHeaderVideo.uCurrentBlockECPackets; i++ )
       {
-         _checkAllocatePacket(m_iNextBufferIndexToFill, i+iECDelta);
-         pVideoDestination = m_VideoPackets[m_iNextBufferIndexToFill][i+iECDelta].pVideoData;
+         if ( ! _checkAllocatePacket(m_iNextBufferIndexToFill, i+iECDelta) )
+            return;
+         pVideoDestination = _getVideoData(m_iNextBufferIndexToFill, i+iECDelta);
          if ( m_PacketHeaderVideo.uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
             pVideoDestination += sizeof(t_packet_header_video_full_98_debug_info);
          p_fec_data_fecs[i] = pVideoDestination;
@@ -429,18 +573,18 @@ void VideoTxPacketsBuffer::addNewVideoPacket(u8* pVideoData, int iDataSize, bool
          // Update packet headers
          _fillVideoPacketHeaders(m_iNextBufferIndexToFill, i+iECDelta, m_PacketHeaderVideo.uCurrentBlockPacketSize, bEndOfFrame, bIsInsideIFrame);
 
-         //pCurrentPacketHeader = m_VideoPackets[m_iNextBufferIndexToFill][i+iECDelta].pPH;
-         pCurrentVideoPacketHeader = m_VideoPackets[m_iNextBufferIndexToFill][i+iECDelta].pPHVF;
-         pVideoDestination = m_VideoPackets[m_iNextBufferIndexToFill][i+iECDelta].pVideoData;
+         pCurrentVideoPacketHeader = _getPHVF(m_iNextBufferIndexToFill, i+iECDelta);
+         pVideoDestination = _getVideoData(m_iNextBufferIndexToFill, i+iECDelta);
 
          if ( m_PacketHeaderVideo.uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_DEBUG_TIMESTAMPS )
          {
-            t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*)(m_VideoPackets[m_iNextBufferIndexToFill][i+iECDelta].pVideoData);
+            t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*)pVideoDestination;
             pVideoDestination += sizeof(t_packet_header_video_full_98_debug_info);
          
             pPHVFDebugInfo->uVideoCRC = base_compute_crc32(pVideoDestination, pCurrentVideoPacketHeader->uCurrentBlockPacketSize);
          }
 
+         m_VideoBlocks[m_iNextBufferIndexToFill].uTimeReadyMicros[i+iECDelta] = get_current_timestamp_micros();
          m_iNextBufferPacketIndexToFill++;
          m_iCountReadyToSend++;
          m_uNextVideoBlockPacketIndexToGenerate++;
@@ -469,10 +613,8 @@ void VideoTxPacketsBuffer::addNewVideoPacket(u8* pVideoData, int iDataSize, bool
 
 void VideoTxPacketsBuffer::_sendPacket(int iBufferIndex, int iPacketIndex, u32 uRetransmissionId)
 {
-   t_packet_header* pCurrentPacketHeader = m_VideoPackets[iBufferIndex][iPacketIndex].pPH;
-   t_packet_header_video_full_98* pCurrentVideoPacketHeader = m_VideoPackets[iBufferIndex][iPacketIndex].pPHVF;
-
-   //t_packet_header_video_full_98* pPHVF = (t_packet_header_video_full_98*) (m_VideoPackets[iBufferIndex][iPacketIndex].pRawData+sizeof(t_packet_header));    
+   t_packet_header* pCurrentPacketHeader = _getPH(iBufferIndex, iPacketIndex);
+   t_packet_header_video_full_98* pCurrentVideoPacketHeader = _getPHVF(iBufferIndex, iPacketIndex);
    
    // stream_packet_idx: high 4 bits: stream id (0..15), lower 28 bits: stream packet index
    pCurrentPacketHeader->stream_packet_idx = m_uRadioStreamPacketIndex;
@@ -507,12 +649,7 @@ void VideoTxPacketsBuffer::_sendPacket(int iBufferIndex, int iPacketIndex, u32 u
    if ( g_bVideoPaused || (! relay_current_vehicle_must_send_own_video_feeds()) )
       return;
 
-   //t_packet_header_video_full_98_debug_info* pPHVFDebugInfo = (t_packet_header_video_full_98_debug_info*) m_VideoPackets[iBufferIndex][iPacketIndex].pVideoData;
-   //u8* pVideoData = m_VideoPackets[iBufferIndex][iPacketIndex].pVideoData;
-   //pVideoData += sizeof(t_packet_header_video_full_98_debug_info);
-   //u32 crc = base_compute_crc32(pVideoData, pCurrentVideoPacketHeader->uCurrentBlockPacketSize);
-
-   send_packet_to_radio_interfaces((u8*)pCurrentPacketHeader, pCurrentPacketHeader->total_length, -1);
+   send_packet_with_headroom_to_radio_interfaces((u8*)pCurrentPacketHeader, pCurrentPacketHeader->total_length, -1);
 }
 
 int VideoTxPacketsBuffer::hasPendingPacketsToSend()
@@ -535,15 +672,21 @@ int VideoTxPacketsBuffer::sendAvailablePackets(int iMaxCountToSend)
    int iCountSent = 0;
    for( int i=0; i<iToSend; i++ )
    {
-      if ( NULL == m_VideoPackets[m_iCurrentBufferIndexToSend][m_iCurrentBufferPacketIndexToSend].pPH )
+      // Out of airtime for now, the rest is sent on the next calls
+      u32 uTimeNowMicros = get_current_timestamp_micros();
+      if ( ! radio_pacer_can_send_video(uTimeNowMicros) )
+         break;
+
+      if ( NULL == _getPH(m_iCurrentBufferIndexToSend, m_iCurrentBufferPacketIndexToSend) )
       {
-         log_softerror_and_alarm("Invalid packet [%d/%d], video next to gen: [%u/%u], ready to send: %d, header: %X", m_iCurrentBufferIndexToSend, m_iCurrentBufferPacketIndexToSend,
-         m_uNextVideoBlockIndexToGenerate, m_uNextVideoBlockPacketIndexToGenerate, m_iCountReadyToSend, m_VideoPackets[m_iCurrentBufferIndexToSend][m_iCurrentBufferPacketIndexToSend].pPH);
+         log_softerror_and_alarm("Invalid packet [%d/%d], video next to gen: [%u/%u], ready to send: %d", m_iCurrentBufferIndexToSend, m_iCurrentBufferPacketIndexToSend,
+         m_uNextVideoBlockIndexToGenerate, m_uNextVideoBlockPacketIndexToGenerate, m_iCountReadyToSend);
          continue;
       }
+      radio_pacer_on_video_queue_delay(uTimeNowMicros - m_VideoBlocks[m_iCurrentBufferIndexToSend].uTimeReadyMicros[m_iCurrentBufferPacketIndexToSend]);
       _sendPacket(m_iCurrentBufferIndexToSend, m_iCurrentBufferPacketIndexToSend, 0);
       iCountSent++;
-      t_packet_header_video_full_98* pCurrentVideoPacketHeader = m_VideoPackets[m_iCurrentBufferIndexToSend][m_iCurrentBufferPacketIndexToSend].pPHVF;
+      t_packet_header_video_full_98* pCurrentVideoPacketHeader = _getPHVF(m_iCurrentBufferIndexToSend, m_iCurrentBufferPacketIndexToSend);
       m_iCurrentBufferPacketIndexToSend++;
       if ( m_iCurrentBufferPacketIndexToSend >= pCurrentVideoPacketHeader->uCurrentBlockDataPackets + pCurrentVideoPacketHeader->uCurrentBlockECPackets )
       {
@@ -563,17 +706,14 @@ int VideoTxPacketsBuffer::sendAvailablePackets(int iMaxCountToSend)
 }
 
 
-void VideoTxPacketsBuffer::resendVideoPacket(u32 uRetransmissionId, u32 uVideoBlockIndex, u32 uVideoBlockPacketIndex)
+int VideoTxPacketsBuffer::_getBufferIndexForVideoBlock(u32 uVideoBlockIndex)
 {
    if ( uVideoBlockIndex > m_uNextVideoBlockIndexToGenerate )
-      return;
-   if ( uVideoBlockIndex == m_uNextVideoBlockIndexToGenerate )
-   if ( uVideoBlockPacketIndex >= m_uNextVideoBlockPacketIndexToGenerate )
-      return;
+      return -1;
  
    int iDeltaBlocksBack = (int)m_uNextVideoBlockIndexToGenerate - (int)uVideoBlockIndex;
    if ( (iDeltaBlocksBack < 0) || (iDeltaBlocksBack >= MAX_RXTX_BLOCKS_BUFFER) )
-      return;
+      return -1;
 
    int iBufferIndex = m_iNextBufferIndexToFill - iDeltaBlocksBack;
    if ( iBufferIndex < 0 )
@@ -581,16 +721,58 @@ void VideoTxPacketsBuffer::resendVideoPacket(u32 uRetransmissionId, u32 uVideoBl
 
    // Still too old?
    if ( iBufferIndex < 0 )
-      return;
+      return -1;
+   return iBufferIndex;
+}
 
-   if ( NULL == m_VideoPackets[iBufferIndex][uVideoBlockPacketIndex].pPH )
-      return;
-   if ( m_VideoPackets[iBufferIndex][uVideoBlockPacketIndex].pPHVF->uCurrentBlockIndex != uVideoBlockIndex )
-      return;
-   if ( m_VideoPackets[iBufferIndex][uVideoBlockPacketIndex].pPHVF->uCurrentBlockPacketIndex != uVideoBlockPacketIndex )
-      return;
+bool VideoTxPacketsBuffer::_resendBufferPacket(u32 uRetransmissionId, int iBufferIndex, u32 uVideoBlockIndex, u32 uVideoBlockPacketIndex)
+{
+   if ( uVideoBlockPacketIndex >= MAX_TOTAL_PACKETS_IN_BLOCK )
+      return false;
+   if ( uVideoBlockIndex == m_uNextVideoBlockIndexToGenerate )
+   if ( uVideoBlockPacketIndex >= m_uNextVideoBlockPacketIndexToGenerate )
+      return false;
+
+   // Released blocks (older than the retransmission window) have no packets
+   t_packet_header_video_full_98* pPHVF = _getPHVF(iBufferIndex, (int)uVideoBlockPacketIndex);
+   if ( NULL == pPHVF )
+      return false;
+   if ( pPHVF->uCurrentBlockIndex != uVideoBlockIndex )
+      return false;
+   if ( pPHVF->uCurrentBlockPacketIndex != uVideoBlockPacketIndex )
+      return false;
 
    if ( 0 == uRetransmissionId )
       uRetransmissionId = MAX_U32-1;
    _sendPacket(iBufferIndex, (int)uVideoBlockPacketIndex, uRetransmissionId);
+   return true;
+}
+
+void VideoTxPacketsBuffer::resendVideoPacket(u32 uRetransmissionId, u32 uVideoBlockIndex, u32 uVideoBlockPacketIndex)
+{
+   int iBufferIndex = _getBufferIndexForVideoBlock(uVideoBlockIndex);
+   if ( iBufferIndex < 0 )
+      return;
+   _resendBufferPacket(uRetransmissionId, iBufferIndex, uVideoBlockIndex, uVideoBlockPacketIndex);
+}
+
+int VideoTxPacketsBuffer::resendVideoPackets(u32 uRetransmissionId, u32 uVideoBlockIndex, const u8* pMissingBitmap)
+{
+   int iBufferIndex = _getBufferIndexForVideoBlock(uVideoBlockIndex);
+   if ( (iBufferIndex < 0) || (NULL == pMissingBitmap) )
+      return 0;
+
+   int iCountSent = 0;
+   for( int i=0; i<VIDEO_NACK_BITMAP_BYTES; i++ )
+   {
+      u8 uBits = pMissingBitmap[i];
+      while ( uBits )
+      {
+         int iPacketIndex = i*8 + __builtin_ctz(uBits);
+         uBits &= uBits - 1;
+         if ( _resendBufferPacket(uRetransmissionId, iBufferIndex, uVideoBlockIndex, (u32)iPacketIndex) )
+            iCountSent++;
+      }
+   }
+   return iCountSent;
 }
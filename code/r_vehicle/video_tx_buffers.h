@@ -3,16 +3,20 @@
 #include "../base/base.h"
 #include "../base/config.h"
 #include "../base/models.h"
+#include "../base/packet_pool.h"
 #include "../radio/radiopackets2.h"
+#include "../radio/video_nack.h"
 
+// The packets are stored in the packets pool (RADIO_PACKET_HEADROOM bytes, then the packet). A block keeps
+// the pool slot and the ready time of each of its packets; its slots are given back once the block is
+// sent and older than the retransmission window.
 typedef struct
 {
-   t_packet_header* pPH; // pointer inside pRawData
-   t_packet_header_video_full_98* pPHVF; // pointer inside pRawData
-   u8* pVideoData; // pointer inside pRawData
-   u8* pRawData;
+   u64 uAllocatedMask; // bit k: packet k has a pool slot
+   u16 uPacketSlots[MAX_TOTAL_PACKETS_IN_BLOCK];
+   u32 uTimeReadyMicros[MAX_TOTAL_PACKETS_IN_BLOCK]; // capture time of its video data if known, otherwise when the packet was ready to send
 }
-type_tx_video_packet_info;
+type_tx_video_block_info;
 
 
 class VideoTxPacketsBuffer
@@ -26,17 +30,29 @@ class VideoTxPacketsBuffer
       void discardBuffer();
       void updateVideoHeader(Model* pModel);
       void updateCurrentKFValue();
-      void fillVideoPackets(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame);
-      void addNewVideoPacket(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame);
+      void setECScheme(int iDataPackets, int iECPackets);
+      // uCaptureTimeMicros: when the video data was received from the camera (kernel rx time), 0 if not known
+      void fillVideoPackets(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame, u32 uCaptureTimeMicros);
+      void addNewVideoPacket(u8* pVideoData, int iDataSize, bool bEndOfFrame, bool bIsInsideIFrame, u32 uCaptureTimeMicros);
       int hasPendingPacketsToSend();
       int sendAvailablePackets(int iMaxCountToSend);
       void resendVideoPacket(u32 uRetransmissionId, u32 uVideoBlockIndex, u32 uVideoBlockPacketIndex);
+      // Resends all the packets set in the bitmap (VIDEO_NACK_BITMAP_BYTES bytes). Returns the number of packets sent.
+      int resendVideoPackets(u32 uRetransmissionId, u32 uVideoBlockIndex, const u8* pMissingBitmap);
 
    protected:
 
-      void _checkAllocatePacket(int iBufferIndex, int iPacketIndex);
+      void _updatePacketsPool(Model* pModel, int iVideoProfile, int iDataPackets);
+      bool _checkAllocatePacket(int iBufferIndex, int iPacketIndex);
+      void _releaseBlock(int iBufferIndex);
+      void _releaseBlocksOutsideRetransmissionWindow();
+      t_packet_header* _getPH(int iBufferIndex, int iPacketIndex);
+      t_packet_header_video_full_98* _getPHVF(int iBufferIndex, int iPacketIndex);
+      u8* _getVideoData(int iBufferIndex, int iPacketIndex);
       void _fillVideoPacketHeaders(int iBufferIndex, int iPacketIndex, int iVideoSize, bool bEndOfFrame, bool bIsInsideIFrame);
       void _sendPacket(int iBufferIndex, int iPacketIndex, u32 uRetransmissionId);
+      int _getBufferIndexForVideoBlock(u32 uVideoBlockIndex);
+      bool _resendBufferPacket(u32 uRetransmissionId, int iBufferIndex, u32 uVideoBlockIndex, u32 uVideoBlockPacketIndex);
       static int m_siVideoBuffersInstancesCount;
       bool m_bInitialized;
       int m_iInstanceIndex;
@@ -59,7 +75,10 @@ class VideoTxPacketsBuffer
       int m_iCurrentBufferPacketIndexToSend;
       u8 m_TempVideoBuffer[MAX_PACKET_TOTAL_SIZE];
       int m_iTempVideoBufferFilledBytes;
-      type_tx_video_packet_info m_VideoPackets[MAX_RXTX_BLOCKS_BUFFER][MAX_TOTAL_PACKETS_IN_BLOCK];
+      u32 m_uTempVideoBufferCaptureTimeMicros; // of the oldest data in the temp buffer
+      type_tx_video_block_info m_VideoBlocks[MAX_RXTX_BLOCKS_BUFFER];
+      t_packet_pool m_PacketsPool;
+      int m_iRetransmissionWindowBlocks;
       int m_iCountReadyToSend;
 
       u32 m_uRadioStreamPacketIndex;
@@ -0,0 +1,224 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "adaptive_fec.h"
+
+static int _adaptive_fec_get_max_ec_packets(int iDataPackets)
+{
+   int iMaxEC = (iDataPackets * ADAPTIVE_FEC_MAX_EC_PERCENT)/100;
+   if ( iMaxEC > MAX_FECS_PACKETS_IN_BLOCK )
+      iMaxEC = MAX_FECS_PACKETS_IN_BLOCK;
+   if ( iMaxEC > MAX_TOTAL_PACKETS_IN_BLOCK - iDataPackets )
+      iMaxEC = MAX_TOTAL_PACKETS_IN_BLOCK - iDataPackets;
+   if ( iMaxEC > ADAPTIVE_FEC_MAX_EC_COUNT-1 )
+      iMaxEC = ADAPTIVE_FEC_MAX_EC_COUNT-1;
+   if ( iMaxEC < ADAPTIVE_FEC_MIN_EC_PACKETS )
+      iMaxEC = ADAPTIVE_FEC_MIN_EC_PACKETS;
+   return iMaxEC;
+}
+
+static void _adaptive_fec_reset_history(t_adaptive_fec_state* pState)
+{
+   memset(pState->uNeededEC, 0, sizeof(pState->uNeededEC));
+   pState->uTotalBlocks = 0;
+}
+
+// Returns 1 if the EC scheme changed
+static int _adaptive_fec_set_scheme(t_adaptive_fec_state* pState, int iDataPackets, int iECPackets)
+{
+   if ( iECPackets < ADAPTIVE_FEC_MIN_EC_PACKETS )
+      iECPackets = ADAPTIVE_FEC_MIN_EC_PACKETS;
+   if ( iECPackets > _adaptive_fec_get_max_ec_packets(iDataPackets) )
+      iECPackets = _adaptive_fec_get_max_ec_packets(iDataPackets);
+   if ( (iDataPackets == pState->iDataPackets) && (iECPackets == pState->iECPackets) )
+      return 0;
+
+   if ( iDataPackets != pState->iDataPackets )
+      _adaptive_fec_reset_history(pState);
+   else if ( iECPackets > pState->iECPackets )
+   {
+      // Blocks lost with the previous scheme needed at least one more EC packet
+      pState->uNeededEC[pState->iECPackets+1] += pState->uNeededEC[ADAPTIVE_FEC_MAX_EC_COUNT];
+      pState->uNeededEC[ADAPTIVE_FEC_MAX_EC_COUNT] = 0;
+   }
+   pState->iDataPackets = iDataPackets;
+   pState->iECPackets = iECPackets;
+   return 1;
+}
+
+static int _adaptive_fec_increase(t_adaptive_fec_state* pState, int iTargetECPackets)
+{
+   int iDataPackets = pState->iDataPackets;
+   if ( iTargetECPackets > _adaptive_fec_get_max_ec_packets(iDataPackets) )
+   if ( iDataPackets < pState->iMaxDataPackets )
+   {
+      // Can't add more EC packets to this block size: use larger blocks, with at least the same EC ratio
+      int iStep = pState->iBaseDataPackets/2;
+      if ( iStep < 1 )
+         iStep = 1;
+      iDataPackets += iStep;
+      if ( iDataPackets > pState->iMaxDataPackets )
+         iDataPackets = pState->iMaxDataPackets;
+      iTargetECPackets = (iTargetECPackets * iDataPackets + pState->iDataPackets - 1) / pState->iDataPackets;
+   }
+   return _adaptive_fec_set_scheme(pState, iDataPackets, iTargetECPackets);
+}
+
+static int _adaptive_fec_decrease(t_adaptive_fec_state* pState)
+{
+   if ( pState->iDataPackets > pState->iBaseDataPackets )
+   {
+      // Go back to the profile block size first, keeping the EC ratio
+      int iStep = pState->iBaseDataPackets/2;
+      if ( iStep < 1 )
+         iStep = 1;
+      int iDataPackets = pState->iDataPackets - iStep;
+      if ( iDataPackets < pState->iBaseDataPackets )
+         iDataPackets = pState->iBaseDataPackets;
+      int iECPackets = (pState->iECPackets * iDataPackets + pState->iDataPackets - 1) / pState->iDataPackets;
+      return _adaptive_fec_set_scheme(pState, iDataPackets, iECPackets);
+   }
+   return _adaptive_fec_set_scheme(pState, pState->iDataPackets, pState->iECPackets - 1);
+}
+
+void adaptive_fec_init(t_adaptive_fec_state* pState, int iDataPackets, int iECPackets)
+{
+   if ( NULL == pState )
+      return;
+   memset(pState, 0, sizeof(t_adaptive_fec_state));
+   pState->iBaseDataPackets = iDataPackets;
+   pState->iBaseECPackets = iECPackets;
+   pState->iDataPackets = iDataPackets;
+   pState->iECPackets = iECPackets;
+   pState->iMaxDataPackets = 2 * iDataPackets;
+   if ( pState->iMaxDataPackets > MAX_DATA_PACKETS_IN_BLOCK )
+      pState->iMaxDataPackets = MAX_DATA_PACKETS_IN_BLOCK;
+   if ( pState->iMaxDataPackets < iDataPackets )
+      pState->iMaxDataPackets = iDataPackets;
+}
+
+int adaptive_fec_get_needed_ec_packets(t_adaptive_fec_state* pState, int iPerThousand)
+{
+   if ( (NULL == pState) || (0 == pState->uTotalBlocks) )
+      return 0;
+
+   u32 uAllowed = (u32)(((u64)pState->uTotalBlocks * (u64)iPerThousand)/1000);
+   u32 uAbove = pState->uNeededEC[ADAPTIVE_FEC_MAX_EC_COUNT];
+   if ( uAbove > uAllowed )
+      return -1;
+
+   for( int k=ADAPTIVE_FEC_MAX_EC_COUNT-1; k>=0; k-- )
+   {
+      uAbove += pState->uNeededEC[k];
+      if ( uAbove > uAllowed )
+         return k;
+   }
+   return 0;
+}
+
+int adaptive_fec_on_recovery_stats(t_adaptive_fec_state* pState, t_packet_data_video_ec_recovery_stats* pStats, u32 uTimeNowMs)
+{
+   if ( (NULL == pState) || (NULL == pStats) || (pState->iBaseDataPackets <= 0) || (pState->iBaseECPackets <= 0) )
+      return 0;
+
+   // Stats for other schemes are for blocks sent before the last change
+   if ( ((int)pStats->uBlockDataPackets != pState->iDataPackets) || ((int)pStats->uBlockECPackets != pState->iECPackets) )
+      return 0;
+
+   u32 uBlocks = (u32)pStats->uBlocksOutput + (u32)pStats->uBlocksLost;
+   if ( 0 == uBlocks )
+      return 0;
+
+   for( int i=0; i<=ADAPTIVE_FEC_MAX_EC_COUNT; i++ )
+      pState->uNeededEC[i] = (pState->uNeededEC[i] * ADAPTIVE_FEC_HISTORY_DECAY)/16;
+   pState->uTotalBlocks = (pState->uTotalBlocks * ADAPTIVE_FEC_HISTORY_DECAY)/16;
+
+   u32 uReconstructed = 0;
+   for( int k=0; k<VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE; k++ )
+   {
+      int iNeeded = k+1;
+      // Last entry has all the blocks that needed that many or more
+      if ( (k == VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE-1) && (iNeeded < pState->iECPackets) )
+         iNeeded = pState->iECPackets;
+      if ( iNeeded > ADAPTIVE_FEC_MAX_EC_COUNT-1 )
+         iNeeded = ADAPTIVE_FEC_MAX_EC_COUNT-1;
+      pState->uNeededEC[iNeeded] += 16 * (u32)pStats->uBlocksECUsed[k];
+      uReconstructed += pStats->uBlocksECUsed[k];
+   }
+   if ( pStats->uBlocksOutput > uReconstructed )
+      pState->uNeededEC[0] += 16 * (pStats->uBlocksOutput - uReconstructed);
+   pState->uNeededEC[ADAPTIVE_FEC_MAX_EC_COUNT] += 16 * (u32)pStats->uBlocksLost;
+   pState->uTotalBlocks += 16 * uBlocks;
+
+   int iNeededEC = adaptive_fec_get_needed_ec_packets(pState, ADAPTIVE_FEC_TARGET_UNRECOVERABLE_PER_THOUSAND);
+   int iTargetEC = iNeededEC + ADAPTIVE_FEC_EC_MARGIN;
+   if ( iNeededEC < 0 )
+   {
+      int iStep = pState->iECPackets/2;
+      if ( iStep < 1 )
+         iStep = 1;
+      iTargetEC = pState->iECPackets + iStep;
+   }
+   else if ( (pStats->uBlocksLost > 0) && (iTargetEC <= pState->iECPackets) )
+      iTargetEC = pState->iECPackets + 1;
+   if ( iTargetEC < ADAPTIVE_FEC_MIN_EC_PACKETS )
+      iTargetEC = ADAPTIVE_FEC_MIN_EC_PACKETS;
+
+   if ( iTargetEC > pState->iECPackets )
+   {
+      pState->uTimeCleanSince = 0;
+      if ( ! _adaptive_fec_increase(pState, iTargetEC) )
+         return 0;
+      pState->uTimeLastIncrease = uTimeNowMs;
+      pState->uCountIncreases++;
+      return 1;
+   }
+
+   if ( (iTargetEC == pState->iECPackets) && (pState->iDataPackets == pState->iBaseDataPackets) )
+   {
+      pState->uTimeCleanSince = 0;
+      return 0;
+   }
+
+   // Cleaner link than needed by the current scheme: reclaim the airtime, one step at a time
+   if ( 0 == pState->uTimeCleanSince )
+      pState->uTimeCleanSince = uTimeNowMs;
+   if ( uTimeNowMs < pState->uTimeCleanSince + ADAPTIVE_FEC_DECREASE_AFTER_MS )
+      return 0;
+   if ( (0 != pState->uTimeLastIncrease) && (uTimeNowMs < pState->uTimeLastIncrease + ADAPTIVE_FEC_HOLD_AFTER_INCREASE_MS) )
+      return 0;
+
+   pState->uTimeCleanSince = uTimeNowMs;
+   if ( ! _adaptive_fec_decrease(pState) )
+      return 0;
+   pState->uCountDecreases++;
+   return 1;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "../base/base.h"
+#include "radiopackets2.h"
+
+// Loss driven EC scheme controller, runs on the vehicle.
+// The controller periodically sends PACKET_TYPE_VIDEO_EC_RECOVERY_STATS with how many EC packets each
+// received video block needed to be reconstructed and how many blocks could not be reconstructed.
+// From a decayed histogram of those, the controller picks the smallest EC count that would have
+// reconstructed all but ADAPTIVE_FEC_TARGET_UNRECOVERABLE_PER_THOUSAND of the blocks, plus a margin,
+// so redundancy is added just ahead of the loss. Lost blocks increase the EC count right away; the EC
+// count (and the block size, if it was increased) goes down only one step at a time, after the link
+// was cleaner than needed for ADAPTIVE_FEC_DECREASE_AFTER_MS.
+// When the EC count would have to go above the data packets count (bursts longer than a block can
+// cover), the block size is increased instead, up to twice the video profile block size.
+
+#define ADAPTIVE_FEC_STATS_INTERVAL_MS 100
+#define ADAPTIVE_FEC_TARGET_UNRECOVERABLE_PER_THOUSAND 5
+#define ADAPTIVE_FEC_EC_MARGIN 1
+#define ADAPTIVE_FEC_MIN_EC_PACKETS 1
+#define ADAPTIVE_FEC_MAX_EC_PERCENT 100
+#define ADAPTIVE_FEC_DECREASE_AFTER_MS 1500
+#define ADAPTIVE_FEC_HOLD_AFTER_INCREASE_MS 3000
+// Each new stats interval keeps this much (out of 16) of the previous histogram
+#define ADAPTIVE_FEC_HISTORY_DECAY 14
+#define ADAPTIVE_FEC_MAX_EC_COUNT (MAX_FECS_PACKETS_IN_BLOCK+1)
+
+typedef struct
+{
+   int iBaseDataPackets; // from the video profile
+   int iBaseECPackets;
+   int iMaxDataPackets;
+   int iDataPackets; // current EC scheme
+   int iECPackets;
+
+   // Decayed histogram of the EC packets needed by each block (x16), index is the EC packets count;
+   // blocks that could not be reconstructed are in the last entry.
+   u32 uNeededEC[ADAPTIVE_FEC_MAX_EC_COUNT+1];
+   u32 uTotalBlocks;
+   u32 uTimeLastIncrease;
+   u32 uTimeCleanSince; // since when the link needs less EC than the current scheme, 0 if not
+   u32 uCountIncreases;
+   u32 uCountDecreases;
+} t_adaptive_fec_state;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void adaptive_fec_init(t_adaptive_fec_state* pState, int iDataPackets, int iECPackets);
+// Returns 1 if the EC scheme changed (see pState->iDataPackets, pState->iECPackets)
+int adaptive_fec_on_recovery_stats(t_adaptive_fec_state* pState, t_packet_data_video_ec_recovery_stats* pStats, u32 uTimeNowMs);
+// Returns the smallest EC packets count needed by all but iPerThousand of the blocks in the history,
+// or -1 if more than that could not be reconstructed with the current EC scheme.
+int adaptive_fec_get_needed_ec_packets(t_adaptive_fec_state* pState, int iPerThousand);
+
+#ifdef __cplusplus
+}
+#endif
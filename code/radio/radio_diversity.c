@@ -0,0 +1,293 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "radio_diversity.h"
+#include "radiopackets2.h"
+
+typedef struct
+{
+   u32 uVehicleId;
+   u32 uStreamPacketIdx; // stream index and stream packet index, as in the radio header
+   u32 uTimeFirstRx;
+   u8 uCardsMask;
+   u8 uUsed;
+} ALIGN_STRUCT_SPEC_INFO t_radio_diversity_packet;
+
+t_radio_diversity_card_stats s_RadioDiversityCards[MAX_RADIO_INTERFACES];
+t_radio_diversity_packet s_RadioDiversityPackets[RADIO_DIVERSITY_TRACKED_PACKETS];
+int s_iRadioDiversityRxOrder[MAX_RADIO_INTERFACES];
+u32 s_uRadioDiversityTmpUniquePackets = 0;
+u32 s_uRadioDiversityTimeLastUpdate = 0;
+
+void radio_diversity_init()
+{
+   memset(s_RadioDiversityCards, 0, sizeof(s_RadioDiversityCards));
+   memset(s_RadioDiversityPackets, 0, sizeof(s_RadioDiversityPackets));
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      s_RadioDiversityCards[i].iDbm = 1000;
+      s_RadioDiversityCards[i].iScore = -1;
+      s_iRadioDiversityRxOrder[i] = i;
+   }
+   s_uRadioDiversityTmpUniquePackets = 0;
+   s_uRadioDiversityTimeLastUpdate = 0;
+}
+
+void radio_diversity_on_rx_frame(int iInterfaceIndex, int iDataIsOk, int iDbm, u32 uTimeNow)
+{
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return;
+   t_radio_diversity_card_stats* pCard = &s_RadioDiversityCards[iInterfaceIndex];
+   pCard->uTotalFrames++;
+   pCard->uTmpFrames++;
+   if ( ! iDataIsOk )
+   {
+      pCard->uTotalFramesBad++;
+      pCard->uTmpFramesBad++;
+   }
+   if ( iDbm < 500 )
+   {
+      pCard->iTmpDbmSum += iDbm;
+      pCard->iTmpDbmCount++;
+   }
+   pCard->uTimeLastRxFrame = uTimeNow;
+}
+
+// The packet was received only by one card while other cards were receiving too
+static void _radio_diversity_close_packet(t_radio_diversity_packet* pPacket)
+{
+   if ( ! pPacket->uUsed )
+      return;
+   pPacket->uUsed = 0;
+   int iCard = -1;
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      if ( ! (pPacket->uCardsMask & (1<<i)) )
+         continue;
+      if ( -1 != iCard )
+         return;
+      iCard = i;
+   }
+   if ( -1 == iCard )
+      return;
+
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      if ( (i == iCard) || (0 == s_RadioDiversityCards[i].uTimeLastRxFrame) )
+         continue;
+      if ( s_RadioDiversityCards[i].uTimeLastRxFrame + RADIO_DIVERSITY_CARD_ACTIVE_MS >= pPacket->uTimeFirstRx )
+      {
+         s_RadioDiversityCards[iCard].uTotalRescuedPackets++;
+         return;
+      }
+   }
+}
+
+void radio_diversity_on_rx_packet(int iInterfaceIndex, u8* pPacketBuffer, int iPacketLength, int iIsDuplicate, u32 uTimeNow)
+{
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return;
+   if ( (NULL == pPacketBuffer) || (iPacketLength < (int)sizeof(t_packet_header_compressed)) )
+      return;
+
+   t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
+   t_packet_header_compressed* pPHC = (t_packet_header_compressed*)pPacketBuffer;
+   u32 uVehicleId = 0;
+   u32 uStreamPacketIdx = 0;
+   if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_FLAGS_MASK_COMPRESSED_HEADER )
+   {
+      uVehicleId = pPHC->vehicle_id_src;
+      uStreamPacketIdx = pPHC->stream_packet_idx;
+   }
+   else
+   {
+      if ( iPacketLength < (int)sizeof(t_packet_header) )
+         return;
+      uVehicleId = pPH->vehicle_id_src;
+      uStreamPacketIdx = pPH->stream_packet_idx;
+   }
+
+   u32 uSlot = ((uStreamPacketIdx & PACKET_FLAGS_MASK_STREAM_PACKET_IDX) + (uStreamPacketIdx >> PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX) * 131) & (RADIO_DIVERSITY_TRACKED_PACKETS-1);
+   t_radio_diversity_packet* pPacket = &s_RadioDiversityPackets[uSlot];
+   t_radio_diversity_card_stats* pCard = &s_RadioDiversityCards[iInterfaceIndex];
+
+   if ( pPacket->uUsed && (pPacket->uVehicleId == uVehicleId) && (pPacket->uStreamPacketIdx == uStreamPacketIdx) )
+   {
+      if ( pPacket->uCardsMask & (1<<iInterfaceIndex) )
+         return;
+      u32 uLag = uTimeNow - pPacket->uTimeFirstRx;
+      if ( uLag > RADIO_DIVERSITY_WINDOW_MS )
+      {
+         pCard->uTotalLateCopies++;
+         return;
+      }
+      pPacket->uCardsMask |= (1<<iInterfaceIndex);
+      pCard->uTotalPackets++;
+      pCard->uTmpPackets++;
+      pCard->uTmpLagSumMs += uLag;
+      return;
+   }
+
+   // Copy of a packet no longer tracked
+   if ( iIsDuplicate )
+   {
+      pCard->uTotalLateCopies++;
+      return;
+   }
+
+   _radio_diversity_close_packet(pPacket);
+   pPacket->uVehicleId = uVehicleId;
+   pPacket->uStreamPacketIdx = uStreamPacketIdx;
+   pPacket->uTimeFirstRx = uTimeNow;
+   pPacket->uCardsMask = (1<<iInterfaceIndex);
+   pPacket->uUsed = 1;
+
+   s_uRadioDiversityTmpUniquePackets++;
+   pCard->uTotalPackets++;
+   pCard->uTmpPackets++;
+   pCard->uTotalFirstCopies++;
+}
+
+static void _radio_diversity_update_card_score(t_radio_diversity_card_stats* pCard)
+{
+   pCard->iDeliveryPerThousand = (int)((pCard->uTmpPackets * 1000) / s_uRadioDiversityTmpUniquePackets);
+   if ( pCard->iDeliveryPerThousand > 1000 )
+      pCard->iDeliveryPerThousand = 1000;
+
+   if ( pCard->uTmpFrames > 0 )
+      pCard->iFrameErrorsPerThousand = (int)((pCard->uTmpFramesBad * 1000) / pCard->uTmpFrames);
+   else
+      pCard->iFrameErrorsPerThousand = 1000;
+
+   int iSignalScore = 0;
+   if ( pCard->iTmpDbmCount > 0 )
+   {
+      pCard->iDbm = pCard->iTmpDbmSum / pCard->iTmpDbmCount;
+      // -95 dbm or less: 0, -45 dbm or more: 100
+      iSignalScore = (pCard->iDbm + 95) * 2;
+      if ( iSignalScore < 0 )
+         iSignalScore = 0;
+      if ( iSignalScore > 100 )
+         iSignalScore = 100;
+   }
+
+   int iLagScore = 0;
+   if ( pCard->uTmpPackets > 0 )
+   {
+      pCard->iAvgLagMs = (int)(pCard->uTmpLagSumMs / pCard->uTmpPackets);
+      iLagScore = 100 - (100 * pCard->iAvgLagMs) / RADIO_DIVERSITY_WINDOW_MS;
+      if ( iLagScore < 0 )
+         iLagScore = 0;
+   }
+
+   int iScore = (pCard->iDeliveryPerThousand * 6) / 10 + ((1000 - pCard->iFrameErrorsPerThousand) * 2) / 10 + iSignalScore + iLagScore;
+   if ( pCard->iScore < 0 )
+      pCard->iScore = iScore;
+   else
+      pCard->iScore = (pCard->iScore * 3 + iScore) / 4;
+}
+
+int radio_diversity_periodic_update(u32 uTimeNow)
+{
+   if ( (uTimeNow >= s_uRadioDiversityTimeLastUpdate) && (uTimeNow < s_uRadioDiversityTimeLastUpdate + RADIO_DIVERSITY_SCORE_INTERVAL_MS) )
+      return 0;
+   s_uRadioDiversityTimeLastUpdate = uTimeNow;
+
+   for( int i=0; i<RADIO_DIVERSITY_TRACKED_PACKETS; i++ )
+   {
+      if ( s_RadioDiversityPackets[i].uUsed )
+      if ( uTimeNow - s_RadioDiversityPackets[i].uTimeFirstRx > RADIO_DIVERSITY_WINDOW_MS )
+         _radio_diversity_close_packet(&s_RadioDiversityPackets[i]);
+   }
+
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      t_radio_diversity_card_stats* pCard = &s_RadioDiversityCards[i];
+      // Scores are not changed while the link is idle
+      if ( (s_uRadioDiversityTmpUniquePackets > 0) && (pCard->uTotalFrames > 0) )
+         _radio_diversity_update_card_score(pCard);
+      pCard->uTmpFrames = 0;
+      pCard->uTmpFramesBad = 0;
+      pCard->uTmpPackets = 0;
+      pCard->uTmpLagSumMs = 0;
+      pCard->iTmpDbmSum = 0;
+      pCard->iTmpDbmCount = 0;
+   }
+   s_uRadioDiversityTmpUniquePackets = 0;
+
+   // Best scored cards first; keeps the interfaces order for equal scores
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+      s_iRadioDiversityRxOrder[i] = i;
+   for( int i=1; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      int iCard = s_iRadioDiversityRxOrder[i];
+      int k = i-1;
+      while ( (k >= 0) && (s_RadioDiversityCards[s_iRadioDiversityRxOrder[k]].iScore < s_RadioDiversityCards[iCard].iScore) )
+      {
+         s_iRadioDiversityRxOrder[k+1] = s_iRadioDiversityRxOrder[k];
+         k--;
+      }
+      s_iRadioDiversityRxOrder[k+1] = iCard;
+   }
+   return 1;
+}
+
+int radio_diversity_get_card_score(int iInterfaceIndex)
+{
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return -1;
+   return s_RadioDiversityCards[iInterfaceIndex].iScore;
+}
+
+t_radio_diversity_card_stats* radio_diversity_get_card_stats(int iInterfaceIndex)
+{
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return NULL;
+   return &s_RadioDiversityCards[iInterfaceIndex];
+}
+
+int* radio_diversity_get_rx_order()
+{
+   return s_iRadioDiversityRxOrder;
+}
+
+void radio_diversity_log_info()
+{
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      t_radio_diversity_card_stats* pCard = &s_RadioDiversityCards[i];
+      if ( 0 == pCard->uTotalFrames )
+         continue;
+      log_line("[RadioDiversity] Radio interface %d: score: %d, delivered: %d/1000, bad frames: %d/1000, %d dbm, avg lag: %d ms; total packets: %u, first copies: %u, rescued: %u, late copies: %u",
+         i+1, pCard->iScore, pCard->iDeliveryPerThousand, pCard->iFrameErrorsPerThousand, pCard->iDbm, pCard->iAvgLagMs,
+         pCard->uTotalPackets, pCard->uTotalFirstCopies, pCard->uTotalRescuedPackets, pCard->uTotalLateCopies);
+   }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+
+// Receive diversity across multiple radio cards (runs in the radio rx thread).
+// Each received valid packet is tracked for a short window, keyed by vehicle and stream packet index,
+// together with the set of cards that delivered a copy of it. From that, each card gets a score
+// (0...1000) updated every RADIO_DIVERSITY_SCORE_INTERVAL_MS, from:
+//  - the share of the unique packets the card delivered within the window (most of the score);
+//  - the rate of good vs bad (FCS/CRC error) frames read from the card;
+//  - the signal level of the frames read from the card;
+//  - how late its copies arrive after the first copy of a packet (from any card).
+// The rx thread reads the cards in score order, so when several cards have copies of the same packet
+// ready at the same time, the copy from the best card is the one used. The station uses the scores to
+// pick the uplink tx card for each radio link.
+// A packet delivered only by one card while other cards were receiving too, is counted as rescued by
+// that card: without that card, the packet would have been lost.
+
+#define RADIO_DIVERSITY_WINDOW_MS 30
+// Must be a power of 2
+#define RADIO_DIVERSITY_TRACKED_PACKETS 1024
+#define RADIO_DIVERSITY_SCORE_INTERVAL_MS 250
+// A card is active if it received frames in this time
+#define RADIO_DIVERSITY_CARD_ACTIVE_MS 1000
+// Minimum score difference for switching the uplink tx card to a different card
+#define RADIO_DIVERSITY_TX_SWITCH_MARGIN 50
+
+typedef struct
+{
+   u32 uTotalFrames;
+   u32 uTotalFramesBad;
+   u32 uTotalPackets; // valid copies delivered within the window
+   u32 uTotalFirstCopies; // packets this card delivered before any other card
+   u32 uTotalLateCopies; // copies delivered after the window
+   u32 uTotalRescuedPackets;
+   u32 uTimeLastRxFrame;
+
+   u32 uTmpFrames;
+   u32 uTmpFramesBad;
+   u32 uTmpPackets;
+   u32 uTmpLagSumMs;
+   int iTmpDbmSum;
+   int iTmpDbmCount;
+
+   int iDeliveryPerThousand;
+   int iFrameErrorsPerThousand;
+   int iAvgLagMs;
+   int iDbm; // 1000 if unknown
+   int iScore; // 0...1000, -1 if not computed yet
+} ALIGN_STRUCT_SPEC_INFO t_radio_diversity_card_stats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void radio_diversity_init();
+// Called for each frame read from a card. iDbm is the best antenna signal, 1000 if unknown
+void radio_diversity_on_rx_frame(int iInterfaceIndex, int iDataIsOk, int iDbm, u32 uTimeNow);
+// Called for each valid radio packet received, before it's discarded if it's a duplicate
+void radio_diversity_on_rx_packet(int iInterfaceIndex, u8* pPacketBuffer, int iPacketLength, int iIsDuplicate, u32 uTimeNow);
+// Returns 1 if the scores were updated
+int radio_diversity_periodic_update(u32 uTimeNow);
+
+// -1 if no score yet
+int radio_diversity_get_card_score(int iInterfaceIndex);
+t_radio_diversity_card_stats* radio_diversity_get_card_stats(int iInterfaceIndex);
+// Radio interfaces indexes (MAX_RADIO_INTERFACES of them), best scored card first
+int* radio_diversity_get_rx_order();
+void radio_diversity_log_info();
+
+#ifdef __cplusplus
+}
+#endif
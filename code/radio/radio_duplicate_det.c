@@ -38,15 +38,23 @@
 #include "radiolink.h"
 
 
-#define PACKETS_INDEX_HASH_SIZE 512
-#define PACKETS_INDEX_HASH_MASK 0x01FF
+// Sliding window of received stream packet indexes (RFC 6479 style): a ring of 64 bit words,
+// one bit per packet index. The word holding the highest received index is shared with the
+// oldest packets, so the usable window is one word less than the ring size.
+#define DUP_DETECTION_WINDOW_WORDS 64
+#define DUP_DETECTION_WINDOW_WORDS_MASK (DUP_DETECTION_WINDOW_WORDS-1)
+#define DUP_DETECTION_WINDOW_SIZE ((DUP_DETECTION_WINDOW_WORDS-1)*64)
+
+// Must be a power of 2, larger than MAX_CONCURENT_VEHICLES
+#define DUP_DETECTION_VEHICLES_HASH_SIZE 16
+#define DUP_DETECTION_VEHICLES_HASH_MASK (DUP_DETECTION_VEHICLES_HASH_SIZE-1)
 
 typedef struct
 {
    u32 uMaxReceivedPacketIndex;
    u32 uLastReceivedPacketIndex;
    u32 uLastTimeReceivedPacket;
-   u32 packetsHashIndexes[PACKETS_INDEX_HASH_SIZE];
+   u64 uWindow[DUP_DETECTION_WINDOW_WORDS];
 } ALIGN_STRUCT_SPEC_INFO t_stream_history_packets_indexes;
 
 typedef struct
@@ -58,6 +66,9 @@ typedef struct
 
 t_vehicle_history_packets_indexes s_ListHistoryRxPacketsVehicles[MAX_CONCURENT_VEHICLES];
 
+// Vehicle id hash -> index in s_ListHistoryRxPacketsVehicles, -1 for empty slots
+int s_iDupDetectionVehiclesHash[DUP_DETECTION_VEHICLES_HASH_SIZE];
+
 extern u32 s_uRadioRxTimeNow;
 
 
@@ -75,8 +86,44 @@ void _radio_dd_reset_duplication_stats_for_vehicle(int iVehicleIndex, int iReaso
       s_ListHistoryRxPacketsVehicles[iVehicleIndex].streamsPacketsHistory[k].uMaxReceivedPacketIndex = 0;
       s_ListHistoryRxPacketsVehicles[iVehicleIndex].streamsPacketsHistory[k].uLastReceivedPacketIndex = MAX_U32;
       s_ListHistoryRxPacketsVehicles[iVehicleIndex].streamsPacketsHistory[k].uLastTimeReceivedPacket = 0;
-      memset((u8*)s_ListHistoryRxPacketsVehicles[iVehicleIndex].streamsPacketsHistory[k].packetsHashIndexes, 0xFF, PACKETS_INDEX_HASH_SIZE * sizeof(u32));
+      memset((u8*)s_ListHistoryRxPacketsVehicles[iVehicleIndex].streamsPacketsHistory[k].uWindow, 0, DUP_DETECTION_WINDOW_WORDS * sizeof(u64));
+   }
+}
+
+static inline int _radio_dd_hash_vehicle_id(u32 uVehicleId)
+{
+   return (int)((uVehicleId * 2654435761u) >> 24) & DUP_DETECTION_VEHICLES_HASH_MASK;
+}
+
+void _radio_dd_rebuild_vehicles_hash()
+{
+   for( int i=0; i<DUP_DETECTION_VEHICLES_HASH_SIZE; i++ )
+      s_iDupDetectionVehiclesHash[i] = -1;
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      if ( 0 == s_ListHistoryRxPacketsVehicles[i].uVehicleId )
+         continue;
+      int iSlot = _radio_dd_hash_vehicle_id(s_ListHistoryRxPacketsVehicles[i].uVehicleId);
+      while ( s_iDupDetectionVehiclesHash[iSlot] != -1 )
+         iSlot = (iSlot + 1) & DUP_DETECTION_VEHICLES_HASH_MASK;
+      s_iDupDetectionVehiclesHash[iSlot] = i;
+   }
+}
+
+// Returns -1 if the vehicle id is not in the hash
+static inline int _radio_dd_find_vehicle_index(u32 uVehicleId)
+{
+   int iSlot = _radio_dd_hash_vehicle_id(uVehicleId);
+   for( int i=0; i<DUP_DETECTION_VEHICLES_HASH_SIZE; i++ )
+   {
+      int iIndex = s_iDupDetectionVehiclesHash[iSlot];
+      if ( -1 == iIndex )
+         return -1;
+      if ( s_ListHistoryRxPacketsVehicles[iIndex].uVehicleId == uVehicleId )
+         return iIndex;
+      iSlot = (iSlot + 1) & DUP_DETECTION_VEHICLES_HASH_MASK;
    }
+   return -1;
 }
 
 
@@ -84,6 +131,7 @@ void radio_duplicate_detection_init()
 {
    for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
       _radio_dd_reset_duplication_stats_for_vehicle(i, 0);
+   _radio_dd_rebuild_vehicles_hash();
 }
 
 void radio_duplicate_detection_log_info()
@@ -110,8 +158,11 @@ void radio_duplicate_detection_log_info()
 
 int _radio_dup_detection_get_runtime_index_for_vid(u32 uVehicleId, u8* pPacketBuffer, int iPacketLength)
 {
-   int iStatsIndex = -1;
+   int iStatsIndex = _radio_dd_find_vehicle_index(uVehicleId);
+   if ( -1 != iStatsIndex )
+      return iStatsIndex;
 
+   // The hash is out of date if the vehicles list was changed by a reset
    for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
    {
       if ( uVehicleId == s_ListHistoryRxPacketsVehicles[i].uVehicleId )
@@ -121,7 +172,10 @@ int _radio_dup_detection_get_runtime_index_for_vid(u32 uVehicleId, u8* pPacketBu
       }
    }
    if ( iStatsIndex != -1 )
+   {
+      _radio_dd_rebuild_vehicles_hash();
       return iStatsIndex;
+   }
 
    // New vehicle id, add it to the runtime list
 
@@ -182,6 +236,7 @@ int _radio_dup_detection_get_runtime_index_for_vid(u32 uVehicleId, u8* pPacketBu
    s_ListHistoryRxPacketsVehicles[iStatsIndex].uVehicleId = uVehicleId;
    _radio_dd_reset_duplication_stats_for_vehicle(iStatsIndex, 1);
    s_ListHistoryRxPacketsVehicles[iStatsIndex].uVehicleId = uVehicleId;
+   _radio_dd_rebuild_vehicles_hash();
 
    szBuff[0] = 0;
    for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
@@ -224,9 +279,12 @@ int radio_dup_detection_is_duplicate(int iRadioInterfaceIndex, u8* pPacketBuffer
       uStreamIndex = (pPH->stream_packet_idx)>>PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX; 
       uPacketType = pPH->packet_type;   
    }
-   int iStatsIndex = -1;
+   if ( uStreamIndex >= MAX_RADIO_STREAMS )
+      return 1;
 
-   iStatsIndex = _radio_dup_detection_get_runtime_index_for_vid(uVehicleId, pPacketBuffer, iPacketLength);
+   int iStatsIndex = _radio_dd_find_vehicle_index(uVehicleId);
+   if ( -1 == iStatsIndex )
+      iStatsIndex = _radio_dup_detection_get_runtime_index_for_vid(uVehicleId, pPacketBuffer, iPacketLength);
    if ( -1 == iStatsIndex )
       return 1;
 
@@ -237,6 +295,8 @@ int radio_dup_detection_is_duplicate(int iRadioInterfaceIndex, u8* pPacketBuffer
 
    u32 uMaxDeltaForVideoStream = 2000;
    u32 uMaxDeltaForDataStream = 50;
+   // Only data streams use it; keep the radio info lookup out of the video packets path
+   if ( uStreamIndex < STREAM_ID_VIDEO_1 )
    if ( hardware_radio_index_is_serial_radio(iRadioInterfaceIndex) )
       uMaxDeltaForDataStream = 200;
 
@@ -288,23 +348,35 @@ int radio_dup_detection_is_duplicate(int iRadioInterfaceIndex, u8* pPacketBuffer
    // ---------------------------------------------------
    // Check for packet duplication on stream for vehicle
 
-   int bIsDuplicatePacket = 0;
-   int iHashIndex = uStreamPacketIndex & PACKETS_INDEX_HASH_MASK;
-   if ( uStreamPacketIndex == pDupInfo->streamsPacketsHistory[uStreamIndex].packetsHashIndexes[iHashIndex] )
-      bIsDuplicatePacket = 1;
-
-   if ( (uPacketType == PACKET_TYPE_RUBY_PING_CLOCK) || (uPacketType == PACKET_TYPE_RUBY_PING_CLOCK_REPLY) )
-      bIsDuplicatePacket = 0;
-
-   if ( bIsDuplicatePacket )
-      return 1;
+   t_stream_history_packets_indexes* pStreamInfo = &(pDupInfo->streamsPacketsHistory[uStreamIndex]);
+   int bIsPingClock = ((uPacketType == PACKET_TYPE_RUBY_PING_CLOCK) || (uPacketType == PACKET_TYPE_RUBY_PING_CLOCK_REPLY))?1:0;
+   u32 uWord = uStreamPacketIndex >> 6;
+   u64 uBit = ((u64)1) << (uStreamPacketIndex & 0x3F);
 
-   
-   pDupInfo->streamsPacketsHistory[uStreamIndex].packetsHashIndexes[iHashIndex] = uStreamPacketIndex;
-   pDupInfo->streamsPacketsHistory[uStreamIndex].uLastReceivedPacketIndex = uStreamPacketIndex;
-   if ( uStreamPacketIndex > pDupInfo->streamsPacketsHistory[uStreamIndex].uMaxReceivedPacketIndex )
-      pDupInfo->streamsPacketsHistory[uStreamIndex].uMaxReceivedPacketIndex = uStreamPacketIndex;
+   if ( uStreamPacketIndex > pStreamInfo->uMaxReceivedPacketIndex )
+   {
+      // Slide the window forward: clear the words skipped over (all of them on a large jump)
+      u32 uWordsToClear = uWord - (pStreamInfo->uMaxReceivedPacketIndex >> 6);
+      if ( uWordsToClear >= DUP_DETECTION_WINDOW_WORDS )
+         memset((u8*)pStreamInfo->uWindow, 0, DUP_DETECTION_WINDOW_WORDS * sizeof(u64));
+      else
+      {
+         for( u32 u=1; u<=uWordsToClear; u++ )
+            pStreamInfo->uWindow[((pStreamInfo->uMaxReceivedPacketIndex >> 6) + u) & DUP_DETECTION_WINDOW_WORDS_MASK] = 0;
+      }
+      pStreamInfo->uMaxReceivedPacketIndex = uStreamPacketIndex;
+   }
+   else
+   {
+      // Older than the window: can't tell if it was received, so treat it as duplicate
+      if ( (pStreamInfo->uMaxReceivedPacketIndex - uStreamPacketIndex >= DUP_DETECTION_WINDOW_SIZE) && (! bIsPingClock) )
+         return 1;
+      if ( (pStreamInfo->uWindow[uWord & DUP_DETECTION_WINDOW_WORDS_MASK] & uBit) && (! bIsPingClock) )
+         return 1;
+   }
 
+   pStreamInfo->uWindow[uWord & DUP_DETECTION_WINDOW_WORDS_MASK] |= uBit;
+   pStreamInfo->uLastReceivedPacketIndex = uStreamPacketIndex;
    pDupInfo->streamsPacketsHistory[uStreamIndex].uLastTimeReceivedPacket = s_uRadioRxTimeNow;
 
    // End - Check for packet duplication on stream for vehicle
@@ -320,11 +392,15 @@ void radio_duplicate_detection_remove_data_for_all_except(u32 uVehicleId)
       if ( (uVehicleId == 0) || (uVehicleId != s_ListHistoryRxPacketsVehicles[i].uVehicleId) )
          _radio_dd_reset_duplication_stats_for_vehicle(i, 3);
    }
+   _radio_dd_rebuild_vehicles_hash();
 }
 
 
 int radio_dup_detection_is_vehicle_restarted(u32 uVehicleId)
 {
+   int iIndex = _radio_dd_find_vehicle_index(uVehicleId);
+   if ( -1 != iIndex )
+      return s_ListHistoryRxPacketsVehicles[iIndex].iRestartDetected;
    for ( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
       if ( s_ListHistoryRxPacketsVehicles[i].uVehicleId == uVehicleId )
          return s_ListHistoryRxPacketsVehicles[i].iRestartDetected;
@@ -365,6 +441,10 @@ u32 radio_dup_detection_get_max_received_packet_index_for_stream(u32 uVehicleId,
    if ( uStreamId >= MAX_RADIO_STREAMS )
       return 0;
 
+   int iIndex = _radio_dd_find_vehicle_index(uVehicleId);
+   if ( -1 != iIndex )
+      return s_ListHistoryRxPacketsVehicles[iIndex].streamsPacketsHistory[uStreamId].uMaxReceivedPacketIndex;
+
    for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
    {
       if ( s_ListHistoryRxPacketsVehicles[i].uVehicleId == uVehicleId )
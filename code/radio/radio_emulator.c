@@ -0,0 +1,879 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <errno.h>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "radiotap.h"
+#include "radiolink.h"
+#include "radio_emulator.h"
+
+#define RADIO_EMULATOR_FRAME_MAGIC 0x52454D55
+#define RADIO_EMULATOR_IEEE_HEADER_LENGTH 24
+#define RADIO_EMULATOR_RX_RADIOTAP_MAX_LENGTH 16
+#define RADIO_EMULATOR_PCAP_LINKTYPE_RADIOTAP 127
+
+typedef struct
+{
+   u32 uMagic;
+   u32 uSenderProcessId;
+   u32 uFrequencyKhz;
+} __attribute__((packed)) t_radio_emulator_frame_header;
+
+#define RADIO_EMULATOR_MAX_FRAME_LENGTH ((int)sizeof(t_radio_emulator_frame_header) + RADIO_EMULATOR_RX_RADIOTAP_MAX_LENGTH + MAX_PACKET_LENGTH_PCAP)
+
+typedef struct
+{
+   u64 uDeliverTimeMicros;
+   u32 uOrder;
+   u32 uFrequencyKhz;
+   int iLength;
+   u8 uData[RADIO_EMULATOR_MAX_FRAME_LENGTH];
+} t_radio_emulator_queued_frame;
+
+static u8 s_uIEEEHeaderEmulatedRx[RADIO_EMULATOR_IEEE_HEADER_LENGTH] = {
+   0x08, 0x01, 0x00, 0x00,
+   0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // first byte is the encoded radio port
+   0x13, 0x12, 0x34, 0x56, 0x78, 0x90,
+   0x13, 0x12, 0x34, 0x56, 0x78, 0x90,
+   0x00, 0x00
+};
+
+static int s_bRadioEmulatorInitialized = 0;
+static t_radio_emulator_params s_RadioEmulatorParams;
+static t_radio_emulator_stats s_RadioEmulatorStats;
+static pthread_mutex_t s_MutexRadioEmulator = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_CondRadioEmulator;
+static pthread_t s_pThreadRadioEmulatorTx;
+static int s_bRadioEmulatorThreadStarted = 0;
+
+static u64 s_uRadioEmulatorRandomState = 1;
+static int s_bRadioEmulatorInBurst = 0;
+static u64 s_uRadioEmulatorAirBusyUntilMicros = 0;
+static u32 s_uRadioEmulatorFramesOrder = 0;
+
+static int s_iRadioEmulatorSocketTx = -1;
+static int s_iRadioEmulatorSocketsRx[MAX_RADIO_INTERFACES];
+static u32 s_uRadioEmulatorFrequenciesRx[MAX_RADIO_INTERFACES];
+static int s_iRadioEmulatorPortsRx[MAX_RADIO_INTERFACES];
+static u8 s_uRadioEmulatorRxBuffer[RADIO_EMULATOR_MAX_FRAME_LENGTH];
+
+static FILE* s_pRadioEmulatorRecordFile = NULL;
+static u32 s_uRadioEmulatorRecordedFrames = 0;
+
+// Delayed frames: a binary heap of slots, ordered by delivery time, then by send order
+static t_radio_emulator_queued_frame* s_pRadioEmulatorQueue = NULL;
+static int s_iRadioEmulatorHeap[RADIO_EMULATOR_MAX_QUEUED_FRAMES];
+static int s_iRadioEmulatorHeapCount = 0;
+static int s_iRadioEmulatorFreeSlots[RADIO_EMULATOR_MAX_QUEUED_FRAMES];
+static int s_iRadioEmulatorFreeSlotsCount = 0;
+
+static u64 _radio_emulator_now_micros()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return ((u64)t.tv_sec)*1000000LL + ((u64)t.tv_nsec)/1000LL;
+}
+
+static void _radio_emulator_seed(u32 uSeed)
+{
+   s_uRadioEmulatorRandomState = ((u64)uSeed) * 0x9E3779B97F4A7C15ULL + 1;
+   s_bRadioEmulatorInBurst = 0;
+}
+
+// xorshift64*, returns a value in [0, uRange)
+static u32 _radio_emulator_random(u32 uRange)
+{
+   s_uRadioEmulatorRandomState ^= s_uRadioEmulatorRandomState >> 12;
+   s_uRadioEmulatorRandomState ^= s_uRadioEmulatorRandomState << 25;
+   s_uRadioEmulatorRandomState ^= s_uRadioEmulatorRandomState >> 27;
+   u64 uValue = s_uRadioEmulatorRandomState * 0x2545F4914F6CDD1DULL;
+   if ( 0 == uRange )
+      return 0;
+   return (u32)((uValue >> 32) % uRange);
+}
+
+static int _radio_emulator_get_port(u32 uFrequencyKhz)
+{
+   return RADIO_EMULATOR_BASE_PORT + (int)((uFrequencyKhz/1000) % 10000);
+}
+
+static void _radio_emulator_init()
+{
+   if ( s_bRadioEmulatorInitialized )
+      return;
+   s_bRadioEmulatorInitialized = 1;
+
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      s_iRadioEmulatorSocketsRx[i] = -1;
+      s_uRadioEmulatorFrequenciesRx[i] = 0;
+      s_iRadioEmulatorPortsRx[i] = -1;
+   }
+   memset(&s_RadioEmulatorStats, 0, sizeof(s_RadioEmulatorStats));
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_CONFIG);
+   strcat(szFile, FILE_CONFIG_RADIO_EMULATOR);
+   if ( access(szFile, R_OK) != -1 )
+      radio_emulator_load_params(szFile);
+   else
+   {
+      radio_emulator_reset_params(&s_RadioEmulatorParams);
+      _radio_emulator_seed(s_RadioEmulatorParams.uSeed);
+   }
+}
+
+void radio_emulator_reset_params(t_radio_emulator_params* pParams)
+{
+   if ( NULL == pParams )
+      return;
+   memset(pParams, 0, sizeof(t_radio_emulator_params));
+   pParams->uSeed = 1;
+   pParams->iEmulateAirtime = 1;
+   pParams->iSignalDBm = -50;
+}
+
+int radio_emulator_load_params(const char* szFile)
+{
+   s_bRadioEmulatorInitialized = 1;
+   radio_emulator_reset_params(&s_RadioEmulatorParams);
+
+   FILE* fd = NULL;
+   if ( NULL != szFile )
+      fd = fopen(szFile, "r");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to read settings file [%s]. Using default settings.", (NULL != szFile)?szFile:"N/A");
+      _radio_emulator_seed(s_RadioEmulatorParams.uSeed);
+      return 0;
+   }
+
+   char szLine[256];
+   char szKey[64];
+   char szValue[MAX_FILE_PATH_SIZE];
+   while ( NULL != fgets(szLine, 255, fd) )
+   {
+      if ( 2 != sscanf(szLine, "%63s %127s", szKey, szValue) )
+         continue;
+      int iValue = atoi(szValue);
+      if ( 0 == strcmp(szKey, "seed") )
+         s_RadioEmulatorParams.uSeed = (u32)strtoul(szValue, NULL, 10);
+      else if ( 0 == strcmp(szKey, "loss") )
+         s_RadioEmulatorParams.iLossPerThousand = iValue;
+      else if ( 0 == strcmp(szKey, "burst_enter") )
+         s_RadioEmulatorParams.iBurstEnterPerThousand = iValue;
+      else if ( 0 == strcmp(szKey, "burst_exit") )
+         s_RadioEmulatorParams.iBurstExitPerThousand = iValue;
+      else if ( 0 == strcmp(szKey, "burst_loss") )
+         s_RadioEmulatorParams.iBurstLossPerThousand = iValue;
+      else if ( 0 == strcmp(szKey, "latency_us") )
+         s_RadioEmulatorParams.iLatencyMicros = iValue;
+      else if ( 0 == strcmp(szKey, "jitter_us") )
+         s_RadioEmulatorParams.iJitterMicros = iValue;
+      else if ( 0 == strcmp(szKey, "airtime") )
+         s_RadioEmulatorParams.iEmulateAirtime = iValue;
+      else if ( 0 == strcmp(szKey, "signal_dbm") )
+         s_RadioEmulatorParams.iSignalDBm = iValue;
+      else if ( 0 == strcmp(szKey, "record") )
+         strcpy(s_RadioEmulatorParams.szRecordFile, szValue);
+   }
+   fclose(fd);
+
+   _radio_emulator_seed(s_RadioEmulatorParams.uSeed);
+   log_line("[RadioEmulator] Loaded settings from [%s]: seed %u, loss %d/1000, burst loss (enter %d, exit %d, loss %d)/1000, latency %d us, jitter %d us, airtime: %s",
+      szFile, s_RadioEmulatorParams.uSeed, s_RadioEmulatorParams.iLossPerThousand,
+      s_RadioEmulatorParams.iBurstEnterPerThousand, s_RadioEmulatorParams.iBurstExitPerThousand, s_RadioEmulatorParams.iBurstLossPerThousand,
+      s_RadioEmulatorParams.iLatencyMicros, s_RadioEmulatorParams.iJitterMicros, s_RadioEmulatorParams.iEmulateAirtime?"yes":"no");
+   return 1;
+}
+
+void radio_emulator_set_params(t_radio_emulator_params* pParams)
+{
+   _radio_emulator_init();
+   if ( NULL == pParams )
+      return;
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   if ( (NULL != s_pRadioEmulatorRecordFile) && (0 != strcmp(s_RadioEmulatorParams.szRecordFile, pParams->szRecordFile)) )
+   {
+      fclose(s_pRadioEmulatorRecordFile);
+      s_pRadioEmulatorRecordFile = NULL;
+   }
+   memcpy(&s_RadioEmulatorParams, pParams, sizeof(t_radio_emulator_params));
+   _radio_emulator_seed(s_RadioEmulatorParams.uSeed);
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+}
+
+t_radio_emulator_params* radio_emulator_get_params()
+{
+   _radio_emulator_init();
+   return &s_RadioEmulatorParams;
+}
+
+void radio_emulator_get_stats(t_radio_emulator_stats* pStats)
+{
+   if ( NULL == pStats )
+      return;
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   memcpy(pStats, &s_RadioEmulatorStats, sizeof(t_radio_emulator_stats));
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+}
+
+void radio_emulator_reset_stats()
+{
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   memset(&s_RadioEmulatorStats, 0, sizeof(t_radio_emulator_stats));
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+}
+
+// Returns the datarate (positive: bps, negative: MCS index - 1) or 0 if not found
+
+static int _radio_emulator_get_frame_datarate(u8* pRadiotap, int iLength)
+{
+   struct ieee80211_radiotap_iterator rti;
+   if ( ieee80211_radiotap_iterator_init(&rti, (struct ieee80211_radiotap_header *)pRadiotap, iLength) < 0 )
+      return 0;
+
+   int iDataRate = 0;
+   while ( ieee80211_radiotap_iterator_next(&rti) == 0 )
+   {
+      if ( rti.this_arg_index == IEEE80211_RADIOTAP_RATE )
+         iDataRate = ((int)(*((u8*)(rti.this_arg)))) * 500000;
+      else if ( rti.this_arg_index == IEEE80211_RADIOTAP_MCS )
+         iDataRate = -((int)rti.this_arg[2]) - 1;
+   }
+   return iDataRate;
+}
+
+// Radiotap header as received from a radio card: flags, rate or MCS, signal, antenna
+
+static int _radio_emulator_write_rx_radiotap(u8* pOutput, int iDataRate)
+{
+   u32 uPresent = (1<<IEEE80211_RADIOTAP_FLAGS) | (1<<IEEE80211_RADIOTAP_DBM_ANTSIGNAL) | (1<<IEEE80211_RADIOTAP_ANTENNA);
+   if ( iDataRate < 0 )
+      uPresent |= (1<<IEEE80211_RADIOTAP_MCS);
+   else
+      uPresent |= (1<<IEEE80211_RADIOTAP_RATE);
+
+   int iPos = 8;
+   pOutput[iPos++] = 0; // flags
+   if ( iDataRate >= 0 )
+      pOutput[iPos++] = (u8)(iDataRate/500000);
+   pOutput[iPos++] = (u8)((int8_t)s_RadioEmulatorParams.iSignalDBm);
+   pOutput[iPos++] = 0; // antenna
+   if ( iDataRate < 0 )
+   {
+      pOutput[iPos++] = IEEE80211_RADIOTAP_MCS_HAVE_MCS | IEEE80211_RADIOTAP_MCS_HAVE_BW | IEEE80211_RADIOTAP_MCS_HAVE_GI;
+      pOutput[iPos++] = 0;
+      pOutput[iPos++] = (u8)(-iDataRate-1);
+   }
+
+   pOutput[0] = 0;
+   pOutput[1] = 0;
+   pOutput[2] = (u8)(iPos & 0xFF);
+   pOutput[3] = (u8)(iPos >> 8);
+   pOutput[4] = (u8)(uPresent & 0xFF);
+   pOutput[5] = (u8)((uPresent >> 8) & 0xFF);
+   pOutput[6] = (u8)((uPresent >> 16) & 0xFF);
+   pOutput[7] = (u8)((uPresent >> 24) & 0xFF);
+   return iPos;
+}
+
+static void _radio_emulator_record_frame(u8* pFrame, int iLength)
+{
+   if ( 0 == s_RadioEmulatorParams.szRecordFile[0] )
+      return;
+
+   if ( NULL == s_pRadioEmulatorRecordFile )
+   {
+      s_pRadioEmulatorRecordFile = fopen(s_RadioEmulatorParams.szRecordFile, "wb");
+      if ( NULL == s_pRadioEmulatorRecordFile )
+      {
+         log_softerror_and_alarm("[RadioEmulator] Failed to create record file [%s]", s_RadioEmulatorParams.szRecordFile);
+         s_RadioEmulatorParams.szRecordFile[0] = 0;
+         return;
+      }
+      u32 uHeader[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, RADIO_EMULATOR_PCAP_LINKTYPE_RADIOTAP };
+      fwrite(uHeader, 1, sizeof(uHeader), s_pRadioEmulatorRecordFile);
+      log_line("[RadioEmulator] Recording radio frames to [%s]", s_RadioEmulatorParams.szRecordFile);
+   }
+
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   u32 uRecord[4] = { (u32)tv.tv_sec, (u32)tv.tv_usec, (u32)iLength, (u32)iLength };
+   fwrite(uRecord, 1, sizeof(uRecord), s_pRadioEmulatorRecordFile);
+   fwrite(pFrame, 1, iLength, s_pRadioEmulatorRecordFile);
+   s_uRadioEmulatorRecordedFrames++;
+   if ( 0 == (s_uRadioEmulatorRecordedFrames % 100) )
+      fflush(s_pRadioEmulatorRecordFile);
+}
+
+static int _radio_emulator_open_tx_socket()
+{
+   if ( -1 != s_iRadioEmulatorSocketTx )
+      return s_iRadioEmulatorSocketTx;
+
+   int iSocket = socket(AF_INET, SOCK_DGRAM, 0);
+   if ( iSocket < 0 )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to create tx socket, error: %s", strerror(errno));
+      return -1;
+   }
+   struct in_addr addrInterface;
+   addrInterface.s_addr = inet_addr("127.0.0.1");
+   u8 uLoop = 1;
+   u8 uTTL = 0;
+   int iBufferSize = 1024*1024;
+   if ( (0 != setsockopt(iSocket, IPPROTO_IP, IP_MULTICAST_IF, &addrInterface, sizeof(addrInterface))) ||
+        (0 != setsockopt(iSocket, IPPROTO_IP, IP_MULTICAST_LOOP, &uLoop, sizeof(uLoop))) ||
+        (0 != setsockopt(iSocket, IPPROTO_IP, IP_MULTICAST_TTL, &uTTL, sizeof(uTTL))) )
+      log_softerror_and_alarm("[RadioEmulator] Failed to set the multicast options on the tx socket, error: %s", strerror(errno));
+   setsockopt(iSocket, SOL_SOCKET, SO_SNDBUF, &iBufferSize, sizeof(iBufferSize));
+   s_iRadioEmulatorSocketTx = iSocket;
+   return iSocket;
+}
+
+// Must be called with the mutex locked
+static void _radio_emulator_send_on_medium(u32 uFrequencyKhz, u8* pData, int iLength)
+{
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = inet_addr(RADIO_EMULATOR_MULTICAST_GROUP);
+   addr.sin_port = htons(_radio_emulator_get_port(uFrequencyKhz));
+
+   if ( sendto(s_iRadioEmulatorSocketTx, pData, iLength, 0, (struct sockaddr*)&addr, sizeof(addr)) != iLength )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to send frame (%d bytes) on the medium, error: %s", iLength, strerror(errno));
+      return;
+   }
+   s_RadioEmulatorStats.uFramesDelivered++;
+   _radio_emulator_record_frame(pData + sizeof(t_radio_emulator_frame_header), iLength - (int)sizeof(t_radio_emulator_frame_header));
+}
+
+static int _radio_emulator_heap_less(int iSlotA, int iSlotB)
+{
+   t_radio_emulator_queued_frame* pA = &s_pRadioEmulatorQueue[iSlotA];
+   t_radio_emulator_queued_frame* pB = &s_pRadioEmulatorQueue[iSlotB];
+   if ( pA->uDeliverTimeMicros != pB->uDeliverTimeMicros )
+      return pA->uDeliverTimeMicros < pB->uDeliverTimeMicros;
+   return (int)(pA->uOrder - pB->uOrder) < 0;
+}
+
+static void _radio_emulator_heap_push(int iSlot)
+{
+   int iPos = s_iRadioEmulatorHeapCount++;
+   s_iRadioEmulatorHeap[iPos] = iSlot;
+   while ( iPos > 0 )
+   {
+      int iParent = (iPos-1)/2;
+      if ( ! _radio_emulator_heap_less(s_iRadioEmulatorHeap[iPos], s_iRadioEmulatorHeap[iParent]) )
+         break;
+      int iTmp = s_iRadioEmulatorHeap[iPos];
+      s_iRadioEmulatorHeap[iPos] = s_iRadioEmulatorHeap[iParent];
+      s_iRadioEmulatorHeap[iParent] = iTmp;
+      iPos = iParent;
+   }
+}
+
+static int _radio_emulator_heap_pop()
+{
+   int iSlot = s_iRadioEmulatorHeap[0];
+   s_iRadioEmulatorHeapCount--;
+   s_iRadioEmulatorHeap[0] = s_iRadioEmulatorHeap[s_iRadioEmulatorHeapCount];
+   int iPos = 0;
+   while ( 1 )
+   {
+      int iSmallest = iPos;
+      int iLeft = 2*iPos+1;
+      int iRight = 2*iPos+2;
+      if ( (iLeft < s_iRadioEmulatorHeapCount) && _radio_emulator_heap_less(s_iRadioEmulatorHeap[iLeft], s_iRadioEmulatorHeap[iSmallest]) )
+         iSmallest = iLeft;
+      if ( (iRight < s_iRadioEmulatorHeapCount) && _radio_emulator_heap_less(s_iRadioEmulatorHeap[iRight], s_iRadioEmulatorHeap[iSmallest]) )
+         iSmallest = iRight;
+      if ( iSmallest == iPos )
+         break;
+      int iTmp = s_iRadioEmulatorHeap[iPos];
+      s_iRadioEmulatorHeap[iPos] = s_iRadioEmulatorHeap[iSmallest];
+      s_iRadioEmulatorHeap[iSmallest] = iTmp;
+      iPos = iSmallest;
+   }
+   return iSlot;
+}
+
+static void* _thread_radio_emulator_tx(void *argument)
+{
+   log_line("[RadioEmulator] Started delayed frames thread.");
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   while ( 1 )
+   {
+      if ( 0 == s_iRadioEmulatorHeapCount )
+      {
+         pthread_cond_wait(&s_CondRadioEmulator, &s_MutexRadioEmulator);
+         continue;
+      }
+      t_radio_emulator_queued_frame* pFrame = &s_pRadioEmulatorQueue[s_iRadioEmulatorHeap[0]];
+      u64 uTimeNow = _radio_emulator_now_micros();
+      if ( pFrame->uDeliverTimeMicros > uTimeNow )
+      {
+         struct timespec ts;
+         ts.tv_sec = (time_t)(pFrame->uDeliverTimeMicros / 1000000LL);
+         ts.tv_nsec = (long)((pFrame->uDeliverTimeMicros % 1000000LL) * 1000LL);
+         pthread_cond_timedwait(&s_CondRadioEmulator, &s_MutexRadioEmulator, &ts);
+         continue;
+      }
+      int iSlot = _radio_emulator_heap_pop();
+      _radio_emulator_send_on_medium(s_pRadioEmulatorQueue[iSlot].uFrequencyKhz, s_pRadioEmulatorQueue[iSlot].uData, s_pRadioEmulatorQueue[iSlot].iLength);
+      s_iRadioEmulatorFreeSlots[s_iRadioEmulatorFreeSlotsCount++] = iSlot;
+      if ( 0 == s_iRadioEmulatorHeapCount )
+         pthread_cond_broadcast(&s_CondRadioEmulator);
+   }
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+   return NULL;
+}
+
+// Must be called with the mutex locked
+static int _radio_emulator_start_tx_thread()
+{
+   if ( s_bRadioEmulatorThreadStarted )
+      return 1;
+
+   s_pRadioEmulatorQueue = (t_radio_emulator_queued_frame*) malloc(RADIO_EMULATOR_MAX_QUEUED_FRAMES * sizeof(t_radio_emulator_queued_frame));
+   if ( NULL == s_pRadioEmulatorQueue )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to allocate the delayed frames queue.");
+      return 0;
+   }
+   s_iRadioEmulatorHeapCount = 0;
+   s_iRadioEmulatorFreeSlotsCount = 0;
+   for( int i=RADIO_EMULATOR_MAX_QUEUED_FRAMES-1; i>=0; i-- )
+      s_iRadioEmulatorFreeSlots[s_iRadioEmulatorFreeSlotsCount++] = i;
+
+   pthread_condattr_t attr;
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   pthread_cond_init(&s_CondRadioEmulator, &attr);
+   pthread_condattr_destroy(&attr);
+
+   if ( 0 != pthread_create(&s_pThreadRadioEmulatorTx, NULL, &_thread_radio_emulator_tx, NULL) )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to create the delayed frames thread.");
+      free(s_pRadioEmulatorQueue);
+      s_pRadioEmulatorQueue = NULL;
+      return 0;
+   }
+   pthread_detach(s_pThreadRadioEmulatorTx);
+   s_bRadioEmulatorThreadStarted = 1;
+   return 1;
+}
+
+// Applies the link impairments and sends the frame on the medium now or later.
+// pData starts with the emulator frame header. Must be called with the mutex locked.
+
+static void _radio_emulator_transmit(u32 uFrequencyKhz, u8* pData, int iLength, int iDataRate)
+{
+   s_RadioEmulatorStats.uFramesSent++;
+
+   if ( (s_RadioEmulatorParams.iBurstEnterPerThousand > 0) || s_bRadioEmulatorInBurst )
+   {
+      if ( s_bRadioEmulatorInBurst )
+      {
+         if ( (int)_radio_emulator_random(1000) < s_RadioEmulatorParams.iBurstExitPerThousand )
+            s_bRadioEmulatorInBurst = 0;
+      }
+      else if ( (int)_radio_emulator_random(1000) < s_RadioEmulatorParams.iBurstEnterPerThousand )
+         s_bRadioEmulatorInBurst = 1;
+
+      if ( s_bRadioEmulatorInBurst && ((int)_radio_emulator_random(1000) < s_RadioEmulatorParams.iBurstLossPerThousand) )
+      {
+         s_RadioEmulatorStats.uFramesLost++;
+         s_RadioEmulatorStats.uFramesLostInBursts++;
+         return;
+      }
+   }
+   if ( s_RadioEmulatorParams.iLossPerThousand > 0 )
+   if ( (int)_radio_emulator_random(1000) < s_RadioEmulatorParams.iLossPerThousand )
+   {
+      s_RadioEmulatorStats.uFramesLost++;
+      return;
+   }
+
+   u64 uTimeNow = _radio_emulator_now_micros();
+   u64 uDeliverTime = uTimeNow;
+   u32 uDataRateBPS = getRealDataRateFromRadioDataRate(iDataRate, 0);
+   if ( s_RadioEmulatorParams.iEmulateAirtime && (0 != iDataRate) && (uDataRateBPS > 0) )
+   {
+      // Preamble plus the frame bits at the frame datarate; frames wait for the medium to be free
+      u64 uAirtime = 20 + ((u64)(iLength - (int)sizeof(t_radio_emulator_frame_header))) * 8LL * 1000000LL / uDataRateBPS;
+      if ( s_uRadioEmulatorAirBusyUntilMicros < uTimeNow )
+         s_uRadioEmulatorAirBusyUntilMicros = uTimeNow;
+      s_uRadioEmulatorAirBusyUntilMicros += uAirtime;
+      uDeliverTime = s_uRadioEmulatorAirBusyUntilMicros;
+      s_RadioEmulatorStats.uAirtimeMicros += uAirtime;
+   }
+   uDeliverTime += s_RadioEmulatorParams.iLatencyMicros;
+   if ( s_RadioEmulatorParams.iJitterMicros > 0 )
+      uDeliverTime += _radio_emulator_random(s_RadioEmulatorParams.iJitterMicros + 1);
+
+   if ( (uDeliverTime <= uTimeNow) && (0 == s_iRadioEmulatorHeapCount) )
+   {
+      _radio_emulator_send_on_medium(uFrequencyKhz, pData, iLength);
+      return;
+   }
+
+   if ( ! _radio_emulator_start_tx_thread() )
+      return;
+   if ( 0 == s_iRadioEmulatorFreeSlotsCount )
+   {
+      // Same as a full radio card tx queue
+      s_RadioEmulatorStats.uFramesDroppedQueueFull++;
+      return;
+   }
+   int iSlot = s_iRadioEmulatorFreeSlots[--s_iRadioEmulatorFreeSlotsCount];
+   t_radio_emulator_queued_frame* pFrame = &s_pRadioEmulatorQueue[iSlot];
+   pFrame->uDeliverTimeMicros = uDeliverTime;
+   pFrame->uOrder = s_uRadioEmulatorFramesOrder++;
+   pFrame->uFrequencyKhz = uFrequencyKhz;
+   pFrame->iLength = iLength;
+   memcpy(pFrame->uData, pData, iLength);
+   _radio_emulator_heap_push(iSlot);
+   if ( s_iRadioEmulatorHeapCount > (int)s_RadioEmulatorStats.uMaxQueuedFrames )
+      s_RadioEmulatorStats.uMaxQueuedFrames = s_iRadioEmulatorHeapCount;
+   if ( s_iRadioEmulatorHeap[0] == iSlot )
+      pthread_cond_broadcast(&s_CondRadioEmulator);
+}
+
+static void _radio_emulator_write_frame_header(u8* pData, u32 uFrequencyKhz)
+{
+   t_radio_emulator_frame_header* pHeader = (t_radio_emulator_frame_header*)pData;
+   pHeader->uMagic = RADIO_EMULATOR_FRAME_MAGIC;
+   pHeader->uSenderProcessId = (u32)getpid();
+   pHeader->uFrequencyKhz = uFrequencyKhz;
+}
+
+int radio_emulator_open_for_read(int iInterfaceIndex, u32 uFrequencyKhz, int iPortEncoded)
+{
+   _radio_emulator_init();
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return -1;
+   if ( -1 != s_iRadioEmulatorSocketsRx[iInterfaceIndex] )
+      radio_emulator_close_for_read(iInterfaceIndex);
+
+   int iSocket = socket(AF_INET, SOCK_DGRAM, 0);
+   if ( iSocket < 0 )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to create rx socket, error: %s", strerror(errno));
+      return -1;
+   }
+   int iOne = 1;
+   int iBufferSize = 2*1024*1024;
+   setsockopt(iSocket, SOL_SOCKET, SO_REUSEADDR, &iOne, sizeof(iOne));
+   setsockopt(iSocket, SOL_SOCKET, SO_REUSEPORT, &iOne, sizeof(iOne));
+   setsockopt(iSocket, SOL_SOCKET, SO_RCVBUF, &iBufferSize, sizeof(iBufferSize));
+
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = inet_addr(RADIO_EMULATOR_MULTICAST_GROUP);
+   addr.sin_port = htons(_radio_emulator_get_port(uFrequencyKhz));
+   if ( bind(iSocket, (struct sockaddr*)&addr, sizeof(addr)) < 0 )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to bind rx socket to port %d, error: %s", _radio_emulator_get_port(uFrequencyKhz), strerror(errno));
+      close(iSocket);
+      return -1;
+   }
+
+   struct ip_mreq mreq;
+   mreq.imr_multiaddr.s_addr = inet_addr(RADIO_EMULATOR_MULTICAST_GROUP);
+   mreq.imr_interface.s_addr = inet_addr("127.0.0.1");
+   if ( 0 != setsockopt(iSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to join the medium multicast group, error: %s", strerror(errno));
+      close(iSocket);
+      return -1;
+   }
+   fcntl(iSocket, F_SETFL, fcntl(iSocket, F_GETFL, 0) | O_NONBLOCK);
+
+   s_iRadioEmulatorSocketsRx[iInterfaceIndex] = iSocket;
+   s_uRadioEmulatorFrequenciesRx[iInterfaceIndex] = uFrequencyKhz;
+   s_iRadioEmulatorPortsRx[iInterfaceIndex] = iPortEncoded;
+   log_line("[RadioEmulator] Opened emulated radio interface %d for read on %u kHz (medium port %d), radio port 0x%02X, fd: %d",
+      iInterfaceIndex+1, uFrequencyKhz, _radio_emulator_get_port(uFrequencyKhz), iPortEncoded, iSocket);
+   return iSocket;
+}
+
+int radio_emulator_open_for_write(int iInterfaceIndex)
+{
+   _radio_emulator_init();
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return -1;
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   int iSocket = _radio_emulator_open_tx_socket();
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+   log_line("[RadioEmulator] Opened emulated radio interface %d for write, fd: %d", iInterfaceIndex+1, iSocket);
+   return iSocket;
+}
+
+void radio_emulator_close_for_read(int iInterfaceIndex)
+{
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) || (! s_bRadioEmulatorInitialized) )
+      return;
+   if ( -1 != s_iRadioEmulatorSocketsRx[iInterfaceIndex] )
+      close(s_iRadioEmulatorSocketsRx[iInterfaceIndex]);
+   s_iRadioEmulatorSocketsRx[iInterfaceIndex] = -1;
+   s_iRadioEmulatorPortsRx[iInterfaceIndex] = -1;
+}
+
+void radio_emulator_close_for_write(int iInterfaceIndex)
+{
+   // The tx socket is shared by all the emulated interfaces and by the delayed frames thread
+   radio_emulator_flush(100);
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   if ( NULL != s_pRadioEmulatorRecordFile )
+      fflush(s_pRadioEmulatorRecordFile);
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+}
+
+int radio_emulator_write(int iInterfaceIndex, u32 uFrequencyKhz, u8* pData, int iLength)
+{
+   _radio_emulator_init();
+   if ( (NULL == pData) || (iLength < 8) || (-1 == s_iRadioEmulatorSocketTx) )
+      return -1;
+
+   int iRadiotapLength = pData[2] | (((int)pData[3]) << 8);
+   if ( iRadiotapLength + 5 > iLength )
+      return -1;
+
+   // Short data and RTS frames have just the frame control, duration and port
+   u8* pIEEE = pData + iRadiotapLength;
+   int iIEEELength = 5;
+   if ( (pIEEE[0] == 0x08) && (iLength >= iRadiotapLength + RADIO_EMULATOR_IEEE_HEADER_LENGTH) )
+   if ( (pIEEE[10] == 0x13) && (pIEEE[11] == 0x12) && (pIEEE[12] == 0x34) && (pIEEE[13] == 0x56) )
+      iIEEELength = RADIO_EMULATOR_IEEE_HEADER_LENGTH;
+
+   int iPayloadLength = iLength - iRadiotapLength - iIEEELength;
+   if ( iPayloadLength + RADIO_EMULATOR_IEEE_HEADER_LENGTH > MAX_PACKET_LENGTH_PCAP )
+      return -1;
+
+   u8 uFrame[RADIO_EMULATOR_MAX_FRAME_LENGTH];
+   int iDataRate = _radio_emulator_get_frame_datarate(pData, iRadiotapLength);
+   _radio_emulator_write_frame_header(uFrame, uFrequencyKhz);
+   int iPos = sizeof(t_radio_emulator_frame_header);
+   iPos += _radio_emulator_write_rx_radiotap(uFrame + iPos, iDataRate);
+   memcpy(uFrame + iPos, s_uIEEEHeaderEmulatedRx, RADIO_EMULATOR_IEEE_HEADER_LENGTH);
+   uFrame[iPos + 4] = pIEEE[4];
+   if ( iIEEELength == RADIO_EMULATOR_IEEE_HEADER_LENGTH )
+   {
+      uFrame[iPos + 22] = pIEEE[22];
+      uFrame[iPos + 23] = pIEEE[23];
+   }
+   iPos += RADIO_EMULATOR_IEEE_HEADER_LENGTH;
+   memcpy(uFrame + iPos, pIEEE + iIEEELength, iPayloadLength);
+   iPos += iPayloadLength;
+
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   _radio_emulator_transmit(uFrequencyKhz, uFrame, iPos, iDataRate);
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+   return iLength;
+}
+
+u8* radio_emulator_read(int iInterfaceIndex, int* piLength)
+{
+   if ( NULL != piLength )
+      *piLength = 0;
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) || (! s_bRadioEmulatorInitialized) )
+      return NULL;
+   int iSocket = s_iRadioEmulatorSocketsRx[iInterfaceIndex];
+   if ( -1 == iSocket )
+      return NULL;
+
+   u32 uProcessId = (u32)getpid();
+   while ( 1 )
+   {
+      int iLength = recv(iSocket, s_uRadioEmulatorRxBuffer, sizeof(s_uRadioEmulatorRxBuffer), 0);
+      if ( iLength <= 0 )
+         return NULL;
+      if ( iLength < (int)sizeof(t_radio_emulator_frame_header) + 8 )
+         continue;
+
+      t_radio_emulator_frame_header* pHeader = (t_radio_emulator_frame_header*)s_uRadioEmulatorRxBuffer;
+      if ( (pHeader->uMagic != RADIO_EMULATOR_FRAME_MAGIC) || (pHeader->uSenderProcessId == uProcessId) )
+         continue;
+      if ( pHeader->uFrequencyKhz != s_uRadioEmulatorFrequenciesRx[iInterfaceIndex] )
+         continue;
+
+      // Same checks as the pcap filter used for the radio cards
+      u8* pFrame = s_uRadioEmulatorRxBuffer + sizeof(t_radio_emulator_frame_header);
+      iLength -= sizeof(t_radio_emulator_frame_header);
+      int iRadiotapLength = pFrame[2] | (((int)pFrame[3]) << 8);
+      if ( iRadiotapLength + RADIO_EMULATOR_IEEE_HEADER_LENGTH > iLength )
+         continue;
+      u8* pIEEE = pFrame + iRadiotapLength;
+      if ( (pIEEE[0] != 0x08) || (pIEEE[1] != 0x01) || (pIEEE[10] != 0x13) || (pIEEE[11] != 0x12) || (pIEEE[12] != 0x34) || (pIEEE[13] != 0x56) )
+         continue;
+      if ( (int)pIEEE[4] != s_iRadioEmulatorPortsRx[iInterfaceIndex] )
+         continue;
+
+      s_RadioEmulatorStats.uFramesReceived++;
+      if ( NULL != piLength )
+         *piLength = iLength;
+      return pFrame;
+   }
+   return NULL;
+}
+
+void radio_emulator_flush(u32 uTimeoutMs)
+{
+   u64 uTimeEnd = _radio_emulator_now_micros() + ((u64)uTimeoutMs)*1000LL;
+   pthread_mutex_lock(&s_MutexRadioEmulator);
+   while ( s_bRadioEmulatorThreadStarted && (s_iRadioEmulatorHeapCount > 0) )
+   {
+      if ( _radio_emulator_now_micros() >= uTimeEnd )
+         break;
+      struct timespec ts;
+      ts.tv_sec = (time_t)(uTimeEnd / 1000000LL);
+      ts.tv_nsec = (long)((uTimeEnd % 1000000LL) * 1000LL);
+      pthread_cond_timedwait(&s_CondRadioEmulator, &s_MutexRadioEmulator, &ts);
+   }
+   if ( NULL != s_pRadioEmulatorRecordFile )
+      fflush(s_pRadioEmulatorRecordFile);
+   pthread_mutex_unlock(&s_MutexRadioEmulator);
+}
+
+static u32 _radio_emulator_swap32(u32 uValue, int bSwap)
+{
+   if ( ! bSwap )
+      return uValue;
+   return ((uValue & 0xFF) << 24) | ((uValue & 0xFF00) << 8) | ((uValue >> 8) & 0xFF00) | (uValue >> 24);
+}
+
+int radio_emulator_replay_pcap(const char* szFile, u32 uFrequencyKhz, int iSpeedPercent)
+{
+   _radio_emulator_init();
+   if ( (NULL == szFile) || (-1 == radio_emulator_open_for_write(0)) )
+      return -1;
+
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Failed to open pcap file [%s]", szFile);
+      return -1;
+   }
+
+   u32 uHeader[6];
+   if ( 1 != fread(uHeader, sizeof(uHeader), 1, fd) )
+   {
+      log_softerror_and_alarm("[RadioEmulator] Invalid pcap file [%s]", szFile);
+      fclose(fd);
+      return -1;
+   }
+   int bSwap = 0;
+   int bNanoseconds = 0;
+   if ( (uHeader[0] == 0xd4c3b2a1) || (uHeader[0] == 0x4d3cb2a1) )
+      bSwap = 1;
+   u32 uMagic = _radio_emulator_swap32(uHeader[0], bSwap);
+   if ( uMagic == 0xa1b23c4d )
+      bNanoseconds = 1;
+   if ( ((uMagic != 0xa1b2c3d4) && (uMagic != 0xa1b23c4d)) || (_radio_emulator_swap32(uHeader[5], bSwap) != RADIO_EMULATOR_PCAP_LINKTYPE_RADIOTAP) )
+   {
+      log_softerror_and_alarm("[RadioEmulator] File [%s] is not a radiotap pcap capture (magic: 0x%08X, link type: %u)", szFile, uMagic, _radio_emulator_swap32(uHeader[5], bSwap));
+      fclose(fd);
+      return -1;
+   }
+
+   u8 uFrame[RADIO_EMULATOR_MAX_FRAME_LENGTH];
+   u8* pFrame = uFrame + sizeof(t_radio_emulator_frame_header);
+   int iCountSent = 0;
+   int iCountSkipped = 0;
+   u64 uFirstRecordTime = 0;
+   u64 uStartTime = _radio_emulator_now_micros();
+   u32 uRecord[4];
+
+   while ( 1 == fread(uRecord, sizeof(uRecord), 1, fd) )
+   {
+      u64 uRecordTime = ((u64)_radio_emulator_swap32(uRecord[0], bSwap)) * 1000000LL;
+      if ( bNanoseconds )
+         uRecordTime += _radio_emulator_swap32(uRecord[1], bSwap)/1000;
+      else
+         uRecordTime += _radio_emulator_swap32(uRecord[1], bSwap);
+      int iLength = (int)_radio_emulator_swap32(uRecord[2], bSwap);
+
+      if ( (iLength <= 0) || (iLength > MAX_PACKET_LENGTH_PCAP) )
+      {
+         if ( (iLength <= 0) || (0 != fseek(fd, iLength, SEEK_CUR)) )
+            break;
+         iCountSkipped++;
+         continue;
+      }
+      if ( 1 != fread(pFrame, iLength, 1, fd) )
+         break;
+
+      // Only Ruby data frames, as the radio cards filter them
+      int iRadiotapLength = pFrame[2] | (((int)pFrame[3]) << 8);
+      u8* pIEEE = pFrame + iRadiotapLength;
+      if ( (iRadiotapLength + RADIO_EMULATOR_IEEE_HEADER_LENGTH > iLength) ||
+           (pIEEE[0] != 0x08) || (pIEEE[10] != 0x13) || (pIEEE[11] != 0x12) || (pIEEE[12] != 0x34) || (pIEEE[13] != 0x56) )
+      {
+         iCountSkipped++;
+         continue;
+      }
+
+      if ( 0 == uFirstRecordTime )
+         uFirstRecordTime = uRecordTime;
+      if ( (iSpeedPercent > 0) && (uRecordTime > uFirstRecordTime) )
+      {
+         u64 uSendTime = uStartTime + (uRecordTime - uFirstRecordTime) * 100LL / (u64)iSpeedPercent;
+         u64 uTimeNow = _radio_emulator_now_micros();
+         if ( uSendTime > uTimeNow )
+            hardware_sleep_micros((u32)(uSendTime - uTimeNow));
+      }
+
+      _radio_emulator_write_frame_header(uFrame, uFrequencyKhz);
+      int iDataRate = _radio_emulator_get_frame_datarate(pFrame, iRadiotapLength);
+      pthread_mutex_lock(&s_MutexRadioEmulator);
+      _radio_emulator_transmit(uFrequencyKhz, uFrame, iLength + (int)sizeof(t_radio_emulator_frame_header), iDataRate);
+      pthread_mutex_unlock(&s_MutexRadioEmulator);
+      iCountSent++;
+   }
+   fclose(fd);
+
+   radio_emulator_flush(1000);
+   log_line("[RadioEmulator] Replayed %d frames from [%s] on %u kHz, skipped %d frames.", iCountSent, szFile, uFrequencyKhz, iCountSkipped);
+   return iCountSent;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+
+// Emulated radio medium, used by radiolink.c for radio interfaces with the RADIO_HW_DRIVER_EMULATED driver.
+// Radio frames are carried as UDP multicast datagrams on the loopback interface, one multicast port
+// for each radio frequency, so any number of processes (vehicle, controller, test tools) can share the medium.
+// The transmitter applies the link impairments (random and burst loss, latency, jitter, airtime for the
+// frame datarate) using a seeded random generator, so runs with the same seed and traffic are repeatable.
+// Received frames look like the ones captured by pcap from a radio card: a radiotap header followed
+// by the full IEEE 802.11 data header and the radio packets.
+//
+// Settings are read from FOLDER_CONFIG FILE_CONFIG_RADIO_EMULATOR, one "name value" pair on each line:
+//    interfaces 1        number of emulated radio interfaces (used by hardware_radio.c)
+//    seed 1              random generator seed
+//    loss 0              independent frame loss, per thousand frames
+//    burst_enter 0       Gilbert-Elliott burst loss: chance to enter the bad state, per thousand frames
+//    burst_exit 0        chance to leave the bad state, per thousand frames
+//    burst_loss 0        frame loss while in the bad state, per thousand frames
+//    latency_us 0        fixed delivery latency
+//    jitter_us 0         random extra delivery latency (frames can get reordered)
+//    airtime 1           serialize the frames using the airtime of their datarate
+//    signal_dbm -50      signal strength reported to the receivers
+//    record <file>       save all the frames sent on the medium to a radiotap pcap file
+
+#define RADIO_EMULATOR_MULTICAST_GROUP "239.255.77.1"
+#define RADIO_EMULATOR_BASE_PORT 41000
+#define RADIO_EMULATOR_MAX_QUEUED_FRAMES 512
+
+typedef struct
+{
+   u32 uSeed;
+   int iLossPerThousand;
+   int iBurstEnterPerThousand;
+   int iBurstExitPerThousand;
+   int iBurstLossPerThousand;
+   int iLatencyMicros;
+   int iJitterMicros;
+   int iEmulateAirtime;
+   int iSignalDBm;
+   char szRecordFile[MAX_FILE_PATH_SIZE];
+} t_radio_emulator_params;
+
+typedef struct
+{
+   u32 uFramesSent;
+   u32 uFramesLost;
+   u32 uFramesLostInBursts;
+   u32 uFramesDroppedQueueFull;
+   u32 uFramesDelivered;
+   u32 uFramesReceived;
+   u32 uMaxQueuedFrames;
+   u64 uAirtimeMicros;
+} t_radio_emulator_stats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void radio_emulator_reset_params(t_radio_emulator_params* pParams);
+// Returns 0 if the settings file could not be read (the default settings are used then)
+int radio_emulator_load_params(const char* szFile);
+void radio_emulator_set_params(t_radio_emulator_params* pParams);
+t_radio_emulator_params* radio_emulator_get_params();
+void radio_emulator_get_stats(t_radio_emulator_stats* pStats);
+void radio_emulator_reset_stats();
+
+// Return a selectable fd or -1 on failure. iPortEncoded is the encoded radio port the interface listens to.
+int radio_emulator_open_for_read(int iInterfaceIndex, u32 uFrequencyKhz, int iPortEncoded);
+int radio_emulator_open_for_write(int iInterfaceIndex);
+void radio_emulator_close_for_read(int iInterfaceIndex);
+void radio_emulator_close_for_write(int iInterfaceIndex);
+
+// pData is a radio frame as built by radiolink.c (radiotap tx header, IEEE header, radio packets).
+// Returns the number of bytes accepted (lost frames are accepted too, as on a real radio link), or -1 on error.
+int radio_emulator_write(int iInterfaceIndex, u32 uFrequencyKhz, u8* pData, int iLength);
+// Returns the next received frame or NULL if there is none right now.
+u8* radio_emulator_read(int iInterfaceIndex, int* piLength);
+// Waits until all the delayed frames are sent on the medium (or the timeout expires)
+void radio_emulator_flush(u32 uTimeoutMs);
+
+// Sends the frames from a radiotap pcap capture on the medium, keeping their recorded timing.
+// iSpeedPercent: 100 for the recorded speed, 0 to send them as fast as possible.
+// Returns the number of frames sent or -1 on error.
+int radio_emulator_replay_pcap(const char* szFile, u32 uFrequencyKhz, int iSpeedPercent);
+
+#ifdef __cplusplus
+}
+#endif
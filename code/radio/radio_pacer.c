@@ -0,0 +1,264 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "radio_pacer.h"
+
+typedef struct
+{
+   u32 uDataRateBPS; // last datarate used on the link
+   int iVideoTokensMicros; // can go negative: one packet over the budget, or priority packets over their share
+   int iPriorityTokensMicros;
+   u32 uTimeLastRefillMicros;
+   u32 uTimeLastVideoMicros;
+   int bCarriesVideo;
+   int bIsDeferred;
+   u32 uAirBusyUntilMicros;
+   u32 uTimeLastPacketMicros;
+   u32 uLastPacketAirtimeMicros;
+   u32 uCurrentBurstPackets;
+   t_radio_pacer_link_stats stats;
+} ALIGN_STRUCT_SPEC_INFO t_radio_pacer_link;
+
+static int s_bRadioPacerEnabled = 1;
+static t_radio_pacer_link s_RadioPacerLinks[MAX_RADIO_INTERFACES];
+static t_radio_pacer_queue_stats s_RadioPacerQueueStats;
+
+void radio_pacer_init()
+{
+   memset(s_RadioPacerLinks, 0, sizeof(s_RadioPacerLinks));
+   memset(&s_RadioPacerQueueStats, 0, sizeof(s_RadioPacerQueueStats));
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      s_RadioPacerLinks[i].iVideoTokensMicros = RADIO_PACER_VIDEO_BURST_MICROS;
+      s_RadioPacerLinks[i].iPriorityTokensMicros = RADIO_PACER_PRIORITY_BURST_MICROS;
+   }
+   log_line("[RadioPacer] Init: %d%% of airtime, %d%% reserved for priority packets, %d/%d us max bursts, %s.",
+      RADIO_PACER_AIRTIME_PERCENT, RADIO_PACER_RESERVED_PERCENT, RADIO_PACER_VIDEO_BURST_MICROS, RADIO_PACER_PRIORITY_BURST_MICROS,
+      s_bRadioPacerEnabled?"enabled":"disabled");
+}
+
+void radio_pacer_set_enabled(int iEnabled)
+{
+   if ( s_bRadioPacerEnabled == iEnabled )
+      return;
+   s_bRadioPacerEnabled = iEnabled;
+   log_line("[RadioPacer] Pacing is now %s.", s_bRadioPacerEnabled?"enabled":"disabled");
+}
+
+int radio_pacer_is_enabled()
+{
+   return s_bRadioPacerEnabled;
+}
+
+void radio_pacer_reset_stats()
+{
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+      memset(&s_RadioPacerLinks[i].stats, 0, sizeof(t_radio_pacer_link_stats));
+   memset(&s_RadioPacerQueueStats, 0, sizeof(s_RadioPacerQueueStats));
+}
+
+u32 radio_pacer_get_packet_airtime_micros(int iPacketLength, u32 uDataRateBPS)
+{
+   if ( 0 == uDataRateBPS )
+      uDataRateBPS = getRealDataRateFromRadioDataRate(DEFAULT_RADIO_DATARATE_VIDEO, 0);
+   return RADIO_PACER_PREAMBLE_MICROS + (u32)(((u64)(iPacketLength + RADIO_PACER_MAC_OVERHEAD_BYTES)) * 8LL * 1000000LL / uDataRateBPS);
+}
+
+static void _radio_pacer_refill(t_radio_pacer_link* pLink, u32 uTimeNowMicros)
+{
+   u32 uElapsed = uTimeNowMicros - pLink->uTimeLastRefillMicros;
+   pLink->uTimeLastRefillMicros = uTimeNowMicros;
+   // Also handles the first use of the link and timestamps going back
+   if ( uElapsed > 1000000 )
+      uElapsed = 1000000;
+
+   int iTotal = (int)(uElapsed * RADIO_PACER_AIRTIME_PERCENT / 100);
+   int iPriority = (int)(uElapsed * RADIO_PACER_RESERVED_PERCENT / 100);
+   pLink->iPriorityTokensMicros += iPriority;
+   int iVideo = iTotal - iPriority;
+
+   // Unused reserved share goes to video
+   if ( pLink->iPriorityTokensMicros > RADIO_PACER_PRIORITY_BURST_MICROS )
+   {
+      iVideo += pLink->iPriorityTokensMicros - RADIO_PACER_PRIORITY_BURST_MICROS;
+      pLink->iPriorityTokensMicros = RADIO_PACER_PRIORITY_BURST_MICROS;
+   }
+   pLink->iVideoTokensMicros += iVideo;
+   if ( pLink->iVideoTokensMicros > RADIO_PACER_VIDEO_BURST_MICROS )
+      pLink->iVideoTokensMicros = RADIO_PACER_VIDEO_BURST_MICROS;
+}
+
+static void _radio_pacer_update_bursts(t_radio_pacer_link* pLink, u32 uAirtimeMicros, u32 uTimeNowMicros)
+{
+   // A burst ends when the radio card had the time to send the previous packet before the next one
+   if ( (pLink->uCurrentBurstPackets > 0) && (uTimeNowMicros - pLink->uTimeLastPacketMicros >= pLink->uLastPacketAirtimeMicros) )
+   {
+      pLink->stats.uBursts++;
+      pLink->stats.uBurstsPackets += pLink->uCurrentBurstPackets;
+      pLink->uCurrentBurstPackets = 0;
+   }
+   pLink->uCurrentBurstPackets++;
+   pLink->uTimeLastPacketMicros = uTimeNowMicros;
+   pLink->uLastPacketAirtimeMicros = uAirtimeMicros;
+   if ( pLink->uCurrentBurstPackets > pLink->stats.uMaxBurstPackets )
+      pLink->stats.uMaxBurstPackets = pLink->uCurrentBurstPackets;
+
+   // Estimated airtime queued in the radio card
+   if ( (int)(pLink->uAirBusyUntilMicros - uTimeNowMicros) < 0 )
+      pLink->uAirBusyUntilMicros = uTimeNowMicros;
+   pLink->uAirBusyUntilMicros += uAirtimeMicros;
+   u32 uBacklog = pLink->uAirBusyUntilMicros - uTimeNowMicros;
+   if ( uBacklog > pLink->stats.uMaxBacklogMicros )
+      pLink->stats.uMaxBacklogMicros = uBacklog;
+}
+
+void radio_pacer_on_packet_sent(int iLocalRadioLinkId, int iPacketLength, u32 uDataRateBPS, int iIsPriority, u32 uTimeNowMicros)
+{
+   if ( (iLocalRadioLinkId < 0) || (iLocalRadioLinkId >= MAX_RADIO_INTERFACES) || (iPacketLength <= 0) )
+      return;
+
+   t_radio_pacer_link* pLink = &s_RadioPacerLinks[iLocalRadioLinkId];
+   _radio_pacer_refill(pLink, uTimeNowMicros);
+   if ( 0 != uDataRateBPS )
+      pLink->uDataRateBPS = uDataRateBPS;
+
+   int iAirtime = (int)radio_pacer_get_packet_airtime_micros(iPacketLength, pLink->uDataRateBPS);
+   _radio_pacer_update_bursts(pLink, (u32)iAirtime, uTimeNowMicros);
+
+   if ( ! iIsPriority )
+   {
+      pLink->iVideoTokensMicros -= iAirtime;
+      pLink->bCarriesVideo = 1;
+      pLink->uTimeLastVideoMicros = uTimeNowMicros;
+      pLink->stats.uPacketsVideo++;
+      pLink->stats.uAirtimeVideoMicros += iAirtime;
+      return;
+   }
+
+   pLink->stats.uPacketsPriority++;
+   pLink->stats.uAirtimePriorityMicros += iAirtime;
+   if ( pLink->iPriorityTokensMicros >= iAirtime )
+   {
+      pLink->iPriorityTokensMicros -= iAirtime;
+      return;
+   }
+   // Over the reserved share: sent anyway, the rest of its airtime is taken from video
+   pLink->stats.uPacketsPriorityOverShare++;
+   if ( pLink->iPriorityTokensMicros > 0 )
+   {
+      iAirtime -= pLink->iPriorityTokensMicros;
+      pLink->iPriorityTokensMicros = 0;
+   }
+   pLink->iVideoTokensMicros -= iAirtime;
+   if ( pLink->iVideoTokensMicros < -RADIO_PACER_VIDEO_BURST_MICROS )
+      pLink->iVideoTokensMicros = -RADIO_PACER_VIDEO_BURST_MICROS;
+}
+
+int radio_pacer_can_send_video(u32 uTimeNowMicros)
+{
+   if ( ! s_bRadioPacerEnabled )
+      return 1;
+
+   int iCanSend = 1;
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      t_radio_pacer_link* pLink = &s_RadioPacerLinks[i];
+      if ( ! pLink->bCarriesVideo )
+         continue;
+      if ( uTimeNowMicros - pLink->uTimeLastVideoMicros > RADIO_PACER_VIDEO_LINK_TIMEOUT_MICROS )
+      {
+         pLink->bCarriesVideo = 0;
+         continue;
+      }
+      _radio_pacer_refill(pLink, uTimeNowMicros);
+      if ( pLink->iVideoTokensMicros > 0 )
+      {
+         pLink->bIsDeferred = 0;
+         continue;
+      }
+      if ( ! pLink->bIsDeferred )
+         pLink->stats.uVideoDeferrals++;
+      pLink->bIsDeferred = 1;
+      iCanSend = 0;
+   }
+   return iCanSend;
+}
+
+void radio_pacer_on_video_queue_delay(u32 uDelayMicros)
+{
+   s_RadioPacerQueueStats.uVideoQueueDelayCount++;
+   s_RadioPacerQueueStats.uVideoQueueDelaySumMicros += uDelayMicros;
+   if ( uDelayMicros > s_RadioPacerQueueStats.uVideoQueueDelayMaxMicros )
+      s_RadioPacerQueueStats.uVideoQueueDelayMaxMicros = uDelayMicros;
+}
+
+int radio_pacer_get_video_tokens_micros(int iLocalRadioLinkId, u32 uTimeNowMicros)
+{
+   if ( (iLocalRadioLinkId < 0) || (iLocalRadioLinkId >= MAX_RADIO_INTERFACES) )
+      return 0;
+   _radio_pacer_refill(&s_RadioPacerLinks[iLocalRadioLinkId], uTimeNowMicros);
+   return s_RadioPacerLinks[iLocalRadioLinkId].iVideoTokensMicros;
+}
+
+t_radio_pacer_link_stats* radio_pacer_get_link_stats(int iLocalRadioLinkId)
+{
+   if ( (iLocalRadioLinkId < 0) || (iLocalRadioLinkId >= MAX_RADIO_INTERFACES) )
+      return NULL;
+   return &s_RadioPacerLinks[iLocalRadioLinkId].stats;
+}
+
+t_radio_pacer_queue_stats* radio_pacer_get_queue_stats()
+{
+   return &s_RadioPacerQueueStats;
+}
+
+void radio_pacer_log_info()
+{
+   t_radio_pacer_queue_stats* pQueue = &s_RadioPacerQueueStats;
+   log_line("[RadioPacer] Pacing %s. Video tx queue delay: avg %u us, max %u us (%u packets)",
+      s_bRadioPacerEnabled?"enabled":"disabled",
+      (pQueue->uVideoQueueDelayCount > 0)?(u32)(pQueue->uVideoQueueDelaySumMicros / pQueue->uVideoQueueDelayCount):0,
+      pQueue->uVideoQueueDelayMaxMicros, pQueue->uVideoQueueDelayCount);
+
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      t_radio_pacer_link_stats* pStats = &s_RadioPacerLinks[i].stats;
+      if ( (0 == pStats->uPacketsVideo) && (0 == pStats->uPacketsPriority) )
+         continue;
+      log_line("[RadioPacer] Radio link %d: %u bps, video: %u pkts (%u ms airtime, held %u times), priority: %u pkts (%u ms airtime, %u over share), bursts: avg %u pkts, max %u pkts, max card backlog %u us",
+         i+1, s_RadioPacerLinks[i].uDataRateBPS,
+         pStats->uPacketsVideo, (u32)(pStats->uAirtimeVideoMicros/1000), pStats->uVideoDeferrals,
+         pStats->uPacketsPriority, (u32)(pStats->uAirtimePriorityMicros/1000), pStats->uPacketsPriorityOverShare,
+         (pStats->uBursts > 0)?(pStats->uBurstsPackets/pStats->uBursts):0, pStats->uMaxBurstPackets, pStats->uMaxBacklogMicros);
+   }
+}
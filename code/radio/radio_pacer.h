@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+
+// Airtime pacing of the vehicle radio tx, one token bucket for each local radio link.
+// Tokens are airtime microseconds, computed from the radio datarate used for each packet, the
+// packet length plus the 802.11 header overhead, and the frame preamble. The buckets refill with
+// RADIO_PACER_AIRTIME_PERCENT of the elapsed time, so the radio cards tx queues do not build up.
+// RADIO_PACER_RESERVED_PERCENT of it goes to the priority traffic (telemetry, commands, RC acks,
+// video retransmissions): priority packets are never held, they use the reserved share first and
+// then the video share. Video packets are sent only while the video bucket of all the radio links
+// that carry video has tokens, so large (I-frame) bursts go out at the link airtime pace instead of
+// at line rate, and priority packets do not wait behind a full card queue.
+
+#define RADIO_PACER_AIRTIME_PERCENT 90
+#define RADIO_PACER_RESERVED_PERCENT 15
+// Buckets depth, this is the largest burst sent to a radio card at once
+#define RADIO_PACER_VIDEO_BURST_MICROS 4000
+#define RADIO_PACER_PRIORITY_BURST_MICROS 3000
+#define RADIO_PACER_PREAMBLE_MICROS 40
+// 802.11 data header and FCS
+#define RADIO_PACER_MAC_OVERHEAD_BYTES 28
+// A radio link is paced for video if it sent video in this time
+#define RADIO_PACER_VIDEO_LINK_TIMEOUT_MICROS 1000000
+
+typedef struct
+{
+   u32 uPacketsVideo;
+   u32 uPacketsPriority;
+   u32 uPacketsPriorityOverShare; // priority packets that used the video share
+   u64 uAirtimeVideoMicros;
+   u64 uAirtimePriorityMicros;
+   u32 uVideoDeferrals; // times video was held back
+   // A burst is a run of packets written to the radio card faster than it can send them
+   u32 uBursts;
+   u32 uBurstsPackets;
+   u32 uMaxBurstPackets;
+   u32 uMaxBacklogMicros; // largest estimated airtime queued in the radio card
+} ALIGN_STRUCT_SPEC_INFO t_radio_pacer_link_stats;
+
+typedef struct
+{
+   // Time video packets waited in the video tx buffer
+   u32 uVideoQueueDelayCount;
+   u64 uVideoQueueDelaySumMicros;
+   u32 uVideoQueueDelayMaxMicros;
+} ALIGN_STRUCT_SPEC_INFO t_radio_pacer_queue_stats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void radio_pacer_init();
+void radio_pacer_set_enabled(int iEnabled);
+int radio_pacer_is_enabled();
+void radio_pacer_reset_stats();
+
+// uDataRateBPS is the real datarate, in bps
+u32 radio_pacer_get_packet_airtime_micros(int iPacketLength, u32 uDataRateBPS);
+// Called for each packet written to a radio interface of the radio link
+void radio_pacer_on_packet_sent(int iLocalRadioLinkId, int iPacketLength, u32 uDataRateBPS, int iIsPriority, u32 uTimeNowMicros);
+// Returns 1 if a video packet can be sent now (always 1 if pacing is disabled)
+int radio_pacer_can_send_video(u32 uTimeNowMicros);
+void radio_pacer_on_video_queue_delay(u32 uDelayMicros);
+
+int radio_pacer_get_video_tokens_micros(int iLocalRadioLinkId, u32 uTimeNowMicros);
+t_radio_pacer_link_stats* radio_pacer_get_link_stats(int iLocalRadioLinkId);
+t_radio_pacer_queue_stats* radio_pacer_get_queue_stats();
+void radio_pacer_log_info();
+
+#ifdef __cplusplus
+}
+#endif
@@ -33,11 +33,13 @@
 #include "../base/encr.h"
 #include "../base/config_hw.h"
 #include "../base/hw_procs.h"
+#include "../base/profiler.h"
 #include "../common/radio_stats.h"
 #include "../common/string_utils.h"
 #include "radio_rx.h"
 #include "radiolink.h"
 #include "radio_duplicate_det.h"
+#include "radio_diversity.h"
 
 int s_iRadioRxInitialized = 0;
 int s_iRadioRxSingalStop = 0;
@@ -72,6 +74,8 @@ u8 s_tmpLastProcessedRadioRxPacket[MAX_PACKET_TOTAL_SIZE];
 
 u32 s_uLastRxShortPacketsVehicleIds[MAX_RADIO_INTERFACES];
 
+t_radio_rx_fast_path_callback s_pRadioRxFastPathCallback = NULL;
+
 // Pointers to array of int-s (max radio cards, for each card)
 u8* s_pPacketsCounterOutputVideo = NULL;
 u8* s_pPacketsCounterOutputECVideo = NULL;
@@ -142,6 +146,17 @@ int _radio_rx_update_local_stats_on_new_radio_packet(int iInterface, int iIsShor
 
    int nReturnLost = 0;
 
+   int iDbm = 1000;
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iInterface);
+   if ( (NULL != pRadioHWInfo) && (! iIsShortPacket) )
+   for( int i=0; i<pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo.nAntennaCount; i++ )
+   {
+      if ( pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo.nDbmLast[i] < 500 )
+      if ( (iDbm > 500) || (pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo.nDbmLast[i] > iDbm) )
+         iDbm = pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo.nDbmLast[i];
+   }
+   radio_diversity_on_rx_frame(iInterface, iDataIsOk, iDbm, s_uRadioRxTimeNow);
+
    t_radio_rx_state_vehicle* pStatsVehicle = _radio_rx_get_stats_structure_for_vehicle(uVehicleId);
 
    if ( iDataIsOk )
@@ -349,12 +364,18 @@ void _radio_rx_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterf
 
 void _radio_rx_check_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterfaceIndex)
 {   
-   if ( radio_dup_detection_is_duplicate(iRadioInterfaceIndex, pPacket, iLength, s_uRadioRxTimeNow) )
+   int iIsDuplicate = radio_dup_detection_is_duplicate(iRadioInterfaceIndex, pPacket, iLength, s_uRadioRxTimeNow);
+   radio_diversity_on_rx_packet(iRadioInterfaceIndex, pPacket, iLength, iIsDuplicate, s_uRadioRxTimeNow);
+   if ( iIsDuplicate )
       return;
 
    if ( NULL != s_pSMRadioStats )
      radio_stats_update_on_unique_packet_received(s_pSMRadioStats, s_pSMRadioRxGraphs, s_uRadioRxTimeNow, iRadioInterfaceIndex, pPacket, iLength);
 
+   if ( NULL != s_pRadioRxFastPathCallback )
+   if ( s_pRadioRxFastPathCallback(iRadioInterfaceIndex, pPacket, iLength) )
+      return;
+
    _radio_rx_add_packet_to_rx_queue(pPacket, iLength, iRadioInterfaceIndex);
 }
 
@@ -587,6 +608,8 @@ int _radio_rx_parse_received_wifi_radio_data(int iInterfaceIndex)
       pBuffer = radio_process_wlan_data_in(iInterfaceIndex, &iBufferLength);
       if ( NULL == pBuffer )
          break;
+      // Arrival time of this frame, used for duplicates and cards lag
+      s_uRadioRxTimeNow = get_current_timestamp_ms();
 
       u8* pData = pBuffer;
       int iLength = iBufferLength;
@@ -723,8 +746,8 @@ int _radio_rx_parse_received_wifi_radio_data(int iInterfaceIndex)
             log_softerror_and_alarm("[RadioRxThread] Received broken packet (wrong CRC) on radio interface %d. Packet size: %d bytes, type: %s",
                iInterfaceIndex+1, pPH->total_length, str_get_packet_type(pPH->packet_type));
             iDataIsOk = 0;
-            pData += pPH->total_length;
-            iRemainingLength -= pPH->total_length; 
+            pData += iThisLen;
+            iRemainingLength -= iThisLen;
             continue;
          }
 
@@ -736,7 +759,11 @@ int _radio_rx_parse_received_wifi_radio_data(int iInterfaceIndex)
             iRemainingLength -= iThisLen;
             continue;
          }
-         _radio_rx_check_add_packet_to_rx_queue(pData, iThisLen, iInterfaceIndex);
+         // Decrypted packets are shorter than on air (no encryption trailer)
+         if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_FLAGS_MASK_COMPRESSED_HEADER )
+            _radio_rx_check_add_packet_to_rx_queue(pData, pPH->total_length, iInterfaceIndex);
+         else
+            _radio_rx_check_add_packet_to_rx_queue(pData, iThisLen, iInterfaceIndex);
 
          pData += iThisLen;
          iRemainingLength -= iThisLen;
@@ -838,6 +865,7 @@ void _radio_rx_update_stats(u32 uTimeNow)
       s_RadioRxState.queue_reg_priority.iStatsMaxPacketsInQueueLastMinute = 0;
 
       radio_duplicate_detection_log_info();
+      radio_diversity_log_info();
 
       if ( (s_iCounterRadioRxStatsUpdate2 % 10) == 0 )
       {
@@ -861,6 +889,7 @@ static void * _thread_radio_rx(void *argument)
    else if ( s_iDefaultRxThreadPriority != -1 )
       s_iDefaultRxThreadPriority = hw_increase_current_thread_priority("[RadioRxThread]", s_iDefaultRxThreadPriority);
 
+   profiler_register_thread("radio_rx");
    log_line("[RadioRxThread] Initialized State. Waiting for rx messages...");
 
    int* piQuit = (int*) argument;
@@ -927,6 +956,16 @@ static void * _thread_radio_rx(void *argument)
          }
       }
 
+      if ( radio_diversity_periodic_update(uTime) )
+      if ( NULL != s_pSMRadioStats )
+      {
+         for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+         {
+            s_pSMRadioStats->radio_interfaces_local[i].iDiversityScore = radio_diversity_get_card_score(i);
+            s_pSMRadioStats->radio_interfaces_local[i].uDiversityRescuedPackets = radio_diversity_get_card_stats(i)->uTotalRescuedPackets;
+         }
+      }
+
       _radio_rx_update_fd_sets();
 
       if ( s_iRadioRxCountFDs <= 0 )
@@ -961,11 +1000,17 @@ static void * _thread_radio_rx(void *argument)
       memset(iParsedPackets, 0, sizeof(int)*MAX_RADIO_INTERFACES);
 
       // Repeat reading while we have max reads on at leas one interface
+      // Read the best scored cards first, so their copies of duplicate packets are the ones used
+      int* piRxOrder = radio_diversity_get_rx_order();
+      PROFILER_BEGIN(PROFILER_SECTION_RX_THREAD_READ);
       do
       {
          iMaxedInterface = -1;
-         for(int iInterfaceIndex=0; iInterfaceIndex<hardware_get_radio_interfaces_count(); iInterfaceIndex++)
+         for( int iOrder=0; iOrder<MAX_RADIO_INTERFACES; iOrder++ )
          {
+            int iInterfaceIndex = piRxOrder[iOrder];
+            if ( iInterfaceIndex >= hardware_get_radio_interfaces_count() )
+               continue;
             radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iInterfaceIndex);
             if( (NULL == pRadioHWInfo) || (s_iRadioRxPausedInterfaces[iInterfaceIndex]) || (0 == FD_ISSET(pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd, &s_RadioRxReadSet)) )
                continue;
@@ -993,8 +1038,10 @@ static void * _thread_radio_rx(void *argument)
             }
          }
       } while (iMaxedInterface != -1);
+      PROFILER_END(PROFILER_SECTION_RX_THREAD_READ);
    }
 
+   profiler_unregister_thread();
    log_line("[RadioRxThread] Stopped.");
    return NULL;
 }
@@ -1010,6 +1057,7 @@ int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, shared_mem_r
    s_iRadioRxSingalStop = 0;
    s_RadioRxState.uAcceptedFirmwareType = uAcceptedFirmwareType;
    radio_rx_reset_interfaces_broken_state();
+   radio_diversity_init();
 
    for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
       s_iRadioRxPausedInterfaces[i] = 0;
@@ -1280,6 +1328,11 @@ void radio_rx_set_air_gap_track_output(u8* pCounterRxAirgap)
    s_pRxAirGapTracking = pCounterRxAirgap;
 }
 
+void radio_rx_set_fast_path_callback(t_radio_rx_fast_path_callback pCallback)
+{
+   s_pRadioRxFastPathCallback = pCallback;
+}
+
 int radio_rx_detect_firmware_type_from_packet(u8* pPacketBuffer, int nPacketLength)
 {
    if ( (NULL == pPacketBuffer) || (nPacketLength < 4) )
@@ -1290,12 +1343,9 @@ int radio_rx_detect_firmware_type_from_packet(u8* pPacketBuffer, int nPacketLeng
       t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
       if ( pPH->total_length > nPacketLength )
       {
+         // Encrypted packets can only be checked by decrypting them (radio_process_received...)
          if ( pPH->packet_flags & PACKET_FLAGS_BIT_HAS_ENCRYPTION )
-         {
-            int dx = sizeof(t_packet_header) - sizeof(u32) - sizeof(u32);
-            int l = nPacketLength-dx;
-            dpp(pPacketBuffer + dx, l);
-         }
+            return 0;
          u32 uCRC = 0;
          if ( pPH->packet_flags & PACKET_FLAGS_BIT_HEADERS_ONLY_CRC )
             uCRC = base_compute_crc32(pPacketBuffer+sizeof(u32), sizeof(t_packet_header)-sizeof(u32));
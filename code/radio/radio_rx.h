@@ -67,6 +67,10 @@ typedef struct
    int iPacketRxInterface;
 } ALIGN_STRUCT_SPEC_INFO type_received_radio_packet;
 
+// Called from the rx thread for each unique valid packet, before it's added to the rx queues.
+// Must only look at the packet headers and return fast. Returns 1 if it took the packet.
+typedef int (*t_radio_rx_fast_path_callback)(int iRadioInterfaceIndex, u8* pPacketData, int iPacketLength);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -83,6 +87,7 @@ void radio_rx_mark_quit();
 void radio_rx_set_dev_mode();
 void radio_rx_set_packet_counter_output(u8* pCounterOutputVideo, u8* pCounterOutputECVideo, u8* pCounterOutputHighPriority, u8* pCounterOutputData, u8* pCounterMissingPackets, u8* pCounterMissingPacketsMaxGap);
 void radio_rx_set_air_gap_track_output(u8* pCounterRxAirgap);
+void radio_rx_set_fast_path_callback(t_radio_rx_fast_path_callback pCallback);
 
 int radio_rx_detect_firmware_type_from_packet(u8* pPacketBuffer, int nPacketLength);
 
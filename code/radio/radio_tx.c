@@ -32,6 +32,7 @@
 #include "../base/base.h"
 #include "../base/hw_procs.h"
 #include "../base/hardware_radio_sik.h"
+#include "../base/hardware_serial_io.h"
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
@@ -123,9 +124,28 @@ int _radio_tx_send_msg(int iInterfaceIndex, u8* pData, int iLength)
          s_iRadioTxSerialPacketSize[i] = DEFAULT_RADIO_SERIAL_AIR_PACKET_SIZE;
    }
 
-   int iUsableDataBytesInEachPacket = s_iRadioTxSerialPacketSize[iInterfaceIndex] - sizeof(t_packet_header_short);
+   // SiK radios: build all the short packets back to back and queue them in a single write;
+   // the serial I/O engine paces the actual writes to the air rate of the radio.
    if ( hardware_radio_index_is_sik_radio(iInterfaceIndex) )
-      iUsableDataBytesInEachPacket = s_iRadioTxSiKPacketSize - sizeof(t_packet_header_short);
+   {
+      u8 uFramesBuffer[MAX_PACKET_TOTAL_SIZE*2];
+      int iFramesLength = radio_packets_short_build_frames(iInterfaceIndex, pData, iLength, s_iRadioTxSiKPacketSize, uFramesBuffer, sizeof(uFramesBuffer));
+      if ( iFramesLength <= 0 )
+      {
+         log_softerror_and_alarm("[RadioTx] Failed to build SiK frames for message (%d bytes).", iLength);
+         return 0;
+      }
+      int iWriteResult = radio_write_sik_packet(iInterfaceIndex, uFramesBuffer, iFramesLength, get_current_timestamp_ms());
+      if ( iWriteResult != iFramesLength )
+      {
+         log_softerror_and_alarm("[RadioTx] Failed to send message to SiK radio: sent %d bytes, only %d bytes written.",
+            iFramesLength, iWriteResult);
+         return 0;
+      }
+      return 1;
+   }
+
+   int iUsableDataBytesInEachPacket = s_iRadioTxSerialPacketSize[iInterfaceIndex] - sizeof(t_packet_header_short);
 
    int iBytesLeftToSend = iLength;
    u8* pDataToSend = pData;
@@ -155,11 +175,7 @@ int _radio_tx_send_msg(int iInterfaceIndex, u8* pData, int iLength)
       iShortPacketDataSize += sizeof(t_packet_header_short);
       uBuffer[1] = base_compute_crc8(&uBuffer[2], iShortPacketDataSize - 2);
       
-      int iWriteResult = 0;
-      if ( hardware_radio_index_is_sik_radio(iInterfaceIndex) )
-         iWriteResult = radio_write_sik_packet(iInterfaceIndex, uBuffer, iShortPacketDataSize, get_current_timestamp_ms());
-      else
-         iWriteResult = radio_write_serial_packet(iInterfaceIndex, uBuffer, iShortPacketDataSize, get_current_timestamp_ms());
+      int iWriteResult = radio_write_serial_packet(iInterfaceIndex, uBuffer, iShortPacketDataSize, get_current_timestamp_ms());
       if ( iWriteResult != iShortPacketDataSize )
       {
          log_softerror_and_alarm("[RadioTx] Failed to send message to serial radio: sent %d bytes, only %d bytes written.",
@@ -194,7 +210,8 @@ static void * _thread_radio_tx(void *argument)
    u32 uWaitTime = 1;
    while ( 1 )
    {
-      hardware_sleep_ms(uWaitTime);
+      // Waits for serial I/O events and flushes pending (paced) SiK tx data
+      serial_io_poll(uWaitTime);
       if ( uWaitTime < 30 )
          uWaitTime += 5;
       
@@ -271,6 +288,7 @@ int radio_tx_start_tx_thread()
    }
 
    _radio_tx_create_msg_queue();
+   serial_io_init();
 
    if ( 0 != pthread_mutex_init(&s_pThreadRadioTxMutex, NULL) )
    {
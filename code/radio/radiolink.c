@@ -49,6 +49,7 @@
 #include "radiolink.h"
 #include "radiopackets2.h"
 #include "radio_rx.h"
+#include "radio_emulator.h"
 
 //#define DEBUG_PACKET_RECEIVED
 //#define DEBUG_PACKET_SENT
@@ -100,7 +101,7 @@ u8 s_uLastPacketBuilt[MAX_PACKET_TOTAL_SIZE];
 u32 s_uLastRadioPingSentTime = 0;
 u8 s_uLastRadioPingId = 0;
 
-u8 s_uRadiotapHeaderLegacy[] = {
+const u8 s_uRadiotapHeaderLegacy[] = {
 	0x00, 0x00, // <-- radiotap version
 	0x0c, 0x00, // <- radiotap header length (2 bytes), 12 bytes (this header)
 	0x04, 0x80, 0x00, 0x00, // <-- radiotap presence flags (rate + tx flags)
@@ -108,7 +109,7 @@ u8 s_uRadiotapHeaderLegacy[] = {
 	0x00, 0x00 // ??
 };
 
-u8 s_uRadiotapHeaderMCS[] = {
+const u8 s_uRadiotapHeaderMCS[] = {
     0x00, 0x00,             // <-- radiotap version
     0x0d, 0x00,             // <- radiotap header length (2 bytes), 13 bytes (this header)
     0x00, 0x80, 0x08, 0x00, // <-- radiotap presence flags (tx flags (0x8000), mcs (0x080000)) (4 bytes)
@@ -119,7 +120,7 @@ u8 s_uRadiotapHeaderMCS[] = {
 };
  
 
-u8 s_uIEEEHeaderData[] = {
+const u8 s_uIEEEHeaderData[] = {
 	0x08, 0x01, 0x00, 0x00, // frame control field (2bytes), duration (2 bytes)
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // port = 1st byte of IEEE802.11 RA (mac) must be something odd (wifi hardware determines broadcast/multicast through odd/even check)
 	0x13, 0x12, 0x34, 0x56, 0x78, 0x90, // mac
@@ -127,18 +128,24 @@ u8 s_uIEEEHeaderData[] = {
 	0x00, 0x00 // IEEE802.11 seqnum, (will be overwritten later by Atheros firmware/wifi chip)
 };
  
-u8 s_uIEEEHeaderRTS[] = {
+const u8 s_uIEEEHeaderRTS[] = {
 	0xb4, 0x01, 0x00, 0x00, // frame control field (2 bytes), duration (2 bytes)
 	0xff, //  port = 1st byte of IEEE802.11 RA (mac) must be something odd (wifi hardware determines broadcast/multicast through odd/even check)
 };
 
-u8 s_uIEEEHeaderData_short[] = {
+const u8 s_uIEEEHeaderData_short[] = {
 	0x08, 0x01, 0x00, 0x00, // frame control field (2bytes), duration (2 bytes)
 	0xff // port =  1st byte of IEEE802.11 RA (mac) must be something odd (wifi hardware determines broadcast/multicast through odd/even check)
 };
 
 uint16_t uIEEEE80211SeqNb = 0; 
 
+t_radio_tx_template s_RadioTxTemplates[RADIO_TX_TEMPLATES_MAX];
+int s_iRadioTxTemplatesCount = 0;
+pthread_mutex_t s_MutexRadioTxTemplates = PTHREAD_MUTEX_INITIALIZER;
+__thread t_radio_tx_template s_RadioTxTemplateOverflow;
+int s_iRadioTxTemplatesOverflowLogged = 0;
+
 int _radio_encode_port(int port)
 {
    //return (port * 2) + 1;
@@ -413,28 +420,6 @@ int radio_set_out_datarate(int rate_bps)
    }
 
    sRadioDataRate_bps = rate_bps;
-
-   if ( sRadioDataRate_bps > 0 )
-   {
-      if ( sRadioDataRate_bps > 56 )
-      {
-         s_uRadiotapHeaderLegacy[8] = (uint8_t)((int)(sRadioDataRate_bps/1000/1000) * 2);
-      }
-      else if ( sRadioDataRate_bps <= 56 )
-      {
-         s_uRadiotapHeaderLegacy[8] = (uint8_t)(sRadioDataRate_bps*2);
-         if ( 5 == sRadioDataRate_bps )
-            s_uRadiotapHeaderLegacy[8] = (uint8_t)11;
-      }
-   }
-   else
-   {
-      int mcsRate = -sRadioDataRate_bps-1;
-      if ( mcsRate < 0 )
-         mcsRate = 0;
-      s_uRadiotapHeaderMCS[12] = (uint8_t)mcsRate;
-   }
-
    return nReturn;
 }
 
@@ -464,50 +449,142 @@ void radio_set_frames_flags(u32 frameFlags)
       s_uPacketsSentUsingCurrent_RadioFlags = 0;
 
    sRadioFrameFlags = frameFlagsFiltered;
+}
+
+void _radio_compute_tx_template(t_radio_tx_template* pTemplate, int iDataRateBPS, u32 uFrameFlags, int iPort)
+{
+   memset(pTemplate, 0, sizeof(t_radio_tx_template));
+   pTemplate->iDataRateBPS = iDataRateBPS;
+   pTemplate->uFrameFlags = uFrameFlags;
+   pTemplate->iPort = iPort;
 
-   if ( (sRadioFrameFlags & RADIO_FLAGS_MCS_MASK) || (sRadioDataRate_bps < 0) )
+   u8* pHeaders = pTemplate->uHeaders;
+   if ( (uFrameFlags & RADIO_FLAGS_MCS_MASK) || (iDataRateBPS < 0) )
    {
+      memcpy(pHeaders, s_uRadiotapHeaderMCS, sizeof(s_uRadiotapHeaderMCS));
+      pTemplate->iRadiotapHeaderLength = sizeof(s_uRadiotapHeaderMCS);
+
       u8 mcs_flags = 0;
       u8 mcs_known = (IEEE80211_RADIOTAP_MCS_HAVE_MCS | IEEE80211_RADIOTAP_MCS_HAVE_BW | IEEE80211_RADIOTAP_MCS_HAVE_GI | IEEE80211_RADIOTAP_MCS_HAVE_STBC);
       mcs_known |= IEEE80211_RADIOTAP_MCS_HAVE_FEC;
-      int mcsRate = -sRadioDataRate_bps-1;
+      int mcsRate = -iDataRateBPS-1;
       if ( mcsRate < 0 )
          mcsRate = 0;
 
       if ( hardware_is_station() )
       {
-         if ( sRadioFrameFlags & RADIO_FLAG_HT40_CONTROLLER )
+         if ( uFrameFlags & RADIO_FLAG_HT40_CONTROLLER )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_BW_40;
          else
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_BW_20;
 
-         if ( sRadioFrameFlags & RADIO_FLAG_LDPC_CONTROLLER )
+         if ( uFrameFlags & RADIO_FLAG_LDPC_CONTROLLER )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_FEC_LDPC; 
-         if ( sRadioFrameFlags & RADIO_FLAG_SGI_CONTROLLER )
+         if ( uFrameFlags & RADIO_FLAG_SGI_CONTROLLER )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_SGI;
-         if ( sRadioFrameFlags & RADIO_FLAG_STBC_CONTROLLER )
+         if ( uFrameFlags & RADIO_FLAG_STBC_CONTROLLER )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_STBC_1 << IEEE80211_RADIOTAP_MCS_STBC_SHIFT;
       }
       else
       {
-         if ( sRadioFrameFlags & RADIO_FLAG_HT40_VEHICLE )
+         if ( uFrameFlags & RADIO_FLAG_HT40_VEHICLE )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_BW_40;
          else
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_BW_20;
 
-         if ( sRadioFrameFlags & RADIO_FLAG_LDPC_VEHICLE )
+         if ( uFrameFlags & RADIO_FLAG_LDPC_VEHICLE )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_FEC_LDPC; 
-         if ( sRadioFrameFlags & RADIO_FLAG_SGI_VEHICLE )
+         if ( uFrameFlags & RADIO_FLAG_SGI_VEHICLE )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_SGI;
-         if ( sRadioFrameFlags & RADIO_FLAG_STBC_VEHICLE )
+         if ( uFrameFlags & RADIO_FLAG_STBC_VEHICLE )
             mcs_flags = mcs_flags | IEEE80211_RADIOTAP_MCS_STBC_1 << IEEE80211_RADIOTAP_MCS_STBC_SHIFT;       
       }
-      s_uRadiotapHeaderMCS[10] = mcs_known;
-      s_uRadiotapHeaderMCS[11] = mcs_flags;
-      s_uRadiotapHeaderMCS[12] = (uint8_t)mcsRate;
-    }
+      pHeaders[10] = mcs_known;
+      pHeaders[11] = mcs_flags;
+      pHeaders[12] = (uint8_t)mcsRate;
+   }
+   else
+   {
+      memcpy(pHeaders, s_uRadiotapHeaderLegacy, sizeof(s_uRadiotapHeaderLegacy));
+      pTemplate->iRadiotapHeaderLength = sizeof(s_uRadiotapHeaderLegacy);
+      if ( iDataRateBPS > 56 )
+         pHeaders[8] = (uint8_t)((int)(iDataRateBPS/1000/1000) * 2);
+      else
+      {
+         pHeaders[8] = (uint8_t)(iDataRateBPS*2);
+         if ( 5 == iDataRateBPS )
+            pHeaders[8] = (uint8_t)11;
+      }
+   }
+
+   pHeaders += pTemplate->iRadiotapHeaderLength;
+   pTemplate->iSeqNumberOffset = -1;
+   int iIEEELength = 0;
+   if ( (uFrameFlags & RADIO_FLAGS_FRAME_TYPE_RTS) && (!(uFrameFlags & RADIO_FLAGS_FRAME_TYPE_DATA)) )
+   {
+      memcpy(pHeaders, s_uIEEEHeaderRTS, sizeof(s_uIEEEHeaderRTS));
+      iIEEELength = sizeof(s_uIEEEHeaderRTS);
+   }
+   else if ( (uFrameFlags & RADIO_FLAGS_FRAME_TYPE_DATA_SHORT) && (!(uFrameFlags & RADIO_FLAGS_FRAME_TYPE_DATA)) )
+   {
+      memcpy(pHeaders, s_uIEEEHeaderData_short, sizeof(s_uIEEEHeaderData_short));
+      iIEEELength = sizeof(s_uIEEEHeaderData_short);
+   }
+   else
+   {
+      memcpy(pHeaders, s_uIEEEHeaderData, sizeof(s_uIEEEHeaderData));
+      iIEEELength = sizeof(s_uIEEEHeaderData);
+      pTemplate->iSeqNumberOffset = pTemplate->iRadiotapHeaderLength + 22;
+   }
+   // Port = 1st byte of IEEE802.11 RA (mac), same offset in all frame types
+   pHeaders[4] = _radio_encode_port(iPort);
+   pTemplate->iHeadersLength = pTemplate->iRadiotapHeaderLength + iIEEELength;
 }
 
+const t_radio_tx_template* radio_get_tx_template(int iDataRateBPS, u32 uFrameFlags, int iPort)
+{
+   if ( 0 == iDataRateBPS )
+      iDataRateBPS = DEFAULT_RADIO_DATARATE_VIDEO_ATHEROS;
+
+   // Templates are only appended, and the count is published after the template is complete,
+   // so lookups do not need the lock
+   int iCount = __atomic_load_n(&s_iRadioTxTemplatesCount, __ATOMIC_ACQUIRE);
+   for( int i=0; i<iCount; i++ )
+   {
+      t_radio_tx_template* pTemplate = &s_RadioTxTemplates[i];
+      if ( (pTemplate->iDataRateBPS == iDataRateBPS) && (pTemplate->uFrameFlags == uFrameFlags) && (pTemplate->iPort == iPort) )
+         return pTemplate;
+   }
+
+   pthread_mutex_lock(&s_MutexRadioTxTemplates);
+   for( int i=iCount; i<s_iRadioTxTemplatesCount; i++ )
+   {
+      t_radio_tx_template* pTemplate = &s_RadioTxTemplates[i];
+      if ( (pTemplate->iDataRateBPS == iDataRateBPS) && (pTemplate->uFrameFlags == uFrameFlags) && (pTemplate->iPort == iPort) )
+      {
+         pthread_mutex_unlock(&s_MutexRadioTxTemplates);
+         return pTemplate;
+      }
+   }
+   if ( s_iRadioTxTemplatesCount < RADIO_TX_TEMPLATES_MAX )
+   {
+      t_radio_tx_template* pTemplate = &s_RadioTxTemplates[s_iRadioTxTemplatesCount];
+      _radio_compute_tx_template(pTemplate, iDataRateBPS, uFrameFlags, iPort);
+      __atomic_store_n(&s_iRadioTxTemplatesCount, s_iRadioTxTemplatesCount+1, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&s_MutexRadioTxTemplates);
+      return pTemplate;
+   }
+   pthread_mutex_unlock(&s_MutexRadioTxTemplates);
+
+   // No room left: use a per thread template, valid until the next overflow on this thread
+   if ( ! s_iRadioTxTemplatesOverflowLogged )
+   {
+      s_iRadioTxTemplatesOverflowLogged = 1;
+      log_softerror_and_alarm("RadioError: Too many radio tx templates (%d), computing radio headers for each packet.", RADIO_TX_TEMPLATES_MAX);
+   }
+   _radio_compute_tx_template(&s_RadioTxTemplateOverflow, iDataRateBPS, uFrameFlags, iPort);
+   return &s_RadioTxTemplateOverflow;
+}
 
 u32 radio_get_received_frames_type()
 {
@@ -625,6 +702,24 @@ int _radio_open_interface_for_read_with_filter(int interfaceIndex, char* szFilte
    return pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd;
 }
 
+int _radio_open_emulated_interface_for_read(int interfaceIndex, int iPortEncoded)
+{
+   s_iRadioInterfacesBroken = 0;
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(interfaceIndex);
+   if ( NULL == pRadioHWInfo )
+      return -1;
+
+   pRadioHWInfo->openedForRead = 0;
+   pRadioHWInfo->runtimeInterfaceInfoRx.ppcap = NULL;
+   pRadioHWInfo->runtimeInterfaceInfoRx.iErrorCount = 0;
+   pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd = radio_emulator_open_for_read(interfaceIndex, pRadioHWInfo->uCurrentFrequencyKhz, iPortEncoded);
+   if ( pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd < 0 )
+      return -1;
+   reset_runtime_radio_rx_info(&(pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo));
+   pRadioHWInfo->openedForRead = 1;
+   return pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd;
+}
+
 int radio_open_interface_for_read(int interfaceIndex, int portNumber)
 {
    char szFilter[256];
@@ -638,7 +733,11 @@ int radio_open_interface_for_read(int interfaceIndex, int portNumber)
    sprintf(szFilter, "ether[0x00:2] == 0x0801 && ether[0x0a:4] == 0x13123456 && ether[0x04:1] == 0x%.2x", port_encoded);
    sprintf(szFilterPrism, "radio[0x40:2] == 0x0801 && radio[0x4a:4] == 0x13123456 && radio[0x44:1] == 0x%.2x", port_encoded);
 
-   int iResult = _radio_open_interface_for_read_with_filter(interfaceIndex, szFilter, szFilterPrism);
+   int iResult = -1;
+   if ( pRadioHWInfo->iRadioDriver == RADIO_HW_DRIVER_EMULATED )
+      iResult = _radio_open_emulated_interface_for_read(interfaceIndex, port_encoded);
+   else
+      iResult = _radio_open_interface_for_read_with_filter(interfaceIndex, szFilter, szFilterPrism);
    
    if ( iResult < 0 )
       return iResult;
@@ -675,7 +774,14 @@ int radio_open_interface_for_write(int interfaceIndex)
    pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd = -1;
    pRadioHWInfo->runtimeInterfaceInfoTx.iErrorCount = 0;
 
-   if ( s_iUsePCAPForTx )
+   if ( pRadioHWInfo->iRadioDriver == RADIO_HW_DRIVER_EMULATED )
+   {
+      pRadioHWInfo->runtimeInterfaceInfoTx.ppcap = NULL;
+      pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd = radio_emulator_open_for_write(interfaceIndex);
+      if ( pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd < 0 )
+         return -1;
+   }
+   else if ( s_iUsePCAPForTx )
    {
       log_line("Using ppcap for tx packets.");
       char errbuf[PCAP_ERRBUF_SIZE];
@@ -777,7 +883,12 @@ void radio_close_interface_for_read(int interfaceIndex)
 
    radio_rx_pause_interface(interfaceIndex, "Close radio interface");
    
-   if ( NULL != pRadioHWInfo->runtimeInterfaceInfoRx.ppcap )
+   if ( pRadioHWInfo->iRadioDriver == RADIO_HW_DRIVER_EMULATED )
+   {
+      log_line("Closed emulated radio interface %d [%s] that was used for read, selectable read fd was: %d", interfaceIndex+1, pRadioHWInfo->szName, pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd);
+      radio_emulator_close_for_read(interfaceIndex);
+   }
+   else if ( NULL != pRadioHWInfo->runtimeInterfaceInfoRx.ppcap )
    {
       log_line("Closed radio interface %d [%s] that was used for read, selectable read fd was: %d, ppcap was: %d", interfaceIndex+1, pRadioHWInfo->szName, pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd, pRadioHWInfo->runtimeInterfaceInfoRx.ppcap);
       pcap_close(pRadioHWInfo->runtimeInterfaceInfoRx.ppcap);
@@ -815,7 +926,9 @@ void radio_close_interface_for_write(int interfaceIndex)
 
    log_line("Closed radio interface %d (%s) that was used for write. Selectable write fd was: %d, ppcap was: %d", interfaceIndex+1, pRadioHWInfo->szName, pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd, pRadioHWInfo->runtimeInterfaceInfoTx.ppcap);
 
-   if ( s_iUsePCAPForTx )
+   if ( pRadioHWInfo->iRadioDriver == RADIO_HW_DRIVER_EMULATED )
+      radio_emulator_close_for_write(interfaceIndex);
+   else if ( s_iUsePCAPForTx )
    {
       if ( NULL != pRadioHWInfo->runtimeInterfaceInfoTx.ppcap )
          pcap_close(pRadioHWInfo->runtimeInterfaceInfoTx.ppcap);
@@ -925,9 +1038,23 @@ u8* radio_process_wlan_data_in(int interfaceNumber, int* outPacketLength)
    */
    struct pcap_pkthdr pcapHeader;
    ppcapPacketHeader = &pcapHeader;
-   pRadioPayload = (u8*) pcap_next(pRadioHWInfo->runtimeInterfaceInfoRx.ppcap, ppcapPacketHeader); 
+   if ( pRadioHWInfo->iRadioDriver == RADIO_HW_DRIVER_EMULATED )
+   {
+      int iFrameLength = 0;
+      pRadioPayload = radio_emulator_read(interfaceNumber, &iFrameLength);
+      pcapHeader.caplen = iFrameLength;
+      pcapHeader.len = iFrameLength;
+   }
+   else
+      pRadioPayload = (u8*) pcap_next(pRadioHWInfo->runtimeInterfaceInfoRx.ppcap, ppcapPacketHeader); 
    if ( NULL == pRadioPayload )
+   {
+      #ifdef FEATURE_RADIO_SYNCHRONIZE_RXTX_THREADS
+      if ( 1 == s_iMutexRadioSyncRxTxThreadsInitialized )
+         pthread_mutex_unlock(&s_pMutexRadioSyncRxTxThreads);
+      #endif
       return NULL;
+   }
    //memcpy(sPayloadBufferRead, pRadioPayload, ppcapPacketHeader->caplen);
    #ifdef DEBUG_PACKET_RECEIVED
    log_line("RX Buffer: caplen: %d bytes, len: %d", ppcapPacketHeader->caplen, ppcapPacketHeader->len);
@@ -1183,6 +1310,7 @@ int packet_process_and_check(int interfaceNb, u8* pPacketBuffer, int iBufferLeng
       return 0;
    }
 
+   // Encrypted packets: verify and decrypt, then restore the plain packet header (as it was when the CRC was computed)
    if ( uPacketFlags & PACKET_FLAGS_BIT_HAS_ENCRYPTION )
    if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_FLAGS_MASK_COMPRESSED_HEADER )
    {
@@ -1190,8 +1318,16 @@ int packet_process_and_check(int interfaceNb, u8* pPacketBuffer, int iBufferLeng
       log_line("enc detected");
       #endif
       int dx = sizeof(t_packet_header) - sizeof(u32) - sizeof(u32);
-      int l = packetLength-dx;
-      dpp(pPacketBuffer + dx, l);
+      if ( (packetLength < (int)sizeof(t_packet_header) + ENC_PACKET_TRAILER_SIZE) || (! dpp(pPacketBuffer, dx, packetLength, pPH->stream_packet_idx, interfaceNb)) )
+      {
+         s_iLastProcessingErrorCode = RADIO_PROCESSING_ERROR_CODE_AUTHENTICATION_FAILED;
+         #ifdef DEBUG_PACKET_RECEIVED
+         log_line("Received encrypted packet that failed authentication, packet length: %d bytes", packetLength);
+         #endif
+         return 0;
+      }
+      pPH->packet_flags &= ~PACKET_FLAGS_BIT_HAS_ENCRYPTION;
+      pPH->total_length -= ENC_PACKET_TRAILER_SIZE;
    }
 
    if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_FLAGS_MASK_COMPRESSED_HEADER )
@@ -1253,70 +1389,94 @@ u32 radio_get_next_radio_link_packet_index(int iLocalRadioLinkId)
 {
    if ( (iLocalRadioLinkId < 0) || (iLocalRadioLinkId >= MAX_RADIO_INTERFACES) )
       iLocalRadioLinkId = 0;
-   u32 uRadioLinkPacketIndex = s_uNextRadioPacketIndexes[iLocalRadioLinkId];
-   s_uNextRadioPacketIndexes[iLocalRadioLinkId]++;
-
-   return uRadioLinkPacketIndex;
+   return __atomic_fetch_add(&s_uNextRadioPacketIndexes[iLocalRadioLinkId], 1, __ATOMIC_RELAXED);
 }
 
-int radio_build_new_raw_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int portNb, int bEncrypt)
+// Writes the radiotap and IEEE headers; returns their total length
+int _radio_write_radio_headers(u8* pRawPacket, const t_radio_tx_template* pTxTemplate)
 {
-   int totalRadioLength = 0;
-
-   s_uIEEEHeaderData_short[4] = _radio_encode_port(portNb);
-   s_uIEEEHeaderData[4] = _radio_encode_port(portNb);
-   s_uIEEEHeaderRTS[4] = _radio_encode_port(portNb);
-   s_uIEEEHeaderData[22] = uIEEEE80211SeqNb & 0xff;
-   s_uIEEEHeaderData[23] = (uIEEEE80211SeqNb >> 8) & 0xff;
-   uIEEEE80211SeqNb += 16;
-   
-   if ( (sRadioFrameFlags & RADIO_FLAGS_MCS_MASK) || (sRadioDataRate_bps < 0) )
+   memcpy(pRawPacket, pTxTemplate->uHeaders, pTxTemplate->iHeadersLength);
+   if ( pTxTemplate->iSeqNumberOffset >= 0 )
    {
-      memcpy(pRawPacket, s_uRadiotapHeaderMCS, sizeof(s_uRadiotapHeaderMCS));
-      pRawPacket += sizeof(s_uRadiotapHeaderMCS);
-      totalRadioLength += sizeof(s_uRadiotapHeaderMCS);
-      s_uLastPacketSentRadioTapHeaderLength = sizeof(s_uRadiotapHeaderMCS);
-   }
-   else
-   {
-      memcpy(pRawPacket, s_uRadiotapHeaderLegacy, sizeof(s_uRadiotapHeaderLegacy));
-      pRawPacket += sizeof(s_uRadiotapHeaderLegacy);
-      totalRadioLength += sizeof(s_uRadiotapHeaderLegacy);
-      s_uLastPacketSentRadioTapHeaderLength = sizeof(s_uRadiotapHeaderLegacy);
+      u16 uSeqNb = __atomic_fetch_add(&uIEEEE80211SeqNb, 16, __ATOMIC_RELAXED);
+      pRawPacket[pTxTemplate->iSeqNumberOffset] = uSeqNb & 0xff;
+      pRawPacket[pTxTemplate->iSeqNumberOffset+1] = (uSeqNb >> 8) & 0xff;
    }
+   s_uLastPacketSentRadioTapHeaderLength = pTxTemplate->iRadiotapHeaderLength;
+   s_uLastPacketSentIEEEHeaderLength = pTxTemplate->iHeadersLength - pTxTemplate->iRadiotapHeaderLength;
+   return pTxTemplate->iHeadersLength;
+}
+
+// Sets the radio link index, CRC and encryption of a single packet (already in the tx buffer).
+// Returns the packet length on the radio (encrypted packets grow by the encryption trailer),
+// or -1 if the packet must be dropped: a packet that must be encrypted is never sent in clear.
+int _radio_prepare_packet_for_tx(u8* pData, int nPacketLength, u16 uRadioLinkPacketIndex, int bEncrypt, int iRoomLeft)
+{
+   t_packet_header* pPH = (t_packet_header*)pData;
+   t_packet_header_compressed* pPHC = (t_packet_header_compressed*)pData;
+   int nPacketRadioLength = nPacketLength;
 
-   if ( sRadioFrameFlags & RADIO_FLAGS_FRAME_TYPE_DATA )
+   if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_FLAGS_MASK_COMPRESSED_HEADER )
    {
-      memcpy(pRawPacket, s_uIEEEHeaderData, sizeof (s_uIEEEHeaderData));
-      pRawPacket += sizeof(s_uIEEEHeaderData);
-      totalRadioLength += sizeof(s_uIEEEHeaderData);
-      s_uLastPacketSentIEEEHeaderLength = sizeof(s_uIEEEHeaderData);
-   }
-   else if ( sRadioFrameFlags & RADIO_FLAGS_FRAME_TYPE_RTS )
-   {   
-      memcpy(pRawPacket, s_uIEEEHeaderRTS, sizeof (s_uIEEEHeaderRTS));
-      pRawPacket += sizeof(s_uIEEEHeaderRTS);
-      totalRadioLength += sizeof(s_uIEEEHeaderRTS);
-      s_uLastPacketSentIEEEHeaderLength = sizeof(s_uIEEEHeaderRTS);
-   }	
-   else if ( sRadioFrameFlags & RADIO_FLAGS_FRAME_TYPE_DATA_SHORT )
-   {
-      memcpy(pRawPacket, s_uIEEEHeaderData_short, sizeof (s_uIEEEHeaderData_short));
-      pRawPacket += sizeof(s_uIEEEHeaderData_short);
-      totalRadioLength += sizeof(s_uIEEEHeaderData_short);
-      s_uLastPacketSentIEEEHeaderLength = sizeof(s_uIEEEHeaderData_short);
+      if ( bEncrypt )
+         pPHC->packet_flags |= PACKET_FLAGS_BIT_HAS_ENCRYPTION;
+
+      radio_packet_compressed_compute_crc(pData, nPacketLength);
+      return nPacketRadioLength;
    }
+
+   pPH->radio_link_packet_index = uRadioLinkPacketIndex;
+   pPH->packet_flags &= ~PACKET_FLAGS_BIT_HAS_ENCRYPTION;
+
+   if ( pPH->packet_flags & PACKET_FLAGS_BIT_HEADERS_ONLY_CRC )
+      radio_packet_compute_crc((u8*)pPH, sizeof(t_packet_header));
    else
+      radio_packet_compute_crc((u8*)pPH, pPH->total_length);
+
+   // Header fields up to the vehicle ids are authenticated, the rest is encrypted
+   if ( bEncrypt )
    {
-      memcpy(pRawPacket, s_uIEEEHeaderData, sizeof (s_uIEEEHeaderData));
-      pRawPacket += sizeof(s_uIEEEHeaderData);
-      totalRadioLength += sizeof(s_uIEEEHeaderData);
-      s_uLastPacketSentIEEEHeaderLength = sizeof(s_uIEEEHeaderData);
+      if ( nPacketLength + ENC_PACKET_TRAILER_SIZE > iRoomLeft )
+      {
+         log_softerror_and_alarm("RadioError: No room for the encryption trailer of packet type %d (%d bytes, %d bytes left in the radio frame). Packet dropped.", pPH->packet_type, nPacketLength, iRoomLeft);
+         return -1;
+      }
+      pPH->packet_flags |= PACKET_FLAGS_BIT_HAS_ENCRYPTION;
+      pPH->total_length += ENC_PACKET_TRAILER_SIZE;
+      int dx = sizeof(t_packet_header) - sizeof(u32) - sizeof(u32);
+      if ( ! epp(pData, dx, nPacketLength, pPH->stream_packet_idx) )
+      {
+         log_softerror_and_alarm("RadioError: Failed to encrypt packet type %d (%d bytes). Packet dropped.", pPH->packet_type, nPacketLength);
+         return -1;
+      }
+      nPacketRadioLength += ENC_PACKET_TRAILER_SIZE;
    }
-   
-   memcpy(pRawPacket, pPacketData, nInputLength);
-   totalRadioLength += nInputLength;
+   return nPacketRadioLength;
+}
 
+int _radio_get_chained_packet_length(u8* pData, int nLength)
+{
+   int nPacketLength = 0;
+   if ( (((t_packet_header*)pData)->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_FLAGS_MASK_COMPRESSED_HEADER )
+      nPacketLength = ((t_packet_header_compressed*)pData)->total_length;
+   else
+      nPacketLength = ((t_packet_header*)pData)->total_length;
+   if ( (nPacketLength <= 0) || (nPacketLength > nLength) )
+      nPacketLength = nLength;
+   return nPacketLength;
+}
+
+int radio_build_new_raw_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int portNb, int bEncrypt)
+{
+   return radio_build_new_raw_packet_with_template(radio_get_tx_template(sRadioDataRate_bps, sRadioFrameFlags, portNb), iLocalRadioLinkId, pRawPacket, pPacketData, nInputLength, bEncrypt);
+}
+
+int radio_build_new_raw_packet_with_template(const t_radio_tx_template* pTxTemplate, int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int bEncrypt)
+{
+   int totalRadioLength = _radio_write_radio_headers(pRawPacket, pTxTemplate);
+   int iRadioHeadersLength = totalRadioLength;
+   pRawPacket += totalRadioLength;
+   
    if ( s_bRadioDebugFlag )
    {
       memset(s_uLastPacketBuilt, 0, MAX_PACKET_TOTAL_SIZE);
@@ -1324,65 +1484,81 @@ int radio_build_new_raw_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* pPacke
    }
    
    #ifdef DEBUG_PACKET_SENT
-   log_line("Building a composed packet of total size: %d, extra data: %d", nInputLength + iExtraData, iExtraData);
+   log_line("Building a composed packet of total size: %d", nInputLength);
    #endif
 
    if ( (iLocalRadioLinkId < 0) || (iLocalRadioLinkId >= MAX_RADIO_INTERFACES) )
       iLocalRadioLinkId = 0;
    u16 uRadioLinkPacketIndex = radio_get_next_radio_link_packet_index(iLocalRadioLinkId);
 
-   // Compute CRC/encrypt all packets in this buffer
+   // Copy and compute CRC/encrypt all packets in this buffer.
+   // Encrypted packets grow by the encryption trailer (nonce and authentication tag).
 
    int nLength = nInputLength;
+   u8* pSource = pPacketData;
    u8* pData = pRawPacket;
 
-   int nPCount = 0;
    while ( nLength > 0 )
    {
-      nPCount++;
-      t_packet_header* pPH = (t_packet_header*)pData;
-      t_packet_header_compressed* pPHC = (t_packet_header_compressed*)pData;
-      int nPacketLength = 0;
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_FLAGS_MASK_COMPRESSED_HEADER )
-      {
-         nPacketLength = pPHC->total_length;
-         if ( bEncrypt )
-            pPHC->packet_flags |= PACKET_FLAGS_BIT_HAS_ENCRYPTION;
+      int nPacketLength = _radio_get_chained_packet_length(pSource, nLength);
+      memcpy(pData, pSource, nPacketLength);
+      int nPacketRadioLength = _radio_prepare_packet_for_tx(pData, nPacketLength, uRadioLinkPacketIndex, bEncrypt, MAX_PACKET_LENGTH_PCAP - totalRadioLength);
 
-         radio_packet_compressed_compute_crc(pData, nPacketLength);
-      }
-      else
-      {
-         nPacketLength = pPH->total_length;
-         pPH->radio_link_packet_index = uRadioLinkPacketIndex;
-         if ( bEncrypt )
-            pPH->packet_flags |= PACKET_FLAGS_BIT_HAS_ENCRYPTION;
+      nLength -= nPacketLength;
+      pSource += nPacketLength;
+      if ( nPacketRadioLength <= 0 )
+         continue;
+      pData += nPacketRadioLength;
+      totalRadioLength += nPacketRadioLength;
+   }
 
-         if ( pPH->packet_flags & PACKET_FLAGS_BIT_HEADERS_ONLY_CRC )
-            radio_packet_compute_crc((u8*)pPH, sizeof(t_packet_header));
-         else
-            radio_packet_compute_crc((u8*)pPH, pPH->total_length);
+   // All the packets were dropped
+   if ( totalRadioLength == iRadioHeadersLength )
+      return 0;
+   return totalRadioLength;
+}
 
-         if ( bEncrypt )
-         {
-            int dx = sizeof(t_packet_header) - sizeof(u32) - sizeof(u32);
-            epp(pData+dx, pPH->total_length-dx);
-         }
-      }
-       
+int radio_build_new_raw_packet_in_headroom(int iLocalRadioLinkId, u8* pPacketData, int nInputLength, int portNb, u8** ppRawPacket)
+{
+   return radio_build_new_raw_packet_in_headroom_with_template(radio_get_tx_template(sRadioDataRate_bps, sRadioFrameFlags, portNb), iLocalRadioLinkId, pPacketData, nInputLength, ppRawPacket);
+}
 
-      #ifdef DEBUG_PACKET_SENT
-      // Add compressed header support:
-      //log_line("Packet %d in composed packet: enc: %d, crc (%s): %u, len: %d", nPCount, bEncrypt, (pPH->packet_flags & PACKET_FLAGS_BIT_HEADERS_ONLY_CRC)?"headers only":"full", pPH->uCRC, pPH->total_length);
-      //if ( pPH->total_length <= 125 )
-      //   log_buffer3(pData, pPH->total_length, 10,6,8);
-      #endif
+int radio_build_new_raw_packet_in_headroom_with_template(const t_radio_tx_template* pTxTemplate, int iLocalRadioLinkId, u8* pPacketData, int nInputLength, u8** ppRawPacket)
+{
+   if ( (NULL == pTxTemplate) || (NULL == pPacketData) || (NULL == ppRawPacket) || (nInputLength <= 0) )
+      return 0;
+
+   int iHeadersLength = pTxTemplate->iHeadersLength;
+   if ( iHeadersLength > RADIO_PACKET_HEADROOM )
+   {
+      log_softerror_and_alarm("RadioError: Radio headers (%d bytes) do not fit in the packet headroom (%d bytes).", iHeadersLength, RADIO_PACKET_HEADROOM);
+      return 0;
+   }
+   u8* pRawPacket = pPacketData - iHeadersLength;
+   _radio_write_radio_headers(pRawPacket, pTxTemplate);
+
+   if ( s_bRadioDebugFlag )
+   {
+      memset(s_uLastPacketBuilt, 0, MAX_PACKET_TOTAL_SIZE);
+      memcpy(s_uLastPacketBuilt, pPacketData, nInputLength);
+   }
 
+   if ( (iLocalRadioLinkId < 0) || (iLocalRadioLinkId >= MAX_RADIO_INTERFACES) )
+      iLocalRadioLinkId = 0;
+   u16 uRadioLinkPacketIndex = radio_get_next_radio_link_packet_index(iLocalRadioLinkId);
+
+   int nLength = nInputLength;
+   u8* pData = pPacketData;
+   while ( nLength > 0 )
+   {
+      int nPacketLength = _radio_get_chained_packet_length(pData, nLength);
+      _radio_prepare_packet_for_tx(pData, nPacketLength, uRadioLinkPacketIndex, 0, 0);
       nLength -= nPacketLength;
       pData += nPacketLength;
    }
 
-   return totalRadioLength;
+   *ppRawPacket = pRawPacket;
+   return iHeadersLength + nInputLength;
 }
 
 
@@ -1422,7 +1598,22 @@ int radio_write_raw_packet(int interfaceIndex, u8* pData, int dataLength)
 
    int len = 0;
 
-   if ( s_iUsePCAPForTx )
+   if ( pRadioHWInfo->iRadioDriver == RADIO_HW_DRIVER_EMULATED )
+   {
+      len = radio_emulator_write(interfaceIndex, pRadioHWInfo->uCurrentFrequencyKhz, pData, dataLength);
+      if ( len < dataLength )
+      {
+         log_softerror_and_alarm("RadioError: Failed to send radio message on emulated radio interface %d (%d bytes).", interfaceIndex+1, dataLength);
+         pRadioHWInfo->runtimeInterfaceInfoTx.iErrorCount++;
+         #ifdef FEATURE_RADIO_SYNCHRONIZE_RXTX_THREADS
+         if ( 1 == s_iMutexRadioSyncRxTxThreadsInitialized )
+            pthread_mutex_unlock(&s_pMutexRadioSyncRxTxThreads);
+         #endif
+         return 0;
+      }
+      pRadioHWInfo->runtimeInterfaceInfoTx.iErrorCount = 0;
+   }
+   else if ( s_iUsePCAPForTx )
    {
       len = pcap_inject(pRadioHWInfo->runtimeInterfaceInfoTx.ppcap, pData, dataLength);
       if ( len < dataLength )
@@ -44,6 +44,7 @@
 #define RADIO_PROCESSING_ERROR_NO_ERROR 0x00
 #define RADIO_PROCESSING_ERROR_CODE_INVALID_CRC_RECEIVED 0x01
 #define RADIO_PROCESSING_ERROR_CODE_PACKET_RECEIVED_TOO_SMALL 0x02
+#define RADIO_PROCESSING_ERROR_CODE_AUTHENTICATION_FAILED 0x03
 #define RADIO_PROCESSING_ERROR_INVALID_PARAMETERS 0x0E
 #define RADIO_PROCESSING_ERROR_INVALID_RECEIVED_PACKET 0x0F
 
@@ -52,6 +53,22 @@
 #define RADIO_READ_ERROR_INTERFACE_BROKEN 2
 #define RADIO_READ_ERROR_READ_ERROR 3
 
+#define RADIO_TX_TEMPLATE_MAX_HEADERS_LENGTH 48
+#define RADIO_TX_TEMPLATES_MAX 256
+
+// Radiotap and IEEE headers precomputed for a tx datarate, radio frames flags and port.
+// Templates are never changed once created, so they can be used from any thread.
+typedef struct
+{
+   int iDataRateBPS; // positive: classic in bps, negative: MCS
+   u32 uFrameFlags;
+   int iPort;
+   int iHeadersLength;
+   int iRadiotapHeaderLength;
+   int iSeqNumberOffset; // -1 if the frame type has no sequence number
+   u8  uHeaders[RADIO_TX_TEMPLATE_MAX_HEADERS_LENGTH];
+} ALIGN_STRUCT_SPEC_INFO t_radio_tx_template;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -65,8 +82,11 @@ void radio_set_link_clock_delta(int iVehicleBehindMilisec);
 int  radio_get_link_clock_delta();
 void radio_set_use_pcap_for_tx(int iEnablePCAPTx);
 void radio_set_bypass_socket_buffers(int iBypass);
+// Datarate and frames flags used by radio_build_new_raw_packet... functions that take no tx template
 int radio_set_out_datarate(int rate_bps); // positive: classic in bps, negative: MCS; returns 1 if it was changed
 void radio_set_frames_flags(u32 frameFlags); // frame type, MSC Flags
+// Returns the (cached) tx template for the datarate, frames flags and port; never NULL
+const t_radio_tx_template* radio_get_tx_template(int iDataRateBPS, u32 uFrameFlags, int iPort);
 u32 radio_get_received_frames_type();
 
 void radio_reset_packets_default_frequencies(int iRCEnabled);
@@ -92,6 +112,13 @@ int get_last_processing_error_code();
 
 u32 radio_get_next_radio_link_packet_index(int iLocalRadioLinkId);
 int radio_build_new_raw_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int portNb, int bEncrypt);
+// Same as above, without copying the packets: pPacketData must have RADIO_PACKET_HEADROOM free bytes in front of it.
+// Packets are updated in place (no encryption). Returns the raw packet length and its start in ppRawPacket, 0 on error.
+int radio_build_new_raw_packet_in_headroom(int iLocalRadioLinkId, u8* pPacketData, int nInputLength, int portNb, u8** ppRawPacket);
+// Same as the two above, using the datarate, frames flags and port of the tx template instead of the ones set
+// with radio_set_out_datarate/radio_set_frames_flags. Can be used from multiple threads at the same time.
+int radio_build_new_raw_packet_with_template(const t_radio_tx_template* pTxTemplate, int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int bEncrypt);
+int radio_build_new_raw_packet_in_headroom_with_template(const t_radio_tx_template* pTxTemplate, int iLocalRadioLinkId, u8* pPacketData, int nInputLength, u8** ppRawPacket);
 int radio_write_raw_packet(int interfaceIndex, u8* pData, int dataLength);
 int radio_write_serial_packet(int interfaceIndex, u8* pData, int dataLength, u32 uTimeNow);
 int radio_write_sik_packet(int interfaceIndex, u8* pData, int dataLength, u32 uTimeNow);
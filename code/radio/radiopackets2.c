@@ -99,6 +99,7 @@ int radio_packet_type_is_high_priority(u8 uPacketType)
       //case PACKET_TYPE_VIDEO_DATA_98:
       case PACKET_TYPE_VIDEO_ACK:
       case PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS:
+      case PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP:
       case PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL:
       case PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK:
       case PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE:
@@ -51,6 +51,8 @@
 #define MAX_PACKET_RADIO_HEADERS 100
 #define MAX_PACKET_PAYLOAD 1250
 #define MAX_PACKET_TOTAL_SIZE 1500
+// Free space kept in front of packets so the radiotap and IEEE headers are written in place when sending them
+#define RADIO_PACKET_HEADROOM 64
 
 #define RADIO_PORT_ROUTER_UPLINK 0x0E     // from controller to vehicle
 #define RADIO_PORT_ROUTER_DOWNLINK 0x0F   // from vehicle to controller
@@ -192,7 +194,7 @@ typedef struct
 //        1 byte - segment size
 //        N bytes - segment data
 
-#define PACKET_TYPE_RUBY_PAIRING_REQUEST 7 // Sent by controller when it has link with vehicle for first time. So that vehicle has controller id. Has an optional u32 param after header: count of retires;
+#define PACKET_TYPE_RUBY_PAIRING_REQUEST 7 // Sent by controller when it has link with vehicle for first time. So that vehicle has controller id. Has an optional u32 param after header: count of retires; then an optional u32: controller software version (same format as the model sw_version);
 #define PACKET_TYPE_RUBY_PAIRING_CONFIRMATION 8 // Sent by vehicle to controller. Has an optional u32 param after header: count of received pairing requests;
 
 #define PACKET_TYPE_RUBY_RADIO_CONFIG_UPDATED 9 // Sent by vehicle to controller to let it know about the current radio config.
@@ -270,6 +272,35 @@ typedef struct
 
 #define PACKET_TYPE_VIDEO_DATA_98 22
 
+#define PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP 23
+// Compact retransmissions request, see video_nack.h. Params after header:
+//   u32: retransmission request id
+//   u8: video stream index
+//   u8: number of block entries
+//   u32: base video block index
+//   each block entry:
+//      u8: video block index delta from the base block index
+//      u8: number of consecutive video blocks with the same missing packets
+//      u8: bit 7: 0 - bitmap, 1 - ranges; bits 0..6: bitmap bytes or ranges count
+//      bitmap bytes (bit k is packet k) or ranges (u8 first packet index + u8 packets count)
+
+#define PACKET_TYPE_VIDEO_EC_RECOVERY_STATS 24
+// From controller to vehicle, periodically, when the active video profile uses an auto EC scheme.
+// Has a t_packet_data_video_ec_recovery_stats after the header. See radio/adaptive_fec.h
+
+#define VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE 8
+
+typedef struct
+{
+   u8 uVideoStreamIndex;
+   u16 uIntervalMs; // time covered by these stats
+   u8 uBlockDataPackets; // EC scheme of the last received video block
+   u8 uBlockECPackets;
+   u16 uBlocksOutput; // clean and reconstructed video blocks
+   u16 uBlocksLost; // video blocks skipped as they could not be reconstructed in time
+   u16 uBlocksECUsed[VIDEO_EC_RECOVERY_STATS_HISTOGRAM_SIZE]; // index k: blocks that needed k+1 EC packets; last one: that many or more
+} __attribute__((packed)) t_packet_data_video_ec_recovery_stats;
+
 #define VIDEO_STREAM_INFO_FLAG_NONE 0
 #define VIDEO_STREAM_INFO_FLAG_SIZE 1
 #define VIDEO_STREAM_INFO_FLAG_FPS 2
@@ -737,6 +768,25 @@ typedef struct
 // u32 - interface index;
 // shared_mem_radio_stats_interface_rx_hist structure
 
+#define PACKET_TYPE_RUBY_TELEMETRY_DELTA 49
+// Delta encoded periodic telemetry packet (see base/telemetry_delta.h). Has:
+// t_packet_header of the original packet (with this packet type and total length)
+// t_packet_header_telemetry_delta
+// keyframe: the original payload (all that was after the original t_packet_header)
+// delta: runs of bytes changed from the keyframe: u8 unchanged bytes to skip, u8 count of bytes, the bytes
+
+#define FLAG_TELEMETRY_DELTA_KEYFRAME ((u8)0x01)
+
+typedef struct
+{
+   u8 uPacketType; // type of the original packet
+   u8 uFlags;
+   u8 uSessionId; // changes when the vehicle encoder restarts
+   u16 uSequence; // incremented on each packet of this type
+   u16 uKeyframeSequence; // sequence of the keyframe the delta applies to
+   u16 uPayloadLength; // length of the original payload
+} __attribute__((packed)) t_packet_header_telemetry_delta;
+
 
 #define PACKET_TYPE_VEHICLE_RECORDING 50
 // Has extra info 8 bytes
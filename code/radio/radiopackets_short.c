@@ -82,3 +82,53 @@ int radio_buffer_is_valid_short_packet(u8* pBuffer, int iLength)
    }
    return 1;
 }
+
+// Splits a full radio packet into consecutive short packets, all built back to back into pOutBuffer,
+// so that they can be written to the serial port in a single (coalesced) write.
+// Returns the total number of bytes built in pOutBuffer, or -1 if the output buffer is too small.
+
+int radio_packets_short_build_frames(int iInterfaceIndex, u8* pData, int iLength, int iMaxShortPacketSize, u8* pOutBuffer, int iMaxOutLength)
+{
+   if ( (NULL == pData) || (iLength <= 0) || (NULL == pOutBuffer) )
+      return -1;
+
+   int iUsableDataBytesInEachPacket = iMaxShortPacketSize - (int)sizeof(t_packet_header_short);
+   if ( iUsableDataBytesInEachPacket <= 0 )
+      return -1;
+   if ( iUsableDataBytesInEachPacket > 255 )
+      iUsableDataBytesInEachPacket = 255;
+
+   int iCountFrames = (iLength + iUsableDataBytesInEachPacket - 1) / iUsableDataBytesInEachPacket;
+   if ( iLength + iCountFrames * (int)sizeof(t_packet_header_short) > iMaxOutLength )
+      return -1;
+
+   int iBytesLeftToSend = iLength;
+   u8* pDataToSend = pData;
+   u8* pOut = pOutBuffer;
+
+   while ( iBytesLeftToSend > 0 )
+   {
+      t_packet_header_short* pPHS = (t_packet_header_short*)pOut;
+      radio_packet_short_init(pPHS);
+
+      pPHS->start_header = SHORT_PACKET_START_BYTE_REG_PACKET;
+      if ( pData == pDataToSend )
+         pPHS->start_header = SHORT_PACKET_START_BYTE_START_PACKET;
+      if ( iBytesLeftToSend <= iUsableDataBytesInEachPacket )
+         pPHS->start_header = SHORT_PACKET_START_BYTE_END_PACKET;
+
+      int iShortPacketDataSize = iUsableDataBytesInEachPacket;
+      if ( iBytesLeftToSend <= iUsableDataBytesInEachPacket )
+         iShortPacketDataSize = iBytesLeftToSend;
+
+      pPHS->packet_id = radio_packets_short_get_next_id_for_radio_interface(iInterfaceIndex);
+      pPHS->data_length = (u8)iShortPacketDataSize;
+      memcpy(pOut + sizeof(t_packet_header_short), pDataToSend, iShortPacketDataSize);
+      pPHS->crc = base_compute_crc8(pOut + 2, iShortPacketDataSize + sizeof(t_packet_header_short) - 2);
+
+      iBytesLeftToSend -= iShortPacketDataSize;
+      pDataToSend += iShortPacketDataSize;
+      pOut += iShortPacketDataSize + sizeof(t_packet_header_short);
+   }
+   return (int)(pOut - pOutBuffer);
+}
@@ -25,6 +25,7 @@ void radio_packets_short_init();
 void radio_packet_short_init(t_packet_header_short* pPHS);
 u8 radio_packets_short_get_next_id_for_radio_interface(int iInterfaceIndex);
 int radio_buffer_is_valid_short_packet(u8* pBuffer, int iLength);
+int radio_packets_short_build_frames(int iInterfaceIndex, u8* pData, int iLength, int iMaxShortPacketSize, u8* pOutBuffer, int iMaxOutLength);
 #ifdef __cplusplus
 }  
 #endif
@@ -6,6 +6,7 @@
 typedef struct
 {
    u8  has_radio_header;
+   u8  headroom[RADIO_PACKET_HEADROOM]; // Radio headers are written here when the packet is sent
    u8  packet_buffer[MAX_PACKET_TOTAL_SIZE];
    u16 packet_length;
 } ALIGN_STRUCT_SPEC_INFO t_packet_queue_item;
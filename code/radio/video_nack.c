@@ -0,0 +1,211 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "video_nack.h"
+
+static int _video_nack_count_packets(const u8* pBitmap)
+{
+   int iCount = 0;
+   for( int i=0; i<VIDEO_NACK_BITMAP_BYTES; i++ )
+      iCount += __builtin_popcount(pBitmap[i]);
+   return iCount;
+}
+
+void video_nack_builder_init(t_video_nack_builder* pBuilder, u8* pBuffer, int iMaxLength, u32 uRequestId, u8 uVideoStreamIndex)
+{
+   if ( NULL == pBuilder )
+      return;
+   memset(pBuilder, 0, sizeof(t_video_nack_builder));
+   pBuilder->pBuffer = pBuffer;
+   pBuilder->iMaxLength = iMaxLength;
+   pBuilder->iLength = VIDEO_NACK_HEADER_SIZE;
+   pBuilder->iLastEntryOffset = -1;
+   if ( (NULL == pBuffer) || (iMaxLength < (int)VIDEO_NACK_HEADER_SIZE) )
+      return;
+   memcpy(pBuffer, &uRequestId, sizeof(u32));
+   pBuffer[sizeof(u32)] = uVideoStreamIndex;
+   pBuffer[sizeof(u32) + sizeof(u8)] = 0;
+   memset(pBuffer + sizeof(u32) + 2*sizeof(u8), 0, sizeof(u32));
+}
+
+int video_nack_builder_add_block(t_video_nack_builder* pBuilder, u32 uVideoBlockIndex, const u8* pMissingBitmap)
+{
+   if ( (NULL == pBuilder) || (NULL == pBuilder->pBuffer) || (NULL == pMissingBitmap) )
+      return 0;
+
+   int iCountPackets = _video_nack_count_packets(pMissingBitmap);
+   if ( 0 == iCountPackets )
+      return 1;
+
+   if ( 0 == pBuilder->iCountEntries )
+   {
+      pBuilder->uBaseVideoBlockIndex = uVideoBlockIndex;
+      memcpy(pBuilder->pBuffer + sizeof(u32) + 2*sizeof(u8), &uVideoBlockIndex, sizeof(u32));
+   }
+   if ( (uVideoBlockIndex < pBuilder->uBaseVideoBlockIndex) || (uVideoBlockIndex - pBuilder->uBaseVideoBlockIndex > VIDEO_NACK_MAX_BLOCK_DELTA) )
+      return 0;
+
+   // Same missing packets as the previous block: extend the previous entry
+   if ( pBuilder->iLastEntryOffset >= 0 )
+   if ( uVideoBlockIndex == pBuilder->uLastVideoBlockIndex + 1 )
+   if ( pBuilder->pBuffer[pBuilder->iLastEntryOffset + 1] < 255 )
+   if ( 0 == memcmp(pMissingBitmap, pBuilder->uLastBitmap, VIDEO_NACK_BITMAP_BYTES) )
+   {
+      pBuilder->pBuffer[pBuilder->iLastEntryOffset + 1]++;
+      pBuilder->uLastVideoBlockIndex = uVideoBlockIndex;
+      pBuilder->iCountPackets += iCountPackets;
+      return 1;
+   }
+
+   if ( pBuilder->iCountEntries >= 255 )
+      return 0;
+
+   int iBitmapBytes = VIDEO_NACK_BITMAP_BYTES;
+   while ( (iBitmapBytes > 0) && (0 == pMissingBitmap[iBitmapBytes-1]) )
+      iBitmapBytes--;
+
+   int iCountRanges = 0;
+   for( int i=0; i<VIDEO_NACK_MAX_PACKETS_IN_BLOCK; i++ )
+   {
+      if ( video_nack_is_packet_missing(pMissingBitmap, i) )
+      if ( (0 == i) || (! video_nack_is_packet_missing(pMissingBitmap, i-1)) )
+         iCountRanges++;
+   }
+
+   int bUseRanges = (2*iCountRanges < iBitmapBytes)?1:0;
+   int iEntryLength = 3 + (bUseRanges?(2*iCountRanges):iBitmapBytes);
+   if ( pBuilder->iLength + iEntryLength > pBuilder->iMaxLength )
+      return 0;
+
+   u8* pEntry = pBuilder->pBuffer + pBuilder->iLength;
+   pEntry[0] = (u8)(uVideoBlockIndex - pBuilder->uBaseVideoBlockIndex);
+   pEntry[1] = 1;
+   if ( bUseRanges )
+   {
+      pEntry[2] = VIDEO_NACK_FLAG_RANGES | (u8)iCountRanges;
+      u8* pRange = pEntry + 3;
+      int i = 0;
+      while ( i < VIDEO_NACK_MAX_PACKETS_IN_BLOCK )
+      {
+         if ( ! video_nack_is_packet_missing(pMissingBitmap, i) )
+         {
+            i++;
+            continue;
+         }
+         int iStart = i;
+         while ( (i < VIDEO_NACK_MAX_PACKETS_IN_BLOCK) && video_nack_is_packet_missing(pMissingBitmap, i) )
+            i++;
+         pRange[0] = (u8)iStart;
+         pRange[1] = (u8)(i - iStart);
+         pRange += 2;
+      }
+   }
+   else
+   {
+      pEntry[2] = (u8)iBitmapBytes;
+      memcpy(pEntry + 3, pMissingBitmap, iBitmapBytes);
+   }
+
+   pBuilder->iLastEntryOffset = pBuilder->iLength;
+   pBuilder->iLength += iEntryLength;
+   pBuilder->uLastVideoBlockIndex = uVideoBlockIndex;
+   memcpy(pBuilder->uLastBitmap, pMissingBitmap, VIDEO_NACK_BITMAP_BYTES);
+   pBuilder->iCountEntries++;
+   pBuilder->iCountPackets += iCountPackets;
+   pBuilder->pBuffer[sizeof(u32) + sizeof(u8)] = (u8)pBuilder->iCountEntries;
+   return 1;
+}
+
+int video_nack_builder_get_length(t_video_nack_builder* pBuilder)
+{
+   if ( (NULL == pBuilder) || (0 == pBuilder->iCountEntries) )
+      return 0;
+   return pBuilder->iLength;
+}
+
+int video_nack_parse(const u8* pData, int iLength, video_nack_block_callback pCallback, void* pContext)
+{
+   if ( (NULL == pData) || (iLength < (int)VIDEO_NACK_HEADER_SIZE) )
+      return -1;
+
+   u32 uRequestId = 0;
+   u32 uBaseVideoBlockIndex = 0;
+   memcpy(&uRequestId, pData, sizeof(u32));
+   int iCountEntries = pData[sizeof(u32) + sizeof(u8)];
+   memcpy(&uBaseVideoBlockIndex, pData + sizeof(u32) + 2*sizeof(u8), sizeof(u32));
+
+   const u8* pEntry = pData + VIDEO_NACK_HEADER_SIZE;
+   const u8* pEnd = pData + iLength;
+   int iCountPackets = 0;
+   u8 uBitmap[VIDEO_NACK_BITMAP_BYTES];
+
+   for( int i=0; i<iCountEntries; i++ )
+   {
+      if ( pEntry + 3 > pEnd )
+         return -1;
+      u32 uVideoBlockIndex = uBaseVideoBlockIndex + pEntry[0];
+      int iCountBlocks = pEntry[1];
+      int iCount = pEntry[2] & (~VIDEO_NACK_FLAG_RANGES);
+      pEntry += 3;
+
+      memset(uBitmap, 0, VIDEO_NACK_BITMAP_BYTES);
+      if ( pEntry[-1] & VIDEO_NACK_FLAG_RANGES )
+      {
+         if ( pEntry + 2*iCount > pEnd )
+            return -1;
+         for( int k=0; k<iCount; k++ )
+         {
+            int iStart = pEntry[0];
+            int iEnd = iStart + pEntry[1];
+            pEntry += 2;
+            if ( iEnd > VIDEO_NACK_MAX_PACKETS_IN_BLOCK )
+               return -1;
+            for( int p=iStart; p<iEnd; p++ )
+               video_nack_set_packet_missing(uBitmap, p);
+         }
+      }
+      else
+      {
+         if ( (iCount > VIDEO_NACK_BITMAP_BYTES) || (pEntry + iCount > pEnd) )
+            return -1;
+         memcpy(uBitmap, pEntry, iCount);
+         pEntry += iCount;
+      }
+
+      iCountPackets += iCountBlocks * _video_nack_count_packets(uBitmap);
+      if ( NULL != pCallback )
+      {
+         for( int k=0; k<iCountBlocks; k++ )
+            pCallback(uRequestId, uVideoBlockIndex + k, uBitmap, pContext);
+      }
+   }
+   return iCountPackets;
+}
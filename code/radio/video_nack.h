@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../base/base.h"
+#include "radiopackets2.h"
+
+// Builds and parses PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP retransmission requests.
+// Each requested video block is encoded either as a bitmap of its missing packets or as a list of
+// missing packets ranges (whichever is smaller); consecutive video blocks missing the same packets
+// share one entry. Blocks are added in the order they will be displayed (oldest first), so when the
+// request is full, the blocks with the latest display deadline are the ones left out.
+
+// Same on all platforms, so that controllers and vehicles with different block sizes understand each other
+#define VIDEO_NACK_MAX_PACKETS_IN_BLOCK 64
+#define VIDEO_NACK_BITMAP_BYTES (VIDEO_NACK_MAX_PACKETS_IN_BLOCK/8)
+#define VIDEO_NACK_HEADER_SIZE (sizeof(u32) + 2*sizeof(u8) + sizeof(u32))
+#define VIDEO_NACK_FLAG_RANGES 0x80
+#define VIDEO_NACK_MAX_BLOCK_DELTA 255
+// First vehicle software build that handles PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS_BITMAP
+#define VIDEO_NACK_MIN_SW_BUILD 255
+
+#define video_nack_is_packet_missing(pBitmap, iPacketIndex) (((pBitmap)[(iPacketIndex)>>3] >> ((iPacketIndex) & 0x07)) & 0x01)
+#define video_nack_set_packet_missing(pBitmap, iPacketIndex) (pBitmap)[(iPacketIndex)>>3] |= (u8)(1 << ((iPacketIndex) & 0x07))
+
+typedef struct
+{
+   u8* pBuffer;
+   int iMaxLength;
+   int iLength;
+   int iCountEntries;
+   int iCountPackets;
+   u32 uBaseVideoBlockIndex;
+   int iLastEntryOffset;
+   u32 uLastVideoBlockIndex;
+   u8 uLastBitmap[VIDEO_NACK_BITMAP_BYTES];
+} t_video_nack_builder;
+
+// Called for each requested video block; pMissingBitmap has VIDEO_NACK_BITMAP_BYTES bytes
+typedef void (*video_nack_block_callback)(u32 uRequestId, u32 uVideoBlockIndex, const u8* pMissingBitmap, void* pContext);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// pBuffer is the packet data after the packet header
+void video_nack_builder_init(t_video_nack_builder* pBuilder, u8* pBuffer, int iMaxLength, u32 uRequestId, u8 uVideoStreamIndex);
+// Video blocks must be added in increasing order. Returns 0 if the block does not fit in the request.
+int video_nack_builder_add_block(t_video_nack_builder* pBuilder, u32 uVideoBlockIndex, const u8* pMissingBitmap);
+// Returns the request data length (0 if no block was added)
+int video_nack_builder_get_length(t_video_nack_builder* pBuilder);
+
+// Returns the number of requested packets, or -1 if the request is invalid
+int video_nack_parse(const u8* pData, int iLength, video_nack_block_callback pCallback, void* pContext);
+
+#ifdef __cplusplus
+}
+#endif